@@ -717,6 +717,30 @@ NBVAR(bput, 7, EightByteInt, integer, int8, `:,:,:,:,:,:,:', INTENTV)
      nf90mpi_cancel = nfmpi_cancel(ncid, num, req, st)
    end function nf90mpi_cancel
 
+   function nf90mpi_wait_start(ncid, num, req, st)
+     integer,               intent(in)    :: ncid, num
+     integer, dimension(:), intent(inout) :: req
+     integer, dimension(:), intent(out)   :: st
+     integer                              :: nf90mpi_wait_start
+
+     nf90mpi_wait_start = nfmpi_wait_start(ncid, num, req, st)
+   end function nf90mpi_wait_start
+
+   function nf90mpi_wait_test(ncid, flag)
+     integer, intent( in) :: ncid
+     integer, intent(out) :: flag
+     integer              :: nf90mpi_wait_test
+
+     nf90mpi_wait_test = nfmpi_wait_test(ncid, flag)
+   end function nf90mpi_wait_test
+
+   function nf90mpi_wait_end(ncid)
+     integer, intent(in) :: ncid
+     integer             :: nf90mpi_wait_end
+
+     nf90mpi_wait_end = nfmpi_wait_end(ncid)
+   end function nf90mpi_wait_end
+
    function nf90mpi_buffer_attach(ncid, bufsize)
      integer,                        intent( in) :: ncid
      integer (kind=MPI_OFFSET_KIND), intent( in) :: bufsize
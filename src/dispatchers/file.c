@@ -23,9 +23,17 @@
 
 /* TODO: the following 3 global variables make PnetCDF not thread safe */
 
-/* static variables are initialized to NULLs */
-static PNC *pnc_filelist[NC_MAX_NFILES];
-static int  pnc_numfiles;
+/* The table of opened files, indexed by ncid, grows on demand and is freed
+ * when the last file is closed. The IDs of its unused elements are kept in
+ * a min-heap, pnc_free_ids, so getting the smallest unused ID does not scan
+ * the table. Static variables are initialized to NULLs.
+ */
+#define PNC_FILELIST_INIT_LEN 64
+static PNC **pnc_filelist;
+static int  *pnc_free_ids;
+static int   pnc_filelist_len;
+static int   pnc_num_free_ids;
+static int   pnc_numfiles;
 
 /* This is the default create format for ncmpi_create and nc__create.
  * The use of this file scope variable is not thread-safe.
@@ -40,26 +48,96 @@ static int ncmpi_default_create_format = NC_FORMAT_CLASSIC;
         printf("%s error at line %d file %s (%s)\n", func, __LINE__, __FILE__, errorString); \
     }
 
+/*----< grow_PNCList() >-----------------------------------------------------*/
+/* double the length of the PNC list and add the IDs of the new elements to
+ * the heap of unused IDs */
+static int
+grow_PNCList(void)
+{
+    int i, len;
+    void *ptr;
+
+    len = (pnc_filelist_len == 0) ? PNC_FILELIST_INIT_LEN
+                                  : pnc_filelist_len * 2;
+    if (len < 0) /* Too many files open */
+        DEBUG_RETURN_ERROR(NC_ENFILE)
+
+    ptr = NCI_Realloc(pnc_filelist, (size_t)len * sizeof(PNC*));
+    if (ptr == NULL) DEBUG_RETURN_ERROR(NC_ENOMEM)
+    pnc_filelist = (PNC**)ptr;
+
+    ptr = NCI_Realloc(pnc_free_ids, (size_t)len * SIZEOF_INT);
+    if (ptr == NULL) DEBUG_RETURN_ERROR(NC_ENOMEM)
+    pnc_free_ids = (int*)ptr;
+
+    /* the heap is empty when the list is full. IDs in increasing order form
+     * a valid min-heap */
+    assert(pnc_num_free_ids == 0);
+    for (i=pnc_filelist_len; i<len; i++) {
+        pnc_filelist[i] = NULL;
+        pnc_free_ids[pnc_num_free_ids++] = i;
+    }
+    pnc_filelist_len = len;
+
+    return NC_NOERR;
+}
+
 /*----< new_id_PNCList() >---------------------------------------------------*/
-/* get a new ID from the PNC list */
+/* get a new ID from the PNC list. The ID is reserved until it is passed to
+ * add_to_PNCList() or free_id_PNCList(). Unused IDs are kept in a binary
+ * min-heap, so the smallest one is always used first, as when the list was
+ * searched linearly. */
 static int
 new_id_PNCList(int *new_id)
 {
-    int i;
+    int i, child, last;
 
     *new_id = -1;
-    for (i=0; i<NC_MAX_NFILES; i++) { /* find the first unused element */
-        if (pnc_filelist[i] == NULL) {
-            *new_id = i;
-            break;
-        }
+    if (pnc_num_free_ids == 0) {
+        int err = grow_PNCList();
+        if (err != NC_NOERR) return err;
     }
-    if (*new_id == -1) /* Too many files open */
-        DEBUG_RETURN_ERROR(NC_ENFILE)
+    *new_id = pnc_free_ids[0];
+
+    /* move the last ID to the root and sift it down */
+    last = pnc_free_ids[--pnc_num_free_ids];
+    for (i=0; (child = 2*i+1) < pnc_num_free_ids; i=child) {
+        if (child+1 < pnc_num_free_ids &&
+            pnc_free_ids[child+1] < pnc_free_ids[child]) child++;
+        if (last <= pnc_free_ids[child]) break;
+        pnc_free_ids[i] = pnc_free_ids[child];
+    }
+    pnc_free_ids[i] = last;
 
     return NC_NOERR;
 }
 
+/*----< free_id_PNCList() >--------------------------------------------------*/
+/* return an ID obtained from new_id_PNCList() to the heap of unused IDs, and
+ * free the list when no file is opened */
+static void
+free_id_PNCList(int ncid)
+{
+    int i, parent;
+
+    /* sift the ID up from the end of the heap */
+    for (i=pnc_num_free_ids++; i>0; i=parent) {
+        parent = (i-1)/2;
+        if (pnc_free_ids[parent] <= ncid) break;
+        pnc_free_ids[i] = pnc_free_ids[parent];
+    }
+    pnc_free_ids[i] = ncid;
+
+    if (pnc_num_free_ids == pnc_filelist_len) {
+        NCI_Free(pnc_filelist);
+        NCI_Free(pnc_free_ids);
+        pnc_filelist     = NULL;
+        pnc_free_ids     = NULL;
+        pnc_filelist_len = 0;
+        pnc_num_free_ids = 0;
+    }
+}
+
 /*----< add_to_PNCList() >---------------------------------------------------*/
 static int
 add_to_PNCList(PNC *pncp,
@@ -68,7 +146,7 @@ add_to_PNCList(PNC *pncp,
     /* these checks below are redundant */
     assert(pncp != NULL);
     assert(new_id >= 0);
-    if (new_id >= NC_MAX_NFILES) return NC_ENFILE;
+    if (new_id >= pnc_filelist_len) return NC_ENFILE;
 
     pnc_filelist[new_id] = pncp;  /* store the pointer */
     pnc_numfiles++;               /* increment number of files opened */
@@ -82,6 +160,7 @@ del_from_PNCList(int ncid)
     /* validity of ncid should have been checked already */
     pnc_filelist[ncid] = NULL;
     pnc_numfiles--;
+    free_id_PNCList(ncid);
 }
 
 #if 0 /* refer to netCDF library's USE_REFCOUNT */
@@ -90,7 +169,7 @@ find_in_PNCList_by_name(const char* path)
 {
     int i;
     PNC* pncp = NULL;
-    for (i=0; i<NC_MAX_NFILES; i++) {
+    for (i=0; i<pnc_filelist_len; i++) {
          if (pnc_filelist[i] == NULL) continue;
          if (strcmp(pnc_filelist[i]->path, path) == 0) {
              pncp = pnc_filelist[i];
@@ -107,7 +186,8 @@ PNC_check_id(int ncid, PNC **pncp)
 {
     assert(pncp != NULL);
 
-    if (pnc_numfiles == 0 || ncid < 0 || ncid >= NC_MAX_NFILES)
+    if (pnc_numfiles == 0 || ncid < 0 || ncid >= pnc_filelist_len ||
+        pnc_filelist[ncid] == NULL)
         DEBUG_RETURN_ERROR(NC_EBADID)
 
     *pncp = pnc_filelist[ncid];
@@ -333,6 +413,7 @@ ncmpi_create(MPI_Comm    comm,
     if (status == NC_NOERR) status = err;
     if (combined_info != MPI_INFO_NULL) MPI_Info_free(&combined_info);
     if (status != NC_NOERR && status != NC_EMULTIDEFINE_CMODE) {
+        free_id_PNCList(*ncidp);
         *ncidp = -1;
         return status;
     }
@@ -341,12 +422,14 @@ ncmpi_create(MPI_Comm    comm,
     pncp = (PNC*) NCI_Malloc(sizeof(PNC));
     if (pncp == NULL) {
         driver->close(ncp); /* close file and ignore error */
+        free_id_PNCList(*ncidp);
         *ncidp = -1;
         DEBUG_RETURN_ERROR(NC_ENOMEM)
     }
     pncp->path = (char*) NCI_Malloc(strlen(path)+1);
     if (pncp->path == NULL) {
         driver->close(ncp); /* close file and ignore error */
+        free_id_PNCList(*ncidp);
         *ncidp = -1;
         NCI_Free(pncp);
         DEBUG_RETURN_ERROR(NC_ENOMEM)
@@ -384,6 +467,7 @@ ncmpi_create(MPI_Comm    comm,
     err = add_to_PNCList(pncp, *ncidp);
     if (err != NC_NOERR) {
         driver->close(ncp); /* close file and ignore error */
+        free_id_PNCList(*ncidp);
         *ncidp = -1;
         MPI_Comm_free(&pncp->comm);
         NCI_Free(pncp->path);
@@ -535,6 +619,7 @@ ncmpi_open(MPI_Comm    comm,
         status != NC_ENULLPAD) {
         /* NC_EMULTIDEFINE_OMODE and NC_ENULLPAD are not fatal error. We
          * continue the rest open procedure */
+        free_id_PNCList(*ncidp);
         *ncidp = -1;
         return status;
     }
@@ -543,12 +628,14 @@ ncmpi_open(MPI_Comm    comm,
     pncp = (PNC*) NCI_Malloc(sizeof(PNC));
     if (pncp == NULL) {
         driver->close(ncp); /* close file and ignore error */
+        free_id_PNCList(*ncidp);
         *ncidp = -1;
         DEBUG_RETURN_ERROR(NC_ENOMEM)
     }
     pncp->path = (char*) NCI_Malloc(strlen(path)+1);
     if (pncp->path == NULL) {
         driver->close(ncp); /* close file and ignore error */
+        free_id_PNCList(*ncidp);
         *ncidp = -1;
         NCI_Free(pncp);
         DEBUG_RETURN_ERROR(NC_ENOMEM)
@@ -588,7 +675,8 @@ ncmpi_open(MPI_Comm    comm,
 
     /* allocate chunk size for pncp->vars[] */
     nalloc = _RNDUP(pncp->nvars, PNC_VARS_CHUNK);
-    pncp->vars = NCI_Malloc(nalloc * sizeof(PNC_var));
+    /* zero-initialized, so shape is NULL for variables not yet visited */
+    pncp->vars = NCI_Calloc(nalloc, sizeof(PNC_var));
     if (pncp->vars == NULL) {
         DEBUG_ASSIGN_ERROR(err, NC_ENOMEM)
         goto fn_exit;
@@ -600,7 +688,7 @@ ncmpi_open(MPI_Comm    comm,
         int ndims;
         err = driver->inq_var(pncp->ncp, i, NULL, &xtype, &ndims,
                               NULL, NULL, NULL, NULL, NULL);
-        if (err != NC_NOERR) return err;
+        if (err != NC_NOERR) goto fn_exit;
         pncp->vars[i].xtype  = xtype;
         pncp->vars[i].ndims  = ndims;
         pncp->vars[i].recdim = -1;   /* if fixed-size variable */
@@ -612,25 +700,37 @@ ncmpi_open(MPI_Comm    comm,
             dimids = (int*) NCI_Malloc(ndims * SIZEOF_INT);
             err = driver->inq_var(pncp->ncp, i, NULL, NULL, NULL,
                                   dimids, NULL, NULL, NULL, NULL);
-            if (err != NC_NOERR) goto fn_exit;
+            if (err != NC_NOERR) {
+                NCI_Free(dimids);
+                goto fn_exit;
+            }
             if (dimids[0] == pncp->unlimdimid)
                 pncp->vars[i].recdim = pncp->unlimdimid;
             for (j=0; j<ndims; j++) {
                 /* obtain size of dimension j */
                 err = driver->inq_dim(pncp->ncp, dimids[j], NULL,
                                       pncp->vars[i].shape+j);
-                if (err != NC_NOERR) goto fn_exit;
+                if (err != NC_NOERR) break;
             }
             NCI_Free(dimids);
+            if (err != NC_NOERR) goto fn_exit;
         }
     }
 
 fn_exit:
     if (err != NC_NOERR) {
         driver->close(ncp); /* close file and ignore error */
+        if (pnc_filelist[*ncidp] == pncp) del_from_PNCList(*ncidp);
+        else                              free_id_PNCList(*ncidp);
         *ncidp = -1;
         MPI_Comm_free(&pncp->comm);
         NCI_Free(pncp->path);
+        if (pncp->vars != NULL) {
+            for (i=0; i<pncp->nvars; i++)
+                if (pncp->vars[i].shape != NULL)
+                    NCI_Free(pncp->vars[i].shape);
+            NCI_Free(pncp->vars);
+        }
         NCI_Free(pncp);
         if (status == NC_NOERR) status = err;
     }
@@ -1222,6 +1322,80 @@ ncmpi_inq_get_size(int ncid, MPI_Offset *get_size)
                                   get_size, NULL, NULL, NULL, NULL);
 }
 
+/*----< ncmpi_inq_stats() >--------------------------------------------------*/
+/* This is an independent subroutine. Arguments put_counts, put_bytes,
+ * get_counts, and get_bytes are arrays of NC_STATS_NUM_APIS elements, and
+ * timings is an array of NC_STATS_NUM_TIMERS elements. Any of them can be
+ * NULL. All are zeros, unless hint nc_stats is enabled.
+ */
+int
+ncmpi_inq_stats(int         ncid,
+                MPI_Offset *put_counts,
+                MPI_Offset *put_bytes,
+                MPI_Offset *get_counts,
+                MPI_Offset *get_bytes,
+                double     *timings)
+{
+    int err;
+    PNC *pncp;
+
+    /* check if ncid is valid */
+    err = PNC_check_id(ncid, &pncp);
+    if (err != NC_NOERR) return err;
+
+    /* calling the subroutine that implements ncmpi_inq_stats() */
+    return pncp->driver->inq_stats(pncp->ncp, put_counts, put_bytes,
+                                   get_counts, get_bytes, timings);
+}
+
+/*----< ncmpi_inq_var_stats() >----------------------------------------------*/
+/* This is an independent subroutine. Arguments put_hist and get_hist are
+ * arrays of NC_STATS_HIST_BINS elements and either can be NULL.
+ */
+int
+ncmpi_inq_var_stats(int         ncid,
+                    int         varid,
+                    MPI_Offset *put_hist,
+                    MPI_Offset *get_hist)
+{
+    int err;
+    PNC *pncp;
+
+    /* check if ncid is valid */
+    err = PNC_check_id(ncid, &pncp);
+    if (err != NC_NOERR) return err;
+
+    /* check whether variable ID is valid */
+    if (varid < 0 || varid >= pncp->nvars) DEBUG_RETURN_ERROR(NC_ENOTVAR)
+
+    /* calling the subroutine that implements ncmpi_inq_var_stats() */
+    return pncp->driver->inq_var_stats(pncp->ncp, varid, put_hist, get_hist);
+}
+
+/*----< ncmpi_inq_buf_pool_stats() >-----------------------------------------*/
+/* This is an independent subroutine. It reports the number of temporary
+ * buffers reused from and newly allocated by the buffer pool of file ncid,
+ * and the high water mark of memory held by the pool. Any of the arguments
+ * other than ncid can be NULL.
+ */
+int
+ncmpi_inq_buf_pool_stats(int         ncid,
+                         MPI_Offset *hits,
+                         MPI_Offset *misses,
+                         MPI_Offset *max_size)
+{
+    int err;
+    PNC *pncp;
+
+    /* check if ncid is valid */
+    err = PNC_check_id(ncid, &pncp);
+    if (err != NC_NOERR) return err;
+
+    /* calling the subroutine that implements ncmpi_inq_buf_pool_stats() */
+    return pncp->driver->inq_buf_pool_stats(pncp->ncp, hits, misses,
+                                            max_size);
+}
+
 /*----< ncmpi_inq_file_info() >----------------------------------------------*/
 /* This is an independent subroutine. */
 int
@@ -1361,7 +1535,7 @@ ncmpi_inq_files_opened(int *num,    /* cannot be NULL */
 
     if (ncids != NULL) { /* ncids can be NULL */
         *num = 0;
-        for (i=0; i<NC_MAX_NFILES; i++) {
+        for (i=0; i<pnc_filelist_len; i++) {
             if (pnc_filelist[i] != NULL) {
                 ncids[*num] = i;
                 (*num)++;
@@ -1550,3 +1724,153 @@ ncmpi_cancel(int  ncid,
     return pncp->driver->cancel(pncp->ncp, num_reqs, req_ids, statuses);
 }
 
+/*----< ncmpi_wait_start() >-------------------------------------------------*/
+/* This API is a collective subroutine and must be called in collective data
+ * mode. It starts a split-phase wait of the nonblocking requests, whose I/O
+ * may still be in progress when this API returns. The requests, their
+ * buffers, and array statuses must not be accessed until ncmpi_wait_end() is
+ * called. No other API accessing the file can be called in between, except
+ * ncmpi_wait_test() and the ones posting new nonblocking requests. Errors of
+ * the requests are returned by ncmpi_wait_end().
+ */
+int
+ncmpi_wait_start(int  ncid,
+                 int  num_reqs, /* number of requests */
+                 int *req_ids,  /* [num_reqs]: IN/OUT */
+                 int *statuses) /* [num_reqs], can be NULL */
+{
+    int err;
+    PNC *pncp;
+
+    /* check if ncid is valid.
+     * For invalid ncid, we must return error now, as there is no way to
+     * continue with invalid ncp. However, collective APIs might hang if this
+     * error occurs only on a subset of processes
+     */
+    err = PNC_check_id(ncid, &pncp);
+    if (err != NC_NOERR) return err;
+
+    /* must be called in collective data mode */
+    if (pncp->flag & NC_MODE_DEF) DEBUG_RETURN_ERROR(NC_EINDEFINE)
+    if (pncp->flag & NC_MODE_INDEP) DEBUG_RETURN_ERROR(NC_EINDEP)
+
+    /* calling the subroutine that implements ncmpi_wait_start() */
+    return pncp->driver->wait_start(pncp->ncp, num_reqs, req_ids, statuses);
+}
+
+/*----< ncmpi_wait_test() >--------------------------------------------------*/
+/* This API is an independent subroutine. It sets flag to 1 if the I/O of the
+ * split-phase wait has completed, 0 otherwise.
+ */
+int
+ncmpi_wait_test(int  ncid,
+                int *flag)
+{
+    int err;
+    PNC *pncp;
+
+    /* check if ncid is valid. */
+    err = PNC_check_id(ncid, &pncp);
+    if (err != NC_NOERR) return err;
+
+    if (flag == NULL) DEBUG_RETURN_ERROR(NC_EINVAL)
+
+    /* calling the subroutine that implements ncmpi_wait_test() */
+    return pncp->driver->wait_test(pncp->ncp, flag);
+}
+
+/*----< ncmpi_wait_end() >---------------------------------------------------*/
+/* This API is a collective subroutine. It completes the split-phase wait
+ * started by ncmpi_wait_start().
+ */
+int
+ncmpi_wait_end(int ncid)
+{
+    int err;
+    PNC *pncp;
+
+    /* check if ncid is valid.
+     * For invalid ncid, we must return error now, as there is no way to
+     * continue with invalid ncp. However, collective APIs might hang if this
+     * error occurs only on a subset of processes
+     */
+    err = PNC_check_id(ncid, &pncp);
+    if (err != NC_NOERR) return err;
+
+    /* calling the subroutine that implements ncmpi_wait_end() */
+    return pncp->driver->wait_end(pncp->ncp);
+}
+
+/*----< ncmpi_start() >------------------------------------------------------*/
+/* This API is an independent subroutine and must be called in independent
+ * data mode. It starts a persistent request created by ncmpi_put_vara_init()
+ * or ncmpi_get_vara_init() and returns when it completes. For a record
+ * variable, recno replaces start[0] given at the request creation, unless it
+ * is negative.
+ */
+int
+ncmpi_start(int        ncid,
+            int        request,
+            MPI_Offset recno)
+{
+    int err;
+    PNC *pncp;
+
+    /* check if ncid is valid. */
+    err = PNC_check_id(ncid, &pncp);
+    if (err != NC_NOERR) return err;
+
+    /* must be called in independent data mode */
+    if (pncp->flag & NC_MODE_DEF) DEBUG_RETURN_ERROR(NC_EINDEFINE)
+    if (!(pncp->flag & NC_MODE_INDEP)) DEBUG_RETURN_ERROR(NC_ENOTINDEP)
+
+    /* calling the subroutine that implements ncmpi_start() */
+    return pncp->driver->start(pncp->ncp, request, recno, NC_REQ_INDEP);
+}
+
+/*----< ncmpi_start_all() >--------------------------------------------------*/
+/* This API is a collective subroutine and must be called in collective data
+ * mode. All processes must start a valid persistent request. A process with
+ * nothing to access creates its request with zero counts.
+ */
+int
+ncmpi_start_all(int        ncid,
+                int        request,
+                MPI_Offset recno)
+{
+    int err;
+    PNC *pncp;
+
+    /* check if ncid is valid.
+     * For invalid ncid, we must return error now, as there is no way to
+     * continue with invalid ncp. However, collective APIs might hang if this
+     * error occurs only on a subset of processes
+     */
+    err = PNC_check_id(ncid, &pncp);
+    if (err != NC_NOERR) return err;
+
+    /* must be called in collective data mode */
+    if (pncp->flag & NC_MODE_DEF) DEBUG_RETURN_ERROR(NC_EINDEFINE)
+    if (pncp->flag & NC_MODE_INDEP) DEBUG_RETURN_ERROR(NC_EINDEP)
+
+    /* calling the subroutine that implements ncmpi_start_all() */
+    return pncp->driver->start(pncp->ncp, request, recno, NC_REQ_COLL);
+}
+
+/*----< ncmpi_request_free() >-----------------------------------------------*/
+/* This API is an independent subroutine. */
+int
+ncmpi_request_free(int ncid,
+                   int request)
+{
+    int err;
+    PNC *pncp;
+
+    /* check if ncid is valid. */
+    err = PNC_check_id(ncid, &pncp);
+    if (err != NC_NOERR) return err;
+
+    /* calling the subroutine that implements ncmpi_request_free() */
+    return pncp->driver->request_free(pncp->ncp, request);
+}
+
@@ -796,3 +796,118 @@ foreach(`putget', (put, get),
                  `VARD(putget,collindep)'
 )')dnl
 dnl
+dnl IVARD(iget/iput/bput)
+dnl
+define(`IVARD',dnl
+`dnl
+/*----< ncmpi_$1_vard() >---------------------------------------------------*/
+/* This API is an independent subroutine, which can be called in either
+ * collective or independent data mode or even in define mode.
+ */
+int
+ncmpi_$1_vard(int           ncid,
+              int           varid,
+              MPI_Datatype  filetype,  /* access layout to the variable in file */
+              ifelse($1, `iget', `void *buf', `const void *buf'),
+              MPI_Offset    bufcount,
+              MPI_Datatype  buftype,   /* data type of the buffer */
+              int          *reqid)
+{
+    int err, reqMode;
+    PNC *pncp;
+
+    /* check if ncid is valid.
+     * For invalid ncid, we must return error now, as there is no way to
+     * continue with invalid ncp. However, collective APIs might hang if this
+     * error occurs only on a subset of processes
+     */
+    err = PNC_check_id(ncid, &pncp);
+    if (err != NC_NOERR) return err;
+
+    if (reqid != NULL) *reqid = NC_REQ_NULL;
+
+    err = sanity_check(pncp, varid, IO_TYPE($1), MPI_DATATYPE_NULL, 0);
+    if (err != NC_NOERR) return err;
+
+    ifelse(`$1',`bput',`/* check if buffer has been attached */
+    MPI_Offset buf_size;
+    err = pncp->driver->inq_misc(pncp->ncp, NULL, NULL, NULL, NULL,
+                                 NULL, NULL, NULL, NULL, NULL, NULL,
+                                 NULL, NULL, NULL, NULL, &buf_size);
+    if (err != NC_NOERR) return err;')
+
+    if (bufcount == 0) return NC_NOERR;
+
+    reqMode = IO_MODE($1) | NB_MODE($1) | NC_REQ_FLEX;
+
+    /* calling the subroutine that implements ncmpi_$1_vard() */
+    return pncp->driver->$1_vard(pncp->ncp, varid, filetype, buf, bufcount,
+                                 buftype, reqid, reqMode);
+}
+')
+dnl
+foreach(`putget', (iget, iput, bput),
+        `IVARD(putget)'
+)dnl
+dnl
+dnl
+dnl VARA_INIT(get/put)
+dnl
+define(`VARA_INIT',dnl
+`dnl
+/*----< ncmpi_$1_vara_init() >-----------------------------------------------*/
+/* This API is an independent subroutine and must be called in data mode. It
+ * creates a persistent request to ifelse(`$1',`put',`write',`read') the subarray start/count of a
+ * variable ifelse(`$1',`put',`from',`to') buf, without starting it. The request can be started
+ * repeatedly by ncmpi_start() or ncmpi_start_all(), each time for a
+ * different record if the variable is a record variable, until it is freed by
+ * ncmpi_request_free(). buf must not be freed before then.
+ */
+int
+ncmpi_$1_vara_init(int               ncid,
+                   int               varid,
+                   const MPI_Offset *start,
+                   const MPI_Offset *count,
+                   ifelse($1, `get', `void *buf', `const void *buf'),
+                   MPI_Offset        bufcount,
+                   MPI_Datatype      buftype,
+                   int              *request)
+{
+    int err;
+    PNC *pncp;
+
+    /* check if ncid is valid.
+     * For invalid ncid, we must return error now, as there is no way to
+     * continue with invalid ncp. However, collective APIs might hang if this
+     * error occurs only on a subset of processes
+     */
+    err = PNC_check_id(ncid, &pncp);
+    if (err != NC_NOERR) return err;
+
+    if (request == NULL) DEBUG_RETURN_ERROR(NC_EINVAL)
+    *request = NC_REQ_NULL;
+
+    /* filetype cannot be created in define mode */
+    if (pncp->flag & NC_MODE_DEF) DEBUG_RETURN_ERROR(NC_EINDEFINE)
+
+    err = sanity_check(pncp, varid, IO_TYPE(i$1), MPI_DATATYPE_NULL, 0);
+    if (err != NC_NOERR) return err;
+
+    /* not-scalar variable checks start, count. The records to be read are
+     * checked when the request is started */
+    if (pncp->vars[varid].ndims > 0) {
+        err = check_start_count_stride(pncp, varid, 0, API_VARA, start,
+                                       count, NULL);
+        if (err != NC_NOERR) return err;
+    }
+
+    /* calling the subroutine that implements ncmpi_$1_vara_init() */
+    return pncp->driver->getput_init(pncp->ncp, varid, start, count, buf,
+                                     bufcount, buftype, request,
+                                     IO_MODE($1));
+}
+')
+dnl
+foreach(`putget', (put, get),
+        `VARA_INIT(putget)
+')dnl
@@ -0,0 +1,239 @@
+/*
+ *  Copyright (C) 2018, Northwestern University and Argonne National Laboratory
+ *  See COPYRIGHT notice in top-level directory.
+ */
+/* $Id$ */
+
+/* A pool of reusable buffers, used for the temporary buffers of put and get
+ * requests, e.g. xbuf for type conversion and byte swap. Buffers are rounded
+ * up to size classes, starting from 64 bytes. Each power of 2 is divided into
+ * POOL_NSUBS classes, e.g. 1024, 1280, 1536, 1792, and 2048 bytes, so
+ * rounding up wastes less than 1/POOL_NSUBS of a buffer. A freed buffer is
+ * kept in the free list of its class for reuse, as long as the total size of
+ * free buffers kept does not exceed the cap of the pool. Buffers larger than
+ * the cap are allocated and freed directly with their exact sizes.
+ *
+ * Each buffer is preceded by a small header storing its size class, so
+ * ncmpii_pool_free() needs no size argument. A NULL pool is allowed, in
+ * which case buffers are allocated and freed directly.
+ *
+ * Each pool counts its hits, misses, and the high water mark of the memory it
+ * holds, which are reported by ncmpi_inq_buf_pool_stats() of the file owning
+ * the pool.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#ifdef HAVE_MADVISE
+#include <sys/mman.h> /* madvise() */
+#endif
+
+#include <mpi.h>
+
+#include <pnetcdf.h>
+#include <pnc_debug.h>
+#include <common.h>
+
+/* size of the smallest class is 2^POOL_MIN_SHIFT bytes */
+#define POOL_MIN_SHIFT 6
+
+/* number of size classes between two consecutive powers of 2, a power of 2
+ * no larger than 2^POOL_MIN_SHIFT */
+#define POOL_NSUBS_SHIFT 2
+#define POOL_NSUBS (1 << POOL_NSUBS_SHIFT)
+
+/* number of size classes, from 64 B to 2^(POOL_MIN_SHIFT+40) */
+#define POOL_NCLASSES (40 * POOL_NSUBS)
+
+/* buffers of this size or larger are advised to be backed by huge pages */
+#define POOL_HUGE_PAGE_SIZE 2097152
+
+typedef struct pool_hdr {
+    struct pool_hdr *next; /* next free buffer of the same class */
+    int              cls;  /* size class, -1 if not pooled */
+} pool_hdr;
+
+/* keep buffers aligned to 16 bytes */
+#define POOL_HDR_SIZE _RNDUP(sizeof(pool_hdr), 16)
+
+struct ncmpii_buf_pool {
+    size_t     cap;                     /* max size of free buffers kept */
+    size_t     cached;                  /* size of free buffers kept */
+    pool_hdr  *free_list[POOL_NCLASSES];
+    MPI_Offset hits;                    /* buffers reused from free lists */
+    MPI_Offset misses;                  /* buffers newly allocated */
+    MPI_Offset size;                    /* size of pooled buffers in use and
+                                           kept */
+    MPI_Offset max_size;                /* high water mark of size */
+};
+
+/*----< class_size() >-------------------------------------------------------*/
+/* class cls is sub-class cls % POOL_NSUBS of the power of 2 cls / POOL_NSUBS
+ */
+static size_t
+class_size(int cls)
+{
+    size_t sub = (size_t)(POOL_NSUBS + cls % POOL_NSUBS);
+    return sub << (cls / POOL_NSUBS + POOL_MIN_SHIFT - POOL_NSUBS_SHIFT);
+}
+
+/*----< size_class() >-------------------------------------------------------*/
+/* return the smallest class whose size is no less than size, or
+ * POOL_NCLASSES if size is larger than all classes
+ */
+static int
+size_class(size_t size)
+{
+    int shift=POOL_MIN_SHIFT;
+    size_t sub;
+
+    /* find the power of 2 with 2^shift < size <= 2^(shift+1) */
+    if (size <= ((size_t)1 << POOL_MIN_SHIFT)) return 0;
+    while (shift - POOL_MIN_SHIFT < POOL_NCLASSES / POOL_NSUBS &&
+           ((size_t)1 << (shift + 1)) < size)
+        shift++;
+
+    /* size in units of 2^shift / POOL_NSUBS, rounded up. It is in the range
+     * (POOL_NSUBS, 2*POOL_NSUBS], where 2*POOL_NSUBS means 2^(shift+1) */
+    sub = (size + ((size_t)1 << (shift - POOL_NSUBS_SHIFT)) - 1)
+        >> (shift - POOL_NSUBS_SHIFT);
+
+    return (shift - POOL_MIN_SHIFT) * POOL_NSUBS + (int)sub - POOL_NSUBS;
+}
+
+/*----< advise_huge_pages() >------------------------------------------------*/
+/* advise the kernel to back the huge-page aligned part of a large buffer with
+ * transparent huge pages, reducing page faults when it is first touched.
+ */
+static void
+advise_huge_pages(void *buf, size_t size)
+{
+#if defined(HAVE_MADVISE) && defined(MADV_HUGEPAGE)
+    size_t beg = _RNDUP((size_t)buf, POOL_HUGE_PAGE_SIZE);
+    size_t end = _RNDDOWN((size_t)buf + size, POOL_HUGE_PAGE_SIZE);
+    if (end > beg) madvise((void*)beg, end - beg, MADV_HUGEPAGE);
+#endif
+}
+
+/*----< ncmpii_pool_create() >-----------------------------------------------*/
+/* create a pool that keeps at most cap bytes of free buffers. When cap is 0,
+ * return NULL, i.e. buffers are not pooled.
+ */
+ncmpii_buf_pool *
+ncmpii_pool_create(size_t cap)
+{
+    ncmpii_buf_pool *pool;
+
+    if (cap == 0) return NULL;
+
+    pool = (ncmpii_buf_pool*) NCI_Calloc(1, sizeof(ncmpii_buf_pool));
+    if (pool == NULL) return NULL;
+    pool->cap = cap;
+    return pool;
+}
+
+/*----< ncmpii_pool_destroy() >----------------------------------------------*/
+/* free all buffers kept in the pool and the pool itself */
+void
+ncmpii_pool_destroy(ncmpii_buf_pool *pool)
+{
+    int cls;
+
+    if (pool == NULL) return;
+
+    for (cls=0; cls<POOL_NCLASSES; cls++) {
+        while (pool->free_list[cls] != NULL) {
+            pool_hdr *hdr = pool->free_list[cls];
+            pool->free_list[cls] = hdr->next;
+            NCI_Free(hdr);
+        }
+    }
+    NCI_Free(pool);
+}
+
+/*----< ncmpii_pool_malloc() >-----------------------------------------------*/
+void *
+ncmpii_pool_malloc(ncmpii_buf_pool *pool,
+                   size_t           size)
+{
+    int cls=-1;
+    pool_hdr *hdr;
+
+    if (pool != NULL && size <= pool->cap) {
+        cls = size_class(size);
+        if (cls >= POOL_NCLASSES || class_size(cls) > pool->cap)
+            cls = -1; /* too large to be pooled */
+    }
+
+    if (cls >= 0 && pool->free_list[cls] != NULL) {
+        /* reuse a free buffer of the same class */
+        hdr = pool->free_list[cls];
+        pool->free_list[cls] = hdr->next;
+        pool->cached -= class_size(cls);
+        pool->hits++;
+        return (char*)hdr + POOL_HDR_SIZE;
+    }
+
+    if (pool != NULL) pool->misses++;
+    if (cls >= 0) size = class_size(cls);
+
+    hdr = (pool_hdr*) NCI_Malloc(POOL_HDR_SIZE + size);
+    if (hdr == NULL) return NULL;
+    hdr->next = NULL;
+    hdr->cls  = cls;
+
+    if (cls >= 0) {
+        pool->size += size;
+        if (pool->max_size < pool->size) pool->max_size = pool->size;
+        if (size >= 2 * POOL_HUGE_PAGE_SIZE)
+            advise_huge_pages((char*)hdr + POOL_HDR_SIZE, size);
+    }
+    return (char*)hdr + POOL_HDR_SIZE;
+}
+
+/*----< ncmpii_pool_free() >-------------------------------------------------*/
+/* return buf, allocated by ncmpii_pool_malloc(), to the pool. If keeping it
+ * would exceed the cap of the pool, buf is freed.
+ */
+void
+ncmpii_pool_free(ncmpii_buf_pool *pool,
+                 void            *buf)
+{
+    pool_hdr *hdr;
+
+    if (buf == NULL) return;
+
+    hdr = (pool_hdr*)((char*)buf - POOL_HDR_SIZE);
+
+    if (hdr->cls >= 0) {
+        size_t size = class_size(hdr->cls);
+        if (pool != NULL && pool->cached + size <= pool->cap) {
+            hdr->next = pool->free_list[hdr->cls];
+            pool->free_list[hdr->cls] = hdr;
+            pool->cached += size;
+            return;
+        }
+        if (pool != NULL) pool->size -= size;
+    }
+    NCI_Free(hdr);
+}
+
+/*----< ncmpii_pool_stats() >-----------------------------------------------*/
+/* report the number of buffers reused from and newly allocated by pool, and
+ * the high water mark of memory held by pool. They are all 0s for a NULL
+ * pool. Any argument other than pool can be NULL.
+ */
+void
+ncmpii_pool_stats(const ncmpii_buf_pool *pool,
+                  MPI_Offset            *hits,
+                  MPI_Offset            *misses,
+                  MPI_Offset            *max_size)
+{
+    if (hits     != NULL) *hits     = (pool == NULL) ? 0 : pool->hits;
+    if (misses   != NULL) *misses   = (pool == NULL) ? 0 : pool->misses;
+    if (max_size != NULL) *max_size = (pool == NULL) ? 0 : pool->max_size;
+}
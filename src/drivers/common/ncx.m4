@@ -298,51 +298,17 @@ inline static void
 swapn2b(void *dst, const void *src, IntType nn)
 {
     /* it is OK if dst == src */
-    int i;
-    uint16_t *op = (uint16_t*) dst;
-    uint16_t *ip = (uint16_t*) src;
-    for (i=0; i<nn; i++) {
-        op[i] = ip[i];
-        op[i] = (uint16_t)SWAP2(op[i]);
-    }
-#if 0
-	char *op = dst;
-	const char *ip = src;
-
-/* unroll the following to reduce loop overhead
- *
- *	while (nn-- > 0)
- *	{
- *		*op++ = *(++ip);
- *		*op++ = *(ip++ -1);
- *	}
- */
-	while (nn > 3)
-	{
-		*op++ = *(++ip);
-		*op++ = *(ip++ -1);
-		*op++ = *(++ip);
-		*op++ = *(ip++ -1);
-		*op++ = *(++ip);
-		*op++ = *(ip++ -1);
-		*op++ = *(++ip);
-		*op++ = *(ip++ -1);
-		nn -= 4;
-	}
-	while (nn-- > 0)
-	{
-		*op++ = *(++ip);
-		*op++ = *(ip++ -1);
-	}
-#endif
+    ncmpii_swapn2b(dst, src, nn);
 }
 
 # ifndef vax
 inline static void
 swap4b(void *dst, const void *src)
 {
-    /* copy over, make the below swap in-place */
-    uint32_t tmp = *(uint32_t*)src;
+    /* copy over, make the below swap in-place. memcpy() is used, as src can
+     * be a float, which must not be read through an uint32_t pointer */
+    uint32_t tmp;
+    memcpy(&tmp, src, 4);
     tmp = SWAP4(tmp);
     memcpy(dst, &tmp, 4);
 
@@ -386,62 +352,8 @@ swap4b(void *dst, const void *src)
 inline static void
 swapn4b(void *dst, const void *src, IntType nn)
 {
-    int i;
-    uint32_t *op = (uint32_t*) dst;
-    uint32_t *ip = (uint32_t*) src;
-    for (i=0; i<nn; i++) {
-        /* copy over, make the below swap in-place */
-        op[i] = ip[i];
-        op[i] = SWAP4(op[i]);
-    }
-
-#if 0
-	char *op = dst;
-	const char *ip = src;
-
-/* unroll the following to reduce loop overhead
- *	while (nn-- > 0)
- *	{
- *		op[0] = ip[3];
- *		op[1] = ip[2];
- *		op[2] = ip[1];
- *		op[3] = ip[0];
- *		op += 4;
- *		ip += 4;
- *	}
- */
-	while (nn > 3)
-	{
-		op[0] = ip[3];
-		op[1] = ip[2];
-		op[2] = ip[1];
-		op[3] = ip[0];
-		op[4] = ip[7];
-		op[5] = ip[6];
-		op[6] = ip[5];
-		op[7] = ip[4];
-		op[8] = ip[11];
-		op[9] = ip[10];
-		op[10] = ip[9];
-		op[11] = ip[8];
-		op[12] = ip[15];
-		op[13] = ip[14];
-		op[14] = ip[13];
-		op[15] = ip[12];
-		op += 16;
-		ip += 16;
-		nn -= 4;
-	}
-	while (nn-- > 0)
-	{
-		op[0] = ip[3];
-		op[1] = ip[2];
-		op[2] = ip[1];
-		op[3] = ip[0];
-		op += 4;
-		ip += 4;
-	}
-#endif
+    /* it is OK if dst == src */
+    ncmpii_swapn4b(dst, src, nn);
 }
 
 # ifndef vax
@@ -457,7 +369,8 @@ swap8b(void *dst, const void *src)
     op = (uint32_t*)((char*)dst+4);
     *op = SWAP4(*op);
 #else
-    uint64_t tmp = *(uint64_t*)src;
+    uint64_t tmp;
+    memcpy(&tmp, src, 8);
     tmp = SWAP8(tmp);
     memcpy(dst, &tmp, 8);
 
@@ -526,61 +439,12 @@ swapn8b(void *dst, const void *src, IntType nn)
 #endif
 
 #else
+#  ifndef FLOAT_WORDS_BIGENDIAN
+	ncmpii_swapn8b(dst, src, nn);
+#  else
 	char *op = dst;
 	const char *ip = src;
 
-/* unroll the following to reduce loop overhead
- *	while (nn-- > 0)
- *	{
- *		op[0] = ip[7];
- *		op[1] = ip[6];
- *		op[2] = ip[5];
- *		op[3] = ip[4];
- *		op[4] = ip[3];
- *		op[5] = ip[2];
- *		op[6] = ip[1];
- *		op[7] = ip[0];
- *		op += 8;
- *		ip += 8;
- *	}
- */
-#  ifndef FLOAT_WORDS_BIGENDIAN
-	while (nn > 1)
-	{
-		op[0] = ip[7];
-		op[1] = ip[6];
-		op[2] = ip[5];
-		op[3] = ip[4];
-		op[4] = ip[3];
-		op[5] = ip[2];
-		op[6] = ip[1];
-		op[7] = ip[0];
-		op[8] = ip[15];
-		op[9] = ip[14];
-		op[10] = ip[13];
-		op[11] = ip[12];
-		op[12] = ip[11];
-		op[13] = ip[10];
-		op[14] = ip[9];
-		op[15] = ip[8];
-		op += 16;
-		ip += 16;
-		nn -= 2;
-	}
-	while (nn-- > 0)
-	{
-		op[0] = ip[7];
-		op[1] = ip[6];
-		op[2] = ip[5];
-		op[3] = ip[4];
-		op[4] = ip[3];
-		op[5] = ip[2];
-		op[6] = ip[1];
-		op[7] = ip[0];
-		op += 8;
-		ip += 8;
-	}
-#  else
 	while (nn-- > 0)
 	{
 		op[0] = ip[3];
@@ -594,7 +458,7 @@ swapn8b(void *dst, const void *src, IntType nn)
 		op += 8;
 		ip += 8;
 	}
-#endif
+#  endif
 #endif
 }
 # endif /* !vax */
@@ -1624,7 +1488,10 @@ NCX_GET1F(float, schar)
 NCX_GET1F(float, short)
 NCX_GET1F(float, int)
 NCX_GET1F(float, long)
+#if defined(WORDS_BIGENDIAN) || X_SIZEOF_FLOAT != SIZEOF_FLOAT || defined(NO_IEEE_FLOAT)
+/* used only when NCX_GETN_SIMD(float, double) is not */
 NCX_GET1F(float, double)
+#endif
 NCX_GET1F(float, longlong)
 NCX_GET1F(float, uchar)
 NCX_GET1F(float, ushort)
@@ -2694,6 +2561,21 @@ APIPrefix`x_getn_'NC_TYPE($1)_$2(const void **xpp, IntType nelems, $2 *tp)
 ')dnl
 dnl dnl dnl
 dnl
+dnl NCX_GETN_SIMD(xtype, itype) byte-swaps and type-casts with a SIMD kernel,
+dnl for pairs of types whose conversion never causes NC_ERANGE
+dnl
+define(`NCX_GETN_SIMD',dnl
+`dnl
+int
+APIPrefix`x_getn_'NC_TYPE($1)_$2(const void **xpp, IntType nelems, $2 *tp)
+{
+	ncmpii_getn_swap_$1_$2(tp, *xpp, nelems);
+	*xpp = (const void *)((const char *)(*xpp) + nelems * Xsizeof($1));
+	return NC_NOERR;
+}
+')dnl
+dnl dnl dnl
+dnl
 dnl NCX_PAD_GETN_SHORT(xtype ttype)
 dnl
 define(`NCX_PAD_GETN_SHORT',dnl
@@ -2903,6 +2785,43 @@ ifelse( $1$2, intfloat,dnl
 ')dnl
 dnl dnl dnl
 dnl
+dnl NCX_PUTN_SIMD(xtype, itype) type-casts and byte-swaps with a SIMD kernel.
+dnl The kernel stops at a block of NCMPII_SIMD_BLOCK elements containing a
+dnl value out of the range of xtype, which is then converted element by
+dnl element, so NC_ERANGE and fill values are handled the same as NCX_PUTN.
+dnl
+define(`NCX_PUTN_SIMD',dnl
+`dnl
+int
+APIPrefix`x_putn_'NC_TYPE($1)_$2(void **xpp, IntType nelems, const $2 *tp, void *fillp)
+{
+	char *xp = (char *) *xpp;
+	int status = NC_NOERR;
+
+	while (nelems > 0)
+	{
+		IntType i, n = ncmpii_putn_swap_$1_$2(xp, tp, nelems);
+		xp     += n * Xsizeof($1);
+		tp     += n;
+		nelems -= n;
+
+		/* the block out of range or the last few elements */
+		n = MIN(nelems, NCMPII_SIMD_BLOCK);
+		for (i=0; i<n; i++, xp += Xsizeof($1), tp++)
+		{
+			int lstatus = APIPrefix`x_put_'NC_TYPE($1)_$2(xp, tp, fillp);
+			if (status == NC_NOERR) /* report the first encountered error */
+				status = lstatus;
+		}
+		nelems -= n;
+	}
+
+	*xpp = (void *)xp;
+	return status;
+}
+')dnl
+dnl dnl dnl
+dnl
 dnl NCX_PAD_PUTN_SHORT(xtype, ttype)
 dnl
 define(`NCX_PAD_PUTN_SHORT',dnl
@@ -3182,7 +3101,11 @@ APIPrefix`x_getn_'NC_TYPE(short)_short(const void **xpp, IntType nelems, short *
 NCX_GETN(short, short)
 #endif
 NCX_GETN(short, schar)
+#if !defined(WORDS_BIGENDIAN) && SIZEOF_SHORT == X_SIZEOF_SHORT && SIZEOF_INT == X_SIZEOF_INT
+NCX_GETN_SIMD(short, int)
+#else
 NCX_GETN(short, int)
+#endif
 NCX_GETN(short, long)
 NCX_GETN(short, float)
 NCX_GETN(short, double)
@@ -3221,7 +3144,11 @@ APIPrefix`x_putn_'NC_TYPE(short)_short(void **xpp, IntType nelems, const short *
 NCX_PUTN(short, short)
 #endif
 NCX_PUTN(short, schar)
+#if !defined(WORDS_BIGENDIAN) && SIZEOF_SHORT == X_SIZEOF_SHORT && SIZEOF_INT == X_SIZEOF_INT
+NCX_PUTN_SIMD(short, int)
+#else
 NCX_PUTN(short, int)
+#endif
 NCX_PUTN(short, long)
 NCX_PUTN(short, float)
 NCX_PUTN(short, double)
@@ -3491,7 +3418,11 @@ NCX_GETN(float, schar)
 NCX_GETN(float, short)
 NCX_GETN(float, int)
 NCX_GETN(float, long)
+#if !defined(WORDS_BIGENDIAN) && X_SIZEOF_FLOAT == SIZEOF_FLOAT && !defined(NO_IEEE_FLOAT)
+NCX_GETN_SIMD(float, double)
+#else
 NCX_GETN(float, double)
+#endif
 NCX_GETN(float, longlong)
 NCX_GETN(float, ushort)
 NCX_GETN(float, uchar)
@@ -3541,7 +3472,11 @@ NCX_PUTN(float, schar)
 NCX_PUTN(float, short)
 NCX_PUTN(float, int)
 NCX_PUTN(float, long)
+#if !defined(WORDS_BIGENDIAN) && X_SIZEOF_FLOAT == SIZEOF_FLOAT && !defined(NO_IEEE_FLOAT)
+NCX_PUTN_SIMD(float, double)
+#else
 NCX_PUTN(float, double)
+#endif
 NCX_PUTN(float, longlong)
 NCX_PUTN(float, uchar)
 NCX_PUTN(float, ushort)
@@ -0,0 +1,177 @@
+/*
+ *  Copyright (C) 2018, Northwestern University and Argonne National Laboratory
+ *  See COPYRIGHT notice in top-level directory.
+ */
+/* $Id$ */
+
+/*
+ * This program measures the throughput of the byte-swap and type-conversion
+ * kernels at each SIMD level supported by the machine, and checks that their
+ * results are the same as the scalar kernels. External buffers are misaligned
+ * on purpose. It returns a non-zero value if any results differ.
+ *
+ *    % ./simd_bench [-q] [-n nelems] [-r repeats]
+ */
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h> /* getopt() */
+
+#include <mpi.h>
+
+#include <pnetcdf.h>
+#include <common.h>
+
+enum {SWAP2, SWAP4, SWAP8, PUT_FLOAT_DOUBLE, PUT_SHORT_INT,
+      GET_FLOAT_DOUBLE, GET_SHORT_INT, NKERNELS};
+
+static const char *kernel_names[NKERNELS] = {
+    "swap 2-byte", "swap 4-byte", "swap 8-byte", "put double->float",
+    "put int->short", "get float->double", "get short->int"};
+
+/* bytes of the native buffer of each kernel, per element */
+static const int native_size[NKERNELS] = {2, 4, 8, 8, 4, 8, 4};
+
+/*----< run_kernel() >-------------------------------------------------------*/
+/* run a kernel once, return the number of elements converted */
+static MPI_Offset
+run_kernel(int kernel, void *native, void *xbuf, MPI_Offset nelems)
+{
+    switch (kernel) {
+        case SWAP2: ncmpii_swapn2b(xbuf, native, nelems); break;
+        case SWAP4: ncmpii_swapn4b(xbuf, native, nelems); break;
+        case SWAP8: ncmpii_swapn8b(xbuf, native, nelems); break;
+        case PUT_FLOAT_DOUBLE:
+            return ncmpii_putn_swap_float_double(xbuf, native, nelems);
+        case PUT_SHORT_INT:
+            return ncmpii_putn_swap_short_int(xbuf, native, nelems);
+        case GET_FLOAT_DOUBLE:
+            ncmpii_getn_swap_float_double(native, xbuf, nelems); break;
+        case GET_SHORT_INT:
+            ncmpii_getn_swap_short_int(native, xbuf, nelems); break;
+    }
+    return nelems;
+}
+
+static void
+usage(char *argv0)
+{
+    char *help =
+    "Usage: %s [-h] | [-q] [-n nelems] [-r repeats]\n"
+    "       [-h] Print help\n"
+    "       [-q] Quiet mode, print only errors\n"
+    "       [-n] number of elements per kernel call (default 1048576)\n"
+    "       [-r] number of repeated calls timed (default 10)\n";
+    fprintf(stderr, help, argv0);
+}
+
+int main(int argc, char **argv)
+{
+    int i, k, level, verbose=1, repeats=10, nerrs=0;
+    size_t bufsize, cmp_size;
+    char *native, *xbuf, *ref[NKERNELS];
+    MPI_Offset j, nelems=1048576;
+
+    MPI_Init(&argc, &argv);
+
+    while ((i = getopt(argc, argv, "hqn:r:")) != EOF)
+        switch(i) {
+            case 'q': verbose = 0;
+                      break;
+            case 'n': nelems = atoll(optarg);
+                      break;
+            case 'r': repeats = atoi(optarg);
+                      break;
+            case 'h':
+            default:  usage(argv[0]);
+                      MPI_Finalize();
+                      return 1;
+        }
+    if (nelems <= 0 || repeats <= 0) {
+        usage(argv[0]);
+        MPI_Finalize();
+        return 1;
+    }
+
+    /* external buffers are 1 byte off the allocated address */
+    bufsize = (size_t)nelems * 8 + 1;
+    native = (char*) malloc(bufsize);
+    xbuf   = (char*) malloc(bufsize);
+    for (k=0; k<NKERNELS; k++) ref[k] = (char*) malloc(bufsize);
+
+    if (verbose)
+        printf("%-18s %-8s %12s %12s\n", "kernel", "level", "time (sec)",
+               "MiB/sec");
+
+    for (level=NCMPII_SIMD_NONE; level<=NCMPII_SIMD_NEON; level++) {
+        if (ncmpii_simd_set_level(level) != level) continue; /* unsupported */
+
+        for (k=0; k<NKERNELS; k++) {
+            double timing;
+            MPI_Offset n;
+            char *out;
+
+            /* initialize input in the range of the external type */
+            srand(k + 1);
+            if (k == PUT_FLOAT_DOUBLE) {
+                double *dp = (double*)native;
+                for (j=0; j<nelems; j++)
+                    dp[j] = ((double)rand() - RAND_MAX/2) * 1.0e-3;
+            }
+            else if (k == PUT_SHORT_INT) {
+                int *ip = (int*)native;
+                for (j=0; j<nelems; j++) ip[j] = rand() % 65536 - 32768;
+            }
+            else if (k == GET_FLOAT_DOUBLE || k == GET_SHORT_INT) {
+                for (j=0; j<nelems*8; j++) xbuf[j+1] = (char)rand();
+                if (k == GET_FLOAT_DOUBLE) /* avoid NaN patterns */
+                    for (j=0; j<nelems; j++) xbuf[j*4+1] &= 0x3f;
+            }
+            else {
+                for (j=0; j<nelems*8; j++) native[j] = (char)rand();
+            }
+
+            n = run_kernel(k, native, xbuf+1, nelems); /* warm up */
+            timing = MPI_Wtime();
+            for (i=0; i<repeats; i++)
+                n = run_kernel(k, native, xbuf+1, nelems);
+            timing = MPI_Wtime() - timing;
+
+            if (n != nelems - nelems % NCMPII_SIMD_BLOCK && n != nelems) {
+                printf("Error: %s at level %s converted %lld of %lld elements\n",
+                       kernel_names[k], ncmpii_simd_name(level), n, nelems);
+                nerrs++;
+            }
+
+            /* compare results against the scalar kernels */
+            out = (k >= GET_FLOAT_DOUBLE) ? native : xbuf+1;
+            cmp_size = (size_t)n * ((k == PUT_FLOAT_DOUBLE) ? 4 :
+                                    (k == PUT_SHORT_INT)    ? 2 : native_size[k]);
+            if (level == NCMPII_SIMD_NONE)
+                memcpy(ref[k], out, cmp_size);
+            else if (memcmp(ref[k], out, cmp_size)) {
+                printf("Error: %s at level %s differs from scalar kernel\n",
+                       kernel_names[k], ncmpii_simd_name(level));
+                nerrs++;
+            }
+
+            if (verbose)
+                printf("%-18s %-8s %12.4f %12.2f\n", kernel_names[k],
+                       ncmpii_simd_name(level), timing, (timing == 0) ? 0 :
+                       (double)native_size[k] * nelems * repeats / 1048576.0
+                       / timing);
+        }
+    }
+
+    free(native);
+    free(xbuf);
+    for (k=0; k<NKERNELS; k++) free(ref[k]);
+
+    MPI_Finalize();
+    return (nerrs > 0);
+}
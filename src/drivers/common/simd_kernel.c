@@ -0,0 +1,697 @@
+/*
+ *  Copyright (C) 2018, Northwestern University and Argonne National Laboratory
+ *  See COPYRIGHT notice in top-level directory.
+ */
+/* $Id$ */
+
+/*
+ * Byte-swap and type-conversion kernels used to convert between the native
+ * (Little Endian) and the external (Big Endian) representations of netCDF
+ * data. Each kernel has a scalar version and, when supported by the compiler,
+ * SSE4.1, AVX2, and AVX-512 versions on x86-64 or a NEON version on ARM. The
+ * x86 version is selected at the first call based on the CPU running the
+ * program. The selection can be capped by setting the environment variable
+ * PNETCDF_SIMD to one of "none", "sse4.1", "avx2", "avx512", or "neon".
+ *
+ * The fused kernels, ncmpii_putn_swap_xtype_itype(), type-cast and byte-swap
+ * in one pass. They stop before the first block of NCMPII_SIMD_BLOCK elements
+ * that contains a value out of the range of the external type and return the
+ * number of elements converted, leaving that block to the callers, which
+ * handle NC_ERANGE and the fill values element by element.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>  /* memcpy() */
+#include <strings.h> /* strcasecmp() */
+
+#ifdef HAVE_INTTYPES_H
+#include <inttypes.h> /* uint16_t, uint32_t, uint64_t */
+#elif defined(HAVE_STDINT_H)
+#include <stdint.h>   /* uint16_t, uint32_t, uint64_t */
+#endif
+
+#include <mpi.h>
+
+#include <pnetcdf.h>
+#include <common.h>
+
+#ifdef HAVE_X86_SIMD
+#include <immintrin.h>
+#endif
+#ifdef HAVE_ARM_NEON
+#include <arm_neon.h>
+#endif
+
+/* range of external NC_SHORT and NC_FLOAT, same as X_SHORT_MAX and
+ * X_FLOAT_MAX in ncx.h
+ */
+#define SIMD_SHORT_MIN (-32768)
+#define SIMD_SHORT_MAX 32767
+#define SIMD_FLOAT_MAX 3.402823466e+38f
+
+typedef struct {
+    void       (*swap2)(void*, const void*, MPI_Offset);
+    void       (*swap4)(void*, const void*, MPI_Offset);
+    void       (*swap8)(void*, const void*, MPI_Offset);
+    MPI_Offset (*put_float_double)(void*, const double*, MPI_Offset);
+    MPI_Offset (*put_short_int)(void*, const int*, MPI_Offset);
+    void       (*get_float_double)(double*, const void*, MPI_Offset);
+    void       (*get_short_int)(int*, const void*, MPI_Offset);
+} simd_kernels;
+
+/* scalar kernels ----------------------------------------------------------*/
+/* Elements are accessed through memcpy(), as external buffers are not always
+ * aligned. Compilers turn these into single loads and stores.
+ */
+static void
+swapn2b_scalar(void *dst, const void *src, MPI_Offset nn)
+{
+    MPI_Offset i;
+    char *op = (char*)dst;
+    const char *ip = (const char*)src;
+    for (i=0; i<nn; i++, op+=2, ip+=2) {
+        uint16_t tmp;
+        memcpy(&tmp, ip, 2);
+        tmp = (uint16_t)(((tmp & 0xff) << 8) | ((tmp >> 8) & 0xff));
+        memcpy(op, &tmp, 2);
+    }
+}
+
+static void
+swapn4b_scalar(void *dst, const void *src, MPI_Offset nn)
+{
+    MPI_Offset i;
+    char *op = (char*)dst;
+    const char *ip = (const char*)src;
+    for (i=0; i<nn; i++, op+=4, ip+=4) {
+        uint32_t tmp;
+        memcpy(&tmp, ip, 4);
+        tmp = (tmp << 24) | ((tmp <<  8) & 0x00ff0000) |
+              ((tmp >>  8) & 0x0000ff00) | (tmp >> 24);
+        memcpy(op, &tmp, 4);
+    }
+}
+
+static void
+swapn8b_scalar(void *dst, const void *src, MPI_Offset nn)
+{
+    MPI_Offset i;
+    char *op = (char*)dst;
+    const char *ip = (const char*)src;
+    for (i=0; i<nn; i++, op+=8, ip+=8) {
+        uint64_t tmp;
+        memcpy(&tmp, ip, 8);
+        tmp = ((tmp & 0x00000000000000FFULL) << 56) |
+              ((tmp & 0x000000000000FF00ULL) << 40) |
+              ((tmp & 0x0000000000FF0000ULL) << 24) |
+              ((tmp & 0x00000000FF000000ULL) <<  8) |
+              ((tmp & 0x000000FF00000000ULL) >>  8) |
+              ((tmp & 0x0000FF0000000000ULL) >> 24) |
+              ((tmp & 0x00FF000000000000ULL) >> 40) |
+              ((tmp & 0xFF00000000000000ULL) >> 56);
+        memcpy(op, &tmp, 8);
+    }
+}
+
+static MPI_Offset
+put_float_double_scalar(void *xp, const double *ip, MPI_Offset nn)
+{
+    MPI_Offset i;
+    char *op = (char*)xp;
+    for (i=0; i<nn; i++, op+=4) {
+        float tmp;
+        if (ip[i] > SIMD_FLOAT_MAX || ip[i] < -SIMD_FLOAT_MAX) break;
+        tmp = (float)ip[i];
+        swapn4b_scalar(op, &tmp, 1);
+    }
+    return i;
+}
+
+static MPI_Offset
+put_short_int_scalar(void *xp, const int *ip, MPI_Offset nn)
+{
+    MPI_Offset i;
+    char *op = (char*)xp;
+    for (i=0; i<nn; i++, op+=2) {
+        short tmp;
+        if (ip[i] > SIMD_SHORT_MAX || ip[i] < SIMD_SHORT_MIN) break;
+        tmp = (short)ip[i];
+        swapn2b_scalar(op, &tmp, 1);
+    }
+    return i;
+}
+
+static void
+get_float_double_scalar(double *ip, const void *xp, MPI_Offset nn)
+{
+    MPI_Offset i;
+    const char *cp = (const char*)xp;
+    for (i=0; i<nn; i++, cp+=4) {
+        float tmp;
+        swapn4b_scalar(&tmp, cp, 1);
+        ip[i] = (double)tmp;
+    }
+}
+
+static void
+get_short_int_scalar(int *ip, const void *xp, MPI_Offset nn)
+{
+    MPI_Offset i;
+    const char *cp = (const char*)xp;
+    for (i=0; i<nn; i++, cp+=2) {
+        short tmp;
+        swapn2b_scalar(&tmp, cp, 1);
+        ip[i] = (int)tmp;
+    }
+}
+
+static const simd_kernels kernels_scalar = {
+    swapn2b_scalar, swapn4b_scalar, swapn8b_scalar,
+    put_float_double_scalar, put_short_int_scalar,
+    get_float_double_scalar, get_short_int_scalar
+};
+
+#ifdef HAVE_X86_SIMD
+/* x86-64 kernels ----------------------------------------------------------*/
+/* Byte-swap is a shuffle of bytes within each 128-bit lane. All loads and
+ * stores are unaligned. Loads of a block always precede its stores, so the
+ * swap kernels can work in place.
+ */
+#define SHUF_MASK2 14,15,12,13,10,11,8,9,6,7,4,5,2,3,0,1
+#define SHUF_MASK4 12,13,14,15,8,9,10,11,4,5,6,7,0,1,2,3
+#define SHUF_MASK8 8,9,10,11,12,13,14,15,0,1,2,3,4,5,6,7
+
+#define DEF_SWAPN_SSE(esize)                                                  \
+__attribute__((target("sse4.1"))) static void                                \
+swapn##esize##b_sse(void *dst, const void *src, MPI_Offset nn)               \
+{                                                                             \
+    MPI_Offset i, nb = nn * esize;                                            \
+    char *op = (char*)dst;                                                    \
+    const char *ip = (const char*)src;                                        \
+    const __m128i mask = _mm_set_epi8(SHUF_MASK##esize);                      \
+    for (i=0; i+16<=nb; i+=16) {                                              \
+        __m128i v = _mm_loadu_si128((const __m128i*)(ip+i));                  \
+        _mm_storeu_si128((__m128i*)(op+i), _mm_shuffle_epi8(v, mask));        \
+    }                                                                         \
+    swapn##esize##b_scalar(op+i, ip+i, (nb-i)/esize);                         \
+}
+
+#define DEF_SWAPN_AVX2(esize)                                                 \
+__attribute__((target("avx2"))) static void                                  \
+swapn##esize##b_avx2(void *dst, const void *src, MPI_Offset nn)              \
+{                                                                             \
+    MPI_Offset i, nb = nn * esize;                                            \
+    char *op = (char*)dst;                                                    \
+    const char *ip = (const char*)src;                                        \
+    const __m256i mask = _mm256_set_epi8(SHUF_MASK##esize, SHUF_MASK##esize); \
+    for (i=0; i+64<=nb; i+=64) {                                              \
+        __m256i v0 = _mm256_loadu_si256((const __m256i*)(ip+i));              \
+        __m256i v1 = _mm256_loadu_si256((const __m256i*)(ip+i+32));           \
+        _mm256_storeu_si256((__m256i*)(op+i),    _mm256_shuffle_epi8(v0, mask)); \
+        _mm256_storeu_si256((__m256i*)(op+i+32), _mm256_shuffle_epi8(v1, mask)); \
+    }                                                                         \
+    swapn##esize##b_scalar(op+i, ip+i, (nb-i)/esize);                         \
+}
+
+#define DEF_SWAPN_AVX512(esize)                                               \
+__attribute__((target("avx512f,avx512bw"))) static void                      \
+swapn##esize##b_avx512(void *dst, const void *src, MPI_Offset nn)            \
+{                                                                             \
+    MPI_Offset i, nb = nn * esize;                                            \
+    char *op = (char*)dst;                                                    \
+    const char *ip = (const char*)src;                                        \
+    const __m512i mask = _mm512_broadcast_i32x4(_mm_set_epi8(SHUF_MASK##esize)); \
+    for (i=0; i+64<=nb; i+=64) {                                              \
+        __m512i v = _mm512_loadu_si512((const void*)(ip+i));                  \
+        _mm512_storeu_si512((void*)(op+i), _mm512_shuffle_epi8(v, mask));     \
+    }                                                                         \
+    swapn##esize##b_scalar(op+i, ip+i, (nb-i)/esize);                         \
+}
+
+DEF_SWAPN_SSE(2)
+DEF_SWAPN_SSE(4)
+DEF_SWAPN_SSE(8)
+DEF_SWAPN_AVX2(2)
+DEF_SWAPN_AVX2(4)
+DEF_SWAPN_AVX2(8)
+DEF_SWAPN_AVX512(2)
+DEF_SWAPN_AVX512(4)
+DEF_SWAPN_AVX512(8)
+
+/* The fused kernels below process NCMPII_SIMD_BLOCK (16) elements per
+ * iteration and return at the first block holding a value out of range.
+ */
+
+/*----< double to external float >------------------------------------------*/
+__attribute__((target("sse4.1"))) static MPI_Offset
+put_float_double_sse(void *xp, const double *ip, MPI_Offset nn)
+{
+    MPI_Offset i, j;
+    char *op = (char*)xp;
+    const __m128i mask = _mm_set_epi8(SHUF_MASK4);
+    const __m128d vmax = _mm_set1_pd(SIMD_FLOAT_MAX);
+    const __m128d vmin = _mm_set1_pd(-SIMD_FLOAT_MAX);
+
+    for (i=0; i+NCMPII_SIMD_BLOCK<=nn; i+=NCMPII_SIMD_BLOCK) {
+        __m128d v[8], bad = _mm_setzero_pd();
+        for (j=0; j<8; j++) {
+            v[j] = _mm_loadu_pd(ip+i+j*2);
+            bad  = _mm_or_pd(bad, _mm_or_pd(_mm_cmpgt_pd(v[j], vmax),
+                                            _mm_cmplt_pd(v[j], vmin)));
+        }
+        if (_mm_movemask_pd(bad)) break;
+        for (j=0; j<4; j++) {
+            __m128 f = _mm_movelh_ps(_mm_cvtpd_ps(v[j*2]), _mm_cvtpd_ps(v[j*2+1]));
+            _mm_storeu_si128((__m128i*)(op+i*4+j*16),
+                             _mm_shuffle_epi8(_mm_castps_si128(f), mask));
+        }
+    }
+    return i;
+}
+
+__attribute__((target("avx2"))) static MPI_Offset
+put_float_double_avx2(void *xp, const double *ip, MPI_Offset nn)
+{
+    MPI_Offset i, j;
+    char *op = (char*)xp;
+    const __m256i mask = _mm256_set_epi8(SHUF_MASK4, SHUF_MASK4);
+    const __m256d vmax = _mm256_set1_pd(SIMD_FLOAT_MAX);
+    const __m256d vmin = _mm256_set1_pd(-SIMD_FLOAT_MAX);
+
+    for (i=0; i+NCMPII_SIMD_BLOCK<=nn; i+=NCMPII_SIMD_BLOCK) {
+        __m256d v[4], bad = _mm256_setzero_pd();
+        for (j=0; j<4; j++) {
+            v[j] = _mm256_loadu_pd(ip+i+j*4);
+            bad  = _mm256_or_pd(bad,
+                   _mm256_or_pd(_mm256_cmp_pd(v[j], vmax, _CMP_GT_OQ),
+                                _mm256_cmp_pd(v[j], vmin, _CMP_LT_OQ)));
+        }
+        if (_mm256_movemask_pd(bad)) break;
+        for (j=0; j<2; j++) {
+            __m256 f = _mm256_insertf128_ps(_mm256_castps128_ps256(
+                       _mm256_cvtpd_ps(v[j*2])), _mm256_cvtpd_ps(v[j*2+1]), 1);
+            _mm256_storeu_si256((__m256i*)(op+i*4+j*32),
+                                _mm256_shuffle_epi8(_mm256_castps_si256(f), mask));
+        }
+    }
+    return i;
+}
+
+__attribute__((target("avx512f,avx512bw"))) static MPI_Offset
+put_float_double_avx512(void *xp, const double *ip, MPI_Offset nn)
+{
+    MPI_Offset i;
+    char *op = (char*)xp;
+    const __m512i mask = _mm512_broadcast_i32x4(_mm_set_epi8(SHUF_MASK4));
+    const __m512d vmax = _mm512_set1_pd(SIMD_FLOAT_MAX);
+    const __m512d vmin = _mm512_set1_pd(-SIMD_FLOAT_MAX);
+
+    for (i=0; i+NCMPII_SIMD_BLOCK<=nn; i+=NCMPII_SIMD_BLOCK) {
+        __m512d v0 = _mm512_loadu_pd(ip+i);
+        __m512d v1 = _mm512_loadu_pd(ip+i+8);
+        __mmask8 bad = _mm512_cmp_pd_mask(v0, vmax, _CMP_GT_OQ) |
+                       _mm512_cmp_pd_mask(v0, vmin, _CMP_LT_OQ) |
+                       _mm512_cmp_pd_mask(v1, vmax, _CMP_GT_OQ) |
+                       _mm512_cmp_pd_mask(v1, vmin, _CMP_LT_OQ);
+        __m512i f;
+        if (bad) break;
+        f = _mm512_inserti64x4(_mm512_castsi256_si512(
+                _mm256_castps_si256(_mm512_cvtpd_ps(v0))),
+                _mm256_castps_si256(_mm512_cvtpd_ps(v1)), 1);
+        _mm512_storeu_si512((void*)(op+i*4), _mm512_shuffle_epi8(f, mask));
+    }
+    return i;
+}
+
+/*----< int to external short >---------------------------------------------*/
+__attribute__((target("sse4.1"))) static MPI_Offset
+put_short_int_sse(void *xp, const int *ip, MPI_Offset nn)
+{
+    MPI_Offset i, j;
+    char *op = (char*)xp;
+    const __m128i mask = _mm_set_epi8(SHUF_MASK2);
+    const __m128i vmax = _mm_set1_epi32(SIMD_SHORT_MAX);
+    const __m128i vmin = _mm_set1_epi32(SIMD_SHORT_MIN);
+
+    for (i=0; i+NCMPII_SIMD_BLOCK<=nn; i+=NCMPII_SIMD_BLOCK) {
+        __m128i v[4], bad = _mm_setzero_si128();
+        for (j=0; j<4; j++) {
+            v[j] = _mm_loadu_si128((const __m128i*)(ip+i+j*4));
+            bad  = _mm_or_si128(bad, _mm_or_si128(_mm_cmpgt_epi32(v[j], vmax),
+                                                  _mm_cmplt_epi32(v[j], vmin)));
+        }
+        if (!_mm_testz_si128(bad, bad)) break;
+        for (j=0; j<2; j++) {
+            __m128i s = _mm_packs_epi32(v[j*2], v[j*2+1]);
+            _mm_storeu_si128((__m128i*)(op+i*2+j*16), _mm_shuffle_epi8(s, mask));
+        }
+    }
+    return i;
+}
+
+__attribute__((target("avx2"))) static MPI_Offset
+put_short_int_avx2(void *xp, const int *ip, MPI_Offset nn)
+{
+    MPI_Offset i;
+    char *op = (char*)xp;
+    const __m256i mask = _mm256_set_epi8(SHUF_MASK2, SHUF_MASK2);
+    const __m256i vmax = _mm256_set1_epi32(SIMD_SHORT_MAX);
+    const __m256i vmin = _mm256_set1_epi32(SIMD_SHORT_MIN);
+
+    for (i=0; i+NCMPII_SIMD_BLOCK<=nn; i+=NCMPII_SIMD_BLOCK) {
+        __m256i v0 = _mm256_loadu_si256((const __m256i*)(ip+i));
+        __m256i v1 = _mm256_loadu_si256((const __m256i*)(ip+i+8));
+        __m256i s, bad;
+        bad = _mm256_or_si256(
+              _mm256_or_si256(_mm256_cmpgt_epi32(v0, vmax),
+                              _mm256_cmpgt_epi32(vmin, v0)),
+              _mm256_or_si256(_mm256_cmpgt_epi32(v1, vmax),
+                              _mm256_cmpgt_epi32(vmin, v1)));
+        if (!_mm256_testz_si256(bad, bad)) break;
+        /* packs works per 128-bit lane, restore the order of 64-bit parts */
+        s = _mm256_permute4x64_epi64(_mm256_packs_epi32(v0, v1), 0xD8);
+        _mm256_storeu_si256((__m256i*)(op+i*2), _mm256_shuffle_epi8(s, mask));
+    }
+    return i;
+}
+
+__attribute__((target("avx512f,avx512bw"))) static MPI_Offset
+put_short_int_avx512(void *xp, const int *ip, MPI_Offset nn)
+{
+    MPI_Offset i;
+    char *op = (char*)xp;
+    const __m256i mask = _mm256_set_epi8(SHUF_MASK2, SHUF_MASK2);
+    const __m512i vmax = _mm512_set1_epi32(SIMD_SHORT_MAX);
+    const __m512i vmin = _mm512_set1_epi32(SIMD_SHORT_MIN);
+
+    for (i=0; i+NCMPII_SIMD_BLOCK<=nn; i+=NCMPII_SIMD_BLOCK) {
+        __m512i v = _mm512_loadu_si512((const void*)(ip+i));
+        __m256i s;
+        if (_mm512_cmpgt_epi32_mask(v, vmax) | _mm512_cmplt_epi32_mask(v, vmin))
+            break;
+        s = _mm512_cvtepi32_epi16(v);
+        _mm256_storeu_si256((__m256i*)(op+i*2), _mm256_shuffle_epi8(s, mask));
+    }
+    return i;
+}
+
+/*----< external float to double >------------------------------------------*/
+__attribute__((target("sse4.1"))) static void
+get_float_double_sse(double *ip, const void *xp, MPI_Offset nn)
+{
+    MPI_Offset i;
+    const char *cp = (const char*)xp;
+    const __m128i mask = _mm_set_epi8(SHUF_MASK4);
+
+    for (i=0; i+4<=nn; i+=4) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(cp+i*4));
+        __m128  f = _mm_castsi128_ps(_mm_shuffle_epi8(v, mask));
+        _mm_storeu_pd(ip+i,   _mm_cvtps_pd(f));
+        _mm_storeu_pd(ip+i+2, _mm_cvtps_pd(_mm_movehl_ps(f, f)));
+    }
+    get_float_double_scalar(ip+i, cp+i*4, nn-i);
+}
+
+__attribute__((target("avx2"))) static void
+get_float_double_avx2(double *ip, const void *xp, MPI_Offset nn)
+{
+    MPI_Offset i;
+    const char *cp = (const char*)xp;
+    const __m256i mask = _mm256_set_epi8(SHUF_MASK4, SHUF_MASK4);
+
+    for (i=0; i+8<=nn; i+=8) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)(cp+i*4));
+        __m256  f = _mm256_castsi256_ps(_mm256_shuffle_epi8(v, mask));
+        _mm256_storeu_pd(ip+i,   _mm256_cvtps_pd(_mm256_castps256_ps128(f)));
+        _mm256_storeu_pd(ip+i+4, _mm256_cvtps_pd(_mm256_extractf128_ps(f, 1)));
+    }
+    get_float_double_scalar(ip+i, cp+i*4, nn-i);
+}
+
+__attribute__((target("avx512f,avx512bw"))) static void
+get_float_double_avx512(double *ip, const void *xp, MPI_Offset nn)
+{
+    MPI_Offset i;
+    const char *cp = (const char*)xp;
+    const __m512i mask = _mm512_broadcast_i32x4(_mm_set_epi8(SHUF_MASK4));
+
+    for (i=0; i+16<=nn; i+=16) {
+        __m512i v = _mm512_shuffle_epi8(_mm512_loadu_si512((const void*)(cp+i*4)), mask);
+        _mm512_storeu_pd(ip+i,   _mm512_cvtps_pd(_mm256_castsi256_ps(
+                                 _mm512_castsi512_si256(v))));
+        _mm512_storeu_pd(ip+i+8, _mm512_cvtps_pd(_mm256_castsi256_ps(
+                                 _mm512_extracti64x4_epi64(v, 1))));
+    }
+    get_float_double_scalar(ip+i, cp+i*4, nn-i);
+}
+
+/*----< external short to int >---------------------------------------------*/
+__attribute__((target("sse4.1"))) static void
+get_short_int_sse(int *ip, const void *xp, MPI_Offset nn)
+{
+    MPI_Offset i;
+    const char *cp = (const char*)xp;
+    const __m128i mask = _mm_set_epi8(SHUF_MASK2);
+
+    for (i=0; i+8<=nn; i+=8) {
+        __m128i v = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(cp+i*2)), mask);
+        _mm_storeu_si128((__m128i*)(ip+i),   _mm_cvtepi16_epi32(v));
+        _mm_storeu_si128((__m128i*)(ip+i+4), _mm_cvtepi16_epi32(_mm_srli_si128(v, 8)));
+    }
+    get_short_int_scalar(ip+i, cp+i*2, nn-i);
+}
+
+__attribute__((target("avx2"))) static void
+get_short_int_avx2(int *ip, const void *xp, MPI_Offset nn)
+{
+    MPI_Offset i;
+    const char *cp = (const char*)xp;
+    const __m256i mask = _mm256_set_epi8(SHUF_MASK2, SHUF_MASK2);
+
+    for (i=0; i+16<=nn; i+=16) {
+        __m256i v = _mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i*)(cp+i*2)), mask);
+        _mm256_storeu_si256((__m256i*)(ip+i),
+                            _mm256_cvtepi16_epi32(_mm256_castsi256_si128(v)));
+        _mm256_storeu_si256((__m256i*)(ip+i+8),
+                            _mm256_cvtepi16_epi32(_mm256_extracti128_si256(v, 1)));
+    }
+    get_short_int_scalar(ip+i, cp+i*2, nn-i);
+}
+
+__attribute__((target("avx512f,avx512bw"))) static void
+get_short_int_avx512(int *ip, const void *xp, MPI_Offset nn)
+{
+    MPI_Offset i;
+    const char *cp = (const char*)xp;
+    const __m512i mask = _mm512_broadcast_i32x4(_mm_set_epi8(SHUF_MASK2));
+
+    for (i=0; i+32<=nn; i+=32) {
+        __m512i v = _mm512_shuffle_epi8(_mm512_loadu_si512((const void*)(cp+i*2)), mask);
+        _mm512_storeu_si512((void*)(ip+i),
+                            _mm512_cvtepi16_epi32(_mm512_castsi512_si256(v)));
+        _mm512_storeu_si512((void*)(ip+i+16),
+                            _mm512_cvtepi16_epi32(_mm512_extracti64x4_epi64(v, 1)));
+    }
+    get_short_int_scalar(ip+i, cp+i*2, nn-i);
+}
+
+static const simd_kernels kernels_sse = {
+    swapn2b_sse, swapn4b_sse, swapn8b_sse,
+    put_float_double_sse, put_short_int_sse,
+    get_float_double_sse, get_short_int_sse
+};
+
+static const simd_kernels kernels_avx2 = {
+    swapn2b_avx2, swapn4b_avx2, swapn8b_avx2,
+    put_float_double_avx2, put_short_int_avx2,
+    get_float_double_avx2, get_short_int_avx2
+};
+
+static const simd_kernels kernels_avx512 = {
+    swapn2b_avx512, swapn4b_avx512, swapn8b_avx512,
+    put_float_double_avx512, put_short_int_avx512,
+    get_float_double_avx512, get_short_int_avx512
+};
+#endif /* HAVE_X86_SIMD */
+
+#ifdef HAVE_ARM_NEON
+/* ARM NEON kernels --------------------------------------------------------*/
+/* NEON is part of the base instruction set of AArch64, so these kernels are
+ * selected at compile time. Only byte-swap is vectorized; the fused kernels
+ * use the scalar versions.
+ */
+#define DEF_SWAPN_NEON(esize, vrev)                                           \
+static void                                                                   \
+swapn##esize##b_neon(void *dst, const void *src, MPI_Offset nn)              \
+{                                                                             \
+    MPI_Offset i, nb = nn * esize;                                            \
+    uint8_t *op = (uint8_t*)dst;                                              \
+    const uint8_t *ip = (const uint8_t*)src;                                  \
+    for (i=0; i+16<=nb; i+=16)                                                \
+        vst1q_u8(op+i, vrev(vld1q_u8(ip+i)));                                 \
+    swapn##esize##b_scalar(op+i, ip+i, (nb-i)/esize);                         \
+}
+
+DEF_SWAPN_NEON(2, vrev16q_u8)
+DEF_SWAPN_NEON(4, vrev32q_u8)
+DEF_SWAPN_NEON(8, vrev64q_u8)
+
+static const simd_kernels kernels_neon = {
+    swapn2b_neon, swapn4b_neon, swapn8b_neon,
+    put_float_double_scalar, put_short_int_scalar,
+    get_float_double_scalar, get_short_int_scalar
+};
+#endif /* HAVE_ARM_NEON */
+
+/* run-time dispatch -------------------------------------------------------*/
+
+static const simd_kernels *kernels;  /* NULL until the first call */
+static int simd_level = -1;
+
+static const char *simd_names[] = {"none", "sse4.1", "avx2", "avx512", "neon"};
+
+/*----< supported() >-------------------------------------------------------*/
+/* whether the kernels of a level can run on this machine */
+static int
+supported(int level)
+{
+    if (level == NCMPII_SIMD_NONE) return 1;
+#ifdef HAVE_X86_SIMD
+    __builtin_cpu_init();
+    if (level == NCMPII_SIMD_SSE41)
+        return __builtin_cpu_supports("sse4.1");
+    if (level == NCMPII_SIMD_AVX2)
+        return __builtin_cpu_supports("avx2");
+    if (level == NCMPII_SIMD_AVX512)
+        return __builtin_cpu_supports("avx512f") &&
+               __builtin_cpu_supports("avx512bw");
+#endif
+#ifdef HAVE_ARM_NEON
+    if (level == NCMPII_SIMD_NEON) return 1;
+#endif
+    return 0;
+}
+
+/*----< ncmpii_simd_name() >------------------------------------------------*/
+const char *
+ncmpii_simd_name(int level)
+{
+    if (level < NCMPII_SIMD_NONE || level > NCMPII_SIMD_NEON) return NULL;
+    return simd_names[level];
+}
+
+/*----< ncmpii_simd_set_level() >-------------------------------------------*/
+/* Select the kernels of the highest level supported and not above the given
+ * level. Return the level selected. Levels are ordered as the x86 extensions;
+ * NEON is not comparable with them and is selected only by itself or by the
+ * highest level, NCMPII_SIMD_NEON.
+ */
+int
+ncmpii_simd_set_level(int level)
+{
+    int i;
+
+    for (i=MIN(level, NCMPII_SIMD_NEON); i>NCMPII_SIMD_NONE; i--)
+        if (supported(i)) break;
+    if (i < NCMPII_SIMD_NONE) i = NCMPII_SIMD_NONE;
+
+    switch (i) {
+#ifdef HAVE_X86_SIMD
+        case NCMPII_SIMD_SSE41:  kernels = &kernels_sse;    break;
+        case NCMPII_SIMD_AVX2:   kernels = &kernels_avx2;   break;
+        case NCMPII_SIMD_AVX512: kernels = &kernels_avx512; break;
+#endif
+#ifdef HAVE_ARM_NEON
+        case NCMPII_SIMD_NEON:   kernels = &kernels_neon;   break;
+#endif
+        default:                 kernels = &kernels_scalar; break;
+    }
+    simd_level = i;
+    return i;
+}
+
+/*----< ncmpii_simd_level() >-----------------------------------------------*/
+/* Return the level of kernels in use. At the first call, select the highest
+ * level supported, capped by the environment variable PNETCDF_SIMD.
+ */
+int
+ncmpii_simd_level(void)
+{
+    if (kernels == NULL) {
+        int i, level = NCMPII_SIMD_NEON;
+        char *env_str = getenv("PNETCDF_SIMD");
+        if (env_str != NULL) {
+            for (i=NCMPII_SIMD_NONE; i<=NCMPII_SIMD_NEON; i++)
+                if (!strcasecmp(env_str, simd_names[i])) break;
+            if (i <= NCMPII_SIMD_NEON) level = i;
+        }
+        ncmpii_simd_set_level(level);
+    }
+    return simd_level;
+}
+
+/*----< ncmpii_swapn2b() >--------------------------------------------------*/
+/* byte-swap nn 2-byte elements from src to dst, it is OK if dst == src */
+void
+ncmpii_swapn2b(void *dst, const void *src, MPI_Offset nn)
+{
+    if (kernels == NULL) ncmpii_simd_level();
+    kernels->swap2(dst, src, nn);
+}
+
+/*----< ncmpii_swapn4b() >--------------------------------------------------*/
+void
+ncmpii_swapn4b(void *dst, const void *src, MPI_Offset nn)
+{
+    if (kernels == NULL) ncmpii_simd_level();
+    kernels->swap4(dst, src, nn);
+}
+
+/*----< ncmpii_swapn8b() >--------------------------------------------------*/
+void
+ncmpii_swapn8b(void *dst, const void *src, MPI_Offset nn)
+{
+    if (kernels == NULL) ncmpii_simd_level();
+    kernels->swap8(dst, src, nn);
+}
+
+/*----< ncmpii_putn_swap_float_double() >-----------------------------------*/
+/* type-cast double to float and byte-swap into external buffer xp. Return the
+ * number of leading elements converted.
+ */
+MPI_Offset
+ncmpii_putn_swap_float_double(void *xp, const double *ip, MPI_Offset nn)
+{
+    if (kernels == NULL) ncmpii_simd_level();
+    return kernels->put_float_double(xp, ip, nn);
+}
+
+/*----< ncmpii_putn_swap_short_int() >--------------------------------------*/
+MPI_Offset
+ncmpii_putn_swap_short_int(void *xp, const int *ip, MPI_Offset nn)
+{
+    if (kernels == NULL) ncmpii_simd_level();
+    return kernels->put_short_int(xp, ip, nn);
+}
+
+/*----< ncmpii_getn_swap_float_double() >-----------------------------------*/
+/* byte-swap external floats in xp and type-cast them to double */
+void
+ncmpii_getn_swap_float_double(double *ip, const void *xp, MPI_Offset nn)
+{
+    if (kernels == NULL) ncmpii_simd_level();
+    kernels->get_float_double(ip, xp, nn);
+}
+
+/*----< ncmpii_getn_swap_short_int() >--------------------------------------*/
+void
+ncmpii_getn_swap_short_int(int *ip, const void *xp, MPI_Offset nn)
+{
+    if (kernels == NULL) ncmpii_simd_level();
+    kernels->get_short_int(ip, xp, nn);
+}
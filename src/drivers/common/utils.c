@@ -59,3 +59,102 @@ ncmpii_xlen_nc_type(nc_type xtype, int *size)
         default: DEBUG_RETURN_ERROR(NC_EBADTYPE);
     }
 }
+
+/*----< ncmpii_hash64() >----------------------------------------------------*/
+/* Return a 64-bit hash of len bytes in buf, computed by the XXH64 algorithm
+ * of xxHash (https://github.com/Cyan4973/xxHash). Bytes are read in the
+ * little Endian order, so the hash is the same on all platforms.
+ */
+#define PRIME64_1 11400714785074694791ULL
+#define PRIME64_2 14029467366897019727ULL
+#define PRIME64_3  1609587929392839161ULL
+#define PRIME64_4  9650029242287828579ULL
+#define PRIME64_5  2870177450012600261ULL
+#define ROTL64(x, r) (((x) << (r)) | ((x) >> (64 - (r))))
+
+static unsigned long long
+read64(const unsigned char *p)
+{
+    unsigned long long v=0;
+    int i;
+    for (i=7; i>=0; i--) v = (v << 8) | p[i];
+    return v;
+}
+
+static unsigned long long
+hash_round(unsigned long long acc, unsigned long long input)
+{
+    acc += input * PRIME64_2;
+    acc  = ROTL64(acc, 31);
+    return acc * PRIME64_1;
+}
+
+static unsigned long long
+hash_merge(unsigned long long acc, unsigned long long val)
+{
+    acc ^= hash_round(0, val);
+    return acc * PRIME64_1 + PRIME64_4;
+}
+
+unsigned long long
+ncmpii_hash64(const void         *buf,
+              size_t              len,
+              unsigned long long  seed)
+{
+    const unsigned char *p = (const unsigned char*)buf;
+    const unsigned char *end = p + len;
+    unsigned long long h;
+
+    if (len >= 32) {
+        unsigned long long v1 = seed + PRIME64_1 + PRIME64_2;
+        unsigned long long v2 = seed + PRIME64_2;
+        unsigned long long v3 = seed;
+        unsigned long long v4 = seed - PRIME64_1;
+        const unsigned char *limit = end - 32;
+
+        do {
+            v1 = hash_round(v1, read64(p));    p += 8;
+            v2 = hash_round(v2, read64(p));    p += 8;
+            v3 = hash_round(v3, read64(p));    p += 8;
+            v4 = hash_round(v4, read64(p));    p += 8;
+        } while (p <= limit);
+
+        h = ROTL64(v1, 1) + ROTL64(v2, 7) + ROTL64(v3, 12) + ROTL64(v4, 18);
+        h = hash_merge(h, v1);
+        h = hash_merge(h, v2);
+        h = hash_merge(h, v3);
+        h = hash_merge(h, v4);
+    }
+    else
+        h = seed + PRIME64_5;
+
+    h += (unsigned long long)len;
+
+    while (p + 8 <= end) {
+        h ^= hash_round(0, read64(p));
+        h  = ROTL64(h, 27) * PRIME64_1 + PRIME64_4;
+        p += 8;
+    }
+    if (p + 4 <= end) {
+        unsigned long long v = (unsigned long long)p[0]
+                             | ((unsigned long long)p[1] << 8)
+                             | ((unsigned long long)p[2] << 16)
+                             | ((unsigned long long)p[3] << 24);
+        h ^= v * PRIME64_1;
+        h  = ROTL64(h, 23) * PRIME64_2 + PRIME64_3;
+        p += 4;
+    }
+    while (p < end) {
+        h ^= (*p) * PRIME64_5;
+        h  = ROTL64(h, 11) * PRIME64_1;
+        p++;
+    }
+
+    /* final avalanche */
+    h ^= h >> 33;
+    h *= PRIME64_2;
+    h ^= h >> 29;
+    h *= PRIME64_3;
+    h ^= h >> 32;
+    return h;
+}
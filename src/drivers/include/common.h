@@ -83,6 +83,25 @@ ncmpii_inq_malloc_max_size(size_t *size);
 extern int
 ncmpii_inq_malloc_list(void);
 
+/* pool of reusable temporary buffers, see buf_pool.c */
+typedef struct ncmpii_buf_pool ncmpii_buf_pool;
+
+extern ncmpii_buf_pool *
+ncmpii_pool_create(size_t cap);
+
+extern void
+ncmpii_pool_destroy(ncmpii_buf_pool *pool);
+
+extern void *
+ncmpii_pool_malloc(ncmpii_buf_pool *pool, size_t size);
+
+extern void
+ncmpii_pool_free(ncmpii_buf_pool *pool, void *buf);
+
+extern void
+ncmpii_pool_stats(const ncmpii_buf_pool *pool, MPI_Offset *hits,
+                  MPI_Offset *misses, MPI_Offset *max_size);
+
 extern int
 ncmpii_dtype_decode(MPI_Datatype dtype, MPI_Datatype *ptype, int *el_size,
                     MPI_Offset *nelems, int *isderived,
@@ -108,6 +127,9 @@ ncmpii_nc2mpitype(nc_type xtype);
 extern int
 ncmpii_xlen_nc_type(nc_type xtype, int *size);
 
+extern unsigned long long
+ncmpii_hash64(const void *buf, size_t len, unsigned long long seed);
+
 extern int
 ncmpii_buftype_decode(int ndims, nc_type xtype, const MPI_Offset *count,
                       MPI_Offset bufcount, MPI_Datatype buftype,
@@ -136,6 +158,46 @@ ncmpii_need_convert(int format, nc_type xtype, MPI_Datatype mpitype);
 extern void
 ncmpii_in_swapn(void *buf, MPI_Offset nelems, int esize);
 
+/* levels of SIMD kernels for byte swap and type conversion */
+#define NCMPII_SIMD_NONE   0
+#define NCMPII_SIMD_SSE41  1
+#define NCMPII_SIMD_AVX2   2
+#define NCMPII_SIMD_AVX512 3
+#define NCMPII_SIMD_NEON   4
+
+/* number of elements checked at once by the fused type-cast kernels */
+#define NCMPII_SIMD_BLOCK 16
+
+extern int
+ncmpii_simd_level(void);
+
+extern int
+ncmpii_simd_set_level(int level);
+
+extern const char *
+ncmpii_simd_name(int level);
+
+extern void
+ncmpii_swapn2b(void *dst, const void *src, MPI_Offset nn);
+
+extern void
+ncmpii_swapn4b(void *dst, const void *src, MPI_Offset nn);
+
+extern void
+ncmpii_swapn8b(void *dst, const void *src, MPI_Offset nn);
+
+extern MPI_Offset
+ncmpii_putn_swap_float_double(void *xp, const double *ip, MPI_Offset nn);
+
+extern MPI_Offset
+ncmpii_putn_swap_short_int(void *xp, const int *ip, MPI_Offset nn);
+
+extern void
+ncmpii_getn_swap_float_double(double *ip, const void *xp, MPI_Offset nn);
+
+extern void
+ncmpii_getn_swap_short_int(int *ip, const void *xp, MPI_Offset nn);
+
 extern int
 ncmpii_putn_NC_CHAR  (void *xbuf, const void *buf, MPI_Offset nelems,
                       MPI_Datatype datatype);
@@ -275,6 +275,43 @@ int ncdwio_bufferedfile_pread(NC_dw_bufferedfile *f, void *buf, size_t count, of
     return ncdwio_sharedfile_pread(f->fd, buf, count, offset);
 }
 
+/*
+ * This function starts reading <count> bytes of data to buffer <buf> from the
+ * file at position specified by <offset>
+ * The file position is not changed
+ * IN       f:    File handle
+ * OUT    buf:    Buffer of data to be read
+ * IN   count:    Number of bytes to read
+ * IN  offset:    Starting read position
+ * OUT    req:    Request to wait for with ncdwio_sharedfile_wait
+ *
+ * We flush the buffer before read so data in the buffer can be reflected
+ */
+int ncdwio_bufferedfile_iread(NC_dw_bufferedfile *f, void *buf, size_t count, off_t offset, NC_dw_sharedfile_req *req){
+    int err;
+
+    if (f->buffer != NULL){
+        // Flush the buffer
+        if (f->bused - f->bunused > 0){
+            // Write data to file, skipping unused part
+            err = ncdwio_sharedfile_write(f->fd, f->buffer + f->bunused, f->bsize - f->bunused);
+            if (err != NC_NOERR){
+                return err;
+            }
+            // Reset buffer status
+            f->bused = 0;
+            f->bunused = 0;
+        }
+    }
+
+    // Record the file size as the largest location ever reach by IO operation
+    if (f->fsize < offset + count){
+        f->fsize = offset + count;
+    }
+
+    return ncdwio_sharedfile_iread(f->fd, buf, count, offset, req);
+}
+
 /*
  * This function read <count> bytes of data to buffer <buf> from the file at it's
  * current file position and increase the file position by <count>
@@ -67,7 +67,22 @@ static PNC_driver ncdwio_driver = {
     ncdwio_buffer_attach,
     ncdwio_buffer_detach,
     ncdwio_wait,
-    ncdwio_cancel
+    ncdwio_cancel,
+
+    ncdwio_getput_init,
+    ncdwio_start,
+    ncdwio_request_free,
+    ncdwio_inq_stats,
+    ncdwio_inq_var_stats,
+    ncdwio_inq_buf_pool_stats,
+
+    ncdwio_wait_start,
+    ncdwio_wait_test,
+    ncdwio_wait_end,
+
+    ncdwio_iget_vard,
+    ncdwio_iput_vard,
+    ncdwio_bput_vard
 };
 
 PNC_driver* ncdwio_inq_driver(void) {
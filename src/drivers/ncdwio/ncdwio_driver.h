@@ -13,6 +13,9 @@
 #include <dispatch.h>
 #include <limits.h>
 #include <unistd.h>
+#ifdef HAVE_AIO
+#include <aio.h>
+#endif
 
 #define NC_LOG_TYPE_TEXT 1
 #define NC_LOG_TYPE_SCHAR 2
@@ -101,12 +104,6 @@ typedef struct NC_dw_metadataptr {
     int reqid;
 } NC_dw_metadataptr;
 
-typedef struct NC_dw_metadataidx {
-    NC_dw_metadataptr *entries;
-    int nused;
-    int nalloc;
-} NC_dw_metadataidx;
-
 /* Buffer structure */
 typedef struct NC_dw_buffer {
     size_t nalloc;
@@ -128,6 +125,14 @@ typedef struct NC_dw_intvector {
     int *values;
 } NC_dw_intvector;
 
+typedef struct NC_dw_metadataidx {
+    NC_dw_metadataptr *entries;
+    int nused;
+    int nalloc;
+    NC_dw_intvector *varents;   /* Index of entries of each variable, in log order */
+    int nvars;  /* Number of variables in varents */
+} NC_dw_metadataidx;
+
 /* Put_req structure */
 typedef struct NC_dw_put_req {
     int valid;  // If this request object is in use (corresponding to some nonblocking request)
@@ -155,6 +160,14 @@ typedef struct NC_dw_sharedfile {
     size_t fsize;   // Current file size
 } NC_dw_sharedfile;
 
+/* Asynchronous read on a shared file */
+typedef struct NC_dw_sharedfile_req {
+    int ncbs;   // Number of control blocks, one per block of the shared file
+#ifdef HAVE_AIO
+    struct aiocb *cbs;  // POSIX AIO control blocks
+#endif
+} NC_dw_sharedfile_req;
+
 /* File structure */
 typedef struct NC_dw_bufferedfile {
     NC_dw_sharedfile *fd;    // Shared file
@@ -191,6 +204,13 @@ typedef struct NC_dw {
     MPI_Offset recdimsize;
     MPI_Offset flushbuffersize;
     MPI_Offset maxentrysize;
+    int nflushed;   /* Number of leading log entries already replayed */
+    size_t flushedsize; /* End of the replayed part of data log */
+    MPI_Offset flushhighwm; /* Pending data size that triggers a drain */
+    MPI_Offset flushlowwm;  /* Pending data size a drain stops at */
+    int mergefrom;  /* First log entry a new put can be merged into */
+    int waitpending;    /* If a split-phase wait is started */
+    int waitstatus;     /* Error of the split-phase wait */
 #ifdef PNETCDF_PROFILING
     /* Profiling information */
     MPI_Offset total_data;
@@ -228,11 +248,16 @@ char* ncdwio_log_buffer_alloc(NC_dw_buffer *bp, size_t size);
 int ncdwio_log_sizearray_init(NC_dw_sizevector *sp);
 void ncdwio_log_sizearray_free(NC_dw_sizevector *sp);
 int ncdwio_log_sizearray_append(NC_dw_sizevector *sp, size_t size);
+int logtype2mpitype(int type, MPI_Datatype *buftype);
 int log_flush(NC_dw *ncdwp);
+int log_flush_entries(NC_dw *ncdwp, int end);
 int ncdwio_log_create(NC_dw *ncdwp, MPI_Info info);
 int ncdwio_log_put_var(NC_dw *ncdwp, int varid, const MPI_Offset start[], const MPI_Offset count[], const MPI_Offset stride[], void *buf, MPI_Datatype buftype, MPI_Offset *putsize);
 int ncdwio_log_close(NC_dw *ncdwp);
 int ncdwio_log_flush(NC_dw *ncdwp);
+int ncdwio_log_drain(NC_dw *ncdwp, int reqMode);
+int ncdwio_log_get_begin(NC_dw *ncdwp, int varid, int num, MPI_Offset* const *starts, MPI_Offset* const *counts, const MPI_Offset *stride, MPI_Datatype buftype, int reqMode, int *overlap);
+int ncdwio_log_get_var(NC_dw *ncdwp, int varid, const MPI_Offset start[], const MPI_Offset count[], const MPI_Offset stride[], void *buf, MPI_Datatype buftype);
 int ncdwio_log_enddef(NC_dw *ncdwp);
 
 int ncdwio_put_list_init(NC_dw *ncdwp);
@@ -246,6 +271,7 @@ int ncdwio_cancel_put_req(NC_dw *ncdwp, int reqid, int *stat);
 int ncdwio_cancel_all_put_req(NC_dw *ncdwp);
 int ncdwio_metaidx_init(NC_dw *ncdwp);
 int ncdwio_metaidx_add(NC_dw *ncdwp, NC_dw_metadataentry *entry);
+int ncdwio_metaidx_reset(NC_dw *ncdwp);
 int ncdwio_metaidx_free(NC_dw *ncdwp);
 int ncdwio_log_intvector_init(NC_dw_intvector *vp);
 void ncdwio_log_intvector_free(NC_dw_intvector *vp);
@@ -257,6 +283,8 @@ int ncdwio_sharedfile_pwrite(NC_dw_sharedfile *f, void *buf, size_t count, off_t
 int ncdwio_sharedfile_write(NC_dw_sharedfile *f, void *buf, size_t count);
 int ncdwio_sharedfile_pread(NC_dw_sharedfile *f, void *buf, size_t count, off_t offset);
 int ncdwio_sharedfile_read(NC_dw_sharedfile *f, void *buf, size_t count);
+int ncdwio_sharedfile_iread(NC_dw_sharedfile *f, void *buf, size_t count, off_t offset, NC_dw_sharedfile_req *req);
+int ncdwio_sharedfile_wait(NC_dw_sharedfile_req *req);
 int ncdwio_sharedfile_seek(NC_dw_sharedfile *f, off_t offset, int whence);
 
 int ncdwio_bufferedfile_open(MPI_Comm comm, char *path, int flag, MPI_Info info, NC_dw_bufferedfile **fh);
@@ -265,6 +293,7 @@ int ncdwio_bufferedfile_pwrite(NC_dw_bufferedfile *f, void *buf, size_t count, o
 int ncdwio_bufferedfile_write(NC_dw_bufferedfile *f, void *buf, size_t count);
 int ncdwio_bufferedfile_pread(NC_dw_bufferedfile *f, void *buf, size_t count, off_t offset);
 int ncdwio_bufferedfile_read(NC_dw_bufferedfile *f, void *buf, size_t count);
+int ncdwio_bufferedfile_iread(NC_dw_bufferedfile *f, void *buf, size_t count, off_t offset, NC_dw_sharedfile_req *req);
 int ncdwio_bufferedfile_seek(NC_dw_bufferedfile *f, off_t offset, int whence);
 
 void ncdwio_extract_hint(NC_dw *ncdwp, MPI_Info info);
@@ -420,4 +449,40 @@ ncdwio_wait(void *ncdp, int num_reqs, int *req_ids, int *statuses, int reqMode);
 extern int
 ncdwio_cancel(void *ncdp, int num_reqs, int *req_ids, int *statuses);
 
+extern int
+ncdwio_getput_init(void *ncdp, int varid, const MPI_Offset *start, const MPI_Offset *count, const void *buf, MPI_Offset bufcount, MPI_Datatype buftype, int *request, int reqMode);
+
+extern int
+ncdwio_start(void *ncdp, int request, MPI_Offset recno, int reqMode);
+
+extern int
+ncdwio_request_free(void *ncdp, int request);
+
+extern int
+ncdwio_inq_stats(void *ncdp, MPI_Offset *put_counts, MPI_Offset *put_bytes, MPI_Offset *get_counts, MPI_Offset *get_bytes, double *timings);
+
+extern int
+ncdwio_inq_var_stats(void *ncdp, int varid, MPI_Offset *put_hist, MPI_Offset *get_hist);
+
+extern int
+ncdwio_inq_buf_pool_stats(void *ncdp, MPI_Offset *hits, MPI_Offset *misses, MPI_Offset *max_size);
+
+extern int
+ncdwio_wait_start(void *ncdp, int num_reqs, int *req_ids, int *statuses);
+
+extern int
+ncdwio_wait_test(void *ncdp, int *flag);
+
+extern int
+ncdwio_wait_end(void *ncdp);
+
+extern int
+ncdwio_iget_vard(void *ncdp, int varid, MPI_Datatype filetype, void *buf, MPI_Offset bufcount, MPI_Datatype buftype, int *reqid, int reqMode);
+
+extern int
+ncdwio_iput_vard(void *ncdp, int varid, MPI_Datatype filetype, const void *buf, MPI_Offset bufcount, MPI_Datatype buftype, int *reqid, int reqMode);
+
+extern int
+ncdwio_bput_vard(void *ncdp, int varid, MPI_Datatype filetype, const void *buf, MPI_Offset bufcount, MPI_Datatype buftype, int *reqid, int reqMode);
+
 #endif
@@ -21,6 +21,17 @@
  * ncmpi_wait()             : dispatcher->wait()
  * ncmpi_wait_all()         : dispatcher->wait()
  * ncmpi_cancel()           : dispatcher->cancel()
+ * ncmpi_put_vara_init()    : dispatcher->getput_init()
+ * ncmpi_get_vara_init()    : dispatcher->getput_init()
+ * ncmpi_start()            : dispatcher->start()
+ * ncmpi_start_all()        : dispatcher->start()
+ * ncmpi_request_free()     : dispatcher->request_free()
+ * ncmpi_inq_stats()        : dispatcher->inq_stats()
+ * ncmpi_inq_var_stats()    : dispatcher->inq_var_stats()
+ * ncmpi_inq_buf_pool_stats(): dispatcher->inq_buf_pool_stats()
+ * ncmpi_wait_start()       : dispatcher->wait_start()
+ * ncmpi_wait_test()        : dispatcher->wait_test()
+ * ncmpi_wait_end()         : dispatcher->wait_end()
  *
  * ncmpi_set_fill()         : dispatcher->set_fill()
  * ncmpi_fill_var_rec()     : dispatcher->fill_rec()
@@ -79,6 +90,7 @@ ncdwio_create(MPI_Comm     comm,
     ncdwp->ncmpio_driver = driver;  // ncmpio driver
     ncdwp->ncid = ncid;
     ncdwp->isindep = 0; // Start at collective mode
+    ncdwp->waitpending = 0; // No split-phase wait started
     ncdwp->ncp = ncp;   // NC object used by ncmpio driver
     ncdwp->recdimsize = 0;
     ncdwp->recdimid = -1;   // Id of record dimension
@@ -135,6 +147,7 @@ ncdwio_open(MPI_Comm     comm,
     ncdwp->ncmpio_driver = driver;  // ncmpio driver
     ncdwp->ncid = ncid;
     ncdwp->isindep = 0; // Start at collective mode
+    ncdwp->waitpending = 0; // No split-phase wait started
     ncdwp->ncp = ncp;   // NC object used by ncmpio driver
     ncdwp->recdimsize = 0;
     ncdwp->recdimid = -1;   // Id of record dimension
@@ -433,13 +446,13 @@ ncdwio_inq_misc(void       *ncdp,
                                 get_size, info_used, nreqs, usage, buf_size);
     if (err != NC_NOERR) return err;
 
-    /* Data that is pending in the log is not counted by the ncmpio driver, we add the size of data in the log to put size
+    /* Data that is pending in the log is not counted by the ncmpio driver, we add the size of data not yet replayed to put size
      * ncmpio driver does not handle put requests, we add number of pending put requests to ureqs
      */
     if (ncdwp->inited) {
         /* Add the size of data log to reflect pending put in the log */
         if (put_size != NULL){
-            *put_size += (MPI_Offset)ncdwp->datalogsize - 8;
+            *put_size += (MPI_Offset)(ncdwp->datalogsize - ncdwp->flushedsize);
 
         }
 
@@ -500,12 +513,10 @@ ncdwio_cancel(void *ncdp,
                 status = err;
             }
         }
-        // Cancel all get requests
-        if (num_req == NC_REQ_ALL || num_req == NC_GET_REQ_ALL){
-            err = ncdwp->ncmpio_driver->cancel(ncdwp->ncp, num_req, NULL, NULL);
-            if (status == NC_NOERR){
-                status = err;
-            }
+        // Cancel all get requests and vard put requests posted to ncmpio
+        err = ncdwp->ncmpio_driver->cancel(ncdwp->ncp, num_req, NULL, NULL);
+        if (status == NC_NOERR){
+            status = err;
         }
 
         return status;
@@ -664,12 +675,10 @@ ncdwio_wait(void *ncdp,
                 status = err;
             }
         }
-        // Cancel all get requests
-        if (num_reqs == NC_REQ_ALL || num_reqs == NC_GET_REQ_ALL){
-            err = ncdwp->ncmpio_driver->wait(ncdwp->ncp, num_reqs, NULL, NULL, reqMode);
-            if (status == NC_NOERR){
-                status = err;
-            }
+        // Wait for all get requests and vard put requests posted to ncmpio
+        err = ncdwp->ncmpio_driver->wait(ncdwp->ncp, num_reqs, NULL, NULL, reqMode);
+        if (status == NC_NOERR){
+            status = err;
         }
 
         return status;
@@ -856,3 +865,146 @@ ncdwio_sync(void *ncdp)
     return NC_NOERR;
 }
 
+
+int
+ncdwio_getput_init(void             *ncdp,
+                   int               varid,
+                   const MPI_Offset *start,
+                   const MPI_Offset *count,
+                   const void       *buf,
+                   MPI_Offset        bufcount,
+                   MPI_Datatype      buftype,
+                   int              *request,
+                   int               reqMode)
+{
+    NC_dw *ncdwp = (NC_dw*)ncdp;
+
+    return ncdwp->ncmpio_driver->getput_init(ncdwp->ncp, varid, start, count,
+                                             buf, bufcount, buftype, request,
+                                             reqMode);
+}
+
+/*
+ * Persistent requests are carried out by the ncmpio driver directly, so the
+ * log is flushed first to keep the data written in order
+ */
+int
+ncdwio_start(void       *ncdp,
+             int         request,
+             MPI_Offset  recno,
+             int         reqMode)
+{
+    int err, status = NC_NOERR;
+    NC_dw *ncdwp = (NC_dw*)ncdp;
+
+    if (ncdwp->inited) {
+        err = ncdwio_log_flush(ncdwp);
+        if (status == NC_NOERR) status = err;
+    }
+
+    err = ncdwp->ncmpio_driver->start(ncdwp->ncp, request, recno, reqMode);
+    if (status == NC_NOERR) status = err;
+
+    return status;
+}
+
+int
+ncdwio_request_free(void *ncdp,
+                    int   request)
+{
+    NC_dw *ncdwp = (NC_dw*)ncdp;
+
+    return ncdwp->ncmpio_driver->request_free(ncdwp->ncp, request);
+}
+
+/*
+ * The statistics are those of the ncmpio driver, i.e. of the requests flushed
+ * from the log to the file
+ */
+int
+ncdwio_inq_stats(void       *ncdp,
+                 MPI_Offset *put_counts,
+                 MPI_Offset *put_bytes,
+                 MPI_Offset *get_counts,
+                 MPI_Offset *get_bytes,
+                 double     *timings)
+{
+    NC_dw *ncdwp = (NC_dw*)ncdp;
+
+    return ncdwp->ncmpio_driver->inq_stats(ncdwp->ncp, put_counts, put_bytes,
+                                           get_counts, get_bytes, timings);
+}
+
+int
+ncdwio_inq_var_stats(void       *ncdp,
+                     int         varid,
+                     MPI_Offset *put_hist,
+                     MPI_Offset *get_hist)
+{
+    NC_dw *ncdwp = (NC_dw*)ncdp;
+
+    return ncdwp->ncmpio_driver->inq_var_stats(ncdwp->ncp, varid, put_hist,
+                                               get_hist);
+}
+
+/*
+ * The log is written without temporary buffers, so the pool is that of the
+ * ncmpio driver
+ */
+int
+ncdwio_inq_buf_pool_stats(void       *ncdp,
+                          MPI_Offset *hits,
+                          MPI_Offset *misses,
+                          MPI_Offset *max_size)
+{
+    NC_dw *ncdwp = (NC_dw*)ncdp;
+
+    return ncdwp->ncmpio_driver->inq_buf_pool_stats(ncdwp->ncp, hits, misses,
+                                                    max_size);
+}
+
+/*
+ * Put requests are written to the log, so the split-phase wait is carried
+ * out at the start and its error is returned at the end
+ */
+int
+ncdwio_wait_start(void *ncdp,
+                  int   num_reqs,
+                  int  *req_ids,
+                  int  *statuses)
+{
+    NC_dw *ncdwp = (NC_dw*)ncdp;
+
+    if (ncdwp->waitpending) DEBUG_RETURN_ERROR(NC_EPENDING)
+
+    ncdwp->waitstatus = ncdwio_wait(ncdwp, num_reqs, req_ids, statuses,
+                                    NC_REQ_COLL);
+    ncdwp->waitpending = 1;
+
+    return NC_NOERR;
+}
+
+int
+ncdwio_wait_test(void *ncdp,
+                 int  *flag)
+{
+    NC_dw *ncdwp = (NC_dw*)ncdp;
+
+    if (!ncdwp->waitpending) DEBUG_RETURN_ERROR(NC_EINVAL_REQUEST)
+
+    *flag = 1;
+
+    return NC_NOERR;
+}
+
+int
+ncdwio_wait_end(void *ncdp)
+{
+    NC_dw *ncdwp = (NC_dw*)ncdp;
+
+    if (!ncdwp->waitpending) DEBUG_RETURN_ERROR(NC_EINVAL_REQUEST)
+
+    ncdwp->waitpending = 0;
+
+    return ncdwp->waitstatus;
+}
@@ -308,6 +308,9 @@ int ncdwio_log_create(NC_dw* ncdwp, MPI_Info info) {
     }
 
     ncdwp->datalogsize = 8;
+    ncdwp->flushedsize = 8;
+    ncdwp->nflushed = 0;
+    ncdwp->mergefrom = 0;
 
 #ifdef PNETCDF_PROFILING
     t2 = MPI_Wtime();
@@ -547,7 +550,7 @@ int ncdwio_log_flush(NC_dw* ncdwp) {
     /* Reset metadata buffer and entry array status */
     ncdwp->metadata.nused = headerp->entry_begin;
     ncdwp->entrydatasize.nused = 0;
-    ncdwp->metaidx.nused = 0;
+    ncdwio_metaidx_reset(ncdwp);
 
     /* Rewind data log file descriptors and reset the size */
     err = ncdwio_bufferedfile_seek(ncdwp->datalog_fd, 8, SEEK_SET);
@@ -556,6 +559,9 @@ int ncdwio_log_flush(NC_dw* ncdwp) {
     }
 
     ncdwp->datalogsize = 8;
+    ncdwp->flushedsize = 8;
+    ncdwp->nflushed = 0;
+    ncdwp->mergefrom = 0;
 
 #ifdef PNETCDF_PROFILING
     t2 = MPI_Wtime();
@@ -565,3 +571,71 @@ int ncdwio_log_flush(NC_dw* ncdwp) {
 
     return status;
 }
+
+/*
+ * Replay the oldest log entries when the size of data pending in the log
+ * exceeds the high watermark, until it drops to the low watermark
+ * Replayed entries stay in the log until the next ncdwio_log_flush, so the
+ * log can still be used for restoration
+ * It is called by blocking put, so the cost of replaying a large log is
+ * spread over the puts instead of stalling the program at wait, sync, or
+ * close. Entries created by nonblocking put are linked to their request only
+ * after the put returns, so nonblocking put never triggers a drain
+ * In collective data mode, all processes must call this function together
+ * IN    ncdwp:    log structure
+ * IN    reqMode:    request mode of the put operation
+ */
+int ncdwio_log_drain(NC_dw *ncdwp, int reqMode) {
+    int err, end, drain, drain_all;
+    size_t pending;
+#ifdef PNETCDF_PROFILING
+    double t1, t2;
+#endif
+
+    /* Drain is disabled by default */
+    if (ncdwp->flushhighwm <= 0 || !(reqMode & NC_REQ_BLK)){
+        return NC_NOERR;
+    }
+
+#ifdef PNETCDF_PROFILING
+    t1 = MPI_Wtime();
+#endif
+
+    pending = ncdwp->datalogsize - ncdwp->flushedsize;
+    drain = (pending > (size_t)ncdwp->flushhighwm) ? 1 : 0;
+
+    /* In collective mode, replay is collective, all processes must agree
+     * Processes below the high watermark also drain down to the low watermark
+     */
+    if (!ncdwp->isindep){
+        err = MPI_Allreduce(&drain, &drain_all, 1, MPI_INT, MPI_LOR, ncdwp->comm);
+        if (err != MPI_SUCCESS){
+            DEBUG_RETURN_ERROR(ncmpii_error_mpi2nc(err, "MPI_Allreduce"));
+        }
+        drain = drain_all;
+    }
+
+    if (!drain){
+        return NC_NOERR;
+    }
+
+    /* Find the first entry after which the pending data is no more than the
+     * low watermark
+     */
+    for (end = ncdwp->nflushed; end < ncdwp->metaidx.nused; end++){
+        if (pending <= (size_t)ncdwp->flushlowwm){
+            break;
+        }
+        pending -= ncdwp->entrydatasize.values[end];
+    }
+
+    err = log_flush_entries(ncdwp, end);
+
+#ifdef PNETCDF_PROFILING
+    t2 = MPI_Wtime();
+    ncdwp->total_time += t2 - t1;
+    ncdwp->flush_time += t2 - t1;
+#endif
+
+    return err;
+}
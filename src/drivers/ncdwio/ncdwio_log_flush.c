@@ -28,7 +28,6 @@
 /* Convert from log type to MPI type used by pnetcdf library
  * Log spec has different enum of types than MPI
  */
-int logtype2mpitype(int type, MPI_Datatype *buftype);
 int logtype2mpitype(int type, MPI_Datatype *buftype){
     /* Convert from log type to MPI type used by pnetcdf library
      * Log spec has different enum of types than MPI
@@ -79,129 +78,165 @@ int logtype2mpitype(int type, MPI_Datatype *buftype){
  * IN    ncdwp:    log structure
  */
 int log_flush(NC_dw *ncdwp) {
-    int i, j, lb, ub, err, status = NC_NOERR;
+    return log_flush_entries(ncdwp, ncdwp->metaidx.nused);
+}
+
+/*
+ * Find the log entries replayed in the batch starting at entry <lb>
+ * A batch takes as many entries as the data buffer can hold, but at least one.
+ * The data of canceled entries in the batch are read but not replayed.
+ * IN    ncdwp:    log structure
+ * IN    lb:    first entry of the batch
+ * IN    end:    index of the first log entry not to replay
+ * IN    bsize:    size of the data buffer
+ * OUT   len:    size of data of the batch in the data log
+ * Return the index of the first entry after the batch
+ */
+static int next_batch(NC_dw *ncdwp, int lb, int end, size_t bsize, size_t *len){
+    int ub;
+    size_t used = 0;
+
+    for (ub = lb; ub < end; ub++) {
+        if (ub > lb && used + ncdwp->entrydatasize.values[ub] > bsize) {
+            break;  // Buffer full
+        }
+        used += ncdwp->entrydatasize.values[ub];
+    }
+    *len = used;
+
+    return ub;
+}
+
+/*
+ * Commit log entries from the first entry not yet replayed up to (excluding)
+ * entry <end> into CDF file
+ * Entries before ncdwp->nflushed are already replayed by an earlier call,
+ * they are skipped. In collective mode, all processes must call this function
+ * together, but they can replay different number of entries
+ * The log is replayed in batches that fit in the data buffer. Two data
+ * buffers are used in turn, so the data of the next batch is read from the
+ * data log while the current batch is written to the CDF file
+ * IN    ncdwp:    log structure
+ * IN    end:    index of the first log entry not to replay
+ */
+int log_flush_entries(NC_dw *ncdwp, int end) {
+    int i, j, lb, ub, nub, cur, err, status = NC_NOERR;
     int *reqids, *stats;
     int ready, ready_all;
-    size_t databufferused, databuffersize, dataread;
-    NC_dw_metadataentry *entryp;
+    size_t databuffersize, dataoff, len, nlen;
+    NC_dw_metadataentry *entryp = NULL;
     MPI_Offset *start, *count, *stride;
     MPI_Datatype buftype;
-    char *databuffer, *databufferoff;
-    NC_dw_metadataheader *headerp;
+    char *databuffer[2], *databufferoff;
+    NC_dw_sharedfile_req readreq[2];
     NC_dw_metadataptr *ip;
+    NC_dw_put_req *req;
 #ifdef PNETCDF_PROFILING
     double t1, t2, t3, t4;
 
     t1 = MPI_Wtime();
 #endif
 
+    lb = ncdwp->nflushed;
+    if (end > ncdwp->metaidx.nused) {
+        end = ncdwp->metaidx.nused;
+    }
+
     /* Read datalog in to memory */
     /*
      * Prepare data buffer
      * We determine the data buffer size according to:
      * hints, size of data log, the largest size of single record
      * 0 in hint means no limit
-     * (Buffer size) = max((largest size of single record), min((size of data log), (size specified in hint)))
+     * The memory in hint is shared by the two data buffers
+     * (Buffer size) = max((largest size of single record), min((size of data log), (size specified in hint) / 2))
      */
-    databuffersize = ncdwp->datalogsize;
-    if (ncdwp->flushbuffersize > 0 && databuffersize > ncdwp->flushbuffersize){
-        databuffersize = ncdwp->flushbuffersize;
+    databuffersize = ncdwp->datalogsize - ncdwp->flushedsize;
+    if (ncdwp->flushbuffersize > 0 && databuffersize > ncdwp->flushbuffersize / 2){
+        databuffersize = ncdwp->flushbuffersize / 2;
     }
     if (databuffersize < ncdwp->maxentrysize){
         databuffersize = ncdwp->maxentrysize;
     }
 
-#ifdef PNETCDF_PROFILING
-    if (ncdwp->max_buffer < databuffersize){
-        ncdwp->max_buffer = databuffersize;
-    }
-#endif
-
-    /* Allocate buffer */
-    databuffer = (char*)NCI_Malloc(databuffersize);
-    if(databuffer == NULL){
+    /* Allocate buffers
+     * Buffer size can be 0 when there is nothing to replay
+     * The second buffer is only needed when there is more than one batch
+     */
+    databuffer[0] = (char*)NCI_Malloc(databuffersize);
+    if(databuffer[0] == NULL && databuffersize > 0){
         DEBUG_RETURN_ERROR(NC_ENOMEM);
     }
+    databuffer[1] = NULL;
+    if (databuffersize < ncdwp->datalogsize - ncdwp->flushedsize){
+        databuffer[1] = (char*)NCI_Malloc(databuffersize);
+        if(databuffer[1] == NULL){
+            NCI_Free(databuffer[0]);
+            DEBUG_RETURN_ERROR(NC_ENOMEM);
+        }
+    }
 
-    /* Seek to the start position of first data record */
-    err = ncdwio_bufferedfile_seek(ncdwp->datalog_fd, 8, SEEK_SET);
-    if (err != NC_NOERR){
-        return err;
+#ifdef PNETCDF_PROFILING
+    if (ncdwp->max_buffer < databuffersize * (databuffer[1] == NULL ? 1 : 2)){
+        ncdwp->max_buffer = databuffersize * (databuffer[1] == NULL ? 1 : 2);
     }
+#endif
 
-    /* Initialize buffer status */
-    databufferused = 0;
-    dataread = 0;
+    memset(readreq, 0, sizeof(readreq));
 
-    reqids = (int*)NCI_Malloc(ncdwp->entrydatasize.nused * SIZEOF_INT);
-    stats = (int*)NCI_Malloc(ncdwp->entrydatasize.nused * SIZEOF_INT);
+    reqids = (int*)NCI_Malloc((end - lb + 1) * SIZEOF_INT);
+    stats = (int*)NCI_Malloc((end - lb + 1) * SIZEOF_INT);
+
+    /* In collective mode, a process with nothing to replay still joins the
+     * collective wait below until every process is done
+     */
+    ready = (lb >= end) ? 1 : 0;
+    ready_all = 0;
+
+    /* Start reading the first batch */
+    cur = 0;
+    ub = nub = lb;
+    len = nlen = 0;
+    dataoff = ncdwp->flushedsize;
+    if (lb < end) {
+        ub = next_batch(ncdwp, lb, end, databuffersize, &len);
+        err = ncdwio_bufferedfile_iread(ncdwp->datalog_fd, databuffer[cur], len, dataoff, readreq + cur);
+        if (err != NC_NOERR){
+            status = err;
+            end = lb;
+            ready = 1;
+        }
+    }
 
     /*
      * Iterate through meta log entries
+     * Index stores entry location relative to the metadata buffer
      */
-    headerp = (NC_dw_metadataheader*)ncdwp->metadata.buffer;
-    entryp = (NC_dw_metadataentry*)(((char*)ncdwp->metadata.buffer) + headerp->entry_begin);
-    for (lb = 0; lb < ncdwp->metaidx.nused;){
-        for (ub = lb; ub < ncdwp->metaidx.nused; ub++) {
-            if (ncdwp->metaidx.entries[ub].valid){
-                if(ncdwp->entrydatasize.values[ub] + databufferused > databuffersize) {
-                    break;  // Buffer full
-                }
-                else{
-                    databufferused += ncdwp->entrydatasize.values[ub]; // Record size of entry
-                }
-            }
-            else{
-                // We encounter a canceled record
-                // Read unread data into data buffer and jump through the gap
-                /*
-                 * Read data to buffer
-                 * We read only what needed by pending requests
-                 */
-                if (dataread < databufferused){
-#ifdef PNETCDF_PROFILING
-                    t2 = MPI_Wtime();
-#endif
-                    err = ncdwio_bufferedfile_read(ncdwp->datalog_fd, databuffer + dataread, databufferused - dataread);
-                    if (err != NC_NOERR){
-                        return err;
-                    }
+    if (lb < end) {
+        entryp = (NC_dw_metadataentry*)(((char*)ncdwp->metadata.buffer) +
+                 (size_t)ncdwp->metaidx.entries[lb].ptr);
+    }
+    for (; lb < end;){
+        /* Wait for the data of this batch */
 #ifdef PNETCDF_PROFILING
-                    t3 = MPI_Wtime();
-                    ncdwp->flush_data_rd_time += t3 - t2;
+        t2 = MPI_Wtime();
 #endif
-                    dataread = databufferused;
-                }
-
-                // Skip canceled entry
-                err = ncdwio_bufferedfile_seek(ncdwp->datalog_fd, ncdwp->entrydatasize.values[ub], SEEK_CUR);
-                if (err != NC_NOERR){
-                    return err;
-                }
-            }
-        }
-
-        /*
-         * Read data to buffer
-         * We read only what needed by pending requests
-         */
-        if (dataread < databufferused){
+        err = ncdwio_sharedfile_wait(readreq + cur);
 #ifdef PNETCDF_PROFILING
-            t2 = MPI_Wtime();
+        t3 = MPI_Wtime();
+        ncdwp->flush_data_rd_time += t3 - t2;
 #endif
-            err = ncdwio_bufferedfile_read(ncdwp->datalog_fd, databuffer + dataread, databufferused - dataread);
-            if (err != NC_NOERR){
-                return err;
+        if (err != NC_NOERR){
+            /* Stop replaying, entries of this batch remain in the log */
+            if (status == NC_NOERR) {
+                status = err;
             }
-#ifdef PNETCDF_PROFILING
-            t3 = MPI_Wtime();
-            ncdwp->flush_data_rd_time += t3 - t2;
-#endif
-            dataread = databufferused;
+            ready = 1;
+            break;
         }
 
         // Pointer points to the data of current entry
-        databufferoff = databuffer;
+        databufferoff = databuffer[cur];
 
         j = 0;
         for(i = lb; i < ub; i++){
@@ -238,16 +273,38 @@ int log_flush(NC_dw *ncdwp) {
                 t3 = MPI_Wtime();
                 ncdwp->flush_put_time += t3 - t2;
 #endif
-
-                // Move to next data location
-                databufferoff += entryp->data_len;
                 j++;
             }
 
+            // Move to next data location, data of canceled entries is skipped
+            databufferoff += ncdwp->entrydatasize.values[i];
+
             /* Move to next position */
             entryp = (NC_dw_metadataentry*)(((char*)entryp) + entryp->esize);
         }
 
+        /* Start reading the next batch into the other buffer
+         * It is read while this batch is written
+         */
+        if (ub < end){
+#ifdef PNETCDF_PROFILING
+            t2 = MPI_Wtime();
+#endif
+            nub = next_batch(ncdwp, ub, end, databuffersize, &nlen);
+            err = ncdwio_bufferedfile_iread(ncdwp->datalog_fd, databuffer[cur ^ 1], nlen, dataoff + len, readreq + (cur ^ 1));
+            if (err != NC_NOERR){
+                /* Stop replaying after this batch */
+                if (status == NC_NOERR) {
+                    status = err;
+                }
+                end = ub;
+            }
+#ifdef PNETCDF_PROFILING
+            t3 = MPI_Wtime();
+            ncdwp->flush_data_rd_time += t3 - t2;
+#endif
+        }
+
 #ifdef PNETCDF_PROFILING
         t2 = MPI_Wtime();
 #endif
@@ -269,30 +326,43 @@ int log_flush(NC_dw *ncdwp) {
         ncdwp->flush_wait_time += t3 - t2;
 #endif
 
-        // Fill up the status for nonblocking request
+        /* Fill up the status for nonblocking request
+         * A request spanning multiple entries keeps the first error and only
+         * becomes ready when its last entry is replayed
+         */
+        j = 0;
         for(i = lb; i < ub; i++){
             ip = ncdwp->metaidx.entries + i;
-            j = 0;
             if (ip->valid) {
                 if (ip->reqid >= 0){
-                    ncdwp->putlist.reqs[ip->reqid].status = stats[j];
-                    ncdwp->putlist.reqs[ip->reqid].ready = 1;
+                    req = ncdwp->putlist.reqs + ip->reqid;
+                    if (req->status == NC_NOERR){
+                        req->status = stats[j];
+                    }
+                    if (i == req->entryend - 1){
+                        req->ready = 1;
+                    }
                 }
                 j++;
             }
+            ncdwp->flushedsize += ncdwp->entrydatasize.values[i];
         }
 
-        /* Update batch status */
-        databufferused = 0;
-
         // Mark as complete
         lb = ub;
+        ncdwp->nflushed = ub;
+
+        /* Move on to the batch being read */
+        ub = nub;
+        dataoff += len;
+        len = nlen;
+        cur ^= 1;
 
         /*
          * In case of collective flush, we sync our status with other processes
          */
         if (!ncdwp->isindep){
-            if (lb >= ncdwp->metaidx.nused){
+            if (lb >= end){
                 ready = 1;
             }
             else{
@@ -326,8 +396,23 @@ int log_flush(NC_dw *ncdwp) {
         }
     }
 
-    /* Free the data buffer */
-    NCI_Free(databuffer);
+    /* No read can be left in flight when the buffers are freed */
+    ncdwio_sharedfile_wait(readreq);
+    ncdwio_sharedfile_wait(readreq + 1);
+
+    /* Data log descriptor must point to the end of file for the next put */
+    err = ncdwio_bufferedfile_seek(ncdwp->datalog_fd, ncdwp->datalogsize, SEEK_SET);
+    if (status == NC_NOERR) {
+        status = err;
+    }
+
+    /* Free the data buffers */
+    if (databuffer[0] != NULL){
+        NCI_Free(databuffer[0]);
+    }
+    if (databuffer[1] != NULL){
+        NCI_Free(databuffer[1]);
+    }
     NCI_Free(reqids);
     NCI_Free(stats);
 
@@ -338,5 +423,3 @@ int log_flush(NC_dw *ncdwp) {
 
     return status;
 }
-
-
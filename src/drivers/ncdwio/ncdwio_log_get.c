@@ -0,0 +1,363 @@
+/*
+ *  Copyright (C) 2018, Northwestern University and Argonne National Laboratory
+ *  See COPYRIGHT notice in top-level directory.
+ */
+/* $Id$ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+#include <sys/types.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <pnc_debug.h>
+#include <common.h>
+#include <pnetcdf.h>
+#include <ncdwio_driver.h>
+
+/* Location of the i-th entry in the metadata buffer
+ * Index stores entry location relative to the metadata buffer
+ */
+#define LOG_ENTRY(ncdwp, i) ((NC_dw_metadataentry*)(((char*)(ncdwp)->metadata.buffer) + (size_t)(ncdwp)->metaidx.entries[i].ptr))
+
+/*
+ * Check if the bounding box of a log entry intersects a hyperslab
+ * count == NULL means one element in each dimension
+ * IN    entryp:    log entry
+ * IN    start, count, stride:    hyperslab
+ */
+static int
+entry_overlap(const NC_dw_metadataentry *entryp,
+              const MPI_Offset          *start,
+              const MPI_Offset          *count,
+              const MPI_Offset          *stride)
+{
+    int i;
+    MPI_Offset *estart, *ecount, *estride, ehi, cnt, hi;
+
+    estart = (MPI_Offset*)(entryp + 1);
+    ecount = estart + entryp->ndims;
+    estride = ecount + entryp->ndims;
+
+    for (i = 0; i < entryp->ndims; i++) {
+        cnt = (count == NULL) ? 1 : count[i];
+        if (cnt == 0 || ecount[i] == 0) {
+            return 0;
+        }
+        if (entryp->api_kind == NC_LOG_API_KIND_VARS) {
+            ehi = estart[i] + (ecount[i] - 1) * estride[i] + 1;
+        }
+        else {
+            ehi = estart[i] + ecount[i];
+        }
+        if (stride == NULL) {
+            hi = start[i] + cnt;
+        }
+        else {
+            hi = start[i] + (cnt - 1) * stride[i] + 1;
+        }
+        if (estart[i] >= hi || start[i] >= ehi) {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+/*
+ * Copy the elements of a log entry that fall in a hyperslab to the read
+ * buffer
+ * IN    entryp:    log entry
+ * IN    edata:    data of the log entry
+ * IN    start, count, stride:    hyperslab of the read
+ * IN    buf:    read buffer, contiguous in the hyperslab
+ * IN    elsize:    element size
+ */
+static int
+entry_copy(const NC_dw_metadataentry *entryp,
+           const char                *edata,
+           const MPI_Offset          *start,
+           const MPI_Offset          *count,
+           const MPI_Offset          *stride,
+           char                      *buf,
+           int                        elsize)
+{
+    int i, d, ndims = entryp->ndims, nruns;
+    MPI_Offset j, c, off, es, nmatch_all, *estart, *ecount, *estride;
+    MPI_Offset *ridx, *eidx, *nmatch, *moff, *pos, *rmul, *emul;
+    MPI_Offset *run_r, *run_e, *run_len, roff, eoff;
+
+    /* Scalar variable */
+    if (ndims == 0) {
+        memcpy(buf, edata, elsize);
+        return NC_NOERR;
+    }
+
+    estart = (MPI_Offset*)(entryp + 1);
+    ecount = estart + ndims;
+    estride = ecount + ndims;
+
+    /* Matched (request index, entry index) pairs of each dimension are
+     * stored in ridx and eidx, starting at moff[d]
+     */
+    nmatch_all = 0;
+    for (d = 0; d < ndims; d++) {
+        nmatch_all += count[d];
+    }
+    ridx = (MPI_Offset*)NCI_Malloc((nmatch_all * 2 + ndims * 5) * SIZEOF_MPI_OFFSET);
+    if (ridx == NULL) {
+        DEBUG_RETURN_ERROR(NC_ENOMEM);
+    }
+    eidx = ridx + nmatch_all;
+    nmatch = eidx + nmatch_all;
+    moff = nmatch + ndims;
+    pos = moff + ndims;
+    rmul = pos + ndims;
+    emul = rmul + ndims;
+
+    nmatch_all = 0;
+    for (d = 0; d < ndims; d++) {
+        es = (entryp->api_kind == NC_LOG_API_KIND_VARS) ? estride[d] : 1;
+        moff[d] = nmatch_all;
+        nmatch[d] = 0;
+        for (j = 0; j < count[d]; j++) {
+            c = start[d] + ((stride == NULL) ? j : j * stride[d]);
+            off = c - estart[d];
+            if (off < 0 || off % es != 0 || off / es >= ecount[d]) {
+                continue;
+            }
+            ridx[nmatch_all + nmatch[d]] = j;
+            eidx[nmatch_all + nmatch[d]] = off / es;
+            nmatch[d]++;
+        }
+        if (nmatch[d] == 0) {
+            NCI_Free(ridx);
+            return NC_NOERR;
+        }
+        nmatch_all += nmatch[d];
+    }
+
+    /* Element distance of each dimension in the read buffer and entry data */
+    rmul[ndims - 1] = 1;
+    emul[ndims - 1] = 1;
+    for (d = ndims - 2; d >= 0; d--) {
+        rmul[d] = rmul[d + 1] * count[d + 1];
+        emul[d] = emul[d + 1] * ecount[d + 1];
+    }
+
+    /* Group matched pairs of the last dimension into contiguous runs */
+    d = ndims - 1;
+    run_r = (MPI_Offset*)NCI_Malloc(nmatch[d] * 3 * SIZEOF_MPI_OFFSET);
+    if (run_r == NULL) {
+        NCI_Free(ridx);
+        DEBUG_RETURN_ERROR(NC_ENOMEM);
+    }
+    run_e = run_r + nmatch[d];
+    run_len = run_e + nmatch[d];
+    nruns = 0;
+    for (j = 0; j < nmatch[d]; j++) {
+        if (nruns > 0 &&
+            ridx[moff[d] + j] == run_r[nruns - 1] + run_len[nruns - 1] &&
+            eidx[moff[d] + j] == run_e[nruns - 1] + run_len[nruns - 1]) {
+            run_len[nruns - 1]++;
+        }
+        else {
+            run_r[nruns] = ridx[moff[d] + j];
+            run_e[nruns] = eidx[moff[d] + j];
+            run_len[nruns++] = 1;
+        }
+    }
+
+    /* Iterate through matched pairs of the other dimensions */
+    for (d = 0; d < ndims; d++) {
+        pos[d] = 0;
+    }
+    for (;;) {
+        roff = 0;
+        eoff = 0;
+        for (d = 0; d < ndims - 1; d++) {
+            roff += ridx[moff[d] + pos[d]] * rmul[d];
+            eoff += eidx[moff[d] + pos[d]] * emul[d];
+        }
+        for (i = 0; i < nruns; i++) {
+            memcpy(buf + (roff + run_r[i]) * elsize,
+                   edata + (eoff + run_e[i]) * elsize,
+                   run_len[i] * elsize);
+        }
+
+        /* Move to the next pair */
+        for (d = ndims - 2; d >= 0; d--) {
+            if (++pos[d] < nmatch[d]) {
+                break;
+            }
+            pos[d] = 0;
+        }
+        if (d < 0) {
+            break;
+        }
+    }
+
+    NCI_Free(run_r);
+    NCI_Free(ridx);
+
+    return NC_NOERR;
+}
+
+/*
+ * Prepare the log for reading a variable
+ * If hint nc_dw_flush_on_read is enabled, the log is flushed. Otherwise, the
+ * log is flushed only if a pending log entry overlaps the read and can not be
+ * copied to the read buffer, because of flexible API or type mismatch. In
+ * collective mode, all processes flush if any process needs to.
+ * When nothing is flushed, the read is served by reading from the file then
+ * copying overlapping pending entries by calling ncdwio_log_get_var
+ * IN    ncdwp:    log structure
+ * IN    varid:    variable to read
+ * IN    num:    number of hyperslabs
+ * IN    starts, counts, stride:    hyperslabs of the read
+ * IN    buftype:    MPI primitive type of the read buffer, or
+ *                   MPI_DATATYPE_NULL if buffer is not contiguous
+ * IN    reqMode:    request mode of the read
+ * OUT   overlap:    whether any pending log entry overlaps the read
+ */
+int ncdwio_log_get_begin(NC_dw *ncdwp, int varid, int num,
+                         MPI_Offset* const *starts, MPI_Offset* const *counts,
+                         const MPI_Offset *stride, MPI_Datatype buftype,
+                         int reqMode, int *overlap) {
+    int i, j, k, err, need_flush = 0, need_flush_all;
+    MPI_Datatype etype;
+    NC_dw_intvector *vp;
+    NC_dw_metadataentry *entryp;
+
+    *overlap = 0;
+
+    /* Flush on read */
+    if (ncdwp->hints & NC_LOG_HINT_FLUSH_ON_READ){
+        return ncdwio_log_flush(ncdwp);
+    }
+
+    /* Erroneous request participating collective call has no valid start */
+    if (!(reqMode & NC_REQ_ZERO) && varid < ncdwp->metaidx.nvars){
+        vp = ncdwp->metaidx.varents + varid;
+        /* Entries before nflushed are replayed already */
+        for (i = vp->nused - 1; i >= 0 && !need_flush; i--){
+            k = vp->values[i];
+            if (k < ncdwp->nflushed){
+                break;
+            }
+            if (!ncdwp->metaidx.entries[k].valid){
+                continue;
+            }
+            entryp = LOG_ENTRY(ncdwp, k);
+            for (j = 0; j < num; j++){
+                if (!entry_overlap(entryp, starts[j],
+                                   (counts == NULL) ? NULL : counts[j], stride)){
+                    continue;
+                }
+                err = logtype2mpitype(entryp->itype, &etype);
+                if (err != NC_NOERR || etype != buftype){
+                    need_flush = 1;
+                    break;
+                }
+                *overlap = 1;
+            }
+        }
+    }
+
+    if (reqMode & NC_REQ_COLL){
+        err = MPI_Allreduce(&need_flush, &need_flush_all, 1, MPI_INT, MPI_LOR,
+                            ncdwp->comm);
+        if (err != MPI_SUCCESS){
+            DEBUG_RETURN_ERROR(ncmpii_error_mpi2nc(err, "MPI_Allreduce"));
+        }
+        need_flush = need_flush_all;
+    }
+
+    if (need_flush){
+        *overlap = 0;
+        return ncdwio_log_flush(ncdwp);
+    }
+
+    return NC_NOERR;
+}
+
+/*
+ * Copy pending log entries overlapping a hyperslab to the read buffer
+ * Entries are applied in log order, so the latest write wins
+ * The read buffer must already contain the data read from the file
+ * IN    ncdwp:    log structure
+ * IN    varid:    variable to read
+ * IN    start, count, stride:    hyperslab of the read
+ * IN    buf:    read buffer, contiguous in the hyperslab
+ * IN    buftype:    MPI primitive type of the read buffer
+ */
+int ncdwio_log_get_var(NC_dw *ncdwp, int varid, const MPI_Offset start[],
+                       const MPI_Offset count[], const MPI_Offset stride[],
+                       void *buf, MPI_Datatype buftype) {
+    int i, k, err, status = NC_NOERR, elsize, nread = 0;
+    size_t bsize = 0;
+    char *edata = NULL;
+    NC_dw_intvector *vp;
+    NC_dw_metadataentry *entryp;
+
+    if (varid >= ncdwp->metaidx.nvars){
+        return NC_NOERR;
+    }
+
+    MPI_Type_size(buftype, &elsize);
+
+    vp = ncdwp->metaidx.varents + varid;
+    for (i = 0; i < vp->nused; i++){
+        k = vp->values[i];
+        if (k < ncdwp->nflushed || !ncdwp->metaidx.entries[k].valid){
+            continue;
+        }
+        entryp = LOG_ENTRY(ncdwp, k);
+        if (!entry_overlap(entryp, start, count, stride)){
+            continue;
+        }
+
+        /* Read entry data from the data log */
+        if (bsize < (size_t)entryp->data_len){
+            if (edata != NULL){
+                NCI_Free(edata);
+            }
+            bsize = (size_t)entryp->data_len;
+            edata = (char*)NCI_Malloc(bsize);
+            if (edata == NULL){
+                DEBUG_RETURN_ERROR(NC_ENOMEM);
+            }
+        }
+        err = ncdwio_bufferedfile_pread(ncdwp->datalog_fd, edata,
+                                        entryp->data_len, entryp->data_off);
+        if (err != NC_NOERR){
+            status = err;
+            break;
+        }
+        nread++;
+
+        err = entry_copy(entryp, edata, start, count, stride, (char*)buf,
+                         elsize);
+        if (err != NC_NOERR){
+            status = err;
+            break;
+        }
+    }
+
+    if (edata != NULL){
+        NCI_Free(edata);
+    }
+
+    /* Data log descriptor must point to the end of file for the next put */
+    if (nread > 0){
+        err = ncdwio_bufferedfile_seek(ncdwp->datalog_fd, ncdwp->datalogsize,
+                                       SEEK_SET);
+        if (status == NC_NOERR){
+            status = err;
+        }
+    }
+
+    return status;
+}
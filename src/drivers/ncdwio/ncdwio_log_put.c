@@ -25,6 +25,92 @@
 #include <pnetcdf.h>
 #include <ncdwio_driver.h>
 
+/*
+ * Check if a put can be merged into the last entry of the log
+ * The last entry must be pending, in the same request, to the same variable in
+ * the same type, and its data must end at the end of the data log. The new
+ * region must extend the region of the entry along one dimension, such that
+ * the data of both, concatenated, is the data of the merged region in row
+ * major order. This is the case when all dimensions before it have count 1
+ * and all dimensions after it are the same, as in writing row by row.
+ * IN    ncdwp:    log structure
+ * IN    varid:    variable id of the put
+ * IN    itype:    log type of the put
+ * IN    ndims:    number of dimensions of the variable
+ * IN    start, count, stride:    region of the put
+ * IN    size:    size of data of the put in byte
+ * OUT   mdim:    dimension to extend the entry along
+ * Return the entry to merge into, or NULL if the put can not be merged
+ */
+static NC_dw_metadataentry*
+log_merge_entry(NC_dw *ncdwp, int varid, int itype, int ndims,
+                const MPI_Offset start[], const MPI_Offset count[],
+                const MPI_Offset stride[], MPI_Offset size, int *mdim){
+    int i, d, last;
+    MPI_Offset step;
+    MPI_Offset *Start, *Count, *Stride;
+    NC_dw_metadataentry *entryp;
+
+    last = ncdwp->metaidx.nused - 1;
+    if (ndims == 0 || size == 0 || last < ncdwp->nflushed ||
+        last < ncdwp->mergefrom || !ncdwp->metaidx.entries[last].valid){
+        return NULL;
+    }
+
+    entryp = (NC_dw_metadataentry*)((char*)ncdwp->metadata.buffer +
+             (size_t)ncdwp->metaidx.entries[last].ptr);
+    if (entryp->varid != varid || entryp->itype != itype ||
+        entryp->ndims != ndims ||
+        entryp->api_kind != (stride == NULL ? NC_LOG_API_KIND_VARA
+                                            : NC_LOG_API_KIND_VARS) ||
+        entryp->data_off + entryp->data_len != (MPI_Offset)ncdwp->datalogsize){
+        return NULL;
+    }
+
+    /* Keep entries within a data buffer of the flush, see log_flush_entries */
+    if (ncdwp->flushbuffersize > 0 &&
+        entryp->data_len + size > ncdwp->flushbuffersize / 2){
+        return NULL;
+    }
+
+    Start = (MPI_Offset*)(entryp + 1);
+    Count = Start + ndims;
+    Stride = Count + ndims;
+    if (stride != NULL){
+        for(i = 0; i < ndims; i++){
+            if (Stride[i] != stride[i]){
+                return NULL;
+            }
+        }
+    }
+
+    /* Dimensions before the one to extend are single elements at the same
+     * position
+     */
+    for(d = 0; d < ndims; d++){
+        if (Start[d] != start[d] || Count[d] != 1 || count[d] != 1){
+            break;
+        }
+    }
+    if (d == ndims){
+        return NULL;
+    }
+
+    step = (stride == NULL) ? 1 : stride[d];
+    if (start[d] != Start[d] + Count[d] * step){
+        return NULL;
+    }
+    for(i = d + 1; i < ndims; i++){
+        if (Start[i] != start[i] || Count[i] != count[i]){
+            return NULL;
+        }
+    }
+
+    *mdim = d;
+
+    return entryp;
+}
+
 /*
  * Prepare a single log entry to be write to log
  * Used by ncmpii_getput_varm
@@ -145,6 +231,56 @@ int ncdwio_log_put_var(NC_dw *ncdwp, int varid, const MPI_Offset start[],
         DEBUG_RETURN_ERROR(NC_EINVAL);
     }
 
+    /* Merge into the last entry if the put extends it
+     * Data goes to the end of data log as usual, only the count and data size
+     * of the entry are updated
+     */
+    entryp = log_merge_entry(ncdwp, varid, itype, dim, start, count, stride,
+                             size, &i);
+    if (entryp != NULL){
+        Count = (MPI_Offset*)(entryp + 1) + dim;
+        Count[i] += count[i];
+        entryp->data_len += size;
+        ncdwp->entrydatasize.values[ncdwp->metaidx.nused - 1] += size;
+        ncdwp->datalogsize += size;
+        if (ncdwp->maxentrysize < entryp->data_len){
+            ncdwp->maxentrysize = entryp->data_len;
+        }
+
+#ifdef PNETCDF_PROFILING
+        t2 = MPI_Wtime();
+#endif
+
+        /* Data must go first */
+        err = ncdwio_bufferedfile_write(ncdwp->datalog_fd, buf, size);
+        if (err != NC_NOERR){
+            return err;
+        }
+
+#ifdef PNETCDF_PROFILING
+        t3 = MPI_Wtime();
+#endif
+
+        /* Overwrite the entry in metadata log */
+        err = ncdwio_sharedfile_pwrite(ncdwp->metalog_fd, entryp, entryp->esize,
+                                       (char*)entryp - (char*)ncdwp->metadata.buffer);
+        if (err != NC_NOERR){
+            return err;
+        }
+
+#ifdef PNETCDF_PROFILING
+        t4 = MPI_Wtime();
+        ncdwp->put_data_wr_time += t3 - t2;
+        ncdwp->put_meta_wr_time += t4 - t3;
+        ncdwp->total_time += t4 - t1;
+        ncdwp->put_time += t4 - t1;
+
+        ncdwp->total_data += size;
+#endif
+
+        return NC_NOERR;
+    }
+
     /* Prepare metadata entry header */
 
     /* Find out the location of data in datalog
@@ -210,12 +210,18 @@ int ncdwio_metaidx_init(NC_dw *ncdwp) {
     ip->nused = 0;
     ip->entries = (NC_dw_metadataptr*)NCI_Malloc(sizeof(NC_dw_metadataptr) * ip->nalloc);
 
+    /* Per variable index is allocated when a variable gets its first entry */
+    ip->varents = NULL;
+    ip->nvars = 0;
+
     return NC_NOERR;
 }
 
 int ncdwio_metaidx_add(NC_dw *ncdwp, NC_dw_metadataentry *ptr) {
+    int i, err, varid;
     NC_dw_metadataidx *ip = &(ncdwp->metaidx);
     NC_dw_metadataptr *tmp;
+    NC_dw_intvector *vtmp;
 
     if (ip->nused == ip->nalloc) {
         ip->nalloc *= SIZE_MULTIPLIER;
@@ -223,6 +229,29 @@ int ncdwio_metaidx_add(NC_dw *ncdwp, NC_dw_metadataentry *ptr) {
         ip->entries = tmp;
     }
 
+    /* Record the entry in the index of its variable
+     * Entry address is relative to the metadata buffer
+     */
+    varid = ((NC_dw_metadataentry*)(((char*)ncdwp->metadata.buffer) + (size_t)ptr))->varid;
+    if (varid >= ip->nvars) {
+        vtmp = (NC_dw_intvector*)NCI_Realloc(ip->varents, sizeof(NC_dw_intvector) * (varid + 1));
+        if (vtmp == NULL){
+            DEBUG_RETURN_ERROR(NC_ENOMEM);
+        }
+        ip->varents = vtmp;
+        for (i = ip->nvars; i <= varid; i++) {
+            err = ncdwio_log_intvector_init(ip->varents + i);
+            if (err != NC_NOERR){
+                return err;
+            }
+        }
+        ip->nvars = varid + 1;
+    }
+    err = ncdwio_log_intvector_append(ip->varents + varid, ip->nused);
+    if (err != NC_NOERR){
+        return err;
+    }
+
     ip->entries[ip->nused].ptr = ptr;
     ip->entries[ip->nused].valid = 1;
     ip->entries[ip->nused++].reqid = -1;
@@ -230,11 +259,33 @@ int ncdwio_metaidx_add(NC_dw *ncdwp, NC_dw_metadataentry *ptr) {
     return NC_NOERR;
 }
 
+/*
+ * Remove all entries from the index
+ * Used after the log is flushed
+ */
+int ncdwio_metaidx_reset(NC_dw *ncdwp) {
+    int i;
+    NC_dw_metadataidx *ip = &(ncdwp->metaidx);
+
+    ip->nused = 0;
+    for (i = 0; i < ip->nvars; i++) {
+        ip->varents[i].nused = 0;
+    }
+
+    return NC_NOERR;
+}
+
 int ncdwio_metaidx_free(NC_dw *ncdwp) {
+    int i;
     NC_dw_metadataidx *ip = &(ncdwp->metaidx);
 
     NCI_Free(ip->entries);
+    for (i = 0; i < ip->nvars; i++) {
+        ncdwio_log_intvector_free(ip->varents + i);
+    }
+    if (ip->varents != NULL) {
+        NCI_Free(ip->varents);
+    }
 
     return NC_NOERR;
 }
-
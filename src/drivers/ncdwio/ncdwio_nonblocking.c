@@ -313,8 +313,9 @@ int ncdwio_cancel_put_req(NC_dw *ncdwp, int reqid, int *stat){
     }
 
     /* If log entry is already flushed, it's too late to cancel
+     * Entries before nflushed are replayed by a drain
      */
-    if (req->ready){
+    if (req->ready || req->entrystart < ncdwp->nflushed){
         if (stat != NULL) {
             *stat = NC_EFLUSHED;    // Fail
         }
@@ -13,6 +13,7 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
+#include <errno.h>
 #include <pnc_debug.h>
 #include <common.h>
 #include <pnetcdf.h>
@@ -355,6 +356,144 @@ int ncdwio_sharedfile_pread(NC_dw_sharedfile *f, void *buf, size_t count, off_t
     return NC_NOERR;
 }
 
+/*
+ * This function starts reading <count> bytes of data to buffer <buf> from the
+ * file at position specified by <offset>
+ * The file position is not changed
+ * The buffer must not be accessed until ncdwio_sharedfile_wait is called on
+ * <req>
+ * IN       f:    File handle
+ * OUT    buf:    Buffer of data to be read
+ * IN   count:    Number of bytes to read
+ * IN  offset:    Starting read position
+ * OUT    req:    Request to wait for
+ *
+ * The region is mapped to blocks of the shared file in the same way as
+ * ncdwio_sharedfile_pread, and one read is posted for each block
+ * Without POSIX AIO, the read is done before returning
+ */
+int ncdwio_sharedfile_iread(NC_dw_sharedfile *f, void *buf, size_t count, off_t offset, NC_dw_sharedfile_req *req){
+#ifdef HAVE_AIO
+    int i, j, err;
+    int sblock, eblock;   // start and end block
+    off_t offstart, offend; // Start and end offset to read for current block in physical file
+
+    if (f->nchanel == 1){
+        sblock = eblock = 0;
+    }
+    else{
+        sblock = offset / f->bsize;
+        eblock = (offset + count) / f->bsize;
+    }
+
+    req->ncbs = eblock - sblock + 1;
+    req->cbs = (struct aiocb*)NCI_Malloc(req->ncbs * sizeof(struct aiocb));
+    if (req->cbs == NULL){
+        DEBUG_RETURN_ERROR(NC_ENOMEM);
+    }
+    memset(req->cbs, 0, req->ncbs * sizeof(struct aiocb));
+
+    for(i = sblock, j = 0; i <= eblock; i++, j++){
+        // Compute physical region of the block, see ncdwio_sharedfile_pread
+        if (f->nchanel == 1){
+            offstart = offset;
+            offend = offset + count;
+        }
+        else{
+            offstart = i * f->nchanel * f->bsize;
+            if (i == eblock){
+                offend = offstart + (offset + count) % f->bsize;
+            }
+            else{
+                offend = offstart + f->bsize;
+            }
+            if (i == sblock){
+                offstart += offset % f->bsize;
+            }
+        }
+
+        req->cbs[j].aio_fildes = f->fd;
+        req->cbs[j].aio_buf = buf;
+        req->cbs[j].aio_nbytes = offend - offstart;
+        req->cbs[j].aio_offset = offstart;
+        req->cbs[j].aio_lio_opcode = LIO_READ;
+
+        /* Read synchronously if the request can not be queued
+         * LIO_NOP marks a block with nothing left to wait for
+         */
+        if (offend <= offstart){
+            req->cbs[j].aio_lio_opcode = LIO_NOP;
+        }
+        else if (aio_read(req->cbs + j) != 0){
+            req->cbs[j].aio_lio_opcode = LIO_NOP;
+            err = ncdwio_sharedfile_pread(f, buf, offend - offstart, offstart);
+            if (err != NC_NOERR){
+                req->ncbs = j;
+                ncdwio_sharedfile_wait(req);
+                return err;
+            }
+        }
+
+        buf = (void*)(((char*)buf) + offend - offstart);
+    }
+
+    // Record the file size as the largest location ever reach by IO operation
+    if (f->fsize < offset + count){
+        f->fsize = offset + count;
+    }
+
+    return NC_NOERR;
+#else
+    req->ncbs = 0;
+
+    return ncdwio_sharedfile_pread(f, buf, count, offset);
+#endif
+}
+
+/*
+ * Wait for a read started by ncdwio_sharedfile_iread to complete
+ * IN     req:    Request to wait for
+ */
+int ncdwio_sharedfile_wait(NC_dw_sharedfile_req *req){
+    int status = NC_NOERR;
+#ifdef HAVE_AIO
+    int i, err;
+    ssize_t ioret;
+    const struct aiocb *cbp;
+
+    for(i = 0; i < req->ncbs; i++){
+        if (req->cbs[i].aio_lio_opcode != LIO_READ){
+            continue;
+        }
+
+        cbp = req->cbs + i;
+        while ((err = aio_error(cbp)) == EINPROGRESS){
+            aio_suspend(&cbp, 1, NULL);
+        }
+
+        ioret = aio_return(req->cbs + i);
+        if (status == NC_NOERR){
+            if (err != 0){
+                errno = err;
+                status = ncmpii_error_posix2nc("read");
+                if (status == NC_EFILE) DEBUG_ASSIGN_ERROR(status, NC_EREAD);
+            }
+            else if (ioret != req->cbs[i].aio_nbytes){
+                DEBUG_ASSIGN_ERROR(status, NC_EREAD);
+            }
+        }
+    }
+
+    if (req->cbs != NULL){
+        NCI_Free(req->cbs);
+        req->cbs = NULL;
+    }
+#endif
+    req->ncbs = 0;
+
+    return status;
+}
+
 /*
  * This function read <count> bytes of data to buffer <buf> from the file at it's
  * current file position and increase the file position by <count>
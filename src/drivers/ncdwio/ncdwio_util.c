@@ -53,6 +53,12 @@ void ncdwio_extract_hint(NC_dw *ncdwp, MPI_Info info){
     if (flag && strcasecmp(value, "disable") == 0){
         ncdwp->hints ^= NC_LOG_HINT_DEL_ON_CLOSE;
     }
+    // Flush the log before reading a variable (enable)
+    MPI_Info_get(info, "nc_dw_flush_on_read", MPI_MAX_INFO_VAL - 1,
+                 value, &flag);
+    if (flag && strcasecmp(value, "disable") == 0){
+        ncdwp->hints ^= NC_LOG_HINT_FLUSH_ON_READ;
+    }
     // Buffer size used to flush the log (0 (unlimited))
     MPI_Info_get(info, "nc_dw_flush_buffer_size", MPI_MAX_INFO_VAL - 1,
                  value, &flag);
@@ -66,6 +72,35 @@ void ncdwio_extract_hint(NC_dw *ncdwp, MPI_Info info){
     else{
         ncdwp->flushbuffersize = 0; // 0 means unlimited}
     }
+    // Size of pending data in the log that triggers a drain (0 (disable))
+    MPI_Info_get(info, "nc_dw_flush_high_watermark", MPI_MAX_INFO_VAL - 1,
+                 value, &flag);
+    if (flag){
+        long int wsize = strtol(value, NULL, 0);
+        if (wsize < 0) {
+            wsize = 0;
+        }
+        ncdwp->flushhighwm = (MPI_Offset)wsize; // Unit: byte
+    }
+    else{
+        ncdwp->flushhighwm = 0; // 0 means no drain before flush
+    }
+    // Size of pending data in the log a drain stops at (0)
+    MPI_Info_get(info, "nc_dw_flush_low_watermark", MPI_MAX_INFO_VAL - 1,
+                 value, &flag);
+    if (flag){
+        long int wsize = strtol(value, NULL, 0);
+        if (wsize < 0) {
+            wsize = 0;
+        }
+        ncdwp->flushlowwm = (MPI_Offset)wsize; // Unit: byte
+    }
+    else{
+        ncdwp->flushlowwm = 0; // Drain the whole log
+    }
+    if (ncdwp->flushlowwm > ncdwp->flushhighwm) {
+        ncdwp->flushlowwm = ncdwp->flushhighwm;
+    }
 }
 
 /*
@@ -86,6 +121,9 @@ void ncdwio_export_hint(NC_dw *ncdwp, MPI_Info info){
     if (!(ncdwp->hints & NC_LOG_HINT_DEL_ON_CLOSE)) {
         MPI_Info_set(info, "nc_dw_del_on_close", "disable");
     }
+    if (!(ncdwp->hints & NC_LOG_HINT_FLUSH_ON_READ)) {
+        MPI_Info_set(info, "nc_dw_flush_on_read", "disable");
+    }
     if (ncdwp->logbase[0] != '\0') {
         MPI_Info_set(info, "nc_dw_dirname", ncdwp->logbase);
     }
@@ -93,4 +131,10 @@ void ncdwio_export_hint(NC_dw *ncdwp, MPI_Info info){
         sprintf(value, "%llu", ncdwp->flushbuffersize);
         MPI_Info_set(info, "nc_dw_flush_buffer_size", value);
     }
+    if (ncdwp->flushhighwm > 0) {
+        sprintf(value, "%lld", ncdwp->flushhighwm);
+        MPI_Info_set(info, "nc_dw_flush_high_watermark", value);
+        sprintf(value, "%lld", ncdwp->flushlowwm);
+        MPI_Info_set(info, "nc_dw_flush_low_watermark", value);
+    }
 }
@@ -39,6 +39,10 @@
  *
  * ncmpi_get_vard()                 : dispatcher->get_vard()
  * ncmpi_put_vard()                 : dispatcher->put_vard()
+ *
+ * ncmpi_iget_vard()                : dispatcher->iget_vard()
+ * ncmpi_iput_vard()                : dispatcher->iput_vard()
+ * ncmpi_bput_vard()                : dispatcher->bput_vard()
  */
 
 #ifdef HAVE_CONFIG_H
@@ -47,6 +51,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include <mpi.h>
 
@@ -138,12 +143,17 @@ ncdwio_get_var(void             *ncdp,
               MPI_Datatype      buftype,
               int               reqMode)
 {
-    int err, status = NC_NOERR;
+    int err, status = NC_NOERR, overlap = 0;
     NC_dw *ncdwp = (NC_dw*)ncdp;
 
-    /* Flush on read */
+    /* Flush the log if needed, pending log entries can only be copied to a
+     * contiguous buffer of the same type
+     */
     if(ncdwp->inited){
-        err = ncdwio_log_flush(ncdwp);
+        err = ncdwio_log_get_begin(ncdwp, varid, 1, (MPI_Offset* const*)&start,
+                                   (MPI_Offset* const*)&count, stride,
+                                   (imap == NULL && bufcount == -1) ? buftype : MPI_DATATYPE_NULL,
+                                   reqMode, &overlap);
         if (status == NC_NOERR){
             status = err;
         }
@@ -155,6 +165,14 @@ ncdwio_get_var(void             *ncdp,
         status = err;
     }
 
+    /* Apply pending writes in the log on top of data read from the file */
+    if (overlap){
+        err = ncdwio_log_get_var(ncdwp, varid, start, count, stride, buf, buftype);
+        if (status == NC_NOERR){
+            status = err;
+        }
+    }
+
     return status;
 }
 
@@ -170,7 +188,7 @@ ncdwio_put_var(void             *ncdp,
               MPI_Datatype      buftype,
               int               reqMode)
 {
-    int err;
+    int err, status=NC_NOERR;
     void *cbuf=(void*)buf;
     NC_dw *ncdwp = (NC_dw*)ncdp;
 
@@ -189,11 +207,17 @@ ncdwio_put_var(void             *ncdp,
 
         err = ncdwp->ncmpio_driver->inq_var(ncdwp->ncp, varid, NULL, NULL, &ndims, NULL,
                                    NULL, NULL, NULL, NULL);
-        if (err != NC_NOERR) return err;;
+        if (err != NC_NOERR){
+            status = err;
+            goto err_check;
+        }
 
         err = ncmpii_pack(ndims, count, imap, (void*)buf, bufcount, buftype,
                           &nelems, &etype, &cbuf);
-        if (err != NC_NOERR) return err;
+        if (err != NC_NOERR){
+            status = err;
+            goto err_check;
+        }
 
         imap     = NULL;
         bufcount = (nelems == 0) ? 0 : -1;  /* make it a high-level API */
@@ -201,11 +225,20 @@ ncdwio_put_var(void             *ncdp,
     }
 
     /* Add log entry */
-    err = ncdwio_log_put_var(ncdwp, varid, start, count, stride, cbuf, buftype, NULL);
+    status = ncdwio_log_put_var(ncdwp, varid, start, count, stride, cbuf, buftype, NULL);
 
     if (cbuf != buf) NCI_Free(cbuf);
 
-    return err;
+err_check:
+    /* Replay part of the log if it grows above the high watermark. In
+     * collective data mode, this must be called even if an error occurred
+     */
+    err = ncdwio_log_drain(ncdwp, reqMode);
+    if (status == NC_NOERR){
+        status = err;
+    }
+
+    return status;
 }
 
 int
@@ -277,8 +310,9 @@ ncdwio_iput_var(void             *ncdp,
      */
 
     // Number of log entries before recording current operation to log
+    // Entries of a request are not merged with those of other requests
     ncdwp->putlist.reqs[id].entrystart = ncdwp->metaidx.nused;
-    ncdwp->putlist.reqs[id].entrystart = ncdwp->metaidx.nused;
+    ncdwp->mergefrom = ncdwp->metaidx.nused;
 
     err = ncdwio_put_var(ncdp, varid, start, count, stride, imap, buf, bufcount, buftype, reqMode);
     if (err != NC_NOERR){
@@ -288,6 +322,7 @@ ncdwio_iput_var(void             *ncdp,
 
     // Number of log entries after recording current operation to log
     ncdwp->putlist.reqs[id].entryend = ncdwp->metaidx.nused;
+    ncdwp->mergefrom = ncdwp->metaidx.nused;
 
     /*
      * If new entry is created in the log, link those entries to the request
@@ -365,12 +400,18 @@ ncdwio_get_varn(void              *ncdp,
                MPI_Datatype       buftype,
                int                reqMode)
 {
-    int err, status = NC_NOERR;
+    int i, j, err, status = NC_NOERR, overlap = 0, ndims, elsize;
+    MPI_Offset *count, nelems;
+    char *bufp;
     NC_dw *ncdwp = (NC_dw*)ncdp;
 
-    /* Flush on read */
+    /* Flush the log if needed, pending log entries can only be copied to a
+     * contiguous buffer of the same type
+     */
     if(ncdwp->inited){
-        err = ncdwio_log_flush(ncdwp);
+        err = ncdwio_log_get_begin(ncdwp, varid, num, starts, counts, NULL,
+                                   (bufcount == -1) ? buftype : MPI_DATATYPE_NULL,
+                                   reqMode, &overlap);
         if (status == NC_NOERR){
             status = err;
         }
@@ -382,6 +423,38 @@ ncdwio_get_varn(void              *ncdp,
         status = err;
     }
 
+    /* Apply pending writes in the log on top of data read from the file
+     * Data of the num requests are stored one after another in buf
+     * counts == NULL means one element of each request
+     */
+    if (overlap){
+        err = ncdwp->ncmpio_driver->inq_var(ncdwp->ncp, varid, NULL, NULL, &ndims,
+                                            NULL, NULL, NULL, NULL, NULL);
+        if (err != NC_NOERR) return err;
+
+        count = (MPI_Offset*)NCI_Malloc((ndims + 1) * SIZEOF_MPI_OFFSET);
+        for (j = 0; j < ndims; j++){
+            count[j] = 1;
+        }
+        MPI_Type_size(buftype, &elsize);
+        bufp = (char*)buf;
+        for (i = 0; i < num; i++){
+            if (counts != NULL){
+                memcpy(count, counts[i], ndims * SIZEOF_MPI_OFFSET);
+            }
+            err = ncdwio_log_get_var(ncdwp, varid, starts[i], count, NULL, bufp, buftype);
+            if (status == NC_NOERR){
+                status = err;
+            }
+            nelems = 1;
+            for (j = 0; j < ndims; j++){
+                nelems *= count[j];
+            }
+            bufp += nelems * elsize;
+        }
+        NCI_Free(count);
+    }
+
     return status;
 }
 
@@ -408,7 +481,8 @@ ncdwio_put_varn(void              *ncdp,
 
     /* It is illegal for starts to be NULL unless num is 0*/
     if (num > 0 && starts == NULL){
-        DEBUG_RETURN_ERROR(NC_ENULLSTART)
+        DEBUG_ASSIGN_ERROR(status, NC_ENULLSTART)
+        goto err_check;
     }
 
     /* Resolve flexible api so we can calculate size of each put_var */
@@ -419,7 +493,8 @@ ncdwio_put_varn(void              *ncdp,
 
         err = ncmpii_dtype_decode(buftype, &ptype, &elsize, &bnelems, &isderived, &iscontig_of_ptypes);
         if (err != NC_NOERR){
-            return err;
+            status = err;
+            goto err_check;
         }
 
         cbuf = NCI_Malloc(elsize * bnelems);
@@ -440,6 +515,15 @@ ncdwio_put_varn(void              *ncdp,
         NCI_Free(cbuf);
     }
 
+err_check:
+    /* Replay part of the log if it grows above the high watermark. In
+     * collective data mode, this must be called even if an error occurred
+     */
+    err = ncdwio_log_drain(ncdwp, reqMode);
+    if (status == NC_NOERR){
+        status = err;
+    }
+
     return status;
 }
 
@@ -515,7 +599,9 @@ ncdwio_iput_varn(void               *ncdp,
      */
 
     // Number of log entries before recording current operation to log
+    // Entries of a request are not merged with those of other requests
     ncdwp->putlist.reqs[id].entrystart = ncdwp->metaidx.nused;
+    ncdwp->mergefrom = ncdwp->metaidx.nused;
 
     // Handle the IO operation same as blocking one
     err = ncdwio_put_varn(ncdp, varid, num, starts, counts, buf, bufcount, buftype, reqMode);
@@ -526,6 +612,7 @@ ncdwio_iput_varn(void               *ncdp,
 
     // Number of log entries after recording current operation to log
     ncdwp->putlist.reqs[id].entryend = ncdwp->metaidx.nused;
+    ncdwp->mergefrom = ncdwp->metaidx.nused;
 
     /* If new entry is created in the log, link those entries to the request
      * The entry may go directly to the ncmpio driver if it is too large
@@ -615,3 +702,88 @@ ncdwio_put_vard(void         *ncdp,
     return NC_NOERR;
 }
 
+int
+ncdwio_iget_vard(void         *ncdp,
+                int           varid,
+                MPI_Datatype  filetype,
+                void         *buf,
+                MPI_Offset    bufcount,
+                MPI_Datatype  buftype,
+                int          *reqid,
+                int           reqMode)
+{
+    int err;
+    NC_dw *ncdwp = (NC_dw*)ncdp;
+
+    err = ncdwp->ncmpio_driver->iget_vard(ncdwp->ncp, varid, filetype, buf,
+                                bufcount, buftype, reqid, reqMode);
+    if (err != NC_NOERR) return err;
+
+    // Translate from ncmpio id to ncdwio id
+    if (reqid != NULL) *reqid = *reqid * 2 + 1;
+
+    return NC_NOERR;
+}
+
+/*
+ * Perform non-blocking vard put operation
+ * BB driver does not log vard, so the request is posted to the ncmpio driver
+ * and carries an odd id, the same as a get request. The log is flushed first,
+ * so data written earlier does not overwrite this request when it is flushed
+ */
+int
+ncdwio_iput_vard(void         *ncdp,
+                int           varid,
+                MPI_Datatype  filetype,
+                const void   *buf,
+                MPI_Offset    bufcount,
+                MPI_Datatype  buftype,
+                int          *reqid,
+                int           reqMode)
+{
+    int err;
+    NC_dw *ncdwp = (NC_dw*)ncdp;
+
+    if (ncdwp->inited){
+        err = ncdwio_log_flush(ncdwp);
+        if (err != NC_NOERR) return err;
+    }
+
+    err = ncdwp->ncmpio_driver->iput_vard(ncdwp->ncp, varid, filetype, buf,
+                                bufcount, buftype, reqid, reqMode);
+    if (err != NC_NOERR) return err;
+
+    // Translate from ncmpio id to ncdwio id
+    if (reqid != NULL) *reqid = *reqid * 2 + 1;
+
+    return NC_NOERR;
+}
+
+int
+ncdwio_bput_vard(void         *ncdp,
+                int           varid,
+                MPI_Datatype  filetype,
+                const void   *buf,
+                MPI_Offset    bufcount,
+                MPI_Datatype  buftype,
+                int          *reqid,
+                int           reqMode)
+{
+    int err;
+    NC_dw *ncdwp = (NC_dw*)ncdp;
+
+    if (ncdwp->inited){
+        err = ncdwio_log_flush(ncdwp);
+        if (err != NC_NOERR) return err;
+    }
+
+    /* the buffer is attached in ncmpio driver, see ncdwio_buffer_attach() */
+    err = ncdwp->ncmpio_driver->bput_vard(ncdwp->ncp, varid, filetype, buf,
+                                bufcount, buftype, reqid, reqMode);
+    if (err != NC_NOERR) return err;
+
+    // Translate from ncmpio id to ncdwio id
+    if (reqid != NULL) *reqid = *reqid * 2 + 1;
+
+    return NC_NOERR;
+}
@@ -67,7 +67,22 @@ static PNC_driver ncfoo_driver = {
     ncfoo_buffer_attach,
     ncfoo_buffer_detach,
     ncfoo_wait,
-    ncfoo_cancel
+    ncfoo_cancel,
+
+    ncfoo_getput_init,
+    ncfoo_start,
+    ncfoo_request_free,
+    ncfoo_inq_stats,
+    ncfoo_inq_var_stats,
+    ncfoo_inq_buf_pool_stats,
+
+    ncfoo_wait_start,
+    ncfoo_wait_test,
+    ncfoo_wait_end,
+
+    ncfoo_iget_vard,
+    ncfoo_iput_vard,
+    ncfoo_bput_vard
 };
 
 PNC_driver* ncfoo_inq_driver(void) {
@@ -21,6 +21,17 @@
  * ncmpi_wait()             : dispatcher->wait()
  * ncmpi_wait_all()         : dispatcher->wait()
  * ncmpi_cancel()           : dispatcher->cancel()
+ * ncmpi_put_vara_init()    : dispatcher->getput_init()
+ * ncmpi_get_vara_init()    : dispatcher->getput_init()
+ * ncmpi_start()            : dispatcher->start()
+ * ncmpi_start_all()        : dispatcher->start()
+ * ncmpi_request_free()     : dispatcher->request_free()
+ * ncmpi_inq_stats()        : dispatcher->inq_stats()
+ * ncmpi_inq_var_stats()    : dispatcher->inq_var_stats()
+ * ncmpi_inq_buf_pool_stats(): dispatcher->inq_buf_pool_stats()
+ * ncmpi_wait_start()       : dispatcher->wait_start()
+ * ncmpi_wait_test()        : dispatcher->wait_test()
+ * ncmpi_wait_end()         : dispatcher->wait_end()
  *
  * ncmpi_set_fill()         : dispatcher->set_fill()
  * ncmpi_fill_var_rec()     : dispatcher->fill_rec()
@@ -374,3 +385,140 @@ ncfoo_sync(void *ncdp)
     return NC_NOERR;
 }
 
+
+int
+ncfoo_getput_init(void             *ncdp,
+                  int               varid,
+                  const MPI_Offset *start,
+                  const MPI_Offset *count,
+                  const void       *buf,
+                  MPI_Offset        bufcount,
+                  MPI_Datatype      buftype,
+                  int              *request,
+                  int               reqMode)
+{
+    int err;
+    NC_foo *foo = (NC_foo*)ncdp;
+
+    err = foo->driver->getput_init(foo->ncp, varid, start, count, buf,
+                                   bufcount, buftype, request, reqMode);
+    if (err != NC_NOERR) return err;
+
+    return NC_NOERR;
+}
+
+int
+ncfoo_start(void       *ncdp,
+            int         request,
+            MPI_Offset  recno,
+            int         reqMode)
+{
+    int err;
+    NC_foo *foo = (NC_foo*)ncdp;
+
+    err = foo->driver->start(foo->ncp, request, recno, reqMode);
+    if (err != NC_NOERR) return err;
+
+    return NC_NOERR;
+}
+
+int
+ncfoo_request_free(void *ncdp,
+                   int   request)
+{
+    int err;
+    NC_foo *foo = (NC_foo*)ncdp;
+
+    err = foo->driver->request_free(foo->ncp, request);
+    if (err != NC_NOERR) return err;
+
+    return NC_NOERR;
+}
+
+int
+ncfoo_inq_stats(void       *ncdp,
+                MPI_Offset *put_counts,
+                MPI_Offset *put_bytes,
+                MPI_Offset *get_counts,
+                MPI_Offset *get_bytes,
+                double     *timings)
+{
+    int err;
+    NC_foo *foo = (NC_foo*)ncdp;
+
+    err = foo->driver->inq_stats(foo->ncp, put_counts, put_bytes, get_counts,
+                                 get_bytes, timings);
+    if (err != NC_NOERR) return err;
+
+    return NC_NOERR;
+}
+
+int
+ncfoo_inq_var_stats(void       *ncdp,
+                    int         varid,
+                    MPI_Offset *put_hist,
+                    MPI_Offset *get_hist)
+{
+    int err;
+    NC_foo *foo = (NC_foo*)ncdp;
+
+    err = foo->driver->inq_var_stats(foo->ncp, varid, put_hist, get_hist);
+    if (err != NC_NOERR) return err;
+
+    return NC_NOERR;
+}
+
+int
+ncfoo_inq_buf_pool_stats(void       *ncdp,
+                         MPI_Offset *hits,
+                         MPI_Offset *misses,
+                         MPI_Offset *max_size)
+{
+    int err;
+    NC_foo *foo = (NC_foo*)ncdp;
+
+    err = foo->driver->inq_buf_pool_stats(foo->ncp, hits, misses, max_size);
+    if (err != NC_NOERR) return err;
+
+    return NC_NOERR;
+}
+
+int
+ncfoo_wait_start(void *ncdp,
+                 int   num_reqs,
+                 int  *req_ids,
+                 int  *statuses)
+{
+    int err;
+    NC_foo *foo = (NC_foo*)ncdp;
+
+    err = foo->driver->wait_start(foo->ncp, num_reqs, req_ids, statuses);
+    if (err != NC_NOERR) return err;
+
+    return NC_NOERR;
+}
+
+int
+ncfoo_wait_test(void *ncdp,
+                int  *flag)
+{
+    int err;
+    NC_foo *foo = (NC_foo*)ncdp;
+
+    err = foo->driver->wait_test(foo->ncp, flag);
+    if (err != NC_NOERR) return err;
+
+    return NC_NOERR;
+}
+
+int
+ncfoo_wait_end(void *ncdp)
+{
+    int err;
+    NC_foo *foo = (NC_foo*)ncdp;
+
+    err = foo->driver->wait_end(foo->ncp);
+    if (err != NC_NOERR) return err;
+
+    return NC_NOERR;
+}
@@ -39,6 +39,10 @@
  *
  * ncmpi_get_vard()                 : dispatcher->get_vard()
  * ncmpi_put_vard()                 : dispatcher->put_vard()
+ *
+ * ncmpi_iget_vard()                : dispatcher->iget_vard()
+ * ncmpi_iput_vard()                : dispatcher->iput_vard()
+ * ncmpi_bput_vard()                : dispatcher->bput_vard()
  */
 
 #ifdef HAVE_CONFIG_H
@@ -436,3 +440,63 @@ ncfoo_put_vard(void         *ncdp,
     return NC_NOERR;
 }
 
+int
+ncfoo_iget_vard(void         *ncdp,
+                int           varid,
+                MPI_Datatype  filetype,
+                void         *buf,
+                MPI_Offset    bufcount,
+                MPI_Datatype  buftype,
+                int          *reqid,
+                int           reqMode)
+{
+    int err;
+    NC_foo *foo = (NC_foo*)ncdp;
+
+    err = foo->driver->iget_vard(foo->ncp, varid, filetype, buf, bufcount,
+                                 buftype, reqid, reqMode);
+    if (err != NC_NOERR) return err;
+
+    return NC_NOERR;
+}
+
+int
+ncfoo_iput_vard(void         *ncdp,
+                int           varid,
+                MPI_Datatype  filetype,
+                const void   *buf,
+                MPI_Offset    bufcount,
+                MPI_Datatype  buftype,
+                int          *reqid,
+                int           reqMode)
+{
+    int err;
+    NC_foo *foo = (NC_foo*)ncdp;
+
+    err = foo->driver->iput_vard(foo->ncp, varid, filetype, buf, bufcount,
+                                 buftype, reqid, reqMode);
+    if (err != NC_NOERR) return err;
+
+    return NC_NOERR;
+}
+
+int
+ncfoo_bput_vard(void         *ncdp,
+                int           varid,
+                MPI_Datatype  filetype,
+                const void   *buf,
+                MPI_Offset    bufcount,
+                MPI_Datatype  buftype,
+                int          *reqid,
+                int           reqMode)
+{
+    int err;
+    NC_foo *foo = (NC_foo*)ncdp;
+
+    err = foo->driver->bput_vard(foo->ncp, varid, filetype, buf, bufcount,
+                                 buftype, reqid, reqMode);
+    if (err != NC_NOERR) return err;
+
+    return NC_NOERR;
+}
+
@@ -15,6 +15,7 @@
 #include <sys/types.h>  /* off_t */
 
 #include <dispatch.h>
+#include <common.h>   /* ncmpii_buf_pool */
 #include "ncmpio_driver.h"
 
 #define FILE_ALIGNMENT_DEFAULT 512
@@ -81,8 +82,8 @@ typedef enum {
 
 typedef struct NC NC; /* forward reference */
 
-#define NC_NAME_TABLE_CHUNK 16
-#define HASH_TABLE_SIZE 256
+#define NC_NAME_TABLE_INIT_SIZE 16 /* initial number of slots, a power of 2 */
+#define NC_NAME_TABLE_ATTR_MIN 8   /* smallest attribute array to hash */
 /*
 #define HASH_FUNC(x) ncmpio_jenkins_one_at_a_time_hash(x)
 #define HASH_FUNC(x) ncmpio_additive_hash(x)
@@ -92,18 +93,18 @@ typedef struct NC NC; /* forward reference */
 #define HASH_FUNC(x) ncmpio_Bernstein_hash(x)
 /* Look like Bernstein's hashing function performs the best */
 
-/* For the initial naive implementation of hashing:
- * #define HASH_FUNC(x) (unsigned char)x[0]
- * if used this simple hash function, HASH_TABLE_SIZE must be 256 which is the
- * number of possible keys can be stored in an unsigned char
- */
+typedef struct {
+    unsigned int hash; /* HASH_FUNC() of the name */
+    int          id;   /* dimension, variable, or attribute ID, -1 if empty */
+} NC_nameslot;
 
+/* Name lookup table using open addressing. nalloc is 0 before the table is
+ * created, otherwise a power of 2. The table grows when it is 3/4 full.
+ */
 typedef struct NC_nametable {
-    int  num;  /* number of elements added in the list array. Its value starts
-                  with zero and incremented with new name is created. When its
-                  value becomes a multiple of NC_NAME_TABLE_CHUNK, list will be
-                  reallocated to a space of size (num + NC_NAME_TABLE_CHUNK) */
-    int *list; /* dimension or variable IDs */
+    int          nalloc; /* number of slots */
+    int          nused;  /* number of names in the table */
+    NC_nameslot *slots;  /* [nalloc] */
 } NC_nametable;
 
 /*
@@ -129,12 +130,7 @@ typedef struct NC_dimarray {
     int            ndefined;      /* number of defined dimensions */
     int            unlimited_id;  /* -1 for not defined, otherwise >= 0 */
     NC_dim       **value;
-    NC_nametable   nameT[HASH_TABLE_SIZE]; /* table for quick name lookup.
-                    * indices 0, 1, ... HASH_TABLE_SIZE-1 are the hash keys.
-                    * nameT[i].num is the number of hash collisions. The IDs of
-                    * dimensions with names producing the same hash key i are
-                    * stored in nameT[i].list[*]
-                    */
+    NC_nametable   nameT;         /* table for quick name lookup */
 } NC_dimarray;
 
 /* Begin defined in dim.c ---------------------------------------------------*/
@@ -169,12 +165,8 @@ typedef struct {
 typedef struct NC_attrarray {
     int            ndefined;  /* number of defined attributes */
     NC_attr      **value;
-    NC_nametable   nameT[HASH_TABLE_SIZE]; /* table for quick name lookup.
-                    * indices 0, 1, ... HASH_TABLE_SIZE-1 are the hash keys.
-                    * nameT[i].num is the number of hash collisions. The IDs of
-                    * variables with names producing the same hash key i are
-                    * stored in nameT[i].list[*]
-                    */
+    NC_nametable   nameT;     /* table for quick name lookup, created when
+                               * first searched, see ncmpio_NC_findattr() */
 } NC_attrarray;
 
 /* Begin defined in attr.c --------------------------------------------------*/
@@ -213,6 +205,11 @@ typedef struct {
                               total size in bytes of the array variable.
                               For record variable, this is the record size */
     NC_attrarray  attrs;   /* attribute array */
+    int           fill_pending; /* 1 if writing fill values is deferred */
+    MPI_Offset    nwritten;     /* number of regions in written[] */
+    MPI_Offset    written_cap;  /* number of regions allocated */
+    MPI_Offset   *written;      /* [written_cap*2] start and end file offsets
+                                   of regions written while fill_pending */
 #ifdef ENABLE_SUBFILING
     int           num_subfiles;
     int           ndims_org;  /* ndims before subfiling */
@@ -236,12 +233,7 @@ typedef struct NC_vararray {
     int            ndefined;    /* number of defined variables */
     int            num_rec_vars;/* number of defined record variables */
     NC_var       **value;
-    NC_nametable   nameT[HASH_TABLE_SIZE]; /* table for quick name lookup.
-                    * indices 0, 1, ... HASH_TABLE_SIZE-1 are the hash keys.
-                    * nameT[i].num is the number of hash collisions. The IDs of
-                    * variables with names producing the same hash key i are
-                    * stored in nameT[i].list[*]
-                    */
+    NC_nametable   nameT;       /* table for quick name lookup */
 } NC_vararray;
 
 /* Begin defined in var.c ---------------------------------------------------*/
@@ -277,12 +269,18 @@ ncmpio_NC_lookupvar(NC *ncp, int varid, NC_var **varp);
 #define NC_REQ_BUF_BYTE_SWAP       0x00000020
 #define NC_REQ_BUF_TO_BE_FREED     0x00000040
 #define NC_REQ_XBUF_TO_BE_FREED    0x00000080
+#define NC_REQ_TO_FREE             0x00000100 /* taken out of the pending list */
+#define NC_REQ_VARN                0x00000200 /* subarrays of a varn API */
+#define NC_REQ_VARD                0x00000400 /* filetype of a vard API */
 
 typedef struct NC_req {
     int           flag;         /* bit-wise OR of the above NC_REQ_* flags */
     int           id;           /* even number for write, odd for read */
     int           abuf_index;   /* index in the abuf occupy_table. -1 means not
                                    using attached buffer */
+    int           arena_chunk;  /* index of the chunk in ncp->arena holding
+                                   start[], -1 if start is NULL */
+    int           varn_num;     /* number of subarrays of a varn request */
     void         *buf;          /* buffer used in calling iput/iget */
     void         *xbuf;         /* buffer in external type, used to read/write,
                                    may point to buf */
@@ -291,7 +289,12 @@ typedef struct NC_req {
                                    allocated, to be unpacked to userBuf and
                                    freed after file access */
     NC_var       *varp;         /* pointer to variable object */
-    MPI_Offset   *start;        /* [varp->ndims*3] for start/count/stride */
+    MPI_Offset   *start;        /* [varp->ndims*3] for start/count/stride,
+                                   or [varn_num*varp->ndims*2] for starts and
+                                   counts of a varn request, carved out of
+                                   ncp->arena. NULL for a vard request */
+    MPI_Datatype  filetype;     /* duplicated filetype of a vard request,
+                                   relative to varp->begin */
     MPI_Offset    offset_start; /* starting offset of aggregate access region */
     MPI_Offset    offset_end;   /*   ending offset of aggregate access region */
     MPI_Offset    bufcount;     /* number of buftype in this request */
@@ -301,6 +304,100 @@ typedef struct NC_req {
     int          *status;       /* pointer to user's status */
 } NC_req;
 
+/* persistent request created by ncmpi_put_vara_init/ncmpi_get_vara_init. The
+ * buftype decoding and the filetype are done once at creation and reused
+ * every time the request is started.
+ */
+typedef struct NC_plan {
+    int           varid;        /* -1 if this entry is free */
+    int           reqMode;      /* NC_REQ_WR or NC_REQ_RD */
+    MPI_Offset   *start;        /* [varp->ndims*3] for start/count at creation
+                                   and start of the current access */
+    void         *buf;          /* user buffer given at creation */
+    MPI_Offset    bufcount;     /* number of buftype in buf */
+    MPI_Datatype  buftype;      /* user's data type, duplicated if derived */
+    int           buftype_dup;  /* 0 or 1, whether buftype is duplicated */
+    MPI_Datatype  itype;        /* element data type in buftype */
+    int           el_size;      /* byte size of itype */
+    int           buftype_is_contig;
+    int           need_convert; /* 0 or 1, type conversion needed */
+    int           need_swap;    /* 0 or 1, byte swap needed */
+    MPI_Offset    nelems;       /* number of itype in buf */
+    MPI_Offset    nbytes;       /* request size in bytes in file */
+    MPI_Offset    begin;        /* varp->begin when filetype was created */
+    MPI_Offset    recsize;      /* ncp->recsize when filetype was created */
+    MPI_Offset    offset;       /* file offset of filetype */
+    MPI_Datatype  filetype;     /* file access layout, MPI_BYTE if
+                                   contiguous */
+} NC_plan;
+
+#define NC_PLAN_CHUNK 16
+
+/* I/O statistics of a file, collected only when hint nc_stats is enabled */
+typedef struct NC_stats {
+    MPI_Offset    counts[2][NC_STATS_NUM_APIS]; /* [0] for puts, [1] gets */
+    MPI_Offset    bytes[2][NC_STATS_NUM_APIS];  /* request sizes in file */
+    double        timing[NC_STATS_NUM_TIMERS];  /* seconds spent */
+    int           num_vars;  /* number of variables in var_hist */
+    MPI_Offset  (*var_hist)[2][NC_STATS_HIST_BINS]; /* [num_vars] access
+                                                       size histograms */
+    char         *json_path; /* file to dump the statistics at close */
+} NC_stats;
+
+/* start and stop a timer of I/O statistics, costing nothing when disabled */
+#define NC_STATS_WTIME(ncp) (((ncp)->stats == NULL) ? 0.0 : MPI_Wtime())
+#define NC_STATS_ADD_TIME(ncp, kind, t0) \
+    if ((ncp)->stats != NULL) (ncp)->stats->timing[kind] += MPI_Wtime() - (t0);
+
+/* arena of the start/count/stride arrays of pending nonblocking requests.
+ * The arrays are carved out of chunks, saving a malloc per request. The
+ * chunk size starts small and doubles with each chunk added while requests
+ * are pending. A chunk is released once all requests using it are completed.
+ */
+#define NC_REQ_ARENA_MIN   256   /* number of MPI_Offset in the first chunk */
+#define NC_REQ_ARENA_CHUNK 65536 /* max number of MPI_Offset in a chunk */
+
+typedef struct {
+    MPI_Offset   *buf;   /* NULL if this chunk has been released */
+    size_t        size;  /* number of MPI_Offset allocated in buf */
+    size_t        used;  /* number of MPI_Offset carved out of buf */
+    int           nlive; /* number of pending requests using buf */
+} NC_arena_chunk;
+
+typedef struct {
+    int             cur;       /* chunk new arrays are carved out of, -1 if
+                                  there is none */
+    int             nchunks;   /* number of entries in chunks[] */
+    int             nlive;     /* number of chunks used by pending requests */
+    size_t          next_size; /* number of MPI_Offset of the next chunk */
+    NC_arena_chunk *chunks;
+} NC_req_arena;
+
+/* state of a split-phase wait started by ncmpi_wait_start(). The requests
+ * are kept until the posted nonblocking MPI-IO call completes in
+ * ncmpi_wait_end(), as their buffers are in use by MPI-IO.
+ */
+typedef struct NC_wait_split {
+    int           pending;    /* 0 or 1, set once ncmpi_wait_start() returns */
+    int           post;       /* 0 or 1, post the next collective read/write
+                                 as a nonblocking MPI-IO call */
+    int           rw_flag;    /* NC_REQ_WR or NC_REQ_RD of the posted call */
+    MPI_Request   mpireq;     /* posted MPI-IO request, MPI_REQUEST_NULL if
+                                 the I/O has been carried out already */
+    MPI_Status    mpistatus;  /* status of the posted call */
+    MPI_Offset    nbytes;     /* amount of the posted call in bytes */
+    int           status;     /* first error encountered so far */
+    int           num_w_reqs; /* number of write requests in put_list */
+    int           num_r_reqs; /* number of read requests in get_list */
+    NC_req       *put_list;   /* write requests to be completed */
+    NC_req       *get_list;   /* read requests to be completed */
+    MPI_Offset    newnumrecs; /* number of records after the writes */
+} NC_wait_split;
+
+/* file access is not allowed while a split-phase wait is pending */
+#define NC_WAIT_PENDING(ncp) \
+    ((ncp)->wait_split != NULL && (ncp)->wait_split->pending)
+
 #define NC_ABUF_DEFAULT_TABLE_SIZE 128
 
 typedef struct NC_buf_status {
@@ -318,6 +415,23 @@ typedef struct NC_buf {
     void          *buf;
 } NC_buf;
 
+/* a contiguous file access segment, used when flattening requests */
+typedef struct {
+    MPI_Offset off;      /* starting file offset of the segment */
+    MPI_Offset len;      /* length of the segment in bytes */
+    MPI_Aint   buf_addr; /* address of the segment in user/xbuf buffer */
+} off_len;
+
+/* default size of staging buffer used by two-phase I/O aggregators */
+#define NC_DEFAULT_TWO_PHASE_BUFSIZE 16777216
+
+/* default max size of free temporary buffers kept for reuse */
+#define NC_DEFAULT_BUF_POOL_SIZE 16777216
+
+/* default size of the chunk each process moves at a time when the data part
+ * of a file is shifted to make room for a grown header */
+#define NC_DEFAULT_MOVE_CHUNK_SIZE 4194304
+
 /* chunk size for allocating read/write nonblocking request lists */
 #define NC_REQUEST_CHUNK 1024
 
@@ -345,6 +459,27 @@ struct NC {
 #endif
     int           striping_unit; /* file stripe size of the file */
     int           chunk;       /* chunk size for reading header */
+    int           hdr_bcast_whole; /* 0 or 1, root reads the header alone and
+                                      broadcasts it at once when opening */
+    int           two_phase;   /* 0 or 1, use PnetCDF's own two-phase I/O
+                                  for collective requests */
+    int           num_aggrs;   /* number of two-phase I/O aggregators, 0 means
+                                  decided at run time */
+    MPI_Offset    tp_bufsize;  /* two-phase I/O staging buffer size */
+    int           intra_node_aggr; /* 0 or 1, aggregate collective requests
+                                      of processes on the same compute node */
+    MPI_Offset    pool_size;   /* max size of free temporary buffers kept in
+                                  pool for reuse, 0 disables the pool */
+    MPI_Offset    stream_size; /* chunk size for streaming type conversion
+                                  of blocking puts, 0 disables streaming */
+    int           lazy_fill;   /* 0 or 1, defer filling fixed-size variables
+                                  until their unwritten regions are known */
+    int           num_fill_pending; /* number of variables whose fill is
+                                       deferred */
+    int           defer_numrecs; /* 0 or 1, defer syncing numrecs of
+                                    collective puts to record variables */
+    MPI_Offset    move_chunk;  /* size of chunk moved by each process at a
+                                  time when shifting data in enddef */
     MPI_Offset    h_align;     /* file alignment for header */
     MPI_Offset    v_align;     /* file alignment for each fixed variable */
     MPI_Offset    r_align;     /* file alignment for record variable section */
@@ -364,6 +499,8 @@ struct NC {
     MPI_Info      mpiinfo;        /* used MPI info object */
     MPI_File      collective_fh;  /* file handle for collective mode */
     MPI_File      independent_fh; /* file handle for independent mode */
+    MPI_Comm      node_comm;      /* intra-node communicator, created at the
+                                     first intra-node aggregation */
 
     NC_dimarray   dims;     /* dimensions defined */
     NC_attrarray  attrs;    /* global attributes defined */
@@ -372,6 +509,14 @@ struct NC {
     NC_req       *get_list; /* list of nonblocking read requests */
     NC_req       *put_list; /* list of nonblocking write requests */
     NC_buf       *abuf;     /* attached buffer, used by bput APIs */
+    NC_plan      *plans;    /* list of persistent requests */
+    int           num_plans; /* number of entries allocated in plans */
+    ncmpii_buf_pool *pool;  /* pool of temporary buffers of put/get requests,
+                               e.g. xbuf */
+    NC_req_arena *arena;    /* start/count/stride of pending requests */
+    NC_stats     *stats;    /* I/O statistics, NULL if not collected */
+    NC_wait_split *wait_split; /* split-phase wait in progress, NULL if
+                                  there is none */
 
     char         *path;     /* file name */
     struct NC    *old;      /* contains the previous NC during redef. */
@@ -418,6 +563,9 @@ typedef struct bufferinfo {
     int         safe_mode;/* 0: disabled, 1: enabled */
     void       *base;     /* beginning of read/write buffer */
     void       *pos;      /* current position in buffer */
+    char       *whole;    /* if not NULL, the entire header in memory */
+    MPI_Offset  whole_size; /* size of whole */
+    int         in_memory;/* 1: fetch from whole, 0: from the file */
 } bufferinfo;
 
 extern MPI_Offset
@@ -460,27 +608,44 @@ ncmpio_igetput_varm(NC *ncp, NC_var *varp, const MPI_Offset *start,
                 MPI_Datatype datatype, int *reqid, int reqMode,
                 int isSameGroup);
 
-/* Begin defined in ncmpio_hash_func.c --------------------------------------*/
 extern int
-ncmpio_jenkins_one_at_a_time_hash(const char *str_name);
+ncmpio_igetput_varn(NC *ncp, NC_var *varp, int num,
+                MPI_Offset* const *starts, MPI_Offset* const *counts,
+                void *buf, MPI_Offset bnelems, MPI_Datatype ptype,
+                int *reqid, int reqMode);
 
 extern int
+ncmpio_igetput_vard(NC *ncp, NC_var *varp, MPI_Datatype filetype, void *buf,
+                MPI_Offset bnelems, int *reqid, int reqMode);
+
+/* Begin defined in ncmpio_getput.m4 ----------------------------------------*/
+extern void
+ncmpio_free_plans(NC *ncp);
+
+/* Begin defined in ncmpio_hash_func.c --------------------------------------*/
+extern unsigned int
+ncmpio_jenkins_one_at_a_time_hash(const char *str_name);
+
+extern unsigned int
 ncmpio_additive_hash(const char *str_name);
 
-extern int
+extern unsigned int
 ncmpio_rotating_hash(const char *str_name);
 
-extern int
+extern unsigned int
 ncmpio_Bernstein_hash(const char *str_name);
 
-extern int
+extern unsigned int
 ncmpio_Pearson_hash(const char *str_name);
 
+extern int
+ncmpio_hash_lookup(const NC_nametable *nameT, unsigned int hash, int *pos);
+
 extern int
 ncmpio_update_name_lookup_table(NC_nametable *nameT, const int id,
                                 const char *oldname, const char *newname);
 
-extern void
+extern int
 ncmpio_hash_insert(NC_nametable *nameT, const char *name, int id);
 
 extern int
@@ -490,20 +655,20 @@ extern int
 ncmpio_hash_replace(NC_nametable *nameT, const char *old_name,
                     const char *new_name, int id);
 
-extern void
+extern int
 ncmpio_hash_table_copy(NC_nametable *dest, const NC_nametable *src);
 
 extern void
 ncmpio_hash_table_free(NC_nametable *nameT);
 
-extern void
+extern int
 ncmpio_hash_table_populate_NC_var(NC_vararray *varsp);
 
-extern void
+extern int
 ncmpio_hash_table_populate_NC_dim(NC_dimarray *dimsp);
 
-extern void
-ncmpio_hash_table_populate_NC_attr(NC *ncp);
+extern int
+ncmpio_hash_table_populate_NC_attr(NC_attrarray *attrsp);
 
 /* Begin defined in ncmpio_fill.c -------------------------------------------*/
 extern int
@@ -515,14 +680,72 @@ ncmpio_inq_var_fill(NC_var *varp, void *fill_value);
 extern int
 ncmpio_fill_vars(NC *ncp);
 
+extern int
+ncmpio_lazy_fill_mark(NC_var *varp, const MPI_Offset *start,
+                      const MPI_Offset *count, const MPI_Offset *stride);
+
+extern int
+ncmpio_lazy_fill_mark_segs(NC *ncp, MPI_Offset nsegs, const off_len *segs);
+
+extern int
+ncmpio_lazy_fill_flush(NC *ncp);
+
 /* Begin defined in ncmpio_nonblocking.c ------------------------------------*/
 extern int
 ncmpio_getput_zero_req(NC *ncp, int rw_flag);
 
+/* Begin defined in ncmpio_two_phase.c -------------------------------------*/
+extern int
+ncmpio_two_phase_io(NC *ncp, int rw_flag, MPI_Offset nsegs, off_len *segs,
+                    void *buf);
+
+/* Begin defined in ncmpio_intra_node.c -----------------------------------*/
+extern int
+ncmpio_intra_node_aggr(NC *ncp, int rw_flag, MPI_Offset nsegs, off_len *segs,
+                       void *buf);
+
 /* Begin defined in ncmpio_close.c */
 extern int
 ncmpio_close_files(NC *ncp, int doUnlink);
 
+/* Begin defined in ncmpio_vard.c -----------------------------------------*/
+extern int
+ncmpio_filetype_flatten(MPI_Datatype filetype, MPI_Offset disp,
+                        MPI_Offset *nsegs, off_len **segs);
+
+/* Begin defined in ncmpio_req_arena.c --------------------------------------*/
+extern MPI_Offset *
+ncmpio_arena_alloc(NC *ncp, size_t len, int *chunk);
+
+extern void
+ncmpio_arena_free(NC *ncp, int chunk);
+
+extern void
+ncmpio_arena_destroy(NC_req_arena *arena);
+
+/* Begin defined in ncmpio_stats.c ------------------------------------------*/
+extern int
+ncmpio_stats_enable(NC *ncp, const char *json_path);
+
+extern void
+ncmpio_stats_free(NC_stats *stats);
+
+extern void
+ncmpio_stats_add(NC *ncp, const NC_var *varp, int api, int reqMode,
+                 MPI_Offset nbytes);
+
+extern void
+ncmpio_stats_add_vars(NC *ncp, const NC_var *varp, const MPI_Offset *count,
+                      const MPI_Offset *stride, const MPI_Offset *imap,
+                      int reqMode);
+
+extern void
+ncmpio_stats_add_varn(NC *ncp, const NC_var *varp, int num,
+                      MPI_Offset* const *counts, int reqMode);
+
+extern int
+ncmpio_stats_dump(NC *ncp);
+
 /* Begin defined in ncmpio_utils.c ------------------------------------------*/
 extern void
 ncmpio_set_pnetcdf_hints(NC *ncp, MPI_Info info);
@@ -161,7 +161,7 @@ ncmpio_free_NC_attrarray(NC_attrarray *ncap)
 
 #ifndef SEARCH_NAME_LINEARLY
     /* free space allocated for attribute name lookup table */
-    ncmpio_hash_table_free(ncap->nameT);
+    ncmpio_hash_table_free(&ncap->nameT);
 #endif
 }
 
@@ -177,6 +177,12 @@ ncmpio_dup_NC_attrarray(NC_attrarray *ncap, const NC_attrarray *ref)
     if (ref->ndefined == 0) { /* return now, if no attribute is defined */
         ncap->ndefined = 0;
         ncap->value    = NULL;
+#ifndef SEARCH_NAME_LINEARLY
+        /* do not share the lookup table of ref */
+        ncap->nameT.nalloc = 0;
+        ncap->nameT.nused  = 0;
+        ncap->nameT.slots  = NULL;
+#endif
         return NC_NOERR;
     }
 
@@ -199,8 +205,12 @@ ncmpio_dup_NC_attrarray(NC_attrarray *ncap, const NC_attrarray *ref)
     assert(ncap->ndefined == ref->ndefined);
 
 #ifndef SEARCH_NAME_LINEARLY
-    /* duplicate attribute name lookup table */
-    ncmpio_hash_table_copy(ncap->nameT, ref->nameT);
+    /* duplicate attribute name lookup table, if it has been created */
+    status = ncmpio_hash_table_copy(&ncap->nameT, &ref->nameT);
+    if (status != NC_NOERR) {
+        ncmpio_free_NC_attrarray(ncap);
+        return status;
+    }
 #endif
 
     return NC_NOERR;
@@ -254,38 +264,45 @@ int
 ncmpio_NC_findattr(const NC_attrarray *ncap,
                    const char         *name) /* normalized string */
 {
-    int i, key;
+    int i;
     size_t nchars;
 
     assert(ncap != NULL);
 
     if (ncap->ndefined == 0) return -1; /* none created yet */
 
-#ifdef SEARCH_NAME_LINEARLY
-    /* we assume the number of attributes is small and use the
-     * following linear search. If the number is expected to be large, then
-     * it is better to use the hashing as for variables and dimensions.
-     */
     nchars = strlen(name);
+
+#ifndef SEARCH_NAME_LINEARLY
+    /* Most variables have only a few attributes, for which a linear search
+     * is cheaper than hashing. The lookup table of an attribute array is
+     * created at its first search once the array grows beyond
+     * NC_NAME_TABLE_ATTR_MIN. The table is only a cache of the names in
+     * ncap->value, hence the cast of the const qualifier.
+     */
+    if (ncap->nameT.nalloc == 0 && ncap->ndefined > NC_NAME_TABLE_ATTR_MIN &&
+        ncmpio_hash_table_populate_NC_attr((NC_attrarray*)ncap) != NC_NOERR)
+        ncmpio_hash_table_free(&((NC_attrarray*)ncap)->nameT);
+
+    if (ncap->nameT.nalloc > 0) {
+        int pos=-1, attr_id;
+        unsigned int hash = HASH_FUNC(name);
+
+        /* check the names of the IDs with the same hash value */
+        while ((attr_id = ncmpio_hash_lookup(&ncap->nameT, hash, &pos)) >= 0) {
+            if (ncap->value[attr_id]->name_len == nchars &&
+                strcmp(name, ncap->value[attr_id]->name) == 0)
+                return attr_id; /* the name already exists */
+        }
+        return -1; /* the name has never been used */
+    }
+#endif
+
     for (i=0; i<ncap->ndefined; i++) {
         if (ncap->value[i]->name_len == nchars &&
             strcmp(ncap->value[i]->name, name) == 0)
             return i;
     }
-#else
-    /* hash name into a key for name lookup */
-    key = HASH_FUNC(name);
-
-    /* check the list (all names sharing the same key) using linear search */
-    nchars = strlen(name);
-    for (i=0; i<ncap->nameT[key].num; i++) {
-        int attr_id = ncap->nameT[key].list[i];
-        if (ncap->value[attr_id]->name_len == nchars &&
-            strcmp(name, ncap->value[attr_id]->name) == 0) {
-            return attr_id; /* the name already exists */
-        }
-    }
-#endif
     return -1; /* the name has never been used */
 }
 
@@ -484,7 +501,8 @@ err_check:
     assert(attrp != NULL);
 
 #ifndef SEARCH_NAME_LINEARLY
-    ncmpio_hash_replace(ncap->nameT, attrp->name, nnewname, attr_id);
+    if (ncap->nameT.nalloc > 0) /* lookup table has been created */
+        ncmpio_hash_replace(&ncap->nameT, attrp->name, nnewname, attr_id);
 #endif
 
     /* replace the old name with new name */
@@ -632,12 +650,28 @@ err_check:
         err = ncmpio_new_NC_attr(nname, iattrp->xtype, iattrp->nelems, &attrp);
         if (err != NC_NOERR) return err;
 
+        err = incr_NC_attrarray(ncap_out, attrp);
+        if (err != NC_NOERR) {
+            ncmpio_free_NC_attr(attrp);
+            NCI_Free(attrp);
+            return err;
+        }
+
 #ifndef SEARCH_NAME_LINEARLY
-        ncmpio_hash_insert(ncap_out->nameT, nname, ncap_out->ndefined);
+        /* insert nname to the lookup table only after the attribute is
+         * added, so the table never refers to an index that does not exist
+         */
+        if (ncap_out->nameT.nalloc > 0) { /* lookup table has been created */
+            err = ncmpio_hash_insert(&ncap_out->nameT, nname,
+                                     ncap_out->ndefined - 1);
+            if (err != NC_NOERR) {
+                ncap_out->ndefined--;
+                ncmpio_free_NC_attr(attrp);
+                NCI_Free(attrp);
+                return err;
+            }
+        }
 #endif
-
-        err = incr_NC_attrarray(ncap_out, attrp);
-        if (err != NC_NOERR) return err;
     }
 
     if (iattrp->xsz > 0)
@@ -686,9 +720,11 @@ ncmpio_del_att(void       *ncdp,
     }
 
 #ifndef SEARCH_NAME_LINEARLY
-    /* delete name entry from hash table */
-    err = ncmpio_hash_delete(ncap->nameT, nname, attrid);
-    if (err != NC_NOERR) goto err_check;
+    /* delete name entry from hash table, if it has been created */
+    if (ncap->nameT.nalloc > 0) {
+        err = ncmpio_hash_delete(&ncap->nameT, nname, attrid);
+        if (err != NC_NOERR) goto err_check;
+    }
 #endif
 
 err_check:
@@ -1073,12 +1109,27 @@ err_check:
         err = ncmpio_new_NC_attr(nname, xtype, nelems, &attrp);
         if (err != NC_NOERR) return err;
 
+        err = incr_NC_attrarray(ncap, attrp);
+        if (err != NC_NOERR) {
+            ncmpio_free_NC_attr(attrp);
+            NCI_Free(attrp);
+            return err;
+        }
+
 #ifndef SEARCH_NAME_LINEARLY
-        ncmpio_hash_insert(ncap->nameT, nname, ncap->ndefined);
+        /* insert nname to the lookup table only after the attribute is
+         * added, so the table never refers to an index that does not exist
+         */
+        if (ncap->nameT.nalloc > 0) { /* lookup table has been created */
+            err = ncmpio_hash_insert(&ncap->nameT, nname, ncap->ndefined - 1);
+            if (err != NC_NOERR) {
+                ncap->ndefined--;
+                ncmpio_free_NC_attr(attrp);
+                NCI_Free(attrp);
+                return err;
+            }
+        }
 #endif
-
-        err = incr_NC_attrarray(ncap, attrp);
-        if (err != NC_NOERR) return err;
     }
 
     if (nelems != 0 && buf != NULL) { /* non-zero length attribute */
@@ -68,6 +68,9 @@ ncmpio_buffer_detach(void *ncdp)
     /* check if the buffer has been previously attached */
     if (ncp->abuf == NULL) DEBUG_RETURN_ERROR(NC_ENULLABUF)
 
+    /* bput requests posted by ncmpio_wait_start() may still be in use */
+    if (NC_WAIT_PENDING(ncp)) DEBUG_RETURN_ERROR(NC_EPENDING)
+
     /* this API assumes users are responsible for no pending bput */
     for (i=0; i<ncp->numPutReqs; i++) {
         if (ncp->put_list[i].abuf_index >= 0) /* check for a pending bput */
@@ -39,10 +39,15 @@ ncmpio_free_NC(NC *ncp)
     ncmpio_free_NC_vararray(&ncp->vars);
 
     if (ncp->mpiinfo != MPI_INFO_NULL) MPI_Info_free(&ncp->mpiinfo);
+    if (ncp->node_comm != MPI_COMM_NULL) MPI_Comm_free(&ncp->node_comm);
 
     if (ncp->get_list != NULL) NCI_Free(ncp->get_list);
     if (ncp->put_list != NULL) NCI_Free(ncp->put_list);
     if (ncp->abuf     != NULL) NCI_Free(ncp->abuf);
+    if (ncp->plans    != NULL) ncmpio_free_plans(ncp);
+    if (ncp->pool     != NULL) ncmpii_pool_destroy(ncp->pool);
+    if (ncp->arena    != NULL) ncmpio_arena_destroy(ncp->arena);
+    if (ncp->stats    != NULL) ncmpio_stats_free(ncp->stats);
     if (ncp->path     != NULL) NCI_Free(ncp->path);
 
     NCI_Free(ncp);
@@ -85,6 +90,12 @@ ncmpio_close(void *ncdp)
     int err=NC_NOERR, status=NC_NOERR;
     NC *ncp = (NC*)ncdp;
 
+    if (NC_WAIT_PENDING(ncp)) {
+        /* the posted MPI-IO call must complete before closing the file */
+        ncmpio_wait_end(ncp);
+        status = NC_EPENDING;
+    }
+
     if (NC_indef(ncp)) { /* currently in define mode */
         status = ncmpio__enddef(ncp, 0, 0, 0, 0); /* TODO: defaults */
 
@@ -103,9 +114,15 @@ ncmpio_close(void *ncdp)
         err = ncmpio_end_indep_data(ncp);
         if (status == NC_NOERR ) status = err;
     }
+    else if (!NC_readonly(ncp) && !NC_indef(ncp) && ncp->defer_numrecs) {
+        /* numrecs of collective puts has not been sync-ed yet */
+        err = ncmpio_sync_numrecs(ncp);
+        if (status == NC_NOERR ) status = err;
+    }
 
     /* if entering this function in  collective data mode, we do not have to
-     * update header in file, as file header is always up-to-date */
+     * update header in file, as file header is always up-to-date, unless
+     * hint nc_defer_numrecs is enabled */
 
 #ifdef ENABLE_SUBFILING
     /* ncmpio__enddef() will update ncp->num_subfiles */
@@ -143,6 +160,18 @@ ncmpio_close(void *ncdp)
     }
 #endif
 
+    if (!NC_readonly(ncp) && ncp->num_fill_pending > 0) {
+        /* write pending lazy fills */
+        err = ncmpio_lazy_fill_flush(ncp);
+        if (status == NC_NOERR ) status = err;
+    }
+
+    if (ncp->stats != NULL && ncp->stats->json_path != NULL) {
+        /* dump I/O statistics of all processes in JSON (hint nc_stats_file) */
+        err = ncmpio_stats_dump(ncp);
+        if (status == NC_NOERR ) status = err;
+    }
+
     /* If the user wants a stronger data consistency by setting NC_SHARE */
     if (NC_doFsync(ncp))
         ncmpio_file_sync(ncp); /* calling MPI_File_sync() */
@@ -213,6 +213,18 @@ ncmpio_create(MPI_Comm     comm,
     /* chunk size for reading header, set to default before check hints */
     ncp->chunk = NC_DEFAULT_CHUNKSIZE;
 
+    /* staging buffer size of two-phase I/O, set to default before check
+     * hints */
+    ncp->tp_bufsize = NC_DEFAULT_TWO_PHASE_BUFSIZE;
+
+    /* max size of the pool of temporary buffers, set to default before check
+     * hints */
+    ncp->pool_size = NC_DEFAULT_BUF_POOL_SIZE;
+
+    /* size of chunks for moving data when the header grows, set to default
+     * before check hints */
+    ncp->move_chunk = NC_DEFAULT_MOVE_CHUNK_SIZE;
+
     /* calculate the true header size (not-yet aligned) */
     ncp->xsz = ncmpio_hdr_len_NC(ncp);
 
@@ -222,6 +234,9 @@ ncmpio_create(MPI_Comm     comm,
     /* extract I/O hints from user info */
     ncmpio_set_pnetcdf_hints(ncp, info);
 
+    /* pool of temporary buffers used by put and get requests */
+    ncp->pool = ncmpii_pool_create((size_t)ncp->pool_size);
+
 #if 0
     ncp->safe_mode    = 0;
     ncp->numGetReqs   = 0; /* number of pending non-blocking get requests */
@@ -234,21 +249,12 @@ ncmpio_create(MPI_Comm     comm,
     ncp->get_list     = NULL;
     ncp->put_list     = NULL;
     ncp->abuf         = NULL;
+    ncp->plans        = NULL;
+    ncp->num_plans    = 0;
     ncp->old          = NULL;
     ncp->put_size     = 0;    /* bytes written so far */
     ncp->get_size     = 0;    /* bytes read    so far */
 
-#ifndef SEARCH_NAME_LINEARLY
-    for (i=0; i<HASH_TABLE_SIZE; i++) {
-        /* initialize dim name lookup table */
-        ncp->dims.nameT[i].num = 0;
-        ncp->dims.nameT[i].list = NULL;
-        /* initialize var name lookup table */
-        ncp->vars.nameT[i].num = 0;
-        ncp->vars.nameT[i].list = NULL;
-    }
-#endif
-
 #ifdef ENABLE_SUBFILING
     ncp->subfile_mode = 0;
     ncp->num_subfiles = 0;
@@ -263,6 +269,7 @@ ncmpio_create(MPI_Comm     comm,
     ncp->mpiomode       = mpiomode;
     ncp->collective_fh  = fh;
     ncp->independent_fh = MPI_FILE_NULL;
+    ncp->node_comm      = MPI_COMM_NULL;
     ncp->path = (char*) NCI_Malloc(strlen(path) + 1);
     strcpy(ncp->path, path);
 
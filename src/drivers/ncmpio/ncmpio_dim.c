@@ -87,18 +87,19 @@ NC_finddim(const NC_dimarray *ncap,
            const char        *name,  /* normalized dim name */
            int               *dimidp)
 {
-    int i, key, dimid;
+    int pos, dimid;
+    unsigned int hash;
     size_t nchars;
 
     if (ncap->ndefined == 0) return NC_EBADDIM;
 
-    /* hash the dim name into a key for name lookup */
-    key = HASH_FUNC(name);
+    /* hash the dim name for name lookup */
+    hash = HASH_FUNC(name);
 
-    /* check the list using linear search */
+    /* check the names of the IDs with the same hash value */
     nchars = strlen(name);
-    for (i=0; i<ncap->nameT[key].num; i++) {
-        dimid = ncap->nameT[key].list[i];
+    pos = -1;
+    while ((dimid = ncmpio_hash_lookup(&ncap->nameT, hash, &pos)) >= 0) {
         if (ncap->value[dimid]->name_len == nchars &&
             strcmp(name, ncap->value[dimid]->name) == 0) {
             if (dimidp != NULL) *dimidp = dimid;
@@ -139,7 +140,7 @@ ncmpio_free_NC_dimarray(NC_dimarray *ncap)
 
 #ifndef SEARCH_NAME_LINEARLY
     /* free space allocated for dim name lookup table */
-    ncmpio_hash_table_free(ncap->nameT);
+    ncmpio_hash_table_free(&ncap->nameT);
 #endif
 }
 
@@ -155,6 +156,12 @@ ncmpio_dup_NC_dimarray(NC_dimarray *ncap, const NC_dimarray *ref)
     if (ref->ndefined == 0) {
         ncap->ndefined = 0;
         ncap->value    = NULL;
+#ifndef SEARCH_NAME_LINEARLY
+        /* do not share the lookup table of ref */
+        ncap->nameT.nalloc = 0;
+        ncap->nameT.nused  = 0;
+        ncap->nameT.slots  = NULL;
+#endif
         return NC_NOERR;
     }
 
@@ -179,7 +186,11 @@ ncmpio_dup_NC_dimarray(NC_dimarray *ncap, const NC_dimarray *ref)
 
 #ifndef SEARCH_NAME_LINEARLY
     /* duplicate dim name lookup table */
-    ncmpio_hash_table_copy(ncap->nameT, ref->nameT);
+    status = ncmpio_hash_table_copy(&ncap->nameT, &ref->nameT);
+    if (status != NC_NOERR) {
+        ncmpio_free_NC_dimarray(ncap);
+        return status;
+    }
 #endif
 
     return NC_NOERR;
@@ -226,6 +237,17 @@ ncmpio_def_dim(void       *ncdp,    /* IN:  NC object */
 
     dimid = ncp->dims.ndefined;
 
+#ifndef SEARCH_NAME_LINEARLY
+    /* insert nname to the lookup table before the dimension is counted in
+     * ncp->dims, so a failure leaves no dimension that cannot be found */
+    err = ncmpio_hash_insert(&ncp->dims.nameT, nname, dimid);
+    if (err != NC_NOERR) {
+        NCI_Free(nname);
+        NCI_Free(dimp);
+        return err;
+    }
+#endif
+
     /* Add a new dim handle to the end of handle array */
     ncp->dims.value[dimid] = dimp;
 
@@ -233,10 +255,6 @@ ncmpio_def_dim(void       *ncdp,    /* IN:  NC object */
 
     ncp->dims.ndefined++;
 
-#ifndef SEARCH_NAME_LINEARLY
-    ncmpio_hash_insert(ncp->dims.nameT, nname, dimid);
-#endif
-
     if (dimidp != NULL) *dimidp = dimid;
 
     return err;
@@ -322,7 +340,7 @@ ncmpio_rename_dim(void       *ncdp,
 #ifndef SEARCH_NAME_LINEARLY
     /* update dim name lookup table, by removing the old name and add
      * the new name */
-    err = ncmpio_update_name_lookup_table(ncp->dims.nameT, dimid,
+    err = ncmpio_update_name_lookup_table(&ncp->dims.nameT, dimid,
                              ncp->dims.value[dimid]->name, nnewname);
     if (err != NC_NOERR) {
         DEBUG_TRACE_ERROR(err)
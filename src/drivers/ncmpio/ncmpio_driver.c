@@ -68,7 +68,22 @@ static PNC_driver ncmpio_driver = {
     ncmpio_buffer_attach,
     ncmpio_buffer_detach,
     ncmpio_wait,
-    ncmpio_cancel
+    ncmpio_cancel,
+
+    ncmpio_getput_init,
+    ncmpio_start,
+    ncmpio_request_free,
+    ncmpio_inq_stats,
+    ncmpio_inq_var_stats,
+    ncmpio_inq_buf_pool_stats,
+
+    ncmpio_wait_start,
+    ncmpio_wait_test,
+    ncmpio_wait_end,
+
+    ncmpio_iget_vard,
+    ncmpio_iput_vard,
+    ncmpio_bput_vard
 };
 
 PNC_driver* ncmpio_inq_driver(void) {
@@ -161,4 +161,40 @@ ncmpio_wait(void *ncdp, int num_reqs, int *req_ids, int *statuses, int reqMode);
 extern int
 ncmpio_cancel(void *ncdp, int num_reqs, int *req_ids, int *statuses);
 
+extern int
+ncmpio_wait_start(void *ncdp, int num_reqs, int *req_ids, int *statuses);
+
+extern int
+ncmpio_wait_test(void *ncdp, int *flag);
+
+extern int
+ncmpio_wait_end(void *ncdp);
+
+extern int
+ncmpio_iget_vard(void *ncdp, int varid, MPI_Datatype filetype, void *buf, MPI_Offset bufcount, MPI_Datatype buftype, int *reqid, int reqMode);
+
+extern int
+ncmpio_iput_vard(void *ncdp, int varid, MPI_Datatype filetype, const void *buf, MPI_Offset bufcount, MPI_Datatype buftype, int *reqid, int reqMode);
+
+extern int
+ncmpio_bput_vard(void *ncdp, int varid, MPI_Datatype filetype, const void *buf, MPI_Offset bufcount, MPI_Datatype buftype, int *reqid, int reqMode);
+
+extern int
+ncmpio_getput_init(void *ncdp, int varid, const MPI_Offset *start, const MPI_Offset *count, const void *buf, MPI_Offset bufcount, MPI_Datatype buftype, int *request, int reqMode);
+
+extern int
+ncmpio_start(void *ncdp, int request, MPI_Offset recno, int reqMode);
+
+extern int
+ncmpio_request_free(void *ncdp, int request);
+
+extern int
+ncmpio_inq_stats(void *ncdp, MPI_Offset *put_counts, MPI_Offset *put_bytes, MPI_Offset *get_counts, MPI_Offset *get_bytes, double *timings);
+
+extern int
+ncmpio_inq_var_stats(void *ncdp, int varid, MPI_Offset *put_hist, MPI_Offset *get_hist);
+
+extern int
+ncmpio_inq_buf_pool_stats(void *ncdp, MPI_Offset *hits, MPI_Offset *misses, MPI_Offset *max_size);
+
 #endif
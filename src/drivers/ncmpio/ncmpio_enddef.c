@@ -18,6 +18,7 @@
 #include <stdio.h>
 #include <stdlib.h>  /* strtol() */
 #include <string.h>  /* memset() */
+#include <limits.h>  /* INT_MAX */
 #include <assert.h>
 #include <errno.h>
 
@@ -32,154 +33,235 @@
 #endif
 
 
+/*----< post_read() >--------------------------------------------------------*/
+/* Round k of move_file_block() moves window [nbytes-(k+1)*win_size,
+ * nbytes-k*win_size) of the data, the last window may be shorter. Post the
+ * nonblocking read of the rank-th chunk of the window and return its offset
+ * relative to the beginning of data in *off.
+ */
+static int
+post_read(NC          *ncp,
+          MPI_Offset   from,
+          MPI_Offset   nbytes,
+          MPI_Offset   win_size,
+          MPI_Offset   chunk_size,
+          int          rank,
+          MPI_Offset   k,
+          void        *buf,
+          MPI_Offset  *off,
+          MPI_Request *req)
+{
+    int mpireturn, bufcount;
+    MPI_Offset win_beg = MAX(0, nbytes - (k + 1) * win_size);
+    MPI_Offset win_end = nbytes - k * win_size;
+
+    *req = MPI_REQUEST_NULL;
+    *off = win_beg + rank * chunk_size;
+    bufcount = (int)MAX(0, MIN(chunk_size, win_end - *off));
+    if (bufcount == 0) return NC_NOERR;
+
+    TRACE_IO(MPI_File_iread_at)(ncp->collective_fh, from + *off, buf,
+                                bufcount, MPI_BYTE, req);
+    if (mpireturn != MPI_SUCCESS) {
+        int err = ncmpii_error_mpi2nc(mpireturn, "MPI_File_iread_at");
+        if (err == NC_EFILE) DEBUG_RETURN_ERROR(NC_EREAD)
+        return err;
+    }
+    return NC_NOERR;
+}
+
 /*----< move_file_block() >--------------------------------------------------*/
+/* Move nbytes of file data from offset "from" to a higher offset "to". The
+ * data is moved tail-first in windows of nprocs chunks, each process moving
+ * one contiguous chunk of a window. Two buffers are used, so the read of the
+ * next (lower) window is in flight while the current window is written. This
+ * is safe because a window is written only to offsets above the source of
+ * all windows not yet read (to > from), and the MPI_Allreduce in each round
+ * ensures all processes have finished reading a window before any of them
+ * writes to it, as the source and destination of a window can overlap.
+ */
 static int
 move_file_block(NC         *ncp,
                 MPI_Offset  to,
                 MPI_Offset  from,
                 MPI_Offset  nbytes)
 {
-    int rank, nprocs, bufcount, mpireturn, err, status=NC_NOERR, min_st;
-    void *buf;
-    int chunk_size=1048576; /* move 1 MB per process at a time */
+    int rank, nprocs, mpireturn, err, status=NC_NOERR, min_st, get_size;
+    char *buf[2];
+    MPI_Offset chunk_size, win_size, off[2]={0,0}, nrounds, k, fsize;
+    MPI_Request rd_req=MPI_REQUEST_NULL, wr_req=MPI_REQUEST_NULL;
     MPI_Status mpistatus;
 
+    if (nbytes <= 0) return NC_NOERR;
+
     MPI_Comm_size(ncp->comm, &nprocs);
     MPI_Comm_rank(ncp->comm, &rank);
 
+    /* data beyond the end of file, e.g. of variables never written, need not
+     * be moved. Besides, some MPI-IO implementations may never complete a
+     * nonblocking read beyond the end of file. All processes must agree on
+     * the file size, as it determines the number of rounds.
+     */
+    TRACE_IO(MPI_File_get_size)(ncp->collective_fh, &fsize);
+    if (mpireturn != MPI_SUCCESS) fsize = from + nbytes;
+    TRACE_COMM(MPI_Allreduce)(MPI_IN_PLACE, &fsize, 1, MPI_OFFSET, MPI_MAX,
+                              ncp->comm);
+    if (mpireturn != MPI_SUCCESS)
+        return ncmpii_error_mpi2nc(mpireturn, "MPI_Allreduce");
+    nbytes = MIN(nbytes, fsize - from);
+    if (nbytes <= 0) return NC_NOERR;
+
     /* if the file striping unit size is known (obtained from MPI-IO), then
-     * we use that instead of 1 MB */
-    if (ncp->striping_unit > 0) chunk_size = ncp->striping_unit;
+     * use a multiple of it, so each chunk covers whole stripes */
+    chunk_size = ncp->move_chunk;
+    if (ncp->striping_unit > 0) {
+        chunk_size += ncp->striping_unit - 1;
+        chunk_size -= chunk_size % ncp->striping_unit;
+        if (chunk_size > INT_MAX) chunk_size = ncp->striping_unit;
+    }
+    /* no need for chunks larger than each process's share */
+    if (chunk_size * nprocs > nbytes) {
+        chunk_size = (nbytes + nprocs - 1) / nprocs;
+        if (ncp->striping_unit > 0 && chunk_size > ncp->striping_unit) {
+            chunk_size += ncp->striping_unit - 1;
+            chunk_size -= chunk_size % ncp->striping_unit;
+        }
+    }
+    win_size = chunk_size * nprocs;
+    nrounds  = (nbytes + win_size - 1) / win_size;
 
-    /* buf will be used as a temporal buffer to move data in chunks, i.e.
-     * read a chunk and later write to the new location */
-    buf = NCI_Malloc((size_t)chunk_size);
-    if (buf == NULL) DEBUG_RETURN_ERROR(NC_ENOMEM)
+    /* two buffers, one being read while the other is written */
+    buf[0] = (char*) NCI_Malloc((size_t)chunk_size * 2);
+    if (buf[0] == NULL) DEBUG_RETURN_ERROR(NC_ENOMEM)
+    buf[1] = buf[0] + chunk_size;
 
     /* make fileview entire file visible */
     TRACE_IO(MPI_File_set_view)(ncp->collective_fh, 0, MPI_BYTE, MPI_BYTE,
                                 "native", MPI_INFO_NULL);
 
-    /* move the variable starting from its tail toward its beginning */
-    while (nbytes > 0) {
-        int get_size=0;
-
-        /* calculate how much to move at each time */
-        bufcount = chunk_size;
-        if (nbytes < (MPI_Offset)nprocs * chunk_size) {
-            /* handle the last group of chunks */
-            MPI_Offset rem_chunks = nbytes / chunk_size;
-            if (rank > rem_chunks) /* these processes do not read/write */
-                bufcount = 0;
-            else if (rank == rem_chunks) /* this process reads/writes less */
-                bufcount = (int)(nbytes % chunk_size);
-            nbytes = 0;
-        }
-        else {
-            nbytes -= chunk_size*nprocs;
-        }
+    err = post_read(ncp, from, nbytes, win_size, chunk_size, rank, 0, buf[0],
+                    &off[0], &rd_req);
+    if (status == NC_NOERR) status = err;
 
-        /* explicitly initialize mpistatus object to 0, see comments below */
+    for (k=0; k<nrounds; k++) {
+        int cur = (int)(k % 2);
+
+        /* wait for the read of this round. For zero-length read, MPI_Get_count
+         * may report incorrect result for some MPICH version, due to the
+         * uninitialized MPI_Status object. Thus we initialize it to work
+         * around. See MPICH ticket:
+         * https://trac.mpich.org/projects/mpich/ticket/2332
+         *
+         * Only the amount actually read is written to the new location.
+         */
         memset(&mpistatus, 0, sizeof(MPI_Status));
+        get_size = 0;
+        if (rd_req != MPI_REQUEST_NULL) {
+            mpireturn = MPI_Wait(&rd_req, &mpistatus);
+            if (mpireturn != MPI_SUCCESS) {
+                err = ncmpii_error_mpi2nc(mpireturn, "MPI_Wait");
+                if (err == NC_EFILE) err = NC_EREAD;
+                if (status == NC_NOERR) status = err;
+            }
+            else {
+                MPI_Get_count(&mpistatus, MPI_BYTE, &get_size);
+                if (get_size == MPI_UNDEFINED) get_size = 0;
+                ncp->get_size += get_size;
+            }
+        }
 
-        /* read the original data @ from+nbytes+rank*chunk_size */
-        TRACE_IO(MPI_File_read_at_all)(ncp->collective_fh,
-                                       from+nbytes+rank*chunk_size,
-                                       buf, bufcount, MPI_BYTE, &mpistatus);
-        if (mpireturn != MPI_SUCCESS) {
-            err = ncmpii_error_mpi2nc(mpireturn, "MPI_File_read_at_all");
-            if (err == NC_EFILE) DEBUG_ASSIGN_ERROR(status, NC_EREAD)
+        /* the other buffer is free once the write of previous round is done */
+        if (wr_req != MPI_REQUEST_NULL) {
+            mpireturn = MPI_Wait(&wr_req, &mpistatus);
+            if (mpireturn != MPI_SUCCESS) {
+                err = ncmpii_error_mpi2nc(mpireturn, "MPI_Wait");
+                if (err == NC_EFILE) err = NC_EWRITE;
+                if (status == NC_NOERR) status = err;
+            }
         }
-        else {
-            /* for zero-length read, MPI_Get_count may report incorrect result
-             * for some MPICH version, due to the uninitialized MPI_Status
-             * object passed to MPI-IO calls. Thus we initialize it above to
-             * work around. See MPICH ticket:
-             * https://trac.mpich.org/projects/mpich/ticket/2332
-             *
-             * Note we cannot set bufcount to get_size, as the actural size
-             * read from a file may be less than bufcount. Because we are
-             * moving whatever read to a new file offset, we must use the
-             * amount actually read to call MPI_File_write_at_all below.
-             */
-            MPI_Get_count(&mpistatus, MPI_BYTE, &get_size);
-            ncp->get_size += get_size;
+
+        /* start reading the next window, which lies entirely below the
+         * source and destination of this window */
+        if (k + 1 < nrounds && status == NC_NOERR) {
+            err = post_read(ncp, from, nbytes, win_size, chunk_size, rank,
+                            k + 1, buf[1-cur], &off[1-cur], &rd_req);
+            if (status == NC_NOERR) status = err;
         }
 
-        /* MPI_Barrier(ncp->comm); */
-        /* important, in case new region overlaps old region */
+        /* important, all processes must finish reading this window before any
+         * of them writes to it, in case new region overlaps old region */
         TRACE_COMM(MPI_Allreduce)(&status, &min_st, 1, MPI_INT, MPI_MIN,
                                   ncp->comm);
         status = min_st;
         if (status != NC_NOERR) break;
 
-        /* write to new location @ to+nbytes+rank*chunk_size
-         *
-         * Ideally, we should write the amount of get_size returned from a call
-         * to MPI_Get_count in the below MPI write. This is in case some
-         * variables are defined but never been written. The value returned by
-         * MPI_Get_count is supposed to be the actual amount read by the MPI
-         * read call. If partial data (or none) is available for read, then we
-         * should just write that amount. Note this MPI write is collective,
-         * and thus all processes must participate the call even if get_size
-         * is 0. However, in some MPICH versions MPI_Get_count fails to report
-         * the correct value due to an internal error that fails to initialize
-         * the MPI_Status object. Therefore, the solution can be either to
-         * explicitly initialize the status object to zeros, or to just use
-         * bufcount for write. Note that the latter will write the variables
-         * that have not been written before. Below uses the former option.
-         */
-#ifdef _USE_MPI_GET_COUNT
-        /* explicitly initialize mpistatus object to 0, see comments below */
-        memset(&mpistatus, 0, sizeof(MPI_Status));
-#endif
-        TRACE_IO(MPI_File_write_at_all)(ncp->collective_fh,
-                                        to+nbytes+rank*chunk_size,
-                                        buf, get_size /* bufcount */,
-                                        MPI_BYTE, &mpistatus);
-        if (mpireturn != MPI_SUCCESS) {
-            err = ncmpii_error_mpi2nc(mpireturn, "MPI_File_write_at_all");
-            if (err == NC_EFILE) DEBUG_ASSIGN_ERROR(status, NC_EWRITE)
+        if (get_size > 0) {
+            TRACE_IO(MPI_File_iwrite_at)(ncp->collective_fh, to + off[cur],
+                                         buf[cur], get_size, MPI_BYTE,
+                                         &wr_req);
+            if (mpireturn != MPI_SUCCESS) {
+                err = ncmpii_error_mpi2nc(mpireturn, "MPI_File_iwrite_at");
+                if (err == NC_EFILE) err = NC_EWRITE;
+                if (status == NC_NOERR) status = err;
+            }
+            else
+                ncp->put_size += get_size;
         }
-        else {
-            /* for zero-length read, MPI_Get_count may report incorrect result
-             * for some MPICH version, due to the uninitialized MPI_Status
-             * object passed to MPI-IO calls. Thus we initialize it above to
-             * work around.
-             */
-#ifdef _USE_MPI_GET_COUNT
-            int put_size;
-            MPI_Get_count(&mpistatus, MPI_BYTE, &put_size);
-            ncp->put_size += put_size;
-#else
-            ncp->put_size += get_size; /* or bufcount */
-#endif
+    }
+
+    /* complete the outstanding requests, including those left by an error */
+    if (rd_req != MPI_REQUEST_NULL) MPI_Wait(&rd_req, &mpistatus);
+    if (wr_req != MPI_REQUEST_NULL) {
+        mpireturn = MPI_Wait(&wr_req, &mpistatus);
+        if (mpireturn != MPI_SUCCESS) {
+            err = ncmpii_error_mpi2nc(mpireturn, "MPI_Wait");
+            if (err == NC_EFILE) err = NC_EWRITE;
+            if (status == NC_NOERR) status = err;
         }
-        TRACE_COMM(MPI_Allreduce)(&status, &min_st, 1, MPI_INT, MPI_MIN, ncp->comm);
-        status = min_st;
-        if (status != NC_NOERR) break;
     }
-    NCI_Free(buf);
-    return status;
+    NCI_Free(buf[0]);
+
+    /* all writes must complete before the caller moves the data below */
+    TRACE_COMM(MPI_Allreduce)(&status, &min_st, 1, MPI_INT, MPI_MIN,
+                              ncp->comm);
+    return min_st;
 }
 
 /*----< move_fixed_vars() >--------------------------------------------------*/
-/* move one fixed variable at a time, only when the new begin > old begin */
+/* move fixed variables, only when the new begin > old begin. Consecutive
+ * variables shifted by the same distance, the common case when only the
+ * header grows, are moved together as one block, including the alignment
+ * gaps between them.
+ */
 static int
 move_fixed_vars(NC *ncp, NC *old)
 {
-    int i, err, status=NC_NOERR;
+    int i, j, err, status=NC_NOERR;
 
     /* move starting from the last fixed variable */
-    for (i=old->vars.ndefined-1; i>=0; i--) {
+    for (i=old->vars.ndefined-1; i>=0; i=j) {
+        MPI_Offset from, to, end;
+
+        j = i - 1;
         if (IS_RECVAR(old->vars.value[i])) continue;
 
-        MPI_Offset from = old->vars.value[i]->begin;
-        MPI_Offset to   = ncp->vars.value[i]->begin;
-        if (to > from) {
-            err = move_file_block(ncp, to, from, ncp->vars.value[i]->len);
-            if (status == NC_NOERR) status = err;
+        from = old->vars.value[i]->begin;
+        to   = ncp->vars.value[i]->begin;
+        end  = from + ncp->vars.value[i]->len;
+        if (to <= from) continue;
+
+        /* extend the block to the preceding fixed variables with the same
+         * shift distance */
+        for (; j>=0; j--) {
+            if (IS_RECVAR(old->vars.value[j])) continue;
+            if (ncp->vars.value[j]->begin - old->vars.value[j]->begin !=
+                to - from) break;
+            from = old->vars.value[j]->begin;
+            to   = ncp->vars.value[j]->begin;
         }
+
+        err = move_file_block(ncp, to, from, end - from);
+        if (status == NC_NOERR) status = err;
     }
     return status;
 }
@@ -445,8 +527,8 @@ NC_begins(NC *ncp)
  * This function is collective and only called by enddef().
  * Write out the header
  * 1. Call ncmpio_hdr_put_NC() to copy the header object, ncp, to a buffer.
- * 2. Call NC_check_header() to check if header is consistent across all
- *    processes.
+ * 2. In safe mode, check if header is consistent across all processes by
+ *    comparing the hashes of the headers.
  * 3. Process rank 0 writes the header to file.
  * This is a collective call.
  */
@@ -481,78 +563,73 @@ write_NC(NC *ncp)
 
     MPI_Comm_rank(ncp->comm, &rank);
 
-#ifdef _DIFF_HEADER
-    if (ncp->safe_mode == 0) {
-        int h_size=(int)ncp->xsz;
-        void *root_header;
-
-        /* check header against root's */
-        if (rank == 0) root_header = buf;
-        else           root_header = (void*) NCI_Malloc((size_t)h_size);
-
-        TRACE_COMM(MPI_Bcast)(root_header, h_size, MPI_BYTE, 0, ncp->comm);
+    if (ncp->safe_mode == 1) {
+        /* Check the header consistency across all processes. Instead of
+         * broadcasting root's header and comparing it on all processes, each
+         * process computes a hash of its header, and the maximums of the
+         * hash, the header size and their bitwise complements are reduced
+         * in a single MPI_Allreduce. All headers match only when the maximum
+         * of each value equals the complement of the maximum of its
+         * complement, i.e. its minimum.
+         */
+        unsigned long long hval[4], max_hval[4];
+
+        hval[0] = ncmpii_hash64(buf, (size_t)local_xsz, 0);
+        hval[1] = ~hval[0];
+        hval[2] = (unsigned long long)local_xsz;
+        hval[3] = ~hval[2];
+        TRACE_COMM(MPI_Allreduce)(hval, max_hval, 4, MPI_UNSIGNED_LONG_LONG,
+                                  MPI_MAX, ncp->comm);
         if (mpireturn != MPI_SUCCESS) {
-            err = ncmpii_error_mpi2nc(mpireturn, "MPI_Bcast");
-            DEBUG_RETURN_ERROR(err)
-        }
-
-        if (rank > 0) {
-            if (h_size != local_xsz || memcmp(buf, root_buf, h_size))
-                status = NC_EMULTIDEFINE;
-            NCI_Free(root_buf);
+            NCI_Free(buf);
+            return ncmpii_error_mpi2nc(mpireturn, "MPI_Allreduce");
         }
 
-        /* report error if header is inconsistency */
-        TRACE_COMM(MPI_Allreduce)(&status, &err, 1, MPI_INT, MPI_MIN,ncp->comm);
-        if (mpireturn != MPI_SUCCESS) {
-            err = ncmpii_error_mpi2nc(mpireturn, "MPI_Allreduce");
-            DEBUG_RETURN_ERROR(err)
-        }
-        if (err != NC_NOERR) {
-            /* TODO: this error return is harsh. Maybe relax for inconsistent
-             * attribute contents? */
-            if (status == NC_NOERR) status = err;
-            NCI_Free(buf);
-            return status;
+        if (max_hval[0] != ~max_hval[1] || max_hval[2] != ~max_hval[3]) {
+            /* The mismatch is known to all processes, so all of them return
+             * the error, as other errors are reported in safe mode. Root's
+             * header is still written to the file below.
+             */
+            DEBUG_ASSIGN_ERROR(status, NC_EMULTIDEFINE)
+#ifdef PNETCDF_DEBUG
+            {
+                /* report the processes whose headers differ from root's */
+                int h_size=(int)ncp->xsz; /* root's header size */
+                void *root_header;
+
+                if (rank == 0) root_header = buf;
+                else           root_header = NCI_Malloc((size_t)h_size);
+
+                TRACE_COMM(MPI_Bcast)(root_header, h_size, MPI_BYTE, 0,
+                                      ncp->comm);
+                if (mpireturn != MPI_SUCCESS) {
+                    err = ncmpii_error_mpi2nc(mpireturn, "MPI_Bcast");
+                    if (rank > 0) NCI_Free(root_header);
+                    NCI_Free(buf);
+                    return err;
+                }
+
+                if (rank > 0) {
+                    if (h_size != local_xsz ||
+                        memcmp(buf, root_header, h_size)) {
+                        MPI_Offset off=0;
+                        while (off < MIN(h_size, local_xsz) &&
+                               ((char*)buf)[off] == ((char*)root_header)[off])
+                            off++;
+                        fprintf(stderr, "Rank %d: header differs from root's at byte offset %lld\n",
+                                rank, off);
+                    }
+                    NCI_Free(root_header);
+                }
+            }
+#endif
         }
     }
-#endif
 
-#ifdef _CHECK_HEADER_CONSISTENCY
-    /* check the header consistency across all processes and sync header.
-     * When safe_mode is on:
-     *   The returned status on root can be either NC_NOERR (all headers are
-     *   consistent) or NC_EMULTIDEFINE (some headers are inconsistent).
-     *   The returned status on non-root processes can be NC_NOERR, fatal
-     *   error (>-250), or inconsistency error (-250 to -269).
-     * When safe_mode is off:
-     *   The returned status on root is always NC_NOERR
-     *   The returned status on non-root processes can be NC_NOERR, fatal
-     *   error (>-250), or inconsistency error (-250 to -269).
-     * For fatal error, we should stop. For others, we can continue.
+    /* For non-fatal error, we continue to write root's header to the file.
+     * Note when NC_EMULTIDEFINE is returned, the header objects in memory
+     * are not sync-ed and may still differ from root's on other processes.
      */
-    int max_err;
-    status = NC_check_header(ncp, buf, local_xsz);
-
-    /* check for fatal error */
-    err =  (status != NC_NOERR && !ErrIsHeaderDiff(status)) ? 1 : 0;
-    max_err = err;
-
-    if (ncp->safe_mode == 1) {
-        TRACE_COMM(MPI_Allreduce)(&err, &max_err, 1, MPI_INT, MPI_MAX,
-                                  ncp->comm);
-        if (mpireturn != MPI_SUCCESS) {
-            err = ncmpii_error_mpi2nc(mpireturn,"MPI_Allreduce");
-            DEBUG_RETURN_ERROR(err)
-        }
-    }
-    if (max_err == 1) { /* some processes encounter a fatal error */
-        NCI_Free(buf);
-        return status;
-    }
-#endif
-    /* For non-fatal error, we continue to write header to the file, as now the
-     * header object in memory has been sync-ed across all processes. */
 
     /* only rank 0's header gets written to the file */
     if (rank == 0) {
@@ -819,9 +896,12 @@ ncmpio__enddef(void       *ncdp,
 {
     int i, flag, striping_unit, mpireturn, err=NC_NOERR, status=NC_NOERR;
     char value[MPI_MAX_INFO_VAL];
+    double timing, enddef_timing;
     MPI_Offset all_fix_var_size;
     NC *ncp = (NC*)ncdp;
 
+    enddef_timing = NC_STATS_WTIME(ncp);
+
     /* sanity check for NC_ENOTINDEFINE, NC_EINVAL, NC_EMULTIDEFINE_FNC_ARGS
      * has been done at dispatchers */
     ncp->h_minfree = h_minfree;
@@ -986,7 +1066,9 @@ ncmpio__enddef(void       *ncdp,
     /* first sync header objects in memory across all processes, and then root
      * writes the header to file. Note safe_mode error check will be done in
      * write_NC() */
+    timing = NC_STATS_WTIME(ncp);
     status = write_NC(ncp);
+    NC_STATS_ADD_TIME(ncp, NC_STATS_TIME_HEADER, timing)
 
     /* we should continue to exit define mode, even if header is inconsistent
      * among processes, so the program can proceed, say to close file properly.
@@ -1009,7 +1091,9 @@ ncmpio__enddef(void       *ncdp,
 
     /* fill variables according to their fill mode settings */
     if (ncp->vars.ndefined > 0) {
+        timing = NC_STATS_WTIME(ncp);
         err = ncmpio_fill_vars(ncp);
+        NC_STATS_ADD_TIME(ncp, NC_STATS_TIME_FILL, timing)
         if (status == NC_NOERR) status = err;
     }
 
@@ -1028,6 +1112,8 @@ ncmpio__enddef(void       *ncdp,
     if (NC_doFsync(ncp))
         ncmpio_file_sync(ncp); /* calling MPI_File_sync() */
 
+    NC_STATS_ADD_TIME(ncp, NC_STATS_TIME_ENDDEF, enddef_timing)
+
     return status;
 }
 
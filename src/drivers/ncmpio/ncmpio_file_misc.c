@@ -53,10 +53,16 @@ dup_NC(const NC *ref)
 
     /* fields below should not copied from ref */
     ncp->comm       = MPI_COMM_NULL;
+    ncp->node_comm  = MPI_COMM_NULL;
     ncp->mpiinfo    = MPI_INFO_NULL;
     ncp->get_list   = NULL;
     ncp->put_list   = NULL;
     ncp->abuf       = NULL;
+    ncp->plans      = NULL;
+    ncp->num_plans  = 0;
+    ncp->pool       = NULL;
+    ncp->arena      = NULL;
+    ncp->stats      = NULL;
     ncp->path       = NULL;
 
     return ncp;
@@ -81,8 +87,22 @@ ncmpio_redef(void *ncdp)
      * also ensure exiting define mode always entering collective data mode
      */
 #endif
+    /* no file access until the pending split-phase wait is ended */
+    if (NC_WAIT_PENDING(ncp)) DEBUG_RETURN_ERROR(NC_EPENDING)
+
     if (NC_indep(ncp)) /* exit independent mode, if in independent mode */
         ncmpio_end_indep_data(ncp);
+    else if (ncp->defer_numrecs && !NC_readonly(ncp)) {
+        /* numrecs of collective puts has not been sync-ed yet */
+        int err = ncmpio_sync_numrecs(ncp);
+        if (err != NC_NOERR) return err;
+    }
+
+    if (ncp->num_fill_pending > 0) {
+        /* write pending lazy fills, as enddef may move variable data */
+        int err = ncmpio_lazy_fill_flush(ncp);
+        if (err != NC_NOERR) return err;
+    }
 
 #if 0
     /* header metadata is always sync-ed among all processes, except for
@@ -115,6 +135,9 @@ ncmpio_begin_indep_data(void *ncdp)
     if (NC_indef(ncp))  /* must not be in define mode */
         DEBUG_RETURN_ERROR(NC_EINDEFINE)
 
+    /* no file access until the pending split-phase wait is ended */
+    if (NC_WAIT_PENDING(ncp)) DEBUG_RETURN_ERROR(NC_EPENDING)
+
     if (NC_indep(ncp))  /* already in indep data mode */
         return NC_NOERR;
         /* starting from 1.2.0, calling begin_indep_data() in independent data
@@ -139,6 +162,12 @@ ncmpio_begin_indep_data(void *ncdp)
     }
 #endif
 
+    if (ncp->num_fill_pending > 0) {
+        /* write pending lazy fills while all processes can still take part */
+        int err = ncmpio_lazy_fill_flush(ncp);
+        if (err != NC_NOERR) return err;
+    }
+
     /* raise independent flag */
     fSet(ncp->flags, NC_MODE_INDEP);
 
@@ -231,6 +260,12 @@ ncmpio_abort(void *ncdp)
     /* delete the file if it is newly created by ncmpi_create() */
     doUnlink = NC_IsNew(ncp);
 
+    if (NC_WAIT_PENDING(ncp)) {
+        /* the posted MPI-IO call must complete before closing the file */
+        err = ncmpio_wait_end(ncp);
+        if (status == NC_NOERR) status = err;
+    }
+
     if (ncp->old != NULL) {
         /* a plain redef, not a create */
         assert(!NC_IsNew(ncp));
@@ -396,6 +431,54 @@ ncmpio_inq_misc(void       *ncdp,
         sprintf(value, "%d", ncp->chunk);
         MPI_Info_set(*info_used, "nc_header_read_chunk_size", value);
 
+        if (ncp->hdr_bcast_whole)
+            MPI_Info_set(*info_used, "nc_header_bcast_whole", "enable");
+        else
+            MPI_Info_set(*info_used, "nc_header_bcast_whole", "disable");
+
+        if (ncp->two_phase)
+            MPI_Info_set(*info_used, "nc_pnetcdf_two_phase", "enable");
+        else
+            MPI_Info_set(*info_used, "nc_pnetcdf_two_phase", "disable");
+
+        sprintf(value, "%d", ncp->num_aggrs);
+        MPI_Info_set(*info_used, "nc_two_phase_num_aggrs", value);
+
+        sprintf(value, "%lld", ncp->tp_bufsize);
+        MPI_Info_set(*info_used, "nc_two_phase_buffer_size", value);
+
+        sprintf(value, "%lld", ncp->pool_size);
+        MPI_Info_set(*info_used, "nc_buf_pool_size", value);
+
+        sprintf(value, "%lld", ncp->stream_size);
+        MPI_Info_set(*info_used, "nc_put_stream_size", value);
+
+        sprintf(value, "%lld", ncp->move_chunk);
+        MPI_Info_set(*info_used, "nc_data_move_chunk_size", value);
+
+        if (ncp->lazy_fill)
+            MPI_Info_set(*info_used, "nc_lazy_fill", "enable");
+        else
+            MPI_Info_set(*info_used, "nc_lazy_fill", "disable");
+
+        if (ncp->defer_numrecs)
+            MPI_Info_set(*info_used, "nc_defer_numrecs", "enable");
+        else
+            MPI_Info_set(*info_used, "nc_defer_numrecs", "disable");
+
+        if (ncp->stats != NULL)
+            MPI_Info_set(*info_used, "nc_stats", "enable");
+        else
+            MPI_Info_set(*info_used, "nc_stats", "disable");
+
+        if (ncp->stats != NULL && ncp->stats->json_path != NULL)
+            MPI_Info_set(*info_used, "nc_stats_file", ncp->stats->json_path);
+
+        if (ncp->intra_node_aggr)
+            MPI_Info_set(*info_used, "nc_intra_node_aggr", "enable");
+        else
+            MPI_Info_set(*info_used, "nc_intra_node_aggr", "disable");
+
 #ifdef ENABLE_SUBFILING
         if (ncp->subfile_mode)
             MPI_Info_set(*info_used, "pnetcdf_subfiling", "enable");
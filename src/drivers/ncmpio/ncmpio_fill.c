@@ -405,6 +405,15 @@ fillerup_aggregate(NC *ncp, NC *old_ncp)
 
         if (IS_RECVAR(varp)) continue; /* first, fixed-size variables only */
 
+        if (ncp->lazy_fill) {
+            /* defer the fill until the regions written are known, see
+             * ncmpio_lazy_fill_flush() */
+            varp->fill_pending = 1;
+            ncp->num_fill_pending++;
+            noFill[i-start_vid] = 1;
+            continue;
+        }
+
         if (varp->ndims == 0) var_len = 1; /* scalar */
         else                  var_len = varp->dsizes[0];
 
@@ -599,6 +608,422 @@ fillerup_aggregate(NC *ncp, NC *old_ncp)
     return status;
 }
 
+/*----< cmp_seg() >----------------------------------------------------------*/
+/* compare the starting offsets of two [start, end) pairs */
+static int
+cmp_seg(const void *a, const void *b)
+{
+    const MPI_Offset *x = (const MPI_Offset*)a;
+    const MPI_Offset *y = (const MPI_Offset*)b;
+
+    if (x[0] < y[0]) return -1;
+    if (x[0] > y[0]) return  1;
+    return 0;
+}
+
+/*----< coalesce_segs() >----------------------------------------------------*/
+/* sort nsegs [start, end) pairs stored in segs and merge the overlapping and
+ * adjacent ones. Return the number of pairs after merging.
+ */
+static MPI_Offset
+coalesce_segs(MPI_Offset *segs,
+              MPI_Offset  nsegs)
+{
+    MPI_Offset i, j;
+
+    if (nsegs <= 1) return nsegs;
+
+    qsort(segs, (size_t)nsegs, 2 * SIZEOF_MPI_OFFSET, cmp_seg);
+
+    for (i=0, j=1; j<nsegs; j++) {
+        if (segs[2*j] <= segs[2*i+1]) { /* overlap or adjacent */
+            if (segs[2*i+1] < segs[2*j+1]) segs[2*i+1] = segs[2*j+1];
+        }
+        else {
+            i++;
+            segs[2*i]   = segs[2*j];
+            segs[2*i+1] = segs[2*j+1];
+        }
+    }
+    return i + 1;
+}
+
+/*----< add_written() >------------------------------------------------------*/
+/* add file region [beg, end) to the list of regions of variable varp that
+ * have been written while its fill is deferred
+ */
+static int
+add_written(NC_var     *varp,
+            MPI_Offset  beg,
+            MPI_Offset  end)
+{
+    MPI_Offset n = varp->nwritten;
+
+    /* extend the last region, the common case of writing in file order */
+    if (n > 0 && beg >= varp->written[2*n-2] && beg <= varp->written[2*n-1]) {
+        if (varp->written[2*n-1] < end) varp->written[2*n-1] = end;
+        return NC_NOERR;
+    }
+
+    if (n == varp->written_cap) {
+        /* merge the regions first and grow the list if still half full */
+        n = varp->nwritten = coalesce_segs(varp->written, n);
+        if (2 * n >= varp->written_cap) {
+            MPI_Offset cap = (varp->written_cap == 0) ? 64
+                           : varp->written_cap * 2;
+            MPI_Offset *segs;
+            segs = (MPI_Offset*) NCI_Realloc(varp->written,
+                                             (size_t)cap * 2 * SIZEOF_MPI_OFFSET);
+            if (segs == NULL) DEBUG_RETURN_ERROR(NC_ENOMEM)
+            varp->written     = segs;
+            varp->written_cap = cap;
+        }
+    }
+    varp->written[2*n]   = beg;
+    varp->written[2*n+1] = end;
+    varp->nwritten++;
+    return NC_NOERR;
+}
+
+/*----< ncmpio_lazy_fill_mark() >--------------------------------------------*/
+/* When the fill of a fixed-size variable is deferred (hint nc_lazy_fill),
+ * record the file regions accessed by a write request to the variable, so
+ * they will not be overwritten with fill values by ncmpio_lazy_fill_flush().
+ */
+int
+ncmpio_lazy_fill_mark(NC_var           *varp,
+                      const MPI_Offset *start,
+                      const MPI_Offset *count,
+                      const MPI_Offset *stride) /* can be NULL */
+{
+    int i, inner, err=NC_NOERR;
+    MPI_Offset run, nruns, off, r, *idx;
+
+    if (!varp->fill_pending) return NC_NOERR;
+
+    if (varp->ndims == 0) /* scalar variable */
+        return add_written(varp, varp->begin, varp->begin + varp->xsz);
+
+    /* find the dimensions inner, inner+1, ..., ndims-1 that are accessed in
+     * contiguous runs of run bytes */
+    inner = varp->ndims;
+    run   = varp->xsz;
+    while (inner > 0) {
+        i = inner - 1;
+        if (stride != NULL && stride[i] > 1 && count[i] > 1) break;
+        run *= count[i];
+        inner = i;
+        if (count[i] < varp->shape[i]) break; /* not the entire dimension */
+    }
+
+    nruns = 1;
+    for (i=0; i<inner; i++) nruns *= count[i];
+    if (run == 0 || nruns == 0) return NC_NOERR;
+
+    /* walk through the runs in the outer dimensions 0, 1, ..., inner-1 */
+    idx = (MPI_Offset*) NCI_Calloc((size_t)inner + 1, SIZEOF_MPI_OFFSET);
+    for (r=0; r<nruns; r++) {
+        off = 0;
+        for (i=0; i<varp->ndims; i++) {
+            MPI_Offset indx = start[i];
+            if (i < inner)
+                indx += idx[i] * ((stride == NULL) ? 1 : stride[i]);
+            off += indx * ((i + 1 < varp->ndims) ? varp->dsizes[i+1] : 1);
+        }
+        off = varp->begin + off * varp->xsz;
+        err = add_written(varp, off, off + run);
+        if (err != NC_NOERR) break;
+
+        for (i=inner-1; i>=0; i--) { /* move to the next run */
+            if (++idx[i] < count[i]) break;
+            idx[i] = 0;
+        }
+    }
+    NCI_Free(idx);
+    return err;
+}
+
+/*----< ncmpio_lazy_fill_mark_segs() >---------------------------------------*/
+/* Same as ncmpio_lazy_fill_mark(), but for the file regions given as sorted
+ * offset-length pairs, e.g. flattened from the filetype of a vard request.
+ * As a filetype may access more than one variable, the regions are recorded
+ * for all variables whose fill is deferred.
+ */
+int
+ncmpio_lazy_fill_mark_segs(NC            *ncp,
+                           MPI_Offset     nsegs,
+                           const off_len *segs)
+{
+    int i, err=NC_NOERR;
+    MPI_Offset j, beg, end;
+
+    if (ncp->num_fill_pending == 0 || nsegs == 0) return NC_NOERR;
+
+    for (i=0; i<ncp->vars.ndefined && err == NC_NOERR; i++) {
+        NC_var *varp = ncp->vars.value[i];
+        if (!varp->fill_pending) continue;
+
+        /* skip variables outside of the regions */
+        if (varp->begin + varp->len <= segs[0].off ||
+            varp->begin >= segs[nsegs-1].off + segs[nsegs-1].len) continue;
+
+        for (j=0; j<nsegs && err == NC_NOERR; j++) {
+            beg = MAX(segs[j].off, varp->begin);
+            end = MIN(segs[j].off + segs[j].len, varp->begin + varp->len);
+            if (beg < end) err = add_written(varp, beg, end);
+        }
+    }
+    return err;
+}
+
+/*----< lazy_fill_part() >---------------------------------------------------*/
+/* the first element of the part of a variable of var_len elements assigned to
+ * process rank, when the elements are divided evenly among nprocs processes,
+ * the same as fillerup_aggregate() */
+static MPI_Offset
+lazy_fill_part(MPI_Offset var_len, int nprocs, int rank)
+{
+    MPI_Offset q = var_len / nprocs, rem = var_len % nprocs;
+    return q * rank + MIN(rank, rem);
+}
+
+/*----< lazy_fill_owner() >--------------------------------------------------*/
+/* the process whose part of a variable of var_len elements contains element
+ * indx */
+static int
+lazy_fill_owner(MPI_Offset var_len, int nprocs, MPI_Offset indx)
+{
+    MPI_Offset q = var_len / nprocs, rem = var_len % nprocs;
+    if (indx < rem * (q + 1)) return (int)(indx / (q + 1));
+    return (int)(rem + (indx - rem * (q + 1)) / q);
+}
+
+/*----< ncmpio_lazy_fill_flush() >-------------------------------------------*/
+/* This function is collective.
+ * Write fill values to the regions of the fixed-size variables whose fill is
+ * deferred that have not been written by any process. As in
+ * fillerup_aggregate(), the elements of each variable are divided evenly
+ * among processes. The written regions recorded by ncmpio_lazy_fill_mark()
+ * are sent to the processes owning them, so each process knows the regions
+ * of its part written by all processes and fills the rest of its part. All
+ * fills are carried out by a single collective write.
+ */
+int
+ncmpio_lazy_fill_flush(NC *ncp)
+{
+    int i, r, rank, nprocs, pass, mpireturn, err, status=NC_NOERR;
+    int *sendcnts, *sdispls, *recvcnts, *rdispls, *pos, *blocklengths=NULL;
+    double timing;
+    char *buf=NULL, *buf_ptr;
+    MPI_Offset k, nrecv, nsegs, buf_len, var_len, beg, end, lo, hi;
+    MPI_Offset *sendbuf, *recvbuf;
+    MPI_Aint *disps=NULL;
+    MPI_Datatype filetype=MPI_BYTE;
+    MPI_File fh;
+    MPI_Status mpistatus;
+    NC_var *varp;
+
+    /* num_fill_pending is the same among processes */
+    if (ncp->num_fill_pending == 0) return NC_NOERR;
+
+    timing = NC_STATS_WTIME(ncp);
+    MPI_Comm_rank(ncp->comm, &rank);
+    MPI_Comm_size(ncp->comm, &nprocs);
+
+    sendcnts = (int*) NCI_Calloc((size_t)nprocs * 5, SIZEOF_INT);
+    sdispls  = sendcnts + nprocs;
+    recvcnts = sdispls  + nprocs;
+    rdispls  = recvcnts + nprocs;
+    pos      = rdispls  + nprocs;
+
+    /* first pass counts the pieces of written regions sent to each process,
+     * second pass packs them into sendbuf. Pieces are split at the boundaries
+     * of processes' parts.
+     */
+    sendbuf = NULL;
+    for (pass=0; pass<2; pass++) {
+        for (i=0; i<ncp->vars.ndefined; i++) {
+            varp = ncp->vars.value[i];
+            if (!varp->fill_pending) continue;
+
+            if (pass == 0)
+                varp->nwritten = coalesce_segs(varp->written, varp->nwritten);
+
+            var_len = (varp->ndims == 0) ? 1 : varp->dsizes[0];
+            for (k=0; k<varp->nwritten; k++) {
+                /* element indices of this region */
+                beg = (varp->written[2*k]   - varp->begin) / varp->xsz;
+                end = (varp->written[2*k+1] - varp->begin) / varp->xsz;
+                while (beg < end) {
+                    r  = lazy_fill_owner(var_len, nprocs, beg);
+                    hi = MIN(end, lazy_fill_part(var_len, nprocs, r + 1));
+                    if (pass == 0)
+                        sendcnts[r] += 2;
+                    else {
+                        sendbuf[sdispls[r] + pos[r]++] = varp->begin
+                                                       + beg * varp->xsz;
+                        sendbuf[sdispls[r] + pos[r]++] = varp->begin
+                                                       + hi  * varp->xsz;
+                    }
+                    beg = hi;
+                }
+            }
+        }
+        if (pass == 0) {
+            for (r=1; r<nprocs; r++)
+                sdispls[r] = sdispls[r-1] + sendcnts[r-1];
+            sendbuf = (MPI_Offset*) NCI_Malloc((size_t)(sdispls[nprocs-1] +
+                      sendcnts[nprocs-1] + 1) * SIZEOF_MPI_OFFSET);
+        }
+    }
+
+    /* exchange the written regions */
+    TRACE_COMM(MPI_Alltoall)(sendcnts, 1, MPI_INT, recvcnts, 1, MPI_INT,
+                             ncp->comm);
+    if (mpireturn != MPI_SUCCESS) {
+        err = ncmpii_error_mpi2nc(mpireturn, "MPI_Alltoall");
+        if (status == NC_NOERR) status = err;
+    }
+    for (r=1; r<nprocs; r++)
+        rdispls[r] = rdispls[r-1] + recvcnts[r-1];
+    nrecv = rdispls[nprocs-1] + recvcnts[nprocs-1];
+    recvbuf = (MPI_Offset*) NCI_Malloc((size_t)(nrecv + 1) * SIZEOF_MPI_OFFSET);
+
+    TRACE_COMM(MPI_Alltoallv)(sendbuf, sendcnts, sdispls, MPI_OFFSET,
+                              recvbuf, recvcnts, rdispls, MPI_OFFSET,
+                              ncp->comm);
+    if (mpireturn != MPI_SUCCESS) {
+        err = ncmpii_error_mpi2nc(mpireturn, "MPI_Alltoallv");
+        if (status == NC_NOERR) status = err;
+    }
+    NCI_Free(sendbuf);
+    NCI_Free(sendcnts);
+
+    nrecv = coalesce_segs(recvbuf, nrecv / 2);
+
+    /* first pass counts the unwritten segments of this process's parts,
+     * second pass fills them into buf and constructs the filetype */
+    nsegs = buf_len = 0;
+    for (pass=0; pass<2; pass++) {
+        MPI_Offset j, cur;
+        nsegs = 0;
+        buf_ptr = buf;
+        for (i=0; i<ncp->vars.ndefined; i++) {
+            varp = ncp->vars.value[i];
+            if (!varp->fill_pending) continue;
+
+            var_len = (varp->ndims == 0) ? 1 : varp->dsizes[0];
+            lo = varp->begin + varp->xsz * lazy_fill_part(var_len, nprocs, rank);
+            hi = varp->begin + varp->xsz * lazy_fill_part(var_len, nprocs, rank+1);
+            if (lo == hi) continue;
+
+            /* binary search the first received region ending after lo */
+            beg = 0;
+            end = nrecv;
+            while (beg < end) {
+                j = (beg + end) / 2;
+                if (recvbuf[2*j+1] <= lo) beg = j + 1;
+                else                      end = j;
+            }
+
+            /* the complement of received regions in [lo, hi) */
+            for (cur=lo, j=beg; cur<hi; j++) {
+                MPI_Offset seg_end = (j < nrecv) ? MIN(hi, recvbuf[2*j]) : hi;
+                if (cur < seg_end) {
+                    if (pass == 0)
+                        buf_len += seg_end - cur;
+                    else {
+                        err = fill_var_buf(varp, (seg_end - cur) / varp->xsz,
+                                           buf_ptr);
+                        if (err != NC_NOERR && status == NC_NOERR)
+                            status = err;
+                        disps[nsegs]        = (MPI_Aint)cur;
+                        blocklengths[nsegs] = (int)(seg_end - cur);
+                        if (disps[nsegs] != cur ||
+                            blocklengths[nsegs] != seg_end - cur) {
+                            DEBUG_ASSIGN_ERROR(err, NC_EINTOVERFLOW)
+                            if (status == NC_NOERR) status = err;
+                        }
+                        buf_ptr += seg_end - cur;
+                    }
+                    nsegs++;
+                }
+                if (j >= nrecv) break;
+                cur = MAX(cur, recvbuf[2*j+1]);
+            }
+        }
+        if (pass == 0) {
+            if (nsegs == 0) break;
+            buf          = (char*)     NCI_Malloc((size_t)buf_len);
+            disps        = (MPI_Aint*) NCI_Malloc((size_t)nsegs * SIZEOF_MPI_AINT);
+            blocklengths = (int*)      NCI_Malloc((size_t)nsegs * SIZEOF_INT);
+        }
+    }
+    NCI_Free(recvbuf);
+
+    if (nsegs > 0 && nsegs == (int)nsegs && status == NC_NOERR) {
+        /* create fileview: a list of contiguous segments to be filled */
+#ifdef HAVE_MPI_TYPE_CREATE_HINDEXED
+        mpireturn = MPI_Type_create_hindexed((int)nsegs, blocklengths, disps,
+                                             MPI_BYTE, &filetype);
+#else
+        mpireturn = MPI_Type_hindexed((int)nsegs, blocklengths, disps,
+                                      MPI_BYTE, &filetype);
+#endif
+        if (mpireturn != MPI_SUCCESS) {
+            err = ncmpii_error_mpi2nc(mpireturn, "MPI_Type_hindexed");
+            if (status == NC_NOERR) status = err;
+            filetype = MPI_BYTE;
+        }
+        else
+            MPI_Type_commit(&filetype);
+    }
+    if (filetype == MPI_BYTE) buf_len = 0; /* nothing to write */
+    if (disps != NULL) NCI_Free(disps);
+    if (blocklengths != NULL) NCI_Free(blocklengths);
+
+    fh = ncp->collective_fh;
+
+    TRACE_IO(MPI_File_set_view)(fh, 0, MPI_BYTE, filetype, "native",
+                                MPI_INFO_NULL);
+    if (filetype != MPI_BYTE) MPI_Type_free(&filetype);
+
+    if (buf_len != (int)buf_len) {
+        if (status == NC_NOERR) status = NC_EINTOVERFLOW;
+        buf_len = 0; /* skip this write */
+    }
+
+    /* write fill values collectively */
+    TRACE_IO(MPI_File_write_at_all)(fh, 0, buf, (int)buf_len, MPI_BYTE,
+                                    &mpistatus);
+    if (mpireturn != MPI_SUCCESS) {
+        err = ncmpii_error_mpi2nc(mpireturn, "MPI_File_write_at_all");
+        if (status == NC_NOERR) status = err;
+    }
+    if (buf != NULL) NCI_Free(buf);
+
+    TRACE_IO(MPI_File_set_view)(fh, 0, MPI_BYTE, MPI_BYTE, "native",
+                                MPI_INFO_NULL);
+    if (mpireturn != MPI_SUCCESS)
+        if (status == NC_NOERR)
+            status = ncmpii_error_mpi2nc(mpireturn, "MPI_File_set_view");
+
+    /* fill of all variables is now complete */
+    for (i=0; i<ncp->vars.ndefined; i++) {
+        varp = ncp->vars.value[i];
+        if (!varp->fill_pending) continue;
+        if (varp->written != NULL) NCI_Free(varp->written);
+        varp->written      = NULL;
+        varp->nwritten     = 0;
+        varp->written_cap  = 0;
+        varp->fill_pending = 0;
+    }
+    ncp->num_fill_pending = 0;
+    NC_STATS_ADD_TIME(ncp, NC_STATS_TIME_FILL, timing)
+
+    return status;
+}
+
 /*----< ncmpio_fill_vars() >-------------------------------------------------*/
 int
 ncmpio_fill_vars(NC *ncp)
@@ -640,9 +1065,13 @@ ncmpio_fill_var_rec(void      *ncdp,
                     MPI_Offset recno) /* record index, ignored if non-record var */
 {
     int     indx, err=NC_NOERR;
+    double  timing;
     NC     *ncp=(NC*)ncdp;
     NC_var *varp=NULL;
 
+    /* no file access until the pending split-phase wait is ended */
+    if (NC_WAIT_PENDING(ncp)) DEBUG_RETURN_ERROR(NC_EPENDING)
+
     /* check whether variable ID is valid */
     /* sanity check for ncdp and varid has been done in dispatchers */
     varp = ncp->vars.value[varid];
@@ -694,7 +1123,11 @@ err_check:
 
     assert(varp != NULL);
 
-    return fill_var_rec(ncp, varp, recno);
+    timing = NC_STATS_WTIME(ncp);
+    err = fill_var_rec(ncp, varp, recno);
+    NC_STATS_ADD_TIME(ncp, NC_STATS_TIME_FILL, timing)
+
+    return err;
 }
 
 /*----< ncmpio_set_fill() >--------------------------------------------------*/
@@ -21,6 +21,11 @@ dnl
  * ncmpi_put_var<kind>_all()        : dispatcher->put_var()
  * ncmpi_get_var<kind>_<type>_all() : dispatcher->get_var()
  * ncmpi_put_var<kind>_<type>_all() : dispatcher->put_var()
+ * ncmpi_put_vara_init()            : dispatcher->getput_init()
+ * ncmpi_get_vara_init()            : dispatcher->getput_init()
+ * ncmpi_start()                    : dispatcher->start()
+ * ncmpi_start_all()                : dispatcher->start()
+ * ncmpi_request_free()             : dispatcher->request_free()
  */
 
 #ifdef HAVE_CONFIG_H
@@ -103,6 +108,200 @@ dnl
      7. free up temp buffers (lbuf, cbuf, xbuf if != buf)
 */
 
+/*----< decode_buftype() >--------------------------------------------------*/
+/* Decode buftype by calling ncmpii_buftype_decode() and check whether the
+ * request can be carried out by a single MPI-IO call.
+ */
+static int
+decode_buftype(const NC_var     *varp,
+               const MPI_Offset *count,
+               MPI_Offset        bufcount,
+               MPI_Datatype      buftype,
+               MPI_Datatype     *itype,             /* OUT */
+               int              *el_size,           /* OUT */
+               MPI_Offset       *nelems,            /* OUT */
+               MPI_Offset       *nbytes,            /* OUT */
+               int              *buftype_is_contig) /* OUT */
+{
+    int err;
+
+    err = ncmpii_buftype_decode(varp->ndims, varp->xtype, count, bufcount,
+                                buftype, itype, el_size, nelems, nbytes,
+                                buftype_is_contig);
+    if (err != NC_NOERR) return err;
+
+    /* because nelems will be used as the argument "count" in MPI-IO
+     * read/write calls and the argument "count" is of type int */
+    if (*nelems > INT_MAX) DEBUG_RETURN_ERROR(NC_EINTOVERFLOW)
+
+#ifndef ENABLE_LARGE_REQ
+    /* Not all MPI-IO libraries support single requests larger than 2 GiB */
+    if (*nbytes > INT_MAX) DEBUG_RETURN_ERROR(NC_EMAX_REQ)
+#endif
+
+    return NC_NOERR;
+}
+
+/*----< plan_filetype() >---------------------------------------------------*/
+/* Return the filetype of a persistent request and its file offset. For a
+ * record variable, the offset is shifted from the record the filetype was
+ * created for to record start[0].
+ */
+static int
+plan_filetype(const NC           *ncp,
+              const NC_var       *varp,
+              const NC_plan      *plan,
+              const MPI_Offset   *start,
+              MPI_Offset         *offset,   /* OUT */
+              MPI_Datatype       *filetype) /* OUT */
+{
+    *filetype = plan->filetype;
+    *offset   = plan->offset;
+    if (IS_RECVAR(varp))
+        *offset += (start[0] - plan->start[0]) * ncp->recsize;
+    return NC_NOERR;
+}
+
+/*----< put_stream() >----------------------------------------------------*/
+/* Write a request whose user buffer, buf, is contiguous, in chunks of
+ * chunk_nelems elements, so xbuf needs to hold only two chunks regardless of
+ * the request size. Each chunk is type-converted/byte-swapped into one half
+ * of xbuf while the previous chunk in the other half is being written. In
+ * independent mode, chunks are written by MPI_File_iwrite_at(), so the
+ * conversion overlaps the write. In collective mode, all processes must make
+ * the same number of MPI_File_write_at_all() calls, so the max number of
+ * chunks is agreed first and processes with fewer chunks participate with
+ * zero-length writes.
+ *
+ * When chunk_nelems is 0, xbuf has been packed with all nelems elements and
+ * is written in the first round.
+ */
+static int
+put_stream(NC           *ncp,
+           NC_var       *varp,
+           MPI_File      fh,
+           MPI_Offset    offset,  /* file offset in the file view */
+           void         *buf,     /* user buffer, contiguous */
+           MPI_Datatype  itype,   /* element data type in buf */
+           MPI_Offset    nelems,  /* no. elements to write */
+           MPI_Offset    chunk_nelems,
+           int           need_convert,
+           int           need_swap,
+           void         *xbuf,    /* of size 2 * chunk_nelems * varp->xsz */
+           int           reqMode)
+{
+    int i, err, mpireturn, el_size, status=NC_NOERR;
+    double timing;
+    MPI_Offset nchunks, max_nchunks, n, done=0, pending[2]={0, 0};
+    MPI_Datatype xtype;
+    MPI_Request req[2]={MPI_REQUEST_NULL, MPI_REQUEST_NULL};
+    MPI_Status mpistatus;
+
+    if (nelems == 0)            nchunks = 0;
+    else if (chunk_nelems == 0) nchunks = 1;
+    else nchunks = (nelems + chunk_nelems - 1) / chunk_nelems;
+
+    max_nchunks = nchunks;
+    if (fIsSet(reqMode, NC_REQ_COLL)) {
+        TRACE_COMM(MPI_Allreduce)(&nchunks, &max_nchunks, 1, MPI_OFFSET,
+                                  MPI_MAX, ncp->comm);
+        if (mpireturn != MPI_SUCCESS)
+            return ncmpii_error_mpi2nc(mpireturn, "MPI_Allreduce");
+        /* participate the collective write even if no process writes */
+        if (max_nchunks == 0) max_nchunks = 1;
+    }
+
+    if (chunk_nelems > 0) MPI_Type_size(itype, &el_size);
+    xtype = ncmpii_nc2mpitype(varp->xtype);
+
+    for (i=0; i<max_nchunks; i++) {
+        int k = i % 2;
+        void *ptr = xbuf;
+
+        n = 0;
+        if (i < nchunks) {
+            if (chunk_nelems == 0)
+                n = nelems;
+            else {
+                n = MIN(chunk_nelems, nelems - done);
+                ptr = (char*)xbuf + k * chunk_nelems * varp->xsz;
+
+                if (req[k] != MPI_REQUEST_NULL) {
+                    /* wait for the write of this half of xbuf to complete */
+                    timing = NC_STATS_WTIME(ncp);
+                    TRACE_IO(MPI_Wait)(&req[k], &mpistatus);
+                    NC_STATS_ADD_TIME(ncp, NC_STATS_TIME_MPIIO, timing)
+                    if (mpireturn == MPI_SUCCESS)
+                        ncp->put_size += pending[k];
+                    else if (status == NC_NOERR) {
+                        err = ncmpii_error_mpi2nc(mpireturn, "MPI_Wait");
+                        DEBUG_ASSIGN_ERROR(status, err)
+                    }
+                }
+
+                /* convert and byte-swap this chunk into xbuf */
+                timing = NC_STATS_WTIME(ncp);
+                err = ncmpio_pack_xbuf(ncp->format, varp, n, itype, 1, n,
+                                       itype, MPI_DATATYPE_NULL, need_convert,
+                                       need_swap, (size_t)(n * varp->xsz),
+                                       (char*)buf + done * el_size, ptr);
+                NC_STATS_ADD_TIME(ncp, NC_STATS_TIME_PACK, timing)
+                if (err != NC_NOERR && status == NC_NOERR) status = err;
+                if (err != NC_NOERR && err != NC_ERANGE) {
+                    /* skip the rest of this request */
+                    nchunks = i;
+                    n = 0;
+                }
+            }
+        }
+
+        timing = NC_STATS_WTIME(ncp);
+        if (fIsSet(reqMode, NC_REQ_COLL)) {
+            TRACE_IO(MPI_File_write_at_all)(fh, offset + done * varp->xsz,
+                                            ptr, (int)n, xtype, &mpistatus);
+            if (mpireturn == MPI_SUCCESS)
+                ncp->put_size += n * varp->xsz;
+            else if (status == NC_NOERR) {
+                err = ncmpii_error_mpi2nc(mpireturn, "MPI_File_write_at_all");
+                err = (err == NC_EFILE) ? NC_EWRITE : err;
+                DEBUG_ASSIGN_ERROR(status, err)
+            }
+        }
+        else if (n > 0) {
+            TRACE_IO(MPI_File_iwrite_at)(fh, offset + done * varp->xsz, ptr,
+                                         (int)n, xtype, &req[k]);
+            if (mpireturn == MPI_SUCCESS)
+                pending[k] = n * varp->xsz;
+            else {
+                if (status == NC_NOERR) {
+                    err = ncmpii_error_mpi2nc(mpireturn, "MPI_File_iwrite_at");
+                    err = (err == NC_EFILE) ? NC_EWRITE : err;
+                    DEBUG_ASSIGN_ERROR(status, err)
+                }
+                req[k] = MPI_REQUEST_NULL;
+            }
+        }
+        NC_STATS_ADD_TIME(ncp, NC_STATS_TIME_MPIIO, timing)
+        done += n;
+    }
+
+    /* wait for the outstanding writes */
+    timing = NC_STATS_WTIME(ncp);
+    for (i=0; i<2; i++) {
+        if (req[i] == MPI_REQUEST_NULL) continue;
+        TRACE_IO(MPI_Wait)(&req[i], &mpistatus);
+        if (mpireturn == MPI_SUCCESS)
+            ncp->put_size += pending[i];
+        else if (status == NC_NOERR) {
+            err = ncmpii_error_mpi2nc(mpireturn, "MPI_Wait");
+            err = (err == NC_EFILE) ? NC_EWRITE : err;
+            DEBUG_ASSIGN_ERROR(status, err)
+        }
+    }
+    NC_STATS_ADD_TIME(ncp, NC_STATS_TIME_MPIIO, timing)
+    return status;
+}
+
 /*----< put_varm() >------------------------------------------------------*/
 static int
 put_varm(NC               *ncp,
@@ -114,14 +313,17 @@ put_varm(NC               *ncp,
          void             *buf,
          MPI_Offset        bufcount,  /* -1: from high-level API */
          MPI_Datatype      buftype,
+         const NC_plan    *plan,      /* persistent request, can be NULL */
          int               reqMode)   /* WR/RD/COLL/INDEP */
 {
     void *xbuf=NULL;
     int mpireturn, err=NC_NOERR, status=NC_NOERR, buftype_is_contig;
-    int el_size, need_convert, need_swap, in_place_swap, need_swap_back_buf=0;
-    MPI_Offset nelems=0, nbytes=0, offset=0;
+    int el_size, need_convert=0, need_swap=0, in_place_swap;
+    int need_swap_back_buf=0, streamed=0;
+    double timing;
+    MPI_Offset nelems=0, nbytes=0, offset=0, chunk_nelems=0;
     MPI_Status mpistatus;
-    MPI_Datatype itype, xtype, imaptype, filetype=MPI_BYTE;
+    MPI_Datatype itype=MPI_DATATYPE_NULL, xtype, imaptype, filetype=MPI_BYTE;
     MPI_File fh;
 
     /* decode buftype to obtain the followings:
@@ -135,32 +337,33 @@ put_varm(NC               *ncp,
      *           the file
      * el_size:  byte size of itype
      * buftype_is_contig: whether buftype is contiguous
+     * For a persistent request, they have been obtained when it was created.
      */
-    err = ncmpii_buftype_decode(varp->ndims, varp->xtype, count, bufcount,
-                                buftype, &itype, &el_size, &nelems,
-                                &nbytes, &buftype_is_contig);
-    if (err != NC_NOERR) goto err_check;
-
-    /* because nelems will be used as the argument "count" in MPI-IO
-     * write calls and the argument "count" is of type int */
-    if (nelems > INT_MAX) {
-        DEBUG_ASSIGN_ERROR(err, NC_EINTOVERFLOW)
-        goto err_check;
+    if (plan != NULL) {
+        itype             = plan->itype;
+        el_size           = plan->el_size;
+        nelems            = plan->nelems;
+        nbytes            = plan->nbytes;
+        buftype_is_contig = plan->buftype_is_contig;
     }
-#ifndef ENABLE_LARGE_REQ
-    /* Not all MPI-IO libraries support single requests larger than 2 GiB */
-    if (nbytes > INT_MAX) {
-        DEBUG_ASSIGN_ERROR(err, NC_EMAX_REQ)
-        goto err_check;
+    else {
+        err = decode_buftype(varp, count, bufcount, buftype, &itype, &el_size,
+                             &nelems, &nbytes, &buftype_is_contig);
+        if (err != NC_NOERR) goto err_check;
     }
-#endif
 
     if (nbytes == 0) /* this process has nothing to write */
         goto err_check;
 
     /* check if type conversion and Endianness byte swap is needed */
-    need_convert = ncmpii_need_convert(ncp->format, varp->xtype, itype);
-    need_swap    = NEED_BYTE_SWAP(varp->xtype, itype);
+    if (plan != NULL) {
+        need_convert = plan->need_convert;
+        need_swap    = plan->need_swap;
+    }
+    else {
+        need_convert = ncmpii_need_convert(ncp->format, varp->xtype, itype);
+        need_swap    = NEED_BYTE_SWAP(varp->xtype, itype);
+    }
 
     if (fIsSet(ncp->flags, NC_MODE_SWAP_ON))
         in_place_swap = 1;
@@ -181,7 +384,17 @@ put_varm(NC               *ncp,
 
     if (!buftype_is_contig || imaptype != MPI_DATATYPE_NULL || need_convert
         || (need_swap && in_place_swap == 0)) {
-        xbuf = NCI_Malloc((size_t)nbytes);
+        if (ncp->stream_size > 0 && nbytes > ncp->stream_size &&
+            buftype_is_contig && imaptype == MPI_DATATYPE_NULL) {
+            /* convert and write the request in chunks, see put_stream().
+             * xbuf holds two chunks only.
+             */
+            chunk_nelems = MAX(1, ncp->stream_size / varp->xsz);
+            xbuf = ncmpii_pool_malloc(ncp->pool,
+                                      (size_t)(chunk_nelems * varp->xsz * 2));
+        }
+        else
+            xbuf = ncmpii_pool_malloc(ncp->pool, (size_t)nbytes);
         if (xbuf == NULL) {
             DEBUG_ASSIGN_ERROR(err, NC_ENOMEM)
             goto err_check;
@@ -195,12 +408,18 @@ put_varm(NC               *ncp,
         need_swap_back_buf = 1;
     }
 
-    /* pack user buffer, buf, to xbuf, which will be used to write to file */
-    err = ncmpio_pack_xbuf(ncp->format, varp, bufcount, buftype,
-                           buftype_is_contig, nelems, itype, imaptype,
-                           need_convert, need_swap, nbytes, buf, xbuf);
+    /* pack user buffer, buf, to xbuf, which will be used to write to file.
+     * When streaming, each chunk is packed right before it is written.
+     */
+    if (chunk_nelems == 0) {
+        timing = NC_STATS_WTIME(ncp);
+        err = ncmpio_pack_xbuf(ncp->format, varp, bufcount, buftype,
+                               buftype_is_contig, nelems, itype, imaptype,
+                               need_convert, need_swap, nbytes, buf, xbuf);
+        NC_STATS_ADD_TIME(ncp, NC_STATS_TIME_PACK, timing)
+    }
     if (err != NC_NOERR && err != NC_ERANGE) {
-        if (xbuf != buf) NCI_Free(xbuf);
+        if (xbuf != buf) ncmpii_pool_free(ncp->pool, xbuf);
         xbuf = NULL;
         goto err_check;
     }
@@ -223,15 +442,27 @@ err_check:
         /* Create the filetype for this request and calculate the beginning
          * file offset for this request. If this request is contiguous in file,
          * then set filetype == MPI_BYTE. Otherwise filetype will be an MPI
-         * derived data type.
+         * derived data type. A persistent request reuses its filetype,
+         * shifted to the record being accessed.
          */
-        err = ncmpio_filetype_create_vars(ncp, varp, start, count, stride,
-                                          NULL, &offset, &filetype, NULL);
+        timing = NC_STATS_WTIME(ncp);
+        if (plan != NULL)
+            err = plan_filetype(ncp, varp, plan, start, &offset, &filetype);
+        else
+            err = ncmpio_filetype_create_vars(ncp, varp, start, count, stride,
+                                              NULL, &offset, &filetype, NULL);
+        NC_STATS_ADD_TIME(ncp, NC_STATS_TIME_FILETYPE, timing)
         if (err != NC_NOERR) {
             filetype = MPI_BYTE;
             nbytes   = 0;
             if (status == NC_NOERR) status = err;
         }
+        else if (varp->fill_pending) {
+            /* record the regions written, as fill of this variable is
+             * deferred */
+            err = ncmpio_lazy_fill_mark(varp, start, count, stride);
+            if (status == NC_NOERR) status = err;
+        }
     }
 
     /* TODO: if record variables are too big (so big that we cannot store the
@@ -247,7 +478,7 @@ err_check:
         nbytes = 0; /* skip this request */
         if (status == NC_NOERR) status = err;
     }
-    if (filetype != MPI_BYTE) MPI_Type_free(&filetype);
+    if (filetype != MPI_BYTE && plan == NULL) MPI_Type_free(&filetype);
 
 #ifdef _USE_MPI_GET_COUNT
     /* explicitly initialize mpistatus object to 0, see comments below */
@@ -259,9 +490,23 @@ err_check:
      * written to the variable defined in file. Note data stored in xbuf is in
      * the external data type, ready to be written to file.
      */
-    if (fIsSet(reqMode, NC_REQ_COLL)) {
+    if (chunk_nelems > 0 ||
+        (fIsSet(reqMode, NC_REQ_COLL) && ncp->stream_size > 0)) {
+        /* In collective mode, all processes call put_stream() when hint
+         * nc_put_stream_size is set, as they must agree on the number of
+         * collective writes.
+         */
+        err = put_stream(ncp, varp, fh, offset, buf, itype,
+                         (nbytes == 0) ? 0 : nelems, chunk_nelems,
+                         need_convert, need_swap, xbuf, reqMode);
+        if (status == NC_NOERR) status = err;
+        streamed = 1;
+    }
+    else if (fIsSet(reqMode, NC_REQ_COLL)) {
+        timing = NC_STATS_WTIME(ncp);
         TRACE_IO(MPI_File_write_at_all)(fh, offset, xbuf, (int)nelems,
                                         xtype, &mpistatus);
+        NC_STATS_ADD_TIME(ncp, NC_STATS_TIME_MPIIO, timing)
         if (mpireturn != MPI_SUCCESS) {
             err = ncmpii_error_mpi2nc(mpireturn, "MPI_File_write_at_all");
             /* return the first encountered error if there is any */
@@ -272,8 +517,10 @@ err_check:
         }
     }
     else {  /* reqMode == NC_REQ_INDEP */
+        timing = NC_STATS_WTIME(ncp);
         TRACE_IO(MPI_File_write_at)(fh, offset, xbuf, (int)nelems,
                                     xtype, &mpistatus);
+        NC_STATS_ADD_TIME(ncp, NC_STATS_TIME_MPIIO, timing)
         if (mpireturn != MPI_SUCCESS) {
             err = ncmpii_error_mpi2nc(mpireturn, "MPI_File_write_at");
             /* return the first encountered error if there is any */
@@ -283,7 +530,7 @@ err_check:
             }
         }
     }
-    if (mpireturn == MPI_SUCCESS) {
+    if (!streamed && mpireturn == MPI_SUCCESS) {
 #ifdef _USE_MPI_GET_COUNT
         int put_size;
         MPI_Get_count(&mpistatus, MPI_BYTE, &put_size);
@@ -294,7 +541,7 @@ err_check:
     }
 
     /* done with xbuf */
-    if (xbuf != NULL && xbuf != buf) NCI_Free(xbuf);
+    if (xbuf != NULL && xbuf != buf) ncmpii_pool_free(ncp->pool, xbuf);
 
     if (need_swap_back_buf) /* byte-swap back to buf's original contents */
         ncmpii_in_swapn(buf, nelems, varp->xsz);
@@ -315,7 +562,7 @@ err_check:
              * write request writes existing records */
         }
 
-        if (fIsSet(reqMode, NC_REQ_COLL)) {
+        if (fIsSet(reqMode, NC_REQ_COLL) && !ncp->defer_numrecs) {
             /* sync numrecs in memory and file. Note new_numrecs may be
              * different among processes. First, find the max numrecs among
              * all processes.
@@ -335,12 +582,15 @@ err_check:
                 ncp->numrecs = max_numrecs;
             }
         }
-        else { /* NC_REQ_INDEP */
+        else { /* NC_REQ_INDEP or hint nc_defer_numrecs is enabled */
             /* For independent put, we delay the sync for numrecs until
              * the next collective call, such as end_indep(), sync(),
              * enddef(), or close(). This is because if we update numrecs
              * to file now, race condition can happen. Note numrecs in
              * memory may be inconsistent and obsolete till then.
+             * For collective put with hint nc_defer_numrecs enabled, the
+             * sync is delayed to the next collective wait, sync(), redef(),
+             * or close(), saving an MPI_Allreduce per put.
              */
             if (ncp->numrecs < new_numrecs) {
                 ncp->numrecs = new_numrecs;
@@ -369,11 +619,13 @@ get_varm(NC               *ncp,
          void             *buf,
          MPI_Offset        bufcount,  /* -1: from high-level API */
          MPI_Datatype      buftype,
+         const NC_plan    *plan,      /* persistent request, can be NULL */
          int               reqMode)   /* WR/RD/COLL/INDEP */
 {
     void *xbuf=NULL;
     int mpireturn, err=NC_NOERR, status=NC_NOERR;
     int el_size, buftype_is_contig, need_swap=0, need_convert=0;
+    double timing;
     MPI_Offset nelems=0, nbytes=0, offset=0;
     MPI_Status mpistatus;
     MPI_Datatype itype, xtype, filetype=MPI_BYTE, imaptype=MPI_DATATYPE_NULL;
@@ -390,32 +642,33 @@ get_varm(NC               *ncp,
      *           read from the file
      * el_size:  size of itype
      * buftype_is_contig: whether buftype is contiguous
+     * For a persistent request, they have been obtained when it was created.
      */
-    err = ncmpii_buftype_decode(varp->ndims, varp->xtype, count, bufcount,
-                                buftype, &itype, &el_size, &nelems,
-                                &nbytes, &buftype_is_contig);
-    if (err != NC_NOERR) goto err_check;
-
-    /* because nelems will be used as the argument "count" in MPI-IO
-     * write calls and the argument "count" is of type int */
-    if (nelems > INT_MAX) {
-        DEBUG_ASSIGN_ERROR(err, NC_EINTOVERFLOW)
-        goto err_check;
+    if (plan != NULL) {
+        itype             = plan->itype;
+        el_size           = plan->el_size;
+        nelems            = plan->nelems;
+        nbytes            = plan->nbytes;
+        buftype_is_contig = plan->buftype_is_contig;
     }
-#ifndef ENABLE_LARGE_REQ
-    /* Not all MPI-IO libraries support single requests larger than 2 GiB */
-    if (nbytes > INT_MAX) {
-        DEBUG_ASSIGN_ERROR(err, NC_EMAX_REQ)
-        goto err_check;
+    else {
+        err = decode_buftype(varp, count, bufcount, buftype, &itype, &el_size,
+                             &nelems, &nbytes, &buftype_is_contig);
+        if (err != NC_NOERR) goto err_check;
     }
-#endif
 
     if (nbytes == 0) /* this process has nothing to read */
         goto err_check;
 
     /* check if type conversion and Endianness byte swap is needed */
-    need_convert = ncmpii_need_convert(ncp->format, varp->xtype, itype);
-    need_swap    = NEED_BYTE_SWAP(varp->xtype, itype);
+    if (plan != NULL) {
+        need_convert = plan->need_convert;
+        need_swap    = plan->need_swap;
+    }
+    else {
+        need_convert = ncmpii_need_convert(ncp->format, varp->xtype, itype);
+        need_swap    = NEED_BYTE_SWAP(varp->xtype, itype);
+    }
 
     /* Check if this is a true varm call. If yes, construct a derived
      * datatype, imaptype.
@@ -434,7 +687,7 @@ get_varm(NC               *ncp,
     if (buftype_is_contig && imaptype == MPI_DATATYPE_NULL && !need_convert)
         xbuf = buf;
     else /* allocate xbuf for reading */
-        xbuf = NCI_Malloc((size_t)nbytes);
+        xbuf = ncmpii_pool_malloc(ncp->pool, (size_t)nbytes);
 
     /* Note xbuf is the buffer to be used in MPI read calls, and hence its
      * contents are in the external type */
@@ -456,10 +709,16 @@ err_check:
         /* Create the filetype for this request and calculate the beginning
          * file offset for this request. If this request is contiguous in file,
          * then set filetype == MPI_BYTE. Otherwise filetype will be an MPI
-         * derived data type.
+         * derived data type. A persistent request reuses its filetype,
+         * shifted to the record being accessed.
          */
-        err = ncmpio_filetype_create_vars(ncp, varp, start, count, stride,
-                                          NULL, &offset, &filetype, NULL);
+        timing = NC_STATS_WTIME(ncp);
+        if (plan != NULL)
+            err = plan_filetype(ncp, varp, plan, start, &offset, &filetype);
+        else
+            err = ncmpio_filetype_create_vars(ncp, varp, start, count, stride,
+                                              NULL, &offset, &filetype, NULL);
+        NC_STATS_ADD_TIME(ncp, NC_STATS_TIME_FILETYPE, timing)
         if (err != NC_NOERR) {
             filetype = MPI_BYTE;
             nbytes   = 0;
@@ -480,7 +739,7 @@ err_check:
         nbytes = 0; /* skip this request */
         if (status == NC_NOERR) status = err;
     }
-    if (filetype != MPI_BYTE) MPI_Type_free(&filetype);
+    if (filetype != MPI_BYTE && plan == NULL) MPI_Type_free(&filetype);
 
 #ifdef _USE_MPI_GET_COUNT
     /* explicitly initialize mpistatus object to 0, see comments below */
@@ -492,6 +751,7 @@ err_check:
      * read from the variable defined in file. Note xbuf will contain data read
      * from the file and hence is in the external data type.
      */
+    timing = NC_STATS_WTIME(ncp);
     if (fIsSet(reqMode, NC_REQ_COLL)) {
         TRACE_IO(MPI_File_read_at_all)(fh, offset, xbuf, (int)nelems,
                                        xtype, &mpistatus);
@@ -516,6 +776,7 @@ err_check:
             }
         }
     }
+    NC_STATS_ADD_TIME(ncp, NC_STATS_TIME_MPIIO, timing)
     if (mpireturn == MPI_SUCCESS) {
 #ifdef _USE_MPI_GET_COUNT
         int get_size;
@@ -529,16 +790,52 @@ err_check:
     if (nbytes == 0) return status;
 
     /* unpack xbuf into user buffer, buf */
+    timing = NC_STATS_WTIME(ncp);
     err = ncmpio_unpack_xbuf(ncp->format, varp, bufcount, buftype,
                              buftype_is_contig, nelems, itype, imaptype,
                              need_convert, need_swap, buf, xbuf);
+    NC_STATS_ADD_TIME(ncp, NC_STATS_TIME_PACK, timing)
     if (status == NC_NOERR) status = err;
 
-    if (xbuf != buf) NCI_Free(xbuf);
+    if (xbuf != buf) ncmpii_pool_free(ncp->pool, xbuf);
 
     return status;
 }
 
+/*----< getput_two_phase() >-------------------------------------------------*/
+/* When PnetCDF's two-phase I/O is enabled, a blocking collective request is
+ * posted as a nonblocking request and committed by a collective wait call,
+ * so its file access is carried out by the two-phase I/O aggregators.
+ */
+static int
+getput_two_phase(NC               *ncp,
+                 NC_var           *varp,
+                 const MPI_Offset *start,
+                 const MPI_Offset *count,
+                 const MPI_Offset *stride,  /* can be NULL */
+                 const MPI_Offset *imap,    /* can be NULL */
+                 void             *buf,
+                 MPI_Offset        bufcount,  /* -1: from high-level API */
+                 MPI_Datatype      buftype,
+                 int               reqMode)   /* WR/RD/COLL */
+{
+    int err, status, reqid=NC_REQ_NULL, req_status=NC_NOERR;
+
+    err = ncmpio_igetput_varm(ncp, varp, start, count, stride, imap, buf,
+                              bufcount, buftype, &reqid, reqMode, 0);
+    /* NC_ERANGE is not a fatal error, the request has been posted */
+    if (err != NC_NOERR && err != NC_ERANGE) reqid = NC_REQ_NULL;
+
+    /* even when the request fails to post, this process must participate
+     * the collective wait call */
+    status = ncmpio_wait(ncp, 1, &reqid, &req_status, reqMode);
+
+    /* return the first error encountered, if there is any */
+    if (err != NC_NOERR) return err;
+    if (status != NC_NOERR) return status;
+    return req_status;
+}
+
 include(`utils.m4')dnl
 dnl
 dnl GETPUT_API(get/put)
@@ -579,15 +876,31 @@ ncmpio_$1_var(void             *ncdp,
     NC_var *varp=NULL;
 
     /* sanity check has been done at dispatchers */
+    /* no file access until the pending split-phase wait is ended */
+    if (NC_WAIT_PENDING(ncp)) DEBUG_RETURN_ERROR(NC_EPENDING)
+ifelse(`$1',`get',`
+    if (fIsSet(reqMode, NC_REQ_COLL) && ncp->num_fill_pending > 0) {
+        /* write pending lazy fills before reading */
+        int err = ncmpio_lazy_fill_flush(ncp);
+        if (err != NC_NOERR) return err;
+    }
+')dnl
 
-    if (fIsSet(reqMode, NC_REQ_ZERO) && fIsSet(reqMode, NC_REQ_COLL))
+    if (fIsSet(reqMode, NC_REQ_ZERO) && fIsSet(reqMode, NC_REQ_COLL)) {
         /* this collective API has a zero-length request */
+        if (ncp->two_phase)
+            /* participate the collective wait call of two-phase I/O */
+            return ncmpio_wait(ncp, 0, NULL, NULL, reqMode);
         return ncmpio_getput_zero_req(ncp, reqMode);
+    }
 
     /* obtain NC_var object pointer, varp. Note sanity check for ncdp and
      * varid has been done in dispatchers */
     varp = ncp->vars.value[varid];
 
+    if (ncp->stats != NULL)
+        ncmpio_stats_add_vars(ncp, varp, count, stride, imap, reqMode);
+
 #ifdef ENABLE_SUBFILING
     /* call a separate routine if variable is stored in subfiles */
     if (varp->num_subfiles > 1) {
@@ -601,11 +914,287 @@ ncmpio_$1_var(void             *ncdp,
                                               buftype, reqMode);
     }
 #endif
+    if (ncp->two_phase && fIsSet(reqMode, NC_REQ_COLL))
+        return getput_two_phase(ncp, varp, start, count, stride, imap,
+                                (void*)buf, bufcount, buftype, reqMode);
+
     return $1_varm(ncp, varp, start, count, stride, imap, (void*)buf,
-                   bufcount, buftype, reqMode);
+                   bufcount, buftype, NULL, reqMode);
 }
 ')dnl
 dnl
 
 GETPUT_API(get)
 GETPUT_API(put)
+
+/*----< create_plan_filetype() >---------------------------------------------*/
+/* (Re)create the filetype of a persistent request for the subarray given at
+ * its creation. This is done at creation and again if the variable has been
+ * moved or the record size has changed since, e.g. by redef.
+ */
+static int
+create_plan_filetype(NC      *ncp,
+                     NC_var  *varp,
+                     NC_plan *plan)
+{
+    int err;
+    double timing;
+
+    if (plan->filetype != MPI_BYTE) MPI_Type_free(&plan->filetype);
+    plan->filetype = MPI_BYTE;
+    plan->offset   = 0;
+    plan->begin    = varp->begin;
+    plan->recsize  = ncp->recsize;
+
+    if (plan->nbytes == 0) return NC_NOERR;
+
+    timing = NC_STATS_WTIME(ncp);
+    err = ncmpio_filetype_create_vars(ncp, varp, plan->start,
+                                      plan->start + varp->ndims, NULL, NULL,
+                                      &plan->offset, &plan->filetype, NULL);
+    NC_STATS_ADD_TIME(ncp, NC_STATS_TIME_FILETYPE, timing)
+    if (err != NC_NOERR) plan->filetype = MPI_BYTE;
+    return err;
+}
+
+/*----< free_plan() >--------------------------------------------------------*/
+static void
+free_plan(NC_plan *plan)
+{
+    if (plan->start != NULL) NCI_Free(plan->start);
+    if (plan->buftype_dup) MPI_Type_free(&plan->buftype);
+    if (plan->filetype != MPI_BYTE) MPI_Type_free(&plan->filetype);
+    plan->start       = NULL;
+    plan->buftype_dup = 0;
+    plan->filetype    = MPI_BYTE;
+    plan->varid       = -1;
+}
+
+/*----< ncmpio_free_plans() >------------------------------------------------*/
+/* free all persistent requests, called at file close */
+void
+ncmpio_free_plans(NC *ncp)
+{
+    int i;
+
+    for (i=0; i<ncp->num_plans; i++)
+        if (ncp->plans[i].varid >= 0) free_plan(ncp->plans + i);
+
+    NCI_Free(ncp->plans);
+    ncp->plans     = NULL;
+    ncp->num_plans = 0;
+}
+
+/*----< ncmpio_getput_init() >-----------------------------------------------*/
+/* Create a persistent request to write/read the subarray start/count of a
+ * variable from/to buf. The decoding of buftype and the construction of the
+ * filetype are done here once, so starting the request later only needs to
+ * shift the file offset to the record being accessed. buf is not accessed
+ * until the request is started.
+ * reqMode is NC_REQ_WR or NC_REQ_RD.
+ */
+int
+ncmpio_getput_init(void             *ncdp,
+                   int               varid,
+                   const MPI_Offset *start,
+                   const MPI_Offset *count,
+                   const void       *buf,
+                   MPI_Offset        bufcount,
+                   MPI_Datatype      buftype,
+                   int              *request,
+                   int               reqMode)
+{
+    int i, id, err, combiner, num_ints, num_adds, num_dtypes;
+    NC *ncp=(NC*)ncdp;
+    NC_var *varp;
+    NC_plan *plan;
+
+    /* sanity check has been done at dispatchers */
+    *request = NC_REQ_NULL;
+    varp = ncp->vars.value[varid];
+
+    /* find a free entry in the list of persistent requests */
+    for (id=0; id<ncp->num_plans; id++)
+        if (ncp->plans[id].varid < 0) break;
+
+    if (id == ncp->num_plans) {
+        size_t len = (size_t)(ncp->num_plans + NC_PLAN_CHUNK);
+        NC_plan *plans = (NC_plan*) NCI_Realloc(ncp->plans,
+                                                len * sizeof(NC_plan));
+        if (plans == NULL) DEBUG_RETURN_ERROR(NC_ENOMEM)
+        ncp->plans = plans;
+        for (i=ncp->num_plans; i<ncp->num_plans+NC_PLAN_CHUNK; i++) {
+            ncp->plans[i].varid       = -1;
+            ncp->plans[i].start       = NULL;
+            ncp->plans[i].buftype_dup = 0;
+            ncp->plans[i].filetype    = MPI_BYTE;
+        }
+        ncp->num_plans += NC_PLAN_CHUNK;
+    }
+    plan = ncp->plans + id;
+
+    plan->varid    = varid;
+    plan->reqMode  = reqMode & (NC_REQ_WR | NC_REQ_RD);
+    plan->buf      = (void*)buf;
+    plan->bufcount = bufcount;
+    plan->buftype  = buftype;
+
+    if (varp->ndims > 0) {
+        /* start[], count[], and start[] of the current access */
+        plan->start = (MPI_Offset*) NCI_Malloc((size_t)varp->ndims * 3 *
+                                               SIZEOF_MPI_OFFSET);
+        if (plan->start == NULL) {
+            plan->varid = -1;
+            DEBUG_RETURN_ERROR(NC_ENOMEM)
+        }
+        memcpy(plan->start, start, (size_t)varp->ndims * SIZEOF_MPI_OFFSET);
+        memcpy(plan->start + varp->ndims, count,
+               (size_t)varp->ndims * SIZEOF_MPI_OFFSET);
+    }
+
+    /* keep a derived buftype alive, in case the user frees it */
+    if (buftype != MPI_DATATYPE_NULL) {
+        MPI_Type_get_envelope(buftype, &num_ints, &num_adds, &num_dtypes,
+                              &combiner);
+        if (combiner != MPI_COMBINER_NAMED) {
+            MPI_Type_dup(buftype, &plan->buftype);
+            plan->buftype_dup = 1;
+        }
+    }
+
+    err = decode_buftype(varp, (varp->ndims > 0) ? count : NULL, bufcount,
+                         buftype, &plan->itype, &plan->el_size,
+                         &plan->nelems, &plan->nbytes,
+                         &plan->buftype_is_contig);
+    if (err != NC_NOERR) {
+        free_plan(plan);
+        return err;
+    }
+
+    plan->need_convert = 0;
+    plan->need_swap    = 0;
+    if (plan->nbytes > 0) {
+        plan->need_convert = ncmpii_need_convert(ncp->format, varp->xtype,
+                                                 plan->itype);
+        plan->need_swap    = NEED_BYTE_SWAP(varp->xtype, plan->itype);
+    }
+
+    err = create_plan_filetype(ncp, varp, plan);
+    if (err != NC_NOERR) {
+        free_plan(plan);
+        return err;
+    }
+
+    *request = id;
+    return NC_NOERR;
+}
+
+/*----< ncmpio_start() >-----------------------------------------------------*/
+/* Start a persistent request and wait for its completion. For a record
+ * variable, recno replaces start[0] given at the request creation, unless it
+ * is negative. reqMode is NC_REQ_COLL or NC_REQ_INDEP.
+ */
+int
+ncmpio_start(void       *ncdp,
+             int         request,
+             MPI_Offset  recno,
+             int         reqMode)
+{
+    int err=NC_NOERR;
+    NC *ncp=(NC*)ncdp;
+    NC_var *varp;
+    NC_plan *plan;
+    MPI_Offset *start=NULL, *count=NULL;
+
+    /* no file access until the pending split-phase wait is ended */
+    if (NC_WAIT_PENDING(ncp)) DEBUG_RETURN_ERROR(NC_EPENDING)
+
+    if (request < 0 || request >= ncp->num_plans ||
+        ncp->plans[request].varid < 0)
+        DEBUG_RETURN_ERROR(NC_EINVAL_REQUEST)
+
+    plan = ncp->plans + request;
+    varp = ncp->vars.value[plan->varid];
+    reqMode |= plan->reqMode | NC_REQ_BLK | NC_REQ_FLEX;
+
+    if (fIsSet(reqMode, NC_REQ_RD) && fIsSet(reqMode, NC_REQ_COLL) &&
+        ncp->num_fill_pending > 0) {
+        /* write pending lazy fills before reading */
+        err = ncmpio_lazy_fill_flush(ncp);
+        if (err != NC_NOERR) return err;
+    }
+
+    if (varp->ndims > 0) {
+        /* start[] of this access */
+        start = plan->start + varp->ndims * 2;
+        count = plan->start + varp->ndims;
+        memcpy(start, plan->start, (size_t)varp->ndims * SIZEOF_MPI_OFFSET);
+        if (IS_RECVAR(varp) && recno >= 0) start[0] = recno;
+    }
+
+    if (IS_RECVAR(varp)) {
+        if (ncp->format < 5 && start[0] > NC_MAX_UINT)
+            DEBUG_ASSIGN_ERROR(err, NC_EINVALCOORDS)
+        /* read cannot go beyond current numrecs */
+        else if (fIsSet(reqMode, NC_REQ_RD) && plan->nbytes > 0) {
+            if (start[0] >= ncp->numrecs)
+                DEBUG_ASSIGN_ERROR(err, NC_EINVALCOORDS)
+            else if (start[0] + count[0] > ncp->numrecs)
+                DEBUG_ASSIGN_ERROR(err, NC_EEDGE)
+        }
+    }
+
+    /* the variable may have been moved, e.g. by redef */
+    if (err == NC_NOERR &&
+        (plan->begin != varp->begin || plan->recsize != ncp->recsize))
+        err = create_plan_filetype(ncp, varp, plan);
+
+    if (err != NC_NOERR) {
+        /* for collective API, this process must still participate the
+         * collective calls with a zero-length request */
+        if (fIsSet(reqMode, NC_REQ_COLL)) {
+            if (ncp->two_phase)
+                ncmpio_wait(ncp, 0, NULL, NULL, reqMode);
+            else
+                ncmpio_getput_zero_req(ncp, reqMode);
+        }
+        return err;
+    }
+
+    if (ncp->stats != NULL)
+        ncmpio_stats_add(ncp, varp, NC_STATS_VARA, reqMode, plan->nbytes);
+
+#ifdef ENABLE_SUBFILING
+    /* call a separate routine if variable is stored in subfiles */
+    if (varp->num_subfiles > 1)
+        return ncmpio_subfile_getput_vars(ncp, varp, start, count, NULL,
+                                          plan->buf, plan->bufcount,
+                                          plan->buftype, reqMode);
+#endif
+    if (ncp->two_phase && fIsSet(reqMode, NC_REQ_COLL))
+        return getput_two_phase(ncp, varp, start, count, NULL, NULL,
+                                plan->buf, plan->bufcount, plan->buftype,
+                                reqMode);
+
+    if (fIsSet(reqMode, NC_REQ_RD))
+        return get_varm(ncp, varp, start, count, NULL, NULL, plan->buf,
+                        plan->bufcount, plan->buftype, plan, reqMode);
+    else
+        return put_varm(ncp, varp, start, count, NULL, NULL, plan->buf,
+                        plan->bufcount, plan->buftype, plan, reqMode);
+}
+
+/*----< ncmpio_request_free() >----------------------------------------------*/
+int
+ncmpio_request_free(void *ncdp,
+                    int   request)
+{
+    NC *ncp=(NC*)ncdp;
+
+    if (request < 0 || request >= ncp->num_plans ||
+        ncp->plans[request].varid < 0)
+        DEBUG_RETURN_ERROR(NC_EINVAL_REQUEST)
+
+    free_plan(ncp->plans + request);
+    return NC_NOERR;
+}
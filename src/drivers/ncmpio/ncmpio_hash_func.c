@@ -23,7 +23,7 @@
 /* borrow Jenkins hash function:
  * https://en.wikipedia.org/wiki/Jenkins_hash_function
  */
-int ncmpio_jenkins_one_at_a_time_hash(const char *str_name)
+unsigned int ncmpio_jenkins_one_at_a_time_hash(const char *str_name)
 {
     unsigned int i, hash=0;
     for (i=0; i<strlen(str_name); ++i) {
@@ -35,45 +35,38 @@ int ncmpio_jenkins_one_at_a_time_hash(const char *str_name)
     hash ^= (hash >> 11);
     hash += (hash << 15);
 
-#if 0
-    ret = (int)hash; /* the return value will be used as an array index */
-    return ((ret < 0) ? -ret : ret); /* make the value positive */
-#endif
-    /* this is to avoid expensive % operation, i.e. % HASH_TABLE_SIZE
-    return (int)((hash ^ (hash>>10) ^ (hash>>20)) & (HASH_TABLE_SIZE-1));
-    */
-    return (int)(hash & (HASH_TABLE_SIZE-1));
-    /* return value will be used as an array index */
+    /* name lookup tables take the low bits of the return value */
+    return hash;
 }
 
 /*----< ncmpio_additive_hash() >---------------------------------------------*/
 /* try different hash functions described in
  * http://www.burtleburtle.net/bob/hash/doobs.html
  */
-int ncmpio_additive_hash(const char *str_name)
+unsigned int ncmpio_additive_hash(const char *str_name)
 {
     size_t i, len = strlen(str_name);
-    int hash = (int)len;
+    unsigned int hash = (unsigned int)len;
     for (i=0; i<len; ++i)
-        hash += str_name[i]; /* additive hash */
+        hash += (unsigned int)str_name[i]; /* additive hash */
 
-    return (hash % 251); /* 251 is the largest prime <= 255 */
+    return hash;
 }
 
 /*----< ncmpio_rotating_hash() >---------------------------------------------*/
-int ncmpio_rotating_hash(const char *str_name)
+unsigned int ncmpio_rotating_hash(const char *str_name)
 {
     size_t i, len = strlen(str_name);
     unsigned int hash = (unsigned int)len;
     for (i=0; i<len; ++i)
         hash = (hash<<4)^(hash>>28)^(unsigned int)str_name[i];
 
-    /* below is a clever way to replace (hash % prime) */
-    return (int)((hash ^ (hash>>10) ^ (hash>>20)) & (HASH_TABLE_SIZE-1));
+    /* fold the high bits into the low bits used by name lookup tables */
+    return (hash ^ (hash>>10) ^ (hash>>20));
 }
 
 /*----< ncmpio_Bernstein_hash() >--------------------------------------------*/
-int ncmpio_Bernstein_hash(const char *str_name)
+unsigned int ncmpio_Bernstein_hash(const char *str_name)
 {
     size_t i, len = strlen(str_name);
     unsigned int hash = (unsigned int)len;
@@ -81,13 +74,13 @@ int ncmpio_Bernstein_hash(const char *str_name)
         /* hash = 65*hash+str_name[i]; */
         hash = hash+(hash<<6)+(unsigned int)str_name[i];
 
-    return (int)((hash ^ (hash>>10) ^ (hash>>20)) & (HASH_TABLE_SIZE-1));
+    /* fold the high bits into the low bits used by name lookup tables */
+    return (hash ^ (hash>>10) ^ (hash>>20));
 }
 
 /*----< ncmpio_Pearson_hash() >----------------------------------------------*/
-int ncmpio_Pearson_hash(const char *str_name)
+unsigned int ncmpio_Pearson_hash(const char *str_name)
 {
-#if HASH_TABLE_SIZE == 256
     unsigned char T[256] = {
         251, 175, 119, 215, 81, 14, 79, 191, 103, 49, 181, 143, 186, 157,  0,
         232, 31, 32, 55, 60, 152, 58, 17, 237, 174, 70, 160, 144, 220, 90, 57,
@@ -110,14 +103,134 @@ int ncmpio_Pearson_hash(const char *str_name)
     size_t i, len=strlen(str_name);
     unsigned char hash = (unsigned char)len;
     for (i=len; i>0; ) hash = T[hash ^ str_name[--i]];
-    return (int)hash;
-#else
-    unsigned int i, hash=strlen(str_name);
-    for (i=0; i<strlen(str_name); ++i)
-        hash ^= str_name[i];
+    return (unsigned int)hash;
+}
 
-    return (int)((hash ^ (hash>>10) ^ (hash>>20)) & (HASH_TABLE_SIZE-1));
-#endif
+
+/* Name lookup tables use open addressing with linear probing. Each slot
+ * stores the full hash value of a name together with its ID, so probing
+ * compares names only when their hash values match. The number of slots is a
+ * power of 2 and is doubled when the table is more than 3/4 full.
+ */
+
+/*----< hash_table_alloc() >-------------------------------------------------*/
+static int
+hash_table_alloc(NC_nametable *nameT, int nalloc)
+{
+    int i;
+
+    nameT->slots = (NC_nameslot*) NCI_Malloc((size_t)nalloc * sizeof(NC_nameslot));
+    if (nameT->slots == NULL) DEBUG_RETURN_ERROR(NC_ENOMEM)
+
+    for (i=0; i<nalloc; i++) nameT->slots[i].id = -1; /* empty slot */
+    nameT->nalloc = nalloc;
+    nameT->nused  = 0;
+
+    return NC_NOERR;
+}
+
+/*----< hash_slot_insert() >-------------------------------------------------*/
+/* add an ID to the first empty slot, the table must not be full */
+static void
+hash_slot_insert(NC_nametable *nameT, unsigned int hash, int id)
+{
+    unsigned int mask = (unsigned int)nameT->nalloc - 1;
+    unsigned int j = hash & mask;
+
+    while (nameT->slots[j].id >= 0) j = (j + 1) & mask;
+
+    nameT->slots[j].hash = hash;
+    nameT->slots[j].id   = id;
+    nameT->nused++;
+}
+
+/*----< hash_slot_remove() >-------------------------------------------------*/
+/* remove an ID from the table. Entries after it in the same probe sequence
+ * are shifted backward, so no deleted marker is left in the table.
+ */
+static int
+hash_slot_remove(NC_nametable *nameT, unsigned int hash, int id)
+{
+    unsigned int i, j, k, mask;
+
+    if (nameT->nalloc == 0) return -1;
+
+    mask = (unsigned int)nameT->nalloc - 1;
+    for (i=hash&mask; nameT->slots[i].id >= 0; i=(i+1)&mask)
+        if (nameT->slots[i].id == id) break;
+
+    /* ID is not found in the table */
+    if (nameT->slots[i].id < 0) return -1;
+
+    for (j=(i+1)&mask; nameT->slots[j].id >= 0; j=(j+1)&mask) {
+        /* entry j can move to i only if its home slot k is not in (i, j] */
+        k = nameT->slots[j].hash & mask;
+        if ((i <= j) ? (i < k && k <= j) : (i < k || k <= j)) continue;
+        nameT->slots[i] = nameT->slots[j];
+        i = j;
+    }
+    nameT->slots[i].id = -1;
+    nameT->nused--;
+
+    return 0;
+}
+
+/*----< hash_table_reserve() >-----------------------------------------------*/
+/* make sure the table can hold nnames names under the maximum load factor */
+static int
+hash_table_reserve(NC_nametable *nameT, int nnames)
+{
+    int i, err, nalloc, old_nalloc;
+    NC_nameslot *old_slots;
+
+    if ((size_t)nnames * 4 <= (size_t)nameT->nalloc * 3) return NC_NOERR;
+
+    nalloc = (nameT->nalloc == 0) ? NC_NAME_TABLE_INIT_SIZE : nameT->nalloc;
+    while ((size_t)nnames * 4 > (size_t)nalloc * 3) nalloc *= 2;
+
+    old_slots  = nameT->slots;
+    old_nalloc = nameT->nalloc;
+
+    err = hash_table_alloc(nameT, nalloc);
+    if (err != NC_NOERR) {
+        nameT->slots = old_slots;
+        return err;
+    }
+
+    /* re-insert the IDs, the stored hash values are reused */
+    for (i=0; i<old_nalloc; i++)
+        if (old_slots[i].id >= 0)
+            hash_slot_insert(nameT, old_slots[i].hash, old_slots[i].id);
+
+    if (old_slots != NULL) NCI_Free(old_slots);
+
+    return NC_NOERR;
+}
+
+/*----< ncmpio_hash_lookup() >-----------------------------------------------*/
+/* Return the next ID in the table whose name has hash value hash, or -1 if
+ * there is none. *pos is the slot to continue from, and must be set to -1
+ * for the first call. Callers compare the names of the returned IDs.
+ */
+int
+ncmpio_hash_lookup(const NC_nametable *nameT,
+                   unsigned int        hash,
+                   int                *pos)
+{
+    unsigned int j, mask;
+
+    if (nameT->nalloc == 0) return -1; /* table not created */
+
+    mask = (unsigned int)nameT->nalloc - 1;
+    j = (*pos < 0) ? (hash & mask) : (((unsigned int)*pos + 1) & mask);
+
+    for (; nameT->slots[j].id >= 0; j=(j+1)&mask) {
+        if (nameT->slots[j].hash == hash) {
+            *pos = (int)j;
+            return nameT->slots[j].id;
+        }
+    }
+    return -1;
 }
 
 /*----< ncmpio_update_name_lookup_table() >----------------------------------*/
@@ -130,69 +243,37 @@ ncmpio_update_name_lookup_table(NC_nametable *nameT,
                                 const char   *oldname,  /*    normalized */
                                 const char   *unewname) /* un-normalized */
 {
-    int i, key, err;
+    int err;
     char *name; /* normalized name string */
 
-    /* remove the old name from the lookup table
-     * hash the var name into a key for name lookup
-     */
-    key = HASH_FUNC(oldname);
-    for (i=0; i<nameT[key].num; i++) {
-        if (nameT[key].list[i] == id) break;
-    }
-    assert(i!=nameT[key].num);
-
-    /* coalesce the id array */
-    for (; i<nameT[key].num-1; i++)
-        nameT[key].list[i] = nameT[key].list[i+1];
-
-    /* decrease the number of IDs and free space if necessary */
-    nameT[key].num--;
-    if (nameT[key].num == 0) {
-        NCI_Free(nameT[key].list);
-        nameT[key].list = NULL;
-    }
-
     /* normalized version of uname */
     err = ncmpii_utf8_normalize(unewname, &name);
     if (err != NC_NOERR) return err;
 
-    /* hash the var name into a key for name lookup */
-    key = HASH_FUNC(name);
+    /* Note unewname must have already been checked for existence */
+    err = ncmpio_hash_replace(nameT, oldname, name, id);
     NCI_Free(name);
+    assert(err == NC_NOERR);
 
-    /* add the new name to the lookup table
-     * Note unewname must have already been checked for existence
-     */
-    if (nameT[key].num % NC_NAME_TABLE_CHUNK == 0)
-        nameT[key].list = (int*) NCI_Realloc(nameT[key].list,
-                          (size_t)(nameT[key].num+NC_NAME_TABLE_CHUNK) * SIZEOF_INT);
-    nameT[key].list[nameT[key].num] = id;
-    nameT[key].num++;
-
-    return NC_NOERR;
+    return err;
 }
 
 /*----< ncmpio_hash_insert() >-----------------------------------------------*/
-void
+int
 ncmpio_hash_insert(NC_nametable *nameT, /* var name lookup table */
                    const char   *name,
                    int           id)
 {
-    int key;
-
-    /* hash the name into a key for name lookup */
-    key = HASH_FUNC(name);
+    int err;
 
-    /* allocate or expand the space for nameT[key].list */
-    if (nameT[key].num % NC_NAME_TABLE_CHUNK == 0)
-        nameT[key].list = (int*) NCI_Realloc(nameT[key].list,
-                          (size_t)(nameT[key].num+NC_NAME_TABLE_CHUNK) *
-                          SIZEOF_INT);
+    /* allocate or expand the table */
+    err = hash_table_reserve(nameT, nameT->nused + 1);
+    if (err != NC_NOERR) return err;
 
     /* add the ID to the name lookup table */
-    nameT[key].list[nameT[key].num] = id;
-    nameT[key].num++;
+    hash_slot_insert(nameT, HASH_FUNC(name), id);
+
+    return NC_NOERR;
 }
 
 /*----< ncmpio_hash_delete() >-----------------------------------------------*/
@@ -202,37 +283,16 @@ ncmpio_hash_delete(NC_nametable *nameT, /* var name lookup table */
                    const char   *name,
                    int           id)
 {
-    int i, j, key;
-
-    /* hash the name into a key for name lookup */
-    key = HASH_FUNC(name);
-
-    /* find the entry from list[] that matches id */
-    for (i=0; i<nameT[key].num; i++)
-        if (nameT[key].list[i] == id)
-            break;
+    int i;
 
     /* name is not found in nameT hash table */
-    if (i == nameT[key].num) DEBUG_RETURN_ERROR(NC_ENOTATT)
-
-    /* coalesce list[] */
-    for (; i<nameT[key].num-1; i++)
-        nameT[key].list[i] = nameT[key].list[i+1];
-
-    nameT[key].num--;
-
-    if (nameT[key].num == 0) {
-        NCI_Free(nameT[key].list);
-        nameT[key].list = NULL;
-    }
+    if (hash_slot_remove(nameT, HASH_FUNC(name), id) < 0)
+        DEBUG_RETURN_ERROR(NC_ENOTATT)
 
     /* update all IDs that are > id */
-    for (i=0; i<HASH_TABLE_SIZE; i++) {
-        if (nameT[i].num == 0) continue;
-        for (j=0; j<nameT[i].num; j++)
-            if (nameT[i].list[j] > id)
-                nameT[i].list[j]--;
-    }
+    for (i=0; i<nameT->nalloc; i++)
+        if (nameT->slots[i].id > id)
+            nameT->slots[i].id--;
 
     return NC_NOERR;
 }
@@ -245,61 +305,35 @@ ncmpio_hash_replace(NC_nametable *nameT, /* var name lookup table */
                     const char   *new_name,
                     int           id)
 {
-    int i, key;
-
-    /* hash the old name into a key for name lookup */
-    key = HASH_FUNC(old_name);
-
-    /* find the entry from list[] that matches id */
-    for (i=0; i<nameT[key].num; i++)
-        if (nameT[key].list[i] == id)
-            break;
-
     /* name is not found in nameT hash table */
-    if (i == nameT[key].num) DEBUG_RETURN_ERROR(NC_ENOTATT)
-
-    /* coalesce list[] */
-    for (; i<nameT[key].num-1; i++)
-        nameT[key].list[i] = nameT[key].list[i+1];
+    if (hash_slot_remove(nameT, HASH_FUNC(old_name), id) < 0)
+        DEBUG_RETURN_ERROR(NC_ENOTATT)
 
-    nameT[key].num--;
-
-    if (nameT[key].num == 0) {
-        NCI_Free(nameT[key].list);
-        nameT[key].list = NULL;
-    }
-
-    /* hash the new name into a key for name lookup */
-    key = HASH_FUNC(new_name);
-
-    /* allocate or expand the space for nameT[key].list */
-    if (nameT[key].num % NC_NAME_TABLE_CHUNK == 0)
-        nameT[key].list = (int*) NCI_Realloc(nameT[key].list,
-                          (size_t)(nameT[key].num+NC_NAME_TABLE_CHUNK) *
-                          SIZEOF_INT);
-
-    /* add the ID to the name lookup table */
-    nameT[key].list[nameT[key].num] = id;
-    nameT[key].num++;
+    /* the slot just freed is enough for the new name */
+    hash_slot_insert(nameT, HASH_FUNC(new_name), id);
 
     return NC_NOERR;
 }
 
 /*----< ncmpio_hash_table_copy() >-------------------------------------------*/
-void
+int
 ncmpio_hash_table_copy(NC_nametable       *dest,
                        const NC_nametable *src)
 {
-    int i;
+    dest->nalloc = 0;
+    dest->nused  = 0;
+    dest->slots  = NULL;
 
-    for (i=0; i<HASH_TABLE_SIZE; i++) {
-        dest[i].num = src[i].num;
-        dest[i].list = NULL;
-        if (dest[i].num > 0) {
-            dest[i].list = NCI_Malloc((size_t)dest[i].num * SIZEOF_INT);
-            memcpy(dest[i].list, src[i].list, (size_t)dest[i].num * SIZEOF_INT);
-        }
-    }
+    if (src->nalloc == 0) return NC_NOERR;
+
+    dest->slots = (NC_nameslot*) NCI_Malloc((size_t)src->nalloc * sizeof(NC_nameslot));
+    if (dest->slots == NULL) DEBUG_RETURN_ERROR(NC_ENOMEM)
+
+    memcpy(dest->slots, src->slots, (size_t)src->nalloc * sizeof(NC_nameslot));
+    dest->nalloc = src->nalloc;
+    dest->nused  = src->nused;
+
+    return NC_NOERR;
 }
 
 /*----< ncmpio_hash_table_free() >-------------------------------------------*/
@@ -307,95 +341,72 @@ ncmpio_hash_table_copy(NC_nametable       *dest,
 void
 ncmpio_hash_table_free(NC_nametable *nameT)
 {
-    int i;
-    for (i=0; i<HASH_TABLE_SIZE; i++) {
-        if (nameT[i].num > 0)
-            NCI_Free(nameT[i].list);
-        nameT[i].num = 0;
-    }
+    if (nameT->slots != NULL) NCI_Free(nameT->slots);
+    nameT->slots  = NULL;
+    nameT->nalloc = 0;
+    nameT->nused  = 0;
 }
 
 /*----< ncmpio_hash_table_populate_NC_dim() >--------------------------------*/
-void
+int
 ncmpio_hash_table_populate_NC_dim(NC_dimarray *dimsp)
 {
-    int i;
-    NC_nametable *nameT = dimsp->nameT;
+    int i, err;
+
+    ncmpio_hash_table_free(&dimsp->nameT);
+    if (dimsp->ndefined == 0) return NC_NOERR;
 
-    /* initialize dim name lookup table -------------------------------------*/
-    memset(nameT, 0, sizeof(NC_nametable) * HASH_TABLE_SIZE);
+    /* size the table for all names at once */
+    err = hash_table_reserve(&dimsp->nameT, dimsp->ndefined);
+    if (err != NC_NOERR) return err;
 
     /* populate name lookup table */
-    for (i=0; i<dimsp->ndefined; i++) {
-        /* hash the dim name into a key for name lookup */
-        int key = HASH_FUNC(dimsp->value[i]->name);
-        nameT = &dimsp->nameT[key];
-        if (nameT->num % NC_NAME_TABLE_CHUNK == 0)
-            nameT->list = (int*) NCI_Realloc(nameT->list,
-                          (size_t)(nameT->num+NC_NAME_TABLE_CHUNK) *SIZEOF_INT);
-        nameT->list[nameT->num] = i;
-        nameT->num++;
-    }
+    for (i=0; i<dimsp->ndefined; i++)
+        hash_slot_insert(&dimsp->nameT, HASH_FUNC(dimsp->value[i]->name), i);
+
+    return NC_NOERR;
 }
 
 /*----< ncmpio_hash_table_populate_NC_var() >--------------------------------*/
-void
+int
 ncmpio_hash_table_populate_NC_var(NC_vararray *varsp)
 {
-    int i;
-    NC_nametable *nameT = varsp->nameT;
+    int i, err;
+
+    ncmpio_hash_table_free(&varsp->nameT);
+    if (varsp->ndefined == 0) return NC_NOERR;
 
-    /* initialize var name lookup table -------------------------------------*/
-    memset(nameT, 0, sizeof(NC_nametable) * HASH_TABLE_SIZE);
+    /* size the table for all names at once */
+    err = hash_table_reserve(&varsp->nameT, varsp->ndefined);
+    if (err != NC_NOERR) return err;
 
     /* populate name lookup table */
-    for (i=0; i<varsp->ndefined; i++) {
-        /* hash the var name into a key for name lookup */
-        int key = HASH_FUNC(varsp->value[i]->name);
-        nameT = &varsp->nameT[key];
-        if (nameT->num % NC_NAME_TABLE_CHUNK == 0)
-            nameT->list = (int*) NCI_Realloc(nameT->list,
-                          (size_t)(nameT->num+NC_NAME_TABLE_CHUNK) *SIZEOF_INT);
-        nameT->list[nameT->num] = i;
-        nameT->num++;
-    }
+    for (i=0; i<varsp->ndefined; i++)
+        hash_slot_insert(&varsp->nameT, HASH_FUNC(varsp->value[i]->name), i);
+
+    return NC_NOERR;
 }
 
 /*----< ncmpio_hash_table_populate_NC_attr() >-------------------------------*/
-void
-ncmpio_hash_table_populate_NC_attr(NC *ncp)
+/* Attribute lookup tables are created on demand by ncmpio_NC_findattr(), when
+ * an attribute array has more than NC_NAME_TABLE_ATTR_MIN attributes. Until
+ * then, attributes are searched linearly and the table is not maintained.
+ */
+int
+ncmpio_hash_table_populate_NC_attr(NC_attrarray *attrsp)
 {
-    int i, j;
-    NC_nametable *nameT;
-
-    /* populate name lookup table of global attributes */
-    memset(ncp->attrs.nameT, 0, sizeof(NC_nametable) * HASH_TABLE_SIZE);
-
-    for (i=0; i<ncp->attrs.ndefined; i++) {
-        /* hash the var name into a key for name lookup */
-        int key = HASH_FUNC(ncp->attrs.value[i]->name);
-        nameT = &ncp->attrs.nameT[key];
-        if (nameT->num % NC_NAME_TABLE_CHUNK == 0)
-            nameT->list = (int*) NCI_Realloc(nameT->list,
-                          (size_t)(nameT->num+NC_NAME_TABLE_CHUNK) *SIZEOF_INT);
-        nameT->list[nameT->num] = i;
-        nameT->num++;
-    }
+    int i, err;
 
-    /* populate name lookup table of each variable's attributes */
-    for (j=0; j<ncp->vars.ndefined; j++) {
-        NC_var *varp = ncp->vars.value[j];
-        memset(varp->attrs.nameT, 0, sizeof(NC_nametable) * HASH_TABLE_SIZE);
-
-        for (i=0; i<varp->attrs.ndefined; i++) {
-            /* hash the var name into a key for name lookup */
-            int key = HASH_FUNC(varp->attrs.value[i]->name);
-            nameT = &varp->attrs.nameT[key];
-            if (nameT->num % NC_NAME_TABLE_CHUNK == 0)
-                nameT->list = (int*) NCI_Realloc(nameT->list,
-                              (size_t)(nameT->num+NC_NAME_TABLE_CHUNK) *SIZEOF_INT);
-            nameT->list[nameT->num] = i;
-            nameT->num++;
-        }
-    }
+    ncmpio_hash_table_free(&attrsp->nameT);
+    if (attrsp->ndefined == 0) return NC_NOERR;
+
+    /* size the table for all names at once */
+    err = hash_table_reserve(&attrsp->nameT, attrsp->ndefined);
+    if (err != NC_NOERR) return err;
+
+    /* populate name lookup table */
+    for (i=0; i<attrsp->ndefined; i++)
+        hash_slot_insert(&attrsp->nameT, HASH_FUNC(attrsp->value[i]->name), i);
+
+    return NC_NOERR;
 }
@@ -9,6 +9,7 @@
 #endif
 
 #include <assert.h>
+#include <limits.h>  /* INT_MAX */
 #include <string.h>  /* memcpy(), memcmp() */
 #ifdef HAVE_STDLIB_H
 #include <stdlib.h>
@@ -353,6 +354,17 @@ hdr_fetch(bufferinfo *gbp) {
      */
     if (slack == gbp->size) slack = 0;
 
+    if (gbp->in_memory) {
+        /* the entire header is in gbp->whole, just move the buffer window */
+        MPI_Offset start = gbp->offset - slack;
+        if (start >= gbp->whole_size) DEBUG_RETURN_ERROR(NC_ENOTNC)
+        gbp->base   = gbp->whole + start;
+        gbp->pos    = gbp->base;
+        gbp->size   = (int) MIN(gbp->whole_size - start, INT_MAX);
+        gbp->offset = start + gbp->size;
+        return NC_NOERR;
+    }
+
     /* No need to zero out the buffer, as it will be filled with read */
     /*
     memset(gbp->base, 0, (size_t)gbp->size);
@@ -380,6 +392,24 @@ hdr_fetch(bufferinfo *gbp) {
             gbp->get_size += gbp->size;
 #endif
         }
+        if (err == NC_NOERR && gbp->whole != NULL) {
+            /* keep a copy of the bytes newly read, which will be broadcast
+             * by hdr_get_NC_bcast_whole() */
+            MPI_Offset end = gbp->offset + gbp->size - slack;
+            if (end > gbp->whole_size) {
+                MPI_Offset whole_size = MAX(end, gbp->whole_size * 2);
+                char *whole = (char*) NCI_Realloc(gbp->whole,
+                                                  (size_t)whole_size);
+                if (whole == NULL) DEBUG_ASSIGN_ERROR(err, NC_ENOMEM)
+                else {
+                    gbp->whole      = whole;
+                    gbp->whole_size = whole_size;
+                }
+            }
+            if (err == NC_NOERR)
+                memcpy(gbp->whole + gbp->offset, (char*)gbp->base + slack,
+                       (size_t)(gbp->size - slack));
+        }
     }
     /* we might have to backtrack */
     gbp->offset += (gbp->size - slack);
@@ -1302,57 +1332,27 @@ ncmpio_hdr_len_NC(const NC *ncp)
     return xlen; /* return the header size (not yet aligned) */
 }
 
-/*----< ncmpio_hdr_get_NC() >------------------------------------------------*/
-/*  CDF format specification
- *      netcdf_file  = header  data
- *      header       = magic  numrecs  dim_list  gatt_list  var_list
- *      magic        = 'C'  'D'  'F'  VERSION
- *      VERSION      = \x01 |                      // classic format
- *                     \x02 |                      // 64-bit offset format
- *                     \x05                        // 64-bit data format
- *      numrecs      = NON_NEG | STREAMING         // length of record dimension
- *      dim_list     = ABSENT | NC_DIMENSION  nelems  [dim ...]
- *      gatt_list    = att_list                    // global attributes
- *      att_list     = ABSENT | NC_ATTRIBUTE  nelems  [attr ...]
- *      var_list     = ABSENT | NC_VARIABLE   nelems  [var ...]
+/*----< hdr_get_NC_lists() >-------------------------------------------------*/
+/* Decode the header from the get buffer, which contains the first chunk of
+ * the header already. See the CDF format specification below.
  */
-int
-ncmpio_hdr_get_NC(NC *ncp)
+static int
+hdr_get_NC_lists(bufferinfo *gbp, NC *ncp)
 {
     int err, status=NC_NOERR;
-    bufferinfo getbuf;
     char magic[NC_MAGIC_LEN];
 
-    assert(ncp != NULL);
-
-    /* Initialize the get buffer that stores the header read from the file */
-    getbuf.comm          = ncp->comm;
-    getbuf.collective_fh = ncp->collective_fh;
-    getbuf.get_size      = 0;
-    getbuf.offset        = 0;   /* read from start of the file */
-    getbuf.safe_mode     = ncp->safe_mode;
-
-    /* CDF-5's minimum header size is 4 bytes more than CDF-1 and CDF-2's */
-    getbuf.size = _RNDUP( MAX(MIN_NC_XSZ+4, ncp->chunk), X_ALIGN );
-
-    getbuf.base = (void *)NCI_Malloc((size_t)getbuf.size);
-    getbuf.pos  = getbuf.base;
-
-    /* Fetch the next header chunk. The chunk is 'gbp->size' bytes big */
-    err = hdr_fetch(&getbuf);
-    if (err != NC_NOERR) return err;
-
-    /* processing the header from getbuf, the get buffer */
+    /* processing the header from gbp, the get buffer */
 
     /* First get the file format information, magic */
-    err = ncmpix_getn_text((const void**)(&getbuf.pos), NC_MAGIC_LEN, magic);
+    err = ncmpix_getn_text((const void**)(&gbp->pos), NC_MAGIC_LEN, magic);
     if (err != NC_NOERR) return err;
 
     /* check if the first three bytes are 'C','D','F' */
     if (memcmp(magic, "CDF", 3) != 0) {
         /* check if is HDF5 file */
         char signature[8], *hdf5_signature="\211HDF\r\n\032\n";
-        ncmpix_getn_text((const void**)(&getbuf.pos), 8, signature);
+        ncmpix_getn_text((const void**)(&gbp->pos), 8, signature);
         if (memcmp(signature, hdf5_signature, 8) == 0) {
             DEBUG_ASSIGN_ERROR(err, NC_ENOTNC3)
             if (ncp->safe_mode)
@@ -1360,72 +1360,203 @@ ncmpio_hdr_get_NC(NC *ncp)
         }
         else
             DEBUG_ASSIGN_ERROR(err, NC_ENOTNC)
-        goto fn_exit;
+        return err;
     }
 
     /* check version number in last byte of magic */
     if (magic[3] == 0x1) {
-        getbuf.version = ncp->format = 1;
+        gbp->version = ncp->format = 1;
     } else if (magic[3] == 0x2) {
-        getbuf.version = ncp->format = 2;
+        gbp->version = ncp->format = 2;
 #if SIZEOF_MPI_OFFSET < 8
         /* take the easy way out: if we can't support all CDF-2
          * files, return immediately */
-        NCI_Free(getbuf.base);
         DEBUG_RETURN_ERROR(NC_ESMALL)
 #endif
     } else if (magic[3] == 0x5) {
-        getbuf.version = ncp->format = 5;
+        gbp->version = ncp->format = 5;
 #if SIZEOF_MPI_OFFSET < 8
-        NCI_Free(getbuf.base);
         DEBUG_RETURN_ERROR(NC_ESMALL)
 #endif
     } else {
-        NCI_Free(getbuf.base);
         DEBUG_RETURN_ERROR(NC_ENOTNC) /* not a netCDF file */
     }
 
-    /* get numrecs from getbuf into ncp */
-    if (getbuf.version < 5) {
+    /* get numrecs from gbp into ncp */
+    if (gbp->version < 5) {
         uint tmp=0;
-        err = hdr_get_uint32(&getbuf, &tmp);
-        if (err != NC_NOERR) goto fn_exit;
+        err = hdr_get_uint32(gbp, &tmp);
+        if (err != NC_NOERR) return err;
         ncp->numrecs = (MPI_Offset)tmp;
     }
     else {
         uint64 tmp=0;
-        err = hdr_get_uint64(&getbuf, &tmp);
-        if (err != NC_NOERR) goto fn_exit;
+        err = hdr_get_uint64(gbp, &tmp);
+        if (err != NC_NOERR) return err;
         ncp->numrecs = (MPI_Offset)tmp;
     }
 
-#if 0
-    MPI_Aint pos_addr, base_addr;
-#ifdef HAVE_MPI_GET_ADDRESS
-    MPI_Get_address(getbuf.pos,  &pos_addr);
-    MPI_Get_address(getbuf.base, &base_addr);
-#else
-    MPI_Address(getbuf.pos,  &pos_addr);
-    MPI_Address(getbuf.base, &base_addr);
-#endif
-    assert(pos_addr < base_addr + getbuf.size);
-#endif
-    assert((char*)getbuf.pos < (char*)getbuf.base + getbuf.size);
+    assert((char*)gbp->pos < (char*)gbp->base + gbp->size);
 
-    /* get dim_list from getbuf into ncp */
-    err = hdr_get_NC_dimarray(&getbuf, &ncp->dims);
+    /* get dim_list from gbp into ncp */
+    err = hdr_get_NC_dimarray(gbp, &ncp->dims);
     if (err == NC_ENULLPAD) status = NC_ENULLPAD; /* non-fatal error */
-    else if (err != NC_NOERR) goto fn_exit;
+    else if (err != NC_NOERR) return err;
 
-    /* get gatt_list from getbuf into ncp */
-    err = hdr_get_NC_attrarray(&getbuf, &ncp->attrs);
+    /* get gatt_list from gbp into ncp */
+    err = hdr_get_NC_attrarray(gbp, &ncp->attrs);
     if (err == NC_ENULLPAD) status = NC_ENULLPAD; /* non-fatal error */
-    else if (err != NC_NOERR) goto fn_exit;
+    else if (err != NC_NOERR) return err;
 
-    /* get var_list from getbuf into ncp */
-    err = hdr_get_NC_vararray(&getbuf, &ncp->vars, ncp->dims.ndefined);
+    /* get var_list from gbp into ncp */
+    err = hdr_get_NC_vararray(gbp, &ncp->vars, ncp->dims.ndefined);
     if (err == NC_ENULLPAD) status = NC_ENULLPAD; /* non-fatal error */
-    else if (err != NC_NOERR) goto fn_exit;
+    else if (err != NC_NOERR) return err;
+
+    return status;
+}
+
+/*----< hdr_get_NC_bcast_whole() >-------------------------------------------*/
+/* When hint nc_header_bcast_whole is enabled, root reads the header in chunks
+ * and decodes it alone, while keeping a copy of the bytes read. The entire
+ * header is then broadcast at once and the other processes decode it from
+ * memory. This replaces a round of read and broadcast per chunk, which is
+ * expensive for large headers opened by many processes.
+ */
+static int
+hdr_get_NC_bcast_whole(bufferinfo *gbp, NC *ncp)
+{
+    int rank, err=NC_NOERR, alloc_err=NC_NOERR, mpireturn;
+    void *chunk_buf=gbp->base;
+    MPI_Offset off, msg[2]; /* root's error code and header extent */
+
+    MPI_Comm_rank(ncp->comm, &rank);
+
+    if (rank == 0) {
+        /* read without broadcasting the chunks to other processes */
+        gbp->comm       = MPI_COMM_SELF;
+        gbp->whole_size = gbp->size;
+        gbp->whole      = (char*) NCI_Malloc((size_t)gbp->whole_size);
+        if (gbp->whole == NULL) DEBUG_ASSIGN_ERROR(err, NC_ENOMEM)
+        else err = hdr_fetch(gbp);
+        if (err == NC_NOERR) err = hdr_get_NC_lists(gbp, ncp);
+        gbp->comm = ncp->comm;
+
+        msg[0] = err;
+        /* header extent is the file offset next to the last byte decoded */
+        msg[1] = gbp->offset - gbp->size
+               + ((char*)gbp->pos - (char*)gbp->base);
+    }
+
+    TRACE_COMM(MPI_Bcast)(msg, 2, MPI_OFFSET, 0, ncp->comm);
+    if (mpireturn != MPI_SUCCESS) {
+        err = ncmpii_error_mpi2nc(mpireturn, "MPI_Bcast");
+        goto fn_exit;
+    }
+
+    /* return now if root fails to decode the header, e.g. not a CDF file */
+    err = (int)msg[0];
+    if (err != NC_NOERR && err != NC_ENULLPAD) goto fn_exit;
+
+    if (rank > 0) {
+        gbp->whole_size = msg[1];
+        gbp->whole      = (char*) NCI_Malloc((size_t)gbp->whole_size);
+        if (gbp->whole == NULL) DEBUG_ASSIGN_ERROR(alloc_err, NC_ENOMEM)
+    }
+
+    /* all processes must be able to receive the header */
+    TRACE_COMM(MPI_Allreduce)(MPI_IN_PLACE, &alloc_err, 1, MPI_INT, MPI_MIN,
+                              ncp->comm);
+    if (mpireturn != MPI_SUCCESS) {
+        err = ncmpii_error_mpi2nc(mpireturn, "MPI_Allreduce");
+        goto fn_exit;
+    }
+    if (alloc_err != NC_NOERR) {
+        err = alloc_err;
+        goto fn_exit;
+    }
+
+    /* broadcast the entire header, in pieces if larger than INT_MAX */
+    for (off=0; off<msg[1]; off+=INT_MAX) {
+        int len = (int) MIN(msg[1] - off, INT_MAX);
+        TRACE_COMM(MPI_Bcast)(gbp->whole + off, len, MPI_BYTE, 0, ncp->comm);
+        if (mpireturn != MPI_SUCCESS) {
+            err = ncmpii_error_mpi2nc(mpireturn, "MPI_Bcast");
+            goto fn_exit;
+        }
+    }
+
+    if (rank > 0) {
+        /* decode the header from memory */
+        gbp->in_memory = 1;
+        gbp->base      = gbp->whole;
+        gbp->pos       = gbp->base;
+        gbp->size      = 0;
+        err = hdr_fetch(gbp);
+        if (err == NC_NOERR) err = hdr_get_NC_lists(gbp, ncp);
+    }
+
+fn_exit:
+    if (gbp->whole != NULL) NCI_Free(gbp->whole);
+    gbp->whole     = NULL;
+    gbp->in_memory = 0;
+    gbp->base      = chunk_buf;
+    gbp->pos       = chunk_buf;
+    return err;
+}
+
+/*----< ncmpio_hdr_get_NC() >------------------------------------------------*/
+/*  CDF format specification
+ *      netcdf_file  = header  data
+ *      header       = magic  numrecs  dim_list  gatt_list  var_list
+ *      magic        = 'C'  'D'  'F'  VERSION
+ *      VERSION      = \x01 |                      // classic format
+ *                     \x02 |                      // 64-bit offset format
+ *                     \x05                        // 64-bit data format
+ *      numrecs      = NON_NEG | STREAMING         // length of record dimension
+ *      dim_list     = ABSENT | NC_DIMENSION  nelems  [dim ...]
+ *      gatt_list    = att_list                    // global attributes
+ *      att_list     = ABSENT | NC_ATTRIBUTE  nelems  [attr ...]
+ *      var_list     = ABSENT | NC_VARIABLE   nelems  [var ...]
+ */
+int
+ncmpio_hdr_get_NC(NC *ncp)
+{
+    int err, status;
+    bufferinfo getbuf;
+
+    assert(ncp != NULL);
+
+    /* Initialize the get buffer that stores the header read from the file */
+    getbuf.comm          = ncp->comm;
+    getbuf.collective_fh = ncp->collective_fh;
+    getbuf.get_size      = 0;
+    getbuf.offset        = 0;   /* read from start of the file */
+    getbuf.safe_mode     = ncp->safe_mode;
+    getbuf.whole         = NULL;
+    getbuf.whole_size    = 0;
+    getbuf.in_memory     = 0;
+
+    /* CDF-5's minimum header size is 4 bytes more than CDF-1 and CDF-2's */
+    getbuf.size = _RNDUP( MAX(MIN_NC_XSZ+4, ncp->chunk), X_ALIGN );
+
+    getbuf.base = (void *)NCI_Malloc((size_t)getbuf.size);
+    if (getbuf.base == NULL) DEBUG_RETURN_ERROR(NC_ENOMEM)
+    getbuf.pos  = getbuf.base;
+
+    if (ncp->hdr_bcast_whole)
+        err = hdr_get_NC_bcast_whole(&getbuf, ncp);
+    else {
+        /* Fetch the next header chunk. The chunk is 'gbp->size' bytes big */
+        err = hdr_fetch(&getbuf);
+        if (err == NC_NOERR) err = hdr_get_NC_lists(&getbuf, ncp);
+    }
+
+    ncp->get_size += getbuf.get_size;
+    NCI_Free(getbuf.base);
+
+    if (err != NC_NOERR && err != NC_ENULLPAD) return err;
+    status = err; /* NC_ENULLPAD is a non-fatal error */
 
     /* get the un-aligned size occupied by the file header */
     ncp->xsz = ncmpio_hdr_len_NC(ncp);
@@ -1435,21 +1566,16 @@ ncmpio_hdr_get_NC(NC *ncp)
      * Sets ncp->begin_rec to start of first record variable.
      */
     err = compute_var_shape(ncp);
-    if (err != NC_NOERR) goto fn_exit;
+    if (err != NC_NOERR) return err;
 
     /* Check whether variable sizes are legal for the given file format */
     err = ncmpio_NC_check_vlens(ncp);
-    if (err != NC_NOERR) goto fn_exit;
+    if (err != NC_NOERR) return err;
 
     /* Check whether variable begins are in an increasing order.
      * Adding this check here is necessary for detecting corrupted metadata. */
     err = ncmpio_NC_check_voffs(ncp);
-    if (err != NC_NOERR) goto fn_exit;
-
-fn_exit:
-    ncp->get_size += getbuf.get_size;
-    NCI_Free(getbuf.base);
+    if (err != NC_NOERR) return err;
 
-    return (err == NC_NOERR) ? status : err;
+    return status;
 }
-
@@ -505,8 +505,12 @@ ncmpio_hdr_put_NC(NC *ncp, void *buf)
 int ncmpio_write_header(NC *ncp)
 {
     int rank, status=NC_NOERR, mpireturn, err;
+    double timing=NC_STATS_WTIME(ncp);
     MPI_File fh;
 
+    /* no file access until the pending split-phase wait is ended */
+    if (NC_WAIT_PENDING(ncp)) DEBUG_RETURN_ERROR(NC_EPENDING)
+
     /* Write the entire header to the file. This function may be called from
      * a rename API. In that case, we cannot just change the variable name in
      * the file header, because if the file space occupied by the name shrinks,
@@ -584,6 +588,7 @@ int ncmpio_write_header(NC *ncp)
             DEBUG_RETURN_ERROR(NC_EMPI)
         }
     }
+    NC_STATS_ADD_TIME(ncp, NC_STATS_TIME_HEADER, timing)
 
     return status;
 }
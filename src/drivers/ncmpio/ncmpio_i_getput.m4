@@ -86,7 +86,8 @@ abuf_dealloc(NC *ncp, int abuf_index)
  * variable request
  */
 static int
-add_record_requests(NC_req           *reqs,
+add_record_requests(NC               *ncp,
+                    NC_req           *reqs,
                     const MPI_Offset *stride)
 {
     int    i, j, ndims;
@@ -95,9 +96,9 @@ add_record_requests(NC_req           *reqs,
 
     ndims = reqs[0].varp->ndims;
     if (stride != NULL)
-        dims_chunk = (size_t)ndims * 3 * SIZEOF_MPI_OFFSET;
+        dims_chunk = (size_t)ndims * 3;
     else
-        dims_chunk = (size_t)ndims * 2 * SIZEOF_MPI_OFFSET;
+        dims_chunk = (size_t)ndims * 2;
 
     /* pointers to start[], count[] and stride[] of reqs[0] */
     req0_start  = reqs[0].start;
@@ -115,7 +116,8 @@ add_record_requests(NC_req           *reqs,
                             * below ones, including the ones need malloc
                             */
 
-        reqs[i].start = (MPI_Offset*) NCI_Malloc(dims_chunk);
+        reqs[i].start = ncmpio_arena_alloc(ncp, dims_chunk,
+                                           &reqs[i].arena_chunk);
         reqi_start = reqs[i].start;
         reqi_count = reqi_start + ndims;
 
@@ -149,59 +151,94 @@ add_record_requests(NC_req           *reqs,
     return NC_NOERR;
 }
 
-/*----< ncmpio_igetput_varm() >-----------------------------------------------*/
-int
-ncmpio_igetput_varm(NC               *ncp,
-                    NC_var           *varp,
-                    const MPI_Offset  start[],
-                    const MPI_Offset  count[],
-                    const MPI_Offset  stride[],
-                    const MPI_Offset  imap[],
-                    void             *buf,      /* user buffer */
-                    MPI_Offset        bufcount,
-                    MPI_Datatype      buftype,
-                    int              *reqid,    /* out, can be NULL */
-                    int               reqMode,
-                    int               isSameGroup) /* if part of a varn group */
+/*----< add_request() >------------------------------------------------------*/
+/* Append a new request to the end of pending write or read request list,
+ * expanding the list if it cannot hold add_reqs more requests. The new
+ * request ID is an even number for write and an odd number for read, 2 more
+ * than the last one in the list.
+ */
+static NC_req *
+add_request(NC  *ncp,
+            int  reqMode,
+            int  add_reqs) /* number of requests to be added */
 {
-    void *xbuf=NULL;
-    int i, j, err=NC_NOERR, abuf_index=-1, el_size, buftype_is_contig;
-    int need_convert, need_swap, in_place_swap, need_swap_back_buf=0, free_xbuf=0;
-    MPI_Offset bnelems=0, nbytes;
-    MPI_Datatype ptype, imaptype;
-    NC_req *req;
+    int rem, *num_reqs;
+    size_t req_alloc;
+    NC_req **list, *req;
 
-    /* decode buftype to obtain the followings:
-     * ptype:    element data type (MPI primitive type) in buftype
-     * bufcount: If it is -1, then this is called from a high-level API and in
-     *           this case buftype will be an MPI primitive data type.
-     *           If it is >=0, then this is called from a flexible API.
-     * bnelems:  number of ptypes in user buffer, buf
-     * nbytes:   number of bytes (in external data representation) to read from
-     *           or write to the file
-     * el_size:  byte size of ptype
-     * buftype_is_contig: whether buftype is contiguous
-     */
-    err = ncmpii_buftype_decode(varp->ndims, varp->xtype, count, bufcount,
-                                buftype, &ptype, &el_size, &bnelems,
-                                &nbytes, &buftype_is_contig);
-    if (err != NC_NOERR) return err;
+    if (fIsSet(reqMode, NC_REQ_WR)) {
+        list     = &ncp->put_list;
+        num_reqs = &ncp->numPutReqs;
+    }
+    else {
+        list     = &ncp->get_list;
+        num_reqs = &ncp->numGetReqs;
+    }
 
-#ifndef ENABLE_LARGE_REQ
-    if (nbytes > INT_MAX) DEBUG_RETURN_ERROR(NC_EMAX_REQ)
-#endif
+    /* allocate or expand request array */
+    rem = *num_reqs % NC_REQUEST_CHUNK;
+    req_alloc = *num_reqs;
 
-    if (bnelems == 0) {
-        /* zero-length request, mark this as a NULL request */
-        if (!isSameGroup && reqid != NULL)
-            /* only if this is not part of a group request */
-            *reqid = NC_REQ_NULL;
-        return NC_NOERR;
-    }
+    if (add_reqs > NC_REQUEST_CHUNK)
+        req_alloc += add_reqs;
+    else if (rem == 0)
+        req_alloc += NC_REQUEST_CHUNK;
+    else if (rem + add_reqs > NC_REQUEST_CHUNK)
+        req_alloc += NC_REQUEST_CHUNK - rem + NC_REQUEST_CHUNK;
+    else
+        req_alloc = 0;
 
-    /* check if type conversion and Endianness byte swap is needed */
-    need_convert = ncmpii_need_convert(ncp->format, varp->xtype, ptype);
-    need_swap    = NEED_BYTE_SWAP(varp->xtype, ptype);
+    if (req_alloc > 0)
+        *list = (NC_req*) NCI_Realloc(*list, req_alloc * sizeof(NC_req));
+    req = *list + *num_reqs;
+
+    /* the new request ID will be the max of write/read ID + 2 */
+    req->id = fIsSet(reqMode, NC_REQ_WR) ? 0 : 1;
+    if (*num_reqs > 0)
+        req->id = (*list)[*num_reqs-1].id + 2;
+
+    (*num_reqs)++;
+
+    return req;
+}
+
+/*----< prepare_xbuf() >-----------------------------------------------------*/
+/* Obtain the I/O buffer, xbuf, of nbytes in the external representation for
+ * a request. For a write request, buf is packed, type-converted and
+ * byte-swapped into xbuf, which is a space in the attached buffer for bput
+ * APIs, a buffer from the pool if buf cannot be used in place, or buf
+ * itself. For a read request, the reverse steps are done at the wait call,
+ * and xbuf is buf if neither unpacking nor type conversion is needed. The
+ * NC_REQ_BUF_* bits describing buf are returned in flag.
+ */
+static int
+prepare_xbuf(NC           *ncp,
+             NC_var       *varp,
+             int           reqMode,
+             void         *buf,
+             MPI_Offset    bufcount,
+             MPI_Datatype  buftype,
+             int           buftype_is_contig,
+             MPI_Offset    bnelems,   /* number of ptype in buf */
+             MPI_Datatype  ptype,     /* element data type in buftype */
+             MPI_Datatype  imaptype,  /* MPI_DATATYPE_NULL if not varm */
+             int           need_convert,
+             MPI_Offset    nbytes,
+             void        **xbufp,      /* OUT */
+             int          *abuf_index, /* OUT: -1 if not bput */
+             int          *free_xbuf,  /* OUT: xbuf is from the pool */
+             int          *flag)       /* OUT: NC_REQ_BUF_* bits */
+{
+    void *xbuf;
+    int err=NC_NOERR, need_swap, in_place_swap, need_swap_back_buf=0;
+    double timing;
+
+    *abuf_index = -1;
+    *free_xbuf  = 0;
+    *flag       = 0;
+
+    /* check if Endianness byte swap is needed */
+    need_swap = NEED_BYTE_SWAP(varp->xtype, ptype);
 
     if (fIsSet(ncp->flags, NC_MODE_SWAP_ON))
         in_place_swap = 1;
@@ -214,14 +251,7 @@ ncmpio_igetput_varm(NC               *ncp,
             in_place_swap = 1;
     }
 
-    /* check whether this is a true varm call, if yes, imaptype will be a
-     * newly created MPI derived data type, otherwise MPI_DATATYPE_NULL
-     */
-    err = ncmpii_create_imaptype(varp->ndims, count, imap, ptype, &imaptype);
-    if (err != NC_NOERR) return err;
-
     if (fIsSet(reqMode, NC_REQ_WR)) { /* pack request to xbuf */
-#if 1
         /* when user buf is used as xbuf, we need to byte-swap buf
          * back to its original contents */
         xbuf = buf;
@@ -233,161 +263,32 @@ ncmpio_igetput_varm(NC               *ncp,
              */
             if (ncp->abuf->size_allocated - ncp->abuf->size_used < nbytes)
                 DEBUG_RETURN_ERROR(NC_EINSUFFBUF)
-            err = abuf_malloc(ncp, nbytes, &xbuf, &abuf_index);
+            err = abuf_malloc(ncp, nbytes, &xbuf, abuf_index);
             if (err != NC_NOERR) return err;
             need_swap_back_buf = 0;
         }
-        else {
-            if (!buftype_is_contig || imaptype != MPI_DATATYPE_NULL ||
-                need_convert || (need_swap && in_place_swap == 0)) {
-                xbuf = NCI_Malloc((size_t)nbytes);
-                free_xbuf = 1;
-                if (xbuf == NULL) DEBUG_RETURN_ERROR(NC_ENOMEM)
-                need_swap_back_buf = 0;
-            }
+        else if (!buftype_is_contig || imaptype != MPI_DATATYPE_NULL ||
+                 need_convert || (need_swap && in_place_swap == 0)) {
+            xbuf = ncmpii_pool_malloc(ncp->pool, (size_t)nbytes);
+            if (xbuf == NULL) DEBUG_RETURN_ERROR(NC_ENOMEM)
+            *free_xbuf = 1;
+            need_swap_back_buf = 0;
         }
 
         /* pack user buffer, buf, to xbuf which will be used to write to file */
+        timing = NC_STATS_WTIME(ncp);
         err = ncmpio_pack_xbuf(ncp->format, varp, bufcount, buftype,
                                buftype_is_contig, bnelems, ptype, imaptype,
                                need_convert, need_swap, nbytes, buf, xbuf);
+        NC_STATS_ADD_TIME(ncp, NC_STATS_TIME_PACK, timing)
         if (err != NC_NOERR && err != NC_ERANGE) {
-            if (fIsSet(reqMode, NC_REQ_NBB)) abuf_dealloc(ncp, abuf_index);
-            else                             NCI_Free(xbuf);
+            if (fIsSet(reqMode, NC_REQ_NBB)) abuf_dealloc(ncp, *abuf_index);
+            else if (*free_xbuf)             ncmpii_pool_free(ncp->pool, xbuf);
+            *free_xbuf = 0;
             return err;
         }
-#else
-        void *cbuf=NULL, *lbuf=NULL;
-        int position;
-
-        /* attached buffer allocation logic
-         * if (fIsSet(reqMode, NC_REQ_NBB))
-         *     if contig && no imap && no convert
-         *         buf   ==   lbuf   ==   cbuf    ==     xbuf memcpy-> abuf
-         *                                               abuf
-         *     if contig && no imap &&    convert
-         *         buf   ==   lbuf   ==   cbuf convert-> xbuf == abuf
-         *                                               abuf
-         *     if contig &&    imap && no convert
-         *         buf   ==   lbuf pack-> cbuf    ==     xbuf == abuf
-         *                                abuf
-         *     if contig &&    imap &&    convert
-         *         buf   ==   lbuf pack-> cbuf convert-> xbuf == abuf
-         *                                               abuf
-         *  if noncontig && no imap && no convert
-         *         buf pack-> lbuf   ==   cbuf    ==     xbuf == abuf
-         *                    abuf
-         *  if noncontig && no imap &&    convert
-         *         buf pack-> lbuf   ==   cbuf convert-> xbuf == abuf
-         *                                               abuf
-         *  if noncontig &&    imap && no convert
-         *         buf pack-> lbuf pack-> cbuf    ==     xbuf == abuf
-         *                                abuf
-         *  if noncontig &&    imap &&    convert
-         *         buf pack-> lbuf pack-> cbuf convert-> xbuf == abuf
-         *                                               abuf
-         */
-
-        MPI_Offset ibufsize = bnelems * el_size;
-        if (ibufsize != (int)ibufsize) DEBUG_RETURN_ERROR(NC_EINTOVERFLOW)
-
-        /* Step 1: if buftype is not contiguous, i.e. a noncontiguous MPI
-         * derived datatype, pack buf into a contiguous buffer, lbuf,
-         */
-        if (!buftype_is_contig) { /* buftype is not contiguous */
-            if (imaptype == MPI_DATATYPE_NULL && !need_convert)
-                /* in this case, lbuf will later become xbuf */
-                lbuf = xbuf;
-            else {
-                /* in this case, allocate lbuf and it will be freed before
-                 * constructing xbuf */
-                lbuf = NCI_Malloc((size_t)ibufsize);
-                if (lbuf == NULL) DEBUG_RETURN_ERROR(NC_ENOMEM)
-            }
-
-            /* pack buf into lbuf based on buftype */
-            if (bufcount > INT_MAX) DEBUG_RETURN_ERROR(NC_EINTOVERFLOW)
-            position = 0;
-            MPI_Pack(buf, (int)bufcount, buftype, lbuf, (int)ibufsize,
-                     &position, MPI_COMM_SELF);
-        }
-        else /* for contiguous case, we reuse buf */
-            lbuf = buf;
-
-        /* Step 2: if imap is non-contiguous, pack lbuf to cbuf */
-        if (imaptype != MPI_DATATYPE_NULL) { /* true varm */
-            if (!need_convert)
-                /* in this case, cbuf will later become xbuf */
-                cbuf = xbuf;
-            else {
-                /* in this case, allocate cbuf and cbuf will be freed before
-                 * constructing xbuf */
-                cbuf = NCI_Malloc((size_t)ibufsize);
-                if (cbuf == NULL) DEBUG_RETURN_ERROR(NC_ENOMEM)
-            }
-
-            /* pack lbuf to cbuf based on imaptype */
-            position = 0;
-            MPI_Pack(lbuf, 1, imaptype, cbuf, (int)ibufsize, &position,
-                     MPI_COMM_SELF);
-            MPI_Type_free(&imaptype);
-
-            /* lbuf is no longer needed */
-            if (lbuf != buf) NCI_Free(lbuf);
-        }
-        else /* not a true varm call: reuse lbuf */
-            cbuf = lbuf;
-
-        /* Step 3: type-convert and byte-swap cbuf to xbuf, and xbuf will be
-         * used in MPI write function to write to file
-         */
-        if (need_convert) {
-            /* user buf type does not match nc var type defined in file */
-            void *fillp; /* fill value in internal representation */
-
-            /* find the fill value */
-            fillp = NCI_Malloc((size_t)varp->xsz);
-            ncmpio_inq_var_fill(varp, fillp);
-
-            /* datatype conversion + byte-swap from cbuf to xbuf */
-            DATATYPE_PUT_CONVERT(ncp->format, varp->xtype, xbuf, cbuf, bnelems,
-                                 ptype, fillp, err)
-            NCI_Free(fillp);
-
-            /* The only error codes returned from DATATYPE_PUT_CONVERT are
-             * NC_EBADTYPE or NC_ERANGE. Bad varp->xtype and itype have been
-             * sanity checked at the dispatchers, so NC_EBADTYPE is not
-             * possible. Thus, the only possible error is NC_ERANGE.
-             * NC_ERANGE can be caused by one or more elements of buf that is
-             * out of range representable by the external data type, it is not
-             * considered a fatal error. The request must continue to finish.
-             */
-            if (cbuf != buf) NCI_Free(cbuf);
-#if 0
-            if (err != NC_NOERR && err != NC_ERANGE) {
-                if (fIsSet(reqMode, NC_REQ_NBB)) abuf_dealloc(ncp, abuf_index);
-                else                             NCI_Free(xbuf);
-                return err;
-            }
-#endif
-        }
-        else {
-/*
-            if (xbuf == NULL) xbuf = cbuf;
-            else if (cbuf == buf) memcpy(xbuf, cbuf, (size_t)nbytes);
-*/
-            if (cbuf == buf && xbuf != buf) memcpy(xbuf, cbuf, (size_t)nbytes);
-
-            if (need_swap) {
-                /* perform array in-place byte swap on xbuf */
-                ncmpii_in_swapn(xbuf, bnelems, varp->xsz);
-
-                if (xbuf == buf) need_swap_back_buf = 1;
-                /* when user buf is used as xbuf, we need to byte-swap buf
-                 * back to its original contents */
-            }
-        }
-#endif
+        /* NC_ERANGE is not fatal, the request must continue to finish */
+        if (need_swap && need_swap_back_buf) fSet(*flag, NC_REQ_BUF_BYTE_SWAP);
     }
     else { /* read request */
         /* Type conversion and byte swap for read are done at wait call, we
@@ -396,79 +297,97 @@ ncmpio_igetput_varm(NC               *ncp,
         if (buftype_is_contig && imaptype == MPI_DATATYPE_NULL && !need_convert)
             xbuf = buf;  /* there is no buffered read (bget_var, etc.) */
         else {
-            xbuf = NCI_Malloc((size_t)nbytes);
-            free_xbuf = 1;
+            xbuf = ncmpii_pool_malloc(ncp->pool, (size_t)nbytes);
+            if (xbuf == NULL) DEBUG_RETURN_ERROR(NC_ENOMEM)
+            *free_xbuf = 1;
         }
+        if (need_swap) fSet(*flag, NC_REQ_BUF_BYTE_SWAP);
     }
 
-    if (fIsSet(reqMode, NC_REQ_WR)) {
-        /* allocate or expand write request array */
-        int add_reqs = IS_RECVAR(varp) ? (int)count[0] : 1;
-        int rem = ncp->numPutReqs % NC_REQUEST_CHUNK;
-        size_t req_alloc = ncp->numPutReqs;
-
-        if (add_reqs > NC_REQUEST_CHUNK)
-            req_alloc += add_reqs;
-        else if (rem == 0)
-            req_alloc += NC_REQUEST_CHUNK;
-        else if (rem + add_reqs > NC_REQUEST_CHUNK)
-            req_alloc += NC_REQUEST_CHUNK - rem + NC_REQUEST_CHUNK;
-        else
-            req_alloc = 0;
+    if (buftype_is_contig) fSet(*flag, NC_REQ_BUF_TYPE_IS_CONTIG);
+    if (need_convert)      fSet(*flag, NC_REQ_BUF_TYPE_CONVERT);
 
-        if (req_alloc > 0)
-            ncp->put_list = (NC_req*) NCI_Realloc(ncp->put_list,
-                                                  req_alloc * sizeof(NC_req));
-        req = ncp->put_list + ncp->numPutReqs;
+    *xbufp = xbuf;
+    return err;
+}
 
-        /* the new request ID will be an even number (max of write ID + 2) */
-        req->id = 0;
-        if (ncp->numPutReqs > 0)
-            req->id = ncp->put_list[ncp->numPutReqs-1].id + 2;
+/*----< ncmpio_igetput_varm() >-----------------------------------------------*/
+int
+ncmpio_igetput_varm(NC               *ncp,
+                    NC_var           *varp,
+                    const MPI_Offset  start[],
+                    const MPI_Offset  count[],
+                    const MPI_Offset  stride[],
+                    const MPI_Offset  imap[],
+                    void             *buf,      /* user buffer */
+                    MPI_Offset        bufcount,
+                    MPI_Datatype      buftype,
+                    int              *reqid,    /* out, can be NULL */
+                    int               reqMode,
+                    int               isSameGroup) /* if part of a varn group */
+{
+    void *xbuf=NULL;
+    int i, j, err=NC_NOERR, abuf_index=-1, el_size, buftype_is_contig;
+    int need_convert, free_xbuf=0, xflag;
+    MPI_Offset bnelems=0, nbytes;
+    MPI_Datatype ptype, imaptype;
+    NC_req *req;
 
-        ncp->numPutReqs++;
+    /* decode buftype to obtain the followings:
+     * ptype:    element data type (MPI primitive type) in buftype
+     * bufcount: If it is -1, then this is called from a high-level API and in
+     *           this case buftype will be an MPI primitive data type.
+     *           If it is >=0, then this is called from a flexible API.
+     * bnelems:  number of ptypes in user buffer, buf
+     * nbytes:   number of bytes (in external data representation) to read from
+     *           or write to the file
+     * el_size:  byte size of ptype
+     * buftype_is_contig: whether buftype is contiguous
+     */
+    err = ncmpii_buftype_decode(varp->ndims, varp->xtype, count, bufcount,
+                                buftype, &ptype, &el_size, &bnelems,
+                                &nbytes, &buftype_is_contig);
+    if (err != NC_NOERR) return err;
+
+#ifndef ENABLE_LARGE_REQ
+    if (nbytes > INT_MAX) DEBUG_RETURN_ERROR(NC_EMAX_REQ)
+#endif
+
+    if (bnelems == 0) {
+        /* zero-length request, mark this as a NULL request */
+        if (!isSameGroup && reqid != NULL)
+            /* only if this is not part of a group request */
+            *reqid = NC_REQ_NULL;
+        return NC_NOERR;
     }
-    else {  /* read request */
-        /* allocate or expand read request array */
-        int add_reqs = IS_RECVAR(varp) ? (int)count[0] : 1;
-        int rem = ncp->numGetReqs % NC_REQUEST_CHUNK;
-        size_t req_alloc = ncp->numGetReqs;
-
-        if (add_reqs > NC_REQUEST_CHUNK)
-            req_alloc += add_reqs;
-        else if (rem == 0)
-            req_alloc += NC_REQUEST_CHUNK;
-        else if (rem + add_reqs > NC_REQUEST_CHUNK)
-            req_alloc += NC_REQUEST_CHUNK - rem + NC_REQUEST_CHUNK;
-        else
-            req_alloc = 0;
 
-        if (req_alloc > 0)
-            ncp->get_list = (NC_req*) NCI_Realloc(ncp->get_list,
-                                                  req_alloc * sizeof(NC_req));
-        req = ncp->get_list + ncp->numGetReqs;
+    /* check if type conversion is needed */
+    need_convert = ncmpii_need_convert(ncp->format, varp->xtype, ptype);
 
-        /* the new request ID will be an odd number (max of read ID + 2) */
-        req->id = 1;
-        if (ncp->numGetReqs > 0)
-            req->id = ncp->get_list[ncp->numGetReqs-1].id + 2;
+    /* check whether this is a true varm call, if yes, imaptype will be a
+     * newly created MPI derived data type, otherwise MPI_DATATYPE_NULL
+     */
+    err = ncmpii_create_imaptype(varp->ndims, count, imap, ptype, &imaptype);
+    if (err != NC_NOERR) return err;
 
-        ncp->numGetReqs++;
+    /* obtain xbuf and, for write, pack buf into it */
+    err = prepare_xbuf(ncp, varp, reqMode, buf, bufcount, buftype,
+                       buftype_is_contig, bnelems, ptype, imaptype,
+                       need_convert, nbytes, &xbuf, &abuf_index, &free_xbuf,
+                       &xflag);
+    if (err != NC_NOERR && err != NC_ERANGE) {
+        if (imaptype != MPI_DATATYPE_NULL) MPI_Type_free(&imaptype);
+        return err;
     }
 
+    /* a request to more than one record is split into one per record */
+    req = add_request(ncp, reqMode, IS_RECVAR(varp) ? (int)count[0] : 1);
+
     /* if isSameGroup, then this request is from i_varn API */
     if (isSameGroup && reqid != NULL)
         req->id = *reqid;
 
-    req->flag = 0;
-    if (buftype_is_contig)  fSet(req->flag, NC_REQ_BUF_TYPE_IS_CONTIG);
-    if (need_convert)       fSet(req->flag, NC_REQ_BUF_TYPE_CONVERT);
-    if (fIsSet(reqMode, NC_REQ_WR)) {
-        if (need_swap_back_buf) fSet(req->flag, NC_REQ_BUF_BYTE_SWAP);
-    }
-    else {
-        if (need_swap) fSet(req->flag, NC_REQ_BUF_BYTE_SWAP);
-    }
+    req->flag = xflag;
 
     req->varp        = varp;
     req->buf         = buf;
@@ -479,6 +398,8 @@ ncmpio_igetput_varm(NC               *ncp,
     req->abuf_index  = abuf_index;
     req->userBuf     = NULL;
     req->status      = NULL;
+    req->varn_num    = 0;
+    req->filetype    = MPI_DATATYPE_NULL;
 
     /* for read requst and buftype is not contiguous, we duplicate buftype for
      * later in the wait call to unpack buffer based on buftype
@@ -488,11 +409,13 @@ ncmpio_igetput_varm(NC               *ncp,
     else
         req->buftype = MPI_DATATYPE_NULL;
 
-    /* allocate a single array to store start/count/stride */
+    /* carve a single array out of the arena to store start/count/stride */
     if (stride != NULL)
-        req->start = (MPI_Offset*) NCI_Malloc(varp->ndims*3*SIZEOF_MPI_OFFSET);
+        req->start = ncmpio_arena_alloc(ncp, (size_t)varp->ndims*3,
+                                        &req->arena_chunk);
     else {
-        req->start = (MPI_Offset*) NCI_Malloc(varp->ndims*2*SIZEOF_MPI_OFFSET);
+        req->start = ncmpio_arena_alloc(ncp, (size_t)varp->ndims*2,
+                                        &req->arena_chunk);
         fSet(req->flag, NC_REQ_STRIDE_NULL);
     }
 
@@ -514,7 +437,7 @@ ncmpio_igetput_varm(NC               *ncp,
          */
 
         /* add (count[0]-1) number of (sub)requests */
-        add_record_requests(req, stride);
+        add_record_requests(ncp, req, stride);
 
         if (fIsSet(reqMode, NC_REQ_WR)) ncp->numPutReqs += count[0] - 1;
         else                            ncp->numGetReqs += count[0] - 1;
@@ -532,6 +455,167 @@ ncmpio_igetput_varm(NC               *ncp,
     return err;
 }
 
+/*----< ncmpio_igetput_varn() >-----------------------------------------------*/
+/* Post the subarrays of a varn API as a single nonblocking request. buf is
+ * contiguous and contains bnelems elements of ptype, for the subarrays one
+ * after another. Only the starts and counts are kept in the request, and the
+ * file offset-length pairs of all subarrays are generated into one sorted
+ * list at the wait call. Unlike ncmpio_igetput_varm(), subarrays accessing
+ * more than one record are not split into a request per record.
+ */
+int
+ncmpio_igetput_varn(NC                *ncp,
+                    NC_var            *varp,
+                    int                num,
+                    MPI_Offset* const *starts,  /* [num][varp->ndims] */
+                    MPI_Offset* const *counts,  /* [num][varp->ndims] */
+                    void              *buf,
+                    MPI_Offset         bnelems, /* number of ptype in buf */
+                    MPI_Datatype       ptype,   /* MPI primitive type */
+                    int               *reqid,   /* out, can be NULL */
+                    int                reqMode)
+{
+    void *xbuf=NULL;
+    int i, j, k, ndims, varn_num, err=NC_NOERR, abuf_index=-1;
+    int need_convert, free_xbuf=0, xflag;
+    MPI_Offset nbytes, *req_counts;
+    NC_req *req;
+
+    if (reqid != NULL) *reqid = NC_REQ_NULL;
+
+    /* count the subarrays of nonzero length */
+    ndims = varp->ndims;
+    for (varn_num=0, i=0; i<num; i++) {
+        MPI_Offset len=1;
+        for (j=0; j<ndims; j++) len *= counts[i][j];
+        if (len > 0) varn_num++;
+    }
+
+    /* zero-length request, mark this as a NULL request */
+    if (varn_num == 0 || bnelems == 0) return NC_NOERR;
+
+    nbytes = bnelems * varp->xsz;
+#ifndef ENABLE_LARGE_REQ
+    if (nbytes > INT_MAX) DEBUG_RETURN_ERROR(NC_EMAX_REQ)
+#endif
+
+    /* obtain xbuf and, for write, pack buf into it */
+    need_convert = ncmpii_need_convert(ncp->format, varp->xtype, ptype);
+    err = prepare_xbuf(ncp, varp, reqMode, buf, bnelems, ptype, 1, bnelems,
+                       ptype, MPI_DATATYPE_NULL, need_convert, nbytes, &xbuf,
+                       &abuf_index, &free_xbuf, &xflag);
+    if (err != NC_NOERR && err != NC_ERANGE) return err;
+
+    req = add_request(ncp, reqMode, 1);
+
+    req->flag = xflag;
+    fSet(req->flag, NC_REQ_LEAD);
+    fSet(req->flag, NC_REQ_VARN);
+    fSet(req->flag, NC_REQ_STRIDE_NULL);
+    if (free_xbuf) fSet(req->flag, NC_REQ_XBUF_TO_BE_FREED);
+
+    req->varp        = varp;
+    req->buf         = buf;
+    req->xbuf        = xbuf;
+    req->bufcount    = bnelems;
+    req->buftype     = MPI_DATATYPE_NULL;
+    req->ptype       = ptype;
+    req->imaptype    = MPI_DATATYPE_NULL;
+    req->abuf_index  = abuf_index;
+    req->userBuf     = NULL;
+    req->status      = NULL;
+    req->varn_num    = varn_num;
+    req->filetype    = MPI_DATATYPE_NULL;
+
+    /* carve a single array out of the arena to store all starts, followed by
+     * all counts */
+    req->start = ncmpio_arena_alloc(ncp, (size_t)varn_num * ndims * 2,
+                                    &req->arena_chunk);
+    req_counts = req->start + (size_t)varn_num * ndims;
+    for (k=0, i=0; i<num; i++) {
+        MPI_Offset len=1;
+        for (j=0; j<ndims; j++) len *= counts[i][j];
+        if (len == 0) continue;
+        for (j=0; j<ndims; j++) {
+            req->start[k*ndims + j] = starts[i][j];
+            req_counts[k*ndims + j] = counts[i][j];
+        }
+        k++;
+    }
+
+    /* return the request ID */
+    if (reqid != NULL) *reqid = req->id;
+
+    return err;
+}
+
+/*----< ncmpio_igetput_vard() >-----------------------------------------------*/
+/* Post the filetype of a vard API as a nonblocking request. buf is contiguous
+ * and contains bnelems elements of the variable's type, as no type conversion
+ * is done for vard APIs. A duplicate of filetype is kept in the request, to
+ * be rebased at varp->begin and concatenated with the other requests at the
+ * wait call.
+ */
+int
+ncmpio_igetput_vard(NC           *ncp,
+                    NC_var       *varp,
+                    MPI_Datatype  filetype, /* access layout in the file */
+                    void         *buf,
+                    MPI_Offset    bnelems,  /* number of elements in buf */
+                    int          *reqid,    /* out, can be NULL */
+                    int           reqMode)
+{
+    void *xbuf=NULL;
+    int err=NC_NOERR, abuf_index=-1, free_xbuf=0, xflag;
+    MPI_Offset nbytes;
+    MPI_Datatype ptype;
+    NC_req *req;
+
+    if (reqid != NULL) *reqid = NC_REQ_NULL;
+
+    /* zero-length request, mark this as a NULL request */
+    if (bnelems == 0) return NC_NOERR;
+
+    nbytes = bnelems * varp->xsz;
+    ptype  = ncmpii_nc2mpitype(varp->xtype);
+
+    /* obtain xbuf and, for write, copy and byte-swap buf into it. No type
+     * conversion is done for vard APIs */
+    err = prepare_xbuf(ncp, varp, reqMode, buf, bnelems, ptype, 1, bnelems,
+                       ptype, MPI_DATATYPE_NULL, 0, nbytes, &xbuf,
+                       &abuf_index, &free_xbuf, &xflag);
+    if (err != NC_NOERR) return err;
+
+    req = add_request(ncp, reqMode, 1);
+
+    req->flag = xflag;
+    fSet(req->flag, NC_REQ_LEAD);
+    fSet(req->flag, NC_REQ_VARD);
+    if (free_xbuf) fSet(req->flag, NC_REQ_XBUF_TO_BE_FREED);
+
+    req->varp        = varp;
+    req->buf         = buf;
+    req->xbuf        = xbuf;
+    req->bufcount    = bnelems;
+    req->buftype     = MPI_DATATYPE_NULL;
+    req->ptype       = ptype;
+    req->imaptype    = MPI_DATATYPE_NULL;
+    req->abuf_index  = abuf_index;
+    req->userBuf     = NULL;
+    req->status      = NULL;
+    req->varn_num    = 0;
+    req->start       = NULL;
+    req->arena_chunk = -1;
+
+    /* filetype may be freed by the user before the wait call */
+    MPI_Type_dup(filetype, &req->filetype);
+
+    /* return the request ID */
+    if (reqid != NULL) *reqid = req->id;
+
+    return NC_NOERR;
+}
+
 include(`utils.m4')dnl
 dnl
 dnl IGETPUT_API(get/put)
@@ -572,6 +656,10 @@ ncmpio_i$1_var(void             *ncdp,
 
     /* Note sanity check for ncdp and varid has been done in dispatchers */
 
+    if (ncp->stats != NULL)
+        ncmpio_stats_add_vars(ncp, ncp->vars.value[varid], count, stride,
+                              imap, reqMode);
+
     return ncmpio_igetput_varm(ncp, ncp->vars.value[varid], start, count,
                                stride, imap, (void*)buf, bufcount, buftype,
                                reqid, reqMode, 0);
@@ -37,11 +37,10 @@ dnl
 #include "ncmpio_NC.h"
 
 /*----< igetput_varn() >-----------------------------------------------------*/
-/* The current implementation for nonlocking varn APIs is to make num calls
- * to iget/iput APIs, although an alternative is to flatten each start-count
- * request into a list of offset-length pairs and concatenate all lists into
- * a hindexed data type. All nonblocking requests posted by igetput_varn()
- * share the same request ID.
+/* The user buffer is packed into a contiguous one, if it is noncontiguous,
+ * and all start-count subarrays are posted as a single nonblocking request,
+ * whose offset-length pairs are generated into one sorted list at the wait
+ * call.
  */
 static int
 igetput_varn(NC                *ncp,
@@ -55,11 +54,10 @@ igetput_varn(NC                *ncp,
              int               *reqidp,    /* OUT: request ID */
              int                reqMode)
 {
-    int i, j, el_size, status=NC_NOERR, free_cbuf=0, isSameGroup, reqid;
+    int i, j, el_size, status=NC_NOERR, free_cbuf=0, reqid;
     int leadIndx;
     void *cbuf=NULL;
-    char *bufp;
-    MPI_Offset **_counts=NULL;
+    MPI_Offset **_counts=NULL, bnelems=0;
     MPI_Datatype ptype;
 
     if (fIsSet(reqMode, NC_REQ_NBB) && ncp->abuf == NULL)
@@ -159,29 +157,24 @@ igetput_varn(NC                *ncp,
     /* obtain the ID of new request to be created */
     leadIndx = fIsSet(reqMode, NC_REQ_RD) ? ncp->numGetReqs : ncp->numPutReqs;
 
-    /* break buf into num pieces */
-    reqid = NC_REQ_NULL;
-    isSameGroup=0;
-    bufp = (char*)cbuf;
+    /* total number of elements of all subarrays */
     for (i=0; i<num; i++) {
         MPI_Offset buflen=1;
         for (j=0; j<varp->ndims; j++)
             buflen *= _counts[i][j];
-
-        if (buflen == 0) continue;
-        status = ncmpio_igetput_varm(ncp, varp, starts[i], _counts[i], NULL,
-                                     NULL, bufp, buflen, ptype, &reqid,
-                                     reqMode, isSameGroup);
-        if (status != NC_NOERR) goto err_check;
-
-        /* use isSamegroup so we end up with one nonblocking request (only the
-         * first request gets a request ID back, the rest reuse the same ID.
-         * This single ID represents num nonblocking requests */
-        isSameGroup=1;
-        bufp += buflen * el_size;
+        bnelems += buflen;
     }
 
-    if (free_cbuf) { /* cbuf != buf, cbuf is temp allocated */
+    /* post a single request for all subarrays */
+    reqid = NC_REQ_NULL;
+    status = ncmpio_igetput_varn(ncp, varp, num, starts, _counts, cbuf,
+                                 bnelems, ptype, &reqid, reqMode);
+    if (status != NC_NOERR) goto err_check;
+
+    if (reqid == NC_REQ_NULL) { /* zero-length request */
+        if (free_cbuf) NCI_Free(cbuf);
+    }
+    else if (free_cbuf) { /* cbuf != buf, cbuf is temp allocated */
         if (fIsSet(reqMode, NC_REQ_RD)) {
             /* first lead request must unpack cbuf to buf and free cbuf at
              * wait()
@@ -253,6 +246,10 @@ ncmpio_$1_varn(void               *ncdp,
 
     /* Note sanity check for ncdp and varid has been done in dispatchers */
 
+    if (ncp->stats != NULL)
+        ncmpio_stats_add_varn(ncp, ncp->vars.value[varid], num, counts,
+                              reqMode);
+
     return igetput_varn(ncp, ncp->vars.value[varid], num, starts, counts,
                         (void*)buf, bufcount, buftype, reqid, reqMode);
 }
@@ -0,0 +1,369 @@
+/*
+ *  Copyright (C) 2018, Northwestern University and Argonne National Laboratory
+ *  See COPYRIGHT notice in top-level directory.
+ */
+/* $Id$ */
+
+/*
+ * This file implements the intra-node aggregation of collective requests,
+ * enabled by setting hint nc_intra_node_aggr to enable.
+ *
+ * Processes running on the same compute node are grouped into a communicator
+ * by calling MPI_Comm_split_type with MPI_COMM_TYPE_SHARED. The process of
+ * rank 0 in the group is the node leader. At each collective wait call,
+ *   1. every process flattens its pending requests into a sorted list of
+ *      offset-length pairs and stores the list, together with the write data,
+ *      in its portion of an MPI-3 shared memory window,
+ *   2. the node leader reads the lists of all processes on the node directly
+ *      from the window, sorts and coalesces them into a list of contiguous
+ *      file regions and packs (for write) the data into a staging buffer,
+ *   3. only the node leaders access the file with non-zero amount of data,
+ *      other processes participate the MPI collective I/O with zero-length
+ *      requests,
+ *   4. for read, the leader copies the data from its staging buffer back to
+ *      the window, from which each process copies the data to its own buffer.
+ * As a result, the number of processes making file requests is reduced to
+ * the number of compute nodes, and each request is larger and less
+ * fragmented, which benefits workloads with many small requests.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h> /* memcpy() */
+#include <limits.h> /* INT_MAX */
+
+#include <mpi.h>
+
+#include <pnc_debug.h>
+#include <common.h>
+#include "ncmpio_NC.h"
+
+#if MPI_VERSION >= 3
+/* an offset-length pair collected by the node leader */
+typedef struct {
+    MPI_Offset  off;   /* starting file offset */
+    MPI_Offset  len;   /* length in bytes */
+    MPI_Offset  spos;  /* position in the leader's staging buffer */
+    char       *ptr;   /* data location in the shared memory window */
+} node_seg;
+
+/*----< node_seg_compare() >-------------------------------------------------*/
+/* used for sorting the offsets of the node_seg array */
+static int
+node_seg_compare(const void *a, const void *b)
+{
+    if (((node_seg*)a)->off > ((node_seg*)b)->off) return  1;
+    if (((node_seg*)a)->off < ((node_seg*)b)->off) return -1;
+    return 0;
+}
+
+/*----< leader_collect() >---------------------------------------------------*/
+/* Called by the node leader only. Collect the offset-length pairs of all
+ * processes on the node from the shared memory window, sort them, and
+ * calculate their positions in a staging buffer that stores the data of all
+ * pairs contiguously, with overlapped regions stored only once. Contiguous
+ * file regions are returned in *filetype, a committed derived data type to be
+ * freed by the caller (MPI_BYTE if there is no data at all).
+ */
+static int
+leader_collect(MPI_Win        win,
+               int            node_size,
+               MPI_Offset    *nents,     /* OUT: number of pairs */
+               node_seg     **ents,      /* OUT: [*nents] pairs */
+               MPI_Offset    *total,     /* OUT: staging buffer size */
+               MPI_Datatype  *filetype)  /* OUT: file regions */
+{
+    int r, j, disp_unit, mpireturn, *blocklengths;
+    MPI_Aint win_size, *displacements;
+    MPI_Offset i, k, n, nblks, run_off=0, run_end=0, run_spos=0, *meta;
+    char *data;
+
+    *nents    = 0;
+    *ents     = NULL;
+    *total    = 0;
+    *filetype = MPI_BYTE;
+
+    /* count the number of pairs of all processes on this node */
+    for (r=0; r<node_size; r++) {
+        MPI_Win_shared_query(win, r, &win_size, &disp_unit, &meta);
+        *nents += meta[0];
+    }
+    if (*nents == 0) return NC_NOERR;
+
+    *ents = (node_seg*) NCI_Malloc((size_t)(*nents) * sizeof(node_seg));
+
+    for (k=0,r=0; r<node_size; r++) {
+        MPI_Win_shared_query(win, r, &win_size, &disp_unit, &meta);
+        n = meta[0];
+        data = (char*)(meta + 1 + 2 * n);
+        for (i=0; i<n; i++, k++) {
+            (*ents)[k].off = meta[1 + 2*i];
+            (*ents)[k].len = meta[2 + 2*i];
+            (*ents)[k].ptr = data;
+            data += (*ents)[k].len;
+        }
+    }
+
+    /* pairs of each process are sorted, but not those across processes */
+    if (node_size > 1)
+        qsort(*ents, (size_t)(*nents), sizeof(node_seg), node_seg_compare);
+
+    /* coalesce overlapped and adjacent pairs into contiguous runs, and
+     * calculate the staging buffer position of each pair. A run longer than
+     * INT_MAX is stored in multiple blocks of the filetype, as block lengths
+     * of a derived data type are int. nblks is the number of blocks.
+     */
+    nblks = 0;
+    for (k=0; k<*nents; k++) {
+        MPI_Offset end = (*ents)[k].off + (*ents)[k].len;
+        if (k == 0 || (*ents)[k].off > run_end) { /* start a new run */
+            if (k > 0) nblks += (run_end - run_off + INT_MAX - 1) / INT_MAX;
+            run_off  = (*ents)[k].off;
+            run_end  = end;
+            run_spos = *total;
+            *total  += (*ents)[k].len;
+        }
+        else if (end > run_end) { /* extend the current run */
+            *total += end - run_end;
+            run_end = end;
+        }
+        (*ents)[k].spos = run_spos + (*ents)[k].off - run_off;
+    }
+    nblks += (run_end - run_off + INT_MAX - 1) / INT_MAX;
+    if (nblks > INT_MAX) DEBUG_RETURN_ERROR(NC_EINTOVERFLOW)
+
+    blocklengths  = (int*)      NCI_Malloc((size_t)nblks * SIZEOF_INT);
+    displacements = (MPI_Aint*) NCI_Malloc((size_t)nblks * SIZEOF_MPI_AINT);
+
+    j = 0;
+    run_off = (*ents)[0].off;
+    run_end = run_off + (*ents)[0].len;
+    for (k=1; k<=*nents; k++) {
+        if (k < *nents && (*ents)[k].off <= run_end) { /* extend the run */
+            MPI_Offset end = (*ents)[k].off + (*ents)[k].len;
+            if (end > run_end) run_end = end;
+            continue;
+        }
+        /* store the current run in blocks of at most INT_MAX bytes */
+        while (run_off < run_end) {
+            blocklengths[j]  = (int) MIN(run_end - run_off, INT_MAX);
+            displacements[j] = (MPI_Aint) run_off;
+            run_off += blocklengths[j++];
+        }
+        if (k < *nents) { /* start a new run */
+            run_off = (*ents)[k].off;
+            run_end = run_off + (*ents)[k].len;
+        }
+    }
+
+#ifdef HAVE_MPI_TYPE_CREATE_HINDEXED
+    mpireturn = MPI_Type_create_hindexed(j, blocklengths, displacements,
+                                         MPI_BYTE, filetype);
+#else
+    mpireturn = MPI_Type_hindexed(j, blocklengths, displacements, MPI_BYTE,
+                                  filetype);
+#endif
+    NCI_Free(displacements);
+    NCI_Free(blocklengths);
+
+    if (mpireturn != MPI_SUCCESS) {
+        *filetype = MPI_BYTE;
+        return ncmpii_error_mpi2nc(mpireturn, "MPI_Type_create_hindexed");
+    }
+    MPI_Type_commit(filetype);
+
+    return NC_NOERR;
+}
+#endif
+
+/*----< ncmpio_intra_node_aggr() >--------------------------------------------*/
+/* Carry out a collective read or write of the offset-length pairs, segs[],
+ * by aggregating the pairs of all processes on the same compute node to the
+ * node leader. segs[] must be sorted in an increasing order of file offsets
+ * and must not overlap with each other. segs[].buf_addr are the addresses
+ * relative to buf. nsegs can be zero, in which case this process only
+ * participates the collective calls.
+ *
+ * This function is collective.
+ */
+int
+ncmpio_intra_node_aggr(NC         *ncp,
+                       int         rw_flag,  /* NC_REQ_WR or NC_REQ_RD */
+                       MPI_Offset  nsegs,    /* number of off-len pairs */
+                       off_len    *segs,     /* [nsegs] sorted, non-overlapped */
+                       void       *buf)      /* base of segs[].buf_addr */
+{
+#if MPI_VERSION >= 3
+    int node_rank, node_size, mpireturn, err, status=NC_NOERR;
+    int io_status=NC_NOERR;
+    char *data, *staging=NULL;
+    MPI_Aint win_size;
+    MPI_Offset k, r, nrounds, nents=0, total=0, offset, my_bytes=0, *meta;
+    MPI_Datatype filetype=MPI_BYTE;
+    MPI_Status mpistatus;
+    MPI_File fh=ncp->collective_fh;
+    MPI_Win win;
+    node_seg *ents=NULL;
+
+    /* create the intra-node communicator at the first time it is used */
+    if (ncp->node_comm == MPI_COMM_NULL) {
+        int rank;
+        MPI_Comm_rank(ncp->comm, &rank);
+        TRACE_COMM(MPI_Comm_split_type)(ncp->comm, MPI_COMM_TYPE_SHARED, rank,
+                                        MPI_INFO_NULL, &ncp->node_comm);
+        if (mpireturn != MPI_SUCCESS)
+            return ncmpii_error_mpi2nc(mpireturn, "MPI_Comm_split_type");
+    }
+    MPI_Comm_rank(ncp->node_comm, &node_rank);
+    MPI_Comm_size(ncp->node_comm, &node_size);
+
+    for (k=0; k<nsegs; k++) my_bytes += segs[k].len;
+
+    /* window layout: number of pairs, the off-len pairs, and the data. The
+     * size is rounded up, so the portion of next process is aligned */
+    win_size = (MPI_Aint)((1 + 2 * nsegs) * SIZEOF_MPI_OFFSET + my_bytes);
+    win_size = (win_size + SIZEOF_MPI_OFFSET - 1) / SIZEOF_MPI_OFFSET
+             * SIZEOF_MPI_OFFSET;
+    TRACE_COMM(MPI_Win_allocate_shared)(win_size, 1, MPI_INFO_NULL,
+                                        ncp->node_comm, &meta, &win);
+    if (mpireturn != MPI_SUCCESS)
+        return ncmpii_error_mpi2nc(mpireturn, "MPI_Win_allocate_shared");
+
+    MPI_Win_lock_all(MPI_MODE_NOCHECK, win);
+
+    /* store this process's pairs and write data in the window */
+    meta[0] = nsegs;
+    data = (char*)(meta + 1 + 2 * nsegs);
+    for (k=0; k<nsegs; k++) {
+        meta[1 + 2*k] = segs[k].off;
+        meta[2 + 2*k] = segs[k].len;
+        if (rw_flag == NC_REQ_WR)
+            memcpy(data, (char*)buf + segs[k].buf_addr, (size_t)segs[k].len);
+        data += segs[k].len;
+    }
+    MPI_Win_sync(win);
+    TRACE_COMM(MPI_Barrier)(ncp->node_comm);
+    MPI_Win_sync(win);
+
+    if (node_rank == 0) {
+        status = leader_collect(win, node_size, &nents, &ents, &total,
+                                &filetype);
+        if (status != NC_NOERR) {
+            /* still participate the collective I/O with zero length */
+            if (filetype != MPI_BYTE) MPI_Type_free(&filetype);
+            filetype = MPI_BYTE;
+            if (ents != NULL) NCI_Free(ents);
+            ents  = NULL;
+            nents = 0;
+            total = 0;
+        }
+
+        if (total > 0) {
+            staging = (char*) NCI_Malloc((size_t)total);
+            if (rw_flag == NC_REQ_WR) {
+                /* pack the write data of all processes into staging */
+                for (k=0; k<nents; k++)
+                    memcpy(staging + ents[k].spos, ents[k].ptr,
+                           (size_t)ents[k].len);
+            }
+        }
+    }
+
+    /* only node leaders have data to access, set the fileview */
+    offset = 0;
+    err = ncmpio_file_set_view(ncp, fh, &offset, filetype);
+    if (err != NC_NOERR) {
+        if (status == NC_NOERR) status = err;
+        total = 0;
+    }
+    if (filetype != MPI_BYTE) MPI_Type_free(&filetype);
+
+    /* the staging buffer is accessed in pieces of at most INT_MAX bytes, as
+     * the count argument of MPI-IO is int. All processes must agree on the
+     * number of collective calls */
+    nrounds = (total + INT_MAX - 1) / INT_MAX;
+    TRACE_COMM(MPI_Allreduce)(MPI_IN_PLACE, &nrounds, 1, MPI_OFFSET, MPI_MAX,
+                              ncp->comm);
+    if (mpireturn != MPI_SUCCESS) {
+        err = ncmpii_error_mpi2nc(mpireturn, "MPI_Allreduce");
+        DEBUG_ASSIGN_ERROR(io_status, err)
+        nrounds = 0;
+    }
+    else if (nrounds == 0)
+        nrounds = 1;
+
+    for (r=0; r<nrounds; r++) {
+        MPI_Offset pos = r * INT_MAX;
+        int len = (pos < total) ? (int) MIN(total - pos, INT_MAX) : 0;
+        char *ptr = (len > 0) ? staging + pos : NULL;
+
+        if (rw_flag == NC_REQ_WR) {
+            TRACE_IO(MPI_File_write_at_all)(fh, offset + pos, ptr, len,
+                                            MPI_BYTE, &mpistatus);
+            if (mpireturn != MPI_SUCCESS) {
+                err = ncmpii_error_mpi2nc(mpireturn, "MPI_File_write_at_all");
+                err = (err == NC_EFILE) ? NC_EWRITE : err;
+                if (io_status == NC_NOERR) DEBUG_ASSIGN_ERROR(io_status, err)
+            }
+        }
+        else {
+            TRACE_IO(MPI_File_read_at_all)(fh, offset + pos, ptr, len,
+                                           MPI_BYTE, &mpistatus);
+            if (mpireturn != MPI_SUCCESS) {
+                err = ncmpii_error_mpi2nc(mpireturn, "MPI_File_read_at_all");
+                err = (err == NC_EFILE) ? NC_EREAD : err;
+                if (io_status == NC_NOERR) DEBUG_ASSIGN_ERROR(io_status, err)
+            }
+        }
+    }
+
+    if (rw_flag == NC_REQ_RD) {
+        if (io_status == NC_NOERR && status == NC_NOERR && staging != NULL) {
+            /* copy the read data back to the window */
+            for (k=0; k<nents; k++)
+                memcpy(ents[k].ptr, staging + ents[k].spos,
+                       (size_t)ents[k].len);
+        }
+        MPI_Win_sync(win);
+    }
+    if (io_status == NC_NOERR) io_status = status;
+
+    /* errors occurred on the leader are reported to all processes on the
+     * node. For read, this also ensures the data in the window is ready */
+    TRACE_COMM(MPI_Bcast)(&io_status, 1, MPI_INT, 0, ncp->node_comm);
+    if (mpireturn != MPI_SUCCESS) {
+        err = ncmpii_error_mpi2nc(mpireturn, "MPI_Bcast");
+        if (io_status == NC_NOERR) io_status = err;
+    }
+
+    if (rw_flag == NC_REQ_RD && io_status == NC_NOERR) {
+        /* copy the read data from the window to the I/O buffer */
+        MPI_Win_sync(win);
+        data = (char*)(meta + 1 + 2 * nsegs);
+        for (k=0; k<nsegs; k++) {
+            memcpy((char*)buf + segs[k].buf_addr, data, (size_t)segs[k].len);
+            data += segs[k].len;
+        }
+    }
+
+    MPI_Win_unlock_all(win);
+    MPI_Win_free(&win);
+
+    if (staging != NULL) NCI_Free(staging);
+    if (ents    != NULL) NCI_Free(ents);
+
+    /* update the number of bytes accessed by this process */
+    if (io_status == NC_NOERR) {
+        if (rw_flag == NC_REQ_WR) ncp->put_size += my_bytes;
+        else                      ncp->get_size += my_bytes;
+    }
+
+    return io_status;
+#else
+    DEBUG_RETURN_ERROR(NC_ENOTSUPPORT)
+#endif
+}
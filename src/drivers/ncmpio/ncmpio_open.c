@@ -41,6 +41,7 @@ ncmpio_open(MPI_Comm     comm,
 {
     char *env_str;
     int i, mpiomode, err, status=NC_NOERR, mpireturn;
+    double timing;
     MPI_File fh;
     MPI_Info info_used;
     NC *ncp=NULL;
@@ -109,9 +110,24 @@ ncmpio_open(MPI_Comm     comm,
 
     /* chunk size for reading header (set default before check hints) */
     ncp->chunk = NC_DEFAULT_CHUNKSIZE;
+
+    /* staging buffer size of two-phase I/O (set default before check hints) */
+    ncp->tp_bufsize = NC_DEFAULT_TWO_PHASE_BUFSIZE;
+
+    /* max size of the pool of temporary buffers, set to default before check
+     * hints */
+    ncp->pool_size = NC_DEFAULT_BUF_POOL_SIZE;
+
+    /* size of chunks for moving data when the header grows, set to default
+     * before check hints */
+    ncp->move_chunk = NC_DEFAULT_MOVE_CHUNK_SIZE;
+
     /* extract I/O hints from user info */
     ncmpio_set_pnetcdf_hints(ncp, info);
 
+    /* pool of temporary buffers used by put and get requests */
+    ncp->pool = ncmpii_pool_create((size_t)ncp->pool_size);
+
 #if 0
     ncp->safe_mode    = 0;
     ncp->numGetReqs   = 0; /* number of pending non-blocking get requests */
@@ -124,6 +140,8 @@ ncmpio_open(MPI_Comm     comm,
     ncp->get_list     = NULL;
     ncp->put_list     = NULL;
     ncp->abuf         = NULL;
+    ncp->plans        = NULL;
+    ncp->num_plans    = 0;
     ncp->old          = NULL;
     ncp->put_size     = 0;    /* bytes written so far */
     ncp->get_size     = 0;    /* bytes read    so far */
@@ -141,6 +159,7 @@ ncmpio_open(MPI_Comm     comm,
     ncp->mpiomode       = mpiomode;
     ncp->collective_fh  = fh;
     ncp->independent_fh = MPI_FILE_NULL;
+    ncp->node_comm      = MPI_COMM_NULL;
     ncp->path = (char*) NCI_Malloc(strlen(path) + 1);
     strcpy(ncp->path, path);
 
@@ -160,7 +179,9 @@ ncmpio_open(MPI_Comm     comm,
     }
 
     /* read header from file into NC object pointed by ncp -------------------*/
+    timing = NC_STATS_WTIME(ncp);
     err = ncmpio_hdr_get_NC(ncp);
+    NC_STATS_ADD_TIME(ncp, NC_STATS_TIME_HEADER, timing)
     if (err == NC_ENULLPAD) status = NC_ENULLPAD; /* non-fatal error */
     else if (err != NC_NOERR) { /* fatal error */
         ncmpio_close_files(ncp, 0);
@@ -210,9 +231,14 @@ ncmpio_open(MPI_Comm     comm,
 
 #ifndef SEARCH_NAME_LINEARLY
     /* initialize and populate name lookup tables ---------------------------*/
-    ncmpio_hash_table_populate_NC_dim(&ncp->dims);
-    ncmpio_hash_table_populate_NC_var(&ncp->vars);
-    ncmpio_hash_table_populate_NC_attr(ncp);
+    err = ncmpio_hash_table_populate_NC_dim(&ncp->dims);
+    if (err == NC_NOERR)
+        err = ncmpio_hash_table_populate_NC_var(&ncp->vars);
+    /* attribute lookup tables are created when first searched */
+    if (err != NC_NOERR) {
+        ncmpio_free_NC(ncp);
+        return err;
+    }
 #endif
 
     *ncpp = (void*)ncp;
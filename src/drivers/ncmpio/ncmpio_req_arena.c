@@ -0,0 +1,127 @@
+/*
+ *  Copyright (C) 2018, Northwestern University and Argonne National Laboratory
+ *  See COPYRIGHT notice in top-level directory.
+ */
+/* $Id$ */
+
+/*
+ * This file implements the arena holding the start/count/stride arrays of
+ * pending nonblocking requests. Posting millions of small requests, e.g. by
+ * a particle code, used to allocate an array per request, whose malloc
+ * overhead can exceed the array itself. Here the arrays are carved out of
+ * chunks of MPI_Offsets. The first chunk has NC_REQ_ARENA_MIN of them, and
+ * each chunk added while others are in use doubles the size, up to
+ * NC_REQ_ARENA_CHUNK, so a few pending requests hold little memory. Each
+ * chunk counts the requests using it, and is released once they are all
+ * completed, so the arena shrinks in bulk after a wait.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <mpi.h>
+
+#include <pnc_debug.h>
+#include <common.h>
+#include "ncmpio_NC.h"
+
+/*----< ncmpio_arena_alloc() >-----------------------------------------------*/
+/* Return an array of len MPI_Offsets carved out of the arena and the index of
+ * the chunk it belongs to, which must be passed to ncmpio_arena_free() when
+ * the request is freed. Return NULL if out of memory.
+ */
+MPI_Offset *
+ncmpio_arena_alloc(NC     *ncp,
+                   size_t  len,
+                   int    *chunk) /* OUT */
+{
+    int c;
+    NC_req_arena *arena=ncp->arena;
+    NC_arena_chunk *cp;
+
+    if (arena == NULL) {
+        arena = (NC_req_arena*) NCI_Calloc(1, sizeof(NC_req_arena));
+        if (arena == NULL) return NULL;
+        arena->cur       = -1;
+        arena->next_size = NC_REQ_ARENA_MIN;
+        ncp->arena = arena;
+    }
+
+    c = arena->cur;
+    if (c < 0 || arena->chunks[c].used + len > arena->chunks[c].size) {
+        /* current chunk is full, find a chunk not used by any request */
+        for (c=0; c<arena->nchunks; c++)
+            if (arena->chunks[c].nlive == 0) break;
+
+        if (c == arena->nchunks) { /* all in use, add a new chunk */
+            cp = (NC_arena_chunk*) NCI_Realloc(arena->chunks,
+                 (size_t)(arena->nchunks + 1) * sizeof(NC_arena_chunk));
+            if (cp == NULL) return NULL;
+            arena->chunks = cp;
+            arena->chunks[c].buf  = NULL;
+            arena->chunks[c].size = 0;
+            arena->nchunks++;
+        }
+        cp = arena->chunks + c;
+
+        /* chunks not used by any request have been released */
+        cp->size = MAX(len, arena->next_size);
+        cp->buf  = (MPI_Offset*) NCI_Malloc(cp->size * SIZEOF_MPI_OFFSET);
+        if (cp->buf == NULL) {
+            cp->size = 0;
+            return NULL;
+        }
+        arena->next_size = MIN(2 * arena->next_size, NC_REQ_ARENA_CHUNK);
+
+        cp->used  = 0;
+        cp->nlive = 0;
+        arena->cur = c;
+        arena->nlive++;
+    }
+
+    cp = arena->chunks + c;
+    cp->used += len;
+    cp->nlive++;
+    *chunk = c;
+
+    return cp->buf + cp->used - len;
+}
+
+/*----< ncmpio_arena_free() >------------------------------------------------*/
+/* Called when a request whose start/count/stride array is carved out of the
+ * given chunk is freed. The chunk is released when no request uses it. Once
+ * all chunks are released, the next chunk starts small again.
+ */
+void
+ncmpio_arena_free(NC  *ncp,
+                  int  chunk)
+{
+    NC_req_arena *arena=ncp->arena;
+    NC_arena_chunk *cp=arena->chunks + chunk;
+
+    if (--cp->nlive > 0) return;
+
+    NCI_Free(cp->buf);
+    cp->buf  = NULL;
+    cp->size = 0;
+    cp->used = 0;
+    if (chunk == arena->cur) arena->cur = -1;
+
+    if (--arena->nlive == 0) arena->next_size = NC_REQ_ARENA_MIN;
+}
+
+/*----< ncmpio_arena_destroy() >---------------------------------------------*/
+void
+ncmpio_arena_destroy(NC_req_arena *arena)
+{
+    int c;
+
+    for (c=0; c<arena->nchunks; c++)
+        if (arena->chunks[c].buf != NULL) NCI_Free(arena->chunks[c].buf);
+    if (arena->chunks != NULL) NCI_Free(arena->chunks);
+    NCI_Free(arena);
+}
@@ -0,0 +1,401 @@
+/*
+ *  Copyright (C) 2018, Northwestern University and Argonne National Laboratory
+ *  See COPYRIGHT notice in top-level directory.
+ */
+/* $Id$ */
+
+/*
+ * This file implements the corresponding APIs defined in src/dispatchers/file.c
+ *
+ * ncmpi_inq_stats()     : dispatcher->inq_stats()
+ * ncmpi_inq_var_stats() : dispatcher->inq_var_stats()
+ * ncmpi_inq_buf_pool_stats() : dispatcher->inq_buf_pool_stats()
+ *
+ * I/O statistics are collected only when hint nc_stats is enabled, so the
+ * put/get paths pay nothing but a NULL pointer check otherwise. They consist
+ * of the number and size of requests per API kind, the time spent in the
+ * major internal steps, and per-variable histograms of request sizes. When
+ * hint nc_stats_file is set, the statistics of all processes are dumped into
+ * that file in JSON at file close.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h> /* memcpy(), memset(), strlen() */
+
+#include <mpi.h>
+
+#include <pnc_debug.h>
+#include <common.h>
+#include "ncmpio_NC.h"
+
+/*----< ncmpio_stats_enable() >----------------------------------------------*/
+/* Start collecting I/O statistics, if not already. When json_path is not
+ * NULL, the statistics will be dumped into file json_path at file close.
+ */
+int
+ncmpio_stats_enable(NC         *ncp,
+                    const char *json_path)
+{
+    if (ncp->stats == NULL) {
+        ncp->stats = (NC_stats*) NCI_Calloc(1, sizeof(NC_stats));
+        if (ncp->stats == NULL) DEBUG_RETURN_ERROR(NC_ENOMEM)
+    }
+
+    if (json_path != NULL) {
+        if (ncp->stats->json_path != NULL) NCI_Free(ncp->stats->json_path);
+        ncp->stats->json_path = (char*) NCI_Malloc(strlen(json_path) + 1);
+        if (ncp->stats->json_path == NULL) DEBUG_RETURN_ERROR(NC_ENOMEM)
+        strcpy(ncp->stats->json_path, json_path);
+    }
+    return NC_NOERR;
+}
+
+/*----< ncmpio_stats_free() >------------------------------------------------*/
+void
+ncmpio_stats_free(NC_stats *stats)
+{
+    if (stats->var_hist  != NULL) NCI_Free(stats->var_hist);
+    if (stats->json_path != NULL) NCI_Free(stats->json_path);
+    NCI_Free(stats);
+}
+
+/*----< ncmpio_stats_add() >-------------------------------------------------*/
+/* Count a request of nbytes in file made by an API of kind api (one of
+ * NC_STATS_VARA, NC_STATS_VARS, etc.) to variable varp. varp is NULL for
+ * requests of no particular variable.
+ */
+void
+ncmpio_stats_add(NC           *ncp,
+                 const NC_var *varp,
+                 int           api,
+                 int           reqMode,
+                 MPI_Offset    nbytes)
+{
+    int rw, bin;
+    MPI_Offset n;
+    NC_stats *stats = ncp->stats;
+
+    if (stats == NULL) return;
+
+    rw = fIsSet(reqMode, NC_REQ_RD) ? 1 : 0;
+    stats->counts[rw][api]++;
+    stats->bytes[rw][api] += nbytes;
+
+    if (varp == NULL || nbytes == 0) return;
+
+    if (varp->varid >= stats->num_vars) {
+        /* variables may be added in redef, grow the histograms */
+        int num_vars = ncp->vars.ndefined;
+        size_t len = sizeof(stats->var_hist[0]);
+        void *ptr = NCI_Realloc(stats->var_hist, len * num_vars);
+        if (ptr == NULL) return; /* skip the histogram */
+        stats->var_hist = ptr;
+        memset(stats->var_hist + stats->num_vars, 0,
+               len * (num_vars - stats->num_vars));
+        stats->num_vars = num_vars;
+    }
+
+    /* bin i counts sizes in [4^i, 4^(i+1)) and the last bin all larger */
+    for (bin=0, n=nbytes; n >= 4 && bin < NC_STATS_HIST_BINS-1; n >>= 2)
+        bin++;
+    stats->var_hist[varp->varid][rw][bin]++;
+}
+
+/*----< ncmpio_stats_add_vars() >--------------------------------------------*/
+/* Count a subarray request of var, var1, vara, vars, or varm APIs. count can
+ * be NULL only for scalar variables.
+ */
+void
+ncmpio_stats_add_vars(NC               *ncp,
+                      const NC_var     *varp,
+                      const MPI_Offset *count,
+                      const MPI_Offset *stride,
+                      const MPI_Offset *imap,
+                      int               reqMode)
+{
+    int i, api;
+    MPI_Offset nbytes;
+
+    if (ncp->stats == NULL) return;
+
+    if (imap != NULL)        api = NC_STATS_VARM;
+    else if (stride != NULL) api = NC_STATS_VARS;
+    else                     api = NC_STATS_VARA;
+
+    nbytes = varp->xsz;
+    for (i=0; i<varp->ndims; i++) nbytes *= count[i];
+
+    ncmpio_stats_add(ncp, varp, api, reqMode, nbytes);
+}
+
+/*----< ncmpio_stats_add_varn() >--------------------------------------------*/
+/* Count a varn request as one request of the total size of its subarrays.
+ * counts can be NULL, meaning one element per subarray.
+ */
+void
+ncmpio_stats_add_varn(NC                *ncp,
+                      const NC_var      *varp,
+                      int                num,
+                      MPI_Offset* const *counts,
+                      int                reqMode)
+{
+    int i, j;
+    MPI_Offset nbytes=0, nelems;
+
+    if (ncp->stats == NULL) return;
+
+    for (i=0; i<num; i++) {
+        nelems = 1;
+        if (counts != NULL && counts[i] != NULL)
+            for (j=0; j<varp->ndims; j++) nelems *= counts[i][j];
+        nbytes += nelems;
+    }
+    nbytes *= varp->xsz;
+
+    ncmpio_stats_add(ncp, varp, NC_STATS_VARN, reqMode, nbytes);
+}
+
+/*----< ncmpio_inq_stats() >-------------------------------------------------*/
+int
+ncmpio_inq_stats(void       *ncdp,
+                 MPI_Offset *put_counts,
+                 MPI_Offset *put_bytes,
+                 MPI_Offset *get_counts,
+                 MPI_Offset *get_bytes,
+                 double     *timings)
+{
+    int i;
+    NC *ncp=(NC*)ncdp;
+    NC_stats *stats=ncp->stats;
+
+    for (i=0; i<NC_STATS_NUM_APIS; i++) {
+        if (put_counts != NULL)
+            put_counts[i] = (stats == NULL) ? 0 : stats->counts[0][i];
+        if (put_bytes != NULL)
+            put_bytes[i]  = (stats == NULL) ? 0 : stats->bytes[0][i];
+        if (get_counts != NULL)
+            get_counts[i] = (stats == NULL) ? 0 : stats->counts[1][i];
+        if (get_bytes != NULL)
+            get_bytes[i]  = (stats == NULL) ? 0 : stats->bytes[1][i];
+    }
+
+    if (timings != NULL) {
+        for (i=0; i<NC_STATS_NUM_TIMERS; i++)
+            timings[i] = (stats == NULL) ? 0.0 : stats->timing[i];
+    }
+    return NC_NOERR;
+}
+
+/*----< ncmpio_inq_var_stats() >---------------------------------------------*/
+int
+ncmpio_inq_var_stats(void       *ncdp,
+                     int         varid,
+                     MPI_Offset *put_hist,
+                     MPI_Offset *get_hist)
+{
+    int i, has_hist;
+    NC *ncp=(NC*)ncdp;
+    NC_stats *stats=ncp->stats;
+
+    has_hist = (stats != NULL && varid < stats->num_vars);
+
+    for (i=0; i<NC_STATS_HIST_BINS; i++) {
+        if (put_hist != NULL)
+            put_hist[i] = (has_hist) ? stats->var_hist[varid][0][i] : 0;
+        if (get_hist != NULL)
+            get_hist[i] = (has_hist) ? stats->var_hist[varid][1][i] : 0;
+    }
+    return NC_NOERR;
+}
+
+/*----< ncmpio_inq_buf_pool_stats() >----------------------------------------*/
+/* statistics of the pool of temporary buffers of this file, all 0s when the
+ * pool is disabled by hint nc_buf_pool_size */
+int
+ncmpio_inq_buf_pool_stats(void       *ncdp,
+                          MPI_Offset *hits,
+                          MPI_Offset *misses,
+                          MPI_Offset *max_size)
+{
+    NC *ncp=(NC*)ncdp;
+
+    ncmpii_pool_stats(ncp->pool, hits, misses, max_size);
+    return NC_NOERR;
+}
+
+/*----< json_string() >------------------------------------------------------*/
+/* write str as a JSON string, escaping quotes, backslashes, and control
+ * characters */
+static void
+json_string(FILE *fp, const char *str)
+{
+    const unsigned char *c;
+
+    fputc('"', fp);
+    for (c=(const unsigned char*)str; *c != '\0'; c++) {
+        if (*c == '"' || *c == '\\')
+            fprintf(fp, "\\%c", *c);
+        else if (*c < 0x20)
+            fprintf(fp, "\\u%04x", *c);
+        else
+            fputc(*c, fp);
+    }
+    fputc('"', fp);
+}
+
+/*----< json_array() >-------------------------------------------------------*/
+static void
+json_array(FILE *fp, const MPI_Offset *vals, int len)
+{
+    int i;
+
+    fputc('[', fp);
+    for (i=0; i<len; i++)
+        fprintf(fp, "%s%lld", (i == 0) ? "" : ", ", vals[i]);
+    fputc(']', fp);
+}
+
+/*----< ncmpio_stats_dump() >------------------------------------------------*/
+/* Reduce the I/O statistics of all processes to root, which writes them into
+ * file stats->json_path in JSON. Counts and sizes are summed and, for each
+ * timer, the maximum and sum among processes are written.
+ * This is a collective subroutine, called at file close.
+ */
+int
+ncmpio_stats_dump(NC *ncp)
+{
+    static const char *api_names[NC_STATS_NUM_APIS] =
+        {"vara", "vars", "varm", "varn", "vard"};
+    static const char *timer_names[NC_STATS_NUM_TIMERS] =
+        {"filetype", "pack", "mpiio", "header", "fill", "enddef"};
+    int i, rank, nprocs, nvars, mpireturn, err=NC_NOERR;
+    size_t hist_len;
+    MPI_Offset sizes[2], sum_sizes[2];
+    MPI_Offset counts[4][NC_STATS_NUM_APIS], sum_counts[4][NC_STATS_NUM_APIS];
+    MPI_Offset *hist=NULL, *sum_hist=NULL;
+    double max_timing[NC_STATS_NUM_TIMERS], sum_timing[NC_STATS_NUM_TIMERS];
+    NC_stats *stats=ncp->stats;
+    FILE *fp;
+
+    MPI_Comm_rank(ncp->comm, &rank);
+    MPI_Comm_size(ncp->comm, &nprocs);
+
+    memcpy(counts,   stats->counts, sizeof(stats->counts));
+    memcpy(counts+2, stats->bytes,  sizeof(stats->bytes));
+    TRACE_COMM(MPI_Reduce)(counts, sum_counts, 4*NC_STATS_NUM_APIS,
+                           MPI_OFFSET, MPI_SUM, 0, ncp->comm);
+    if (mpireturn != MPI_SUCCESS)
+        return ncmpii_error_mpi2nc(mpireturn, "MPI_Reduce");
+
+    sizes[0] = ncp->put_size;
+    sizes[1] = ncp->get_size;
+    TRACE_COMM(MPI_Reduce)(sizes, sum_sizes, 2, MPI_OFFSET, MPI_SUM, 0,
+                           ncp->comm);
+    if (mpireturn != MPI_SUCCESS)
+        return ncmpii_error_mpi2nc(mpireturn, "MPI_Reduce");
+
+    TRACE_COMM(MPI_Reduce)(stats->timing, max_timing, NC_STATS_NUM_TIMERS,
+                           MPI_DOUBLE, MPI_MAX, 0, ncp->comm);
+    if (mpireturn != MPI_SUCCESS)
+        return ncmpii_error_mpi2nc(mpireturn, "MPI_Reduce");
+
+    TRACE_COMM(MPI_Reduce)(stats->timing, sum_timing, NC_STATS_NUM_TIMERS,
+                           MPI_DOUBLE, MPI_SUM, 0, ncp->comm);
+    if (mpireturn != MPI_SUCCESS)
+        return ncmpii_error_mpi2nc(mpireturn, "MPI_Reduce");
+
+    /* histograms of all variables, including those never accessed by this
+     * process, so all processes contribute arrays of the same length */
+    nvars = ncp->vars.ndefined;
+    hist_len = (size_t)nvars * 2 * NC_STATS_HIST_BINS;
+    if (nvars > 0) {
+        hist = (MPI_Offset*) NCI_Calloc(hist_len, sizeof(MPI_Offset));
+        if (hist == NULL) DEBUG_ASSIGN_ERROR(err, NC_ENOMEM)
+        else if (stats->num_vars > 0)
+            memcpy(hist, stats->var_hist, sizeof(stats->var_hist[0]) *
+                   MIN(stats->num_vars, nvars));
+        if (rank == 0 && err == NC_NOERR) {
+            sum_hist = (MPI_Offset*) NCI_Malloc(hist_len * sizeof(MPI_Offset));
+            if (sum_hist == NULL) DEBUG_ASSIGN_ERROR(err, NC_ENOMEM)
+        }
+
+        /* all processes must agree on whether to call MPI_Reduce */
+        TRACE_COMM(MPI_Allreduce)(MPI_IN_PLACE, &err, 1, MPI_INT, MPI_MIN,
+                                  ncp->comm);
+        if (mpireturn != MPI_SUCCESS) {
+            err = ncmpii_error_mpi2nc(mpireturn, "MPI_Allreduce");
+            if (hist != NULL) NCI_Free(hist);
+            if (sum_hist != NULL) NCI_Free(sum_hist);
+            return err;
+        }
+        if (err != NC_NOERR) { /* out of memory on one or more processes */
+            if (hist != NULL) NCI_Free(hist);
+            if (sum_hist != NULL) NCI_Free(sum_hist);
+            return err;
+        }
+
+        TRACE_COMM(MPI_Reduce)(hist, sum_hist, (int)hist_len, MPI_OFFSET,
+                               MPI_SUM, 0, ncp->comm);
+        NCI_Free(hist);
+        if (mpireturn != MPI_SUCCESS) {
+            if (sum_hist != NULL) NCI_Free(sum_hist);
+            return ncmpii_error_mpi2nc(mpireturn, "MPI_Reduce");
+        }
+    }
+
+    if (rank > 0) return NC_NOERR;
+
+    fp = fopen(stats->json_path, "w");
+    if (fp == NULL) {
+        if (sum_hist != NULL) NCI_Free(sum_hist);
+        fprintf(stderr, "Error: cannot open file %s to write I/O statistics\n",
+                stats->json_path);
+        DEBUG_RETURN_ERROR(NC_EFILE)
+    }
+
+    fprintf(fp, "{\n  \"path\": ");
+    json_string(fp, (ncp->path == NULL) ? "" : ncp->path);
+    fprintf(fp, ",\n  \"nprocs\": %d,\n", nprocs);
+    fprintf(fp, "  \"put_size\": %lld,\n", sum_sizes[0]);
+    fprintf(fp, "  \"get_size\": %lld,\n", sum_sizes[1]);
+
+    fprintf(fp, "  \"apis\": {\n");
+    for (i=0; i<NC_STATS_NUM_APIS; i++)
+        fprintf(fp, "    \"%s\": {\"put_count\": %lld, \"put_bytes\": %lld, "
+                "\"get_count\": %lld, \"get_bytes\": %lld}%s\n",
+                api_names[i], sum_counts[0][i], sum_counts[2][i],
+                sum_counts[1][i], sum_counts[3][i],
+                (i < NC_STATS_NUM_APIS-1) ? "," : "");
+    fprintf(fp, "  },\n");
+
+    fprintf(fp, "  \"timings\": {\n");
+    for (i=0; i<NC_STATS_NUM_TIMERS; i++)
+        fprintf(fp, "    \"%s\": {\"max\": %.6f, \"sum\": %.6f}%s\n",
+                timer_names[i], max_timing[i], sum_timing[i],
+                (i < NC_STATS_NUM_TIMERS-1) ? "," : "");
+    fprintf(fp, "  },\n");
+
+    fprintf(fp, "  \"hist_bins\": %d,\n", NC_STATS_HIST_BINS);
+    fprintf(fp, "  \"variables\": [");
+    for (i=0; i<nvars; i++) {
+        MPI_Offset *put_hist = sum_hist + (size_t)i * 2 * NC_STATS_HIST_BINS;
+        fprintf(fp, "%s\n    {\"name\": ", (i == 0) ? "" : ",");
+        json_string(fp, ncp->vars.value[i]->name);
+        fprintf(fp, ", \"put_hist\": ");
+        json_array(fp, put_hist, NC_STATS_HIST_BINS);
+        fprintf(fp, ", \"get_hist\": ");
+        json_array(fp, put_hist + NC_STATS_HIST_BINS, NC_STATS_HIST_BINS);
+        fprintf(fp, "}");
+    }
+    fprintf(fp, "%s]\n}\n", (nvars > 0) ? "\n  " : "");
+
+    if (fclose(fp) != 0) DEBUG_ASSIGN_ERROR(err, NC_EFILE)
+
+    if (sum_hist != NULL) NCI_Free(sum_hist);
+    return err;
+}
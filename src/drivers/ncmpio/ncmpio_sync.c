@@ -134,10 +134,11 @@ ncmpio_write_numrecs(NC         *ncp,
  * 3. ncmpi_end_indep_data(): exit from independent data mode
  * 4. all blocking collective put APIs when writing record variables
  * 5. ncmpi_close(): file close and currently in independent data mode
+ * 6. ncmpi_redef() and ncmpi_close() when hint nc_defer_numrecs is enabled
  *
  * This API is collective, but can be called in independent data mode.
  * Note numrecs is always sync-ed in memory and update in file in collective
- * data mode.
+ * data mode, unless hint nc_defer_numrecs is enabled.
  */
 int
 ncmpio_sync_numrecs(void *ncdp)
@@ -155,9 +156,10 @@ ncmpio_sync_numrecs(void *ncdp)
     /* check write permission */
     if (NC_readonly(ncp)) DEBUG_RETURN_ERROR(NC_EPERM)
 
-    if (!NC_indep(ncp)) /* in collective data mode, numrecs is always sync-ed */
+    if (!NC_indep(ncp) && !ncp->defer_numrecs)
+        /* in collective data mode, numrecs is always sync-ed */
         return NC_NOERR;
-    else /* if called in independent mode, we force sync in memory */
+    else /* otherwise, we force sync in memory */
         set_NC_ndirty(ncp);
 
     /* return now if there is no record variabled defined */
@@ -224,6 +226,9 @@ ncmpio_sync(void *ncdp)
     /* cannot be in define mode */
     if (NC_indef(ncp)) DEBUG_RETURN_ERROR(NC_EINDEFINE)
 
+    /* no file access until the pending split-phase wait is ended */
+    if (NC_WAIT_PENDING(ncp)) DEBUG_RETURN_ERROR(NC_EPENDING)
+
 #if 0
     /* In PnetCDF, header metadata is always sync-ed among all processes.
      * There is no need to re-read the header from file.
@@ -236,14 +241,21 @@ ncmpio_sync(void *ncdp)
 #endif
 
     /* the only part of header that can be dirty is numrecs (caused only by
-     * independent APIs) */
-    if (ncp->vars.num_rec_vars > 0 && NC_indep(ncp)) {
+     * independent APIs, or collective APIs when hint nc_defer_numrecs is
+     * enabled) */
+    if (ncp->vars.num_rec_vars > 0 && (NC_indep(ncp) || ncp->defer_numrecs)) {
         /* sync numrecs in memory among processes and in file */
         set_NC_ndirty(ncp);
         err = ncmpio_sync_numrecs(ncp);
         if (err != NC_NOERR) return err;
     }
 
+    if (ncp->num_fill_pending > 0) {
+        /* write pending lazy fills (only possible in collective mode) */
+        err = ncmpio_lazy_fill_flush(ncp);
+        if (err != NC_NOERR) return err;
+    }
+
     /* calling MPI_File_sync() on both collective and independent handlers */
     return ncmpio_file_sync(ncp);
 }
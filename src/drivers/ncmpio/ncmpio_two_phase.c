@@ -0,0 +1,524 @@
+/*
+ *  Copyright (C) 2018, Northwestern University and Argonne National Laboratory
+ *  See COPYRIGHT notice in top-level directory.
+ */
+/* $Id$ */
+
+/*
+ * This file implements PnetCDF's own two-phase collective I/O, an alternative
+ * to MPI collective I/O used by the collective nonblocking and blocking
+ * requests when hint nc_pnetcdf_two_phase is set to enable.
+ *
+ * The aggregate file access range of all processes is divided into contiguous
+ * file domains, one per I/O aggregator. Domain boundaries are aligned with the
+ * file striping unit, so no two aggregators write to the same file stripe.
+ * Each file domain is further processed in rounds, each round accesses at
+ * most nc_two_phase_buffer_size bytes of the domain. In each round,
+ *   1. all processes exchange the number of offset-length pairs and bytes to
+ *      be sent to each aggregator,
+ *   2. processes send their offset-length pairs to the aggregators,
+ *   3. for write, processes send their data to the aggregators, which copy the
+ *      data into a staging buffer and write the contiguous runs to the file,
+ *   4. for read, aggregators read the data range covering all requested pairs
+ *      (data sieving) into the staging buffer and send the data back.
+ * Aggregators access the file through independent MPI-IO calls.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h> /* memcpy(), memset() */
+#include <limits.h> /* INT_MAX */
+#include <errno.h>
+#include <assert.h>
+
+#include <mpi.h>
+
+#include <pnc_debug.h>
+#include <common.h>
+#include <ncx.h>
+#include "ncmpio_NC.h"
+
+#define TWO_PHASE_TAG_META 0
+#define TWO_PHASE_TAG_DATA 1
+
+/*----< seg_off_compare() >--------------------------------------------------*/
+/* used for sorting the offsets of the off_len array */
+static int
+seg_off_compare(const void *a, const void *b)
+{
+    if (((off_len*)a)->off > ((off_len*)b)->off) return  1;
+    if (((off_len*)a)->off < ((off_len*)b)->off) return -1;
+    return 0;
+}
+
+/*----< info_get_int() >-----------------------------------------------------*/
+/* obtain an integer valued MPI-IO hint, return 0 if not set or invalid */
+static int
+info_get_int(MPI_Info info, char *key)
+{
+    char value[MPI_MAX_INFO_VAL];
+    int  flag, ival=0;
+
+    if (info == MPI_INFO_NULL) return 0;
+
+    MPI_Info_get(info, key, MPI_MAX_INFO_VAL-1, value, &flag);
+    if (flag) {
+        errno = 0;
+        ival = (int)strtol(value,NULL,10);
+        if (errno != 0 || ival < 0) ival = 0;
+    }
+    return ival;
+}
+
+/*----< buf_type_create() >--------------------------------------------------*/
+/* Construct a derived data type of MPI_BYTE describing the memory layout of
+ * nsegs segments, whose addresses segs[].buf_addr are relative to a base
+ * buffer. Segments contiguous in memory are coalesced. When all segments
+ * coalesce into one, *dtype is MPI_BYTE, and *disp and *count describe the
+ * contiguous block. Otherwise, *dtype is a committed derived data type to be
+ * freed by the caller, *disp is 0 and *count is 1.
+ */
+static int
+buf_type_create(int            nsegs,
+                const off_len *segs,   /* [nsegs] */
+                MPI_Aint      *disp,   /* OUT: displacement from base */
+                int           *count,  /* OUT: count of dtype */
+                MPI_Datatype  *dtype)  /* OUT: MPI_BYTE or derived type */
+{
+    int i, j, mpireturn, *blocklengths;
+    MPI_Aint *displacements;
+
+    /* count the number of coalesced blocks */
+    for (j=0,i=1; i<nsegs; i++)
+        if (segs[i-1].buf_addr + segs[i-1].len != segs[i].buf_addr) j++;
+
+    if (j == 0) { /* all segments are contiguous in memory */
+        *disp  = segs[0].buf_addr;
+        *count = (int)(segs[nsegs-1].buf_addr + segs[nsegs-1].len
+                       - segs[0].buf_addr);
+        *dtype = MPI_BYTE;
+        return NC_NOERR;
+    }
+
+    blocklengths  = (int*)      NCI_Malloc((size_t)(j+1) * SIZEOF_INT);
+    displacements = (MPI_Aint*) NCI_Malloc((size_t)(j+1) * SIZEOF_MPI_AINT);
+
+    displacements[0] =      segs[0].buf_addr;
+    blocklengths[0]  = (int)segs[0].len;
+    for (j=0,i=1; i<nsegs; i++) {
+        if (displacements[j] + blocklengths[j] == segs[i].buf_addr)
+            blocklengths[j] += (int)segs[i].len;
+        else {
+            j++;
+            displacements[j] =      segs[i].buf_addr;
+            blocklengths[j]  = (int)segs[i].len;
+        }
+    }
+
+#ifdef HAVE_MPI_TYPE_CREATE_HINDEXED
+    mpireturn = MPI_Type_create_hindexed(j+1, blocklengths, displacements,
+                                         MPI_BYTE, dtype);
+#else
+    mpireturn = MPI_Type_hindexed(j+1, blocklengths, displacements, MPI_BYTE,
+                                  dtype);
+#endif
+    NCI_Free(displacements);
+    NCI_Free(blocklengths);
+
+    if (mpireturn != MPI_SUCCESS) {
+        *dtype = MPI_BYTE;
+        *disp  = 0;
+        *count = 0;
+        return ncmpii_error_mpi2nc(mpireturn, "MPI_Type_create_hindexed");
+    }
+    MPI_Type_commit(dtype);
+    *disp  = 0;
+    *count = 1;
+
+    return NC_NOERR;
+}
+
+/*----< ncmpio_two_phase_io() >-----------------------------------------------*/
+/* Carry out a collective read or write of the offset-length pairs, segs[],
+ * using PnetCDF's two-phase I/O. segs[] must be sorted in an increasing order
+ * of file offsets and must not overlap with each other. segs[].buf_addr are
+ * the addresses relative to buf. nsegs can be zero, in which case this
+ * process only participates the collective communication.
+ *
+ * This function is collective.
+ */
+int
+ncmpio_two_phase_io(NC         *ncp,
+                    int         rw_flag,  /* NC_REQ_WR or NC_REQ_RD */
+                    MPI_Offset  nsegs,    /* number of off-len pairs */
+                    off_len    *segs,     /* [nsegs] sorted, non-overlapped */
+                    void       *buf)      /* base of segs[].buf_addr */
+{
+    int i, j, d, p, rank, nprocs, naggrs, ndoms, my_dom, unit, mpireturn;
+    int err, status=NC_NOERR, io_status=NC_NOERR, nreqs, *dom_start, *dom_end;
+    char *staging=NULL, *rbuf=NULL;
+    size_t rbuf_size=0;
+    MPI_Offset k, r, npcs, nrounds, fd_lo, fd_size, span, cb, my_bytes=0;
+    MPI_Offset range[2], g_range[2], *scnt, *rcnt, *pmeta=NULL, *rmeta=NULL;
+    MPI_Offset rmeta_size=0, nents;
+    off_len *pcs=NULL, *ents=NULL;
+    MPI_Datatype pair_type;
+    MPI_Request *reqs;
+    MPI_File fh=ncp->collective_fh;
+    MPI_Status mpistatus;
+
+    MPI_Comm_rank(ncp->comm, &rank);
+    MPI_Comm_size(ncp->comm, &nprocs);
+
+    /* find the aggregate access range among all processes. Only MPI_MAX on
+     * non-negative values is used, as some MPI libraries treat MPI_OFFSET as
+     * an unsigned type in reductions */
+    range[0] = (nsegs > 0) ? X_INT64_MAX - segs[0].off : 0;
+    range[1] = (nsegs > 0) ? segs[nsegs-1].off + segs[nsegs-1].len : 0;
+    TRACE_COMM(MPI_Allreduce)(range, g_range, 2, MPI_OFFSET, MPI_MAX,
+                              ncp->comm);
+    if (mpireturn != MPI_SUCCESS)
+        return ncmpii_error_mpi2nc(mpireturn, "MPI_Allreduce");
+    g_range[0] = X_INT64_MAX - g_range[0];
+
+    /* no process has data to access */
+    if (g_range[0] >= g_range[1]) return NC_NOERR;
+
+    /* determine the number of aggregators: use the hint if set, otherwise the
+     * number of MPI-IO collective buffering nodes */
+    naggrs = ncp->num_aggrs;
+    if (naggrs == 0) naggrs = info_get_int(ncp->mpiinfo, "cb_nodes");
+    if (naggrs <= 0 || naggrs > nprocs) naggrs = nprocs;
+
+    /* file domains are aligned with the file striping unit */
+    unit = ncp->striping_unit;
+    if (unit <= 0) unit = info_get_int(ncp->mpiinfo, "striping_unit");
+    if (unit <= 0) unit = 1;
+
+    fd_lo   = g_range[0] - g_range[0] % unit;
+    span    = g_range[1] - fd_lo;
+    fd_size = (span + naggrs - 1) / naggrs;
+    fd_size = ((fd_size + unit - 1) / unit) * unit;
+    ndoms   = (int)((span + fd_size - 1) / fd_size);
+
+    /* each round accesses at most cb bytes of a file domain */
+    cb = ncp->tp_bufsize;
+    if (cb > unit) cb -= cb % unit;
+    if (cb > fd_size) cb = fd_size;
+    nrounds = (fd_size + cb - 1) / cb;
+
+    /* the aggregator of file domain d is rank d*nprocs/naggrs */
+    my_dom = -1;
+    for (d=0; d<ndoms; d++) {
+        if ((int)((MPI_Offset)d * nprocs / naggrs) == rank) {
+            my_dom = d;
+            break;
+        }
+    }
+
+    /* split segs[] into pieces, each falls into a single round of a single
+     * file domain. Because segs[] are sorted, pieces are sorted by file
+     * domains first and then rounds. First, count the number of pieces.
+     */
+    npcs = 0;
+    for (k=0; k<nsegs; k++) {
+        MPI_Offset off = segs[k].off, end = segs[k].off + segs[k].len;
+        while (off < end) {
+            MPI_Offset dom_off = fd_lo + ((off - fd_lo) / fd_size) * fd_size;
+            MPI_Offset rel     = off - dom_off;
+            MPI_Offset chk_end = dom_off + MIN(((rel / cb) + 1) * cb, fd_size);
+            off = MIN(end, chk_end);
+            npcs++;
+        }
+    }
+
+    if (npcs > 0) {
+        pcs   = (off_len*)    NCI_Malloc((size_t)npcs * sizeof(off_len));
+        pmeta = (MPI_Offset*) NCI_Malloc((size_t)npcs * 2 * SIZEOF_MPI_OFFSET);
+    }
+    dom_start = (int*) NCI_Malloc((size_t)(ndoms+1) * 2 * SIZEOF_INT);
+    dom_end   = dom_start + ndoms + 1;
+
+    /* fill in the pieces and find the first piece of each file domain.
+     * dom_start[d] is then used as a cursor advanced by rounds */
+    for (d=0; d<=ndoms; d++) dom_start[d] = (int)npcs;
+    npcs = 0;
+    for (k=0; k<nsegs; k++) {
+        MPI_Offset off = segs[k].off, end = segs[k].off + segs[k].len;
+        while (off < end) {
+            MPI_Offset dom = (off - fd_lo) / fd_size;
+            MPI_Offset dom_off = fd_lo + dom * fd_size;
+            MPI_Offset rel     = off - dom_off;
+            MPI_Offset chk_end = dom_off + MIN(((rel / cb) + 1) * cb, fd_size);
+            MPI_Offset pend    = MIN(end, chk_end);
+
+            if (dom_start[dom] > npcs) dom_start[dom] = (int)npcs;
+            pcs[npcs].off      = off;
+            pcs[npcs].len      = pend - off;
+            pcs[npcs].buf_addr = segs[k].buf_addr + (off - segs[k].off);
+            pmeta[2*npcs]      = pcs[npcs].off;
+            pmeta[2*npcs+1]    = pcs[npcs].len;
+            my_bytes += pcs[npcs].len;
+            off = pend;
+            npcs++;
+        }
+    }
+    /* domains without pieces start where the next domain starts */
+    for (d=ndoms-1; d>=0; d--)
+        if (dom_start[d] > dom_start[d+1]) dom_start[d] = dom_start[d+1];
+    for (d=0; d<ndoms; d++) dom_end[d] = dom_start[d+1];
+
+    /* an off-len pair is sent as two MPI_Offset */
+    MPI_Type_contiguous(2, MPI_OFFSET, &pair_type);
+    MPI_Type_commit(&pair_type);
+
+    scnt = (MPI_Offset*) NCI_Malloc((size_t)nprocs * 4 * SIZEOF_MPI_OFFSET);
+    rcnt = scnt + nprocs * 2;
+    reqs = (MPI_Request*) NCI_Malloc((size_t)nprocs * 4 * sizeof(MPI_Request));
+
+    if (my_dom >= 0) staging = (char*) NCI_Malloc((size_t)cb);
+
+    /* make the whole file visible, MPI_File_set_view is collective */
+    k = 0;
+    err = ncmpio_file_set_view(ncp, fh, &k, MPI_BYTE);
+    if (err != NC_NOERR) io_status = err;
+
+    for (r=0; r<nrounds; r++) {
+        MPI_Offset chk_lo=0;
+
+        /* number of pairs and bytes to be sent to each aggregator */
+        for (p=0; p<nprocs*2; p++) scnt[p] = 0;
+        for (d=0; d<ndoms; d++) {
+            int aggr = (int)((MPI_Offset)d * nprocs / naggrs);
+            for (j=dom_start[d]; j<dom_end[d]; j++) {
+                MPI_Offset dom_off = fd_lo + (MPI_Offset)d * fd_size;
+                if ((pcs[j].off - dom_off) / cb != r) break;
+                scnt[aggr*2]++;
+                scnt[aggr*2+1] += pcs[j].len;
+            }
+        }
+
+        TRACE_COMM(MPI_Alltoall)(scnt, 2, MPI_OFFSET, rcnt, 2, MPI_OFFSET,
+                                 ncp->comm);
+        if (mpireturn != MPI_SUCCESS) {
+            err = ncmpii_error_mpi2nc(mpireturn, "MPI_Alltoall");
+            if (status == NC_NOERR) status = err;
+            break; /* all processes fail the collective call */
+        }
+
+        /* aggregator: receive the off-len pairs from all processes */
+        nreqs = 0;
+        nents = 0;
+        if (my_dom >= 0) {
+            MPI_Offset total_bytes=0;
+            chk_lo = fd_lo + (MPI_Offset)my_dom * fd_size + r * cb;
+            for (p=0; p<nprocs; p++) {
+                nents       += rcnt[p*2];
+                total_bytes += rcnt[p*2+1];
+            }
+            if (nents > rmeta_size) {
+                rmeta = (MPI_Offset*) NCI_Realloc(rmeta,
+                        (size_t)nents * 2 * SIZEOF_MPI_OFFSET);
+                ents  = (off_len*) NCI_Realloc(ents,
+                        (size_t)nents * sizeof(off_len));
+                rmeta_size = nents;
+            }
+            if (rw_flag == NC_REQ_WR && (size_t)total_bytes > rbuf_size) {
+                rbuf_size = (size_t)total_bytes;
+                rbuf = (char*) NCI_Realloc(rbuf, rbuf_size);
+            }
+            for (k=0,p=0; p<nprocs; p++) {
+                if (rcnt[p*2] == 0) continue;
+                TRACE_COMM(MPI_Irecv)(rmeta + k*2, (int)rcnt[p*2], pair_type,
+                                      p, TWO_PHASE_TAG_META, ncp->comm,
+                                      &reqs[nreqs++]);
+                k += rcnt[p*2];
+            }
+        }
+
+        /* send off-len pairs, and data if write, to the aggregators */
+        for (d=0; d<ndoms; d++) {
+            int aggr = (int)((MPI_Offset)d * nprocs / naggrs);
+            int cnt=0;
+            MPI_Aint disp;
+            MPI_Datatype dtype;
+
+            if (scnt[aggr*2] == 0) continue;
+            j = dom_start[d];
+
+            TRACE_COMM(MPI_Isend)(pmeta + j*2, (int)scnt[aggr*2], pair_type,
+                                  aggr, TWO_PHASE_TAG_META, ncp->comm,
+                                  &reqs[nreqs++]);
+
+            err = buf_type_create((int)scnt[aggr*2], pcs+j, &disp, &cnt,
+                                  &dtype);
+            if (err != NC_NOERR && status == NC_NOERR) status = err;
+
+            if (rw_flag == NC_REQ_WR)
+                TRACE_COMM(MPI_Isend)((char*)buf + disp, cnt, dtype, aggr,
+                                      TWO_PHASE_TAG_DATA, ncp->comm,
+                                      &reqs[nreqs++]);
+            else
+                TRACE_COMM(MPI_Irecv)((char*)buf + disp, cnt, dtype, aggr,
+                                      TWO_PHASE_TAG_DATA, ncp->comm,
+                                      &reqs[nreqs++]);
+            if (dtype != MPI_BYTE) MPI_Type_free(&dtype);
+
+            /* move on to the pieces of next round */
+            dom_start[d] += (int)scnt[aggr*2];
+        }
+
+        /* aggregator: receive write data from all processes */
+        if (my_dom >= 0 && rw_flag == NC_REQ_WR) {
+            char *ptr = rbuf;
+            for (p=0; p<nprocs; p++) {
+                if (rcnt[p*2+1] == 0) continue;
+                TRACE_COMM(MPI_Irecv)(ptr, (int)rcnt[p*2+1], MPI_BYTE, p,
+                                      TWO_PHASE_TAG_DATA, ncp->comm,
+                                      &reqs[nreqs++]);
+                ptr += rcnt[p*2+1];
+            }
+        }
+
+        if (rw_flag == NC_REQ_RD && my_dom >= 0 && nents > 0) {
+            /* aggregator must receive the off-len pairs before reading */
+            int nmeta=0;
+            for (p=0; p<nprocs; p++) if (rcnt[p*2] > 0) nmeta++;
+            TRACE_COMM(MPI_Waitall)(nmeta, reqs, MPI_STATUSES_IGNORE);
+            for (i=0; i<nreqs-nmeta; i++) reqs[i] = reqs[i+nmeta];
+            nreqs -= nmeta;
+        }
+        else {
+            TRACE_COMM(MPI_Waitall)(nreqs, reqs, MPI_STATUSES_IGNORE);
+            nreqs = 0;
+        }
+        if (mpireturn != MPI_SUCCESS) {
+            err = ncmpii_error_mpi2nc(mpireturn, "MPI_Waitall");
+            if (status == NC_NOERR) status = err;
+        }
+
+        if (my_dom < 0 || nents == 0) continue; /* no file access this round */
+
+        if (rw_flag == NC_REQ_WR) {
+            MPI_Offset run_lo, run_hi;
+            MPI_Aint pos=0;
+
+            /* copy data received into the staging buffer */
+            for (k=0; k<nents; k++) {
+                ents[k].off      = rmeta[k*2];
+                ents[k].len      = rmeta[k*2+1];
+                ents[k].buf_addr = pos;
+                pos += ents[k].len;
+            }
+            qsort(ents, (size_t)nents, sizeof(off_len), seg_off_compare);
+            for (k=0; k<nents; k++)
+                memcpy(staging + (ents[k].off - chk_lo),
+                       rbuf + ents[k].buf_addr, (size_t)ents[k].len);
+
+            /* write the contiguous runs of the staging buffer */
+            run_lo = ents[0].off;
+            run_hi = ents[0].off + ents[0].len;
+            for (k=1; k<=nents; k++) {
+                if (k < nents && ents[k].off <= run_hi) {
+                    run_hi = MAX(run_hi, ents[k].off + ents[k].len);
+                    continue;
+                }
+                TRACE_IO(MPI_File_write_at)(fh, run_lo,
+                                            staging + (run_lo - chk_lo),
+                                            (int)(run_hi - run_lo), MPI_BYTE,
+                                            &mpistatus);
+                if (mpireturn != MPI_SUCCESS) {
+                    err = ncmpii_error_mpi2nc(mpireturn, "MPI_File_write_at");
+                    if (io_status == NC_NOERR) {
+                        err = (err == NC_EFILE) ? NC_EWRITE : err;
+                        DEBUG_ASSIGN_ERROR(io_status, err)
+                    }
+                }
+                if (k < nents) {
+                    run_lo = ents[k].off;
+                    run_hi = ents[k].off + ents[k].len;
+                }
+            }
+        }
+        else { /* NC_REQ_RD */
+            MPI_Offset read_lo=X_INT64_MAX, read_hi=0;
+
+            for (k=0; k<nents; k++) {
+                ents[k].off      = rmeta[k*2];
+                ents[k].len      = rmeta[k*2+1];
+                ents[k].buf_addr = ents[k].off - chk_lo;
+                read_lo = MIN(read_lo, ents[k].off);
+                read_hi = MAX(read_hi, ents[k].off + ents[k].len);
+            }
+
+            /* read the range covering all requests (data sieving). Zero out
+             * the staging buffer first, in case of reading beyond EOF */
+            memset(staging + (read_lo - chk_lo), 0, (size_t)(read_hi-read_lo));
+            TRACE_IO(MPI_File_read_at)(fh, read_lo, staging + (read_lo-chk_lo),
+                                       (int)(read_hi - read_lo), MPI_BYTE,
+                                       &mpistatus);
+            if (mpireturn != MPI_SUCCESS) {
+                err = ncmpii_error_mpi2nc(mpireturn, "MPI_File_read_at");
+                if (io_status == NC_NOERR) {
+                    err = (err == NC_EFILE) ? NC_EREAD : err;
+                    DEBUG_ASSIGN_ERROR(io_status, err)
+                }
+            }
+
+            /* send the data back to the requesting processes */
+            for (k=0,p=0; p<nprocs; p++) {
+                int cnt=0;
+                MPI_Aint disp;
+                MPI_Datatype dtype;
+
+                if (rcnt[p*2] == 0) continue;
+                err = buf_type_create((int)rcnt[p*2], ents+k, &disp, &cnt,
+                                      &dtype);
+                if (err != NC_NOERR && status == NC_NOERR) status = err;
+                TRACE_COMM(MPI_Isend)(staging + disp, cnt, dtype, p,
+                                      TWO_PHASE_TAG_DATA, ncp->comm,
+                                      &reqs[nreqs++]);
+                if (dtype != MPI_BYTE) MPI_Type_free(&dtype);
+                k += rcnt[p*2];
+            }
+            TRACE_COMM(MPI_Waitall)(nreqs, reqs, MPI_STATUSES_IGNORE);
+            if (mpireturn != MPI_SUCCESS) {
+                err = ncmpii_error_mpi2nc(mpireturn, "MPI_Waitall");
+                if (status == NC_NOERR) status = err;
+            }
+        }
+    }
+
+    MPI_Type_free(&pair_type);
+    NCI_Free(reqs);
+    NCI_Free(scnt);
+    NCI_Free(dom_start);
+    if (staging != NULL) NCI_Free(staging);
+    if (rbuf    != NULL) NCI_Free(rbuf);
+    if (rmeta   != NULL) NCI_Free(rmeta);
+    if (ents    != NULL) NCI_Free(ents);
+    if (pmeta   != NULL) NCI_Free(pmeta);
+    if (pcs     != NULL) NCI_Free(pcs);
+
+    /* file access errors only occur on aggregators, report them to all */
+    TRACE_COMM(MPI_Allreduce)(&io_status, &err, 1, MPI_INT, MPI_MIN,
+                              ncp->comm);
+    if (mpireturn != MPI_SUCCESS) {
+        err = ncmpii_error_mpi2nc(mpireturn, "MPI_Allreduce");
+        if (status == NC_NOERR) status = err;
+    }
+    else if (err != NC_NOERR && status == NC_NOERR)
+        status = err;
+
+    /* update the number of bytes accessed by this process */
+    if (status == NC_NOERR) {
+        if (rw_flag == NC_REQ_WR) ncp->put_size += my_bytes;
+        else                      ncp->get_size += my_bytes;
+    }
+
+    return status;
+}
@@ -71,6 +71,17 @@ void ncmpio_set_pnetcdf_hints(NC *ncp, MPI_Info info)
         else if (ncp->chunk < 0) ncp->chunk = 0;
     }
 
+    /* hint on letting root read and decode the header alone and then
+     * broadcast the entire header to others at once */
+    MPI_Info_get(info, "nc_header_bcast_whole", MPI_MAX_INFO_VAL-1, value,
+                 &flag);
+    if (flag) {
+        if (strcasecmp(value, "enable") == 0)
+            ncp->hdr_bcast_whole = 1;
+        else if (strcasecmp(value, "disable") == 0)
+            ncp->hdr_bcast_whole = 0;
+    }
+
     /* hint on setting in-place byte swap (matters only for Little Endian) */
     MPI_Info_get(info, "nc_in_place_swap", MPI_MAX_INFO_VAL-1, value, &flag);
     if (flag) {
@@ -88,6 +99,123 @@ void ncmpio_set_pnetcdf_hints(NC *ncp, MPI_Info info)
         }
     }
 
+    /* hint on using PnetCDF's own two-phase I/O for collective requests */
+    MPI_Info_get(info, "nc_pnetcdf_two_phase", MPI_MAX_INFO_VAL-1, value,
+                 &flag);
+    if (flag) {
+        if (strcasecmp(value, "enable") == 0)
+            ncp->two_phase = 1;
+        else if (strcasecmp(value, "disable") == 0)
+            ncp->two_phase = 0;
+    }
+
+    /* hint on deferring fill of fixed-size variables until file close, data
+     * read, or leaving collective data mode */
+    MPI_Info_get(info, "nc_lazy_fill", MPI_MAX_INFO_VAL-1, value, &flag);
+    if (flag) {
+        if (strcasecmp(value, "enable") == 0)
+            ncp->lazy_fill = 1;
+        else if (strcasecmp(value, "disable") == 0)
+            ncp->lazy_fill = 0;
+    }
+
+    /* hint on deferring the sync of numrecs of collective puts to record
+     * variables until the next collective wait, sync, redef, or close */
+    MPI_Info_get(info, "nc_defer_numrecs", MPI_MAX_INFO_VAL-1, value, &flag);
+    if (flag) {
+        if (strcasecmp(value, "enable") == 0)
+            ncp->defer_numrecs = 1;
+        else if (strcasecmp(value, "disable") == 0)
+            ncp->defer_numrecs = 0;
+    }
+
+    /* number of two-phase I/O aggregators, 0 means decided at run time */
+    MPI_Info_get(info, "nc_two_phase_num_aggrs", MPI_MAX_INFO_VAL-1, value,
+                 &flag);
+    if (flag) {
+        errno = 0;  /* errno must set to zero before calling strtoll */
+        ncp->num_aggrs = (int) strtol(value,NULL,10);
+        if (errno != 0) ncp->num_aggrs = 0;
+        else if (ncp->num_aggrs < 0) ncp->num_aggrs = 0;
+    }
+
+    /* size of staging buffer used by each two-phase I/O aggregator */
+    MPI_Info_get(info, "nc_two_phase_buffer_size", MPI_MAX_INFO_VAL-1, value,
+                 &flag);
+    if (flag) {
+        errno = 0;  /* errno must set to zero before calling strtoll */
+        ncp->tp_bufsize = strtoll(value,NULL,10);
+        if (errno != 0 || ncp->tp_bufsize <= 0)
+            ncp->tp_bufsize = NC_DEFAULT_TWO_PHASE_BUFSIZE;
+        else if (ncp->tp_bufsize > INT_MAX)
+            /* MPI-IO calls take count argument of type int */
+            ncp->tp_bufsize = INT_MAX;
+    }
+
+    /* max size of free temporary buffers kept for reuse */
+    MPI_Info_get(info, "nc_buf_pool_size", MPI_MAX_INFO_VAL-1, value, &flag);
+    if (flag) {
+        errno = 0;  /* errno must set to zero before calling strtoll */
+        ncp->pool_size = strtoll(value,NULL,10);
+        if (errno != 0 || ncp->pool_size < 0)
+            ncp->pool_size = NC_DEFAULT_BUF_POOL_SIZE;
+    }
+
+    /* chunk size for converting and writing large blocking put requests */
+    MPI_Info_get(info, "nc_put_stream_size", MPI_MAX_INFO_VAL-1, value, &flag);
+    if (flag) {
+        errno = 0;  /* errno must set to zero before calling strtoll */
+        ncp->stream_size = strtoll(value,NULL,10);
+        if (errno != 0 || ncp->stream_size < 0)
+            ncp->stream_size = 0;
+        else if (ncp->stream_size > INT_MAX)
+            /* MPI-IO calls take count argument of type int */
+            ncp->stream_size = INT_MAX;
+    }
+
+    /* chunk size for moving data when the header grows in enddef */
+    MPI_Info_get(info, "nc_data_move_chunk_size", MPI_MAX_INFO_VAL-1, value,
+                 &flag);
+    if (flag) {
+        errno = 0;  /* errno must set to zero before calling strtoll */
+        ncp->move_chunk = strtoll(value,NULL,10);
+        if (errno != 0 || ncp->move_chunk <= 0)
+            ncp->move_chunk = NC_DEFAULT_MOVE_CHUNK_SIZE;
+        else if (ncp->move_chunk > INT_MAX)
+            /* MPI-IO calls take count argument of type int */
+            ncp->move_chunk = INT_MAX;
+    }
+
+    /* hint on collecting I/O statistics, see ncmpi_inq_stats() */
+    MPI_Info_get(info, "nc_stats", MPI_MAX_INFO_VAL-1, value, &flag);
+    if (flag) {
+        if (strcasecmp(value, "enable") == 0)
+            ncmpio_stats_enable(ncp, NULL);
+        else if (strcasecmp(value, "disable") == 0 && ncp->stats != NULL) {
+            ncmpio_stats_free(ncp->stats);
+            ncp->stats = NULL;
+        }
+    }
+
+    /* file to dump the I/O statistics of all processes in JSON at file
+     * close, which also enables the collection */
+    MPI_Info_get(info, "nc_stats_file", MPI_MAX_INFO_VAL-1, value, &flag);
+    if (flag && *value != '\0')
+        ncmpio_stats_enable(ncp, value);
+
+#if MPI_VERSION >= 3
+    /* hint on aggregating collective requests within each compute node, which
+     * requires MPI-3 shared memory windows */
+    MPI_Info_get(info, "nc_intra_node_aggr", MPI_MAX_INFO_VAL-1, value,
+                 &flag);
+    if (flag) {
+        if (strcasecmp(value, "enable") == 0)
+            ncp->intra_node_aggr = 1;
+        else if (strcasecmp(value, "disable") == 0)
+            ncp->intra_node_aggr = 0;
+    }
+#endif
+
 #ifdef ENABLE_SUBFILING
     MPI_Info_get(info, "pnetcdf_subfiling", MPI_MAX_INFO_VAL-1, value, &flag);
     if (flag && strcasecmp(value, "enable") == 0)
@@ -313,6 +441,533 @@ ncmpio_access_range(const NC         *ncp,
     return NC_NOERR;
 }
 
+/* The memory layout of a user buffer, when described by an MPI datatype made
+ * of contiguous, vector, hvector, subarray, or resized constructors of a
+ * single predefined type. Element (i_0, i_1, ..., i_{ndims-1}) is at byte
+ * displacement disp + i_0 * stride[0] + ... + i_{ndims-1} * stride[ndims-1]
+ * of the buffer. Such layouts can be walked without MPI_Pack/MPI_Unpack, so
+ * packing, type conversion, and byte swap are fused into a single pass.
+ */
+#define LAYOUT_MAX_DIMS 32
+
+/* elements gathered into a buffer on stack before conversion */
+#define FUSED_STAGE_SIZE 4096
+
+/* the stage is accessed as elements of any type, so align it for the
+ * largest ones */
+typedef union {
+    char      c[FUSED_STAGE_SIZE];
+    double    d[FUSED_STAGE_SIZE/sizeof(double)];
+    long long ll[FUSED_STAGE_SIZE/sizeof(long long)];
+} fused_stage;
+
+/* contiguous runs of at least this many elements are converted in place */
+#define FUSED_MIN_RUN 64
+
+typedef struct {
+    int        ndims;
+    MPI_Offset disp;
+    MPI_Offset count[LAYOUT_MAX_DIMS];
+    MPI_Offset stride[LAYOUT_MAX_DIMS]; /* in bytes */
+} mem_layout;
+
+typedef struct {
+    const mem_layout *lp;
+    MPI_Offset        idx[LAYOUT_MAX_DIMS];
+    char             *ptr; /* address of the current element */
+} layout_cursor;
+
+/*----< layout_prepend() >---------------------------------------------------*/
+/* add an outermost dimension, return 0 if there are too many dimensions */
+static int
+layout_prepend(mem_layout *lp,
+               MPI_Offset  count,
+               MPI_Offset  stride)
+{
+    if (count == 1) return 1;
+    if (lp->ndims == LAYOUT_MAX_DIMS) return 0;
+
+    memmove(lp->count+1,  lp->count,  (size_t)lp->ndims * sizeof(MPI_Offset));
+    memmove(lp->stride+1, lp->stride, (size_t)lp->ndims * sizeof(MPI_Offset));
+    lp->count[0]  = count;
+    lp->stride[0] = stride;
+    lp->ndims++;
+    return 1;
+}
+
+/*----< layout_decode() >----------------------------------------------------*/
+/* Decode dtype into the layout of its elements of el_size bytes. Return 1 if
+ * successful, 0 if dtype is made of other constructors.
+ */
+static int
+layout_decode(MPI_Datatype  dtype,
+              int           el_size,
+              mem_layout   *lp)
+{
+    int ok=0, num_ints, num_adds, num_dtypes, combiner, type_size;
+    int *ints;
+    MPI_Aint *adds, lb, old_extent;
+    MPI_Datatype *dtypes;
+
+    MPI_Type_get_envelope(dtype, &num_ints, &num_adds, &num_dtypes, &combiner);
+
+    if (combiner == MPI_COMBINER_NAMED) { /* predefined datatype */
+        MPI_Type_size(dtype, &type_size);
+        lp->ndims = 0;
+        lp->disp  = 0;
+        return (type_size == el_size);
+    }
+
+    /* all constructors handled below have a single old type */
+    if (num_dtypes != 1) return 0;
+
+    ints   = (int*)         NCI_Malloc(sizeof(int)      * (size_t)(num_ints + 1));
+    adds   = (MPI_Aint*)    NCI_Malloc(sizeof(MPI_Aint) * (size_t)(num_adds + 1));
+    dtypes = (MPI_Datatype*)NCI_Malloc(sizeof(MPI_Datatype));
+
+    MPI_Type_get_contents(dtype, num_ints, num_adds, num_dtypes, ints, adds,
+                          dtypes);
+
+    if (!layout_decode(dtypes[0], el_size, lp)) goto fn_exit;
+    MPI_Type_get_extent(dtypes[0], &lb, &old_extent);
+
+    switch (combiner) {
+#ifdef HAVE_DECL_MPI_COMBINER_DUP
+        case MPI_COMBINER_DUP:
+#endif
+#ifdef HAVE_DECL_MPI_COMBINER_RESIZED
+        case MPI_COMBINER_RESIZED: /* extent only matters to the outer type */
+#endif
+            ok = 1;
+            break;
+        case MPI_COMBINER_CONTIGUOUS:
+            ok = layout_prepend(lp, ints[0], old_extent);
+            break;
+        case MPI_COMBINER_VECTOR:
+            ok = layout_prepend(lp, ints[1], old_extent) &&
+                 layout_prepend(lp, ints[0], (MPI_Offset)ints[2] * old_extent);
+            break;
+        case MPI_COMBINER_HVECTOR:
+            ok = layout_prepend(lp, ints[1], old_extent) &&
+                 layout_prepend(lp, ints[0], adds[0]);
+            break;
+#ifdef HAVE_DECL_MPI_COMBINER_SUBARRAY
+        case MPI_COMBINER_SUBARRAY: {
+            int i, ndims = ints[0], order = ints[3*ndims+1];
+            MPI_Offset stride = old_extent;
+            ok = 1;
+            for (i=0; i<ndims && ok; i++) {
+                /* start from the fastest changing dimension */
+                int dim = (order == MPI_ORDER_C) ? ndims-1-i : i;
+                lp->disp += ints[2*ndims+1+dim] * stride;
+                ok = layout_prepend(lp, ints[ndims+1+dim], stride);
+                stride *= ints[1+dim];
+            }
+            break;
+        }
+#endif
+        default:
+            break;
+    }
+
+fn_exit:
+    MPI_Type_get_envelope(dtypes[0], &num_ints, &num_adds, &num_dtypes,
+                          &combiner);
+    if (combiner != MPI_COMBINER_NAMED) MPI_Type_free(dtypes);
+    NCI_Free(dtypes);
+    NCI_Free(adds);
+    NCI_Free(ints);
+    return ok;
+}
+
+/*----< layout_create() >----------------------------------------------------*/
+/* Create the layout of count instances of dtype, which should contain nelems
+ * elements of el_size bytes in total. Adjacent dimensions are merged when
+ * possible, so the innermost dimension is as long as possible. Return 1 if
+ * successful.
+ */
+static int
+layout_create(MPI_Datatype  dtype,
+              MPI_Offset    count,
+              int           el_size,
+              MPI_Offset    nelems,
+              mem_layout   *lp)
+{
+    int i;
+    MPI_Aint lb, extent;
+    MPI_Offset total;
+
+    if (!layout_decode(dtype, el_size, lp)) return 0;
+
+    MPI_Type_get_extent(dtype, &lb, &extent);
+    if (!layout_prepend(lp, count, extent)) return 0;
+
+    /* merge dimension i into i+1 when their elements are evenly spaced */
+    for (i=lp->ndims-2; i>=0; i--) {
+        if (lp->stride[i] != lp->count[i+1] * lp->stride[i+1]) continue;
+        lp->count[i+1] *= lp->count[i];
+        memmove(lp->count+i,  lp->count+i+1,
+                (size_t)(lp->ndims-i-1) * sizeof(MPI_Offset));
+        memmove(lp->stride+i, lp->stride+i+1,
+                (size_t)(lp->ndims-i-1) * sizeof(MPI_Offset));
+        lp->ndims--;
+    }
+    if (lp->ndims == 0) { /* a single element */
+        lp->ndims     = 1;
+        lp->count[0]  = 1;
+        lp->stride[0] = el_size;
+    }
+
+    for (total=1, i=0; i<lp->ndims; i++) total *= lp->count[i];
+    return (total == nelems);
+}
+
+/*----< cursor_advance() >---------------------------------------------------*/
+/* move the cursor n elements forward along the innermost dimension */
+static void
+cursor_advance(layout_cursor *cur,
+               MPI_Offset     n)
+{
+    int dim = cur->lp->ndims - 1;
+    const MPI_Offset *count = cur->lp->count, *stride = cur->lp->stride;
+
+    cur->ptr += n * stride[dim];
+    cur->idx[dim] += n;
+    while (dim > 0 && cur->idx[dim] == count[dim]) {
+        cur->ptr -= count[dim] * stride[dim];
+        cur->idx[dim] = 0;
+        dim--;
+        cur->idx[dim]++;
+        cur->ptr += stride[dim];
+    }
+}
+
+/*----< gather_elems() >-----------------------------------------------------*/
+static void
+gather_elems(char             *dst,
+             const char       *src,
+             MPI_Offset        n,
+             MPI_Offset        stride,
+             int               el_size)
+{
+    MPI_Offset i;
+    switch (el_size) {
+        case 1: for (i=0; i<n; i++, src+=stride) dst[i] = *src;
+                break;
+        case 2: for (i=0; i<n; i++, src+=stride) memcpy(dst+i*2, src, 2);
+                break;
+        case 4: for (i=0; i<n; i++, src+=stride) memcpy(dst+i*4, src, 4);
+                break;
+        case 8: for (i=0; i<n; i++, src+=stride) memcpy(dst+i*8, src, 8);
+                break;
+        default:
+            for (i=0; i<n; i++, src+=stride)
+                memcpy(dst+i*el_size, src, (size_t)el_size);
+    }
+}
+
+/*----< scatter_elems() >----------------------------------------------------*/
+static void
+scatter_elems(char             *dst,
+              const char       *src,
+              MPI_Offset        n,
+              MPI_Offset        stride,
+              int               el_size)
+{
+    MPI_Offset i;
+    switch (el_size) {
+        case 1: for (i=0; i<n; i++, dst+=stride) *dst = src[i];
+                break;
+        case 2: for (i=0; i<n; i++, dst+=stride) memcpy(dst, src+i*2, 2);
+                break;
+        case 4: for (i=0; i<n; i++, dst+=stride) memcpy(dst, src+i*4, 4);
+                break;
+        case 8: for (i=0; i<n; i++, dst+=stride) memcpy(dst, src+i*8, 8);
+                break;
+        default:
+            for (i=0; i<n; i++, dst+=stride)
+                memcpy(dst, src+i*el_size, (size_t)el_size);
+    }
+}
+
+/*----< putn_xbuf() >--------------------------------------------------------*/
+/* type-convert and/or byte-swap nelems elements from cbuf to xbuf */
+static int
+putn_xbuf(int           fmt,
+          NC_var       *varp,
+          int           need_convert,
+          void         *xbuf,
+          const void   *cbuf,
+          MPI_Offset    nelems,
+          MPI_Datatype  etype,
+          void         *fillp)
+{
+    int err=NC_NOERR;
+
+    if (!need_convert) { /* copy with byte swap */
+        switch (varp->xsz) {
+            case 2:  ncmpii_swapn2b(xbuf, cbuf, nelems); break;
+            case 4:  ncmpii_swapn4b(xbuf, cbuf, nelems); break;
+            case 8:  ncmpii_swapn8b(xbuf, cbuf, nelems); break;
+            default: memcpy(xbuf, cbuf, (size_t)(nelems * varp->xsz));
+        }
+        return NC_NOERR;
+    }
+
+    /* datatype conversion + byte-swap from cbuf to xbuf */
+    switch(varp->xtype) {
+        case NC_BYTE:
+            err = ncmpii_putn_NC_BYTE(fmt,xbuf,cbuf,nelems,etype,fillp);
+            break;
+        case NC_UBYTE:
+            err = ncmpii_putn_NC_UBYTE(xbuf,cbuf,nelems,etype,fillp);
+            break;
+        case NC_SHORT:
+            err = ncmpii_putn_NC_SHORT(xbuf,cbuf,nelems,etype,fillp);
+            break;
+        case NC_USHORT:
+            err = ncmpii_putn_NC_USHORT(xbuf,cbuf,nelems,etype,fillp);
+            break;
+        case NC_INT:
+            err = ncmpii_putn_NC_INT(xbuf,cbuf,nelems,etype,fillp);
+            break;
+        case NC_UINT:
+            err = ncmpii_putn_NC_UINT(xbuf,cbuf,nelems,etype,fillp);
+            break;
+        case NC_FLOAT:
+            err = ncmpii_putn_NC_FLOAT(xbuf,cbuf,nelems,etype,fillp);
+            break;
+        case NC_DOUBLE:
+            err = ncmpii_putn_NC_DOUBLE(xbuf,cbuf,nelems,etype,fillp);
+            break;
+        case NC_INT64:
+            err = ncmpii_putn_NC_INT64(xbuf,cbuf,nelems,etype,fillp);
+            break;
+        case NC_UINT64:
+            err = ncmpii_putn_NC_UINT64(xbuf,cbuf,nelems,etype,fillp);
+            break;
+        default:
+            err = NC_EBADTYPE; /* this never happens */
+            break;
+    }
+    /* The only error codes returned from the above switch block are
+     * NC_EBADTYPE or NC_ERANGE. Bad varp->xtype and itype have been sanity
+     * checked at the dispatchers, so NC_EBADTYPE is not possible. Thus,
+     * the only possible error is NC_ERANGE.  NC_ERANGE can be caused by
+     * one or more elements of buf that is out of range representable by
+     * the external data type, it is not considered a fatal error. This
+     * request must continue to finish.
+     */
+    return err;
+}
+
+/*----< getn_xbuf() >--------------------------------------------------------*/
+/* type-convert and/or byte-swap nelems elements from xbuf to cbuf */
+static int
+getn_xbuf(int           fmt,
+          NC_var       *varp,
+          int           need_convert,
+          const void   *xbuf,
+          void         *cbuf,
+          MPI_Offset    nelems,
+          MPI_Datatype  etype)
+{
+    int err=NC_NOERR;
+
+    if (!need_convert) { /* copy with byte swap */
+        switch (varp->xsz) {
+            case 2:  ncmpii_swapn2b(cbuf, xbuf, nelems); break;
+            case 4:  ncmpii_swapn4b(cbuf, xbuf, nelems); break;
+            case 8:  ncmpii_swapn8b(cbuf, xbuf, nelems); break;
+            default: memcpy(cbuf, xbuf, (size_t)(nelems * varp->xsz));
+        }
+        return NC_NOERR;
+    }
+
+    /* datatype conversion + byte-swap from xbuf to cbuf */
+    switch(varp->xtype) {
+        case NC_BYTE:
+            err = ncmpii_getn_NC_BYTE(fmt,xbuf,cbuf,nelems,etype);
+            break;
+        case NC_UBYTE:
+            err = ncmpii_getn_NC_UBYTE(xbuf,cbuf,nelems,etype);
+            break;
+        case NC_SHORT:
+            err = ncmpii_getn_NC_SHORT(xbuf,cbuf,nelems,etype);
+            break;
+        case NC_USHORT:
+            err = ncmpii_getn_NC_USHORT(xbuf,cbuf,nelems,etype);
+            break;
+        case NC_INT:
+            err = ncmpii_getn_NC_INT(xbuf,cbuf,nelems,etype);
+            break;
+        case NC_UINT:
+            err = ncmpii_getn_NC_UINT(xbuf,cbuf,nelems,etype);
+            break;
+        case NC_FLOAT:
+            err = ncmpii_getn_NC_FLOAT(xbuf,cbuf,nelems,etype);
+            break;
+        case NC_DOUBLE:
+            err = ncmpii_getn_NC_DOUBLE(xbuf,cbuf,nelems,etype);
+            break;
+        case NC_INT64:
+            err = ncmpii_getn_NC_INT64(xbuf,cbuf,nelems,etype);
+            break;
+        case NC_UINT64:
+            err = ncmpii_getn_NC_UINT64(xbuf,cbuf,nelems,etype);
+            break;
+        default:
+            err = NC_EBADTYPE; /* this never happens */
+            break;
+    }
+    /* The only error codes returned from the above switch block are
+     * NC_EBADTYPE or NC_ERANGE. Bad varp->xtype and itype have been sanity
+     * checked at the dispatchers, so NC_EBADTYPE is not possible. Thus,
+     * the only possible error is NC_ERANGE.  NC_ERANGE can be caused by
+     * one or more elements of buf that is out of range representable by
+     * the external data type, it is not considered a fatal error. This
+     * request must continue to finish.
+     */
+    return err;
+}
+
+/*----< fused_layout() >-----------------------------------------------------*/
+/* Find the layout walked by the fused pack and unpack. When imaptype is used,
+ * it is the layout of imaptype, which is applied to buf if buftype is
+ * contiguous, or to a contiguous buffer packed from buf otherwise. Return 1
+ * if the layout is supported.
+ */
+static int
+fused_layout(MPI_Offset    bufcount,
+             MPI_Datatype  buftype,
+             MPI_Offset    nelems,
+             int           el_size,
+             MPI_Datatype  imaptype,
+             mem_layout   *lp)
+{
+    if (imaptype != MPI_DATATYPE_NULL)
+        return layout_create(imaptype, 1, el_size, nelems, lp);
+
+    return layout_create(buftype, bufcount, el_size, nelems, lp);
+}
+
+/*----< fused_pack() >-------------------------------------------------------*/
+/* Walk the layout of buf and write the elements, type-converted and/or
+ * byte-swapped, to xbuf in a single pass. Long contiguous runs of elements
+ * are converted directly from buf. Short or strided runs are first gathered
+ * into a small buffer on stack.
+ */
+static int
+fused_pack(int               fmt,
+           NC_var           *varp,
+           const mem_layout *lp,
+           const void       *buf,
+           MPI_Offset        nelems,
+           MPI_Datatype      etype,
+           int               el_size,
+           int               need_convert,
+           void             *fillp,
+           void             *xbuf)
+{
+    fused_stage stage;
+    char *xp=(char*)xbuf;
+    int err, status=NC_NOERR, dim=lp->ndims-1;
+    MPI_Offset n, nstage=0, max_stage=FUSED_STAGE_SIZE/el_size;
+    layout_cursor cur;
+
+    cur.lp  = lp;
+    cur.ptr = (char*)buf + lp->disp;
+    memset(cur.idx, 0, (size_t)lp->ndims * sizeof(MPI_Offset));
+
+    while (nelems > 0) {
+        n = lp->count[dim] - cur.idx[dim]; /* rest of the current run */
+        if (lp->stride[dim] == el_size && n >= FUSED_MIN_RUN) {
+            /* flush the stage, then convert the run directly from buf */
+            if (nstage > 0) {
+                err = putn_xbuf(fmt, varp, need_convert, xp, stage.c, nstage,
+                                etype, fillp);
+                if (status == NC_NOERR) status = err;
+                xp += nstage * varp->xsz;
+                nstage = 0;
+            }
+            err = putn_xbuf(fmt, varp, need_convert, xp, cur.ptr, n, etype,
+                            fillp);
+            if (status == NC_NOERR) status = err;
+            xp += n * varp->xsz;
+        }
+        else {
+            n = MIN(n, max_stage - nstage);
+            gather_elems(stage.c + nstage * el_size, cur.ptr, n,
+                         lp->stride[dim], el_size);
+            nstage += n;
+            if (nstage == max_stage || n == nelems) {
+                err = putn_xbuf(fmt, varp, need_convert, xp, stage.c, nstage,
+                                etype, fillp);
+                if (status == NC_NOERR) status = err;
+                xp += nstage * varp->xsz;
+                nstage = 0;
+            }
+        }
+        nelems -= n;
+        cursor_advance(&cur, n);
+    }
+    return status;
+}
+
+/*----< fused_unpack() >-----------------------------------------------------*/
+/* Convert and/or byte-swap the elements in xbuf and scatter them to buf based
+ * on its layout in a single pass. This is the reverse of fused_pack().
+ */
+static int
+fused_unpack(int               fmt,
+             NC_var           *varp,
+             const mem_layout *lp,
+             void             *buf,
+             MPI_Offset        nelems,
+             MPI_Datatype      etype,
+             int               el_size,
+             int               need_convert,
+             const void       *xbuf)
+{
+    fused_stage stage;
+    char *xp=(char*)xbuf;
+    int err, status=NC_NOERR, dim=lp->ndims-1;
+    MPI_Offset n, nstage=0, pos=0, max_stage=FUSED_STAGE_SIZE/el_size;
+    layout_cursor cur;
+
+    cur.lp  = lp;
+    cur.ptr = (char*)buf + lp->disp;
+    memset(cur.idx, 0, (size_t)lp->ndims * sizeof(MPI_Offset));
+
+    while (nelems > 0) {
+        n = lp->count[dim] - cur.idx[dim]; /* rest of the current run */
+        if (pos == nstage && lp->stride[dim] == el_size &&
+            n >= FUSED_MIN_RUN) {
+            /* stage is empty, convert the run directly into buf */
+            err = getn_xbuf(fmt, varp, need_convert, xp, cur.ptr, n, etype);
+            if (status == NC_NOERR) status = err;
+            xp += n * varp->xsz;
+        }
+        else {
+            if (pos == nstage) { /* convert the next chunk of xbuf */
+                nstage = MIN(nelems, max_stage);
+                err = getn_xbuf(fmt, varp, need_convert, xp, stage.c, nstage,
+                                etype);
+                if (status == NC_NOERR) status = err;
+                xp += nstage * varp->xsz;
+                pos = 0;
+            }
+            n = MIN(n, nstage - pos);
+            scatter_elems(cur.ptr, stage.c + pos * el_size, n,
+                          lp->stride[dim], el_size);
+            pos += n;
+        }
+        nelems -= n;
+        cursor_advance(&cur, n);
+    }
+    return status;
+}
+
 /*----< ncmpio_pack_xbuf() >-------------------------------------------------*/
 /* Pack user buffer, buf, into xbuf, when buftype is non-contiguous or imap
  * is non-contiguous, or type-casting is needed. The immediate buffers, lbuf
@@ -397,6 +1052,44 @@ ncmpio_pack_xbuf(int           fmt,    /* NC_FORMAT_CDF2 NC_FORMAT_CDF5 etc. */
     ibuf_size = nelems * el_size;
     if (ibuf_size > INT_MAX) DEBUG_RETURN_ERROR(NC_EINTOVERFLOW)
 
+    /* When type conversion or byte swap is needed for a noncontiguous buftype
+     * or imap, try to pack, convert, and byte-swap in a single pass.
+     */
+    if ((need_convert || need_swap) &&
+        (!buftype_is_contig || imaptype != MPI_DATATYPE_NULL)) {
+        mem_layout layout;
+
+        if (fused_layout(bufcount, buftype, nelems, el_size, imaptype,
+                         &layout)) {
+            void *fillp=NULL; /* fill value in internal representation */
+
+            if (imaptype != MPI_DATATYPE_NULL && !buftype_is_contig) {
+                /* imaptype is walked on buf packed based on buftype */
+                if (bufcount > INT_MAX) DEBUG_RETURN_ERROR(NC_EINTOVERFLOW)
+                lbuf = NCI_Malloc((size_t)ibuf_size);
+                if (lbuf == NULL) DEBUG_RETURN_ERROR(NC_ENOMEM)
+                position = 0;
+                MPI_Pack(buf, (int)bufcount, buftype, lbuf, (int)ibuf_size,
+                         &position, MPI_COMM_SELF);
+            }
+            else
+                lbuf = buf;
+
+            if (need_convert) {
+                fillp = NCI_Malloc((size_t)varp->xsz);
+                ncmpio_inq_var_fill(varp, fillp);
+            }
+
+            err = fused_pack(fmt, varp, &layout, lbuf, nelems, etype, el_size,
+                             need_convert, fillp, xbuf);
+
+            if (fillp != NULL) NCI_Free(fillp);
+            if (lbuf != buf) NCI_Free(lbuf);
+            if (imaptype != MPI_DATATYPE_NULL) MPI_Type_free(&imaptype);
+            return err;
+        }
+    }
+
     /* Step 1: if buftype is not contiguous, i.e. a noncontiguous MPI
      * derived datatype, pack buf into a contiguous buffer, lbuf,
      */
@@ -456,49 +1149,8 @@ ncmpio_pack_xbuf(int           fmt,    /* NC_FORMAT_CDF2 NC_FORMAT_CDF5 etc. */
         ncmpio_inq_var_fill(varp, fillp);
 
         /* datatype conversion + byte-swap from cbuf to xbuf */
-        switch(varp->xtype) {
-            case NC_BYTE:
-                err = ncmpii_putn_NC_BYTE(fmt,xbuf,cbuf,nelems,etype,fillp);
-                break;
-            case NC_UBYTE:
-                err = ncmpii_putn_NC_UBYTE(xbuf,cbuf,nelems,etype,fillp);
-                break;
-            case NC_SHORT:
-                err = ncmpii_putn_NC_SHORT(xbuf,cbuf,nelems,etype,fillp);
-                break;
-            case NC_USHORT:
-                err = ncmpii_putn_NC_USHORT(xbuf,cbuf,nelems,etype,fillp);
-                break;
-            case NC_INT:
-                err = ncmpii_putn_NC_INT(xbuf,cbuf,nelems,etype,fillp);
-                break;
-            case NC_UINT:
-                err = ncmpii_putn_NC_UINT(xbuf,cbuf,nelems,etype,fillp);
-                break;
-            case NC_FLOAT:
-                err = ncmpii_putn_NC_FLOAT(xbuf,cbuf,nelems,etype,fillp);
-                break;
-            case NC_DOUBLE:
-                err = ncmpii_putn_NC_DOUBLE(xbuf,cbuf,nelems,etype,fillp);
-                break;
-            case NC_INT64:
-                err = ncmpii_putn_NC_INT64(xbuf,cbuf,nelems,etype,fillp);
-                break;
-            case NC_UINT64:
-                err = ncmpii_putn_NC_UINT64(xbuf,cbuf,nelems,etype,fillp);
-                break;
-            default:
-                err = NC_EBADTYPE; /* this never happens */
-                break;
-        }
-        /* The only error codes returned from the above switch block are
-	 * NC_EBADTYPE or NC_ERANGE. Bad varp->xtype and itype have been sanity
-	 * checked at the dispatchers, so NC_EBADTYPE is not possible. Thus,
-	 * the only possible error is NC_ERANGE.  NC_ERANGE can be caused by
-	 * one or more elements of buf that is out of range representable by
-	 * the external data type, it is not considered a fatal error. This
-	 * request must continue to finish.
-         */
+        err = putn_xbuf(fmt, varp, need_convert, xbuf, cbuf, nelems, etype,
+                        fillp);
 
         NCI_Free(fillp);
         if (cbuf != buf) NCI_Free(cbuf);
@@ -567,6 +1219,44 @@ ncmpio_unpack_xbuf(int           fmt,   /* NC_FORMAT_CDF2 NC_FORMAT_CDF5 etc. */
     ibuf_size = nelems * el_size;
     if (ibuf_size > INT_MAX) DEBUG_RETURN_ERROR(NC_EINTOVERFLOW)
 
+    /* When type conversion or byte swap is needed for a noncontiguous buftype
+     * or imap, try to convert, byte-swap, and unpack in a single pass.
+     */
+    if ((need_convert || need_swap) &&
+        (!buftype_is_contig || imaptype != MPI_DATATYPE_NULL)) {
+        mem_layout layout;
+
+        if (fused_layout(bufcount, buftype, nelems, el_size, imaptype,
+                         &layout)) {
+            if (imaptype != MPI_DATATYPE_NULL && !buftype_is_contig) {
+                /* imaptype is walked on lbuf, later unpacked to buf based
+                 * on buftype */
+                lbuf = NCI_Malloc((size_t)ibuf_size);
+                if (lbuf == NULL) DEBUG_RETURN_ERROR(NC_ENOMEM)
+            }
+            else
+                lbuf = buf;
+
+            err = fused_unpack(fmt, varp, &layout, lbuf, nelems, etype,
+                               el_size, need_convert, xbuf);
+
+            if (imaptype != MPI_DATATYPE_NULL) MPI_Type_free(&imaptype);
+            if (lbuf != buf) {
+                if (bufcount > INT_MAX) {
+                    if (err == NC_NOERR)
+                        DEBUG_ASSIGN_ERROR(err, NC_EINTOVERFLOW)
+                }
+                else {
+                    position = 0;
+                    MPI_Unpack(lbuf, (int)ibuf_size, &position, buf,
+                               (int)bufcount, buftype, MPI_COMM_SELF);
+                }
+                NCI_Free(lbuf);
+            }
+            return err;
+        }
+    }
+
     /* Step 1: type-convert and byte-swap xbuf to cbuf, and xbuf contains data
      * read from file
      */
@@ -582,49 +1272,7 @@ ncmpio_unpack_xbuf(int           fmt,   /* NC_FORMAT_CDF2 NC_FORMAT_CDF5 etc. */
         }
 
         /* datatype conversion + byte-swap from xbuf to cbuf */
-        switch(varp->xtype) {
-            case NC_BYTE:
-                err = ncmpii_getn_NC_BYTE(fmt,xbuf,cbuf,nelems,etype);
-                break;
-            case NC_UBYTE:
-                err = ncmpii_getn_NC_UBYTE(xbuf,cbuf,nelems,etype);
-                break;
-            case NC_SHORT:
-                err = ncmpii_getn_NC_SHORT(xbuf,cbuf,nelems,etype);
-                break;
-            case NC_USHORT:
-                err = ncmpii_getn_NC_USHORT(xbuf,cbuf,nelems,etype);
-                break;
-            case NC_INT:
-                err = ncmpii_getn_NC_INT(xbuf,cbuf,nelems,etype);
-                break;
-            case NC_UINT:
-                err = ncmpii_getn_NC_UINT(xbuf,cbuf,nelems,etype);
-                break;
-            case NC_FLOAT:
-                err = ncmpii_getn_NC_FLOAT(xbuf,cbuf,nelems,etype);
-                break;
-            case NC_DOUBLE:
-                err = ncmpii_getn_NC_DOUBLE(xbuf,cbuf,nelems,etype);
-                break;
-            case NC_INT64:
-                err = ncmpii_getn_NC_INT64(xbuf,cbuf,nelems,etype);
-                break;
-            case NC_UINT64:
-                err = ncmpii_getn_NC_UINT64(xbuf,cbuf,nelems,etype);
-                break;
-            default:
-                err = NC_EBADTYPE; /* this never happens */
-                break;
-        }
-        /* The only error codes returned from the above switch block are
-	 * NC_EBADTYPE or NC_ERANGE. Bad varp->xtype and itype have been sanity
-	 * checked at the dispatchers, so NC_EBADTYPE is not possible. Thus,
-	 * the only possible error is NC_ERANGE.  NC_ERANGE can be caused by
-	 * one or more elements of buf that is out of range representable by
-	 * the external data type, it is not considered a fatal error. This
-	 * request must continue to finish.
-         */
+        err = getn_xbuf(fmt, varp, need_convert, xbuf, cbuf, nelems, etype);
     }
     else {
         if (need_swap) /* perform array in-place byte swap on xbuf */
@@ -48,6 +48,7 @@ ncmpio_free_NC_var(NC_var *varp)
     if (varp->shape  != NULL) NCI_Free(varp->shape);
     if (varp->dsizes != NULL) NCI_Free(varp->dsizes);
     if (varp->dimids != NULL) NCI_Free(varp->dimids);
+    if (varp->written != NULL) NCI_Free(varp->written);
 
     NCI_Free(varp);
 }
@@ -145,7 +146,7 @@ ncmpio_free_NC_vararray(NC_vararray *ncap)
 
 #ifndef SEARCH_NAME_LINEARLY
     /* free space allocated for var name lookup table */
-    ncmpio_hash_table_free(ncap->nameT);
+    ncmpio_hash_table_free(&ncap->nameT);
 #endif
 }
 
@@ -162,6 +163,12 @@ ncmpio_dup_NC_vararray(NC_vararray       *ncap,
     if (ref->ndefined == 0) {
         ncap->ndefined = 0;
         ncap->value = NULL;
+#ifndef SEARCH_NAME_LINEARLY
+        /* do not share the lookup table of ref */
+        ncap->nameT.nalloc = 0;
+        ncap->nameT.nused  = 0;
+        ncap->nameT.slots  = NULL;
+#endif
         return NC_NOERR;
     }
 
@@ -189,7 +196,11 @@ ncmpio_dup_NC_vararray(NC_vararray       *ncap,
 
 #ifndef SEARCH_NAME_LINEARLY
     /* duplicate var name lookup table */
-    ncmpio_hash_table_copy(ncap->nameT, ref->nameT);
+    status = ncmpio_hash_table_copy(&ncap->nameT, &ref->nameT);
+    if (status != NC_NOERR) {
+        ncmpio_free_NC_vararray(ncap);
+        return status;
+    }
 #endif
 
     return NC_NOERR;
@@ -254,20 +265,21 @@ NC_findvar(const NC_vararray  *ncap,
            const char         *name,  /* normalized name */
            int                *varidp)
 {
-    int i, key, varid;
+    int pos, varid;
+    unsigned int hash;
     size_t nchars;
 
     assert (ncap != NULL);
 
     if (ncap->ndefined == 0) return NC_ENOTVAR;
 
-    /* hash the var name into a key for name lookup */
-    key = HASH_FUNC(name);
+    /* hash the var name for name lookup */
+    hash = HASH_FUNC(name);
 
-    /* check the list using linear search */
+    /* check the names of the IDs with the same hash value */
     nchars = strlen(name);
-    for (i=0; i<ncap->nameT[key].num; i++) {
-        varid = ncap->nameT[key].list[i];
+    pos = -1;
+    while ((varid = ncmpio_hash_lookup(&ncap->nameT, hash, &pos)) >= 0) {
         if (ncap->value[varid]->name_len == nchars &&
             strcmp(ncap->value[varid]->name, name) == 0) {
             if (varidp != NULL) *varidp = varid;
@@ -428,6 +440,18 @@ ncmpio_def_var(void       *ncdp,
         }
     }
 
+#ifndef SEARCH_NAME_LINEARLY
+    /* insert nname to the lookup table. This is done before the variable is
+     * counted in ncp->vars, so a failure leaves no variable that cannot be
+     * found by name */
+    err = ncmpio_hash_insert(&ncp->vars.nameT, nname, ncp->vars.ndefined);
+    if (err != NC_NOERR) {
+        ncmpio_free_NC_var(varp);
+        nname = NULL; /* already freed in ncmpio_free_NC_var() */
+        goto err_check;
+    }
+#endif
+
     varp->varid = ncp->vars.ndefined; /* varid */
 
     /* Add a new handle to the end of an array of handles */
@@ -458,11 +482,6 @@ err_check:
 
     assert(nname != NULL);
 
-#ifndef SEARCH_NAME_LINEARLY
-    /* insert nname to the lookup table */
-    ncmpio_hash_insert(ncp->vars.nameT, nname, varp->varid);
-#endif
-
     if (varidp != NULL) *varidp = varp->varid;
 
     /* default is NOFILL */
@@ -610,7 +629,7 @@ ncmpio_rename_var(void       *ncdp,
 
 #ifndef SEARCH_NAME_LINEARLY
     /* update var name lookup table */
-    err = ncmpio_update_name_lookup_table(ncp->vars.nameT, varid,
+    err = ncmpio_update_name_lookup_table(&ncp->vars.nameT, varid,
                         ncp->vars.value[varid]->name, nnewname);
     if (err != NC_NOERR) {
         DEBUG_TRACE_ERROR(err)
@@ -8,8 +8,11 @@
  * This file implements the corresponding APIs defined in
  * src/dispatchers/var_getput.m4
  *
- * ncmpi_get_vard() : dispatcher->get_vard()
- * ncmpi_put_vard() : dispatcher->put_vard()
+ * ncmpi_get_vard()  : dispatcher->get_vard()
+ * ncmpi_put_vard()  : dispatcher->put_vard()
+ * ncmpi_iget_vard() : dispatcher->iget_vard()
+ * ncmpi_iput_vard() : dispatcher->iput_vard()
+ * ncmpi_bput_vard() : dispatcher->bput_vard()
  */
 
 #ifdef HAVE_CONFIG_H
@@ -53,6 +56,7 @@ getput_vard(NC               *ncp,
     int isderived, el_size, mpireturn, status=NC_NOERR, err=NC_NOERR;
     int buftype_is_contig=0, filetype_is_contig=1, is_buf_swapped=0;
     int need_swap=0, buftype_size=0;
+    double timing;
     MPI_Offset btnelems=0, bnelems=0, offset=0, orig_bufcount=bufcount;
     MPI_Status mpistatus;
     MPI_Datatype ptype, orig_buftype=buftype;
@@ -120,6 +124,9 @@ getput_vard(NC               *ncp,
         goto err_check;
     }
 
+    if (ncp->stats != NULL)
+        ncmpio_stats_add(ncp, varp, NC_STATS_VARD, reqMode, filetype_size);
+
     /* filetype's lb may not always be 0 (e.g. created by constructor
      * MPI_Type_create_hindexed), we need to find the true last byte accessed
      * by this request, true_ub, in order to calculate new_numrecs.
@@ -292,6 +299,7 @@ err_check:
     memset(&mpistatus, 0, sizeof(MPI_Status));
 #endif
 
+    timing = NC_STATS_WTIME(ncp);
     if (fIsSet(reqMode, NC_REQ_WR)) {
         if (fIsSet(reqMode, NC_REQ_COLL)) {
             TRACE_IO(MPI_File_write_at_all)(fh, offset, cbuf, (int)bufcount,
@@ -338,6 +346,7 @@ err_check:
 #endif
         }
     }
+    NC_STATS_ADD_TIME(ncp, NC_STATS_TIME_MPIIO, timing)
 
     /* No longer need to reset the file view, as the root's fileview includes
      * the whole file header.
@@ -368,12 +377,14 @@ err_check:
             MPI_Offset new_numrecs = true_ub / ncp->recsize;
             if (true_ub % ncp->recsize) new_numrecs++;
 
-            if (fIsSet(reqMode, NC_REQ_INDEP)) {
+            if (fIsSet(reqMode, NC_REQ_INDEP) || ncp->defer_numrecs) {
                 /* For independent put, we delay the sync for numrecs until
                  * the next collective call, such as end_indep(), sync(),
                  * enddef(), or close(). This is because if we update numrecs
                  * to file now, race condition can happen. Note numrecs in
                  * memory may be inconsistent and obsolete till then.
+                 * Collective put also delays it when hint nc_defer_numrecs
+                 * is enabled.
                  */
                 if (ncp->numrecs < new_numrecs) {
                     ncp->numrecs = new_numrecs;
@@ -425,6 +436,15 @@ ncmpio_get_vard(void         *ncdp,
 {
     NC *ncp=(NC*)ncdp;
 
+    /* no file access until the pending split-phase wait is ended */
+    if (NC_WAIT_PENDING(ncp)) DEBUG_RETURN_ERROR(NC_EPENDING)
+
+    if (fIsSet(reqMode, NC_REQ_COLL) && ncp->num_fill_pending > 0) {
+        /* write pending lazy fills before reading */
+        int err = ncmpio_lazy_fill_flush(ncp);
+        if (err != NC_NOERR) return err;
+    }
+
     if (fIsSet(reqMode, NC_REQ_ZERO) && fIsSet(reqMode, NC_REQ_COLL))
         /* this collective API has a zero-length request */
         return ncmpio_getput_zero_req(ncp, reqMode);
@@ -447,6 +467,16 @@ ncmpio_put_vard(void         *ncdp,
 {
     NC *ncp=(NC*)ncdp;
 
+    /* no file access until the pending split-phase wait is ended */
+    if (NC_WAIT_PENDING(ncp)) DEBUG_RETURN_ERROR(NC_EPENDING)
+
+    if (fIsSet(reqMode, NC_REQ_COLL) && ncp->num_fill_pending > 0) {
+        /* regions written by a filetype are not tracked, so write pending
+         * lazy fills first, before they can overwrite the data */
+        int err = ncmpio_lazy_fill_flush(ncp);
+        if (err != NC_NOERR) return err;
+    }
+
     if (fIsSet(reqMode, NC_REQ_ZERO) && fIsSet(reqMode, NC_REQ_COLL))
         /* this collective API has a zero-length request */
         return ncmpio_getput_zero_req(ncp, reqMode);
@@ -456,3 +486,586 @@ ncmpio_put_vard(void         *ncdp,
     return getput_vard(ncp, ncp->vars.value[varid], filetype, (void*)buf,
                        bufcount, buftype, reqMode);
 }
+
+/* offset-length pairs generated by flatten_dtype() */
+typedef struct {
+    MPI_Offset  nsegs;    /* number of pairs in segs[] */
+    MPI_Offset  max_segs; /* number of pairs allocated for segs[] */
+    MPI_Offset  buf_off;  /* buffer offset of the next pair */
+    off_len    *segs;     /* [max_segs] */
+} seg_list;
+
+/*----< seg_list_add() >-----------------------------------------------------*/
+/* append a segment of len bytes at file offset off. It is coalesced with the
+ * last one if they are contiguous in the file, as the buffer is contiguous.
+ */
+static void
+seg_list_add(seg_list   *sl,
+             MPI_Offset  off,
+             MPI_Offset  len)
+{
+    off_len *seg;
+
+    if (len == 0) return;
+
+    if (sl->nsegs > 0) {
+        seg = sl->segs + sl->nsegs - 1;
+        if (seg->off + seg->len == off) {
+            seg->len    += len;
+            sl->buf_off += len;
+            return;
+        }
+    }
+
+    if (sl->nsegs == sl->max_segs) {
+        sl->max_segs = (sl->max_segs == 0) ? 64 : sl->max_segs * 2;
+        sl->segs = (off_len*) NCI_Realloc(sl->segs,
+                              (size_t)sl->max_segs * sizeof(off_len));
+    }
+    seg = sl->segs + sl->nsegs++;
+    seg->off      = off;
+    seg->len      = len;
+    seg->buf_addr = sl->buf_off;
+    sl->buf_off  += len;
+}
+
+/*----< type_size() >--------------------------------------------------------*/
+static MPI_Offset
+type_size(MPI_Datatype dtype)
+{
+#if MPI_VERSION >= 3
+    MPI_Count size;
+    MPI_Type_size_x(dtype, &size);
+#else
+    int size;
+    MPI_Type_size(dtype, &size);
+#endif
+    return (MPI_Offset)size;
+}
+
+/*----< type_dense() >-------------------------------------------------------*/
+/* Return 1 if dtype fills its entire extent starting from its origin, so
+ * consecutive instances of dtype form a single contiguous block.
+ */
+static int
+type_dense(MPI_Datatype  dtype,
+           MPI_Aint     *extent)  /* OUT */
+{
+    MPI_Aint lb, true_lb, true_extent;
+
+    MPI_Type_get_extent(dtype, &lb, extent);
+    MPI_Type_get_true_extent(dtype, &true_lb, &true_extent);
+
+    return (lb == 0 && true_lb == 0 && true_extent == *extent &&
+            type_size(dtype) == *extent);
+}
+
+/*----< free_contents() >----------------------------------------------------*/
+/* free the derived data types returned by MPI_Type_get_contents() */
+static void
+free_contents(int           num_dtypes,
+              MPI_Datatype *dtypes)
+{
+    int i, num_ints, num_adds, ntypes, combiner;
+
+    for (i=0; i<num_dtypes; i++) {
+        MPI_Type_get_envelope(dtypes[i], &num_ints, &num_adds, &ntypes,
+                              &combiner);
+        if (combiner != MPI_COMBINER_NAMED) MPI_Type_free(dtypes+i);
+    }
+}
+
+/*----< flatten_check() >----------------------------------------------------*/
+/* Return NC_ENOTSUPPORT if dtype is made of a constructor that
+ * flatten_dtype() cannot handle, e.g. darray.
+ */
+static int
+flatten_check(MPI_Datatype dtype)
+{
+    int i, err=NC_NOERR, num_ints, num_adds, num_dtypes, combiner;
+    int *ints;
+    MPI_Aint *adds;
+    MPI_Datatype *dtypes;
+
+    MPI_Type_get_envelope(dtype, &num_ints, &num_adds, &num_dtypes, &combiner);
+
+    switch (combiner) {
+        case MPI_COMBINER_NAMED:
+            return NC_NOERR;
+        case MPI_COMBINER_CONTIGUOUS:
+        case MPI_COMBINER_VECTOR:
+        case MPI_COMBINER_HVECTOR:
+        case MPI_COMBINER_INDEXED:
+        case MPI_COMBINER_HINDEXED:
+        case MPI_COMBINER_STRUCT:
+#ifdef HAVE_DECL_MPI_COMBINER_DUP
+        case MPI_COMBINER_DUP:
+#endif
+#ifdef HAVE_DECL_MPI_COMBINER_RESIZED
+        case MPI_COMBINER_RESIZED:
+#endif
+#ifdef HAVE_DECL_MPI_COMBINER_HVECTOR_INTEGER
+        case MPI_COMBINER_HVECTOR_INTEGER:
+#endif
+#ifdef HAVE_DECL_MPI_COMBINER_HINDEXED_INTEGER
+        case MPI_COMBINER_HINDEXED_INTEGER:
+#endif
+#ifdef HAVE_DECL_MPI_COMBINER_STRUCT_INTEGER
+        case MPI_COMBINER_STRUCT_INTEGER:
+#endif
+#ifdef HAVE_DECL_MPI_COMBINER_INDEXED_BLOCK
+        case MPI_COMBINER_INDEXED_BLOCK:
+#endif
+#if MPI_VERSION >= 3
+        case MPI_COMBINER_HINDEXED_BLOCK:
+#endif
+#ifdef HAVE_DECL_MPI_COMBINER_SUBARRAY
+        case MPI_COMBINER_SUBARRAY:
+#endif
+            break;
+        default:
+            DEBUG_RETURN_ERROR(NC_ENOTSUPPORT)
+    }
+
+    ints   = (int*)          NCI_Malloc(sizeof(int)      * (size_t)(num_ints + 1));
+    adds   = (MPI_Aint*)     NCI_Malloc(sizeof(MPI_Aint) * (size_t)(num_adds + 1));
+    dtypes = (MPI_Datatype*) NCI_Malloc(sizeof(MPI_Datatype) * (size_t)num_dtypes);
+
+    MPI_Type_get_contents(dtype, num_ints, num_adds, num_dtypes, ints, adds,
+                          dtypes);
+
+    for (i=0; i<num_dtypes && err == NC_NOERR; i++)
+        err = flatten_check(dtypes[i]);
+
+    free_contents(num_dtypes, dtypes);
+    NCI_Free(dtypes);
+    NCI_Free(adds);
+    NCI_Free(ints);
+
+    return err;
+}
+
+static int
+flatten_dtype(MPI_Datatype dtype, MPI_Offset disp, seg_list *sl);
+
+/*----< flatten_block() >----------------------------------------------------*/
+/* flatten n consecutive instances of dtype, the first one at file offset
+ * disp */
+static int
+flatten_block(MPI_Datatype  dtype,
+              MPI_Offset    disp,
+              MPI_Offset    n,
+              seg_list     *sl)
+{
+    int err=NC_NOERR;
+    MPI_Offset k;
+    MPI_Aint extent;
+
+    if (type_dense(dtype, &extent)) {
+        seg_list_add(sl, disp, n * extent);
+        return NC_NOERR;
+    }
+
+    for (k=0; k<n && err == NC_NOERR; k++)
+        err = flatten_dtype(dtype, disp + k * extent, sl);
+
+    return err;
+}
+
+/*----< flatten_subarray() >-------------------------------------------------*/
+/* flatten a subarray data type, whose constructor arguments are in ints[] */
+static int
+flatten_subarray(const int    *ints,
+                 MPI_Datatype  oldtype,
+                 MPI_Offset    disp,
+                 seg_list     *sl)
+{
+    int i, d, ndims=ints[0], order=ints[1+3*ndims], err=NC_NOERR;
+    MPI_Offset r, nrows, off, array_len, *idx, *count, *step;
+    MPI_Aint lb, extent;
+
+    MPI_Type_get_extent(oldtype, &lb, &extent);
+
+    /* dimension i of idx[], count[] and step[] is the i-th slowest changing
+     * one, i.e. the dimensions are reversed for Fortran order */
+    idx   = (MPI_Offset*) NCI_Calloc((size_t)ndims * 3, SIZEOF_MPI_OFFSET);
+    count = idx + ndims;
+    step  = count + ndims;
+
+    off       = disp;
+    array_len = extent;
+    for (i=ndims-1; i>=0; i--) {
+        d = (order == MPI_ORDER_C) ? i : ndims-1-i;
+        count[i]   = ints[1+ndims+d];            /* subsizes */
+        step[i]    = array_len;
+        off       += ints[1+2*ndims+d] * array_len; /* starts */
+        array_len *= ints[1+d];                  /* sizes */
+    }
+
+    nrows = (count[ndims-1] > 0) ? 1 : 0;
+    for (i=0; i<ndims-1; i++) nrows *= count[i];
+
+    /* each row along the fastest changing dimension is a block */
+    for (r=0; r<nrows && err == NC_NOERR; r++) {
+        err = flatten_block(oldtype, off, count[ndims-1], sl);
+
+        /* move to the next row */
+        for (i=ndims-2; i>=0; i--) {
+            off += step[i];
+            if (++idx[i] < count[i]) break;
+            off -= count[i] * step[i];
+            idx[i] = 0;
+        }
+    }
+    NCI_Free(idx);
+
+    return err;
+}
+
+/*----< flatten_dtype() >----------------------------------------------------*/
+/* Append the offset-length pairs of dtype, whose origin is at file offset
+ * disp, to sl in the order of its type map.
+ */
+static int
+flatten_dtype(MPI_Datatype  dtype,
+              MPI_Offset    disp,
+              seg_list     *sl)
+{
+    int i, err=NC_NOERR, num_ints, num_adds, num_dtypes, combiner, count;
+    int *ints;
+    MPI_Aint *adds, lb, extent;
+    MPI_Datatype *dtypes;
+
+    MPI_Type_get_envelope(dtype, &num_ints, &num_adds, &num_dtypes, &combiner);
+
+    if (combiner == MPI_COMBINER_NAMED) {
+        seg_list_add(sl, disp, type_size(dtype));
+        return NC_NOERR;
+    }
+
+    ints   = (int*)          NCI_Malloc(sizeof(int)      * (size_t)(num_ints + 1));
+    adds   = (MPI_Aint*)     NCI_Malloc(sizeof(MPI_Aint) * (size_t)(num_adds + 1));
+    dtypes = (MPI_Datatype*) NCI_Malloc(sizeof(MPI_Datatype) * (size_t)num_dtypes);
+
+    MPI_Type_get_contents(dtype, num_ints, num_adds, num_dtypes, ints, adds,
+                          dtypes);
+
+    extent = 0;
+    if (num_dtypes > 0) MPI_Type_get_extent(dtypes[0], &lb, &extent);
+    count = ints[0];
+
+    switch (combiner) {
+#ifdef HAVE_DECL_MPI_COMBINER_DUP
+        case MPI_COMBINER_DUP:
+#endif
+#ifdef HAVE_DECL_MPI_COMBINER_RESIZED
+        case MPI_COMBINER_RESIZED: /* extent only matters to the outer type */
+#endif
+            err = flatten_dtype(dtypes[0], disp, sl);
+            break;
+        case MPI_COMBINER_CONTIGUOUS:
+            err = flatten_block(dtypes[0], disp, count, sl);
+            break;
+        case MPI_COMBINER_VECTOR:
+            for (i=0; i<count && err == NC_NOERR; i++)
+                err = flatten_block(dtypes[0],
+                                    disp + (MPI_Offset)i * ints[2] * extent,
+                                    ints[1], sl);
+            break;
+        case MPI_COMBINER_HVECTOR:
+#ifdef HAVE_DECL_MPI_COMBINER_HVECTOR_INTEGER
+        case MPI_COMBINER_HVECTOR_INTEGER:
+#endif
+            for (i=0; i<count && err == NC_NOERR; i++)
+                err = flatten_block(dtypes[0], disp + (MPI_Offset)i * adds[0],
+                                    ints[1], sl);
+            break;
+        case MPI_COMBINER_INDEXED:
+            for (i=0; i<count && err == NC_NOERR; i++)
+                err = flatten_block(dtypes[0],
+                                    disp + (MPI_Offset)ints[1+count+i] * extent,
+                                    ints[1+i], sl);
+            break;
+        case MPI_COMBINER_HINDEXED:
+#ifdef HAVE_DECL_MPI_COMBINER_HINDEXED_INTEGER
+        case MPI_COMBINER_HINDEXED_INTEGER:
+#endif
+            for (i=0; i<count && err == NC_NOERR; i++)
+                err = flatten_block(dtypes[0], disp + adds[i], ints[1+i], sl);
+            break;
+#ifdef HAVE_DECL_MPI_COMBINER_INDEXED_BLOCK
+        case MPI_COMBINER_INDEXED_BLOCK:
+            for (i=0; i<count && err == NC_NOERR; i++)
+                err = flatten_block(dtypes[0],
+                                    disp + (MPI_Offset)ints[2+i] * extent,
+                                    ints[1], sl);
+            break;
+#endif
+#if MPI_VERSION >= 3
+        case MPI_COMBINER_HINDEXED_BLOCK:
+            for (i=0; i<count && err == NC_NOERR; i++)
+                err = flatten_block(dtypes[0], disp + adds[i], ints[1], sl);
+            break;
+#endif
+        case MPI_COMBINER_STRUCT:
+#ifdef HAVE_DECL_MPI_COMBINER_STRUCT_INTEGER
+        case MPI_COMBINER_STRUCT_INTEGER:
+#endif
+            for (i=0; i<count && err == NC_NOERR; i++)
+                err = flatten_block(dtypes[i], disp + adds[i], ints[1+i], sl);
+            break;
+#ifdef HAVE_DECL_MPI_COMBINER_SUBARRAY
+        case MPI_COMBINER_SUBARRAY:
+            err = flatten_subarray(ints, dtypes[0], disp, sl);
+            break;
+#endif
+        default:
+            DEBUG_ASSIGN_ERROR(err, NC_ENOTSUPPORT)
+            break;
+    }
+
+    free_contents(num_dtypes, dtypes);
+    NCI_Free(dtypes);
+    NCI_Free(adds);
+    NCI_Free(ints);
+
+    return err;
+}
+
+/*----< ncmpio_filetype_flatten() >------------------------------------------*/
+/* Flatten filetype of a vard request, whose origin is at file offset disp,
+ * into offset-length pairs. Buffer addresses of the pairs are relative to
+ * the start of a contiguous buffer. As required for an MPI fileview, the
+ * file offsets of filetype are monotonically nondecreasing, so are those of
+ * the pairs. Contiguous pairs are coalesced.
+ */
+int
+ncmpio_filetype_flatten(MPI_Datatype   filetype,
+                        MPI_Offset     disp,
+                        MPI_Offset    *nsegs,  /* OUT */
+                        off_len      **segs)   /* OUT: [*nsegs] */
+{
+    int err;
+    seg_list sl;
+
+    sl.nsegs    = 0;
+    sl.max_segs = 0;
+    sl.buf_off  = 0;
+    sl.segs     = NULL;
+
+    err = flatten_dtype(filetype, disp, &sl);
+    if (err != NC_NOERR) {
+        if (sl.segs != NULL) NCI_Free(sl.segs);
+        sl.nsegs = 0;
+        sl.segs  = NULL;
+    }
+
+    *nsegs = sl.nsegs;
+    *segs  = sl.segs;
+
+    return err;
+}
+
+/*----< igetput_vard() >-----------------------------------------------------*/
+/* The user buffer is packed into a contiguous one, if it is noncontiguous,
+ * and the filetype is posted as a nonblocking request, to be aggregated with
+ * other pending requests at the wait call.
+ */
+static int
+igetput_vard(NC               *ncp,
+             NC_var           *varp,
+             MPI_Datatype      filetype, /* access layout in the file */
+             void             *buf,
+             MPI_Offset        bufcount,
+             MPI_Datatype      buftype,  /* data type of the buffer */
+             int              *reqidp,   /* OUT: request ID */
+             int               reqMode)
+{
+    void *cbuf=NULL;
+    int isderived, el_size, buftype_is_contig, filetype_is_contig;
+    int err=NC_NOERR, free_cbuf=0, reqid, leadIndx;
+    MPI_Offset btnelems=0, bnelems=0, filetype_size;
+    MPI_Datatype ptype;
+
+    if (filetype == MPI_DATATYPE_NULL) /* zero-length request */
+        return NC_NOERR;
+
+    if (bufcount == 0 && buftype != MPI_DATATYPE_NULL) return NC_NOERR;
+
+#ifdef ENABLE_SUBFILING
+    /* call a separate routine if variable is stored in subfiles */
+    if (varp->num_subfiles > 1) {
+        printf("This feature for subfiling is yet to implement\n");
+        DEBUG_RETURN_ERROR(NC_ENOTSUPPORT)
+    }
+#endif
+
+    filetype_size = type_size(filetype);
+    if (filetype_size < 0) DEBUG_RETURN_ERROR(NC_EINTOVERFLOW)
+    if (filetype_size == 0) return NC_NOERR; /* zero-length request */
+
+#ifndef ENABLE_LARGE_REQ
+    if (filetype_size > INT_MAX) DEBUG_RETURN_ERROR(NC_EMAX_REQ)
+#endif
+
+    /* find the element type of filetype */
+    err = ncmpii_dtype_decode(filetype, &ptype, &el_size, &btnelems,
+                              &isderived, &filetype_is_contig);
+    if (err != NC_NOERR) return err;
+
+    /* element type of filetype must be the same as variable's type */
+    if (ptype != ncmpii_nc2mpitype(varp->xtype))
+        DEBUG_RETURN_ERROR(NC_ETYPE_MISMATCH)
+
+    /* filetype is flattened into offset-length pairs at the wait call when
+     * aggregated with interleaved requests or by two-phase I/O */
+    err = flatten_check(filetype);
+    if (err != NC_NOERR) return err;
+
+    if (ncp->stats != NULL)
+        ncmpio_stats_add(ncp, varp, NC_STATS_VARD, reqMode, filetype_size);
+
+    cbuf = buf;
+    if (buftype == MPI_DATATYPE_NULL) {
+        /* In this case, bufcount is ignored and will be set to the size of
+         * filetype. Note buf's data type must match the external data type of
+         * variable defined in the file - no data conversion will be done.
+         */
+        bnelems = filetype_size / varp->xsz;
+    }
+    else {
+        /* find whether buftype is contiguous */
+        err = ncmpii_dtype_decode(buftype, &ptype, &el_size, &btnelems,
+                                  &isderived, &buftype_is_contig);
+        if (err != NC_NOERR) return err;
+
+        err = NCMPII_ECHAR(varp->xtype, ptype);
+        if (err != NC_NOERR) return err;
+
+        bnelems = bufcount * btnelems;
+        if (bnelems * el_size != filetype_size)
+            DEBUG_RETURN_ERROR(NC_ETYPESIZE_MISMATCH)
+
+        /* if buf is not contiguous, we need to pack it to one, cbuf */
+        if (!buftype_is_contig && bnelems > 0) {
+            if (bufcount > INT_MAX) DEBUG_RETURN_ERROR(NC_EINTOVERFLOW)
+            cbuf = NCI_Malloc((size_t)filetype_size);
+            free_cbuf = 1;
+
+            if (fIsSet(reqMode, NC_REQ_WR)) {
+                /* pack buf into cbuf, a contiguous buffer */
+                int position = 0;
+                MPI_Pack(buf, (int)bufcount, buftype, cbuf,
+                         (int)filetype_size, &position, MPI_COMM_SELF);
+            }
+        }
+        /* no type conversion is allowed by vard APIs, cbuf is treated as an
+         * array of elements of variable's type */
+        bnelems = filetype_size / varp->xsz;
+    }
+
+    /* obtain the ID of new request to be created */
+    leadIndx = fIsSet(reqMode, NC_REQ_RD) ? ncp->numGetReqs : ncp->numPutReqs;
+
+    reqid = NC_REQ_NULL;
+    err = ncmpio_igetput_vard(ncp, varp, filetype, cbuf, bnelems, &reqid,
+                              reqMode);
+    if (err != NC_NOERR) {
+        if (reqid != NC_REQ_NULL) /* cancel pending nonblocking request */
+            ncmpio_cancel(ncp, 1, &reqid, NULL);
+        if (free_cbuf) NCI_Free(cbuf);
+        return err;
+    }
+
+    if (free_cbuf) { /* cbuf != buf, cbuf is temp allocated */
+        if (fIsSet(reqMode, NC_REQ_RD)) {
+            /* lead request must unpack cbuf to buf and free cbuf at wait() */
+            ncp->get_list[leadIndx].bufcount = bufcount;
+            ncp->get_list[leadIndx].flag    |= NC_REQ_BUF_TO_BE_FREED;
+            ncp->get_list[leadIndx].userBuf  = buf;
+            MPI_Type_dup(buftype, &ncp->get_list[leadIndx].buftype);
+        }
+        else if (fIsSet(reqMode, NC_REQ_NBB))
+            /* cbuf has been copied to the attached buffer, so it is safe to
+             * free cbuf now */
+            NCI_Free(cbuf);
+        else
+            /* lead request must free cbuf at wait() */
+            ncp->put_list[leadIndx].flag |= NC_REQ_BUF_TO_BE_FREED;
+    }
+
+    if (reqidp != NULL) *reqidp = reqid;
+
+    return NC_NOERR;
+}
+
+/*----< ncmpio_iget_vard() >-------------------------------------------------*/
+int
+ncmpio_iget_vard(void         *ncdp,
+                 int           varid,
+                 MPI_Datatype  filetype,  /* access layout in file */
+                 void         *buf,
+                 MPI_Offset    bufcount,
+                 MPI_Datatype  buftype,   /* data type of the buffer */
+                 int          *reqid,
+                 int           reqMode)
+{
+    NC *ncp=(NC*)ncdp;
+
+    if (reqid != NULL) *reqid = NC_REQ_NULL;
+
+    if (fIsSet(reqMode, NC_REQ_ZERO)) return NC_NOERR;
+
+    /* Note sanity check for ncdp and varid has been done in dispatchers */
+
+    return igetput_vard(ncp, ncp->vars.value[varid], filetype, buf, bufcount,
+                        buftype, reqid, reqMode);
+}
+
+/*----< ncmpio_iput_vard() >-------------------------------------------------*/
+int
+ncmpio_iput_vard(void         *ncdp,
+                 int           varid,
+                 MPI_Datatype  filetype,  /* access layout in file */
+                 const void   *buf,
+                 MPI_Offset    bufcount,
+                 MPI_Datatype  buftype,   /* data type of the buffer */
+                 int          *reqid,
+                 int           reqMode)
+{
+    NC *ncp=(NC*)ncdp;
+
+    if (reqid != NULL) *reqid = NC_REQ_NULL;
+
+    if (fIsSet(reqMode, NC_REQ_ZERO)) return NC_NOERR;
+
+    /* Note sanity check for ncdp and varid has been done in dispatchers */
+
+    return igetput_vard(ncp, ncp->vars.value[varid], filetype, (void*)buf,
+                        bufcount, buftype, reqid, reqMode);
+}
+
+/*----< ncmpio_bput_vard() >-------------------------------------------------*/
+int
+ncmpio_bput_vard(void         *ncdp,
+                 int           varid,
+                 MPI_Datatype  filetype,  /* access layout in file */
+                 const void   *buf,
+                 MPI_Offset    bufcount,
+                 MPI_Datatype  buftype,   /* data type of the buffer */
+                 int          *reqid,
+                 int           reqMode)
+{
+    NC *ncp=(NC*)ncdp;
+
+    if (reqid != NULL) *reqid = NC_REQ_NULL;
+
+    if (fIsSet(reqMode, NC_REQ_ZERO)) return NC_NOERR;
+
+    if (ncp->abuf == NULL) DEBUG_RETURN_ERROR(NC_ENULLABUF)
+
+    /* Note sanity check for ncdp and varid has been done in dispatchers */
+
+    return igetput_vard(ncp, ncp->vars.value[varid], filetype, (void*)buf,
+                        bufcount, buftype, reqid, reqMode);
+}
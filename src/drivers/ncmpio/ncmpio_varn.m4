@@ -38,10 +38,8 @@ dnl
 #include "ncmpio_NC.h"
 
 /*----< getput_varn() >------------------------------------------------------*/
-/* The current implementation for varn APIs is to make num calls to iget/iput
- * APIs, although an alternative is to flatten each start-count request into
- * a list of offset-length pairs and concatenate all lists into a hindexed
- * data type.
+/* All start-count subarrays are posted as a single nonblocking request, whose
+ * offset-length pairs are generated into one sorted list at the wait call.
  */
 static int
 getput_varn(NC                *ncp,
@@ -55,10 +53,9 @@ getput_varn(NC                *ncp,
             int                reqMode)
 {
     int i, j, el_size, status=NC_NOERR, min_st, err, free_cbuf=0;
-    int req_id=NC_REQ_NULL, isSameGroup, position;
+    int req_id=NC_REQ_NULL, position;
     void *cbuf=NULL;
-    char *bufp;
-    MPI_Offset packsize=0, **_counts=NULL;
+    MPI_Offset packsize=0, **_counts=NULL, bnelems=0;
     MPI_Datatype ptype;
 
     /* check for zero-size request */
@@ -163,7 +160,6 @@ getput_varn(NC                *ncp,
         if (status != NC_NOERR) goto err_check;
 
         ptype = buftype;
-        el_size = varp->xsz;
 
 #ifndef ENABLE_LARGE_REQ
         /* TODO: sum up all request sizes and check against INT_MAX */
@@ -185,9 +181,7 @@ getput_varn(NC                *ncp,
     else
         _counts = (MPI_Offset**) counts;
 
-    /* break buf into num pieces */
-    isSameGroup=0;
-    bufp = (char*)cbuf;
+    /* total number of elements of all subarrays */
     for (i=0; i<num; i++) {
         MPI_Offset buflen;
         for (buflen=1, j=0; j<varp->ndims; j++) {
@@ -197,21 +191,13 @@ getput_varn(NC                *ncp,
             }
             buflen *= _counts[i][j];
         }
-        if (buflen == 0) continue;
-        status = ncmpio_igetput_varm(ncp, varp, starts[i], _counts[i], NULL,
-                                     NULL, bufp, buflen, ptype, &req_id,
-                                     reqMode, isSameGroup);
-        /* req_id is reused because requests in a varn is considered in the
-         * same group */
-        if (status != NC_NOERR) goto err_check;
-
-        /* use isSamegroup so we end up with one nonblocking request (only the
-         * first request gets a request ID back, the rest reuse the same ID.
-         * This single ID represents num nonblocking requests */
-        isSameGroup=1;
-        bufp += buflen * el_size;
+        bnelems += buflen;
     }
 
+    /* post a single request for all subarrays */
+    status = ncmpio_igetput_varn(ncp, varp, num, starts, _counts, cbuf,
+                                 bnelems, ptype, &req_id, reqMode);
+
 err_check:
     if (_counts != NULL && _counts != counts) {
         NCI_Free(_counts[0]);
@@ -242,10 +228,13 @@ err_check:
 
     if (status == NC_NOERR)
         err = ncmpio_wait(ncp, 1, &req_id, NULL, reqMode);
-    else
+    else {
         /* This can only be reached for NC_REQ_COLL and safe_mode == 0.
          * Let this process participate the collective calls in wait_all */
+        if (req_id != NC_REQ_NULL) /* cancel pending nonblocking request */
+            ncmpio_cancel(ncp, 1, &req_id, NULL);
         err = ncmpio_wait(ncp, 0, NULL, NULL, reqMode);
+    }
 
     /* if error occurs, it is reflected in err */
 
@@ -284,12 +273,30 @@ ncmpio_$1_varn(void              *ncdp,
 {
     NC *ncp=(NC*)ncdp;
 
-    if (fIsSet(reqMode, NC_REQ_ZERO) && fIsSet(reqMode, NC_REQ_COLL))
+    /* no file access until the pending split-phase wait is ended */
+    if (NC_WAIT_PENDING(ncp)) DEBUG_RETURN_ERROR(NC_EPENDING)
+ifelse(`$1',`get',`
+    if (fIsSet(reqMode, NC_REQ_COLL) && ncp->num_fill_pending > 0) {
+        /* write pending lazy fills before reading */
+        int err = ncmpio_lazy_fill_flush(ncp);
+        if (err != NC_NOERR) return err;
+    }
+')dnl
+
+    if (fIsSet(reqMode, NC_REQ_ZERO) && fIsSet(reqMode, NC_REQ_COLL)) {
         /* this collective API has a zero-length request */
+        if (ncp->two_phase)
+            /* participate the collective wait call of two-phase I/O */
+            return ncmpio_wait(ncp, 0, NULL, NULL, reqMode);
         return ncmpio_getput_zero_req(ncp, reqMode);
+    }
 
     /* Note sanity check for ncdp and varid has been done in dispatchers */
 
+    if (ncp->stats != NULL)
+        ncmpio_stats_add_varn(ncp, ncp->vars.value[varid], num, counts,
+                              reqMode);
+
     return getput_varn(ncp, ncp->vars.value[varid], num, starts, counts,
                        (void*)buf, bufcount, buftype, reqMode);
 }
@@ -7,9 +7,12 @@
 /*
  * This file implements the corresponding APIs defined in src/dispatchers/file.c
  *
- * ncmpi_wait()     : dispatcher->wait()
- * ncmpi_wait_all() : dispatcher->wait()
- * ncmpi_cancel()   : dispatcher->cancel()
+ * ncmpi_wait()       : dispatcher->wait()
+ * ncmpi_wait_all()   : dispatcher->wait()
+ * ncmpi_cancel()     : dispatcher->cancel()
+ * ncmpi_wait_start() : dispatcher->wait_start()
+ * ncmpi_wait_test()  : dispatcher->wait_test()
+ * ncmpi_wait_end()   : dispatcher->wait_end()
  */
 
 #ifdef HAVE_CONFIG_H
@@ -43,6 +46,60 @@ static int wait_getput(NC *ncp, int num_reqs, NC_req *reqs, int rw_flag,
 static int mgetput(NC *ncp, int num_reqs, NC_req *reqs, int rw_flag,
                    int coll_indep);
 
+static int req_finish(NC *ncp, int num_w_reqs, NC_req *put_list,
+                      int num_r_reqs, NC_req *get_list);
+
+static int wait_write_done(NC *ncp, int coll_indep, MPI_Offset newnumrecs);
+
+/*----< post_coll_io() >-----------------------------------------------------*/
+/* Post the collective read/write of a split-phase wait as a nonblocking
+ * MPI-IO call. It is completed in ncmpio_wait_test() or ncmpio_wait_end().
+ * Only called when ncp->wait_split->post is set, i.e. when the MPI library
+ * supports MPI_File_iread_at_all() and MPI_File_iwrite_at_all().
+ */
+static int
+post_coll_io(NC           *ncp,
+             MPI_File      fh,
+             MPI_Offset    offset,
+             void         *buf,
+             int           len,
+             MPI_Datatype  buf_type,
+             int           rw_flag,
+             MPI_Offset    nbytes)
+{
+    int err=NC_NOERR;
+#if defined(HAVE_MPI_FILE_IREAD_AT_ALL) && defined(HAVE_MPI_FILE_IWRITE_AT_ALL)
+    int mpireturn;
+#endif
+    NC_wait_split *ws=ncp->wait_split;
+
+    /* only the first collective call after post is set is nonblocking */
+    ws->post    = 0;
+    ws->rw_flag = rw_flag;
+    ws->nbytes  = nbytes;
+
+#if defined(HAVE_MPI_FILE_IREAD_AT_ALL) && defined(HAVE_MPI_FILE_IWRITE_AT_ALL)
+    if (rw_flag == NC_REQ_RD) {
+        TRACE_IO(MPI_File_iread_at_all)(fh, offset, buf, len, buf_type,
+                                        &ws->mpireq);
+        if (mpireturn != MPI_SUCCESS) {
+            err = ncmpii_error_mpi2nc(mpireturn, "MPI_File_iread_at_all");
+            if (err == NC_EFILE) DEBUG_ASSIGN_ERROR(err, NC_EREAD)
+        }
+    } else {
+        TRACE_IO(MPI_File_iwrite_at_all)(fh, offset, buf, len, buf_type,
+                                         &ws->mpireq);
+        if (mpireturn != MPI_SUCCESS) {
+            err = ncmpii_error_mpi2nc(mpireturn, "MPI_File_iwrite_at_all");
+            if (err == NC_EFILE) DEBUG_ASSIGN_ERROR(err, NC_EWRITE)
+        }
+    }
+    if (mpireturn != MPI_SUCCESS) ws->mpireq = MPI_REQUEST_NULL;
+#endif
+
+    return err;
+}
+
 /*----< ncmpio_getput_zero_req() >--------------------------------------------*/
 /* This function is called when this process has zero-length I/O request and
  * must participate all the MPI collective calls involved in the collective
@@ -66,6 +123,12 @@ ncmpio_getput_zero_req(NC *ncp, int reqMode)
     TRACE_IO(MPI_File_set_view)(fh, 0, MPI_BYTE, MPI_BYTE, "native",
                                 MPI_INFO_NULL);
 
+    if (ncp->wait_split != NULL && ncp->wait_split->post) {
+        /* the last collective call of a split-phase wait */
+        int rw_flag = fIsSet(reqMode, NC_REQ_RD) ? NC_REQ_RD : NC_REQ_WR;
+        return post_coll_io(ncp, fh, 0, NULL, 0, MPI_BYTE, rw_flag, 0);
+    }
+
     if (fIsSet(reqMode, NC_REQ_RD)) {
         TRACE_IO(MPI_File_read_all)(fh, NULL, 0, MPI_BYTE, &mpistatus);
         if (mpireturn != MPI_SUCCESS) {
@@ -124,15 +187,173 @@ abuf_coalesce(NC *ncp)
         /* free resource allocated at lead request */             \
         if (req.abuf_index < 0) {                                 \
             if (fIsSet(req.flag, NC_REQ_XBUF_TO_BE_FREED))        \
-                NCI_Free(req.xbuf); /* free xbuf */               \
+                ncmpii_pool_free(ncp->pool, req.xbuf);            \
             if (fIsSet(req.flag, NC_REQ_BUF_TO_BE_FREED))         \
                 NCI_Free(req.buf);  /* free buf */                \
         }                                                         \
         else  /* this is bput request */                          \
             ncp->abuf->occupy_table[req.abuf_index].is_used = 0;  \
+        if (fIsSet(req.flag, NC_REQ_VARD))                        \
+            MPI_Type_free(&req.filetype);                         \
     }                                                             \
     req.xbuf = NULL;                                              \
-    NCI_Free(req.start);                                          \
+    if (req.arena_chunk >= 0)                                     \
+        ncmpio_arena_free(ncp, req.arena_chunk);                  \
+}
+
+/*----< req_nelems() >-------------------------------------------------------*/
+/* Return the number of array elements accessed by request req. For a varn
+ * request, it is the sum over all its subarrays. For a vard request, it is
+ * the number of elements in its filetype.
+ */
+static MPI_Offset
+req_nelems(const NC_req *req)
+{
+    int i, j, ndims=req->varp->ndims;
+    MPI_Offset nelems, sum, *count;
+
+    if (fIsSet(req->flag, NC_REQ_VARD)) {
+        /* req->bufcount may have been set to the user's for unpacking */
+#if MPI_VERSION >= 3
+        MPI_Count size;
+        MPI_Type_size_x(req->filetype, &size);
+#else
+        int size;
+        MPI_Type_size(req->filetype, &size);
+#endif
+        return (MPI_Offset)size / req->varp->xsz;
+    }
+
+    if (!fIsSet(req->flag, NC_REQ_VARN)) {
+        count = req->start + ndims;
+        for (nelems=1, j=0; j<ndims; j++) nelems *= count[j];
+        return nelems;
+    }
+
+    count = req->start + (size_t)req->varn_num * ndims;
+    for (sum=0, i=0; i<req->varn_num; i++, count+=ndims) {
+        for (nelems=1, j=0; j<ndims; j++) nelems *= count[j];
+        sum += nelems;
+    }
+    return sum;
+}
+
+/*----< req_xlen() >---------------------------------------------------------*/
+/* Return the size in bytes of the I/O buffer, xbuf, of request req. Note a
+ * request to a record variable accesses one record only, except for varn and
+ * vard requests, whose xbuf holds all their elements.
+ */
+static MPI_Offset
+req_xlen(const NC_req *req)
+{
+    int k, ndims=req->varp->ndims;
+    MPI_Offset len=req->varp->xsz, *count;
+
+    if (fIsSet(req->flag, NC_REQ_VARD) || fIsSet(req->flag, NC_REQ_VARN))
+        return req_nelems(req) * len;
+
+    if (ndims > 0) { /* non-scalar variable */
+        count = req->start + ndims;
+        if (!IS_RECVAR(req->varp)) len *= count[0];
+        for (k=1; k<ndims; k++) len *= count[k];
+    }
+    return len;
+}
+
+/*----< vard_range() >-------------------------------------------------------*/
+/* Return the range of file offsets accessed by the filetype of vard request
+ * req, relative to the beginning of its variable.
+ */
+static void
+vard_range(const NC_req *req,
+           MPI_Offset   *lb,  /* OUT: first byte accessed */
+           MPI_Offset   *ub)  /* OUT: one past the last byte accessed */
+{
+#if MPI_VERSION >= 3
+    MPI_Count true_lb, true_extent;
+    MPI_Type_get_true_extent_x(req->filetype, &true_lb, &true_extent);
+#else
+    MPI_Aint true_lb, true_extent;
+    MPI_Type_get_true_extent(req->filetype, &true_lb, &true_extent);
+#endif
+    *lb = true_lb;
+    *ub = true_lb + true_extent;
+}
+
+/*----< req_fill_mark() >----------------------------------------------------*/
+/* Record the file regions written by put request req, if fill of the
+ * variables it accesses is deferred. This is done when the request completes
+ * rather than when it is posted, so regions of requests cancelled or skipped
+ * will still be filled by ncmpio_lazy_fill_flush().
+ */
+static int
+req_fill_mark(NC           *ncp,
+              const NC_req *req)
+{
+    int i, err=NC_NOERR, ndims=req->varp->ndims;
+    MPI_Offset *count, *stride;
+
+    if (fIsSet(req->flag, NC_REQ_VARD)) {
+        /* the filetype of a vard request may access more than one variable */
+        MPI_Offset nsegs;
+        off_len *segs;
+
+        if (ncp->num_fill_pending == 0) return NC_NOERR;
+        err = ncmpio_filetype_flatten(req->filetype, req->varp->begin, &nsegs,
+                                      &segs);
+        if (err == NC_NOERR)
+            err = ncmpio_lazy_fill_mark_segs(ncp, nsegs, segs);
+        if (segs != NULL) NCI_Free(segs);
+        return err;
+    }
+
+    /* fills of record variables are never deferred */
+    if (!req->varp->fill_pending) return NC_NOERR;
+
+    if (fIsSet(req->flag, NC_REQ_VARN)) {
+        count = req->start + (size_t)req->varn_num * ndims;
+        for (i=0; i<req->varn_num && err == NC_NOERR; i++)
+            err = ncmpio_lazy_fill_mark(req->varp, req->start + i*ndims,
+                                        count + i*ndims, NULL);
+        return err;
+    }
+
+    count  = req->start + ndims;
+    stride = fIsSet(req->flag, NC_REQ_STRIDE_NULL) ? NULL : count + ndims;
+    return ncmpio_lazy_fill_mark(req->varp, req->start, count, stride);
+}
+
+/*----< req_lookup() >-------------------------------------------------------*/
+/* Return the index of the first request in list[] whose ID is id, or -1 if
+ * there is none. Request IDs in get_list[] and put_list[] are monotonically
+ * nondecreasing, and requests posted one after another have IDs 2 apart. The
+ * index is thus first guessed from the ID of list[0], which hits when no
+ * request in between has been completed or shares its ID with others, i.e.
+ * requests to more than one record or from varn APIs. Otherwise, a binary
+ * search is used.
+ */
+static int
+req_lookup(const NC_req *list,
+           int           num,   /* number of requests in list[] */
+           int           id)
+{
+    int lo, hi, mid;
+
+    if (num == 0 || id < list[0].id) return -1;
+
+    mid = (id - list[0].id) / 2;
+    if (mid < num && list[mid].id == id && (mid == 0 || list[mid-1].id < id))
+        return mid;
+
+    /* find the first request whose ID is not less than id */
+    lo = 0;
+    hi = num;
+    while (lo < hi) {
+        mid = lo + (hi - lo) / 2;
+        if (list[mid].id < id) lo = mid + 1;
+        else                   hi = mid;
+    }
+    return (lo < num && list[lo].id == id) ? lo : -1;
 }
 
 /*----< ncmpio_cancel() >-----------------------------------------------------*/
@@ -144,7 +365,7 @@ ncmpio_cancel(void *ncdp,
               int  *req_ids,  /* [num_req]: IN/OUT */
               int  *statuses) /* [num_req] can be NULL (ignore status) */
 {
-    int i, j, k, status=NC_NOERR;
+    int i, j, status=NC_NOERR;
     NC *ncp=(NC*)ncdp;
 
     if (num_req == 0) return NC_NOERR;
@@ -176,14 +397,10 @@ ncmpio_cancel(void *ncdp,
         NC_req *put_list = ncp->put_list;
         for (i=0; i<ncp->numPutReqs; i++) {
             if (fIsSet(put_list[i].flag, NC_REQ_LEAD) &&
-                fIsSet(put_list[i].flag, NC_REQ_BUF_BYTE_SWAP)) {
-                MPI_Offset nelems, *count;
-                count=put_list[i].start+put_list[i].varp->ndims;
-                for (nelems=1, k=0; k<put_list[i].varp->ndims; k++)
-                    nelems *= count[k];
+                fIsSet(put_list[i].flag, NC_REQ_BUF_BYTE_SWAP))
                 /* if user buffer is in-place byte-swapped, swap it back */
-                ncmpii_in_swapn(put_list[i].buf, nelems, put_list[i].varp->xsz);
-            }
+                ncmpii_in_swapn(put_list[i].buf, req_nelems(put_list+i),
+                                put_list[i].varp->xsz);
             FREE_REQUEST(put_list[i])
         }
         NCI_Free(put_list);
@@ -204,9 +421,12 @@ ncmpio_cancel(void *ncdp,
 
         if (req_ids[i] & 1) { /* read request (id is an odd number) */
             int found=0;
-            for (j=0; j<ncp->numGetReqs; j++) {
+            j = req_lookup(ncp->get_list, ncp->numGetReqs, req_ids[i]);
+            for (; j>=0 && j<ncp->numGetReqs; j++) {
                 NC_req *req=ncp->get_list+j;
-                if (req->id == NC_REQ_NULL || req->id != req_ids[i]) continue;
+                /* there may be more than one request with the same ID */
+                if (req->id != req_ids[i]) break;
+                if (fIsSet(req->flag, NC_REQ_TO_FREE)) continue;
                 found = 1;
                 if (fIsSet(req->flag, NC_REQ_LEAD)) { /* lead request */
                     if (req->imaptype != MPI_DATATYPE_NULL)
@@ -215,7 +435,7 @@ ncmpio_cancel(void *ncdp,
                         MPI_Type_free(&req->buftype);
                 }
                 FREE_REQUEST(ncp->get_list[j])
-                req->id = NC_REQ_NULL; /* marked as freed */
+                fSet(req->flag, NC_REQ_TO_FREE); /* marked as freed */
             }
             if (found) {
                 req_ids[i] = NC_REQ_NULL;
@@ -225,22 +445,21 @@ ncmpio_cancel(void *ncdp,
         }
         else { /* write request (id is an even number) */
             int found=0;
-            for (j=0; j<ncp->numPutReqs; j++) {
+            j = req_lookup(ncp->put_list, ncp->numPutReqs, req_ids[i]);
+            for (; j>=0 && j<ncp->numPutReqs; j++) {
                 NC_req *req=ncp->put_list+j;
-                if (req->id == NC_REQ_NULL || req->id != req_ids[i]) continue;
+                /* there may be more than one request with the same ID */
+                if (req->id != req_ids[i]) break;
+                if (fIsSet(req->flag, NC_REQ_TO_FREE)) continue;
                 found = 1;
                 if (fIsSet(req->flag, NC_REQ_LEAD) && /* lead request */
-                    fIsSet(req->flag, NC_REQ_BUF_BYTE_SWAP)) {
-                    MPI_Offset nelems=1;
-                    MPI_Offset *count=req->start+req->varp->ndims;
-                    for (k=0; k<req->varp->ndims; k++)
-                        nelems *= count[k];
+                    fIsSet(req->flag, NC_REQ_BUF_BYTE_SWAP))
                     /* if user buffer has been in-place byte-swapped,
                      * swap it back */
-                    ncmpii_in_swapn(req->buf, nelems, req->varp->xsz);
-                }
+                    ncmpii_in_swapn(req->buf, req_nelems(req),
+                                    req->varp->xsz);
                 FREE_REQUEST(ncp->put_list[j])
-                req->id = NC_REQ_NULL; /* marked as freed */
+                fSet(req->flag, NC_REQ_TO_FREE); /* marked as freed */
             }
             if (found) {
                 req_ids[i] = NC_REQ_NULL;
@@ -257,7 +476,7 @@ ncmpio_cancel(void *ncdp,
 
     /* coalesce get_list */
     for (i=0,j=0; j<ncp->numGetReqs; j++) {
-        if (ncp->get_list[j].id == NC_REQ_NULL) continue;
+        if (fIsSet(ncp->get_list[j].flag, NC_REQ_TO_FREE)) continue;
         if (i < j) ncp->get_list[i] = ncp->get_list[j];
         i++;
     }
@@ -269,7 +488,7 @@ ncmpio_cancel(void *ncdp,
 
     /* coalesce put_list */
     for (i=0,j=0; j<ncp->numPutReqs; j++) {
-        if  (ncp->put_list[j].id == NC_REQ_NULL) continue;
+        if (fIsSet(ncp->put_list[j].flag, NC_REQ_TO_FREE)) continue;
         if (i < j) ncp->put_list[i] = ncp->put_list[j];
         i++;
     }
@@ -434,7 +653,15 @@ construct_filetypes(NC           *ncp,
 
         ftypes[j] = MPI_BYTE; /* in case the call below failed */
 
-        if (ndims == 0) { /* scalar variable */
+        if (fIsSet(reqs[i].flag, NC_REQ_VARD)) {
+            /* filetype of a vard request is relative to the variable's
+             * beginning file offset */
+            MPI_Type_dup(reqs[i].filetype, &ftypes[j]);
+            blocklens[j]       = 1;
+            displacements[j]   = reqs[i].varp->begin;
+            is_filetype_contig = 0;
+        }
+        else if (ndims == 0) { /* scalar variable */
             blocklens[j]       = reqs[i].varp->xsz;
             displacements[j]   = reqs[i].varp->begin;
             is_filetype_contig = 1;
@@ -536,7 +763,7 @@ construct_buffertypes(int           num_reqs,
                       NC_req       *reqs,         /* [num_reqs] */
                       MPI_Datatype *buffer_type)  /* OUT */
 {
-    int i, j, k, *blocklengths, status=NC_NOERR, mpireturn;
+    int i, j, *blocklengths, status=NC_NOERR, mpireturn;
     MPI_Aint a0, ai, *disps;
 
     *buffer_type = MPI_BYTE;
@@ -551,12 +778,7 @@ construct_buffertypes(int           num_reqs,
         MPI_Offset req_size;
         if (fIsSet(reqs[i].flag, NC_REQ_SKIP)) continue;
 
-        req_size = reqs[i].varp->xsz;
-        if (reqs[i].varp->ndims > 0) { /* non-scalar variable */
-            MPI_Offset *count = reqs[i].start + reqs[i].varp->ndims;
-            if (!IS_RECVAR(reqs[i].varp)) req_size *= count[0];
-            for (k=1; k<reqs[i].varp->ndims; k++) req_size *= count[k];
-        }
+        req_size = req_xlen(reqs+i);
 
         /* check int overflow */
         if (req_size > INT_MAX) { /* skip this request */
@@ -632,11 +854,16 @@ req_commit(NC  *ncp,
            int *statuses,   /* [num_reqs] */
            int  coll_indep) /* NC_REQ_COLL or NC_REQ_INDEP */
 {
-    int i, j, k, err=NC_NOERR, status=NC_NOERR;
+    int i, j, err=NC_NOERR, status=NC_NOERR;
     int do_read, do_write, num_w_reqs=0, num_r_reqs=0;
-    int first_non_null_get, first_non_null_put;
     MPI_Offset newnumrecs=0;
     NC_req *put_list=NULL, *get_list=NULL;
+    NC_wait_split *ws=NULL;
+
+#if defined(HAVE_MPI_FILE_IREAD_AT_ALL) && defined(HAVE_MPI_FILE_IWRITE_AT_ALL)
+    /* called from ncmpio_wait_start() */
+    if (coll_indep == NC_REQ_COLL) ws = ncp->wait_split;
+#endif
 
     num_r_reqs = 0;
     num_w_reqs = 0;
@@ -666,8 +893,6 @@ req_commit(NC  *ncp,
     }
 
     /* check each request ID from the read/write request list */
-    first_non_null_get = 0;
-    first_non_null_put = 0;
     for (i=0; i<num_reqs; i++) {
         /* initialize the request's status */
         if (statuses != NULL) statuses[i] = NC_NOERR;
@@ -675,53 +900,41 @@ req_commit(NC  *ncp,
         if (req_ids[i] == NC_REQ_NULL) continue; /* skip NULL request */
 
         if (req_ids[i] & 1) { /* read request (id is an odd number)*/
-            int last_index=-1;
-            for (j=first_non_null_get; j<ncp->numGetReqs; j++) {
-                if (ncp->get_list[j].id == NC_REQ_NULL) continue;
+            int found=0;
+            j = req_lookup(ncp->get_list, ncp->numGetReqs, req_ids[i]);
+            for (; j>=0 && j<ncp->numGetReqs; j++) {
                 /* there may be more than one node with the same ID */
-                if (ncp->get_list[j].id == req_ids[i]) { /* found it */
-                    if (last_index < 0) last_index = j; /* keep first index */
-                    get_list[num_r_reqs] = ncp->get_list[j];
-                    get_list[num_r_reqs].status = (statuses == NULL) ? NULL :
-                                                  statuses + i;
-                    num_r_reqs++;
-                    ncp->get_list[j].id = NC_REQ_NULL; /* marked as freed */
-                }
-                else if (last_index >= 0)
-                    break; /* done with all requests of this ID */
+                if (ncp->get_list[j].id != req_ids[i]) break;
+                if (fIsSet(ncp->get_list[j].flag, NC_REQ_TO_FREE)) continue;
+                found = 1;
+                get_list[num_r_reqs] = ncp->get_list[j];
+                get_list[num_r_reqs].status = (statuses == NULL) ? NULL :
+                                              statuses + i;
+                num_r_reqs++;
+                /* marked as taken out of the pending list */
+                fSet(ncp->get_list[j].flag, NC_REQ_TO_FREE);
             }
-            if (last_index >= 0) { /* found in read list */
-                /* using first_non_null_get only makes sense when the request
-                 * IDs in get_list[] are monotonically nondecreasing, which is
-                 * the case in PnetCDF
-                 */
-                if (last_index == first_non_null_get) first_non_null_get = j;
+            if (found) { /* found in read list */
                 req_ids[i] = NC_REQ_NULL;
                 continue; /* loop i, go to next request ID */
             }
         }
         else { /* write request (id is an even number) */
-            int last_index=-1;
-            for (j=first_non_null_put; j<ncp->numPutReqs; j++) {
-                if (ncp->put_list[j].id == NC_REQ_NULL) continue;
+            int found=0;
+            j = req_lookup(ncp->put_list, ncp->numPutReqs, req_ids[i]);
+            for (; j>=0 && j<ncp->numPutReqs; j++) {
                 /* there may be more than one node with the same ID */
-                if (ncp->put_list[j].id == req_ids[i]) {
-                    if (last_index < 0) last_index = j;
-                    put_list[num_w_reqs] = ncp->put_list[j];
-                    put_list[num_w_reqs].status = (statuses == NULL) ? NULL :
-                                                  statuses + i;
-                    num_w_reqs++;
-                    ncp->put_list[j].id = NC_REQ_NULL; /* marked as freed */
-                }
-                else if (last_index >= 0)
-                    break; /* done with all requests of this ID */
+                if (ncp->put_list[j].id != req_ids[i]) break;
+                if (fIsSet(ncp->put_list[j].flag, NC_REQ_TO_FREE)) continue;
+                found = 1;
+                put_list[num_w_reqs] = ncp->put_list[j];
+                put_list[num_w_reqs].status = (statuses == NULL) ? NULL :
+                                              statuses + i;
+                num_w_reqs++;
+                /* marked as taken out of the pending list */
+                fSet(ncp->put_list[j].flag, NC_REQ_TO_FREE);
             }
-            if (last_index >= 0) { /* found in write list */
-                /* using first_non_null_put only makes sense when the request
-                 * IDs in put_list[] are monotonically nondecreasing, which is
-                 * the case in PnetCDF
-                 */
-                if (last_index == first_non_null_put) first_non_null_put = j;
+            if (found) { /* found in write list */
                 req_ids[i] = NC_REQ_NULL;
                 continue; /* loop i, go to next request ID */
             }
@@ -734,8 +947,8 @@ req_commit(NC  *ncp,
 
     if (num_reqs > 0) { /* not NC_REQ_ALL, NC_GET_REQ_ALL, or NC_PUT_REQ_ALL */
         /* coalesce get_list */
-        for (i=0,j=first_non_null_get; j<ncp->numGetReqs; j++) {
-            if (ncp->get_list[j].id == NC_REQ_NULL) continue;
+        for (i=0,j=0; j<ncp->numGetReqs; j++) {
+            if (fIsSet(ncp->get_list[j].flag, NC_REQ_TO_FREE)) continue;
             if (i < j) ncp->get_list[i] = ncp->get_list[j];
             i++;
         }
@@ -746,8 +959,8 @@ req_commit(NC  *ncp,
         }
 
         /* coalesce put_list */
-        for (i=0,j=first_non_null_put; j<ncp->numPutReqs; j++) {
-            if (ncp->put_list[j].id == NC_REQ_NULL) continue;
+        for (i=0,j=0; j<ncp->numPutReqs; j++) {
+            if (fIsSet(ncp->put_list[j].flag, NC_REQ_TO_FREE)) continue;
             if (i < j) ncp->put_list[i] = ncp->put_list[j];
             i++;
         }
@@ -780,6 +993,25 @@ req_commit(NC  *ncp,
         if (!IS_RECVAR(put_list[i].varp)) continue; /* not a record var */
         /* skip invalid request */
         if (fIsSet(put_list[i].flag, NC_REQ_SKIP)) continue;
+        if (fIsSet(put_list[i].flag, NC_REQ_VARN)) {
+            /* subarrays of a varn request may access more than one record */
+            int k, ndims=put_list[i].varp->ndims;
+            MPI_Offset *start=put_list[i].start;
+            MPI_Offset *count=start + (size_t)put_list[i].varn_num * ndims;
+            for (k=0; k<put_list[i].varn_num; k++)
+                newnumrecs = MAX(newnumrecs, start[k*ndims] + count[k*ndims]);
+            continue;
+        }
+        if (fIsSet(put_list[i].flag, NC_REQ_VARD)) {
+            /* the filetype of a vard request may access more than one
+             * record, find the last record it touches */
+            MPI_Offset lb, ub, nrecs;
+            vard_range(put_list+i, &lb, &ub);
+            nrecs = ub / ncp->recsize;
+            if (ub % ncp->recsize) nrecs++;
+            newnumrecs = MAX(newnumrecs, nrecs);
+            continue;
+        }
         /* for record variable, the request has been split into subrequests
          * each accessing one record only */
         newnumrecs = MAX(newnumrecs, put_list[i].start[0] + 1);
@@ -812,18 +1044,60 @@ req_commit(NC  *ncp,
         do_write = (num_w_reqs > 0);
     }
 
-    /* carry out writes and reads separately (writes first) */
-    if (do_write > 0)
+    /* carry out writes and reads separately (writes first). For a
+     * split-phase wait, the last collective MPI-IO call is posted as a
+     * nonblocking one.
+     */
+    if (do_write > 0) {
+        if (ws != NULL) ws->post = !do_read;
         err = wait_getput(ncp, num_w_reqs, put_list, NC_REQ_WR, coll_indep,
                           newnumrecs);
+    }
 
-    if (do_read > 0)
+    if (do_read > 0) {
+        if (ws != NULL) ws->post = 1;
         err = wait_getput(ncp, num_r_reqs, get_list, NC_REQ_RD, coll_indep,
                           newnumrecs);
+    }
 
     /* retain the first error status */
     if (status == NC_NOERR) status = err;
 
+    if (ws != NULL) {
+        /* two-phase I/O and intra-node aggregation are always blocking */
+        ws->post = 0;
+        if (ws->rw_flag != 0) {
+            /* The posted call is still using the request buffers. Keep the
+             * requests until it completes in ncmpio_wait_end().
+             */
+            ws->status     = status;
+            ws->num_w_reqs = num_w_reqs;
+            ws->num_r_reqs = num_r_reqs;
+            ws->put_list   = put_list;
+            ws->get_list   = get_list;
+            ws->newnumrecs = newnumrecs;
+            return NC_NOERR;
+        }
+    }
+
+    err = req_finish(ncp, num_w_reqs, put_list, num_r_reqs, get_list);
+    if (status == NC_NOERR) status = err;
+
+    return status;
+}
+
+/*----< req_finish() >-------------------------------------------------------*/
+/* Complete the requests whose I/O has been carried out and free them */
+static int
+req_finish(NC     *ncp,
+           int     num_w_reqs,
+           NC_req *put_list,   /* [num_w_reqs] */
+           int     num_r_reqs,
+           NC_req *get_list)   /* [num_r_reqs] */
+{
+    int i, err, status=NC_NOERR;
+    double timing;
+
     /* post-IO data processing: In write case, we may need to byte-swap user
      * write buf if it is used as the write buffer in MPI write call and the
      * target machine is little Endian. For read case, we may need to
@@ -839,15 +1113,18 @@ req_commit(NC  *ncp,
          * does swap for the entire request)
          */
         if (fIsSet(put_list[i].flag, NC_REQ_LEAD) &&
-            fIsSet(put_list[i].flag, NC_REQ_BUF_BYTE_SWAP)) {
-            MPI_Offset nelems=1;
-            MPI_Offset *count=put_list[i].start+put_list[i].varp->ndims;
-            for (k=0; k<put_list[i].varp->ndims; k++)
-                nelems *= count[k];
-            ncmpii_in_swapn(put_list[i].buf, nelems, put_list[i].varp->xsz);
-        }
+            fIsSet(put_list[i].flag, NC_REQ_BUF_BYTE_SWAP))
+            ncmpii_in_swapn(put_list[i].buf, req_nelems(put_list+i),
+                            put_list[i].varp->xsz);
     }
     for (i=0; i<num_w_reqs; i++) {
+        /* record the regions written, if fill of the variables is deferred */
+        if (ncp->num_fill_pending > 0 &&
+            !fIsSet(put_list[i].flag, NC_REQ_SKIP)) {
+            err = req_fill_mark(ncp, put_list+i);
+            if (status == NC_NOERR) status = err;
+        }
+
         /* Free space allocated for the request objects. During the posting of
          * a nonblocking varn request, the temporary buffer (cbuf), if
          * allocated, can be split into several sub-buffers, each used in a
@@ -869,7 +1146,6 @@ req_commit(NC  *ncp,
     }
 
     for (i=0; i<num_r_reqs; i++) {
-        MPI_Offset nelems, *count;
         NC_req *req=get_list+i;
 
         /* non-lead record requests skip type-conversion/byte-swap/unpack */
@@ -879,20 +1155,19 @@ req_commit(NC  *ncp,
          * It may need to be type-converted, byte-swapped, unpacked from xbuf
          * buf. This is done in ncmpio_unpack_xbuf().
          */
-        count = req->start + req->varp->ndims;
-        for (nelems=1, k=0; k<req->varp->ndims; k++)
-            nelems *= count[k];
+        timing = NC_STATS_WTIME(ncp);
         err = ncmpio_unpack_xbuf(ncp->format, req->varp,
                                  req->bufcount,
                                  req->buftype,
                                  fIsSet(req->flag, NC_REQ_BUF_TYPE_IS_CONTIG),
-                                 nelems,
+                                 req_nelems(req),
                                  req->ptype,
                                  req->imaptype,
                                  fIsSet(req->flag, NC_REQ_BUF_TYPE_CONVERT),
                                  fIsSet(req->flag, NC_REQ_BUF_BYTE_SWAP),
                                  req->buf,
                                  req->xbuf);
+        NC_STATS_ADD_TIME(ncp, NC_STATS_TIME_PACK, timing)
         if (req->status != NULL && *req->status == NC_NOERR)
             *req->status = err;
         if (status == NC_NOERR) status = err;
@@ -953,8 +1228,28 @@ ncmpio_wait(void *ncdp,
     if (NC_indef(ncp)) /* wait must be called in data mode */
         DEBUG_RETURN_ERROR(NC_EINDEFINE)
 
+    /* a split-phase wait must be ended first */
+    if (NC_WAIT_PENDING(ncp)) DEBUG_RETURN_ERROR(NC_EPENDING)
+
     coll_indep = (fIsSet(reqMode, NC_REQ_INDEP)) ? NC_REQ_INDEP : NC_REQ_COLL;
 
+    /* When called from ncmpi_wait_all(), pending lazy fills must be written
+     * before any process reads data. Internal calls from the blocking APIs
+     * have already done so at their entry.
+     */
+    if (coll_indep == NC_REQ_COLL && !fIsSet(reqMode, NC_REQ_BLK) &&
+        ncp->num_fill_pending > 0 && !NC_indep(ncp)) {
+        int err, mpireturn, has_get = (ncp->numGetReqs > 0);
+        TRACE_COMM(MPI_Allreduce)(MPI_IN_PLACE, &has_get, 1, MPI_INT, MPI_MAX,
+                                  ncp->comm);
+        if (mpireturn != MPI_SUCCESS)
+            return ncmpii_error_mpi2nc(mpireturn, "MPI_Allreduce");
+        if (has_get) {
+            err = ncmpio_lazy_fill_flush(ncp);
+            if (err != NC_NOERR) return err;
+        }
+    }
+
 #ifdef ENABLE_REQ_AGGREGATION
     /* check collective or independent mode */
     if (coll_indep == NC_REQ_INDEP && !NC_indep(ncp))
@@ -1046,125 +1341,459 @@ ncmpio_wait(void *ncdp,
 #endif
 }
 
-/* C struct for breaking down a request to a list of offset-length segments */
+/* When the number of sorted runs in an off_len array is no more than this,
+ * the runs are k-way merged, otherwise LSD radix sort is used.
+ */
+#define NC_MERGE_MAX_RUNS 32
+
+/*----< seg_append() >-------------------------------------------------------*/
+/* Append segment s to the end of segs[0 ... *n-1], whose file offsets are
+ * sorted and not overlapped. If s overlaps with the last segment, only the
+ * non-overlapped part of s is appended, i.e. the segment appended earlier
+ * wins the overlapped region. If s and the last segment are contiguous in
+ * both file and buffer, they are coalesced into one. s can be segs[*n].
+ */
+static void
+seg_append(off_len       *segs,
+           MPI_Offset    *n,
+           const off_len *s)
+{
+    off_len *last;
+    MPI_Offset gap;
+
+    if (*n == 0) {
+        segs[(*n)++] = *s;
+        return;
+    }
+
+    last = segs + *n - 1;
+    if (last->off + last->len >= s->off + s->len)
+        /* last completely covers s, skip s */
+        return;
+
+    gap = last->off + last->len - s->off;
+    if (gap >= 0) { /* last and s overlap or are adjacent */
+        if (last->buf_addr + last->len == s->buf_addr + gap)
+            /* buffers are contiguous, merge s to last */
+            last->len += s->len - gap;
+        else { /* buffers are not contiguous, reduce s's len */
+            segs[*n].off      = s->off + gap;
+            segs[*n].len      = s->len - gap;
+            segs[*n].buf_addr = s->buf_addr + gap;
+            (*n)++;
+        }
+    }
+    else /* last and s do not overlap */
+        segs[(*n)++] = *s;
+}
+
+/*----< heap_sift_down() >---------------------------------------------------*/
+/* restore the min-heap property of heap[] from node i. heap[] stores the
+ * indices of sorted runs, keyed by key[], the file offset of the current
+ * segment of each run. Ties are broken by run index to keep the merge stable.
+ */
+static void
+heap_sift_down(const MPI_Offset *key,
+               int              *heap,
+               int               hsize,
+               int               i)
+{
+    int c, r = heap[i];
+
+    while ((c = 2 * i + 1) < hsize) {
+        if (c + 1 < hsize &&
+            (key[heap[c+1]] < key[heap[c]] ||
+             (key[heap[c+1]] == key[heap[c]] && heap[c+1] < heap[c])))
+            c++; /* the right child is smaller */
+        if (key[heap[c]] > key[r] || (key[heap[c]] == key[r] && heap[c] > r))
+            break;
+        heap[i] = heap[c];
+        i = c;
+    }
+    heap[i] = r;
+}
+
+/*----< radix_sort_segs() >--------------------------------------------------*/
+/* Stable LSD radix sort of segs[] on the 64-bit file offsets, one byte per
+ * pass. Passes in which all offsets have the same digit are skipped, e.g. the
+ * high-order bytes for files smaller than 2^40 bytes. tmp[] is a work buffer
+ * of the same size as segs[]. Return the buffer containing the sorted result,
+ * either segs or tmp.
+ */
+static off_len *
+radix_sort_segs(MPI_Offset  nsegs,
+                off_len    *segs,
+                off_len    *tmp)
+{
+    int b, d;
+    MPI_Offset i, *hist, pos, cnt;
+    off_len *swap;
+
+    /* histograms of all 8 digits are collected in a single scan */
+    hist = (MPI_Offset*) NCI_Calloc(8 * 256, SIZEOF_MPI_OFFSET);
+    for (i=0; i<nsegs; i++) {
+        unsigned long long key = (unsigned long long)segs[i].off;
+        for (b=0; b<8; b++)
+            hist[b*256 + ((key >> (8*b)) & 0xff)]++;
+    }
+
+    for (b=0; b<8; b++) {
+        MPI_Offset *h = hist + b * 256;
+
+        d = (int)(((unsigned long long)segs[0].off >> (8*b)) & 0xff);
+        if (h[d] == nsegs) continue; /* all have the same digit */
+
+        /* convert counts to starting positions */
+        for (pos=0, d=0; d<256; d++) {
+            cnt  = h[d];
+            h[d] = pos;
+            pos += cnt;
+        }
+        for (i=0; i<nsegs; i++) {
+            d = (int)(((unsigned long long)segs[i].off >> (8*b)) & 0xff);
+            tmp[h[d]++] = segs[i];
+        }
+        swap = segs; segs = tmp; tmp = swap;
+    }
+    NCI_Free(hist);
+
+    return segs;
+}
+
+/*----< sort_segs() >--------------------------------------------------------*/
+/* Sort segs[] into an increasing order of file offsets. The sort is stable.
+ * segs[] often consists of a few sorted runs, e.g. the segments flattened
+ * from each request are sorted. When the number of runs is no more than
+ * NC_MERGE_MAX_RUNS, the runs are k-way merged using a min-heap, otherwise
+ * LSD radix sort is used. If coalesce is set, overlapped and contiguous
+ * segments are also merged by seg_append() and *nsegs is updated. The
+ * sorted segments may be returned in a newly allocated buffer, in which case
+ * the old *segs is freed.
+ */
+static void
+sort_segs(MPI_Offset  *nsegs,
+          off_len    **segs,
+          int          coalesce)
+{
+    int r, k, hsize, *heap;
+    MPI_Offset i, m, n=*nsegs, *cur, *end, *key;
+    off_len *src=*segs, *tmp, *out;
+
+    /* count the number of sorted runs */
+    for (k=1,i=1; i<n; i++)
+        if (src[i-1].off > src[i].off) k++;
+
+    if (k == 1) { /* already sorted */
+        if (coalesce) {
+            for (m=0,i=0; i<n; i++) seg_append(src, &m, src+i);
+            *nsegs = m;
+        }
+        return;
+    }
+
+    tmp = (off_len*) NCI_Malloc((size_t)n * sizeof(off_len));
+
+    if (k > NC_MERGE_MAX_RUNS) {
+        out = radix_sort_segs(n, src, tmp);
+        if (coalesce) {
+            for (m=0,i=0; i<n; i++) seg_append(out, &m, out+i);
+            *nsegs = m;
+        }
+        NCI_Free((out == src) ? tmp : src);
+        *segs = out;
+        return;
+    }
+
+    /* k-way merge runs from src to tmp */
+    cur  = (MPI_Offset*) NCI_Malloc((size_t)k * 3 * SIZEOF_MPI_OFFSET);
+    end  = cur + k;
+    key  = end + k;
+    heap = (int*) NCI_Malloc((size_t)k * SIZEOF_INT);
+
+    cur[0] = 0;
+    for (r=0,i=1; i<n; i++) {
+        if (src[i-1].off > src[i].off) {
+            end[r++] = i;
+            cur[r]   = i;
+        }
+    }
+    end[r] = n;
+
+    for (r=0; r<k; r++) {
+        heap[r] = r;
+        key[r]  = src[cur[r]].off;
+    }
+    for (r=k/2-1; r>=0; r--) heap_sift_down(key, heap, k, r);
+
+    hsize = k;
+    m = 0;
+    while (hsize > 0) {
+        r = heap[0];
+        if (coalesce) seg_append(tmp, &m, src + cur[r]);
+        else          tmp[m++] = src[cur[r]];
+        if (++cur[r] == end[r]) /* run r is exhausted */
+            heap[0] = heap[--hsize];
+        else
+            key[r] = src[cur[r]].off;
+        if (hsize > 0) heap_sift_down(key, heap, hsize, 0);
+    }
+    *nsegs = m;
+
+    NCI_Free(heap);
+    NCI_Free(cur);
+    NCI_Free(src);
+    *segs = tmp;
+}
+
+/* Segments are processed in chunks of at most this many when constructing
+ * MPI derived data types from the flattened requests.
+ */
+#define NC_FLATTEN_CHUNK 65536
+
+/* iterator generating the offset-length pairs of a subarray request lazily,
+ * in an increasing order of file offsets */
 typedef struct {
-    MPI_Offset off;      /* starting file offset of the request */
-    MPI_Offset len;      /* requested length in bytes starting from off */
-    MPI_Aint   buf_addr; /* distance of this request's I/O buffer to the first
-                            request to be merged */
-} off_len;
-
-/*----< off_compare() >-------------------------------------------------------*/
-/* used for sorting the offsets of the off_len array */
+    int         ndims;    /* number of dimensions iterated */
+    MPI_Offset  nrows;    /* number of raw segments yet to be generated */
+    MPI_Offset  seg_len;  /* length of each raw segment in bytes */
+    MPI_Offset  off;      /* file offset of the next raw segment */
+    MPI_Aint    buf_addr; /* buffer address of the next raw segment */
+    MPI_Offset *idx;      /* [ndims] index of the next raw segment */
+    MPI_Offset *count;    /* [ndims] number of raw segments along each dim */
+    MPI_Offset *step;     /* [ndims] file offset distance along each dim */
+    MPI_Offset  nsegs;    /* number of pairs in segs[] */
+    off_len    *segs;     /* [nsegs] sorted pairs of a varn request, whose
+                             buffer addresses are relative to buf_addr */
+} seg_iter;
+
+/*----< seg_iter_init_vars() >-----------------------------------------------*/
+/* Initialize an iterator for subarray start/count/stride of variable varp,
+ * whose I/O buffer starts at address buf_addr. For record variable, the
+ * subarray must be within a record. Only the loop indices are stored, so the
+ * memory footprint is O(ndims), regardless of the number of segments.
+ */
+static void
+seg_iter_init_vars(const NC         *ncp,
+                   const NC_var     *varp,
+                   const MPI_Offset *start,
+                   const MPI_Offset *count,
+                   const MPI_Offset *stride, /* can be NULL */
+                   MPI_Aint          buf_addr,
+                   seg_iter         *it)
+{
+    int i, ndims;
+    MPI_Offset *shape, array_len, off;
+
+    ndims = varp->ndims;
+    shape = varp->shape;
+
+    /* find the starting file offset for this variable */
+    off = varp->begin;
+
+    /* for record variable, each req is within a record */
+    if (IS_RECVAR(varp)) {
+        /* find the starting file offset for this record */
+        off += start[0] * ncp->recsize;
+        ndims--;
+        start++;
+        count++;
+        shape++;
+        if (stride != NULL) stride++;
+    }
+
+    it->ndims    = ndims;
+    it->off      = off;
+    it->buf_addr = buf_addr;
+    it->seg_len  = varp->xsz;
+    it->idx      = NULL;
+    it->segs     = NULL;
+
+    if (ndims <= 0) { /* scalar or 1D record variable */
+        it->nrows = (ndims == 0) ? 1 : 0;
+        return;
+    }
+
+    it->idx   = (MPI_Offset*) NCI_Calloc((size_t)ndims * 3, SIZEOF_MPI_OFFSET);
+    it->count = it->idx + ndims;
+    it->step  = it->count + ndims;
+
+    /* array_len is the size in bytes of the subarray below dimension i */
+    array_len = varp->xsz;
+    it->nrows = 1;
+    for (i=ndims-1; i>=0; i--) {
+        MPI_Offset str = (stride == NULL) ? 1 : stride[i];
+
+        it->count[i] = count[i];
+        it->step[i]  = str * array_len;
+        it->off     += start[i] * array_len;
+        if (i == ndims-1 && str == 1) {
+            /* the lowest dimension is a single raw segment */
+            it->seg_len *= count[i];
+            it->count[i] = (count[i] > 0) ? 1 : 0;
+        }
+        it->nrows *= it->count[i];
+        array_len *= shape[i];
+    }
+}
+
+/*----< seg_iter_next() >----------------------------------------------------*/
+/* Generate the next offset-length pair into seg. Raw segments contiguous in
+ * the file are coalesced, e.g. the rows of a subarray spanning the whole
+ * lower dimensions. Return 0 when all segments have been generated, 1
+ * otherwise.
+ */
 static int
-off_compare(const void *a, const void *b)
+seg_iter_next(seg_iter *it,
+              off_len  *seg)
 {
-    if (((off_len*)a)->off > ((off_len*)b)->off) return  1;
-    if (((off_len*)a)->off < ((off_len*)b)->off) return -1;
-    return 0;
+    int d;
+
+    if (it->nrows == 0) return 0;
+
+    if (it->segs != NULL) { /* varn or vard request */
+        *seg = it->segs[it->nsegs - it->nrows];
+        seg->buf_addr += it->buf_addr;
+        it->nrows--;
+        return 1;
+    }
+
+    seg->off      = it->off;
+    seg->len      = it->seg_len;
+    seg->buf_addr = it->buf_addr;
+
+    while (1) {
+        /* move to the next raw segment */
+        it->buf_addr += it->seg_len;
+        if (--it->nrows == 0) break;
+        for (d=it->ndims-1; d>=0; d--) {
+            it->off += it->step[d];
+            if (++it->idx[d] < it->count[d]) break;
+            it->off -= it->count[d] * it->step[d];
+            it->idx[d] = 0;
+        }
+        if (it->off != seg->off + seg->len) break;
+
+        /* contiguous in both file and buffer, coalesce it */
+        seg->len += it->seg_len;
+    }
+    return 1;
 }
 
-/*----< vars_flatten() >------------------------------------------------------*/
-/* flatten a subarray request into a list of offset-length pairs */
-static MPI_Offset
-vars_flatten(int          ndim,    /* number of dimensions */
-             int          el_size, /* array element size */
-             MPI_Offset  *dimlen,  /* [ndim] dimension lengths */
-             MPI_Offset   offset,  /* starting file offset of variable */
-             MPI_Aint     buf_addr,/* starting buffer address */
-             MPI_Offset  *start,   /* [ndim] starts of subarray */
-             MPI_Offset  *count,   /* [ndim] counts of subarray */
-             MPI_Offset  *stride,  /* [ndim] strides of subarray */
-             MPI_Offset  *nseg,    /* OUT: number of segments */
-             off_len     *seg)     /* OUT: array of segments */
+/*----< seg_iter_free() >----------------------------------------------------*/
+static void
+seg_iter_free(seg_iter *it)
+{
+    if (it->idx  != NULL) NCI_Free(it->idx);
+    if (it->segs != NULL) NCI_Free(it->segs);
+    it->idx  = NULL;
+    it->segs = NULL;
+}
+
+/*----< seg_iter_init() >----------------------------------------------------*/
+/* Initialize an iterator for request req, whose I/O buffer starts at address
+ * buf_addr. The subarrays of a varn request may be in any order and overlap
+ * with each other, so they are flattened into one list of offset-length
+ * pairs, sorted in an increasing order of file offsets, with overlapped
+ * regions accessed only once, the same as for overlapping requests. The
+ * filetype of a vard request is flattened as is, as a valid MPI fileview
+ * already has monotonically nondecreasing file offsets.
+ */
+static void
+seg_iter_init(const NC     *ncp,
+              const NC_req *req,
+              MPI_Aint      buf_addr,
+              seg_iter     *it)
 {
-    int i, j, to_free_stride=0;
-    MPI_Offset seg_len, nstride, array_len, off, subarray_len;
-    off_len *ptr=seg, *seg0;
-
-    *nseg = 0;
-    if (ndim < 0) return *nseg;
-
-    if (ndim == 0) {  /* scalar record variable */
-        *nseg = 1;
-        seg->off      = offset;
-        seg->len      = el_size;
-        seg->buf_addr = buf_addr;
-        return *nseg;
-    }
-
-    if (stride == NULL) { /* equivalent to {1, 1, ..., 1} */
-        stride = (MPI_Offset*) NCI_Malloc((size_t)ndim * SIZEOF_MPI_OFFSET);
-        for (i=0; i<ndim; i++) stride[i] = 1;
-        to_free_stride = 1;
-    }
-
-    /* TODO: check if all stride[] >= 1
-       Q: Is it legal if any stride[] <= 0 ? */
-
-    /* calculate the number of offset-length pairs */
-    *nseg = (stride[ndim-1] == 1) ? 1 : count[ndim-1];
-    for (i=0; i<ndim-1; i++)
-        *nseg *= count[i];
-    if (*nseg == 0) {  /* not reachable, an error if count[] == 0 */
-        if (to_free_stride) NCI_Free(stride);
-        return *nseg;
-    }
-
-    /* the length of all segments are of the same size */
-    seg_len  = (stride[ndim-1] == 1) ? count[ndim-1] : 1;
-    seg_len *= el_size;
-    nstride  = (stride[ndim-1] == 1) ? 1 : count[ndim-1];
-
-    /* set the offset-length pairs for the lowest dimension */
-    off = offset + start[ndim-1] * el_size;
-    for (i=0; i<nstride; i++) {
-        ptr->off       = off;
-        ptr->len       = seg_len;
-        ptr->buf_addr  = buf_addr;
-        buf_addr      += seg_len;
-        off           += stride[ndim-1] * el_size;
-        ptr++;
-    }
-    ndim--;
-
-    subarray_len = nstride;
-    array_len = 1;
-    /* for higher dimensions */
-    while (ndim > 0) {
-        /* array_len is global array size from lowest up to ndim */
-        array_len *= dimlen[ndim];
-
-        /* off is the global array offset for this dimension, ndim-1 */
-        off = start[ndim-1] * array_len * el_size;
-
-        /* update all offsets from lowest up to dimension ndim-1 */
-        seg0 = seg;
-        for (j=0; j<subarray_len; j++) {
-            seg0->off += off;
-            seg0++;
-        }
-
-        /* update each plan subarray of dimension ndim-1 */
-        off = array_len * stride[ndim-1] * el_size;
-        for (i=1; i<count[ndim-1]; i++) {
-            seg0 = seg;
-            for (j=0; j<subarray_len; j++) {
-                ptr->off       = seg0->off + off;
-                ptr->len       = seg_len;
-                ptr->buf_addr  = buf_addr;
-                buf_addr      += seg_len;
-                ptr++;
-                seg0++;
+    int i, pass, ndims=req->varp->ndims;
+    MPI_Offset j, k, nrecs, len, nsegs=0, *starts, *counts, *sub_start=NULL;
+    MPI_Aint buf_off;
+    off_len *segs=NULL;
+    seg_iter sub;
+
+    if (fIsSet(req->flag, NC_REQ_VARD)) {
+        /* errors of unsupported type constructors have been checked when
+         * the request was posted */
+        ncmpio_filetype_flatten(req->filetype, req->varp->begin, &nsegs,
+                                &segs);
+        it->ndims    = 0;
+        it->idx      = NULL;
+        it->buf_addr = buf_addr;
+        it->nrows    = nsegs;
+        it->nsegs    = nsegs;
+        it->segs     = segs;
+        return;
+    }
+
+    if (!fIsSet(req->flag, NC_REQ_VARN)) {
+        MPI_Offset *count, *stride;
+        count  = req->start + ndims;
+        stride = fIsSet(req->flag, NC_REQ_STRIDE_NULL) ? NULL : count + ndims;
+        seg_iter_init_vars(ncp, req->varp, req->start, count, stride,
+                           buf_addr, it);
+        return;
+    }
+
+    starts = req->start;
+    counts = starts + (size_t)req->varn_num * ndims;
+
+    /* subarrays accessing more than one record are iterated one record at a
+     * time, using sub_start[] and sub_start[ndims ... 2*ndims-1] */
+    if (IS_RECVAR(req->varp))
+        sub_start = (MPI_Offset*) NCI_Malloc((size_t)ndims * 2 *
+                                             SIZEOF_MPI_OFFSET);
+
+    /* the first pass counts the raw segments, the second generates them */
+    for (pass=0; pass<2; pass++) {
+        nsegs   = 0;
+        buf_off = 0;
+        for (i=0; i<req->varn_num; i++) {
+            MPI_Offset *start=starts+(size_t)i*ndims, *count=counts+(size_t)i*ndims;
+
+            nrecs = 1;
+            len   = req->varp->xsz;
+            if (sub_start != NULL) {
+                nrecs = count[0];
+                for (k=0; k<ndims; k++) {
+                    sub_start[k]         = start[k];
+                    sub_start[ndims + k] = count[k];
+                }
+                sub_start[ndims] = 1;
+                for (k=1; k<ndims; k++) len *= count[k];
+            }
+            else
+                for (k=0; k<ndims; k++) len *= count[k];
+
+            for (j=0; j<nrecs; j++) {
+                if (sub_start != NULL) {
+                    sub_start[0] = start[0] + j;
+                    seg_iter_init_vars(ncp, req->varp, sub_start,
+                                       sub_start + ndims, NULL, buf_off, &sub);
+                }
+                else
+                    seg_iter_init_vars(ncp, req->varp, start, count, NULL,
+                                       buf_off, &sub);
+                if (pass == 0)
+                    nsegs += sub.nrows;
+                else
+                    while (seg_iter_next(&sub, segs + nsegs)) nsegs++;
+                seg_iter_free(&sub);
+                buf_off += len;
             }
-            off += array_len * stride[ndim-1] * el_size;
         }
-        ndim--;  /* move to next higher dimension */
-        subarray_len *= count[ndim];
+        if (pass == 0)
+            segs = (off_len*) NCI_Malloc((size_t)nsegs * sizeof(off_len));
     }
-    if (to_free_stride) NCI_Free(stride);
+    if (sub_start != NULL) NCI_Free(sub_start);
+
+    /* each subarray is a sorted run, sort and merge all runs */
+    sort_segs(&nsegs, &segs, 1);
 
-    return *nseg;
+    it->ndims    = 0;
+    it->idx      = NULL;
+    it->buf_addr = buf_addr;
+    it->nrows    = nsegs;
+    it->nsegs    = nsegs;
+    it->segs     = segs;
 }
 
 /*----< merge_requests() >---------------------------------------------------*/
@@ -1176,9 +1805,10 @@ merge_requests(NC          *ncp,
                MPI_Offset  *nsegs,   /* OUT: no. off-len pairs */
                off_len    **segs)    /* OUT: [*nsegs] */
 {
-    int i, j, status=NC_NOERR, ndims;
-    MPI_Offset  nseg, *start, *count, *shape, *stride;
+    int i, status=NC_NOERR;
+    MPI_Offset nseg;
     MPI_Aint addr, buf_addr;
+    seg_iter *iters;
 
     *nsegs = 0;    /* total number of offset-length pairs */
     *segs  = NULL; /* array of offset-length pairs */
@@ -1194,334 +1824,308 @@ merge_requests(NC          *ncp,
 #endif
 
     /* Count the number off-len pairs from reqs[], so we can malloc a
-     * contiguous memory space for storing off-len pairs
+     * contiguous memory space for storing off-len pairs. This is an upper
+     * bound, as the iterator coalesces contiguous pairs. Buffer addresses are
+     * relative to the buf of first req.
      */
-    for (i=0; i<num_reqs; i++) {
-        ndims  = reqs[i].varp->ndims;
-        start  = reqs[i].start;
-        count  = start + ndims;
-        stride = count + ndims;
-
-        /* for record variable, each reqs[] is within a record */
-        if (IS_RECVAR(reqs[i].varp)) {
-            ndims--;
-            start++;
-            count++;
-            stride++;
-        }
-        if (fIsSet(reqs[i].flag, NC_REQ_STRIDE_NULL)) stride = NULL;
-
-        if (ndims < 0) continue;
-        if (ndims == 0) {  /* 1D record variable */
-            (*nsegs)++;
-            continue;
-        }
-        nseg = 1;
-        if (stride != NULL && stride[ndims-1] > 1)
-            nseg = count[ndims-1];  /* count of last dimension */
-        for (j=0; j<ndims-1; j++)
-            nseg *= count[j];  /* all count[] except the last dimension */
-
-        *nsegs += nseg;
-    }
-
-    /* now we can allocate a contiguous memory space for the off-len pairs */
-    off_len *seg_ptr = (off_len*) NCI_Malloc((size_t)(*nsegs) * sizeof(off_len));
-    *segs = seg_ptr;
-
-    /* now re-run the loop to fill in the off-len pairs */
-    for (i=0; i<num_reqs; i++) {
-        MPI_Offset var_begin;
-
-        /* buf_addr is the buffer address of the first valid request */
+    iters = (seg_iter*) NCI_Malloc((size_t)num_reqs * sizeof(seg_iter));
+    for (nseg=0, i=0; i<num_reqs; i++) {
 #ifdef HAVE_MPI_GET_ADDRESS
         MPI_Get_address(reqs[i].xbuf, &addr);
 #else
         MPI_Address(reqs[i].xbuf, &addr);
 #endif
-        addr -= buf_addr,  /* distance to the buf of first req */
-
-        ndims  = reqs[i].varp->ndims;
-        start  = reqs[i].start;
-        count  = start + ndims;
-        stride = count + ndims;
-        shape  = reqs[i].varp->shape;
-
-        /* find the starting file offset for this variable */
-        var_begin = reqs[i].varp->begin;
-
-        /* for record variable, each reqs[] is within a record */
-        if (IS_RECVAR(reqs[i].varp)) {
-            ndims--;
-            start++;
-            count++;
-            stride++;
-            shape++;
-            /* find the starting file offset for this record */
-            var_begin += reqs[i].start[0] * ncp->recsize;
-        }
-
-        if (fIsSet(reqs[i].flag, NC_REQ_STRIDE_NULL)) stride = NULL;
-
-        /* flatten each request to a list of offset-length pairs */
-        vars_flatten(ndims, reqs[i].varp->xsz, shape, var_begin,
-                     addr, start, count, stride,
-                     &nseg,    /* OUT: number of offset-length pairs */
-                     seg_ptr); /* OUT: array of offset-length pairs */
-        seg_ptr += nseg; /* append the list to the end of segs array */
-    }
-
-    /* check if (*segs)[].off are in an increasing order */
-    for (i=1; i<*nsegs; i++) {
-        if ((*segs)[i-1].off > (*segs)[i].off)
-            break;
+        seg_iter_init(ncp, reqs+i, addr - buf_addr, iters+i);
+        nseg += iters[i].nrows;
     }
-    if (i < *nsegs) /* not in an increasing order */
-        /* sort the off-len array, segs[], in an increasing order */
-        qsort(*segs, (size_t)(*nsegs), sizeof(off_len), off_compare);
 
-    /* merge the overlapped requests, skip the overlapped regions for those
-     * requests with higher j indices (i.e. requests with lower j indices
-     * win the writes to the overlapped regions)
-     */
-    for (i=0, j=1; j<*nsegs; j++) {
-        if ((*segs)[i].off + (*segs)[i].len >= (*segs)[j].off + (*segs)[j].len)
-            /* segment i completely covers segment j, skip j */
-            continue;
+    /* now we can allocate a contiguous memory space for the off-len pairs */
+    *segs = (off_len*) NCI_Malloc((size_t)nseg * sizeof(off_len));
 
-        MPI_Offset gap = (*segs)[i].off + (*segs)[i].len - (*segs)[j].off;
-        if (gap >= 0) { /* segments i and j overlaps */
-            if ((*segs)[i].buf_addr + (*segs)[i].len ==
-                (*segs)[j].buf_addr + gap) {
-                /* buffers i and j are contiguous, merge j to i */
-                (*segs)[i].len += (*segs)[j].len - gap;
-            }
-            else { /* buffers are not contiguous, reduce j's len */
-                (*segs)[i+1].off      = (*segs)[j].off + gap;
-                (*segs)[i+1].len      = (*segs)[j].len - gap;
-                (*segs)[i+1].buf_addr = (*segs)[j].buf_addr + gap;
-                i++;
-            }
-        }
-        else { /* i and j do not overlap */
-            i++;
-            if (i < j) (*segs)[i] = (*segs)[j];
-        }
+    /* flatten each request to a list of offset-length pairs, appended to the
+     * end of segs array */
+    for (i=0; i<num_reqs; i++) {
+        while (seg_iter_next(iters+i, *segs + *nsegs))
+            (*nsegs)++;
+        seg_iter_free(iters+i);
     }
+    NCI_Free(iters);
 
-    /* update number of segments, now all off-len pairs are not overlapped */
-    *nsegs = i+1;
+    /* The off-len pairs flattened from each request are in an increasing
+     * order. Sort the sorted runs of segs[] into an increasing order and merge
+     * the overlapped requests, skip the overlapped regions for those requests
+     * with higher indices (i.e. requests with lower indices win the writes to
+     * the overlapped regions). Now all off-len pairs are not overlapped.
+     */
+    sort_segs(nsegs, segs, 1);
 
     return status;
 }
 
-/*----< type_create_off_len() >----------------------------------------------*/
-static int
-type_create_off_len(MPI_Offset    nsegs,    /* no. off-len pairs */
-                    off_len      *segs,     /* [nsegs] off-en pairs */
-                    MPI_Datatype *filetype,
-                    MPI_Datatype *buf_type)
+/* builder of an MPI derived data type from a stream of blocks, sorted in
+ * the type map order. Blocks are coalesced and collected in chunks of at most
+ * NC_FLATTEN_CHUNK. Each chunk becomes an hindexed type and all chunk types
+ * are concatenated at the end. The arrays of a chunk are reused once its type
+ * is committed, but the chunk types are kept until the end.
+ */
+typedef struct {
+    int           nblks;     /* number of blocks in the current chunk */
+    int           max_blks;  /* capacity of blocklens[] and disps[] */
+    int          *blocklens; /* [max_blks] */
+    MPI_Aint     *disps;     /* [max_blks] */
+    int           ntypes;    /* number of chunk types constructed */
+    MPI_Datatype *types;     /* [ntypes] chunk types */
+} type_builder;
+
+/*----< type_builder_init() >------------------------------------------------*/
+static void
+type_builder_init(type_builder *tb,
+                  MPI_Offset    max_blks) /* upper bound of no. blocks */
 {
-    int i, j, mpireturn, *blocklengths;
-    MPI_Aint   *displacements;
-    MPI_Offset  next_off, next_len;
-
-    assert(nsegs > 0);
+    if (max_blks > NC_FLATTEN_CHUNK) max_blks = NC_FLATTEN_CHUNK;
+    if (max_blks < 1) max_blks = 1;
+
+    tb->nblks     = 0;
+    tb->max_blks  = (int)max_blks;
+    tb->blocklens = (int*)      NCI_Malloc((size_t)max_blks * SIZEOF_INT);
+    tb->disps     = (MPI_Aint*) NCI_Malloc((size_t)max_blks * SIZEOF_MPI_AINT);
+    tb->ntypes    = 0;
+    tb->types     = NULL;
+}
 
-    /* create the file view MPI derived data type by concatenating the sorted
-       offset-length pairs */
+/*----< type_builder_flush() >-----------------------------------------------*/
+/* construct an hindexed type from the blocks of the current chunk */
+static int
+type_builder_flush(type_builder *tb)
+{
+    int mpireturn;
+    MPI_Datatype dtype;
 
-    /* For filetype, the segs[].off can be further coalesced. For example,
-     * when writing a consecutive columns of a 2D array, even though the I/O
-     * buffer addresses may not be able to coalesced, the file offsets on
-     * the same row can be coalesced. Thus, first calculate the length of
-     * coalesced off-len pairs (the memory space needed for malloc)
-     */
-    next_off = segs[0].off;
-    next_len = segs[0].len;
-    for (j=0,i=1; i<nsegs; i++) {
-        if (next_off + next_len == segs[i].off) /* j and i are contiguous */
-            next_len += segs[i].len;
-        else {
-            j++;
-            next_off = segs[i].off;
-            next_len = segs[i].len;
-        }
-    }
-    /* j+1 is the coalesced length */
-    blocklengths  = (int*)      NCI_Malloc((size_t)(j+1) * SIZEOF_INT);
-    displacements = (MPI_Aint*) NCI_Malloc((size_t)(j+1) * SIZEOF_MPI_AINT);
-
-    /* coalesce segs[].off and len to dispalcements[] and blocklengths[] */
-    if (segs[0].len != (int)segs[0].len) DEBUG_RETURN_ERROR(NC_EINTOVERFLOW)
-    displacements[0] =      segs[0].off;
-    blocklengths[0]  = (int)segs[0].len;
-    for (j=0,i=1; i<nsegs; i++) {
-        if (segs[i].len != (int)segs[i].len) DEBUG_RETURN_ERROR(NC_EINTOVERFLOW)
-        if (displacements[j] + blocklengths[j] == segs[i].off)
-            /* j and i are contiguous */
-            blocklengths[j] += (int)segs[i].len;
-            /* TODO: take care of 4-byte int overflow problem */
-        else {
-            j++;
-            displacements[j] =      segs[i].off;
-            blocklengths[j]  = (int)segs[i].len;
-        }
-    }
-    /* j+1 is the coalesced length */
+    if (tb->nblks == 0) return NC_NOERR;
 
 #ifdef HAVE_MPI_TYPE_CREATE_HINDEXED
-    mpireturn = MPI_Type_create_hindexed(j+1, blocklengths, displacements,
-                                         MPI_BYTE, filetype);
+    mpireturn = MPI_Type_create_hindexed(tb->nblks, tb->blocklens, tb->disps,
+                                         MPI_BYTE, &dtype);
 #else
-    mpireturn = MPI_Type_hindexed(j+1, blocklengths, displacements, MPI_BYTE,
-                                  filetype);
+    mpireturn = MPI_Type_hindexed(tb->nblks, tb->blocklens, tb->disps,
+                                  MPI_BYTE, &dtype);
 #endif
-    if (mpireturn != MPI_SUCCESS) {
-        *filetype = MPI_BYTE;
-        *buf_type = MPI_BYTE;
-        NCI_Free(displacements);
-        NCI_Free(blocklengths);
+    if (mpireturn != MPI_SUCCESS)
         return ncmpii_error_mpi2nc(mpireturn, "MPI_Type_create_hindexed");
-    }
-    MPI_Type_commit(filetype);
-    NCI_Free(displacements);
-    NCI_Free(blocklengths);
+    MPI_Type_commit(&dtype);
 
-    /* create the I/O buffer derived data type from the I/O buffer's
-       offset-length pairs */
-
-    /* Although it is unlikely buffers can be coalesced, it will not harm to
-       check it out */
-    next_off = segs[0].buf_addr;
-    next_len = segs[0].len;
-    for (j=0,i=1; i<nsegs; i++) {
-        if (next_off + next_len == segs[i].buf_addr)
-            /* j and i are contiguous */
-            next_len += segs[i].len;
-        else {
-            j++;
-            next_off = segs[i].buf_addr;
-            next_len = segs[i].len;
-        }
-    }
-    /* j+1 is the coalesced length */
-    blocklengths  = (int*)      NCI_Malloc((size_t)(j+1) * SIZEOF_INT);
-    displacements = (MPI_Aint*) NCI_Malloc((size_t)(j+1) * SIZEOF_MPI_AINT);
+    tb->types = (MPI_Datatype*) NCI_Realloc(tb->types,
+                (size_t)(tb->ntypes + 1) * sizeof(MPI_Datatype));
+    tb->types[tb->ntypes++] = dtype;
+    tb->nblks = 0;
 
-    /* coalesce segs[].off and len to dispalcements[] and blocklengths[] */
-    if (segs[0].len != (int)segs[0].len) {
-        NCI_Free(displacements);
-        NCI_Free(blocklengths);
-        DEBUG_RETURN_ERROR(NC_EINTOVERFLOW)
-    }
-    displacements[0] =      segs[0].buf_addr;
-    blocklengths[0]  = (int)segs[0].len;
-    for (j=0,i=1; i<nsegs; i++) {
-        if (segs[i].len != (int)segs[i].len) {
-            NCI_Free(displacements);
-            DEBUG_RETURN_ERROR(NC_EINTOVERFLOW)
-        }
-        if (displacements[j] + blocklengths[j] == segs[i].buf_addr)
-            /* j and i are contiguous */
-            blocklengths[j] += (int)segs[i].len;
-        else {
-            j++;
-            displacements[j] =      segs[i].buf_addr;
-            blocklengths[j]  = (int)segs[i].len;
-        }
+    return NC_NOERR;
+}
+
+/*----< type_builder_add() >-------------------------------------------------*/
+/* append a block to the type, coalesce it with the last one if contiguous */
+static int
+type_builder_add(type_builder *tb,
+                 MPI_Aint      disp,
+                 MPI_Offset    len)
+{
+    int err, j = tb->nblks - 1;
+
+    if (j >= 0 && tb->disps[j] + tb->blocklens[j] == disp &&
+        tb->blocklens[j] + len <= INT_MAX) {
+        /* j and this block are contiguous */
+        tb->blocklens[j] += (int)len;
+        return NC_NOERR;
     }
-    /* j+1 is the coalesced length */
-#ifdef HAVE_MPI_TYPE_CREATE_HINDEXED
-    mpireturn = MPI_Type_create_hindexed(j+1, blocklengths, displacements,
-                                         MPI_BYTE, buf_type);
-#else
-    mpireturn = MPI_Type_hindexed(j+1, blocklengths, displacements, MPI_BYTE,
-                                  buf_type);
-#endif
-    if (mpireturn != MPI_SUCCESS) {
-        if (*filetype != MPI_BYTE) MPI_Type_free(filetype);
-        *filetype = MPI_BYTE;
-        *buf_type = MPI_BYTE;
-        NCI_Free(displacements);
-        NCI_Free(blocklengths);
-        return ncmpii_error_mpi2nc(mpireturn, "MPI_Type_create_hindexed");
+    if (len != (int)len) DEBUG_RETURN_ERROR(NC_EINTOVERFLOW)
+
+    if (tb->nblks == tb->max_blks) { /* the current chunk is full */
+        err = type_builder_flush(tb);
+        if (err != NC_NOERR) return err;
     }
-    MPI_Type_commit(buf_type);
-    NCI_Free(displacements);
-    NCI_Free(blocklengths);
+    tb->disps[tb->nblks]     = disp;
+    tb->blocklens[tb->nblks] = (int)len;
+    tb->nblks++;
 
     return NC_NOERR;
 }
 
-/*----< req_compare() >------------------------------------------------------*/
-/* used to sort the the string file offsets of reqs[] */
+/*----< type_builder_finish() >----------------------------------------------*/
+/* Concatenate the chunk types into *dtype and free the builder. If status
+ * indicates an error occurred earlier or no block has been added, *dtype is
+ * MPI_BYTE.
+ */
 static int
-req_compare(const void *a, const void *b)
+type_builder_finish(type_builder *tb,
+                    int           status,
+                    MPI_Datatype *dtype)
 {
-    if (((NC_req*)a)->offset_start > ((NC_req*)b)->offset_start) return (1);
-    if (((NC_req*)a)->offset_start < ((NC_req*)b)->offset_start) return (-1);
-    return (0);
+    int i, mpireturn, *blocklens;
+    MPI_Aint *disps;
+
+    *dtype = MPI_BYTE;
+    if (status == NC_NOERR) status = type_builder_flush(tb);
+
+    if (status == NC_NOERR && tb->ntypes == 1)
+        *dtype = tb->types[0];
+    else if (status == NC_NOERR && tb->ntypes > 1) {
+        blocklens = (int*)      NCI_Malloc((size_t)tb->ntypes * SIZEOF_INT);
+        disps     = (MPI_Aint*) NCI_Malloc((size_t)tb->ntypes * SIZEOF_MPI_AINT);
+        for (i=0; i<tb->ntypes; i++) {
+            blocklens[i] = 1;
+            disps[i]     = 0; /* chunk types use absolute displacements */
+        }
+#ifdef HAVE_MPI_TYPE_CREATE_STRUCT
+        mpireturn = MPI_Type_create_struct(tb->ntypes, blocklens, disps,
+                                           tb->types, dtype);
+#else
+        mpireturn = MPI_Type_struct(tb->ntypes, blocklens, disps, tb->types,
+                                    dtype);
+#endif
+        if (mpireturn != MPI_SUCCESS) {
+            status = ncmpii_error_mpi2nc(mpireturn, "MPI_Type_create_struct");
+            *dtype = MPI_BYTE;
+        }
+        else
+            MPI_Type_commit(dtype);
+        NCI_Free(disps);
+        NCI_Free(blocklens);
+    }
+
+    /* free the chunk types, unless it is used as *dtype */
+    for (i=0; i<tb->ntypes; i++)
+        if (tb->types[i] != *dtype) MPI_Type_free(&tb->types[i]);
+
+    if (tb->types != NULL) NCI_Free(tb->types);
+    NCI_Free(tb->disps);
+    NCI_Free(tb->blocklens);
+
+    return status;
 }
 
-/*----< req_aggregation() >--------------------------------------------------*/
-/* aggregate multiple read/write (non-contiguous) requests and call MPI-IO
+/*----< type_create_reqs() >-------------------------------------------------*/
+/* Construct a fileview type and a buffer type for the interleaved requests
+ * reqs[], whose buffer addresses are relative to the buffer of reqs[0].
+ * The offset-length pairs are generated lazily by an iterator per request,
+ * k-way merged into an increasing order of file offsets, overlaps removed
+ * (requests with lower indices win), and streamed to the type builders. The
+ * temporary arrays allocated here are thus O(num_reqs + NC_FLATTEN_CHUNK),
+ * instead of O(number of pairs). Note the committed chunk types still keep
+ * all blocks until the final types are freed, so the total memory, including
+ * that held by MPI, still grows with the number of coalesced pairs. If no
+ * data is accessed, both types are MPI_BYTE.
  */
 static int
-req_aggregation(NC     *ncp,
-                int     num_reqs,    /* # requests */
-                NC_req *reqs,        /* sorted requests */
-                int     rw_flag,     /* NC_REQ_WR or NC_REQ_RD */
-                int     coll_indep,  /* NC_REQ_COLL or NC_REQ_INDEP */
-                int     interleaved) /* interleaved in reqs[] */
+type_create_reqs(NC           *ncp,
+                 int           num_reqs,
+                 NC_req       *reqs,       /* [num_reqs] */
+                 MPI_Datatype *filetype,   /* OUT */
+                 MPI_Datatype *buf_type)   /* OUT */
 {
-    int i, gtype, err, status=NC_NOERR, ngroups, mpireturn, buf_len;
-    int *group_index, *group_type;
-    int *f_blocklengths, *b_blocklengths;
-    void *buf; /* point to starting buffer, used by MPI-IO call */
-    MPI_Aint      b_begin, b_addr, *f_disps, *b_disps;
-    MPI_Datatype  filetype, buf_type, *ftypes, *btypes;
-    MPI_File fh;
-    MPI_Status mpistatus;
-    MPI_Offset max_end;
-#if MPI_VERSION >= 3
-    MPI_Count buf_type_size=0;
+    int r, hsize, err, status=NC_NOERR, *heap;
+    MPI_Aint buf_begin, addr;
+    MPI_Offset npend=0, nrows=0, *key;
+    off_len *heads, pend[2];
+    seg_iter *iters;
+    type_builder ftb, btb;
+
+#ifdef HAVE_MPI_GET_ADDRESS
+    MPI_Get_address(reqs[0].xbuf, &buf_begin);
 #else
-    int buf_type_size=0;
+    MPI_Address(reqs[0].xbuf, &buf_begin);
 #endif
 
-    if (num_reqs == 0) { /* only NC_REQ_COLL can reach here for 0 request */
-        assert(coll_indep == NC_REQ_COLL);
-        /* simply participate the collective call */
-        return ncmpio_getput_zero_req(ncp, rw_flag);
-    }
-    if (! interleaved) {
-        /* concatenate all filetypes into a single one and do I/O */
-        return mgetput(ncp, num_reqs, reqs, rw_flag, coll_indep);
+    iters = (seg_iter*)   NCI_Malloc((size_t)num_reqs * sizeof(seg_iter));
+    heads = (off_len*)    NCI_Malloc((size_t)num_reqs * sizeof(off_len));
+    key   = (MPI_Offset*) NCI_Malloc((size_t)num_reqs * SIZEOF_MPI_OFFSET);
+    heap  = (int*)        NCI_Malloc((size_t)num_reqs * SIZEOF_INT);
+
+    /* heads[r] is the next pair of request r, heap[] is keyed by its offset */
+    for (hsize=0, r=0; r<num_reqs; r++) {
+#ifdef HAVE_MPI_GET_ADDRESS
+        MPI_Get_address(reqs[r].xbuf, &addr);
+#else
+        MPI_Address(reqs[r].xbuf, &addr);
+#endif
+        seg_iter_init(ncp, reqs+r, addr - buf_begin, iters+r);
+        nrows += iters[r].nrows;
+        if (seg_iter_next(iters+r, heads+r)) {
+            key[r] = heads[r].off;
+            heap[hsize++] = r;
+        }
+    }
+    for (r=hsize/2-1; r>=0; r--) heap_sift_down(key, heap, hsize, r);
+
+    type_builder_init(&ftb, nrows);
+    type_builder_init(&btb, nrows);
+
+    while (hsize > 0 && status == NC_NOERR) {
+        r = heap[0];
+        /* pend[] keeps the last pair, which may still be merged with the
+         * following ones. Once a new pair is appended, the previous one is
+         * final and added to the types */
+        seg_append(pend, &npend, heads+r);
+        if (npend == 2) {
+            status = type_builder_add(&ftb, pend[0].off, pend[0].len);
+            if (status == NC_NOERR)
+                status = type_builder_add(&btb, pend[0].buf_addr, pend[0].len);
+            pend[0] = pend[1];
+            npend = 1;
+        }
+
+        if (seg_iter_next(iters+r, heads+r))
+            key[r] = heads[r].off;
+        else /* request r is exhausted */
+            heap[0] = heap[--hsize];
+        if (hsize > 0) heap_sift_down(key, heap, hsize, 0);
+    }
+    if (npend == 1 && status == NC_NOERR) {
+        status = type_builder_add(&ftb, pend[0].off, pend[0].len);
+        if (status == NC_NOERR)
+            status = type_builder_add(&btb, pend[0].buf_addr, pend[0].len);
+    }
+
+    for (r=0; r<num_reqs; r++) seg_iter_free(iters+r);
+    NCI_Free(heap);
+    NCI_Free(key);
+    NCI_Free(heads);
+    NCI_Free(iters);
+
+    err = type_builder_finish(&ftb, status, filetype);
+    if (status == NC_NOERR) status = err;
+    err = type_builder_finish(&btb, status, buf_type);
+    if (status == NC_NOERR) status = err;
+
+    if (status != NC_NOERR && *filetype != MPI_BYTE) {
+        MPI_Type_free(filetype);
+        *filetype = MPI_BYTE;
     }
-    /* now some request's aggregate access region is interleaved with other's */
+    return status;
+}
 
-    /* divide the requests into groups.
-     * Two types of groups: one contains requests that all are not interleaved
-     * and the other contains requests that any 2 consecutive requests are
-     * interleaved. All requests will be aggregated into one and carried out
-     * by a single MPI-IO call.
-     * This approach is because MPI collective I/O requires each process's
-     * fileview must contain only monotonic non-decreasing file offsets. Thus
-     * if the nonblocking requests interleave with each other (although not
-     * overlap), then we cannot simply concatenate the filetypes of individual
-     * requests. This approach flattens the requests of "interleaved" groups
-     * into offset-length pairs, sorts, and merges them into an aggregated
-     * filetype. Similar for building an aggregated I/O buffer type.
-     */
+/* group types used in req_aggregation() */
+#define INTERLEAVED    1
+#define NONINTERLEAVED 0
+
+/*----< group_requests() >---------------------------------------------------*/
+/* Divide the sorted requests reqs[] into groups of consecutive requests and
+ * return the number of groups. (*group_index)[i] is the index of the first
+ * request of group i, with (*group_index)[ngroups] == num_reqs, and
+ * (*group_type)[i] is either INTERLEAVED or NONINTERLEAVED.
+ */
+static int
+group_requests(int            num_reqs,
+               const NC_req  *reqs,            /* [num_reqs] sorted */
+               int          **group_index_ptr, /* OUT: [ngroups+1] */
+               int          **group_type_ptr)  /* OUT: [ngroups+1] */
+{
+    int i, gtype, ngroups, *group_index, *group_type;
+    MPI_Offset max_end;
 
     /* first calculate the number of groups, so group_index and group_type can
        be malloc-ed. Group type: 0 for non-interleaved group and 1 for
        interleaved group.
      */
-#define INTERLEAVED    1
-#define NONINTERLEAVED 0
-
     assert(num_reqs > 1);
     ngroups = 1;
     gtype   = (reqs[0].offset_end > reqs[1].offset_start) ?
@@ -1555,6 +2159,8 @@ req_aggregation(NC     *ncp,
 
     group_index = (int*) NCI_Malloc((size_t)(ngroups+1) * SIZEOF_INT);
     group_type  = (int*) NCI_Malloc((size_t)(ngroups+1) * SIZEOF_INT);
+    *group_index_ptr = group_index;
+    *group_type_ptr  = group_type;
 
     /* calculate the starting index of each group and determine group type */
     ngroups        = 1;
@@ -1596,6 +2202,139 @@ req_aggregation(NC     *ncp,
     }
     group_index[ngroups] = num_reqs; /* to indicate end of groups */
 
+    return ngroups;
+}
+
+/*----< req_aggregation() >--------------------------------------------------*/
+/* aggregate multiple read/write (non-contiguous) requests and call MPI-IO
+ */
+static int
+req_aggregation(NC     *ncp,
+                int     num_reqs,    /* # requests */
+                NC_req *reqs,        /* sorted requests */
+                int     rw_flag,     /* NC_REQ_WR or NC_REQ_RD */
+                int     coll_indep,  /* NC_REQ_COLL or NC_REQ_INDEP */
+                int     interleaved) /* interleaved in reqs[] */
+{
+    int i, err, status=NC_NOERR, ngroups, mpireturn, buf_len, has_varn;
+    int *group_index, *group_type;
+    int *f_blocklengths, *b_blocklengths;
+    double timing;
+    void *buf; /* point to starting buffer, used by MPI-IO call */
+    MPI_Aint      b_begin, b_addr, *f_disps, *b_disps;
+    MPI_Datatype  filetype, buf_type, *ftypes, *btypes;
+    MPI_File fh;
+    MPI_Status mpistatus;
+#if MPI_VERSION >= 3
+    MPI_Count buf_type_size=0;
+#else
+    int buf_type_size=0;
+#endif
+
+    if (coll_indep == NC_REQ_COLL && ncp->two_phase) {
+        /* Use PnetCDF's own two-phase I/O. Flatten all requests into a sorted
+         * list of non-overlapped offset-length pairs, which is then
+         * redistributed among the I/O aggregators. Processes with zero
+         * requests must still participate the data exchange.
+         */
+        MPI_Offset nsegs=0;
+        off_len *segs=NULL;
+
+        buf = NULL;
+        if (num_reqs > 0)
+            status = merge_requests(ncp, num_reqs, reqs, &buf, &nsegs, &segs);
+
+        timing = NC_STATS_WTIME(ncp);
+        err = ncmpio_two_phase_io(ncp, rw_flag, nsegs, segs, buf);
+        NC_STATS_ADD_TIME(ncp, NC_STATS_TIME_MPIIO, timing)
+        if (status == NC_NOERR) status = err;
+
+        if (segs != NULL) NCI_Free(segs);
+        return status;
+    }
+
+    if (coll_indep == NC_REQ_COLL && ncp->intra_node_aggr) {
+        /* Aggregate the requests of all processes on the same compute node
+         * to the node leader, which carries out the MPI collective I/O on
+         * behalf of them. Processes with zero requests must still
+         * participate, as the aggregation is collective.
+         */
+        MPI_Offset nsegs=0;
+        off_len *segs=NULL;
+
+        buf = NULL;
+        if (num_reqs > 0)
+            status = merge_requests(ncp, num_reqs, reqs, &buf, &nsegs, &segs);
+
+        timing = NC_STATS_WTIME(ncp);
+        err = ncmpio_intra_node_aggr(ncp, rw_flag, nsegs, segs, buf);
+        NC_STATS_ADD_TIME(ncp, NC_STATS_TIME_MPIIO, timing)
+        if (status == NC_NOERR) status = err;
+
+        if (segs != NULL) NCI_Free(segs);
+        return status;
+    }
+
+    if (num_reqs == 0) { /* only NC_REQ_COLL can reach here for 0 request */
+        assert(coll_indep == NC_REQ_COLL);
+        /* simply participate the collective call */
+        return ncmpio_getput_zero_req(ncp, rw_flag);
+    }
+
+    /* subarrays of a varn request are only accessed through its flattened
+     * offset-length pairs, see seg_iter_init() */
+    for (i=0; i<num_reqs; i++)
+        if (fIsSet(reqs[i].flag, NC_REQ_VARN)) break;
+    has_varn = (i < num_reqs);
+
+    if (! interleaved && ! has_varn) {
+        /* concatenate all filetypes into a single one and do I/O */
+        return mgetput(ncp, num_reqs, reqs, rw_flag, coll_indep);
+    }
+    /* now some request's aggregate access region is interleaved with other's */
+
+    /* divide the requests into groups.
+     * Two types of groups: one contains requests that all are not interleaved
+     * and the other contains requests that any 2 consecutive requests are
+     * interleaved. All requests will be aggregated into one and carried out
+     * by a single MPI-IO call.
+     * This approach is because MPI collective I/O requires each process's
+     * fileview must contain only monotonic non-decreasing file offsets. Thus
+     * if the nonblocking requests interleave with each other (although not
+     * overlap), then we cannot simply concatenate the filetypes of individual
+     * requests. This approach flattens the requests of "interleaved" groups
+     * into offset-length pairs, sorts, and merges them into an aggregated
+     * filetype. Similar for building an aggregated I/O buffer type.
+     */
+    if (num_reqs > 1)
+        ngroups = group_requests(num_reqs, reqs, &group_index, &group_type);
+    else { /* a single varn request */
+        ngroups = 1;
+        group_index = (int*) NCI_Malloc(2 * SIZEOF_INT);
+        group_type  = (int*) NCI_Malloc(2 * SIZEOF_INT);
+        group_index[0] = 0;
+        group_index[1] = num_reqs;
+        group_type[0]  = NONINTERLEAVED;
+    }
+
+    if (has_varn) {
+        /* A varn request is flattened into offset-length pairs, so its
+         * subarrays can be in any order. The groups containing a varn
+         * request are treated as interleaved. Its access range covers all
+         * its subarrays, so the groups still do not interleave each other.
+         */
+        for (i=0; i<ngroups; i++) {
+            int j;
+            if (group_type[i] == INTERLEAVED) continue;
+            for (j=group_index[i]; j<group_index[i+1]; j++) {
+                if (fIsSet(reqs[j].flag, NC_REQ_VARN)) {
+                    group_type[i] = INTERLEAVED;
+                    break;
+                }
+            }
+        }
+    }
+
     /* for each group, construct one filetype by concatenating if the group
      * is non-interleaved and by flatten/sort/merge if the group is
      * interleaved. At the end, all ngroups filetypes are concatenated into
@@ -1629,7 +2368,9 @@ req_aggregation(NC     *ncp,
             /* This group contains no interleaved filetypes, so we can
              * simply concatenate filetypes of this group into a single one
              */
+            timing = NC_STATS_WTIME(ncp);
             err = construct_filetypes(ncp, g_num_reqs, g_reqs, &ftypes[i]);
+            NC_STATS_ADD_TIME(ncp, NC_STATS_TIME_FILETYPE, timing)
             if (status == NC_NOERR) status = err;
             if (err != NC_NOERR) { /* skip this group */
                 ftypes[i] = btypes[i] = MPI_BYTE;
@@ -1655,41 +2396,16 @@ req_aggregation(NC     *ncp,
              * requests each accessing a single column of a 2D array, that each
              * produces a filetype interleaving with others'.
              *
-             * The pitfall of this flattening is the additional memory
-             * requirement, as it will have to break down each request into a
-             * list of offset-length pairs, and merge all lists into a sorted
-             * list based on their offsets into an increasing order.
-             *
-             * Be warned! The additional memory requirement for this merging can
-             * be more than the I/O data itself. For example, each nonblocking
-             * request access a single column of a 2D array of 4-byte integer
-             * type. Each off-len pair represents only a 4-byte integer, but the
-             * off-len pair itself takes 24 bytes. Additional memory is also
-             * required for MPI arguments of displacements and blocklengths.
+             * The offset-length pairs are generated lazily from each request
+             * and merged on the fly, and the derived data types are built in
+             * chunks, so the off-len pairs of all requests are never
+             * materialized at the same time.
              */
-            MPI_Offset  nsegs=0;   /* number of merged offset-length pairs */
-            off_len    *segs=NULL; /* array of the offset-length pairs */
-            void       *merged_buf;
-
-            /* merge all requests into sorted offset-length pairs */
-            err = merge_requests(ncp, g_num_reqs, g_reqs, &merged_buf, &nsegs,
-                                 &segs);
-            if (status == NC_NOERR) status = err;
-            if (err != NC_NOERR) { /* skip this group */
-                ftypes[i] = btypes[i] = MPI_BYTE;
-                b_blocklengths[i] = 0;
-                f_blocklengths[i] = 0;
-                if (segs != NULL) NCI_Free(segs);
-                continue;
-            }
-            assert(nsegs > 0);
-
-            /* sges[] will be used to construct fileview and buffer type */
-            err = type_create_off_len(nsegs, segs, &ftypes[i], &btypes[i]);
+            err = type_create_reqs(ncp, g_num_reqs, g_reqs, &ftypes[i],
+                                   &btypes[i]);
             /* preserve the previous error if there is any */
             if (status == NC_NOERR) status = err;
-            NCI_Free(segs);
-            if (err != NC_NOERR) { /* skip this group */
+            if (err != NC_NOERR || ftypes[i] == MPI_BYTE) { /* skip group */
                 ftypes[i] = btypes[i] = MPI_BYTE;
                 b_blocklengths[i] = 0;
                 f_blocklengths[i] = 0;
@@ -1823,7 +2539,15 @@ req_aggregation(NC     *ncp,
         memset(&mpistatus, 0, sizeof(MPI_Status));
 #endif
 
-    if (rw_flag == NC_REQ_RD) {
+    timing = NC_STATS_WTIME(ncp);
+    if (coll_indep == NC_REQ_COLL && ncp->wait_split != NULL &&
+        ncp->wait_split->post) {
+        /* split-phase wait: completed in ncmpio_wait_end() */
+        err = post_coll_io(ncp, fh, offset, buf, buf_len, buf_type, rw_flag,
+                           (MPI_Offset)buf_len * buf_type_size);
+        if (status == NC_NOERR) status = err;
+    }
+    else if (rw_flag == NC_REQ_RD) {
         if (coll_indep == NC_REQ_COLL) {
             TRACE_IO(MPI_File_read_at_all)(fh, offset, buf, buf_len, buf_type,
                                            &mpistatus);
@@ -1891,6 +2615,7 @@ req_aggregation(NC     *ncp,
 #endif
         }
     }
+    NC_STATS_ADD_TIME(ncp, NC_STATS_TIME_MPIIO, timing)
 
     if (filetype != MPI_BYTE) MPI_Type_free(&filetype);
     if (buf_type != MPI_BYTE) MPI_Type_free(&buf_type);
@@ -1908,6 +2633,67 @@ req_aggregation(NC     *ncp,
     return status;
 }
 
+/*----< wait_write_done() >--------------------------------------------------*/
+/* Called once the writes of a wait have completed.
+ * Update the number of records if new records have been created.
+ * For nonblocking APIs, there is no way for a process to know whether
+ * others write to a record variable or not. Note newnumrecs has been
+ * sync-ed and always >= ncp->numrecs. Flush the file if NC_SHARE is set.
+ */
+static int
+wait_write_done(NC         *ncp,
+                int         coll_indep, /* NC_REQ_COLL or NC_REQ_INDEP */
+                MPI_Offset  newnumrecs) /* new number of records */
+{
+    int err, status=NC_NOERR;
+
+    if (coll_indep == NC_REQ_COLL) {
+        if (newnumrecs > ncp->numrecs || NC_ndirty(ncp)) {
+            /* update new record number in file. Note newnumrecs is already
+             * sync-ed among all processes and in collective mode
+             * ncp->numrecs is always sync-ed in memory among processes,
+             * thus no need another MPI_Allreduce to sync it. When hint
+             * nc_defer_numrecs is enabled, newnumrecs also reconciles the
+             * numrecs deferred by the collective blocking puts, and the
+             * root's may be dirty but not smaller. */
+            err = ncmpio_write_numrecs(ncp, newnumrecs);
+            if (status == NC_NOERR) status = err;
+            /* retain the first error if there is any */
+            if (ncp->numrecs < newnumrecs) ncp->numrecs = newnumrecs;
+        }
+        /* numrecs is now sync-ed in memory among processes */
+        fClr(ncp->flags, NC_NDIRTY);
+    }
+    else { /* NC_REQ_INDEP */
+        if (ncp->numrecs < newnumrecs) {
+            ncp->numrecs = newnumrecs;
+            set_NC_ndirty(ncp);
+            /* delay numrecs sync until end_indep, redef or close */
+        }
+    }
+
+    if (NC_doFsync(ncp)) { /* NC_SHARE is set */
+        int mpireturn;
+        if (coll_indep == NC_REQ_INDEP) {
+            TRACE_IO(MPI_File_sync)(ncp->independent_fh);
+            if (mpireturn != MPI_SUCCESS) {
+                err = ncmpii_error_mpi2nc(mpireturn, "MPI_File_sync");
+                if (status == NC_NOERR) status = err;
+            }
+        }
+        else {
+            TRACE_IO(MPI_File_sync)(ncp->collective_fh);
+            if (mpireturn != MPI_SUCCESS) {
+                err = ncmpii_error_mpi2nc(mpireturn, "MPI_File_sync");
+                if (status == NC_NOERR) status = err;
+            }
+            TRACE_COMM(MPI_Barrier)(ncp->comm);
+        }
+    }
+
+    return status;
+}
+
 /*----< wait_getput() >------------------------------------------------------*/
 static int
 wait_getput(NC         *ncp,
@@ -1928,12 +2714,34 @@ wait_getput(NC         *ncp,
         NC_req     *req=reqs+i;
         int         ndims=req->varp->ndims;
 
+        if (fIsSet(req->flag, NC_REQ_VARD)) {
+            /* access range of the filetype of a vard request */
+            vard_range(req, &req->offset_start, &req->offset_end);
+            req->offset_start += req->varp->begin;
+            req->offset_end   += req->varp->begin;
+            continue;
+        }
+
         if (ndims == 0) { /* scalar variable */
             req->offset_start = req->varp->begin;
             req->offset_end   = req->varp->begin + req->varp->xsz;
             continue;
         }
 
+        if (fIsSet(req->flag, NC_REQ_VARN)) {
+            /* access range covering all subarrays of a varn request */
+            int j;
+            MPI_Offset *start=req->start, st, end;
+            count = start + (size_t)req->varn_num * ndims;
+            for (j=0; j<req->varn_num; j++, start+=ndims, count+=ndims) {
+                ncmpio_access_range(ncp, req->varp, start, count, NULL,
+                                    &st, &end);
+                if (j == 0 || st < req->offset_start) req->offset_start = st;
+                if (j == 0 || end > req->offset_end)  req->offset_end   = end;
+            }
+            continue;
+        }
+
         count  = req->start + ndims;
         stride = fIsSet(req->flag, NC_REQ_STRIDE_NULL) ? NULL : count+ndims;
 
@@ -1968,9 +2776,28 @@ wait_getput(NC         *ncp,
             break;
         }
     }
-    if (i < num_reqs) /* a non-increasing order is found */
-        /* sort reqs[] based on reqs[].offset_start */
-        qsort(reqs, (size_t)num_reqs, sizeof(NC_req), req_compare);
+    if (i < num_reqs) { /* a non-increasing order is found */
+        /* sort reqs[] based on reqs[].offset_start. Instead of moving the
+         * NC_req objects around, sort an array of keys, whose buf_addr stores
+         * the index to reqs[], and then permute reqs[] */
+        MPI_Offset nkeys=num_reqs;
+        off_len *keys;
+        NC_req *sorted;
+
+        keys = (off_len*) NCI_Malloc((size_t)num_reqs * sizeof(off_len));
+        for (i=0; i<num_reqs; i++) {
+            keys[i].off      = reqs[i].offset_start;
+            keys[i].len      = 0;
+            keys[i].buf_addr = i;
+        }
+        sort_segs(&nkeys, &keys, 0);
+
+        sorted = (NC_req*) NCI_Malloc((size_t)num_reqs * sizeof(NC_req));
+        for (i=0; i<num_reqs; i++) sorted[i] = reqs[keys[i].buf_addr];
+        memcpy(reqs, sorted, (size_t)num_reqs * sizeof(NC_req));
+        NCI_Free(sorted);
+        NCI_Free(keys);
+    }
 
     /* check for any interleaved requests */
     for (i=1; i<num_reqs; i++) {
@@ -1985,50 +2812,12 @@ wait_getput(NC         *ncp,
                           access_interleaved);
     if (status == NC_NOERR) status = err;
 
-    /* Update the number of records if new records have been created.
-     * For nonblocking APIs, there is no way for a process to know whether
-     * others write to a record variable or not. Note newnumrecs has been
-     * sync-ed and always >= ncp->numrecs.
-     */
-    if (rw_flag == NC_REQ_WR) {
-        if (coll_indep == NC_REQ_COLL) {
-            if (newnumrecs > ncp->numrecs) {
-                /* update new record number in file. Note newnumrecs is already
-                 * sync-ed among all processes and in collective mode
-                 * ncp->numrecs is always sync-ed in memory among processes,
-                 * thus no need another MPI_Allreduce to sync it. */
-                err = ncmpio_write_numrecs(ncp, newnumrecs);
-                if (status == NC_NOERR) status = err;
-                /* retain the first error if there is any */
-                if (ncp->numrecs < newnumrecs) ncp->numrecs = newnumrecs;
-            }
-        }
-        else { /* NC_REQ_INDEP */
-            if (ncp->numrecs < newnumrecs) {
-                ncp->numrecs = newnumrecs;
-                set_NC_ndirty(ncp);
-                /* delay numrecs sync until end_indep, redef or close */
-            }
-        }
-
-        if (NC_doFsync(ncp)) { /* NC_SHARE is set */
-            int mpireturn;
-            if (coll_indep == NC_REQ_INDEP) {
-                TRACE_IO(MPI_File_sync)(ncp->independent_fh);
-                if (mpireturn != MPI_SUCCESS) {
-                    err = ncmpii_error_mpi2nc(mpireturn, "MPI_File_sync");
-                    if (status == NC_NOERR) status = err;
-                }
-            }
-            else {
-                TRACE_IO(MPI_File_sync)(ncp->collective_fh);
-                if (mpireturn != MPI_SUCCESS) {
-                    err = ncmpii_error_mpi2nc(mpireturn, "MPI_File_sync");
-                    if (status == NC_NOERR) status = err;
-                }
-                TRACE_COMM(MPI_Barrier)(ncp->comm);
-            }
-        }
+    /* for a split-phase wait, numrecs is updated after the posted write
+     * completes, see ncmpio_wait_end() */
+    if (rw_flag == NC_REQ_WR && (ncp->wait_split == NULL ||
+                                 ncp->wait_split->rw_flag != NC_REQ_WR)) {
+        err = wait_write_done(ncp, coll_indep, newnumrecs);
+        if (status == NC_NOERR) status = err;
     }
 
     return status;
@@ -2048,7 +2837,8 @@ mgetput(NC     *ncp,
         int     rw_flag,     /* NC_REQ_WR or NC_REQ_RD */
         int     coll_indep)  /* NC_REQ_COLL or NC_REQ_INDEP */
 {
-    int i, j, k, len=0, status=NC_NOERR, mpireturn, err;
+    int i, j, len=0, status=NC_NOERR, mpireturn, err;
+    double timing;
     void *buf=NULL;
     MPI_Status mpistatus;
     MPI_Datatype filetype, buf_type=MPI_BYTE;
@@ -2066,7 +2856,9 @@ mgetput(NC     *ncp,
         fh = ncp->independent_fh;
 
     /* construct a MPI file type by concatenating fileviews of all requests */
+    timing = NC_STATS_WTIME(ncp);
     status = construct_filetypes(ncp,num_reqs, reqs, &filetype);
+    NC_STATS_ADD_TIME(ncp, NC_STATS_TIME_FILETYPE, timing)
     if (status != NC_NOERR) { /* if failed, skip this request */
         if (coll_indep == NC_REQ_INDEP) return status;
 
@@ -2097,14 +2889,8 @@ mgetput(NC     *ncp,
         MPI_Offset req_size;
         if (fIsSet(reqs[0].flag, NC_REQ_SKIP))
             req_size = 0;
-        else {
-            req_size = reqs[0].varp->xsz;
-            if (reqs[0].varp->ndims > 0) {
-                MPI_Offset *count = reqs[0].start + reqs[0].varp->ndims;
-                if (!IS_RECVAR(reqs[0].varp)) req_size *= count[0];
-                for (k=1; k<reqs[0].varp->ndims; k++) req_size *= count[k];
-            }
-        }
+        else
+            req_size = req_xlen(reqs);
 
         if (req_size > INT_MAX) { /* skip this request */
             if (status == NC_NOERR) DEBUG_ASSIGN_ERROR(status, NC_EINTOVERFLOW)
@@ -2129,12 +2915,7 @@ mgetput(NC     *ncp,
             MPI_Offset req_size;
             if (fIsSet(reqs[i].flag, NC_REQ_SKIP)) continue;
 
-            req_size = reqs[i].varp->xsz;
-            if (reqs[i].varp->ndims > 0) { /* non-scalar variable */
-                MPI_Offset *count = reqs[i].start + reqs[i].varp->ndims;
-                if (!IS_RECVAR(reqs[i].varp)) req_size *= count[0];
-                for (k=1; k<reqs[i].varp->ndims; k++) req_size *= count[k];
-            }
+            req_size = req_xlen(reqs+i);
 
             /* check int overflow */
             if (req_size > INT_MAX) { /* int overflows, skip this request */
@@ -2258,7 +3039,15 @@ mgetput(NC     *ncp,
     memset(&mpistatus, 0, sizeof(MPI_Status));
 #endif
 
-    if (rw_flag == NC_REQ_RD) {
+    timing = NC_STATS_WTIME(ncp);
+    if (coll_indep == NC_REQ_COLL && ncp->wait_split != NULL &&
+        ncp->wait_split->post) {
+        /* split-phase wait: completed in ncmpio_wait_end() */
+        err = post_coll_io(ncp, fh, offset, buf, len, buf_type, rw_flag,
+                           (MPI_Offset)len * buf_type_size);
+        if (status == NC_NOERR) status = err;
+    }
+    else if (rw_flag == NC_REQ_RD) {
         if (coll_indep == NC_REQ_COLL) {
             TRACE_IO(MPI_File_read_at_all)(fh, offset, buf, len, buf_type,
                                            &mpistatus);
@@ -2327,6 +3116,7 @@ mgetput(NC     *ncp,
 #endif
         }
     }
+    NC_STATS_ADD_TIME(ncp, NC_STATS_TIME_MPIIO, timing)
 
     if (buf_type != MPI_BYTE) /* free user buffer type */
         mpireturn = MPI_Type_free(&buf_type);
@@ -2339,3 +3129,144 @@ mgetput(NC     *ncp,
 
     return status;
 }
+
+/*----< wait_split_io_done() >-----------------------------------------------*/
+/* called when the nonblocking MPI-IO call of a split-phase wait completes */
+static void
+wait_split_io_done(NC *ncp,
+                   int mpireturn)
+{
+    int err;
+#ifdef _USE_MPI_GET_COUNT
+    int io_size;
+#endif
+    NC_wait_split *ws=ncp->wait_split;
+
+    if (mpireturn != MPI_SUCCESS) {
+        err = ncmpii_error_mpi2nc(mpireturn, "MPI_Wait");
+        if (err == NC_EFILE)
+            err = (ws->rw_flag == NC_REQ_RD) ? NC_EREAD : NC_EWRITE;
+        /* retain the first error if there is any */
+        if (ws->status == NC_NOERR) DEBUG_ASSIGN_ERROR(ws->status, err)
+        return;
+    }
+
+    /* update the number of bytes read/written since file open */
+#ifdef _USE_MPI_GET_COUNT
+    MPI_Get_count(&ws->mpistatus, MPI_BYTE, &io_size);
+    ws->nbytes = io_size;
+#endif
+    if (ws->rw_flag == NC_REQ_RD)
+        ncp->get_size += ws->nbytes;
+    else
+        ncp->put_size += ws->nbytes;
+}
+
+/*----< ncmpio_wait_start() >-------------------------------------------------*/
+/* This function is collective and is called in collective data mode. Same as
+ * ncmpio_wait(), the requests are aggregated and the fileview is constructed,
+ * but the last MPI collective read/write is posted by MPI_File_iread_at_all()
+ * or MPI_File_iwrite_at_all() and this function returns without waiting for
+ * it to complete. When both reads and writes are waited, the writes are
+ * carried out first and only the reads are posted. The requests complete in
+ * ncmpio_wait_end(), which must be called before the file is accessed again.
+ * The I/O is carried out in this function when the MPI library does not
+ * support these MPI-3.1 functions or when two-phase I/O or intra-node
+ * aggregation is enabled. Errors are reported by ncmpio_wait_end().
+ */
+int
+ncmpio_wait_start(void *ncdp,
+                  int   num_reqs,
+                  int  *req_ids,   /* [num_reqs]: IN/OUT */
+                  int  *statuses)  /* [num_reqs] */
+{
+    int err;
+    NC *ncp = (NC*)ncdp;
+    NC_wait_split *ws;
+
+    if (NC_WAIT_PENDING(ncp)) DEBUG_RETURN_ERROR(NC_EPENDING)
+
+    ws = (NC_wait_split*) NCI_Calloc(1, sizeof(NC_wait_split));
+    if (ws == NULL) DEBUG_RETURN_ERROR(NC_ENOMEM)
+    ws->mpireq = MPI_REQUEST_NULL;
+    ncp->wait_split = ws;
+
+    err = ncmpio_wait(ncp, num_reqs, req_ids, statuses, NC_REQ_COLL);
+    if (ws->status == NC_NOERR) ws->status = err;
+
+    /* from now on, the file cannot be accessed until ncmpio_wait_end() */
+    ws->pending = 1;
+
+    return NC_NOERR;
+}
+
+/*----< ncmpio_wait_test() >--------------------------------------------------*/
+/* This function is independent. It sets flag to 1 if the I/O posted by
+ * ncmpio_wait_start() has completed, 0 otherwise. ncmpio_wait_end() must
+ * still be called to complete the requests.
+ */
+int
+ncmpio_wait_test(void *ncdp,
+                 int  *flag)
+{
+    int mpireturn;
+    NC *ncp = (NC*)ncdp;
+    NC_wait_split *ws=ncp->wait_split;
+
+    if (!NC_WAIT_PENDING(ncp)) DEBUG_RETURN_ERROR(NC_EINVAL_REQUEST)
+
+    *flag = 1;
+    if (ws->mpireq == MPI_REQUEST_NULL) return NC_NOERR;
+
+    TRACE_IO(MPI_Test)(&ws->mpireq, flag, &ws->mpistatus);
+    if (mpireturn != MPI_SUCCESS) {
+        /* MPI_Test has freed the request */
+        *flag = 1;
+        ws->mpireq = MPI_REQUEST_NULL;
+    }
+    if (*flag) wait_split_io_done(ncp, mpireturn);
+
+    return NC_NOERR;
+}
+
+/*----< ncmpio_wait_end() >---------------------------------------------------*/
+/* This function is collective. It waits for the I/O posted by
+ * ncmpio_wait_start() to complete, updates the number of records, and
+ * completes the requests, i.e. unpacks the read data into user buffers.
+ * The first error of all requests is returned.
+ */
+int
+ncmpio_wait_end(void *ncdp)
+{
+    int err, mpireturn, status;
+    double timing;
+    NC *ncp = (NC*)ncdp;
+    NC_wait_split *ws=ncp->wait_split;
+
+    if (!NC_WAIT_PENDING(ncp)) DEBUG_RETURN_ERROR(NC_EINVAL_REQUEST)
+
+    if (ws->mpireq != MPI_REQUEST_NULL) {
+        timing = NC_STATS_WTIME(ncp);
+        TRACE_IO(MPI_Wait)(&ws->mpireq, &ws->mpistatus);
+        NC_STATS_ADD_TIME(ncp, NC_STATS_TIME_MPIIO, timing)
+        wait_split_io_done(ncp, mpireturn);
+    }
+
+    /* the file can be accessed again */
+    ncp->wait_split = NULL;
+    status = ws->status;
+
+    /* numrecs is updated only after the posted write completes */
+    if (ws->rw_flag == NC_REQ_WR) {
+        err = wait_write_done(ncp, NC_REQ_COLL, ws->newnumrecs);
+        if (status == NC_NOERR) status = err;
+    }
+
+    err = req_finish(ncp, ws->num_w_reqs, ws->put_list, ws->num_r_reqs,
+                     ws->get_list);
+    if (status == NC_NOERR) status = err;
+
+    NCI_Free(ws);
+
+    return status;
+}
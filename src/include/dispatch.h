@@ -105,6 +105,26 @@ struct PNC_driver {
     int (*buffer_detach)(void*);
     int (*wait)(void*,int,int*,int*,int);
     int (*cancel)(void*,int,int*,int*);
+
+    /* APIs of persistent requests */
+    int (*getput_init)(void*,int,const MPI_Offset*,const MPI_Offset*,const void*,MPI_Offset,MPI_Datatype,int*,int);
+    int (*start)(void*,int,MPI_Offset,int);
+    int (*request_free)(void*,int);
+
+    /* APIs of I/O statistics */
+    int (*inq_stats)(void*,MPI_Offset*,MPI_Offset*,MPI_Offset*,MPI_Offset*,double*);
+    int (*inq_var_stats)(void*,int,MPI_Offset*,MPI_Offset*);
+    int (*inq_buf_pool_stats)(void*,MPI_Offset*,MPI_Offset*,MPI_Offset*);
+
+    /* APIs of split-phase wait */
+    int (*wait_start)(void*,int,int*,int*);
+    int (*wait_test)(void*,int*);
+    int (*wait_end)(void*);
+
+    /* APIs of nonblocking vard */
+    int (*iget_vard)(void*,int,MPI_Datatype,void*,MPI_Offset,MPI_Datatype,int*,int);
+    int (*iput_vard)(void*,int,MPI_Datatype,const void*,MPI_Offset,MPI_Datatype,int*,int);
+    int (*bput_vard)(void*,int,MPI_Datatype,const void*,MPI_Offset,MPI_Datatype,int*,int);
 };
 
 typedef struct PNC_driver PNC_driver;
@@ -0,0 +1,189 @@
+/*********************************************************************
+ *
+ *  Copyright (C) 2018, Northwestern University and Argonne National Laboratory
+ *  See COPYRIGHT notice in top-level directory.
+ *
+ *********************************************************************/
+/* $Id$ */
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * This program tests draining the log when the size of pending data exceeds
+ * the high watermark set by hint nc_dw_flush_high_watermark.
+ * Each process writes NY rows of NX integers, one row per request, the first
+ * row with a nonblocking put and the rest with blocking puts in collective and
+ * independent data mode. The watermarks are set to a few rows, so the log is
+ * partially replayed while the program writes. A drained nonblocking request
+ * can no longer be canceled. The file is read back with the driver disabled.
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pnetcdf.h>
+#include <limits.h>
+#include <testutils.h>
+#include <libgen.h>
+
+#define NY 8
+#define NX 16
+
+int main(int argc, char *argv[]) {
+    int i, j, err, nerrs = 0, flag;
+    int rank, np;
+    int ncid, varid, req, stat;
+    int dimid[2];
+    int buffer[NY * NX];
+    char filename[PATH_MAX], hint[MPI_MAX_INFO_VAL];
+    MPI_Offset start[2], count[2], put_size, put_size_old;
+    MPI_Info info, infoused;
+
+    /* Initialize MPI */
+    MPI_Init(&argc, &argv);
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &np);
+
+    if (argc > 2) {
+        if (!rank) printf("Usage: %s [filename]\n", argv[0]);
+        MPI_Finalize();
+        return 1;
+    }
+
+    /* Determine test file name */
+    if (argc > 1) {
+        snprintf(filename, PATH_MAX, "%s", argv[1]);
+    }
+    else{
+        snprintf(filename, PATH_MAX, "testfile.nc");
+    }
+
+    if (rank == 0) {
+        char *cmd_str = (char*)malloc(strlen(argv[0]) + 256);
+        sprintf(cmd_str, "*** TESTING C   %s for draining log at watermark", basename(argv[0]));
+        printf("%-66s ------ ", cmd_str); fflush(stdout);
+        free(cmd_str);
+    }
+
+    /* Drain when more than 3 rows are pending, down to 1 row */
+    MPI_Info_create(&info);
+    MPI_Info_set(info, "nc_dw", "enable");
+    MPI_Info_set(info, "nc_dw_overwrite", "enable");
+    sprintf(hint, "%d", (int)(3 * NX * sizeof(int)));
+    MPI_Info_set(info, "nc_dw_flush_high_watermark", hint);
+    sprintf(hint, "%d", (int)(NX * sizeof(int)));
+    MPI_Info_set(info, "nc_dw_flush_low_watermark", hint);
+
+    /* Create new netcdf file */
+    err = ncmpi_create(MPI_COMM_WORLD, filename, NC_CLOBBER, info, &ncid); CHECK_ERR
+
+    /* Check if the hint is used, when the driver is enabled */
+    err = ncmpi_inq_file_info(ncid, &infoused); CHECK_ERR
+    MPI_Info_get(infoused, "nc_dw", MPI_MAX_INFO_VAL - 1, hint, &flag);
+    if (flag && strcasecmp(hint, "enable") == 0) {
+        MPI_Info_get(infoused, "nc_dw_flush_high_watermark",
+                     MPI_MAX_INFO_VAL - 1, hint, &flag);
+        if (!flag || atoi(hint) != (int)(3 * NX * sizeof(int))) {
+            printf("Error at line %d: nc_dw_flush_high_watermark is not set\n", __LINE__);
+            nerrs++;
+        }
+    }
+    MPI_Info_free(&infoused);
+
+    /* Define dimensions and variable */
+    err = ncmpi_def_dim(ncid, "Y", NY * np, dimid); CHECK_ERR
+    err = ncmpi_def_dim(ncid, "X", NX, dimid + 1); CHECK_ERR
+    err = ncmpi_def_var(ncid, "M", NC_INT, 2, dimid, &varid); CHECK_ERR
+
+    /* Switch to data mode */
+    err = ncmpi_enddef(ncid); CHECK_ERR
+
+    err = ncmpi_inq_put_size(ncid, &put_size_old); CHECK_ERR
+
+    for (i = 0; i < NY * NX; i++) {
+        buffer[i] = rank * 1000 + i;
+    }
+
+    /* First row with a nonblocking put */
+    start[0] = rank * NY;
+    start[1] = 0;
+    count[0] = 1;
+    count[1] = NX;
+    err = ncmpi_iput_vara_int(ncid, varid, start, count, buffer, &req); CHECK_ERR
+
+    /* Half of the rows with blocking collective puts */
+    for (j = 1; j < NY / 2; j++) {
+        start[0] = rank * NY + j;
+        err = ncmpi_put_vara_int_all(ncid, varid, start, count, buffer + j * NX);
+        CHECK_ERR
+    }
+
+    /* The rest with blocking independent puts */
+    err = ncmpi_begin_indep_data(ncid); CHECK_ERR
+    for (; j < NY; j++) {
+        start[0] = rank * NY + j;
+        err = ncmpi_put_vara_int(ncid, varid, start, count, buffer + j * NX);
+        CHECK_ERR
+    }
+    err = ncmpi_end_indep_data(ncid); CHECK_ERR
+
+    /* Data replayed and data pending in the log are counted only once */
+    err = ncmpi_inq_put_size(ncid, &put_size); CHECK_ERR
+    if (put_size - put_size_old != NY * NX * sizeof(int)) {
+        printf("Error at line %d: expecting put size %d but got %lld\n",
+               __LINE__, (int)(NY * NX * sizeof(int)), put_size - put_size_old);
+        nerrs++;
+    }
+
+    /* The nonblocking request must have been replayed by now */
+    err = ncmpi_inq_file_info(ncid, &infoused); CHECK_ERR
+    MPI_Info_get(infoused, "nc_dw", MPI_MAX_INFO_VAL - 1, hint, &flag);
+    MPI_Info_free(&infoused);
+    if (flag && strcasecmp(hint, "enable") == 0) {
+        err = ncmpi_cancel(ncid, 1, &req, &stat); CHECK_ERR
+        if (stat != NC_EFLUSHED) {
+            printf("Error at line %d: expecting NC_EFLUSHED but got %d\n", __LINE__, stat);
+            nerrs++;
+        }
+    }
+    else {
+        err = ncmpi_wait_all(ncid, 1, &req, &stat); CHECK_ERR
+    }
+
+    /* Close the file */
+    err = ncmpi_close(ncid); CHECK_ERR
+    MPI_Info_free(&info);
+
+    /* Read it back */
+    memset(buffer, 0, sizeof(buffer));
+    err = ncmpi_open(MPI_COMM_WORLD, filename, NC_NOWRITE, MPI_INFO_NULL, &ncid); CHECK_ERR
+    err = ncmpi_inq_varid(ncid, "M", &varid); CHECK_ERR
+    start[0] = rank * NY;
+    count[0] = NY;
+    err = ncmpi_get_vara_int_all(ncid, varid, start, count, buffer); CHECK_ERR
+    for (i = 0; i < NY * NX; i++) {
+        if (buffer[i] != rank * 1000 + i) {
+            printf("Error at line %d in %s: expecting buffer[%d] = %d but got %d\n", __LINE__, __FILE__, i, rank * 1000 + i, buffer[i]);
+            nerrs++;
+            break;
+        }
+    }
+    err = ncmpi_close(ncid); CHECK_ERR
+
+    /* check if PnetCDF freed all internal malloc */
+    MPI_Offset malloc_size, sum_size;
+    err = ncmpi_inq_malloc_size(&malloc_size);
+    if (err == NC_NOERR) {
+        MPI_Reduce(&malloc_size, &sum_size, 1, MPI_OFFSET, MPI_SUM, 0, MPI_COMM_WORLD);
+        if (rank == 0 && sum_size > 0)
+            printf("heap memory allocated by PnetCDF internally has %lld bytes yet to be freed\n", sum_size);
+    }
+
+    MPI_Allreduce(MPI_IN_PLACE, &nerrs, 1, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
+    if (rank == 0) {
+        if (nerrs) printf(FAIL_STR, nerrs);
+        else       printf(PASS_STR);
+    }
+
+    MPI_Finalize();
+
+    return nerrs > 0;
+}
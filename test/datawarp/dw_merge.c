@@ -0,0 +1,199 @@
+/*********************************************************************
+ *
+ *  Copyright (C) 2018, Northwestern University and Argonne National Laboratory
+ *  See COPYRIGHT notice in top-level directory.
+ *
+ *********************************************************************/
+/* $Id$ */
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * This program tests merging consecutive puts into one log entry.
+ * Each process writes its own NY rows of NX integers: rows one by one, a
+ * nonblocking put between two blocking puts, a varn put of two rows, a row in
+ * two halves, and a row in two strided parts. The nonblocking put is then
+ * canceled, which must not cancel the puts before and after it. The file is
+ * read back with the driver disabled.
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pnetcdf.h>
+#include <limits.h>
+#include <testutils.h>
+#include <libgen.h>
+
+#define NY 9
+#define NX 8
+
+/* Row 3 is written by the canceled nonblocking put */
+#define CANCELED_ROW 3
+
+int main(int argc, char *argv[]) {
+    int i, j, err, nerrs = 0, flag;
+    int rank, np;
+    int ncid, varid, req, stat;
+    int dimid[2];
+    int buffer[NY * NX], row[NX];
+    char filename[PATH_MAX], hint[MPI_MAX_INFO_VAL];
+    MPI_Offset start[2], count[2], stride[2];
+    MPI_Offset *starts[2], *counts[2], sc[8];
+    MPI_Info info, infoused;
+
+    /* Initialize MPI */
+    MPI_Init(&argc, &argv);
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &np);
+
+    if (argc > 2) {
+        if (!rank) printf("Usage: %s [filename]\n", argv[0]);
+        MPI_Finalize();
+        return 1;
+    }
+
+    /* Determine test file name */
+    if (argc > 1) {
+        snprintf(filename, PATH_MAX, "%s", argv[1]);
+    }
+    else{
+        snprintf(filename, PATH_MAX, "testfile.nc");
+    }
+
+    if (rank == 0) {
+        char *cmd_str = (char*)malloc(strlen(argv[0]) + 256);
+        sprintf(cmd_str, "*** TESTING C   %s for merging log entries", basename(argv[0]));
+        printf("%-66s ------ ", cmd_str); fflush(stdout);
+        free(cmd_str);
+    }
+
+    MPI_Info_create(&info);
+    MPI_Info_set(info, "nc_dw", "enable");
+    MPI_Info_set(info, "nc_dw_overwrite", "enable");
+
+    /* Create new netcdf file */
+    err = ncmpi_create(MPI_COMM_WORLD, filename, NC_CLOBBER, info, &ncid); CHECK_ERR
+
+    /* Define dimensions and variable */
+    err = ncmpi_def_dim(ncid, "Y", NY * np, dimid); CHECK_ERR
+    err = ncmpi_def_dim(ncid, "X", NX, dimid + 1); CHECK_ERR
+    err = ncmpi_def_var(ncid, "M", NC_INT, 2, dimid, &varid); CHECK_ERR
+    err = ncmpi_set_fill(ncid, NC_FILL, NULL); CHECK_ERR
+    err = ncmpi_enddef(ncid); CHECK_ERR
+
+    for (i = 0; i < NY * NX; i++) {
+        buffer[i] = rank * 1000 + i;
+    }
+
+    /* Rows 0 to 2 one by one */
+    count[0] = 1; count[1] = NX;
+    start[1] = 0;
+    for (j = 0; j < CANCELED_ROW; j++) {
+        start[0] = rank * NY + j;
+        err = ncmpi_put_vara_int_all(ncid, varid, start, count, buffer + j * NX);
+        CHECK_ERR
+    }
+
+    /* Row 3 with a nonblocking put, row 4 with a blocking put */
+    start[0] = rank * NY + CANCELED_ROW;
+    err = ncmpi_iput_vara_int(ncid, varid, start, count, buffer + CANCELED_ROW * NX,
+                              &req); CHECK_ERR
+    start[0] = rank * NY + CANCELED_ROW + 1;
+    err = ncmpi_put_vara_int_all(ncid, varid, start, count,
+                                 buffer + (CANCELED_ROW + 1) * NX); CHECK_ERR
+
+    /* Rows 5 and 6 with a varn put */
+    starts[0] = sc;     counts[0] = sc + 2;
+    starts[1] = sc + 4; counts[1] = sc + 6;
+    starts[0][0] = rank * NY + 5; starts[0][1] = 0;
+    counts[0][0] = 1;             counts[0][1] = NX;
+    starts[1][0] = rank * NY + 6; starts[1][1] = 0;
+    counts[1][0] = 1;             counts[1][1] = NX;
+    err = ncmpi_put_varn_int_all(ncid, varid, 2, starts, counts, buffer + 5 * NX);
+    CHECK_ERR
+
+    /* Row 7 in two halves */
+    start[0] = rank * NY + 7;
+    count[1] = NX / 2;
+    for (i = 0; i < 2; i++) {
+        start[1] = i * NX / 2;
+        err = ncmpi_put_vara_int_all(ncid, varid, start, count,
+                                     buffer + 7 * NX + i * NX / 2); CHECK_ERR
+    }
+
+    /* Row 8 in two strided parts, each of even columns of one half */
+    start[0] = rank * NY + 8;
+    count[1] = NX / 4;
+    stride[0] = 1; stride[1] = 2;
+    for (i = 0; i < 2; i++) {
+        for (j = 0; j < NX / 4; j++) {
+            row[j] = buffer[8 * NX + i * NX / 2 + j * 2];
+        }
+        start[1] = i * NX / 2;
+        err = ncmpi_put_vars_int_all(ncid, varid, start, count, stride, row);
+        CHECK_ERR
+    }
+
+    /* Canceling the nonblocking put keeps row 4 */
+    err = ncmpi_inq_file_info(ncid, &infoused); CHECK_ERR
+    MPI_Info_get(infoused, "nc_dw", MPI_MAX_INFO_VAL - 1, hint, &flag);
+    MPI_Info_free(&infoused);
+    if (flag && strcasecmp(hint, "enable") == 0) {
+        err = ncmpi_cancel(ncid, 1, &req, &stat); CHECK_ERR
+        if (stat != NC_NOERR) {
+            printf("Error at line %d: expecting NC_NOERR but got %d\n", __LINE__, stat);
+            nerrs++;
+        }
+        for (i = 0; i < NX; i++) {
+            buffer[CANCELED_ROW * NX + i] = NC_FILL_INT;
+        }
+    }
+    else {
+        err = ncmpi_wait_all(ncid, 1, &req, &stat); CHECK_ERR
+    }
+    for (i = 1; i < NX; i += 2) {
+        buffer[8 * NX + i] = NC_FILL_INT;
+    }
+
+    /* Close the file */
+    err = ncmpi_close(ncid); CHECK_ERR
+    MPI_Info_free(&info);
+
+    /* Read it back */
+    memset(row, 0, sizeof(row));
+    err = ncmpi_open(MPI_COMM_WORLD, filename, NC_NOWRITE, MPI_INFO_NULL, &ncid); CHECK_ERR
+    err = ncmpi_inq_varid(ncid, "M", &varid); CHECK_ERR
+    count[1] = NX;
+    start[1] = 0;
+    for (j = 0; j < NY; j++) {
+        start[0] = rank * NY + j;
+        err = ncmpi_get_vara_int_all(ncid, varid, start, count, row); CHECK_ERR
+        for (i = 0; i < NX; i++) {
+            if (row[i] != buffer[j * NX + i]) {
+                printf("Error at line %d in %s: expecting row %d column %d = %d but got %d\n",
+                       __LINE__, __FILE__, j, i, buffer[j * NX + i], row[i]);
+                nerrs++;
+                break;
+            }
+        }
+    }
+    err = ncmpi_close(ncid); CHECK_ERR
+
+    /* check if PnetCDF freed all internal malloc */
+    MPI_Offset malloc_size, sum_size;
+    err = ncmpi_inq_malloc_size(&malloc_size);
+    if (err == NC_NOERR) {
+        MPI_Reduce(&malloc_size, &sum_size, 1, MPI_OFFSET, MPI_SUM, 0, MPI_COMM_WORLD);
+        if (rank == 0 && sum_size > 0)
+            printf("heap memory allocated by PnetCDF internally has %lld bytes yet to be freed\n", sum_size);
+    }
+
+    MPI_Allreduce(MPI_IN_PLACE, &nerrs, 1, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
+    if (rank == 0) {
+        if (nerrs) printf(FAIL_STR, nerrs);
+        else       printf(PASS_STR);
+    }
+
+    MPI_Finalize();
+
+    return nerrs > 0;
+}
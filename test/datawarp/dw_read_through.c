@@ -0,0 +1,246 @@
+/*********************************************************************
+ *
+ *  Copyright (C) 2018, Northwestern University and Argonne National Laboratory
+ *  See COPYRIGHT notice in top-level directory.
+ *
+ *********************************************************************/
+/* $Id$ */
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * This program tests reading variables with pending writes in the log when
+ * hint nc_dw_flush_on_read is disabled. Reads are served by merging the data
+ * in the file with the pending log entries, without flushing the log.
+ * Each process writes its own NY rows of NX integers, syncs, overwrites part
+ * of them, and reads them back using vara, vars, and varn APIs. A nonblocking
+ * put is read back and then canceled, which succeeds only if the log was not
+ * flushed by the reads. A read of a different type flushes the log.
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pnetcdf.h>
+#include <limits.h>
+#include <testutils.h>
+#include <libgen.h>
+
+#define NY 6
+#define NX 8
+
+/* expected value of row y, column x of a process */
+static int
+expect(int rank, int y, int x)
+{
+    if (y == 1 && x % 2 == 0) return -(rank * 1000 + y * NX + x);
+    return rank * 1000 + y * NX + x;
+}
+
+static int
+check_rows(int rank, int *buffer, int y0, int ny, int line)
+{
+    int i, j;
+
+    for (j = 0; j < ny; j++) {
+        for (i = 0; i < NX; i++) {
+            if (buffer[j * NX + i] != expect(rank, y0 + j, i)) {
+                printf("Error at line %d: expecting row %d column %d = %d but got %d\n",
+                       line, y0 + j, i, expect(rank, y0 + j, i), buffer[j * NX + i]);
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    int i, j, err, nerrs = 0, flag, dw_enabled;
+    int rank, np;
+    int ncid, varid, req, stat;
+    int dimid[2];
+    int buffer[NY * NX], row[NX];
+    double dbuffer[NY * NX];
+    char filename[PATH_MAX], hint[MPI_MAX_INFO_VAL];
+    MPI_Offset start[2], count[2], stride[2];
+    MPI_Offset *starts[2], *counts[2], sc[8];
+    MPI_Info info, infoused;
+
+    /* Initialize MPI */
+    MPI_Init(&argc, &argv);
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &np);
+
+    if (argc > 2) {
+        if (!rank) printf("Usage: %s [filename]\n", argv[0]);
+        MPI_Finalize();
+        return 1;
+    }
+
+    /* Determine test file name */
+    if (argc > 1) {
+        snprintf(filename, PATH_MAX, "%s", argv[1]);
+    }
+    else{
+        snprintf(filename, PATH_MAX, "testfile.nc");
+    }
+
+    if (rank == 0) {
+        char *cmd_str = (char*)malloc(strlen(argv[0]) + 256);
+        sprintf(cmd_str, "*** TESTING C   %s for reading through the log", basename(argv[0]));
+        printf("%-66s ------ ", cmd_str); fflush(stdout);
+        free(cmd_str);
+    }
+
+    MPI_Info_create(&info);
+    MPI_Info_set(info, "nc_dw", "enable");
+    MPI_Info_set(info, "nc_dw_overwrite", "enable");
+    MPI_Info_set(info, "nc_dw_flush_on_read", "disable");
+
+    /* Create new netcdf file */
+    err = ncmpi_create(MPI_COMM_WORLD, filename, NC_CLOBBER, info, &ncid); CHECK_ERR
+
+    /* Check if the hint is used, when the driver is enabled */
+    err = ncmpi_inq_file_info(ncid, &infoused); CHECK_ERR
+    MPI_Info_get(infoused, "nc_dw", MPI_MAX_INFO_VAL - 1, hint, &flag);
+    dw_enabled = (flag && strcasecmp(hint, "enable") == 0);
+    if (dw_enabled) {
+        MPI_Info_get(infoused, "nc_dw_flush_on_read", MPI_MAX_INFO_VAL - 1,
+                     hint, &flag);
+        if (!flag || strcasecmp(hint, "disable")) {
+            printf("Error at line %d: nc_dw_flush_on_read is not disabled\n", __LINE__);
+            nerrs++;
+        }
+    }
+    MPI_Info_free(&infoused);
+
+    /* Define dimensions and variable */
+    err = ncmpi_def_dim(ncid, "Y", NY * np, dimid); CHECK_ERR
+    err = ncmpi_def_dim(ncid, "X", NX, dimid + 1); CHECK_ERR
+    err = ncmpi_def_var(ncid, "M", NC_INT, 2, dimid, &varid); CHECK_ERR
+    err = ncmpi_enddef(ncid); CHECK_ERR
+
+    /* Write all rows but the last one and flush them to the file, then
+     * overwrite even columns of row 1 with a strided put
+     */
+    for (j = 0; j < NY; j++) {
+        for (i = 0; i < NX; i++) {
+            buffer[j * NX + i] = rank * 1000 + j * NX + i;
+        }
+    }
+    start[0] = rank * NY; start[1] = 0;
+    count[0] = NY - 1;    count[1] = NX;
+    err = ncmpi_put_vara_int_all(ncid, varid, start, count, buffer); CHECK_ERR
+
+    /* Flush them to the file */
+    err = ncmpi_sync(ncid); CHECK_ERR
+
+    for (i = 0; i < NX / 2; i++) {
+        row[i] = expect(rank, 1, i * 2);
+    }
+    start[0] = rank * NY + 1; start[1] = 0;
+    count[0] = 1;             count[1] = NX / 2;
+    stride[0] = 1;            stride[1] = 2;
+    err = ncmpi_put_vars_int_all(ncid, varid, start, count, stride, row); CHECK_ERR
+
+    /* Last row with a nonblocking put */
+    start[0] = rank * NY + NY - 1; start[1] = 0;
+    count[0] = 1;                  count[1] = NX;
+    err = ncmpi_iput_vara_int(ncid, varid, start, count, buffer + (NY - 1) * NX, &req);
+    CHECK_ERR
+
+    /* Read all rows of this process */
+    memset(buffer, 0, sizeof(buffer));
+    start[0] = rank * NY; start[1] = 0;
+    count[0] = NY;        count[1] = NX;
+    err = ncmpi_get_vara_int_all(ncid, varid, start, count, buffer); CHECK_ERR
+    nerrs += check_rows(rank, buffer, 0, NY, __LINE__);
+
+    /* Strided read of rows 1 and 3, columns 1, 4, 7 */
+    memset(buffer, 0, sizeof(buffer));
+    start[0] = rank * NY + 1; start[1] = 1;
+    count[0] = 2;             count[1] = 3;
+    stride[0] = 2;            stride[1] = 3;
+    err = ncmpi_get_vars_int_all(ncid, varid, start, count, stride, buffer); CHECK_ERR
+    for (j = 0; j < 2; j++) {
+        for (i = 0; i < 3; i++) {
+            if (buffer[j * 3 + i] != expect(rank, 1 + j * 2, 1 + i * 3)) {
+                printf("Error at line %d: expecting %d but got %d\n", __LINE__,
+                       expect(rank, 1 + j * 2, 1 + i * 3), buffer[j * 3 + i]);
+                nerrs++;
+                j = 2;
+                break;
+            }
+        }
+    }
+
+    /* Independent varn read of rows 1 and 4 */
+    err = ncmpi_begin_indep_data(ncid); CHECK_ERR
+    memset(buffer, 0, sizeof(buffer));
+    starts[0] = sc;     counts[0] = sc + 2;
+    starts[1] = sc + 4; counts[1] = sc + 6;
+    starts[0][0] = rank * NY + 1; starts[0][1] = 0;
+    counts[0][0] = 1;             counts[0][1] = NX;
+    starts[1][0] = rank * NY + 4; starts[1][1] = 0;
+    counts[1][0] = 1;             counts[1][1] = NX;
+    err = ncmpi_get_varn_int(ncid, varid, 2, starts, counts, buffer); CHECK_ERR
+    nerrs += check_rows(rank, buffer, 1, 1, __LINE__);
+    nerrs += check_rows(rank, buffer + NX, 4, 1, __LINE__);
+    err = ncmpi_end_indep_data(ncid); CHECK_ERR
+
+    /* The reads did not flush the log, the nonblocking put can be canceled */
+    err = ncmpi_cancel(ncid, 1, &req, &stat); CHECK_ERR
+    if (dw_enabled && stat != NC_NOERR) {
+        printf("Error at line %d: expecting NC_NOERR but got %d\n", __LINE__, stat);
+        nerrs++;
+    }
+
+    /* Write the last row again */
+    for (i = 0; i < NX; i++) {
+        row[i] = expect(rank, NY - 1, i);
+    }
+    start[0] = rank * NY + NY - 1; start[1] = 0;
+    count[0] = 1;                  count[1] = NX;
+    err = ncmpi_put_vara_int_all(ncid, varid, start, count, row); CHECK_ERR
+
+    /* Reading in a different type flushes the log */
+    start[0] = rank * NY; start[1] = 0;
+    count[0] = NY;        count[1] = NX;
+    err = ncmpi_get_vara_double_all(ncid, varid, start, count, dbuffer); CHECK_ERR
+    for (i = 0; i < NY * NX; i++) {
+        if (dbuffer[i] != expect(rank, i / NX, i % NX)) {
+            printf("Error at line %d: expecting %d but got %f\n", __LINE__,
+                   expect(rank, i / NX, i % NX), dbuffer[i]);
+            nerrs++;
+            break;
+        }
+    }
+
+    err = ncmpi_close(ncid); CHECK_ERR
+    MPI_Info_free(&info);
+
+    /* Read it back */
+    memset(buffer, 0, sizeof(buffer));
+    err = ncmpi_open(MPI_COMM_WORLD, filename, NC_NOWRITE, MPI_INFO_NULL, &ncid); CHECK_ERR
+    err = ncmpi_inq_varid(ncid, "M", &varid); CHECK_ERR
+    err = ncmpi_get_vara_int_all(ncid, varid, start, count, buffer); CHECK_ERR
+    nerrs += check_rows(rank, buffer, 0, NY, __LINE__);
+    err = ncmpi_close(ncid); CHECK_ERR
+
+    /* check if PnetCDF freed all internal malloc */
+    MPI_Offset malloc_size, sum_size;
+    err = ncmpi_inq_malloc_size(&malloc_size);
+    if (err == NC_NOERR) {
+        MPI_Reduce(&malloc_size, &sum_size, 1, MPI_OFFSET, MPI_SUM, 0, MPI_COMM_WORLD);
+        if (rank == 0 && sum_size > 0)
+            printf("heap memory allocated by PnetCDF internally has %lld bytes yet to be freed\n", sum_size);
+    }
+
+    MPI_Allreduce(MPI_IN_PLACE, &nerrs, 1, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
+    if (rank == 0) {
+        if (nerrs) printf(FAIL_STR, nerrs);
+        else       printf(PASS_STR);
+    }
+
+    MPI_Finalize();
+
+    return nerrs > 0;
+}
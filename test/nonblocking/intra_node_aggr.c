@@ -0,0 +1,201 @@
+/*********************************************************************
+ *
+ *  Copyright (C) 2018, Northwestern University and Argonne National Laboratory
+ *  See COPYRIGHT notice in top-level directory.
+ *
+ *********************************************************************/
+/* $Id$ */
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *
+ * This program tests the intra-node aggregation of nonblocking requests,
+ * enabled by setting hint nc_intra_node_aggr to "enable". Each process writes
+ * interleaved columns of a fixed-size variable and a record of a record
+ * variable, with the last process making no request, reads them back using
+ * nonblocking APIs with the hint enabled, and then again with the hint
+ * disabled.
+ *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <libgen.h> /* basename() */
+#include <mpi.h>
+#include <pnetcdf.h>
+
+#include <testutils.h>
+
+#define NY 4
+#define NX 3
+
+static int
+check_vars(int ncid, int rank, int nprocs, int fix_id, int rec_id)
+{
+    int i, j, err, nerrs=0, *buf, reqs[2], sts[2];
+    MPI_Offset start[2], count[2];
+
+    buf = (int*) malloc((NY + 1) * NX * nprocs * sizeof(int));
+
+    /* all processes read the whole fixed-size variable and record 1 */
+    start[0] = 0; start[1] = 0;
+    count[0] = NY; count[1] = NX * nprocs;
+    err = ncmpi_iget_vara_int(ncid, fix_id, start, count, buf, &reqs[0]);
+    CHECK_ERR
+    start[0] = 1; count[0] = 1;
+    err = ncmpi_iget_vara_int(ncid, rec_id, start, count, buf+NY*NX*nprocs,
+                              &reqs[1]);
+    CHECK_ERR
+    err = ncmpi_wait_all(ncid, 2, reqs, sts); CHECK_ERR
+
+    for (j=0; j<NY; j++) {
+        for (i=0; i<NX*nprocs; i++) {
+            /* column i was written by process i % nprocs, except the last
+             * process which writes nothing */
+            int p = i % nprocs;
+            int expect = (p == nprocs - 1 && nprocs > 1) ? NC_FILL_INT
+                                                         : p * 100 + j;
+            if (buf[j*NX*nprocs+i] != expect) {
+                printf("Error at line %d in %s: fix[%d][%d] expect %d but got %d\n",
+                       __LINE__,__FILE__,j,i,expect,buf[j*NX*nprocs+i]);
+                nerrs++;
+                j = NY;
+                break;
+            }
+        }
+    }
+    for (i=0; i<NX*nprocs; i++) {
+        int p = i / NX;
+        int expect = (p == nprocs - 1 && nprocs > 1) ? NC_FILL_INT : 1000 + p;
+        if (buf[NY*NX*nprocs+i] != expect) {
+            printf("Error at line %d in %s: rec[1][%d] expect %d but got %d\n",
+                   __LINE__,__FILE__,i,expect,buf[NY*NX*nprocs+i]);
+            nerrs++;
+            break;
+        }
+    }
+    free(buf);
+    return nerrs;
+}
+
+int main(int argc, char** argv)
+{
+    char filename[256], value[MPI_MAX_INFO_VAL];
+    int i, j, rank, nprocs, err, nerrs=0, flag, nreqs;
+    int ncid, fix_id, rec_id, dimid[3], reqs[NX+1], sts[NX+1], *buf;
+    MPI_Offset start[2], count[2];
+    MPI_Info info, info_used;
+
+    MPI_Init(&argc, &argv);
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &nprocs);
+
+    if (argc > 2) {
+        if (!rank) printf("Usage: %s [filename]\n",argv[0]);
+        MPI_Finalize();
+        return 1;
+    }
+    if (argc == 2) snprintf(filename, 256, "%s", argv[1]);
+    else           strcpy(filename, "testfile.nc");
+    MPI_Bcast(filename, 256, MPI_CHAR, 0, MPI_COMM_WORLD);
+
+    if (rank == 0) {
+        char *cmd_str = (char*)malloc(strlen(argv[0]) + 256);
+        sprintf(cmd_str, "*** TESTING C   %s for intra-node aggregation ", basename(argv[0]));
+        printf("%-66s ------ ",cmd_str);
+        free(cmd_str);
+    }
+
+    MPI_Info_create(&info);
+    MPI_Info_set(info, "nc_intra_node_aggr", "enable");
+
+    err = ncmpi_create(MPI_COMM_WORLD, filename, NC_CLOBBER, info, &ncid);
+    CHECK_ERR
+
+    /* check if the hint is used */
+    err = ncmpi_inq_file_info(ncid, &info_used); CHECK_ERR
+    MPI_Info_get(info_used, "nc_intra_node_aggr", MPI_MAX_INFO_VAL-1, value,
+                 &flag);
+#if MPI_VERSION >= 3
+    if (!flag || strcmp(value, "enable")) {
+        printf("Error at line %d in %s: hint nc_intra_node_aggr is not enabled\n",
+               __LINE__,__FILE__);
+        nerrs++;
+    }
+#endif
+    MPI_Info_free(&info_used);
+
+    err = ncmpi_def_dim(ncid, "REC", NC_UNLIMITED, &dimid[0]); CHECK_ERR
+    err = ncmpi_def_dim(ncid, "Y",   NY,           &dimid[1]); CHECK_ERR
+    err = ncmpi_def_dim(ncid, "X",   NX*nprocs,    &dimid[2]); CHECK_ERR
+    err = ncmpi_def_var(ncid, "fix", NC_INT, 2, dimid+1, &fix_id); CHECK_ERR
+    dimid[1] = dimid[2];
+    err = ncmpi_def_var(ncid, "rec", NC_INT, 2, dimid, &rec_id); CHECK_ERR
+
+    /* fill the variables, so the data not written can be checked */
+    err = ncmpi_set_fill(ncid, NC_FILL, NULL); CHECK_ERR
+    err = ncmpi_enddef(ncid); CHECK_ERR
+    err = ncmpi_fill_var_rec(ncid, rec_id, 1); CHECK_ERR
+
+    buf = (int*) malloc((NY + 1) * NX * sizeof(int));
+
+    /* nonblocking column-wise writes: columns of all processes interleave.
+     * The last process makes no request. */
+    nreqs = 0;
+    if (rank < nprocs - 1 || nprocs == 1) {
+        for (i=0; i<NX; i++) {
+            for (j=0; j<NY; j++) buf[i*NY+j] = rank * 100 + j;
+            start[0] = 0;  start[1] = rank + i * nprocs;
+            count[0] = NY; count[1] = 1;
+            err = ncmpi_iput_vara_int(ncid, fix_id, start, count, buf+i*NY,
+                                      &reqs[nreqs++]);
+            CHECK_ERR
+        }
+        for (i=0; i<NX; i++) buf[NY*NX+i] = 1000 + rank;
+        start[0] = 1; start[1] = rank * NX;
+        count[0] = 1; count[1] = NX;
+        err = ncmpi_iput_vara_int(ncid, rec_id, start, count, buf+NY*NX,
+                                  &reqs[nreqs++]);
+        CHECK_ERR
+    }
+    err = ncmpi_wait_all(ncid, nreqs, reqs, sts); CHECK_ERR
+    for (i=0; i<nreqs; i++) {
+        err = sts[i];
+        CHECK_ERR
+    }
+
+    /* read back with intra-node aggregation */
+    nerrs += check_vars(ncid, rank, nprocs, fix_id, rec_id);
+    err = ncmpi_close(ncid); CHECK_ERR
+
+    /* read back with intra-node aggregation disabled */
+    err = ncmpi_open(MPI_COMM_WORLD, filename, NC_NOWRITE, MPI_INFO_NULL,
+                     &ncid);
+    CHECK_ERR
+    nerrs += check_vars(ncid, rank, nprocs, fix_id, rec_id);
+    err = ncmpi_close(ncid); CHECK_ERR
+
+    free(buf);
+    MPI_Info_free(&info);
+
+    /* check if PnetCDF freed all internal malloc */
+    MPI_Offset malloc_size, sum_size;
+    err = ncmpi_inq_malloc_size(&malloc_size);
+    if (err == NC_NOERR) {
+        MPI_Reduce(&malloc_size, &sum_size, 1, MPI_OFFSET, MPI_SUM, 0, MPI_COMM_WORLD);
+        if (rank == 0 && sum_size > 0) {
+            printf("heap memory allocated by PnetCDF internally has %lld bytes yet to be freed\n",
+                   sum_size);
+            ncmpi_inq_malloc_list();
+        }
+    }
+
+    MPI_Allreduce(MPI_IN_PLACE, &nerrs, 1, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
+    if (rank == 0) {
+        if (nerrs) printf(FAIL_STR,nerrs);
+        else       printf(PASS_STR);
+    }
+
+    MPI_Finalize();
+    return (nerrs > 0);
+}
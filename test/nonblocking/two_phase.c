@@ -0,0 +1,232 @@
+/*********************************************************************
+ *
+ *  Copyright (C) 2018, Northwestern University and Argonne National Laboratory
+ *  See COPYRIGHT notice in top-level directory.
+ *
+ *********************************************************************/
+/* $Id$ */
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *
+ * This program tests PnetCDF's own two-phase I/O, enabled by setting hint
+ * nc_pnetcdf_two_phase to "enable". A small staging buffer size is used, so
+ * each aggregator's file domain is processed in multiple rounds. It writes
+ * a fixed-size and a record variable using blocking, nonblocking (interleaved
+ * column-wise accesses), and varn APIs, in which one process makes zero-length
+ * requests, and reads them back with two-phase I/O enabled and disabled.
+ *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <libgen.h> /* basename() */
+#include <mpi.h>
+#include <pnetcdf.h>
+
+#include <testutils.h>
+
+#define NY 6
+#define NX 5
+
+static int
+check_vars(int ncid, int rank, int nprocs, int fix_id, int rec_id)
+{
+    int i, j, err, nerrs=0, *buf;
+    MPI_Offset start[2], count[2];
+
+    buf = (int*) malloc(NY * NX * nprocs * sizeof(int));
+
+    /* each process reads the whole variable */
+    start[0] = 0; start[1] = 0;
+    count[0] = NY; count[1] = NX * nprocs;
+    err = ncmpi_get_vara_int_all(ncid, fix_id, start, count, buf); CHECK_ERR
+    for (j=0; j<NY; j++) {
+        for (i=0; i<NX*nprocs; i++) {
+            /* column i was written by process i % nprocs */
+            int expect = (i % nprocs) * 100 + j;
+            if (buf[j*NX*nprocs+i] != expect) {
+                printf("Error at line %d in %s: fix[%d][%d] expect %d but got %d\n",
+                       __LINE__,__FILE__,j,i,expect,buf[j*NX*nprocs+i]);
+                nerrs++;
+                j = NY;
+                break;
+            }
+        }
+    }
+
+    /* only rank 0 reads the record variable, others make zero-length
+     * requests */
+    count[0] = (rank == 0) ? 2 : 0;
+    err = ncmpi_get_vara_int_all(ncid, rec_id, start, count, buf); CHECK_ERR
+    for (i=0; i<count[0]*count[1]; i++) {
+        int expect = (i % (NX * nprocs)) / NX + 1000 * (i / (NX * nprocs));
+        if (buf[i] != expect) {
+            printf("Error at line %d in %s: rec[%d] expect %d but got %d\n",
+                   __LINE__,__FILE__,i,expect,buf[i]);
+            nerrs++;
+            break;
+        }
+    }
+    free(buf);
+    return nerrs;
+}
+
+int main(int argc, char** argv)
+{
+    char filename[256], value[MPI_MAX_INFO_VAL];
+    int i, j, rank, nprocs, err, nerrs=0, flag;
+    int ncid, fix_id, rec_id, dimid[3], *reqs, *sts, *rbuf;
+    MPI_Offset start[2], count[2], **starts, **counts;
+    MPI_Info info, info_used;
+
+    MPI_Init(&argc, &argv);
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &nprocs);
+
+    if (argc > 2) {
+        if (!rank) printf("Usage: %s [filename]\n",argv[0]);
+        MPI_Finalize();
+        return 1;
+    }
+    if (argc == 2) snprintf(filename, 256, "%s", argv[1]);
+    else           strcpy(filename, "testfile.nc");
+    MPI_Bcast(filename, 256, MPI_CHAR, 0, MPI_COMM_WORLD);
+
+    if (rank == 0) {
+        char *cmd_str = (char*)malloc(strlen(argv[0]) + 256);
+        sprintf(cmd_str, "*** TESTING C   %s for PnetCDF two-phase I/O ", basename(argv[0]));
+        printf("%-66s ------ ",cmd_str);
+        free(cmd_str);
+    }
+
+    MPI_Info_create(&info);
+    MPI_Info_set(info, "nc_pnetcdf_two_phase", "enable");
+    MPI_Info_set(info, "nc_two_phase_buffer_size", "64");
+    MPI_Info_set(info, "nc_two_phase_num_aggrs", "2");
+
+    err = ncmpi_create(MPI_COMM_WORLD, filename, NC_CLOBBER, info, &ncid);
+    CHECK_ERR
+
+    /* check if the hints are used */
+    err = ncmpi_inq_file_info(ncid, &info_used); CHECK_ERR
+    MPI_Info_get(info_used, "nc_pnetcdf_two_phase", MPI_MAX_INFO_VAL-1, value,
+                 &flag);
+    if (!flag || strcmp(value, "enable")) {
+        printf("Error at line %d in %s: hint nc_pnetcdf_two_phase is not enabled\n",
+               __LINE__,__FILE__);
+        nerrs++;
+    }
+    MPI_Info_free(&info_used);
+
+    err = ncmpi_def_dim(ncid, "REC", NC_UNLIMITED, &dimid[0]); CHECK_ERR
+    err = ncmpi_def_dim(ncid, "Y",   NY,           &dimid[1]); CHECK_ERR
+    err = ncmpi_def_dim(ncid, "X",   NX*nprocs,    &dimid[2]); CHECK_ERR
+    err = ncmpi_def_var(ncid, "fix", NC_INT, 2, dimid+1, &fix_id); CHECK_ERR
+    dimid[1] = dimid[2];
+    err = ncmpi_def_var(ncid, "rec", NC_INT, 2, dimid, &rec_id); CHECK_ERR
+    err = ncmpi_enddef(ncid); CHECK_ERR
+
+    /* nonblocking column-wise writes: columns of all processes interleave */
+    reqs = (int*) malloc(NX * 2 * sizeof(int));
+    sts  = reqs + NX;
+    rbuf = (int*) malloc(NY * NX * sizeof(int));
+    for (i=0; i<NX; i++) {
+        for (j=0; j<NY; j++) rbuf[i*NY+j] = rank * 100 + j;
+        start[0] = 0;  start[1] = rank + i * nprocs;
+        count[0] = NY; count[1] = 1;
+        err = ncmpi_iput_vara_int(ncid, fix_id, start, count, rbuf+i*NY,
+                                  &reqs[i]);
+        CHECK_ERR
+    }
+    err = ncmpi_wait_all(ncid, NX, reqs, sts); CHECK_ERR
+    for (i=0; i<NX; i++) {
+        err = sts[i];
+        CHECK_ERR
+    }
+
+    /* blocking writes to record 0, in the first call rank 0 makes a
+     * zero-length request and in the second call only rank 0 writes */
+    for (i=0; i<NX; i++) rbuf[i] = rank;
+    start[0] = 0; start[1] = rank * NX;
+    count[0] = (rank == 0) ? 0 : 1; count[1] = NX;
+    err = ncmpi_put_vara_int_all(ncid, rec_id, start, count, rbuf); CHECK_ERR
+    count[0] = (rank == 0) ? 1 : 0;
+    err = ncmpi_put_vara_int_all(ncid, rec_id, start, count, rbuf); CHECK_ERR
+
+    /* varn write to record 1, two requests per process */
+    starts    = (MPI_Offset**) malloc(2 * sizeof(MPI_Offset*));
+    counts    = (MPI_Offset**) malloc(2 * sizeof(MPI_Offset*));
+    starts[0] = (MPI_Offset*)  calloc(8, sizeof(MPI_Offset));
+    starts[1] = starts[0] + 2;
+    counts[0] = starts[0] + 4;
+    counts[1] = starts[0] + 6;
+    starts[0][0] = 1; starts[0][1] = rank * NX + 2;
+    counts[0][0] = 1; counts[0][1] = NX - 2;
+    starts[1][0] = 1; starts[1][1] = rank * NX;
+    counts[1][0] = 1; counts[1][1] = 2;
+    for (i=0; i<NX; i++) rbuf[i] = 1000 + rank;
+    err = ncmpi_put_varn_int_all(ncid, rec_id, 2, starts, counts, rbuf);
+    CHECK_ERR
+    free(starts[0]);
+    free(starts);
+    free(counts);
+
+    /* read back with two-phase I/O */
+    nerrs += check_vars(ncid, rank, nprocs, fix_id, rec_id);
+
+    /* nonblocking reads of own columns */
+    for (i=0; i<NX*NY; i++) rbuf[i] = -1;
+    for (i=0; i<NX; i++) {
+        start[0] = 0;  start[1] = rank + i * nprocs;
+        count[0] = NY; count[1] = 1;
+        err = ncmpi_iget_vara_int(ncid, fix_id, start, count, rbuf+i*NY,
+                                  &reqs[i]);
+        CHECK_ERR
+    }
+    err = ncmpi_wait_all(ncid, NX, reqs, sts); CHECK_ERR
+    for (i=0; i<NX; i++) {
+        for (j=0; j<NY; j++) {
+            if (rbuf[i*NY+j] != rank * 100 + j) {
+                printf("Error at line %d in %s: column %d row %d expect %d but got %d\n",
+                       __LINE__,__FILE__,i,j,rank*100+j,rbuf[i*NY+j]);
+                nerrs++;
+                j = NY;
+                i = NX;
+            }
+        }
+    }
+    err = ncmpi_close(ncid); CHECK_ERR
+
+    /* read back with two-phase I/O disabled */
+    err = ncmpi_open(MPI_COMM_WORLD, filename, NC_NOWRITE, MPI_INFO_NULL,
+                     &ncid);
+    CHECK_ERR
+    nerrs += check_vars(ncid, rank, nprocs, fix_id, rec_id);
+    err = ncmpi_close(ncid); CHECK_ERR
+
+    free(rbuf);
+    free(reqs);
+    MPI_Info_free(&info);
+
+    /* check if PnetCDF freed all internal malloc */
+    MPI_Offset malloc_size, sum_size;
+    err = ncmpi_inq_malloc_size(&malloc_size);
+    if (err == NC_NOERR) {
+        MPI_Reduce(&malloc_size, &sum_size, 1, MPI_OFFSET, MPI_SUM, 0, MPI_COMM_WORLD);
+        if (rank == 0 && sum_size > 0) {
+            printf("heap memory allocated by PnetCDF internally has %lld bytes yet to be freed\n",
+                   sum_size);
+            ncmpi_inq_malloc_list();
+        }
+    }
+
+    MPI_Allreduce(MPI_IN_PLACE, &nerrs, 1, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
+    if (rank == 0) {
+        if (nerrs) printf(FAIL_STR,nerrs);
+        else       printf(PASS_STR);
+    }
+
+    MPI_Finalize();
+    return (nerrs > 0);
+}
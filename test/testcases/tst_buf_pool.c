@@ -0,0 +1,198 @@
+/*
+ *  Copyright (C) 2018, Northwestern University and Argonne National Laboratory
+ *  See COPYRIGHT notice in top-level directory.
+ *
+ *  $Id$
+ */
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *
+ * This program tests the pool of temporary buffers used by put and get
+ * requests. Many small blocking and nonblocking requests that need type
+ * conversion are made, so their temporary buffers should be reused from the
+ * pool of the file, as reported by ncmpi_inq_buf_pool_stats(). When hint
+ * nc_buf_pool_size is set to 0, buffers must not be reused. The statistics
+ * are kept per file, so they start from 0s for a newly created file. The data
+ * read back is checked in both cases.
+ *
+ * The compile and run commands are given below.
+ *
+ *    % mpicc -g -o tst_buf_pool tst_buf_pool.c -lpnetcdf
+ *
+ *    % mpiexec -l -n 4 ./tst_buf_pool testfile.nc
+ *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h> /* strcasecmp() */
+#include <libgen.h> /* basename() */
+#include <mpi.h>
+#include <pnetcdf.h>
+
+#include <testutils.h>
+
+#define NX 10
+#define NREQS 100
+
+static int
+run_test(const char *filename, const char *pool_size, int expect_hits)
+{
+    char value[MPI_MAX_INFO_VAL];
+    int i, j, err, nerrs=0, rank, nprocs, ncid, dimids[2], varid, flag;
+    int reqs[NREQS], sts[NREQS];
+    double buf[NREQS][NX];
+    float rbuf[NREQS][NX];
+    MPI_Offset start[2], count[2], hits, misses, max_size, hits2;
+    MPI_Info info, info_used;
+
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &nprocs);
+
+    MPI_Info_create(&info);
+    MPI_Info_set(info, "nc_buf_pool_size", (char*)pool_size);
+
+    err = ncmpi_create(MPI_COMM_WORLD, filename, NC_CLOBBER, info, &ncid);
+    CHECK_ERR
+    MPI_Info_free(&info);
+
+    err = ncmpi_inq_file_info(ncid, &info_used); CHECK_ERR
+    MPI_Info_get(info_used, "nc_buf_pool_size", MPI_MAX_INFO_VAL-1, value,
+                 &flag);
+    if (!flag || strcmp(value, pool_size)) {
+        printf("Error at line %d in %s: expect nc_buf_pool_size %s but got %s\n",
+               __LINE__,__FILE__,pool_size,(flag) ? value : "(not set)");
+        nerrs++;
+    }
+#ifdef BUILD_DRIVER_DW
+    /* the DataWarp driver logs puts and flushes them without going through
+     * the temporary buffers of the nonblocking requests */
+    MPI_Info_get(info_used, "nc_dw", MPI_MAX_INFO_VAL-1, value, &flag);
+    if (flag && strcasecmp(value, "enable") == 0)
+        expect_hits = 0;
+#endif
+    MPI_Info_free(&info_used);
+
+    err = ncmpi_def_dim(ncid, "Y", NREQS*nprocs, &dimids[0]); CHECK_ERR
+    err = ncmpi_def_dim(ncid, "X", NX, &dimids[1]); CHECK_ERR
+    err = ncmpi_def_var(ncid, "var", NC_FLOAT, 2, dimids, &varid); CHECK_ERR
+    err = ncmpi_enddef(ncid); CHECK_ERR
+
+    for (i=0; i<NREQS; i++)
+        for (j=0; j<NX; j++)
+            buf[i][j] = rank * 10000 + i * NX + j;
+
+    /* statistics are those of the pool of this file only */
+    err = ncmpi_inq_buf_pool_stats(ncid, &hits, &misses, &max_size); CHECK_ERR
+    if (hits != 0 || misses != 0 || max_size != 0) {
+        printf("Error at line %d in %s: expect no pool activity of a new file but got hits=%lld misses=%lld max_size=%lld\n",
+               __LINE__,__FILE__,hits,misses,max_size);
+        nerrs++;
+    }
+
+    /* blocking puts, each needs an xbuf for type conversion */
+    start[1] = 0; count[0] = 1; count[1] = NX;
+    for (i=0; i<NREQS/2; i++) {
+        start[0] = rank * NREQS + i;
+        err = ncmpi_put_vara_double_all(ncid, varid, start, count, buf[i]);
+        CHECK_ERR
+    }
+
+    /* nonblocking puts, each needs an xbuf */
+    for (i=NREQS/2; i<NREQS; i++) {
+        start[0] = rank * NREQS + i;
+        err = ncmpi_iput_vara_double(ncid, varid, start, count, buf[i],
+                                     &reqs[i]); CHECK_ERR
+    }
+    err = ncmpi_wait_all(ncid, NREQS/2, reqs+NREQS/2, sts+NREQS/2); CHECK_ERR
+
+    /* nonblocking gets, reusing buffers freed by the puts */
+    for (i=0; i<NREQS; i++) {
+        start[0] = rank * NREQS + i;
+        err = ncmpi_iget_vara_float(ncid, varid, start, count, rbuf[i],
+                                    &reqs[i]); CHECK_ERR
+    }
+    err = ncmpi_wait_all(ncid, NREQS, reqs, sts); CHECK_ERR
+
+    for (i=0; i<NREQS; i++) {
+        for (j=0; j<NX; j++) {
+            if (rbuf[i][j] != (float)buf[i][j]) {
+                printf("Error at line %d in %s: expect buf[%d][%d]=%f but got %f\n",
+                       __LINE__,__FILE__,i,j,(float)buf[i][j],rbuf[i][j]);
+                nerrs++;
+                i = NREQS;
+                break;
+            }
+        }
+    }
+
+    err = ncmpi_inq_buf_pool_stats(ncid, &hits2, NULL, &max_size); CHECK_ERR
+    if (expect_hits && hits2 - hits < NREQS/2) {
+        printf("Error at line %d in %s: expect at least %d buffers reused but got %lld\n",
+               __LINE__,__FILE__,NREQS/2,hits2-hits);
+        nerrs++;
+    }
+    if (!strcmp(pool_size, "0") && hits2 != hits) {
+        printf("Error at line %d in %s: expect no buffer reused but got %lld\n",
+               __LINE__,__FILE__,hits2-hits);
+        nerrs++;
+    }
+    if (expect_hits && max_size <= 0) {
+        printf("Error at line %d in %s: expect a positive high water mark but got %lld\n",
+               __LINE__,__FILE__,max_size);
+        nerrs++;
+    }
+
+    err = ncmpi_close(ncid); CHECK_ERR
+    return nerrs;
+}
+
+int main(int argc, char** argv) {
+    char filename[256];
+    int rank, err, nerrs=0;
+
+    MPI_Init(&argc, &argv);
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+
+    if (argc > 2) {
+        if (!rank) printf("Usage: %s [filename]\n",argv[0]);
+        MPI_Finalize();
+        return 1;
+    }
+    if (argc == 2) snprintf(filename, 256, "%s", argv[1]);
+    else           strcpy(filename, "testfile.nc");
+    MPI_Bcast(filename, 256, MPI_CHAR, 0, MPI_COMM_WORLD);
+
+    if (rank == 0) {
+        char *cmd_str = (char*)malloc(strlen(argv[0]) + 256);
+        sprintf(cmd_str, "*** TESTING C   %s for pool of temporary buffers ", basename(argv[0]));
+        printf("%-66s ------ ", cmd_str); fflush(stdout);
+        free(cmd_str);
+    }
+
+    /* buffers are not pooled */
+    nerrs += run_test(filename, "0", 0);
+
+    /* buffers are reused from the pool */
+    nerrs += run_test(filename, "1048576", 1);
+
+    /* check if PnetCDF freed all internal malloc */
+    MPI_Offset malloc_size, sum_size;
+    err = ncmpi_inq_malloc_size(&malloc_size);
+    if (err == NC_NOERR) {
+        MPI_Reduce(&malloc_size, &sum_size, 1, MPI_OFFSET, MPI_SUM, 0, MPI_COMM_WORLD);
+        if (rank == 0 && sum_size > 0)
+            printf("heap memory allocated by PnetCDF internally has %lld bytes yet to be freed\n",
+                   sum_size);
+    }
+
+    MPI_Allreduce(MPI_IN_PLACE, &nerrs, 1, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
+    if (rank == 0) {
+        if (nerrs) printf(FAIL_STR,nerrs);
+        else       printf(PASS_STR);
+    }
+
+    MPI_Finalize();
+    return (nerrs > 0);
+}
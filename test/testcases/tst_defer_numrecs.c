@@ -0,0 +1,213 @@
+/*
+ *  Copyright (C) 2018, Northwestern University and Argonne National Laboratory
+ *  See COPYRIGHT notice in top-level directory.
+ *
+ *  $Id$
+ */
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *
+ * This program tests hint nc_defer_numrecs, which defers the sync of the
+ * number of records of collective puts to record variables. Each process
+ * writes a different number of records, so numrecs in memory is local to
+ * each process until it is sync-ed by ncmpi_sync_numrecs(), a collective
+ * wait, ncmpi_sync(), ncmpi_redef(), or ncmpi_close(). The number of records
+ * in the file is checked after reopening it.
+ *
+ * The compile and run commands are given below.
+ *
+ *    % mpicc -g -o tst_defer_numrecs tst_defer_numrecs.c -lpnetcdf
+ *
+ *    % mpiexec -l -n 4 ./tst_defer_numrecs testfile.nc
+ *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h> /* strcasecmp() */
+#include <libgen.h> /* basename() */
+#include <mpi.h>
+#include <pnetcdf.h>
+
+#include <testutils.h>
+
+#define NX 4
+#define NVARS 8
+
+static int
+check_numrecs(int ncid, int dimid, MPI_Offset expect, int line)
+{
+    int err, nerrs=0;
+    MPI_Offset numrecs;
+
+    err = ncmpi_inq_dimlen(ncid, dimid, &numrecs); CHECK_ERR
+    if (numrecs != expect) {
+        printf("Error at line %d in %s: expect numrecs %lld but got %lld\n",
+               line,__FILE__,expect,numrecs);
+        nerrs++;
+    }
+    return nerrs;
+}
+
+/* each process writes record rank + base of all variables */
+static int
+write_recs(int ncid, int *varids, int rank, int base)
+{
+    int i, j, err, nerrs=0, buf[NX];
+    MPI_Offset start[2], count[2];
+
+    for (i=0; i<NX; i++) buf[i] = rank + base + i;
+    start[0] = rank + base; start[1] = 0;
+    count[0] = 1;           count[1] = NX;
+    for (j=0; j<NVARS; j++) {
+        err = ncmpi_put_vara_int_all(ncid, varids[j], start, count, buf);
+        CHECK_ERR
+    }
+    return nerrs;
+}
+
+int main(int argc, char** argv) {
+    char filename[256], value[MPI_MAX_INFO_VAL], name[16];
+    int i, err, nerrs=0, rank, nprocs, ncid, dimids[2], varids[NVARS], flag;
+    int req, buf[NX];
+    MPI_Offset start[2], count[2];
+    MPI_Info info, info_used;
+
+    MPI_Init(&argc, &argv);
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &nprocs);
+
+    if (argc > 2) {
+        if (!rank) printf("Usage: %s [filename]\n",argv[0]);
+        MPI_Finalize();
+        return 1;
+    }
+    if (argc == 2) snprintf(filename, 256, "%s", argv[1]);
+    else           strcpy(filename, "testfile.nc");
+    MPI_Bcast(filename, 256, MPI_CHAR, 0, MPI_COMM_WORLD);
+
+    if (rank == 0) {
+        char *cmd_str = (char*)malloc(strlen(argv[0]) + 256);
+        sprintf(cmd_str, "*** TESTING C   %s for hint nc_defer_numrecs ", basename(argv[0]));
+        printf("%-66s ------ ", cmd_str); fflush(stdout);
+        free(cmd_str);
+    }
+
+    MPI_Info_create(&info);
+    MPI_Info_set(info, "nc_defer_numrecs", "enable");
+
+    err = ncmpi_create(MPI_COMM_WORLD, filename, NC_CLOBBER, info, &ncid);
+    CHECK_ERR
+    MPI_Info_free(&info);
+
+    err = ncmpi_inq_file_info(ncid, &info_used); CHECK_ERR
+#ifdef BUILD_DRIVER_DW
+    /* the DataWarp driver keeps its own numrecs */
+    MPI_Info_get(info_used, "nc_dw", MPI_MAX_INFO_VAL-1, value, &flag);
+    if (flag && strcasecmp(value, "enable") == 0) {
+        MPI_Info_free(&info_used);
+        err = ncmpi_close(ncid); CHECK_ERR
+        goto err_out;
+    }
+#endif
+    MPI_Info_get(info_used, "nc_defer_numrecs", MPI_MAX_INFO_VAL-1, value,
+                 &flag);
+    MPI_Info_free(&info_used);
+    if (!flag || strcasecmp(value, "enable")) {
+        printf("Error at line %d in %s: hint nc_defer_numrecs is not enabled\n",
+               __LINE__,__FILE__);
+        nerrs++;
+    }
+
+    err = ncmpi_def_dim(ncid, "time", NC_UNLIMITED, &dimids[0]); CHECK_ERR
+    err = ncmpi_def_dim(ncid, "X", NX, &dimids[1]); CHECK_ERR
+    for (i=0; i<NVARS; i++) {
+        sprintf(name, "var%d", i);
+        err = ncmpi_def_var(ncid, name, NC_INT, 2, dimids, &varids[i]);
+        CHECK_ERR
+    }
+    err = ncmpi_enddef(ncid); CHECK_ERR
+
+    /* numrecs in memory is local until sync-ed */
+    nerrs += write_recs(ncid, varids, rank, 0);
+    nerrs += check_numrecs(ncid, dimids[0], rank + 1, __LINE__);
+    err = ncmpi_sync_numrecs(ncid); CHECK_ERR
+    nerrs += check_numrecs(ncid, dimids[0], nprocs, __LINE__);
+
+    /* a collective wait syncs numrecs, even of the blocking puts */
+    nerrs += write_recs(ncid, varids, rank, nprocs);
+    for (i=0; i<NX; i++) buf[i] = i;
+    start[0] = 0; start[1] = 0;
+    count[0] = 1; count[1] = NX;
+    err = ncmpi_iput_vara_int(ncid, varids[0], start, count, buf, &req);
+    CHECK_ERR
+    err = ncmpi_wait_all(ncid, 1, &req, NULL); CHECK_ERR
+    nerrs += check_numrecs(ncid, dimids[0], 2 * nprocs, __LINE__);
+
+    /* ncmpi_sync syncs numrecs */
+    nerrs += write_recs(ncid, varids, rank, 2 * nprocs);
+    err = ncmpi_sync(ncid); CHECK_ERR
+    nerrs += check_numrecs(ncid, dimids[0], 3 * nprocs, __LINE__);
+
+    /* ncmpi_redef syncs numrecs */
+    nerrs += write_recs(ncid, varids, rank, 3 * nprocs);
+    err = ncmpi_redef(ncid); CHECK_ERR
+    nerrs += check_numrecs(ncid, dimids[0], 4 * nprocs, __LINE__);
+    err = ncmpi_put_att_int(ncid, NC_GLOBAL, "attr", NC_INT, 1, &nprocs);
+    CHECK_ERR
+    err = ncmpi_enddef(ncid); CHECK_ERR
+
+    /* independent puts mixed with the deferred collective ones */
+    nerrs += write_recs(ncid, varids, rank, 4 * nprocs);
+    err = ncmpi_begin_indep_data(ncid); CHECK_ERR
+    start[0] = 5 * nprocs + rank;
+    err = ncmpi_put_vara_int(ncid, varids[0], start, count, buf); CHECK_ERR
+    err = ncmpi_end_indep_data(ncid); CHECK_ERR
+    nerrs += check_numrecs(ncid, dimids[0], 6 * nprocs, __LINE__);
+
+    /* ncmpi_close syncs numrecs */
+    nerrs += write_recs(ncid, varids, rank, 6 * nprocs);
+    err = ncmpi_close(ncid); CHECK_ERR
+
+    err = ncmpi_open(MPI_COMM_WORLD, filename, NC_NOWRITE, MPI_INFO_NULL,
+                     &ncid); CHECK_ERR
+    nerrs += check_numrecs(ncid, dimids[0], 7 * nprocs, __LINE__);
+    for (i=0; i<NVARS; i++) {
+        int j;
+        start[0] = 6 * nprocs + rank;
+        err = ncmpi_get_vara_int_all(ncid, varids[i], start, count, buf);
+        CHECK_ERR
+        for (j=0; j<NX; j++) {
+            if (buf[j] != 6 * nprocs + rank + j) {
+                printf("Error at line %d in %s: var%d expect buf[%d]=%d but got %d\n",
+                       __LINE__,__FILE__,i,j,6 * nprocs + rank + j,buf[j]);
+                nerrs++;
+                break;
+            }
+        }
+    }
+    err = ncmpi_close(ncid); CHECK_ERR
+
+#ifdef BUILD_DRIVER_DW
+err_out:
+#endif
+    /* check if PnetCDF freed all internal malloc */
+    MPI_Offset malloc_size, sum_size;
+    err = ncmpi_inq_malloc_size(&malloc_size);
+    if (err == NC_NOERR) {
+        MPI_Reduce(&malloc_size, &sum_size, 1, MPI_OFFSET, MPI_SUM, 0, MPI_COMM_WORLD);
+        if (rank == 0 && sum_size > 0)
+            printf("heap memory allocated by PnetCDF internally has %lld bytes yet to be freed\n",
+                   sum_size);
+    }
+
+    MPI_Allreduce(MPI_IN_PLACE, &nerrs, 1, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
+    if (rank == 0) {
+        if (nerrs) printf(FAIL_STR,nerrs);
+        else       printf(PASS_STR);
+    }
+
+    MPI_Finalize();
+    return (nerrs > 0);
+}
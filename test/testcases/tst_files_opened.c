@@ -0,0 +1,168 @@
+/*
+ *  Copyright (C) 2018, Northwestern University and Argonne National Laboratory
+ *  See COPYRIGHT notice in top-level directory.
+ *
+ *  $Id$
+ */
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *
+ * This program tests the table of opened files kept by the dispatcher, which
+ * grows on demand. The same file is opened more times than the initial size
+ * of the table, and the file IDs are checked to be distinct and reported by
+ * ncmpi_inq_files_opened(). Every other file is closed, its ID must become
+ * invalid, and the IDs are reused by the files opened next, the smallest
+ * first, regardless of the order the files were closed.
+ *
+ * The compile and run commands are given below.
+ *
+ *    % mpicc -g -o tst_files_opened tst_files_opened.c -lpnetcdf
+ *
+ *    % mpiexec -l -n 4 ./tst_files_opened testfile.nc
+ *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <libgen.h> /* basename() */
+#include <mpi.h>
+#include <pnetcdf.h>
+
+#include <testutils.h>
+
+#define NFILES 150
+
+static int
+check_opened(const int *ncids, int expect)
+{
+    int i, j, err, nerrs=0, num, *list;
+
+    err = ncmpi_inq_files_opened(&num, NULL); CHECK_ERR
+    if (num != expect) {
+        printf("Error at line %d in %s: expect %d files opened but got %d\n",
+               __LINE__,__FILE__,expect,num);
+        return 1;
+    }
+    if (num == 0) return nerrs;
+
+    list = (int*) malloc(num * sizeof(int));
+    err = ncmpi_inq_files_opened(&num, list); CHECK_ERR
+
+    /* all IDs of opened files must be reported */
+    for (i=0; i<NFILES; i++) {
+        if (ncids[i] == -1) continue;
+        for (j=0; j<num; j++)
+            if (list[j] == ncids[i]) break;
+        if (j == num) {
+            printf("Error at line %d in %s: ncid %d not reported as opened\n",
+                   __LINE__,__FILE__,ncids[i]);
+            nerrs++;
+            break;
+        }
+    }
+    free(list);
+    return nerrs;
+}
+
+int main(int argc, char** argv) {
+    char filename[256];
+    int i, j, err, nerrs=0, rank, ncid, nopened, ncids[NFILES], format;
+    int freed[NFILES];
+
+    MPI_Init(&argc, &argv);
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+
+    if (argc > 2) {
+        if (!rank) printf("Usage: %s [filename]\n",argv[0]);
+        MPI_Finalize();
+        return 1;
+    }
+    if (argc == 2) snprintf(filename, 256, "%s", argv[1]);
+    else           strcpy(filename, "testfile.nc");
+    MPI_Bcast(filename, 256, MPI_CHAR, 0, MPI_COMM_WORLD);
+    for (i=0; i<NFILES; i++) ncids[i] = -1;
+
+    if (rank == 0) {
+        char *cmd_str = (char*)malloc(strlen(argv[0]) + 256);
+        sprintf(cmd_str, "*** TESTING C   %s for many opened files ", basename(argv[0]));
+        printf("%-66s ------ ", cmd_str); fflush(stdout);
+        free(cmd_str);
+    }
+
+    err = ncmpi_create(MPI_COMM_WORLD, filename, NC_CLOBBER, MPI_INFO_NULL,
+                       &ncid); CHECK_ERR
+    err = ncmpi_close(ncid); CHECK_ERR
+
+    /* closed and never used IDs are invalid */
+    err = ncmpi_inq_format(ncid, &format);
+    EXP_ERR(NC_EBADID)
+    err = ncmpi_inq_format(NFILES * 100, &format);
+    EXP_ERR(NC_EBADID)
+
+    for (i=0; i<NFILES; i++) {
+        err = ncmpi_open(MPI_COMM_WORLD, filename, NC_NOWRITE, MPI_INFO_NULL,
+                         &ncids[i]); CHECK_ERR
+        for (j=0; j<i; j++) {
+            if (ncids[j] == ncids[i]) {
+                printf("Error at line %d in %s: ncid %d used twice\n",
+                       __LINE__,__FILE__,ncids[i]);
+                nerrs++;
+                goto err_out;
+            }
+        }
+    }
+    nerrs += check_opened(ncids, NFILES);
+
+    /* close every other file */
+    for (i=0; i<NFILES; i+=2) {
+        ncid = freed[i] = ncids[i];
+        err = ncmpi_close(ncid); CHECK_ERR
+        ncids[i] = -1;
+        err = ncmpi_inq_format(ncid, &format);
+        EXP_ERR(NC_EBADID)
+    }
+    nopened = NFILES / 2;
+    nerrs += check_opened(ncids, nopened);
+
+    /* files opened next reuse the IDs freed, the smallest first. The IDs
+     * were given in increasing order when the files were opened. */
+    for (i=0; i<NFILES; i+=2) {
+        err = ncmpi_open(MPI_COMM_WORLD, filename, NC_NOWRITE, MPI_INFO_NULL,
+                         &ncids[i]); CHECK_ERR
+        if (ncids[i] != freed[i]) {
+            printf("Error at line %d in %s: expect ncid %d reused but got %d\n",
+                   __LINE__,__FILE__,freed[i],ncids[i]);
+            nerrs++;
+        }
+        err = ncmpi_inq_format(ncids[i], &format); CHECK_ERR
+    }
+    nerrs += check_opened(ncids, NFILES);
+
+err_out:
+    for (i=0; i<NFILES; i++) {
+        if (ncids[i] == -1) continue;
+        err = ncmpi_close(ncids[i]); CHECK_ERR
+        ncids[i] = -1;
+    }
+    nerrs += check_opened(ncids, 0);
+
+    /* check if PnetCDF freed all internal malloc */
+    MPI_Offset malloc_size, sum_size;
+    err = ncmpi_inq_malloc_size(&malloc_size);
+    if (err == NC_NOERR) {
+        MPI_Reduce(&malloc_size, &sum_size, 1, MPI_OFFSET, MPI_SUM, 0, MPI_COMM_WORLD);
+        if (rank == 0 && sum_size > 0)
+            printf("heap memory allocated by PnetCDF internally has %lld bytes yet to be freed\n",
+                   sum_size);
+    }
+
+    MPI_Allreduce(MPI_IN_PLACE, &nerrs, 1, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
+    if (rank == 0) {
+        if (nerrs) printf(FAIL_STR,nerrs);
+        else       printf(PASS_STR);
+    }
+
+    MPI_Finalize();
+    return (nerrs > 0);
+}
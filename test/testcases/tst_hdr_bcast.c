@@ -0,0 +1,219 @@
+/*
+ *  Copyright (C) 2018, Northwestern University and Argonne National Laboratory
+ *  See COPYRIGHT notice in top-level directory.
+ *
+ *  $Id$
+ */
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *
+ * This program tests opening files with hint nc_header_bcast_whole enabled,
+ * where the root process reads and decodes the header alone and broadcasts
+ * the entire header to others at once. A small nc_header_read_chunk_size is
+ * used, so the header spans many chunks. The metadata obtained is checked
+ * against the one obtained when the hint is disabled. Opening a file that is
+ * not a netCDF file must fail on all processes.
+ *
+ * The compile and run commands are given below.
+ *
+ *    % mpicc -g -o tst_hdr_bcast tst_hdr_bcast.c -lpnetcdf
+ *
+ *    % mpiexec -l -n 4 ./tst_hdr_bcast testfile.nc
+ *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <libgen.h> /* basename() */
+#include <mpi.h>
+#include <pnetcdf.h>
+
+#include <testutils.h>
+
+#define NVARS 40
+#define NATTS 12
+
+static int
+check_header(const char *filename, MPI_Info info, int bcast_whole)
+{
+    char name[NC_MAX_NAME+1], value[MPI_MAX_INFO_VAL];
+    int i, j, err, nerrs=0, ncid, ndims, nvars, natts, flag, attval, buf[4];
+    MPI_Offset len, header_size;
+    MPI_Info info_used;
+
+    err = ncmpi_open(MPI_COMM_WORLD, filename, NC_NOWRITE, info, &ncid);
+    CHECK_ERR
+
+    err = ncmpi_inq_file_info(ncid, &info_used); CHECK_ERR
+    MPI_Info_get(info_used, "nc_header_bcast_whole", MPI_MAX_INFO_VAL-1,
+                 value, &flag);
+    if (!flag || strcmp(value, bcast_whole ? "enable" : "disable")) {
+        printf("Error at line %d in %s: unexpected nc_header_bcast_whole %s\n",
+               __LINE__,__FILE__,(flag) ? value : "(not set)");
+        nerrs++;
+    }
+    MPI_Info_free(&info_used);
+
+    err = ncmpi_inq(ncid, &ndims, &nvars, &natts, NULL); CHECK_ERR
+    if (ndims != 2 || nvars != NVARS || natts != NATTS) {
+        printf("Error at line %d in %s: expect ndims=2 nvars=%d natts=%d but got %d %d %d\n",
+               __LINE__,__FILE__,NVARS,NATTS,ndims,nvars,natts);
+        nerrs++;
+    }
+    err = ncmpi_inq_header_size(ncid, &header_size); CHECK_ERR
+    if (header_size <= 1024) {
+        printf("Error at line %d in %s: header size %lld is too small\n",
+               __LINE__,__FILE__,header_size);
+        nerrs++;
+    }
+    err = ncmpi_inq_dimlen(ncid, 1, &len); CHECK_ERR
+    if (len != 4) {
+        printf("Error at line %d in %s: expect dim len 4 but got %lld\n",
+               __LINE__,__FILE__,len);
+        nerrs++;
+    }
+
+    for (i=0; i<NATTS; i++) {
+        sprintf(name, "global_attribute_%d", i);
+        err = ncmpi_get_att_int(ncid, NC_GLOBAL, name, &attval); CHECK_ERR
+        if (attval != i) {
+            printf("Error at line %d in %s: expect %s=%d but got %d\n",
+                   __LINE__,__FILE__,name,i,attval);
+            nerrs++;
+        }
+    }
+
+    for (i=0; i<NVARS; i++) {
+        int varid;
+        sprintf(name, "variable_with_a_long_name_%d", i);
+        err = ncmpi_inq_varid(ncid, name, &varid); CHECK_ERR
+        if (varid != i) {
+            printf("Error at line %d in %s: expect varid %d but got %d\n",
+                   __LINE__,__FILE__,i,varid);
+            nerrs++;
+        }
+        err = ncmpi_inq_varnatts(ncid, i, &natts); CHECK_ERR
+        if (natts != 2) {
+            printf("Error at line %d in %s: expect var %d natts 2 but got %d\n",
+                   __LINE__,__FILE__,i,natts);
+            nerrs++;
+        }
+        err = ncmpi_get_att_text(ncid, i, "long_name", name); CHECK_ERR
+        err = ncmpi_get_att_int(ncid, i, "index", &attval); CHECK_ERR
+        if (attval != i) {
+            printf("Error at line %d in %s: expect index %d but got %d\n",
+                   __LINE__,__FILE__,i,attval);
+            nerrs++;
+        }
+        if (i % 10) continue;
+
+        err = ncmpi_get_var_int_all(ncid, i, buf); CHECK_ERR
+        for (j=0; j<4; j++) {
+            if (buf[j] != i * 10 + j) {
+                printf("Error at line %d in %s: expect var %d [%d]=%d but got %d\n",
+                       __LINE__,__FILE__,i,j,i*10+j,buf[j]);
+                nerrs++;
+                break;
+            }
+        }
+    }
+
+    err = ncmpi_close(ncid); CHECK_ERR
+    return nerrs;
+}
+
+int main(int argc, char** argv) {
+    char filename[256], name[NC_MAX_NAME+1];
+    int i, j, rank, err, nerrs=0, ncid, dimids[2], varid, buf[4];
+    MPI_Info info;
+
+    MPI_Init(&argc, &argv);
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+
+    if (argc > 2) {
+        if (!rank) printf("Usage: %s [filename]\n",argv[0]);
+        MPI_Finalize();
+        return 1;
+    }
+    if (argc == 2) snprintf(filename, 256, "%s", argv[1]);
+    else           strcpy(filename, "testfile.nc");
+    MPI_Bcast(filename, 256, MPI_CHAR, 0, MPI_COMM_WORLD);
+
+    if (rank == 0) {
+        char *cmd_str = (char*)malloc(strlen(argv[0]) + 256);
+        sprintf(cmd_str, "*** TESTING C   %s for broadcasting whole header ", basename(argv[0]));
+        printf("%-66s ------ ", cmd_str); fflush(stdout);
+        free(cmd_str);
+    }
+
+    /* create a file whose header is many times of the read chunk size */
+    err = ncmpi_create(MPI_COMM_WORLD, filename, NC_CLOBBER, MPI_INFO_NULL,
+                       &ncid); CHECK_ERR
+    err = ncmpi_def_dim(ncid, "REC", NC_UNLIMITED, &dimids[0]); CHECK_ERR
+    err = ncmpi_def_dim(ncid, "X", 4, &dimids[1]); CHECK_ERR
+    for (i=0; i<NATTS; i++) {
+        sprintf(name, "global_attribute_%d", i);
+        err = ncmpi_put_att_int(ncid, NC_GLOBAL, name, NC_INT, 1, &i); CHECK_ERR
+    }
+    for (i=0; i<NVARS; i++) {
+        sprintf(name, "variable_with_a_long_name_%d", i);
+        err = ncmpi_def_var(ncid, name, NC_INT, 1, &dimids[1], &varid);
+        CHECK_ERR
+        err = ncmpi_put_att_text(ncid, varid, "long_name", strlen(name), name);
+        CHECK_ERR
+        err = ncmpi_put_att_int(ncid, varid, "index", NC_INT, 1, &i); CHECK_ERR
+    }
+    err = ncmpi_enddef(ncid); CHECK_ERR
+    for (i=0; i<NVARS; i+=10) {
+        for (j=0; j<4; j++) buf[j] = i * 10 + j;
+        err = ncmpi_put_var_int_all(ncid, i, buf); CHECK_ERR
+    }
+    err = ncmpi_close(ncid); CHECK_ERR
+
+    MPI_Info_create(&info);
+    MPI_Info_set(info, "nc_header_read_chunk_size", "256");
+
+    /* read the header chunk by chunk */
+    MPI_Info_set(info, "nc_header_bcast_whole", "disable");
+    nerrs += check_header(filename, info, 0);
+
+    /* root broadcasts the whole header */
+    MPI_Info_set(info, "nc_header_bcast_whole", "enable");
+    nerrs += check_header(filename, info, 1);
+
+    /* opening a file that is not a netCDF file */
+    if (rank == 0) {
+        FILE *fp = fopen(filename, "w");
+        for (i=0; i<100; i++) fprintf(fp, "this is not a netCDF file\n");
+        fclose(fp);
+    }
+    MPI_Barrier(MPI_COMM_WORLD);
+    err = ncmpi_open(MPI_COMM_WORLD, filename, NC_NOWRITE, info, &ncid);
+    EXP_ERR(NC_ENOTNC)
+    MPI_Info_free(&info);
+
+    /* leave a valid netCDF file behind */
+    err = ncmpi_create(MPI_COMM_WORLD, filename, NC_CLOBBER, MPI_INFO_NULL,
+                       &ncid); CHECK_ERR
+    err = ncmpi_close(ncid); CHECK_ERR
+
+    /* check if PnetCDF freed all internal malloc */
+    MPI_Offset malloc_size, sum_size;
+    err = ncmpi_inq_malloc_size(&malloc_size);
+    if (err == NC_NOERR) {
+        MPI_Reduce(&malloc_size, &sum_size, 1, MPI_OFFSET, MPI_SUM, 0, MPI_COMM_WORLD);
+        if (rank == 0 && sum_size > 0)
+            printf("heap memory allocated by PnetCDF internally has %lld bytes yet to be freed\n",
+                   sum_size);
+    }
+
+    MPI_Allreduce(MPI_IN_PLACE, &nerrs, 1, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
+    if (rank == 0) {
+        if (nerrs) printf(FAIL_STR,nerrs);
+        else       printf(PASS_STR);
+    }
+
+    MPI_Finalize();
+    return (nerrs > 0);
+}
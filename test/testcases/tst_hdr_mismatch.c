@@ -0,0 +1,121 @@
+/*
+ *  Copyright (C) 2018, Northwestern University and Argonne National Laboratory
+ *  See COPYRIGHT notice in top-level directory.
+ *
+ *  $Id$
+ */
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *
+ * This program tests the header consistency check done at enddef in safe
+ * mode, when the header of one process differs from the others. The argument
+ * checks of the define-mode APIs do not catch this case, because the
+ * attribute is copied by ncmpi_copy_att() from a file created by each
+ * process on its own, in which the last process puts a different value.
+ * ncmpi_enddef() must return NC_EMULTIDEFINE on all processes, and root's
+ * header must be the one written to the file.
+ *
+ * The compile and run commands are given below.
+ *
+ *    % mpicc -g -o tst_hdr_mismatch tst_hdr_mismatch.c -lpnetcdf
+ *
+ *    % mpiexec -l -n 4 ./tst_hdr_mismatch testfile.nc
+ *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <libgen.h> /* basename() */
+#include <mpi.h>
+#include <pnetcdf.h>
+
+#include <testutils.h>
+
+int main(int argc, char** argv) {
+    char filename[256], srcname[288];
+    int err, nerrs=0, rank, nprocs, ncid, src_ncid, dimid, varid, val, exp;
+
+    MPI_Init(&argc, &argv);
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &nprocs);
+
+    if (argc > 2) {
+        if (!rank) printf("Usage: %s [filename]\n",argv[0]);
+        MPI_Finalize();
+        return 1;
+    }
+    if (argc == 2) snprintf(filename, 256, "%s", argv[1]);
+    else           strcpy(filename, "testfile.nc");
+    MPI_Bcast(filename, 256, MPI_CHAR, 0, MPI_COMM_WORLD);
+
+    if (rank == 0) {
+        char *cmd_str = (char*)malloc(strlen(argv[0]) + 256);
+        sprintf(cmd_str, "*** TESTING C   %s for inconsistent header at enddef ", basename(argv[0]));
+        printf("%-66s ------ ", cmd_str); fflush(stdout);
+        free(cmd_str);
+    }
+
+    /* the header consistency check is done only in safe mode */
+    setenv("PNETCDF_SAFE_MODE", "1", 1);
+
+    /* each process creates its own file holding the attribute to be copied.
+     * Only the last process puts a different value, so with one process
+     * all headers are consistent. */
+    sprintf(srcname, "%s.%d", filename, rank);
+    err = ncmpi_create(MPI_COMM_SELF, srcname, NC_CLOBBER, MPI_INFO_NULL,
+                       &src_ncid); CHECK_ERR
+    val = (nprocs > 1 && rank == nprocs - 1) ? 1 : 0;
+    err = ncmpi_put_att_int(src_ncid, NC_GLOBAL, "attr", NC_INT, 1, &val);
+    CHECK_ERR
+
+    err = ncmpi_create(MPI_COMM_WORLD, filename, NC_CLOBBER, MPI_INFO_NULL,
+                       &ncid); CHECK_ERR
+    err = ncmpi_def_dim(ncid, "X", nprocs, &dimid); CHECK_ERR
+    err = ncmpi_def_var(ncid, "var", NC_INT, 1, &dimid, &varid); CHECK_ERR
+
+    /* arguments are consistent, but the attribute values are not */
+    err = ncmpi_copy_att(src_ncid, NC_GLOBAL, "attr", ncid, NC_GLOBAL);
+    CHECK_ERR
+
+    /* all processes must get the error, not only the last one */
+    err = ncmpi_enddef(ncid);
+    if (nprocs > 1) EXP_ERR(NC_EMULTIDEFINE)
+    else            CHECK_ERR
+
+    err = ncmpi_close(ncid); CHECK_ERR
+    err = ncmpi_close(src_ncid); CHECK_ERR
+    err = ncmpi_delete(srcname, MPI_INFO_NULL); CHECK_ERR
+
+    /* root's header is the one written to the file */
+    err = ncmpi_open(MPI_COMM_WORLD, filename, NC_NOWRITE, MPI_INFO_NULL,
+                     &ncid); CHECK_ERR
+    val = -1;
+    exp = 0;
+    err = ncmpi_get_att_int(ncid, NC_GLOBAL, "attr", &val); CHECK_ERR
+    if (val != exp) {
+        printf("Error at line %d in %s: expect attr value %d but got %d\n",
+               __LINE__,__FILE__,exp,val);
+        nerrs++;
+    }
+    err = ncmpi_close(ncid); CHECK_ERR
+
+    /* check if PnetCDF freed all internal malloc */
+    MPI_Offset malloc_size, sum_size;
+    err = ncmpi_inq_malloc_size(&malloc_size);
+    if (err == NC_NOERR) {
+        MPI_Reduce(&malloc_size, &sum_size, 1, MPI_OFFSET, MPI_SUM, 0, MPI_COMM_WORLD);
+        if (rank == 0 && sum_size > 0)
+            printf("heap memory allocated by PnetCDF internally has %lld bytes yet to be freed\n",
+                   sum_size);
+    }
+
+    MPI_Allreduce(MPI_IN_PLACE, &nerrs, 1, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
+    if (rank == 0) {
+        if (nerrs) printf(FAIL_STR,nerrs);
+        else       printf(PASS_STR);
+    }
+
+    MPI_Finalize();
+    return (nerrs > 0);
+}
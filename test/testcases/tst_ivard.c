@@ -0,0 +1,296 @@
+/*
+ *  Copyright (C) 2018, Northwestern University and Argonne National Laboratory
+ *  See COPYRIGHT notice in top-level directory.
+ *
+ *  $Id$
+ */
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *
+ * This program tests nonblocking vard APIs, whose filetypes are posted as
+ * requests and aggregated with other pending requests at the wait call. The
+ * filetype may be freed right after the request is posted. Requests to a
+ * fixed-size variable, a record variable spanning more than one record and a
+ * buffered one are completed by a single wait call, together with a vara
+ * request interleaving with one of the filetypes. Noncontiguous buffer types,
+ * a zero-length request and cancelling a vard request are also tested.
+ *
+ * The compile and run commands are given below.
+ *
+ *    % mpicc -g -o tst_ivard tst_ivard.c -lpnetcdf
+ *
+ *    % mpiexec -l -n 4 ./tst_ivard testfile.nc
+ *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <libgen.h> /* basename() */
+#include <mpi.h>
+#include <pnetcdf.h>
+
+#include <testutils.h>
+
+#define NY    2
+#define NX    10
+#define NRECS 3
+#define GAP   2   /* ghost cells of each row in the buffer of fix */
+#define LO    2   /* first column of fix accessed by its filetype */
+#define HI    8   /* one past the last column of fix accessed by filetype */
+
+/* Compare len values in buf against exp. Return the number of mismatches. */
+static int
+check_ints(const char *name,
+           int         len,
+           const int  *exp,
+           const int  *buf,
+           int         line)
+{
+    int i;
+    for (i=0; i<len; i++) {
+        if (buf[i] != exp[i]) {
+            printf("Error at line %d in %s: expect %s[%d]=%d but got %d\n",
+                   line,__FILE__,name,i,exp[i],buf[i]);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+int main(int argc, char** argv) {
+    char filename[256];
+    int i, j, err, nerrs=0, rank, nprocs, ncid, dimids[3], fix, rec, flt;
+    int nreqs, reqs[4], sts[4], blocklen=1;
+    int gsizes[3], subsizes[3], starts[3];
+    int exp_fix[NY*NX], exp_rec[NRECS*NY*NX], ibuf[NRECS*NY*NX];
+    int gbuf[NY*(HI-LO+GAP)];
+    float exp_flt[NY*NX], fbuf[NY*NX];
+    MPI_Offset start[3], count[3], numrecs;
+    MPI_Aint disp;
+    MPI_Datatype fix_ftype, rec_ftype, flt_ftype, vtype, buftype;
+
+    MPI_Init(&argc, &argv);
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &nprocs);
+
+    if (argc > 2) {
+        if (!rank) printf("Usage: %s [filename]\n",argv[0]);
+        MPI_Finalize();
+        return 1;
+    }
+    if (argc == 2) snprintf(filename, 256, "%s", argv[1]);
+    else           strcpy(filename, "testfile.nc");
+    MPI_Bcast(filename, 256, MPI_CHAR, 0, MPI_COMM_WORLD);
+
+    if (rank == 0) {
+        char *cmd_str = (char*)malloc(strlen(argv[0]) + 256);
+        sprintf(cmd_str, "*** TESTING C   %s for nonblocking vard APIs ", basename(argv[0]));
+        printf("%-66s ------ ", cmd_str); fflush(stdout);
+        free(cmd_str);
+    }
+
+    err = ncmpi_create(MPI_COMM_WORLD, filename, NC_CLOBBER, MPI_INFO_NULL,
+                       &ncid); CHECK_ERR
+
+    err = ncmpi_def_dim(ncid, "time", NC_UNLIMITED, &dimids[0]); CHECK_ERR
+    err = ncmpi_def_dim(ncid, "Y", (MPI_Offset)nprocs * NY, &dimids[1]);
+    CHECK_ERR
+    err = ncmpi_def_dim(ncid, "X", NX, &dimids[2]); CHECK_ERR
+    err = ncmpi_def_var(ncid, "fix", NC_INT, 2, dimids+1, &fix); CHECK_ERR
+    err = ncmpi_def_var(ncid, "flt", NC_FLOAT, 2, dimids+1, &flt); CHECK_ERR
+    err = ncmpi_def_var(ncid, "rec", NC_INT, 3, dimids, &rec); CHECK_ERR
+
+    /* elements not written are left with fill values */
+    err = ncmpi_def_var_fill(ncid, fix, 0, NULL); CHECK_ERR
+    err = ncmpi_def_var_fill(ncid, flt, 0, NULL); CHECK_ERR
+    err = ncmpi_enddef(ncid); CHECK_ERR
+
+    /* this rank accesses rows [rank*NY, rank*NY+NY) of all variables.
+     * Filetype of fix covers columns [LO, HI) */
+    gsizes[0]   = nprocs * NY; gsizes[1]   = NX;
+    subsizes[0] = NY;          subsizes[1] = HI - LO;
+    starts[0]   = rank * NY;   starts[1]   = LO;
+    MPI_Type_create_subarray(2, gsizes, subsizes, starts, MPI_ORDER_C,
+                             MPI_INT, &fix_ftype);
+    MPI_Type_commit(&fix_ftype);
+
+    /* filetype of rec spans NRECS records, as rec is the only record
+     * variable, its records are laid out contiguously */
+    gsizes[0]   = NRECS; gsizes[1]   = nprocs * NY; gsizes[2]   = NX;
+    subsizes[0] = NRECS; subsizes[1] = NY;          subsizes[2] = NX;
+    starts[0]   = 0;     starts[1]   = rank * NY;   starts[2]   = 0;
+    MPI_Type_create_subarray(3, gsizes, subsizes, starts, MPI_ORDER_C,
+                             MPI_INT, &rec_ftype);
+    MPI_Type_commit(&rec_ftype);
+
+    /* filetype of flt covers the first half of columns, built from a vector
+     * displaced in bytes */
+    MPI_Type_vector(NY, NX/2, NX, MPI_FLOAT, &vtype);
+    disp = (MPI_Aint)rank * NY * NX * sizeof(float);
+    MPI_Type_create_hindexed(1, &blocklen, &disp, vtype, &flt_ftype);
+    MPI_Type_commit(&flt_ftype);
+    MPI_Type_free(&vtype);
+
+    /* buffer of fix has GAP ghost cells at the end of each row */
+    MPI_Type_vector(NY, HI-LO, HI-LO+GAP, MPI_INT, &buftype);
+    MPI_Type_commit(&buftype);
+
+    /* expected contents of the rows of this rank */
+    for (i=0; i<NY; i++) {
+        for (j=0; j<NX; j++) {
+            int idx = i * NX + j;
+            exp_fix[idx] = (j < HI) ? rank * 1000 + idx : NC_FILL_INT;
+            exp_flt[idx] = (j < NX/2) ? rank * 1000 + idx + 0.5 : NC_FILL_FLOAT;
+        }
+    }
+    for (i=0; i<NRECS*NY*NX; i++) exp_rec[i] = -(rank * 1000 + i);
+
+    /* nonblocking vard write with a noncontiguous buffer */
+    for (i=0; i<NY; i++) {
+        for (j=0; j<HI-LO+GAP; j++)
+            gbuf[i*(HI-LO+GAP) + j] = (j < HI-LO) ? exp_fix[i*NX + LO + j] : -1;
+    }
+    err = ncmpi_iput_vard(ncid, fix, fix_ftype, gbuf, 1, buftype, &reqs[0]);
+    CHECK_ERR
+
+    /* nonblocking vara write to columns [0, LO) of fix, interleaving with
+     * the filetype above */
+    start[0] = rank * NY;  start[1] = 0;
+    count[0] = NY;         count[1] = LO;
+    for (i=0; i<NY; i++)
+        for (j=0; j<LO; j++)
+            ibuf[i*LO + j] = exp_fix[i*NX + j];
+    err = ncmpi_iput_vara_int(ncid, fix, start, count, ibuf, &reqs[1]);
+    CHECK_ERR
+
+    /* nonblocking vard write to more than one record, buffer type is
+     * ignored */
+    err = ncmpi_iput_vard(ncid, rec, rec_ftype, exp_rec, 1, MPI_DATATYPE_NULL,
+                          &reqs[2]); CHECK_ERR
+
+    /* buffered vard write, buffer can be reused once posted */
+    err = ncmpi_buffer_attach(ncid, NY * NX * sizeof(float)); CHECK_ERR
+    for (i=0; i<NY; i++)
+        for (j=0; j<NX/2; j++)
+            fbuf[i*(NX/2) + j] = exp_flt[i*NX + j];
+    err = ncmpi_bput_vard(ncid, flt, flt_ftype, fbuf, NY*(NX/2), MPI_FLOAT,
+                          &reqs[3]); CHECK_ERR
+    for (i=0; i<NY*NX; i++) fbuf[i] = 0;
+
+    /* a zero-length request */
+    err = ncmpi_iput_vard(ncid, fix, MPI_DATATYPE_NULL, NULL, 0, MPI_INT,
+                          &i); CHECK_ERR
+    if (i != NC_REQ_NULL) {
+        printf("Error at line %d in %s: expect NC_REQ_NULL but got %d\n",
+               __LINE__,__FILE__,i);
+        nerrs++;
+    }
+
+    /* a filetype can be freed once the request is posted */
+    MPI_Type_free(&flt_ftype);
+
+    err = ncmpi_inq_nreqs(ncid, &nreqs); CHECK_ERR
+    if (nreqs != 4) {
+        printf("Error at line %d in %s: expect 4 pending requests but got %d\n",
+               __LINE__,__FILE__,nreqs);
+        nerrs++;
+    }
+
+    /* all requests are completed by a single collective wait */
+    err = ncmpi_wait_all(ncid, 4, reqs, sts); CHECK_ERR
+    for (i=0; i<4; i++) {
+        err = sts[i]; CHECK_ERR
+    }
+    err = ncmpi_buffer_detach(ncid); CHECK_ERR
+
+    err = ncmpi_inq_dimlen(ncid, dimids[0], &numrecs); CHECK_ERR
+    if (numrecs != NRECS) {
+        printf("Error at line %d in %s: expect %d records but got %lld\n",
+               __LINE__,__FILE__,NRECS,numrecs);
+        nerrs++;
+    }
+
+    /* a cancelled vard request must not change the file */
+    for (i=0; i<NY*(HI-LO+GAP); i++) gbuf[i] = -1;
+    err = ncmpi_iput_vard(ncid, fix, fix_ftype, gbuf, 1, buftype, &reqs[0]);
+    CHECK_ERR
+    err = ncmpi_cancel(ncid, 1, reqs, sts); CHECK_ERR
+    err = ncmpi_inq_nreqs(ncid, &nreqs); CHECK_ERR
+    if (nreqs != 0) {
+        printf("Error at line %d in %s: expect no pending request but got %d\n",
+               __LINE__,__FILE__,nreqs);
+        nerrs++;
+    }
+
+    /* read back with nonblocking vard reads, into a noncontiguous buffer */
+    for (i=0; i<NY*(HI-LO+GAP); i++) gbuf[i] = 0;
+    err = ncmpi_iget_vard(ncid, fix, fix_ftype, gbuf, 1, buftype, &reqs[0]);
+    CHECK_ERR
+    for (i=0; i<NRECS*NY*NX; i++) ibuf[i] = 0;
+    err = ncmpi_iget_vard(ncid, rec, rec_ftype, ibuf, NRECS*NY*NX, MPI_INT,
+                          &reqs[1]); CHECK_ERR
+    err = ncmpi_wait_all(ncid, 2, reqs, sts); CHECK_ERR
+    for (i=0; i<2; i++) {
+        err = sts[i]; CHECK_ERR
+    }
+    for (i=0; i<NY; i++) {
+        for (j=0; j<HI-LO+GAP; j++) {
+            int exp = (j < HI-LO) ? exp_fix[i*NX + LO + j] : 0;
+            if (gbuf[i*(HI-LO+GAP) + j] != exp) {
+                printf("Error at line %d in %s: expect gbuf[%d][%d]=%d but got %d\n",
+                       __LINE__,__FILE__,i,j,exp,gbuf[i*(HI-LO+GAP) + j]);
+                nerrs++;
+                i = NY;
+                break;
+            }
+        }
+    }
+    nerrs += check_ints("rec", NRECS*NY*NX, exp_rec, ibuf, __LINE__);
+
+    MPI_Type_free(&buftype);
+    MPI_Type_free(&fix_ftype);
+    MPI_Type_free(&rec_ftype);
+
+    /* check the whole contents written by this rank */
+    start[0] = rank * NY;  start[1] = 0;
+    count[0] = NY;         count[1] = NX;
+    err = ncmpi_get_vara_int_all(ncid, fix, start, count, ibuf); CHECK_ERR
+    nerrs += check_ints("fix", NY*NX, exp_fix, ibuf, __LINE__);
+
+    err = ncmpi_get_vara_float_all(ncid, flt, start, count, fbuf); CHECK_ERR
+    for (i=0; i<NY*NX; i++) {
+        if (fbuf[i] != exp_flt[i]) {
+            printf("Error at line %d in %s: expect flt[%d]=%f but got %f\n",
+                   __LINE__,__FILE__,i,exp_flt[i],fbuf[i]);
+            nerrs++;
+            break;
+        }
+    }
+
+    start[0] = 0;      start[1] = rank * NY;  start[2] = 0;
+    count[0] = NRECS;  count[1] = NY;         count[2] = NX;
+    err = ncmpi_get_vara_int_all(ncid, rec, start, count, ibuf); CHECK_ERR
+    nerrs += check_ints("rec", NRECS*NY*NX, exp_rec, ibuf, __LINE__);
+
+    err = ncmpi_close(ncid); CHECK_ERR
+
+    /* check if PnetCDF freed all internal malloc */
+    MPI_Offset malloc_size, sum_size;
+    err = ncmpi_inq_malloc_size(&malloc_size);
+    if (err == NC_NOERR) {
+        MPI_Reduce(&malloc_size, &sum_size, 1, MPI_OFFSET, MPI_SUM, 0, MPI_COMM_WORLD);
+        if (rank == 0 && sum_size > 0)
+            printf("heap memory allocated by PnetCDF internally has %lld bytes yet to be freed\n",
+                   sum_size);
+    }
+
+    MPI_Allreduce(MPI_IN_PLACE, &nerrs, 1, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
+    if (rank == 0) {
+        if (nerrs) printf(FAIL_STR,nerrs);
+        else       printf(PASS_STR);
+    }
+
+    MPI_Finalize();
+    return (nerrs > 0);
+}
@@ -0,0 +1,203 @@
+/*
+ *  Copyright (C) 2018, Northwestern University and Argonne National Laboratory
+ *  See COPYRIGHT notice in top-level directory.
+ *
+ *  $Id$
+ */
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *
+ * This program tests deferred fill of fixed-size variables when hint
+ * nc_lazy_fill is enabled. Each process writes part of its row of a 2D
+ * variable with a blocking collective put and another part with a
+ * nonblocking put, leaving the rest of the row unwritten. A nonblocking put
+ * cancelled after being posted must not prevent its region from being
+ * filled. A scalar variable
+ * and a variable never written are also defined. The data read back before
+ * and after the file is closed must contain the written values and fill
+ * values in the regions not written.
+ *
+ * The compile and run commands are given below.
+ *
+ *    % mpicc -g -o tst_lazy_fill tst_lazy_fill.c -lpnetcdf
+ *
+ *    % mpiexec -l -n 4 ./tst_lazy_fill testfile.nc
+ *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <libgen.h> /* basename() */
+#include <mpi.h>
+#include <pnetcdf.h>
+
+#include <testutils.h>
+
+#define NX 100
+
+/* the value expected at [i][j] of variable "var" */
+static int
+expect_val(int i, int j)
+{
+    /* process i writes elements [10, 30) with a blocking put and
+     * [50, 50+i) with a nonblocking put */
+    if (10 <= j && j < 30) return i * NX + j;
+    if (50 <= j && j < 50 + i) return -(i * NX + j);
+    return NC_FILL_INT;
+}
+
+static int
+check_data(int ncid, int nprocs, const char *when)
+{
+    int i, j, err, nerrs=0, varid, *buf;
+    double dval;
+
+    buf = (int*) malloc((size_t)nprocs * NX * sizeof(int));
+
+    err = ncmpi_inq_varid(ncid, "var", &varid); CHECK_ERR
+    err = ncmpi_get_var_int_all(ncid, varid, buf); CHECK_ERR
+    for (i=0; i<nprocs; i++) {
+        for (j=0; j<NX; j++) {
+            if (buf[i*NX+j] != expect_val(i, j)) {
+                printf("Error at line %d in %s: %s var[%d][%d] expect %d but got %d\n",
+                       __LINE__,__FILE__,when,i,j,expect_val(i,j),buf[i*NX+j]);
+                nerrs++;
+                goto err_out;
+            }
+        }
+    }
+
+    err = ncmpi_inq_varid(ncid, "unwritten", &varid); CHECK_ERR
+    err = ncmpi_get_var_int_all(ncid, varid, buf); CHECK_ERR
+    for (i=0; i<nprocs*NX; i++) {
+        if (buf[i] != NC_FILL_INT) {
+            printf("Error at line %d in %s: %s unwritten[%d] expect %d but got %d\n",
+                   __LINE__,__FILE__,when,i,NC_FILL_INT,buf[i]);
+            nerrs++;
+            goto err_out;
+        }
+    }
+
+    err = ncmpi_inq_varid(ncid, "scalar", &varid); CHECK_ERR
+    err = ncmpi_get_var_double_all(ncid, varid, &dval); CHECK_ERR
+    if (dval != 1.5) {
+        printf("Error at line %d in %s: %s scalar expect 1.5 but got %f\n",
+               __LINE__,__FILE__,when,dval);
+        nerrs++;
+    }
+
+err_out:
+    free(buf);
+    return nerrs;
+}
+
+int main(int argc, char** argv) {
+    char filename[256], value[MPI_MAX_INFO_VAL];
+    int i, err, nerrs=0, rank, nprocs, ncid, dimids[2], varid, sid, uid;
+    int flag, req, buf[NX];
+    double dval=1.5;
+    MPI_Offset start[2], count[2];
+    MPI_Info info, info_used;
+
+    MPI_Init(&argc, &argv);
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &nprocs);
+
+    if (argc > 2) {
+        if (!rank) printf("Usage: %s [filename]\n",argv[0]);
+        MPI_Finalize();
+        return 1;
+    }
+    if (argc == 2) snprintf(filename, 256, "%s", argv[1]);
+    else           strcpy(filename, "testfile.nc");
+    MPI_Bcast(filename, 256, MPI_CHAR, 0, MPI_COMM_WORLD);
+
+    if (rank == 0) {
+        char *cmd_str = (char*)malloc(strlen(argv[0]) + 256);
+        sprintf(cmd_str, "*** TESTING C   %s for lazy fill ", basename(argv[0]));
+        printf("%-66s ------ ", cmd_str); fflush(stdout);
+        free(cmd_str);
+    }
+
+    MPI_Info_create(&info);
+    MPI_Info_set(info, "nc_lazy_fill", "enable");
+
+    err = ncmpi_create(MPI_COMM_WORLD, filename, NC_CLOBBER, info, &ncid);
+    CHECK_ERR
+    MPI_Info_free(&info);
+
+    err = ncmpi_inq_file_info(ncid, &info_used); CHECK_ERR
+    MPI_Info_get(info_used, "nc_lazy_fill", MPI_MAX_INFO_VAL-1, value, &flag);
+    if (!flag || strcmp(value, "enable")) {
+        printf("Error at line %d in %s: expect nc_lazy_fill enable but got %s\n",
+               __LINE__,__FILE__,(flag) ? value : "(not set)");
+        nerrs++;
+    }
+    MPI_Info_free(&info_used);
+
+    err = ncmpi_set_fill(ncid, NC_FILL, NULL); CHECK_ERR
+    err = ncmpi_def_dim(ncid, "Y", nprocs, &dimids[0]); CHECK_ERR
+    err = ncmpi_def_dim(ncid, "X", NX, &dimids[1]); CHECK_ERR
+    err = ncmpi_def_var(ncid, "var", NC_INT, 2, dimids, &varid); CHECK_ERR
+    err = ncmpi_def_var(ncid, "scalar", NC_DOUBLE, 0, NULL, &sid); CHECK_ERR
+    err = ncmpi_def_var(ncid, "unwritten", NC_INT, 2, dimids, &uid); CHECK_ERR
+    err = ncmpi_enddef(ncid); CHECK_ERR
+
+    /* blocking collective put of elements [10, 30) of row rank */
+    for (i=0; i<NX; i++) buf[i] = rank * NX + i;
+    start[0] = rank; start[1] = 10;
+    count[0] = 1;    count[1] = 20;
+    err = ncmpi_put_vara_int_all(ncid, varid, start, count, buf+10); CHECK_ERR
+
+    /* nonblocking put of elements [50, 50+rank) of row rank, none on rank 0 */
+    for (i=0; i<NX; i++) buf[i] = -(rank * NX + i);
+    start[1] = 50;
+    count[1] = rank;
+    err = ncmpi_iput_vara_int(ncid, varid, start, count, buf+50, &req);
+    CHECK_ERR
+    err = ncmpi_wait_all(ncid, 1, &req, NULL); CHECK_ERR
+
+    /* nonblocking put of elements [70, 90) of row rank, cancelled. The
+     * values are the fill value, in case a driver has already written them
+     * when the request is cancelled. */
+    for (i=0; i<NX; i++) buf[i] = NC_FILL_INT;
+    start[1] = 70;
+    count[1] = 20;
+    err = ncmpi_iput_vara_int(ncid, varid, start, count, buf+70, &req);
+    CHECK_ERR
+    err = ncmpi_cancel(ncid, 1, &req, NULL); CHECK_ERR
+
+    /* all processes write the same value to the scalar variable */
+    err = ncmpi_put_var_double_all(ncid, sid, &dval); CHECK_ERR
+
+    /* read before close triggers the deferred fill */
+    nerrs += check_data(ncid, nprocs, "before close");
+
+    err = ncmpi_close(ncid); CHECK_ERR
+
+    /* read again after reopen */
+    err = ncmpi_open(MPI_COMM_WORLD, filename, NC_NOWRITE, MPI_INFO_NULL, &ncid);
+    CHECK_ERR
+    nerrs += check_data(ncid, nprocs, "after reopen");
+    err = ncmpi_close(ncid); CHECK_ERR
+
+    /* check if PnetCDF freed all internal malloc */
+    MPI_Offset malloc_size, sum_size;
+    err = ncmpi_inq_malloc_size(&malloc_size);
+    if (err == NC_NOERR) {
+        MPI_Reduce(&malloc_size, &sum_size, 1, MPI_OFFSET, MPI_SUM, 0, MPI_COMM_WORLD);
+        if (rank == 0 && sum_size > 0)
+            printf("heap memory allocated by PnetCDF internally has %lld bytes yet to be freed\n",
+                   sum_size);
+    }
+
+    MPI_Allreduce(MPI_IN_PLACE, &nerrs, 1, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
+    if (rank == 0) {
+        if (nerrs) printf(FAIL_STR,nerrs);
+        else       printf(PASS_STR);
+    }
+
+    MPI_Finalize();
+    return (nerrs > 0);
+}
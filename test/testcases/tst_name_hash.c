@@ -0,0 +1,193 @@
+/*
+ *  Copyright (C) 2018, Northwestern University and Argonne National Laboratory
+ *  See COPYRIGHT notice in top-level directory.
+ *
+ *  $Id$
+ */
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *
+ * This program tests the name lookup tables of dimensions, variables, and
+ * attributes with names whose hash values are all the same, so they collide
+ * on a single probe chain. The names are made of pairs of characters, each
+ * of which is either "B~" or "C=". Both pairs have the same value of
+ * 65*c[0]+c[1], so all names of the same number of pairs have the same hash
+ * value with the Bernstein hash function. The names are looked up after
+ * they are defined, after some attributes are deleted in the middle of the
+ * chain, after some dimensions and variables are renamed, and after the file
+ * is reopened.
+ *
+ * The compile and run commands are given below.
+ *
+ *    % mpicc -g -o tst_name_hash tst_name_hash.c -lpnetcdf
+ *
+ *    % mpiexec -l -n 4 ./tst_name_hash testfile.nc
+ *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <libgen.h> /* basename() */
+#include <mpi.h>
+#include <pnetcdf.h>
+
+#include <testutils.h>
+
+#define NPAIRS  5              /* number of character pairs in a name */
+#define NNAMES  (1 << NPAIRS)  /* number of colliding names */
+#define NDEFS   24             /* number of names defined, more than the
+                                  initial size of a lookup table */
+#define DEL0    3              /* attributes deleted */
+#define DEL1    10
+#define RENDIM  2              /* dimension renamed to names[NDEFS] */
+#define RENVAR  5              /* variable renamed to names[NDEFS+1] */
+
+static char names[NNAMES][2*NPAIRS+2];
+
+/* Check the IDs of dimensions, variables, and global attributes looked up by
+ * names. Return the number of mismatches. */
+static int
+check_ids(int ncid, int line, int deleted)
+{
+    int i, id, err, exp, nerrs=0;
+
+    for (i=0; i<NDEFS+2; i++) {
+        /* dimension */
+        exp = (i == RENDIM || i == NDEFS+1) ? -1 : (i == NDEFS) ? RENDIM : i;
+        err = ncmpi_inq_dimid(ncid, names[i], &id);
+        if (exp < 0 && err != NC_EBADDIM) {
+            printf("Error at line %d in %s: expect NC_EBADDIM for dim %s but got %s\n",
+                   line,__FILE__,names[i],ncmpi_strerrno(err));
+            nerrs++;
+        }
+        else if (exp >= 0 && (err != NC_NOERR || id != exp)) {
+            printf("Error at line %d in %s: expect dim %s ID %d but got %d (%s)\n",
+                   line,__FILE__,names[i],exp,id,ncmpi_strerrno(err));
+            nerrs++;
+        }
+
+        /* variable */
+        exp = (i == RENVAR || i == NDEFS) ? -1 : (i == NDEFS+1) ? RENVAR : i;
+        err = ncmpi_inq_varid(ncid, names[i], &id);
+        if (exp < 0 && err != NC_ENOTVAR) {
+            printf("Error at line %d in %s: expect NC_ENOTVAR for var %s but got %s\n",
+                   line,__FILE__,names[i],ncmpi_strerrno(err));
+            nerrs++;
+        }
+        else if (exp >= 0 && (err != NC_NOERR || id != exp)) {
+            printf("Error at line %d in %s: expect var %s ID %d but got %d (%s)\n",
+                   line,__FILE__,names[i],exp,id,ncmpi_strerrno(err));
+            nerrs++;
+        }
+
+        /* global attribute, IDs after a deleted one are shifted down */
+        exp = i;
+        if (i >= NDEFS) exp = -1;
+        else if (deleted) {
+            if (i == DEL0 || i == DEL1) exp = -1;
+            else exp = i - (i > DEL0) - (i > DEL1);
+        }
+        err = ncmpi_inq_attid(ncid, NC_GLOBAL, names[i], &id);
+        if (exp < 0 && err != NC_ENOTATT) {
+            printf("Error at line %d in %s: expect NC_ENOTATT for attr %s but got %s\n",
+                   line,__FILE__,names[i],ncmpi_strerrno(err));
+            nerrs++;
+        }
+        else if (exp >= 0 && (err != NC_NOERR || id != exp)) {
+            printf("Error at line %d in %s: expect attr %s ID %d but got %d (%s)\n",
+                   line,__FILE__,names[i],exp,id,ncmpi_strerrno(err));
+            nerrs++;
+        }
+    }
+    return nerrs;
+}
+
+int main(int argc, char** argv) {
+    char filename[256];
+    int i, j, err, nerrs=0, rank, ncid, dimid, varid;
+
+    MPI_Init(&argc, &argv);
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+
+    if (argc > 2) {
+        if (!rank) printf("Usage: %s [filename]\n",argv[0]);
+        MPI_Finalize();
+        return 1;
+    }
+    if (argc == 2) snprintf(filename, 256, "%s", argv[1]);
+    else           strcpy(filename, "testfile.nc");
+    MPI_Bcast(filename, 256, MPI_CHAR, 0, MPI_COMM_WORLD);
+
+    if (rank == 0) {
+        char *cmd_str = (char*)malloc(strlen(argv[0]) + 256);
+        sprintf(cmd_str, "*** TESTING C   %s for colliding name hashes ", basename(argv[0]));
+        printf("%-66s ------ ", cmd_str); fflush(stdout);
+        free(cmd_str);
+    }
+
+    /* names[i] has pair "C=" at position j if bit j of i is set */
+    for (i=0; i<NNAMES; i++) {
+        names[i][0] = 'n';
+        for (j=0; j<NPAIRS; j++) {
+            names[i][1+2*j] = (i & (1 << j)) ? 'C' : 'B';
+            names[i][2+2*j] = (i & (1 << j)) ? '=' : '~';
+        }
+        names[i][1+2*NPAIRS] = '\0';
+    }
+
+    err = ncmpi_create(MPI_COMM_WORLD, filename, NC_CLOBBER, MPI_INFO_NULL,
+                       &ncid); CHECK_ERR
+
+    for (i=0; i<NDEFS; i++) {
+        err = ncmpi_def_dim(ncid, names[i], i+1, &dimid); CHECK_ERR
+        err = ncmpi_def_var(ncid, names[i], NC_INT, 1, &dimid, &varid);
+        CHECK_ERR
+        err = ncmpi_put_att_int(ncid, NC_GLOBAL, names[i], NC_INT, 1, &i);
+        CHECK_ERR
+    }
+
+    /* defining an existing name must fail */
+    err = ncmpi_def_dim(ncid, names[NDEFS-1], 1, &dimid);
+    EXP_ERR(NC_ENAMEINUSE)
+    err = ncmpi_def_var(ncid, names[NDEFS-1], NC_INT, 0, NULL, &varid);
+    EXP_ERR(NC_ENAMEINUSE)
+
+    /* rename to colliding names not used yet */
+    err = ncmpi_rename_dim(ncid, RENDIM, names[NDEFS]); CHECK_ERR
+    err = ncmpi_rename_var(ncid, RENVAR, names[NDEFS+1]); CHECK_ERR
+    nerrs += check_ids(ncid, __LINE__, 0);
+
+    /* delete attributes in the middle of the probe chain */
+    err = ncmpi_del_att(ncid, NC_GLOBAL, names[DEL1]); CHECK_ERR
+    err = ncmpi_del_att(ncid, NC_GLOBAL, names[DEL0]); CHECK_ERR
+    nerrs += check_ids(ncid, __LINE__, 1);
+
+    err = ncmpi_enddef(ncid); CHECK_ERR
+    err = ncmpi_close(ncid); CHECK_ERR
+
+    /* lookup tables are built from the file header */
+    err = ncmpi_open(MPI_COMM_WORLD, filename, NC_NOWRITE, MPI_INFO_NULL,
+                     &ncid); CHECK_ERR
+    nerrs += check_ids(ncid, __LINE__, 1);
+    err = ncmpi_close(ncid); CHECK_ERR
+
+    /* check if PnetCDF freed all internal malloc */
+    MPI_Offset malloc_size, sum_size;
+    err = ncmpi_inq_malloc_size(&malloc_size);
+    if (err == NC_NOERR) {
+        MPI_Reduce(&malloc_size, &sum_size, 1, MPI_OFFSET, MPI_SUM, 0, MPI_COMM_WORLD);
+        if (rank == 0 && sum_size > 0)
+            printf("heap memory allocated by PnetCDF internally has %lld bytes yet to be freed\n",
+                   sum_size);
+    }
+
+    MPI_Allreduce(MPI_IN_PLACE, &nerrs, 1, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
+    if (rank == 0) {
+        if (nerrs) printf(FAIL_STR,nerrs);
+        else       printf(PASS_STR);
+    }
+
+    MPI_Finalize();
+    return (nerrs > 0);
+}
@@ -0,0 +1,237 @@
+/*
+ *  Copyright (C) 2018, Northwestern University and Argonne National Laboratory
+ *  See COPYRIGHT notice in top-level directory.
+ *
+ *  $Id$
+ */
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *
+ * This program tests persistent requests created by ncmpi_put_vara_init() and
+ * ncmpi_get_vara_init(). Each process writes a noncontiguous subarray of a
+ * record variable, one record at a time, by starting the same request with a
+ * different record number, in both collective and independent data modes. A
+ * fixed-size variable is written from a buffer of a different type, so the
+ * data is converted. The header is grown in redef between the starts, so the
+ * variables are moved. The data is read back by persistent get requests and
+ * checked.
+ *
+ * The compile and run commands are given below.
+ *
+ *    % mpicc -g -o tst_persist_plan tst_persist_plan.c -lpnetcdf
+ *
+ *    % mpiexec -l -n 4 ./tst_persist_plan testfile.nc
+ *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <libgen.h> /* basename() */
+#include <mpi.h>
+#include <pnetcdf.h>
+
+#include <testutils.h>
+
+#define NY 2
+#define NX 10
+#define NREC 4
+
+/* the value expected at [r][y][x] of variable "rec" */
+#define REC_VAL(r, y, x) ((r) * 10000 + (y) * 100 + (x))
+
+static int
+check_data(int ncid, int rank, int nprocs, const char *when)
+{
+    int i, j, r, err, nerrs=0, varid, req[2], buf[NY][NX/2];
+    double *dbuf;
+    MPI_Offset start[3], count[3];
+
+    /* each process reads back its subarray of all records */
+    err = ncmpi_inq_varid(ncid, "rec", &varid); CHECK_ERR
+    start[0] = 0;  start[1] = rank * NY; start[2] = NX / 2;
+    count[0] = 1;  count[1] = NY;        count[2] = NX / 2;
+    err = ncmpi_get_vara_init(ncid, varid, start, count, buf, NY*NX/2,
+                              MPI_INT, &req[0]); CHECK_ERR
+
+    for (r=0; r<NREC+2; r++) {
+        memset(buf, 0, sizeof(buf));
+        err = ncmpi_start_all(ncid, req[0], r); CHECK_ERR
+        for (i=0; i<NY; i++) {
+            for (j=0; j<NX/2; j++) {
+                int expect = REC_VAL(r, rank*NY+i, NX/2+j);
+                if (buf[i][j] != expect) {
+                    printf("Error at line %d in %s: %s rec[%d][%d][%d] expect %d but got %d\n",
+                           __LINE__,__FILE__,when,r,rank*NY+i,NX/2+j,expect,
+                           buf[i][j]);
+                    nerrs++;
+                    break;
+                }
+            }
+            /* keep calling the collective ncmpi_start_all on mismatch */
+            if (j < NX/2) break;
+        }
+    }
+
+    /* reading beyond the number of records is an error */
+    err = ncmpi_start_all(ncid, req[0], NREC+2);
+    EXP_ERR(NC_EINVALCOORDS)
+
+    /* the last process reads the fixed-size variable, the others nothing */
+    dbuf = (double*) malloc((size_t)nprocs * NX * sizeof(double));
+    err = ncmpi_inq_varid(ncid, "fix", &varid); CHECK_ERR
+    start[0] = 0;  start[1] = 0;
+    count[0] = 0;  count[1] = 0;
+    if (rank == nprocs - 1) {
+        count[0] = nprocs;
+        count[1] = NX;
+    }
+    err = ncmpi_get_vara_init(ncid, varid, start, count, dbuf,
+                              count[0]*count[1], MPI_DOUBLE, &req[1]);
+    CHECK_ERR
+    err = ncmpi_start_all(ncid, req[1], -1); CHECK_ERR
+    if (rank == nprocs - 1) {
+        for (i=0; i<nprocs*NX; i++) {
+            if (dbuf[i] != i + 0.5) {
+                printf("Error at line %d in %s: %s fix[%d] expect %f but got %f\n",
+                       __LINE__,__FILE__,when,i,i+0.5,dbuf[i]);
+                nerrs++;
+                break;
+            }
+        }
+    }
+    free(dbuf);
+    err = ncmpi_request_free(ncid, req[1]); CHECK_ERR
+    err = ncmpi_request_free(ncid, req[0]); CHECK_ERR
+    return nerrs;
+}
+
+int main(int argc, char** argv) {
+    char filename[256], str[1024];
+    int i, j, r, err, nerrs=0, rank, nprocs, ncid, dimids[3], varid[2];
+    int req[2], buf[NY][NX/2];
+    float fbuf[NX];
+    MPI_Offset start[3], count[3];
+    MPI_Info info;
+
+    MPI_Init(&argc, &argv);
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &nprocs);
+
+    if (argc > 2) {
+        if (!rank) printf("Usage: %s [filename]\n",argv[0]);
+        MPI_Finalize();
+        return 1;
+    }
+    if (argc == 2) snprintf(filename, 256, "%s", argv[1]);
+    else           strcpy(filename, "testfile.nc");
+    MPI_Bcast(filename, 256, MPI_CHAR, 0, MPI_COMM_WORLD);
+
+    if (rank == 0) {
+        char *cmd_str = (char*)malloc(strlen(argv[0]) + 256);
+        sprintf(cmd_str, "*** TESTING C   %s for persistent requests ", basename(argv[0]));
+        printf("%-66s ------ ", cmd_str); fflush(stdout);
+        free(cmd_str);
+    }
+
+    /* no extra space for the header, so it grows in redef */
+    MPI_Info_create(&info);
+    MPI_Info_set(info, "nc_header_align_size", "1");
+    MPI_Info_set(info, "nc_var_align_size", "1");
+
+    err = ncmpi_create(MPI_COMM_WORLD, filename, NC_CLOBBER, info, &ncid);
+    CHECK_ERR
+    MPI_Info_free(&info);
+
+    err = ncmpi_def_dim(ncid, "REC", NC_UNLIMITED, &dimids[0]); CHECK_ERR
+    err = ncmpi_def_dim(ncid, "Y", nprocs * NY, &dimids[1]); CHECK_ERR
+    err = ncmpi_def_dim(ncid, "X", NX, &dimids[2]); CHECK_ERR
+    err = ncmpi_def_var(ncid, "rec", NC_INT, 3, dimids, &varid[0]); CHECK_ERR
+    err = ncmpi_def_dim(ncid, "P", nprocs, &dimids[1]); CHECK_ERR
+    err = ncmpi_def_var(ncid, "fix", NC_DOUBLE, 2, dimids+1, &varid[1]);
+    CHECK_ERR
+
+    /* persistent requests cannot be created in define mode */
+    start[0] = 0;  start[1] = 0;  start[2] = 0;
+    count[0] = 1;  count[1] = 1;  count[2] = 1;
+    err = ncmpi_put_vara_init(ncid, varid[0], start, count, buf, 1,
+                              MPI_INT, &req[0]);
+    EXP_ERR(NC_EINDEFINE)
+    err = ncmpi_enddef(ncid); CHECK_ERR
+
+    /* each process writes the second half of its NY rows, not contiguous
+     * in file */
+    start[0] = 0;  start[1] = rank * NY; start[2] = NX / 2;
+    count[0] = 1;  count[1] = NY;        count[2] = NX / 2;
+    err = ncmpi_put_vara_init(ncid, varid[0], start, count, buf, NY*NX/2,
+                              MPI_INT, &req[0]); CHECK_ERR
+
+    /* write a float buffer to a double variable, one row per process */
+    for (i=0; i<NX; i++) fbuf[i] = rank * NX + i + 0.5;
+    start[0] = rank; start[1] = 0;
+    count[0] = 1;    count[1] = NX;
+    err = ncmpi_put_vara_init(ncid, varid[1], start, count, fbuf, NX,
+                              MPI_FLOAT, &req[1]); CHECK_ERR
+    err = ncmpi_start_all(ncid, req[1], -1); CHECK_ERR
+
+    /* write records 0 .. NREC-1 in collective data mode */
+    for (r=0; r<NREC; r++) {
+        for (i=0; i<NY; i++)
+            for (j=0; j<NX/2; j++)
+                buf[i][j] = REC_VAL(r, rank*NY+i, NX/2+j);
+        err = ncmpi_start_all(ncid, req[0], r); CHECK_ERR
+    }
+
+    /* write record NREC in independent data mode */
+    err = ncmpi_begin_indep_data(ncid); CHECK_ERR
+    for (i=0; i<NY; i++)
+        for (j=0; j<NX/2; j++)
+            buf[i][j] = REC_VAL(NREC, rank*NY+i, NX/2+j);
+    err = ncmpi_start(ncid, req[0], NREC); CHECK_ERR
+    err = ncmpi_end_indep_data(ncid); CHECK_ERR
+
+    /* grow the header, so the variables are moved */
+    err = ncmpi_redef(ncid); CHECK_ERR
+    memset(str, 'a', 1000);
+    str[1000] = '\0';
+    err = ncmpi_put_att_text(ncid, NC_GLOBAL, "grow", 1000, str); CHECK_ERR
+    err = ncmpi_enddef(ncid); CHECK_ERR
+
+    /* write record NREC+1 after the variables are moved */
+    for (i=0; i<NY; i++)
+        for (j=0; j<NX/2; j++)
+            buf[i][j] = REC_VAL(NREC+1, rank*NY+i, NX/2+j);
+    err = ncmpi_start_all(ncid, req[0], NREC+1); CHECK_ERR
+
+    err = ncmpi_request_free(ncid, req[0]); CHECK_ERR
+    err = ncmpi_request_free(ncid, req[1]); CHECK_ERR
+    err = ncmpi_start_all(ncid, req[0], 0);
+    EXP_ERR(NC_EINVAL_REQUEST)
+
+    nerrs += check_data(ncid, rank, nprocs, "before close");
+    err = ncmpi_close(ncid); CHECK_ERR
+
+    err = ncmpi_open(MPI_COMM_WORLD, filename, NC_NOWRITE, MPI_INFO_NULL,
+                     &ncid); CHECK_ERR
+    nerrs += check_data(ncid, rank, nprocs, "after reopen");
+    err = ncmpi_close(ncid); CHECK_ERR
+
+    /* check if PnetCDF freed all internal malloc */
+    MPI_Offset malloc_size, sum_size;
+    err = ncmpi_inq_malloc_size(&malloc_size);
+    if (err == NC_NOERR) {
+        MPI_Reduce(&malloc_size, &sum_size, 1, MPI_OFFSET, MPI_SUM, 0, MPI_COMM_WORLD);
+        if (rank == 0 && sum_size > 0)
+            printf("heap memory allocated by PnetCDF internally has %lld bytes yet to be freed\n",
+                   sum_size);
+    }
+
+    MPI_Allreduce(MPI_IN_PLACE, &nerrs, 1, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
+    if (rank == 0) {
+        if (nerrs) printf(FAIL_STR,nerrs);
+        else       printf(PASS_STR);
+    }
+
+    MPI_Finalize();
+    return (nerrs > 0);
+}
@@ -0,0 +1,175 @@
+/*
+ *  Copyright (C) 2018, Northwestern University and Argonne National Laboratory
+ *  See COPYRIGHT notice in top-level directory.
+ *
+ *  $Id$
+ */
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *
+ * This program tests blocking put requests that need type conversion, when
+ * hint nc_put_stream_size is set so they are converted and written in chunks.
+ * The request sizes differ among processes, so the numbers of chunks differ
+ * and one process writes nothing in collective mode. Requests are made in
+ * collective and independent modes, to fixed-size and record variables, and
+ * with a stride. The data read back is checked.
+ *
+ * The compile and run commands are given below.
+ *
+ *    % mpicc -g -o tst_put_stream tst_put_stream.c -lpnetcdf
+ *
+ *    % mpiexec -l -n 4 ./tst_put_stream testfile.nc
+ *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <libgen.h> /* basename() */
+#include <mpi.h>
+#include <pnetcdf.h>
+
+#include <testutils.h>
+
+#define NX 1000
+#define STREAM_SIZE "256"
+
+static int
+check_data(int ncid, int varid, int nprocs, const char *name)
+{
+    int i, j, err, nerrs=0;
+    MPI_Offset start[2], count[2];
+    double *rbuf;
+
+    rbuf = (double*) malloc(NX * sizeof(double));
+    for (i=1; i<nprocs; i++) {
+        /* process i writes the first (i*NX/nprocs) elements of row i */
+        start[0] = i;  start[1] = 0;
+        count[0] = 1;  count[1] = i * NX / nprocs;
+        if (count[1] == 0) continue;
+        err = ncmpi_get_vara_double_all(ncid, varid, start, count, rbuf);
+        CHECK_ERR
+
+        for (j=0; j<count[1]; j++) {
+            double expect = i * NX + j;
+            if (rbuf[j] != expect) {
+                printf("Error at line %d in %s: var %s [%d][%d] expect %f but got %f\n",
+                       __LINE__,__FILE__,name,i,j,expect,rbuf[j]);
+                nerrs++;
+                break;
+            }
+        }
+    }
+    free(rbuf);
+    return nerrs;
+}
+
+int main(int argc, char** argv) {
+    char filename[256], value[MPI_MAX_INFO_VAL];
+    int i, err, nerrs=0, rank, nprocs, ncid, dimids[2], fix_id, rec_id, str_id;
+    int flag;
+    double *buf;
+    MPI_Offset start[2], count[2], stride[2];
+    MPI_Info info, info_used;
+
+    MPI_Init(&argc, &argv);
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &nprocs);
+
+    if (argc > 2) {
+        if (!rank) printf("Usage: %s [filename]\n",argv[0]);
+        MPI_Finalize();
+        return 1;
+    }
+    if (argc == 2) snprintf(filename, 256, "%s", argv[1]);
+    else           strcpy(filename, "testfile.nc");
+    MPI_Bcast(filename, 256, MPI_CHAR, 0, MPI_COMM_WORLD);
+
+    if (rank == 0) {
+        char *cmd_str = (char*)malloc(strlen(argv[0]) + 256);
+        sprintf(cmd_str, "*** TESTING C   %s for streaming type conversion ", basename(argv[0]));
+        printf("%-66s ------ ", cmd_str); fflush(stdout);
+        free(cmd_str);
+    }
+
+    MPI_Info_create(&info);
+    MPI_Info_set(info, "nc_put_stream_size", STREAM_SIZE);
+
+    err = ncmpi_create(MPI_COMM_WORLD, filename, NC_CLOBBER, info, &ncid);
+    CHECK_ERR
+    MPI_Info_free(&info);
+
+    err = ncmpi_inq_file_info(ncid, &info_used); CHECK_ERR
+    MPI_Info_get(info_used, "nc_put_stream_size", MPI_MAX_INFO_VAL-1, value,
+                 &flag);
+    if (!flag || strcmp(value, STREAM_SIZE)) {
+        printf("Error at line %d in %s: expect nc_put_stream_size %s but got %s\n",
+               __LINE__,__FILE__,STREAM_SIZE,(flag) ? value : "(not set)");
+        nerrs++;
+    }
+    MPI_Info_free(&info_used);
+
+    err = ncmpi_def_dim(ncid, "REC", NC_UNLIMITED, &dimids[0]); CHECK_ERR
+    err = ncmpi_def_dim(ncid, "X", NX, &dimids[1]); CHECK_ERR
+    err = ncmpi_def_var(ncid, "rec", NC_FLOAT, 2, dimids, &rec_id); CHECK_ERR
+    err = ncmpi_def_dim(ncid, "Y", nprocs, &dimids[0]); CHECK_ERR
+    err = ncmpi_def_var(ncid, "fix", NC_FLOAT, 2, dimids, &fix_id); CHECK_ERR
+    err = ncmpi_def_var(ncid, "str", NC_FLOAT, 2, dimids, &str_id); CHECK_ERR
+    err = ncmpi_enddef(ncid); CHECK_ERR
+
+    /* each process writes a different number of elements, rank 0 none */
+    buf = (double*) malloc(NX * sizeof(double));
+    for (i=0; i<NX; i++) buf[i] = rank * NX + i;
+
+    start[0] = rank; start[1] = 0;
+    count[0] = 1;    count[1] = rank * NX / nprocs;
+
+    /* collective puts, fixed-size and record variables */
+    err = ncmpi_put_vara_double_all(ncid, fix_id, start, count, buf); CHECK_ERR
+    err = ncmpi_put_vara_double_all(ncid, rec_id, start, count, buf); CHECK_ERR
+
+    /* independent puts with a stride, the first writes the even elements of
+     * the row and the second the odd ones */
+    err = ncmpi_begin_indep_data(ncid); CHECK_ERR
+    stride[0] = 1; stride[1] = 2;
+    count[1] = (rank * NX / nprocs + 1) / 2;
+    for (i=0; i<count[1]; i++) buf[i] = rank * NX + 2 * i;
+    if (count[1] > 0) {
+        err = ncmpi_put_vars_double(ncid, str_id, start, count, stride, buf);
+        CHECK_ERR
+    }
+    start[1] = 1;
+    count[1] = rank * NX / nprocs / 2;
+    for (i=0; i<count[1]; i++) buf[i] = rank * NX + 2 * i + 1;
+    if (count[1] > 0) {
+        err = ncmpi_put_vars_double(ncid, str_id, start, count, stride, buf);
+        CHECK_ERR
+    }
+    err = ncmpi_end_indep_data(ncid); CHECK_ERR
+
+    nerrs += check_data(ncid, fix_id, nprocs, "fix");
+    nerrs += check_data(ncid, rec_id, nprocs, "rec");
+    nerrs += check_data(ncid, str_id, nprocs, "str");
+
+    err = ncmpi_close(ncid); CHECK_ERR
+    free(buf);
+
+    /* check if PnetCDF freed all internal malloc */
+    MPI_Offset malloc_size, sum_size;
+    err = ncmpi_inq_malloc_size(&malloc_size);
+    if (err == NC_NOERR) {
+        MPI_Reduce(&malloc_size, &sum_size, 1, MPI_OFFSET, MPI_SUM, 0, MPI_COMM_WORLD);
+        if (rank == 0 && sum_size > 0)
+            printf("heap memory allocated by PnetCDF internally has %lld bytes yet to be freed\n",
+                   sum_size);
+    }
+
+    MPI_Allreduce(MPI_IN_PLACE, &nerrs, 1, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
+    if (rank == 0) {
+        if (nerrs) printf(FAIL_STR,nerrs);
+        else       printf(PASS_STR);
+    }
+
+    MPI_Finalize();
+    return (nerrs > 0);
+}
@@ -0,0 +1,203 @@
+/*
+ *  Copyright (C) 2018, Northwestern University and Argonne National Laboratory
+ *  See COPYRIGHT notice in top-level directory.
+ *
+ *  $Id$
+ */
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *
+ * This program tests moving the data part of a file when the header grows in
+ * redef. Hint nc_data_move_chunk_size is set small, so the data is moved in
+ * many rounds, and the header grows by less than the size moved in a round,
+ * so the source and destination of each round overlap. After new attributes
+ * and variables are added, the data of both fixed-size and record variables
+ * read back are checked.
+ *
+ * The compile and run commands are given below.
+ *
+ *    % mpicc -g -o tst_redef_move tst_redef_move.c -lpnetcdf
+ *
+ *    % mpiexec -l -n 4 ./tst_redef_move testfile.nc
+ *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <libgen.h> /* basename() */
+#include <mpi.h>
+#include <pnetcdf.h>
+
+#include <testutils.h>
+
+#define NY 6
+#define NX 1000
+#define NREC 3
+#define CHUNK_SIZE "512"
+
+static int
+check_data(int ncid, const char *when)
+{
+    int i, j, err, nerrs=0, varid, *buf;
+    MPI_Offset start[3], count[3];
+
+    buf = (int*) malloc(NREC * NY * NX * sizeof(int));
+
+    for (i=0; i<2; i++) {
+        char name[16];
+        sprintf(name, "fix%d", i);
+        err = ncmpi_inq_varid(ncid, name, &varid); CHECK_ERR
+        err = ncmpi_get_var_int_all(ncid, varid, buf); CHECK_ERR
+        for (j=0; j<NY*NX; j++) {
+            if (buf[j] != i * NY * NX + j) {
+                printf("Error at line %d in %s: %s %s[%d] expect %d but got %d\n",
+                       __LINE__,__FILE__,when,name,j,i*NY*NX+j,buf[j]);
+                nerrs++;
+                break;
+            }
+        }
+    }
+
+    err = ncmpi_inq_varid(ncid, "rec", &varid); CHECK_ERR
+    start[0] = 0; start[1] = 0; start[2] = 0;
+    count[0] = NREC; count[1] = NY; count[2] = NX;
+    err = ncmpi_get_vara_int_all(ncid, varid, start, count, buf); CHECK_ERR
+    for (j=0; j<NREC*NY*NX; j++) {
+        if (buf[j] != -j) {
+            printf("Error at line %d in %s: %s rec[%d] expect %d but got %d\n",
+                   __LINE__,__FILE__,when,j,-j,buf[j]);
+            nerrs++;
+            break;
+        }
+    }
+    free(buf);
+    return nerrs;
+}
+
+int main(int argc, char** argv) {
+    char filename[256], value[MPI_MAX_INFO_VAL], str[1024];
+    int i, err, nerrs=0, rank, nprocs, ncid, dimids[3], varid[3], flag, *buf;
+    MPI_Offset start[3], count[3], hsize[2];
+    MPI_Info info, info_used;
+
+    MPI_Init(&argc, &argv);
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &nprocs);
+
+    if (argc > 2) {
+        if (!rank) printf("Usage: %s [filename]\n",argv[0]);
+        MPI_Finalize();
+        return 1;
+    }
+    if (argc == 2) snprintf(filename, 256, "%s", argv[1]);
+    else           strcpy(filename, "testfile.nc");
+    MPI_Bcast(filename, 256, MPI_CHAR, 0, MPI_COMM_WORLD);
+
+    if (rank == 0) {
+        char *cmd_str = (char*)malloc(strlen(argv[0]) + 256);
+        sprintf(cmd_str, "*** TESTING C   %s for moving data in redef ", basename(argv[0]));
+        printf("%-66s ------ ", cmd_str); fflush(stdout);
+        free(cmd_str);
+    }
+
+    MPI_Info_create(&info);
+    MPI_Info_set(info, "nc_data_move_chunk_size", CHUNK_SIZE);
+    /* no extra space for the header, so it grows in redef */
+    MPI_Info_set(info, "nc_header_align_size", "1");
+    MPI_Info_set(info, "nc_var_align_size", "1");
+
+    err = ncmpi_create(MPI_COMM_WORLD, filename, NC_CLOBBER, info, &ncid);
+    CHECK_ERR
+
+    err = ncmpi_inq_file_info(ncid, &info_used); CHECK_ERR
+    MPI_Info_get(info_used, "nc_data_move_chunk_size", MPI_MAX_INFO_VAL-1,
+                 value, &flag);
+    if (!flag || strcmp(value, CHUNK_SIZE)) {
+        printf("Error at line %d in %s: expect nc_data_move_chunk_size %s but got %s\n",
+               __LINE__,__FILE__,CHUNK_SIZE,(flag) ? value : "(not set)");
+        nerrs++;
+    }
+    MPI_Info_free(&info_used);
+
+    err = ncmpi_def_dim(ncid, "REC", NC_UNLIMITED, &dimids[0]); CHECK_ERR
+    err = ncmpi_def_dim(ncid, "Y", NY, &dimids[1]); CHECK_ERR
+    err = ncmpi_def_dim(ncid, "X", NX, &dimids[2]); CHECK_ERR
+    err = ncmpi_def_var(ncid, "fix0", NC_INT, 2, dimids+1, &varid[0]); CHECK_ERR
+    err = ncmpi_def_var(ncid, "rec", NC_INT, 3, dimids, &varid[2]); CHECK_ERR
+    err = ncmpi_def_var(ncid, "fix1", NC_INT, 2, dimids+1, &varid[1]); CHECK_ERR
+    err = ncmpi_enddef(ncid); CHECK_ERR
+
+    /* process 0 writes all data, so the others have nothing to write */
+    buf = (int*) malloc(NREC * NY * NX * sizeof(int));
+    start[0] = 0; start[1] = 0; start[2] = 0;
+    count[0] = count[1] = count[2] = 0;
+    if (rank == 0) {
+        count[0] = NREC; count[1] = NY; count[2] = NX;
+    }
+    for (i=0; i<2; i++) {
+        int j;
+        for (j=0; j<NY*NX; j++) buf[j] = i * NY * NX + j;
+        err = ncmpi_put_vara_int_all(ncid, varid[i], start+1, count+1, buf);
+        CHECK_ERR
+    }
+    for (i=0; i<NREC*NY*NX; i++) buf[i] = -i;
+    err = ncmpi_put_vara_int_all(ncid, varid[2], start, count, buf); CHECK_ERR
+    free(buf);
+
+    err = ncmpi_inq_header_size(ncid, &hsize[0]); CHECK_ERR
+
+    /* grow the header by a few hundred bytes, less than the amount moved
+     * in each round, so source and destination of rounds overlap */
+    err = ncmpi_redef(ncid); CHECK_ERR
+    memset(str, 'a', 300);
+    str[300] = '\0';
+    err = ncmpi_put_att_text(ncid, NC_GLOBAL, "grow", 300, str); CHECK_ERR
+    err = ncmpi_enddef(ncid); CHECK_ERR
+
+    err = ncmpi_inq_header_size(ncid, &hsize[1]); CHECK_ERR
+    if (hsize[1] <= hsize[0]) {
+        printf("Error at line %d in %s: header size expected to grow from %lld but got %lld\n",
+               __LINE__,__FILE__,hsize[0],hsize[1]);
+        nerrs++;
+    }
+    nerrs += check_data(ncid, "after 1st redef");
+
+    /* grow the header again, a lot more, and add a fixed-size variable */
+    err = ncmpi_redef(ncid); CHECK_ERR
+    for (i=0; i<20; i++) {
+        char name[16];
+        sprintf(name, "att%d", i);
+        err = ncmpi_put_att_text(ncid, NC_GLOBAL, name, 1000, str); CHECK_ERR
+    }
+    err = ncmpi_def_var(ncid, "new", NC_INT, 2, dimids+1, &varid[0]); CHECK_ERR
+    err = ncmpi_enddef(ncid); CHECK_ERR
+    nerrs += check_data(ncid, "after 2nd redef");
+
+    err = ncmpi_close(ncid); CHECK_ERR
+
+    err = ncmpi_open(MPI_COMM_WORLD, filename, NC_NOWRITE, info, &ncid);
+    CHECK_ERR
+    nerrs += check_data(ncid, "after reopen");
+    err = ncmpi_close(ncid); CHECK_ERR
+    MPI_Info_free(&info);
+
+    /* check if PnetCDF freed all internal malloc */
+    MPI_Offset malloc_size, sum_size;
+    err = ncmpi_inq_malloc_size(&malloc_size);
+    if (err == NC_NOERR) {
+        MPI_Reduce(&malloc_size, &sum_size, 1, MPI_OFFSET, MPI_SUM, 0, MPI_COMM_WORLD);
+        if (rank == 0 && sum_size > 0)
+            printf("heap memory allocated by PnetCDF internally has %lld bytes yet to be freed\n",
+                   sum_size);
+    }
+
+    MPI_Allreduce(MPI_IN_PLACE, &nerrs, 1, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
+    if (rank == 0) {
+        if (nerrs) printf(FAIL_STR,nerrs);
+        else       printf(PASS_STR);
+    }
+
+    MPI_Finalize();
+    return (nerrs > 0);
+}
@@ -0,0 +1,291 @@
+/*
+ *  Copyright (C) 2018, Northwestern University and Argonne National Laboratory
+ *  See COPYRIGHT notice in top-level directory.
+ *
+ *  $Id$
+ */
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *
+ * This program tests the lookup of pending nonblocking requests by their IDs.
+ * A large number of small requests are posted, including ones to more than
+ * one record and ones from varn APIs, which share the same ID with others.
+ * Some are cancelled and the rest are waited in an order different from the
+ * one they were posted in. The contents of the file are checked at the end.
+ *
+ * The compile and run commands are given below.
+ *
+ *    % mpicc -g -o tst_req_lookup tst_req_lookup.c -lpnetcdf
+ *
+ *    % mpiexec -l -n 4 ./tst_req_lookup testfile.nc
+ *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h> /* strcasecmp() */
+#include <libgen.h> /* basename() */
+#include <mpi.h>
+#include <pnetcdf.h>
+
+#include <testutils.h>
+
+#define NREQS  1000 /* number of requests to variable fix */
+#define NRECS  8    /* number of records, written 2 per request */
+#define NVARN  100  /* number of varn requests to variable vn */
+#define NX     4
+#define NBATCH 100  /* number of requests waited at a time */
+
+/* index in reqs[] of the request to fix posted i-th */
+#define FIX_INDEX(i) ((i) + ((i) < NRECS / 2 ? (i) : NRECS / 2) \
+                          + ((i) < NVARN ? (i) : NVARN))
+
+/* requests to fix posted after all record and varn ones */
+#define FIX_ONLY (NVARN * 2 + NRECS / 2)
+
+int main(int argc, char** argv) {
+    char filename[256];
+    int i, j, k, err, nerrs=0, rank, nprocs, ncid, dimids[3], fix, rec, vn;
+    int dw_enabled=0, cancelled, nreqs, nposted, *reqs, *wait_reqs, *sts;
+    int *buf, *ibuf;
+    int recbuf[2][NX];
+    MPI_Offset start[2], count[2], **starts, **counts;
+
+    MPI_Init(&argc, &argv);
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &nprocs);
+
+    if (argc > 2) {
+        if (!rank) printf("Usage: %s [filename]\n",argv[0]);
+        MPI_Finalize();
+        return 1;
+    }
+    if (argc == 2) snprintf(filename, 256, "%s", argv[1]);
+    else           strcpy(filename, "testfile.nc");
+    MPI_Bcast(filename, 256, MPI_CHAR, 0, MPI_COMM_WORLD);
+
+    if (rank == 0) {
+        char *cmd_str = (char*)malloc(strlen(argv[0]) + 256);
+        sprintf(cmd_str, "*** TESTING C   %s for request lookup by ID ", basename(argv[0]));
+        printf("%-66s ------ ", cmd_str); fflush(stdout);
+        free(cmd_str);
+    }
+
+    err = ncmpi_create(MPI_COMM_WORLD, filename, NC_CLOBBER, MPI_INFO_NULL,
+                       &ncid); CHECK_ERR
+
+#ifdef BUILD_DRIVER_DW
+    {
+        /* the DataWarp driver flushes its log only on processes with pending
+         * puts, so all processes keep their requests */
+        char value[MPI_MAX_INFO_VAL];
+        int flag;
+        MPI_Info info_used;
+        err = ncmpi_inq_file_info(ncid, &info_used); CHECK_ERR
+        MPI_Info_get(info_used, "nc_dw", MPI_MAX_INFO_VAL-1, value, &flag);
+        if (flag && strcasecmp(value, "enable") == 0)
+            dw_enabled = 1;
+        MPI_Info_free(&info_used);
+    }
+#endif
+
+    err = ncmpi_def_dim(ncid, "time", NC_UNLIMITED, &dimids[0]); CHECK_ERR
+    err = ncmpi_def_dim(ncid, "Y", (MPI_Offset)nprocs * NREQS, &dimids[1]);
+    CHECK_ERR
+    err = ncmpi_def_dim(ncid, "X", (MPI_Offset)nprocs * NX, &dimids[2]);
+    CHECK_ERR
+    err = ncmpi_def_var(ncid, "fix", NC_INT, 1, &dimids[1], &fix); CHECK_ERR
+    err = ncmpi_def_var(ncid, "vn", NC_INT, 1, &dimids[1], &vn); CHECK_ERR
+    dimids[1] = dimids[2];
+    err = ncmpi_def_var(ncid, "rec", NC_INT, 2, dimids, &rec); CHECK_ERR
+    /* fill fix, so the cancelled requests leave fill values behind */
+    err = ncmpi_def_var_fill(ncid, fix, 0, NULL); CHECK_ERR
+    err = ncmpi_enddef(ncid); CHECK_ERR
+
+    nreqs     = NREQS + NRECS / 2 + NVARN;
+    reqs      = (int*) malloc(sizeof(int) * nreqs * 2);
+    wait_reqs = reqs + nreqs;
+    sts       = (int*) malloc(sizeof(int) * nreqs);
+    buf       = (int*) malloc(sizeof(int) * NREQS);
+    ibuf      = (int*) malloc(sizeof(int) * NVARN * 2);
+    starts    = (MPI_Offset**) malloc(sizeof(MPI_Offset*) * NVARN * 2);
+    counts    = (MPI_Offset**) malloc(sizeof(MPI_Offset*) * NVARN * 2);
+    starts[0] = (MPI_Offset*) malloc(sizeof(MPI_Offset) * NVARN * 4);
+    counts[0] = starts[0] + NVARN * 2;
+    for (i=1; i<NVARN*2; i++) {
+        starts[i] = starts[i-1] + 1;
+        counts[i] = counts[i-1] + 1;
+    }
+
+    for (i=0; i<NREQS; i++) buf[i] = rank * NREQS + i;
+    for (i=0; i<NVARN*2; i++) ibuf[i] = -(rank * NREQS + i);
+    for (i=0; i<2; i++)
+        for (j=0; j<NX; j++) recbuf[i][j] = rank * NX + j + i * 1000;
+
+    /* interleave requests of one element, requests of 2 records, and varn
+     * requests of 2 elements */
+    nposted = 0;
+    for (i=0; i<NREQS; i++) {
+        start[0] = (MPI_Offset)rank * NREQS + i;
+        err = ncmpi_iput_var1_int(ncid, fix, start, &buf[i], &reqs[nposted++]);
+        CHECK_ERR
+        if (i < NRECS / 2) {
+            start[0] = i * 2; start[1] = rank * NX;
+            count[0] = 2;     count[1] = NX;
+            err = ncmpi_iput_vara_int(ncid, rec, start, count, recbuf[0],
+                                      &reqs[nposted++]); CHECK_ERR
+        }
+        if (i < NVARN) {
+            for (j=0; j<2; j++) {
+                starts[i*2+j][0] = (MPI_Offset)rank * NREQS + i * 2 + j;
+                counts[i*2+j][0] = 1;
+            }
+            err = ncmpi_iput_varn_int(ncid, vn, 2, starts + i*2, counts + i*2,
+                                      ibuf + i*2, &reqs[nposted++]); CHECK_ERR
+        }
+    }
+    if (nposted != nreqs) {
+        printf("Error at line %d in %s: expect %d requests but got %d\n",
+               __LINE__,__FILE__,nreqs,nposted);
+        nerrs++;
+    }
+
+    /* cancel every 7th request, except the varn and record ones */
+    k = 0;
+    if (!dw_enabled) {
+        for (i=0; i<nreqs; i+=7) {
+            if (i >= FIX_ONLY) wait_reqs[k++] = reqs[i];
+        }
+        /* ncmpi_cancel sets the IDs in wait_reqs[] to NC_REQ_NULL */
+        cancelled = wait_reqs[0];
+        err = ncmpi_cancel(ncid, k, wait_reqs, sts); CHECK_ERR
+        for (i=0; i<k; i++) {
+            if (sts[i] != NC_NOERR) {
+                printf("Error at line %d in %s: cancel status[%d] = %d\n",
+                       __LINE__,__FILE__,i,sts[i]);
+                nerrs++;
+                break;
+            }
+        }
+        /* a request cannot be cancelled twice */
+        err = ncmpi_cancel(ncid, 1, &cancelled, sts);
+        EXP_ERR(NC_EINVAL_REQUEST)
+    }
+    err = ncmpi_inq_nreqs(ncid, &i); CHECK_ERR
+    if (i != nreqs - k) {
+        printf("Error at line %d in %s: expect %d pending requests but got %d\n",
+               __LINE__,__FILE__,nreqs - k,i);
+        nerrs++;
+    }
+
+    /* wait the rest from the last one posted, NBATCH at a time */
+    k = 0;
+    for (i=nreqs-1; i>=0; i--) {
+        if (!dw_enabled && i % 7 == 0 && i >= FIX_ONLY) continue;
+        wait_reqs[k++] = reqs[i];
+        if (k == NBATCH || i == 0) {
+            err = ncmpi_wait_all(ncid, k, wait_reqs, sts); CHECK_ERR
+            for (j=0; j<k; j++) {
+                if (sts[j] != NC_NOERR) {
+                    printf("Error at line %d in %s: wait status[%d] = %d\n",
+                           __LINE__,__FILE__,j,sts[j]);
+                    nerrs++;
+                    break;
+                }
+            }
+            k = 0;
+        }
+    }
+    err = ncmpi_inq_nreqs(ncid, &i); CHECK_ERR
+    if (i != 0) {
+        printf("Error at line %d in %s: expect no pending request but got %d\n",
+               __LINE__,__FILE__,i);
+        nerrs++;
+    }
+
+    /* read fix back with a stride permutation of the posting order */
+    for (i=0; i<NREQS; i++) buf[i] = -1;
+    for (i=0; i<NREQS; i++) {
+        start[0] = (MPI_Offset)rank * NREQS + i;
+        err = ncmpi_iget_var1_int(ncid, fix, start, &buf[i], &reqs[i]);
+        CHECK_ERR
+    }
+    for (i=0; i<NREQS; i++) wait_reqs[i] = reqs[(i * 37) % NREQS];
+    err = ncmpi_wait_all(ncid, NREQS, wait_reqs, sts); CHECK_ERR
+    for (i=0; i<NREQS; i++) {
+        int indx = FIX_INDEX(i), expect = rank * NREQS + i;
+        if (!dw_enabled && indx % 7 == 0 && indx >= FIX_ONLY)
+            expect = NC_FILL_INT;
+        if (sts[i] != NC_NOERR) {
+            printf("Error at line %d in %s: wait status[%d] = %d\n",
+                   __LINE__,__FILE__,i,sts[i]);
+            nerrs++;
+            break;
+        }
+        if (buf[i] != expect) {
+            printf("Error at line %d in %s: expect fix[%d]=%d but got %d\n",
+                   __LINE__,__FILE__,i,expect,buf[i]);
+            nerrs++;
+            break;
+        }
+    }
+
+    /* check rec and vn */
+    start[0] = 0;     start[1] = rank * NX;
+    count[0] = 1;     count[1] = NX;
+    for (i=0; i<NRECS; i++) {
+        start[0] = i;
+        err = ncmpi_get_vara_int_all(ncid, rec, start, count, recbuf[0]);
+        CHECK_ERR
+        for (j=0; j<NX; j++) {
+            int expect = rank * NX + j + (i % 2) * 1000;
+            if (recbuf[0][j] != expect) {
+                printf("Error at line %d in %s: expect rec[%d][%d]=%d but got %d\n",
+                       __LINE__,__FILE__,i,j,expect,recbuf[0][j]);
+                nerrs++;
+                break;
+            }
+        }
+    }
+    start[0] = (MPI_Offset)rank * NREQS;
+    count[0] = NVARN * 2;
+    err = ncmpi_get_vara_int_all(ncid, vn, start, count, ibuf); CHECK_ERR
+    for (i=0; i<NVARN*2; i++) {
+        if (ibuf[i] != -(rank * NREQS + i)) {
+            printf("Error at line %d in %s: expect vn[%d]=%d but got %d\n",
+                   __LINE__,__FILE__,i,-(rank * NREQS + i),ibuf[i]);
+            nerrs++;
+            break;
+        }
+    }
+
+    err = ncmpi_close(ncid); CHECK_ERR
+
+    free(starts[0]);
+    free(starts);
+    free(counts);
+    free(ibuf);
+    free(buf);
+    free(sts);
+    free(reqs);
+
+    /* check if PnetCDF freed all internal malloc */
+    MPI_Offset malloc_size, sum_size;
+    err = ncmpi_inq_malloc_size(&malloc_size);
+    if (err == NC_NOERR) {
+        MPI_Reduce(&malloc_size, &sum_size, 1, MPI_OFFSET, MPI_SUM, 0, MPI_COMM_WORLD);
+        if (rank == 0 && sum_size > 0)
+            printf("heap memory allocated by PnetCDF internally has %lld bytes yet to be freed\n",
+                   sum_size);
+    }
+
+    MPI_Allreduce(MPI_IN_PLACE, &nerrs, 1, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
+    if (rank == 0) {
+        if (nerrs) printf(FAIL_STR,nerrs);
+        else       printf(PASS_STR);
+    }
+
+    MPI_Finalize();
+    return (nerrs > 0);
+}
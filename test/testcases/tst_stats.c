@@ -0,0 +1,340 @@
+/*
+ *  Copyright (C) 2018, Northwestern University and Argonne National Laboratory
+ *  See COPYRIGHT notice in top-level directory.
+ *
+ *  $Id$
+ */
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *
+ * This program tests the I/O statistics enabled by hint nc_stats_file. Each
+ * process makes requests of vara, var1, vars, varn, and nonblocking APIs of
+ * known sizes, and checks the counts, bytes, and per-variable histograms
+ * returned by ncmpi_inq_stats() and ncmpi_inq_var_stats(). At file close, the
+ * statistics are dumped into a JSON file, which root checks for the expected
+ * keys. The statistics of a file opened without the hint must be all zeros.
+ *
+ * The compile and run commands are given below.
+ *
+ *    % mpicc -g -o tst_stats tst_stats.c -lpnetcdf
+ *
+ *    % mpiexec -l -n 4 ./tst_stats testfile.nc
+ *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h> /* strcasecmp() */
+#include <libgen.h> /* basename() */
+#include <mpi.h>
+#include <pnetcdf.h>
+
+#include <testutils.h>
+
+#define NY 4
+#define NX 10
+
+/* histogram bin of a request of nbytes, bin i covers [4^i, 4^(i+1)) */
+static int
+hist_bin(MPI_Offset nbytes)
+{
+    int bin=0;
+    while (nbytes >= 4 && bin < NC_STATS_HIST_BINS-1) {
+        nbytes >>= 2;
+        bin++;
+    }
+    return bin;
+}
+
+static int
+check_counts(const char       *name,
+             const MPI_Offset *got,
+             const MPI_Offset *expect)
+{
+    int i, nerrs=0;
+    for (i=0; i<NC_STATS_NUM_APIS; i++) {
+        if (got[i] != expect[i]) {
+            printf("Error at line %d in %s: %s[%d] expect %lld but got %lld\n",
+                   __LINE__,__FILE__,name,i,expect[i],got[i]);
+            nerrs++;
+        }
+    }
+    return nerrs;
+}
+
+static int
+check_hist(const char       *name,
+           const MPI_Offset *got,
+           const MPI_Offset *expect)
+{
+    int i, nerrs=0;
+    for (i=0; i<NC_STATS_HIST_BINS; i++) {
+        if (got[i] != expect[i]) {
+            printf("Error at line %d in %s: %s bin %d expect %lld but got %lld\n",
+                   __LINE__,__FILE__,name,i,expect[i],got[i]);
+            nerrs++;
+        }
+    }
+    return nerrs;
+}
+
+static int
+check_json(const char *path, int nprocs)
+{
+    const char *keys[] = {"\"apis\"", "\"vara\"", "\"varn\"", "\"vard\"",
+                          "\"timings\"", "\"mpiio\"", "\"enddef\"",
+                          "\"variables\"", "\"name\": \"v\"",
+                          "\"name\": \"w\"", "\"put_hist\"", "\"get_hist\""};
+    char *buf, expect[64];
+    int i, nkeys=sizeof(keys)/sizeof(keys[0]), nerrs=0;
+    long len;
+    FILE *fp;
+
+    fp = fopen(path, "r");
+    if (fp == NULL) {
+        printf("Error at line %d in %s: cannot open %s\n",__LINE__,__FILE__,path);
+        return 1;
+    }
+    fseek(fp, 0, SEEK_END);
+    len = ftell(fp);
+    rewind(fp);
+    buf = (char*) malloc(len + 1);
+    len = (long)fread(buf, 1, len, fp);
+    buf[len] = '\0';
+    fclose(fp);
+
+    for (i=0; i<nkeys; i++) {
+        if (strstr(buf, keys[i]) == NULL) {
+            printf("Error at line %d in %s: key %s not found in %s\n",
+                   __LINE__,__FILE__,keys[i],path);
+            nerrs++;
+        }
+    }
+    sprintf(expect, "\"nprocs\": %d", nprocs);
+    if (strstr(buf, expect) == NULL) {
+        printf("Error at line %d in %s: %s not found in %s\n",
+               __LINE__,__FILE__,expect,path);
+        nerrs++;
+    }
+    free(buf);
+    return nerrs;
+}
+
+int main(int argc, char** argv) {
+    char filename[256], json_file[512], value[MPI_MAX_INFO_VAL];
+    int i, err, nerrs=0, rank, nprocs, ncid, dimids[2], varid[2], flag, req;
+    int dw_enabled=0;
+    int buf[NY][NX];
+    double dval, timings[NC_STATS_NUM_TIMERS];
+    MPI_Offset start[2], count[2], stride[2], *starts[2], *counts[2];
+    MPI_Offset put_counts[NC_STATS_NUM_APIS], put_bytes[NC_STATS_NUM_APIS];
+    MPI_Offset get_counts[NC_STATS_NUM_APIS], get_bytes[NC_STATS_NUM_APIS];
+    MPI_Offset exp_counts[NC_STATS_NUM_APIS], exp_bytes[NC_STATS_NUM_APIS];
+    MPI_Offset put_hist[NC_STATS_HIST_BINS], get_hist[NC_STATS_HIST_BINS];
+    MPI_Offset exp_hist[NC_STATS_HIST_BINS];
+    MPI_Info info, info_used;
+
+    MPI_Init(&argc, &argv);
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &nprocs);
+
+    if (argc > 2) {
+        if (!rank) printf("Usage: %s [filename]\n",argv[0]);
+        MPI_Finalize();
+        return 1;
+    }
+    if (argc == 2) snprintf(filename, 256, "%s", argv[1]);
+    else           strcpy(filename, "testfile.nc");
+    MPI_Bcast(filename, 256, MPI_CHAR, 0, MPI_COMM_WORLD);
+    sprintf(json_file, "%s.json", filename);
+
+    if (rank == 0) {
+        char *cmd_str = (char*)malloc(strlen(argv[0]) + 256);
+        sprintf(cmd_str, "*** TESTING C   %s for I/O statistics ", basename(argv[0]));
+        printf("%-66s ------ ", cmd_str); fflush(stdout);
+        free(cmd_str);
+    }
+
+    MPI_Info_create(&info);
+    MPI_Info_set(info, "nc_stats_file", json_file);
+
+    err = ncmpi_create(MPI_COMM_WORLD, filename, NC_CLOBBER, info, &ncid);
+    CHECK_ERR
+    MPI_Info_free(&info);
+
+    /* setting nc_stats_file also enables nc_stats */
+    err = ncmpi_inq_file_info(ncid, &info_used); CHECK_ERR
+#ifdef BUILD_DRIVER_DW
+    /* the DataWarp driver logs the put requests, so the statistics of the
+     * underlying ncmpio driver count the replays of the log instead */
+    MPI_Info_get(info_used, "nc_dw", MPI_MAX_INFO_VAL-1, value, &flag);
+    if (flag && strcasecmp(value, "enable") == 0)
+        dw_enabled = 1;
+#endif
+    MPI_Info_get(info_used, "nc_stats", MPI_MAX_INFO_VAL-1, value, &flag);
+    if (!dw_enabled && (!flag || strcmp(value, "enable"))) {
+        printf("Error at line %d in %s: expect nc_stats enable but got %s\n",
+               __LINE__,__FILE__,(flag) ? value : "(not set)");
+        nerrs++;
+    }
+    MPI_Info_get(info_used, "nc_stats_file", MPI_MAX_INFO_VAL-1, value, &flag);
+    if (!dw_enabled && (!flag || strcmp(value, json_file))) {
+        printf("Error at line %d in %s: expect nc_stats_file %s but got %s\n",
+               __LINE__,__FILE__,json_file,(flag) ? value : "(not set)");
+        nerrs++;
+    }
+    MPI_Info_free(&info_used);
+
+    err = ncmpi_def_dim(ncid, "Y", nprocs * NY, &dimids[0]); CHECK_ERR
+    err = ncmpi_def_dim(ncid, "X", NX, &dimids[1]); CHECK_ERR
+    err = ncmpi_def_var(ncid, "v", NC_INT, 2, dimids, &varid[0]); CHECK_ERR
+    err = ncmpi_def_var(ncid, "w", NC_DOUBLE, 1, dimids+1, &varid[1]);
+    CHECK_ERR
+    err = ncmpi_enddef(ncid); CHECK_ERR
+
+    for (i=0; i<NY*NX; i++) buf[i/NX][i%NX] = rank * NY * NX + i;
+
+    /* vara: NY rows of NX ints */
+    start[0] = rank * NY; start[1] = 0;
+    count[0] = NY;        count[1] = NX;
+    err = ncmpi_put_vara_int_all(ncid, varid[0], start, count, &buf[0][0]);
+    CHECK_ERR
+
+    /* vars: every other column of NY rows */
+    stride[0] = 1; stride[1] = 2;
+    count[0]  = NY; count[1]  = NX / 2;
+    err = ncmpi_put_vars_int_all(ncid, varid[0], start, count, stride,
+                                 &buf[0][0]); CHECK_ERR
+
+    /* varn: the first two rows, counted as one request */
+    starts[0] = (MPI_Offset*) malloc(4 * sizeof(MPI_Offset));
+    starts[1] = starts[0] + 2;
+    counts[0] = (MPI_Offset*) malloc(4 * sizeof(MPI_Offset));
+    counts[1] = counts[0] + 2;
+    for (i=0; i<2; i++) {
+        starts[i][0] = rank * NY + i; starts[i][1] = 0;
+        counts[i][0] = 1;             counts[i][1] = NX;
+    }
+    err = ncmpi_put_varn_int_all(ncid, varid[0], 2, starts, counts,
+                                 &buf[0][0]); CHECK_ERR
+    free(starts[0]);
+    free(counts[0]);
+
+    /* nonblocking vara of one element, counted when posted */
+    start[0] = rank * NY; start[1] = 0;
+    count[0] = 1;         count[1] = 1;
+    err = ncmpi_iput_vara_int(ncid, varid[0], start, count, &buf[0][0], &req);
+    CHECK_ERR
+    err = ncmpi_wait_all(ncid, 1, &req, NULL); CHECK_ERR
+
+    /* var1 is counted as vara */
+    start[0] = rank % NX;
+    dval = rank;
+    err = ncmpi_put_var1_double_all(ncid, varid[1], start, &dval); CHECK_ERR
+
+    /* read back the NY rows */
+    start[0] = rank * NY; start[1] = 0;
+    count[0] = NY;        count[1] = NX;
+    err = ncmpi_get_vara_int_all(ncid, varid[0], start, count, &buf[0][0]);
+    CHECK_ERR
+
+    if (dw_enabled) goto fn_exit;
+
+    err = ncmpi_inq_stats(ncid, put_counts, put_bytes, get_counts, get_bytes,
+                          timings); CHECK_ERR
+
+    memset(exp_counts, 0, sizeof(exp_counts));
+    memset(exp_bytes,  0, sizeof(exp_bytes));
+    exp_counts[NC_STATS_VARA] = 3;
+    exp_bytes[NC_STATS_VARA]  = NY*NX*4 + 4 + 8;
+    exp_counts[NC_STATS_VARS] = 1;
+    exp_bytes[NC_STATS_VARS]  = NY*(NX/2)*4;
+    exp_counts[NC_STATS_VARN] = 1;
+    exp_bytes[NC_STATS_VARN]  = 2*NX*4;
+    nerrs += check_counts("put_counts", put_counts, exp_counts);
+    nerrs += check_counts("put_bytes",  put_bytes,  exp_bytes);
+
+    memset(exp_counts, 0, sizeof(exp_counts));
+    memset(exp_bytes,  0, sizeof(exp_bytes));
+    exp_counts[NC_STATS_VARA] = 1;
+    exp_bytes[NC_STATS_VARA]  = NY*NX*4;
+    nerrs += check_counts("get_counts", get_counts, exp_counts);
+    nerrs += check_counts("get_bytes",  get_bytes,  exp_bytes);
+
+    for (i=0; i<NC_STATS_NUM_TIMERS; i++) {
+        if (timings[i] < 0.0) {
+            printf("Error at line %d in %s: timings[%d] expect >= 0 but got %f\n",
+                   __LINE__,__FILE__,i,timings[i]);
+            nerrs++;
+        }
+    }
+    if (timings[NC_STATS_TIME_ENDDEF] <= 0.0) {
+        printf("Error at line %d in %s: enddef time expect > 0 but got %f\n",
+               __LINE__,__FILE__,timings[NC_STATS_TIME_ENDDEF]);
+        nerrs++;
+    }
+
+    /* histograms of request sizes */
+    err = ncmpi_inq_var_stats(ncid, varid[0], put_hist, get_hist); CHECK_ERR
+    memset(exp_hist, 0, sizeof(exp_hist));
+    exp_hist[hist_bin(NY*NX*4)]++;
+    exp_hist[hist_bin(NY*(NX/2)*4)]++;
+    exp_hist[hist_bin(2*NX*4)]++;
+    exp_hist[hist_bin(4)]++;
+    nerrs += check_hist("v put_hist", put_hist, exp_hist);
+    memset(exp_hist, 0, sizeof(exp_hist));
+    exp_hist[hist_bin(NY*NX*4)]++;
+    nerrs += check_hist("v get_hist", get_hist, exp_hist);
+
+    err = ncmpi_inq_var_stats(ncid, varid[1], put_hist, NULL); CHECK_ERR
+    memset(exp_hist, 0, sizeof(exp_hist));
+    exp_hist[hist_bin(8)]++;
+    nerrs += check_hist("w put_hist", put_hist, exp_hist);
+
+    err = ncmpi_inq_var_stats(ncid, 2, put_hist, get_hist);
+    EXP_ERR(NC_ENOTVAR)
+
+fn_exit:
+    err = ncmpi_close(ncid); CHECK_ERR
+
+    if (rank == 0 && !dw_enabled) nerrs += check_json(json_file, nprocs);
+
+    /* statistics are not collected without the hint */
+    err = ncmpi_open(MPI_COMM_WORLD, filename, NC_NOWRITE, MPI_INFO_NULL,
+                     &ncid); CHECK_ERR
+    err = ncmpi_get_vara_int_all(ncid, varid[0], start, count, &buf[0][0]);
+    CHECK_ERR
+    err = ncmpi_inq_stats(ncid, put_counts, put_bytes, get_counts, get_bytes,
+                          timings); CHECK_ERR
+    memset(exp_counts, 0, sizeof(exp_counts));
+    nerrs += check_counts("get_counts", get_counts, exp_counts);
+    nerrs += check_counts("get_bytes",  get_bytes,  exp_counts);
+    for (i=0; i<NC_STATS_NUM_TIMERS; i++) {
+        if (timings[i] != 0.0) {
+            printf("Error at line %d in %s: timings[%d] expect 0 but got %f\n",
+                   __LINE__,__FILE__,i,timings[i]);
+            nerrs++;
+        }
+    }
+    err = ncmpi_close(ncid); CHECK_ERR
+
+    /* check if PnetCDF freed all internal malloc */
+    MPI_Offset malloc_size, sum_size;
+    err = ncmpi_inq_malloc_size(&malloc_size);
+    if (err == NC_NOERR) {
+        MPI_Reduce(&malloc_size, &sum_size, 1, MPI_OFFSET, MPI_SUM, 0, MPI_COMM_WORLD);
+        if (rank == 0 && sum_size > 0)
+            printf("heap memory allocated by PnetCDF internally has %lld bytes yet to be freed\n",
+                   sum_size);
+    }
+
+    MPI_Allreduce(MPI_IN_PLACE, &nerrs, 1, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
+    if (rank == 0) {
+        if (nerrs) printf(FAIL_STR,nerrs);
+        else       printf(PASS_STR);
+    }
+
+    MPI_Finalize();
+    return (nerrs > 0);
+}
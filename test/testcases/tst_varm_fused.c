@@ -0,0 +1,266 @@
+/*
+ *  Copyright (C) 2018, Northwestern University and Argonne National Laboratory
+ *  See COPYRIGHT notice in top-level directory.
+ *
+ *  $Id$
+ */
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *
+ * This program tests put and get requests whose user buffers are both
+ * noncontiguous and in a type different from the variable's, so the packing,
+ * type conversion, and byte swap are done in a single pass. It covers a
+ * transposed imap, vector and subarray buftypes, a vector buftype combined
+ * with an imap, and NC_ERANGE returned for an out-of-range element.
+ * The data read back by contiguous requests is checked against the user
+ * buffers.
+ *
+ * The compile and run commands are given below.
+ *
+ *    % mpicc -g -o tst_varm_fused tst_varm_fused.c -lpnetcdf
+ *
+ *    % mpiexec -l -n 4 ./tst_varm_fused testfile.nc
+ *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h> /* strcasecmp() */
+#include <libgen.h> /* basename() */
+#include <mpi.h>
+#include <pnetcdf.h>
+
+#include <testutils.h>
+
+#define NY 30
+#define NX 200
+
+int main(int argc, char** argv) {
+    char filename[256];
+    int i, j, k, rank, nprocs, err, nerrs=0, ncid, dimids[2];
+    int vid_flt, vid_dbl, vid_sht, *ibuf, *irbuf, sizes[2], subsizes[2];
+    int starts[2];
+    short *sbuf;
+    float *fbuf;
+    double *dbuf, *drbuf, *dvals;
+    MPI_Offset start[2], count[2], imap[2];
+    MPI_Datatype vtype2, vtype3=MPI_DATATYPE_NULL, subtype;
+#ifdef BUILD_DRIVER_DW
+    int dw_enabled=0;
+#endif
+
+    MPI_Init(&argc, &argv);
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &nprocs);
+
+    if (argc > 2) {
+        if (!rank) printf("Usage: %s [filename]\n",argv[0]);
+        MPI_Finalize();
+        return 1;
+    }
+    if (argc == 2) snprintf(filename, 256, "%s", argv[1]);
+    else           strcpy(filename, "testfile.nc");
+    MPI_Bcast(filename, 256, MPI_CHAR, 0, MPI_COMM_WORLD);
+
+    if (rank == 0) {
+        char *cmd_str = (char*)malloc(strlen(argv[0]) + 256);
+        sprintf(cmd_str, "*** TESTING C   %s for fused pack and type conversion ", basename(argv[0]));
+        printf("%-66s ------ ", cmd_str); fflush(stdout);
+        free(cmd_str);
+    }
+
+    err = ncmpi_create(MPI_COMM_WORLD, filename, NC_CLOBBER, MPI_INFO_NULL,
+                       &ncid); CHECK_ERR
+
+#ifdef BUILD_DRIVER_DW
+    {
+        int flag;
+        char hint[MPI_MAX_INFO_VAL];
+        MPI_Info infoused;
+        ncmpi_inq_file_info(ncid, &infoused);
+        MPI_Info_get(infoused, "nc_dw", MPI_MAX_INFO_VAL - 1, hint, &flag);
+        if (flag && strcasecmp(hint, "enable") == 0)
+            dw_enabled = 1;
+        MPI_Info_free(&infoused);
+    }
+#endif
+
+    err = ncmpi_def_dim(ncid, "Y", NY*nprocs, &dimids[0]); CHECK_ERR
+    err = ncmpi_def_dim(ncid, "X", NX, &dimids[1]); CHECK_ERR
+    err = ncmpi_def_var(ncid, "flt", NC_FLOAT,  2, dimids, &vid_flt); CHECK_ERR
+    err = ncmpi_def_var(ncid, "dbl", NC_DOUBLE, 2, dimids, &vid_dbl); CHECK_ERR
+    err = ncmpi_def_var(ncid, "sht", NC_SHORT,  2, dimids, &vid_sht); CHECK_ERR
+    err = ncmpi_enddef(ncid); CHECK_ERR
+
+    dbuf  = (double*) malloc(sizeof(double) * NY * NX * 3);
+    drbuf = (double*) malloc(sizeof(double) * NY * NX * 3);
+    dvals = (double*) malloc(sizeof(double) * NY * NX);
+    fbuf  = (float*)  malloc(sizeof(float)  * NY * NX);
+    sbuf  = (short*)  malloc(sizeof(short)  * NY * NX);
+    ibuf  = (int*)    malloc(sizeof(int)    * NY * NX * 2);
+    irbuf = (int*)    malloc(sizeof(int)    * NY * NX * 2);
+
+    start[0] = NY * rank; start[1] = 0;
+    count[0] = NY;        count[1] = NX;
+
+    /* write a transposed double buffer to float and double variables */
+    imap[0] = 1; imap[1] = NY;
+    for (i=0; i<NY*NX; i++) dbuf[i] = rank * 1000.0 + i * 0.5;
+    err = ncmpi_put_varm_double_all(ncid, vid_flt, start, count, NULL, imap,
+                                    dbuf); CHECK_ERR
+    err = ncmpi_put_varm_double_all(ncid, vid_dbl, start, count, NULL, imap,
+                                    dbuf); CHECK_ERR
+
+    /* write every other int to a short variable, one element out of range */
+    MPI_Type_vector(NY*NX, 1, 2, MPI_INT, &vtype2);
+    MPI_Type_commit(&vtype2);
+    for (i=0; i<NY*NX*2; i++) ibuf[i] = (i % 3) ? -(i % 30000) : i % 30000;
+    ibuf[14] = 100000;
+#ifdef BUILD_DRIVER_DW
+    /* DataWarp driver reports NC_ERANGE only when its log is flushed */
+    if (dw_enabled) ibuf[14] = 10000;
+#endif
+    err = ncmpi_put_vara_all(ncid, vid_sht, start, count, ibuf, 1, vtype2);
+#ifdef BUILD_DRIVER_DW
+    if (dw_enabled) {
+        CHECK_ERR
+    }
+    else
+#endif
+    EXP_ERR(NC_ERANGE)
+
+    /* read back contiguously and check */
+    err = ncmpi_get_vara_float_all(ncid, vid_flt, start, count, fbuf); CHECK_ERR
+    err = ncmpi_get_vara_double_all(ncid, vid_dbl, start, count, drbuf); CHECK_ERR
+    err = ncmpi_get_vara_short_all(ncid, vid_sht, start, count, sbuf); CHECK_ERR
+    for (j=0; j<NY; j++) {
+        for (i=0; i<NX; i++) {
+            double expect = dbuf[i*NY+j];
+            short sexpect;
+            k = j*NX+i;
+            if (fbuf[k] != (float)expect || drbuf[k] != expect) {
+                printf("Error at line %d in %s: expect [%d][%d]=%f but got %f %f\n",
+                       __LINE__,__FILE__,j,i,expect,fbuf[k],drbuf[k]);
+                nerrs++;
+                goto err_out;
+            }
+            /* element 7 is out of range, its value depends on whether
+             * erange-fill is enabled at configure time */
+            sexpect = (short)ibuf[2*k];
+            if (k != 7 && sbuf[k] != sexpect) {
+                printf("Error at line %d in %s: expect sht[%d]=%d but got %d\n",
+                       __LINE__,__FILE__,k,sexpect,sbuf[k]);
+                nerrs++;
+                goto err_out;
+            }
+        }
+    }
+
+    /* read with the transposed imap */
+    memset(drbuf, 0, sizeof(double) * NY * NX);
+    err = ncmpi_get_varm_double_all(ncid, vid_flt, start, count, NULL, imap,
+                                    drbuf); CHECK_ERR
+    for (i=0; i<NY*NX; i++) {
+        if (drbuf[i] != (double)(float)dbuf[i]) {
+            printf("Error at line %d in %s: expect buf[%d]=%f but got %f\n",
+                   __LINE__,__FILE__,i,(double)(float)dbuf[i],drbuf[i]);
+            nerrs++;
+            goto err_out;
+        }
+    }
+
+    /* read with the vector buftype, gaps must be untouched */
+    for (i=0; i<NY*NX*2; i++) irbuf[i] = -1;
+    err = ncmpi_get_vara_all(ncid, vid_sht, start, count, irbuf, 1, vtype2);
+    CHECK_ERR
+    for (i=0; i<NY*NX; i++) {
+        if (irbuf[2*i] != sbuf[i] || irbuf[2*i+1] != -1) {
+            printf("Error at line %d in %s: expect buf[%d]=%d,-1 but got %d,%d\n",
+                   __LINE__,__FILE__,i,sbuf[i],irbuf[2*i],irbuf[2*i+1]);
+            nerrs++;
+            goto err_out;
+        }
+    }
+
+    /* a vector buftype combined with the transposed imap */
+    MPI_Type_vector(NY*NX, 1, 3, MPI_DOUBLE, &vtype3);
+    MPI_Type_commit(&vtype3);
+    for (i=0; i<NY*NX; i++) dbuf[3*i] = dvals[i] = rank * 1000.0 + i * 0.25;
+    err = ncmpi_put_varm_all(ncid, vid_flt, start, count, NULL, imap, dbuf, 1,
+                             vtype3); CHECK_ERR
+    for (i=0; i<NY*NX*3; i++) drbuf[i] = -1.0;
+    err = ncmpi_get_varm_all(ncid, vid_flt, start, count, NULL, imap, drbuf, 1,
+                             vtype3); CHECK_ERR
+    for (i=0; i<NY*NX; i++) {
+        if (drbuf[3*i] != (double)(float)dvals[i] || drbuf[3*i+1] != -1.0) {
+            printf("Error at line %d in %s: expect buf[%d]=%f,-1 but got %f,%f\n",
+                   __LINE__,__FILE__,i,dvals[i],drbuf[3*i],drbuf[3*i+1]);
+            nerrs++;
+            goto err_out;
+        }
+    }
+
+    /* a subarray buftype of a 10 x 10 double array */
+    sizes[0] = sizes[1] = 10;
+    subsizes[0] = 3; subsizes[1] = 4;
+    starts[0]   = 2; starts[1]   = 3;
+    MPI_Type_create_subarray(2, sizes, subsizes, starts, MPI_ORDER_C,
+                             MPI_DOUBLE, &subtype);
+    MPI_Type_commit(&subtype);
+    for (i=0; i<100; i++) dbuf[i] = i;
+    count[0] = 3; count[1] = 4;
+    err = ncmpi_put_vara_all(ncid, vid_sht, start, count, dbuf, 1, subtype);
+    CHECK_ERR
+    err = ncmpi_get_vara_float_all(ncid, vid_sht, start, count, fbuf); CHECK_ERR
+    for (j=0; j<3; j++) {
+        for (i=0; i<4; i++) {
+            if (fbuf[j*4+i] != (j+2)*10+i+3) {
+                printf("Error at line %d in %s: expect [%d][%d]=%d but got %f\n",
+                       __LINE__,__FILE__,j,i,(j+2)*10+i+3,fbuf[j*4+i]);
+                nerrs++;
+                goto err_out;
+            }
+        }
+    }
+    for (i=0; i<100; i++) drbuf[i] = -1.0;
+    err = ncmpi_get_vara_all(ncid, vid_sht, start, count, drbuf, 1, subtype);
+    CHECK_ERR
+    for (i=0; i<100; i++) {
+        int in_sub = (i/10 >= 2 && i/10 < 5 && i%10 >= 3 && i%10 < 7);
+        if (drbuf[i] != (in_sub ? dbuf[i] : -1.0)) {
+            printf("Error at line %d in %s: expect buf[%d]=%f but got %f\n",
+                   __LINE__,__FILE__,i,in_sub ? dbuf[i] : -1.0,drbuf[i]);
+            nerrs++;
+            goto err_out;
+        }
+    }
+    MPI_Type_free(&subtype);
+
+err_out:
+    MPI_Type_free(&vtype2);
+    if (vtype3 != MPI_DATATYPE_NULL) MPI_Type_free(&vtype3);
+    err = ncmpi_close(ncid); CHECK_ERR
+
+    free(dbuf); free(drbuf); free(dvals); free(fbuf); free(sbuf); free(ibuf);
+    free(irbuf);
+
+    /* check if PnetCDF freed all internal malloc */
+    MPI_Offset malloc_size, sum_size;
+    err = ncmpi_inq_malloc_size(&malloc_size);
+    if (err == NC_NOERR) {
+        MPI_Reduce(&malloc_size, &sum_size, 1, MPI_OFFSET, MPI_SUM, 0, MPI_COMM_WORLD);
+        if (rank == 0 && sum_size > 0)
+            printf("heap memory allocated by PnetCDF internally has %lld bytes yet to be freed\n",
+                   sum_size);
+    }
+
+    MPI_Allreduce(MPI_IN_PLACE, &nerrs, 1, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
+    if (rank == 0) {
+        if (nerrs) printf(FAIL_STR,nerrs);
+        else       printf(PASS_STR);
+    }
+
+    MPI_Finalize();
+    return (nerrs > 0);
+}
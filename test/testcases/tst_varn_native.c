@@ -0,0 +1,346 @@
+/*
+ *  Copyright (C) 2018, Northwestern University and Argonne National Laboratory
+ *  See COPYRIGHT notice in top-level directory.
+ *
+ *  $Id$
+ */
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *
+ * This program tests varn APIs, whose subarrays are posted as a single
+ * request. The subarrays of each call are in no particular order, include a
+ * zero-length one and, for the record variable, ones accessing more than one
+ * record. The subarrays written also overlap with each other. As the value
+ * written to an element depends only on its location, the contents are
+ * well-defined regardless of which subarray wins the overlapped elements.
+ * Blocking, nonblocking, buffered and type-converting varn APIs are tested,
+ * as well as cancelling a varn request.
+ *
+ * The compile and run commands are given below.
+ *
+ *    % mpicc -g -o tst_varn_native tst_varn_native.c -lpnetcdf
+ *
+ *    % mpiexec -l -n 4 ./tst_varn_native testfile.nc
+ *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h> /* strcasecmp() */
+#include <libgen.h> /* basename() */
+#include <mpi.h>
+#include <pnetcdf.h>
+
+#include <testutils.h>
+
+#define NY    2
+#define NX    10
+#define NRECS 3
+#define NSUB  5
+
+/* subarrays written to variables fix and bfix, relative to the rows of this
+ * rank */
+static MPI_Offset fix_start[NSUB][2] = {{1,5},{0,0},{0,2},{1,3},{0,9}};
+static MPI_Offset fix_count[NSUB][2] = {{1,5},{2,3},{1,6},{1,4},{0,1}};
+
+/* subarrays written to variable rec, relative to the columns of this rank */
+static MPI_Offset rec_start[NSUB][2] = {{1,4},{0,0},{1,5},{2,9},{2,0}};
+static MPI_Offset rec_count[NSUB][2] = {{2,3},{3,2},{1,3},{1,1},{1,0}};
+
+/* subarrays read, not overlapped */
+static MPI_Offset fix_rstart[NSUB][2] = {{1,0},{0,5},{0,0},{0,9},{1,0}};
+static MPI_Offset fix_rcount[NSUB][2] = {{1,10},{1,4},{1,5},{1,1},{0,10}};
+static MPI_Offset rec_rstart[NSUB][2] = {{1,0},{0,3},{0,0},{1,2},{0,0}};
+static MPI_Offset rec_rcount[NSUB][2] = {{2,2},{1,7},{1,3},{2,8},{2,0}};
+
+/* Fill buf with the values of the subarrays to be written, where the value of
+ * an element is base + its index in exp[ny][nx]. Compute in exp[][] the
+ * expected contents, with the elements not written set to fill. Return the
+ * number of elements in buf.
+ */
+static int
+expect_contents(MPI_Offset  start[NSUB][2],
+                MPI_Offset  count[NSUB][2],
+                int         base,
+                int         ny,
+                int         nx,
+                int         fill,
+                int        *exp,
+                int        *buf)
+{
+    int i, j, k, n=0;
+
+    for (i=0; i<ny*nx; i++) exp[i] = fill;
+    for (i=0; i<NSUB; i++) {
+        for (j=0; j<count[i][0]; j++) {
+            for (k=0; k<count[i][1]; k++) {
+                int idx = (int)(start[i][0] + j) * nx + (int)start[i][1] + k;
+                exp[idx] = base + idx;
+                buf[n++] = base + idx;
+            }
+        }
+    }
+    return n;
+}
+
+/* Check the values read by a varn call of subarrays start/count against
+ * exp[][nx]. Return the number of mismatches.
+ */
+static int
+check_varn(const char *name,
+           MPI_Offset  start[NSUB][2],
+           MPI_Offset  count[NSUB][2],
+           int         nx,
+           const int  *exp,
+           const float *buf,
+           int         line)
+{
+    int i, j, k, n=0;
+
+    for (i=0; i<NSUB; i++) {
+        for (j=0; j<count[i][0]; j++) {
+            for (k=0; k<count[i][1]; k++) {
+                int idx = (int)(start[i][0] + j) * nx + (int)start[i][1] + k;
+                if (buf[n] != (float)exp[idx]) {
+                    printf("Error at line %d in %s: expect %s subarray %d element %d = %d but got %f\n",
+                           line,__FILE__,name,i,j*(int)count[i][1]+k,exp[idx],buf[n]);
+                    return 1;
+                }
+                n++;
+            }
+        }
+    }
+    return 0;
+}
+
+/* Check the values read by a vara call against exp[]. */
+static int
+check_vara(const char *name,
+           int         len,
+           const int  *exp,
+           const int  *buf,
+           int         line)
+{
+    int i;
+    for (i=0; i<len; i++) {
+        if (buf[i] != exp[i]) {
+            printf("Error at line %d in %s: expect %s[%d]=%d but got %d\n",
+                   line,__FILE__,name,i,exp[i],buf[i]);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+int main(int argc, char** argv) {
+    char filename[256];
+    int i, err, nerrs=0, rank, nprocs, ncid, dimids[3], fix, bfix, rec;
+    int dw_enabled=0, nreqs, reqs[4], sts[4], nelems;
+    int exp_fix[NY*NX], exp_rec[NRECS*NX], ibuf[NRECS*NX*2];
+    short sbuf[NY*NX];
+    float fbuf[NRECS*NX];
+    double dbuf[NY*NX*2];
+    MPI_Offset start[2], count[2], numrecs;
+    MPI_Offset fs[NSUB][2], fc[NSUB][2], rs[NSUB][2], rc[NSUB][2];
+    MPI_Offset frs[NSUB][2], frc[NSUB][2], rrs[NSUB][2], rrc[NSUB][2];
+    MPI_Offset *fstarts[NSUB], *fcounts[NSUB], *rstarts[NSUB], *rcounts[NSUB];
+    MPI_Offset *frstarts[NSUB], *frcounts[NSUB];
+    MPI_Offset *rrstarts[NSUB], *rrcounts[NSUB];
+
+    MPI_Init(&argc, &argv);
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &nprocs);
+
+    if (argc > 2) {
+        if (!rank) printf("Usage: %s [filename]\n",argv[0]);
+        MPI_Finalize();
+        return 1;
+    }
+    if (argc == 2) snprintf(filename, 256, "%s", argv[1]);
+    else           strcpy(filename, "testfile.nc");
+    MPI_Bcast(filename, 256, MPI_CHAR, 0, MPI_COMM_WORLD);
+
+    if (rank == 0) {
+        char *cmd_str = (char*)malloc(strlen(argv[0]) + 256);
+        sprintf(cmd_str, "*** TESTING C   %s for native varn requests ", basename(argv[0]));
+        printf("%-66s ------ ", cmd_str); fflush(stdout);
+        free(cmd_str);
+    }
+
+    err = ncmpi_create(MPI_COMM_WORLD, filename, NC_CLOBBER, MPI_INFO_NULL,
+                       &ncid); CHECK_ERR
+
+#ifdef BUILD_DRIVER_DW
+    {
+        /* the DataWarp driver keeps cancelled write requests in its log */
+        char value[MPI_MAX_INFO_VAL];
+        int flag;
+        MPI_Info info_used;
+        err = ncmpi_inq_file_info(ncid, &info_used); CHECK_ERR
+        MPI_Info_get(info_used, "nc_dw", MPI_MAX_INFO_VAL-1, value, &flag);
+        if (flag && strcasecmp(value, "enable") == 0)
+            dw_enabled = 1;
+        MPI_Info_free(&info_used);
+    }
+#endif
+
+    err = ncmpi_def_dim(ncid, "time", NC_UNLIMITED, &dimids[0]); CHECK_ERR
+    err = ncmpi_def_dim(ncid, "Y", (MPI_Offset)nprocs * NY, &dimids[1]);
+    CHECK_ERR
+    err = ncmpi_def_dim(ncid, "X", NX, &dimids[2]); CHECK_ERR
+    err = ncmpi_def_var(ncid, "fix", NC_INT, 2, dimids+1, &fix); CHECK_ERR
+    err = ncmpi_def_var(ncid, "bfix", NC_SHORT, 2, dimids+1, &bfix); CHECK_ERR
+    err = ncmpi_def_dim(ncid, "Z", (MPI_Offset)nprocs * NX, &dimids[1]);
+    CHECK_ERR
+    err = ncmpi_def_var(ncid, "rec", NC_INT, 2, dimids, &rec); CHECK_ERR
+    /* elements not written by any subarray are left with fill values */
+    err = ncmpi_def_var_fill(ncid, fix, 0, NULL); CHECK_ERR
+    err = ncmpi_def_var_fill(ncid, bfix, 0, NULL); CHECK_ERR
+    err = ncmpi_def_var_fill(ncid, rec, 0, NULL); CHECK_ERR
+    err = ncmpi_enddef(ncid); CHECK_ERR
+
+    /* this rank writes rows [rank*NY, rank*NY+NY) of fix and bfix and
+     * columns [rank*NX, rank*NX+NX) of rec */
+    for (i=0; i<NSUB; i++) {
+        fs[i][0] = fix_start[i][0] + rank * NY;
+        fs[i][1] = fix_start[i][1];
+        fc[i][0] = fix_count[i][0];
+        fc[i][1] = fix_count[i][1];
+        rs[i][0] = rec_start[i][0];
+        rs[i][1] = rec_start[i][1] + rank * NX;
+        rc[i][0] = rec_count[i][0];
+        rc[i][1] = rec_count[i][1];
+        frs[i][0] = fix_rstart[i][0] + rank * NY;
+        frs[i][1] = fix_rstart[i][1];
+        frc[i][0] = fix_rcount[i][0];
+        frc[i][1] = fix_rcount[i][1];
+        rrs[i][0] = rec_rstart[i][0];
+        rrs[i][1] = rec_rstart[i][1] + rank * NX;
+        rrc[i][0] = rec_rcount[i][0];
+        rrc[i][1] = rec_rcount[i][1];
+        fstarts[i]  = fs[i];
+        fcounts[i]  = fc[i];
+        rstarts[i]  = rs[i];
+        rcounts[i]  = rc[i];
+        frstarts[i] = frs[i];
+        frcounts[i] = frc[i];
+        rrstarts[i] = rrs[i];
+        rrcounts[i] = rrc[i];
+    }
+
+    nelems = expect_contents(fix_start, fix_count, rank * 1000, NY, NX,
+                             NC_FILL_INT, exp_fix, ibuf);
+    for (i=0; i<nelems; i++) dbuf[i] = ibuf[i];
+
+    /* nonblocking varn write with type conversion from double to int */
+    err = ncmpi_iput_varn_double(ncid, fix, NSUB, fstarts, fcounts, dbuf,
+                                 &reqs[0]); CHECK_ERR
+
+    /* buffered varn write with type conversion from int to short */
+    err = ncmpi_buffer_attach(ncid, nelems * sizeof(short)); CHECK_ERR
+    err = ncmpi_bput_varn_int(ncid, bfix, NSUB, fstarts, fcounts, ibuf,
+                              &reqs[1]); CHECK_ERR
+
+    err = ncmpi_inq_nreqs(ncid, &nreqs); CHECK_ERR
+    if (nreqs != 2) {
+        printf("Error at line %d in %s: expect 2 pending requests but got %d\n",
+               __LINE__,__FILE__,nreqs);
+        nerrs++;
+    }
+    err = ncmpi_wait_all(ncid, 2, reqs, sts); CHECK_ERR
+    for (i=0; i<2; i++) {
+        err = sts[i]; CHECK_ERR
+    }
+    err = ncmpi_buffer_detach(ncid); CHECK_ERR
+
+    /* records of rec are not filled automatically */
+    for (i=0; i<NRECS; i++) {
+        err = ncmpi_fill_var_rec(ncid, rec, i); CHECK_ERR
+    }
+
+    /* blocking varn write to the record variable, the subarrays span more
+     * than one record */
+    expect_contents(rec_start, rec_count, -rank * 1000 - NRECS * NX, NRECS, NX,
+                    NC_FILL_INT, exp_rec, ibuf);
+    err = ncmpi_put_varn_int_all(ncid, rec, NSUB, rstarts, rcounts, ibuf);
+    CHECK_ERR
+
+    err = ncmpi_inq_dimlen(ncid, dimids[0], &numrecs); CHECK_ERR
+    if (numrecs != NRECS) {
+        printf("Error at line %d in %s: expect %d records but got %lld\n",
+               __LINE__,__FILE__,NRECS,numrecs);
+        nerrs++;
+    }
+
+    if (!dw_enabled) {
+        /* a cancelled varn request must not change the file */
+        for (i=0; i<nelems; i++) dbuf[i] = -1;
+        err = ncmpi_iput_varn_double(ncid, fix, NSUB, fstarts, fcounts, dbuf,
+                                     &reqs[0]); CHECK_ERR
+        err = ncmpi_cancel(ncid, 1, reqs, sts); CHECK_ERR
+        err = ncmpi_inq_nreqs(ncid, &nreqs); CHECK_ERR
+        if (nreqs != 0) {
+            printf("Error at line %d in %s: expect no pending request but got %d\n",
+                   __LINE__,__FILE__,nreqs);
+            nerrs++;
+        }
+    }
+
+    /* read back with varn reads and type conversion from int to float */
+    for (i=0; i<NRECS*NX; i++) fbuf[i] = 0;
+    err = ncmpi_iget_varn_float(ncid, fix, NSUB, frstarts, frcounts, fbuf,
+                                &reqs[0]); CHECK_ERR
+    err = ncmpi_wait_all(ncid, 1, reqs, sts); CHECK_ERR
+    nerrs += check_varn("fix", fix_rstart, fix_rcount, NX, exp_fix, fbuf,
+                        __LINE__);
+
+    for (i=0; i<NRECS*NX; i++) fbuf[i] = 0;
+    err = ncmpi_get_varn_float_all(ncid, rec, NSUB, rrstarts, rrcounts, fbuf);
+    CHECK_ERR
+    nerrs += check_varn("rec", rec_rstart, rec_rcount, NX, exp_rec, fbuf,
+                        __LINE__);
+
+    /* check the whole contents written by this rank */
+    start[0] = rank * NY;  start[1] = 0;
+    count[0] = NY;         count[1] = NX;
+    err = ncmpi_get_vara_int_all(ncid, fix, start, count, ibuf); CHECK_ERR
+    nerrs += check_vara("fix", NY*NX, exp_fix, ibuf, __LINE__);
+
+    err = ncmpi_get_vara_short_all(ncid, bfix, start, count, sbuf); CHECK_ERR
+    for (i=0; i<NY*NX; i++) {
+        int exp = (exp_fix[i] == NC_FILL_INT) ? NC_FILL_SHORT : exp_fix[i];
+        if (sbuf[i] != exp) {
+            printf("Error at line %d in %s: expect bfix[%d]=%d but got %d\n",
+                   __LINE__,__FILE__,i,exp,sbuf[i]);
+            nerrs++;
+            break;
+        }
+    }
+
+    start[0] = 0;      start[1] = rank * NX;
+    count[0] = NRECS;  count[1] = NX;
+    err = ncmpi_get_vara_int_all(ncid, rec, start, count, ibuf); CHECK_ERR
+    nerrs += check_vara("rec", NRECS*NX, exp_rec, ibuf, __LINE__);
+
+    err = ncmpi_close(ncid); CHECK_ERR
+
+    /* check if PnetCDF freed all internal malloc */
+    MPI_Offset malloc_size, sum_size;
+    err = ncmpi_inq_malloc_size(&malloc_size);
+    if (err == NC_NOERR) {
+        MPI_Reduce(&malloc_size, &sum_size, 1, MPI_OFFSET, MPI_SUM, 0, MPI_COMM_WORLD);
+        if (rank == 0 && sum_size > 0)
+            printf("heap memory allocated by PnetCDF internally has %lld bytes yet to be freed\n",
+                   sum_size);
+    }
+
+    MPI_Allreduce(MPI_IN_PLACE, &nerrs, 1, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
+    if (rank == 0) {
+        if (nerrs) printf(FAIL_STR,nerrs);
+        else       printf(PASS_STR);
+    }
+
+    MPI_Finalize();
+    return (nerrs > 0);
+}
@@ -0,0 +1,285 @@
+/*
+ *  Copyright (C) 2018, Northwestern University and Argonne National Laboratory
+ *  See COPYRIGHT notice in top-level directory.
+ *
+ *  $Id$
+ */
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *
+ * This program tests the split-phase wait APIs, ncmpi_wait_start(),
+ * ncmpi_wait_test(), and ncmpi_wait_end(). Nonblocking writes and reads of a
+ * fixed-size and a record variable are waited in split phases, with process
+ * 0 having no request in some of them. While a wait is pending, APIs
+ * accessing the file must return NC_EPENDING, but new nonblocking requests
+ * can still be posted, and the buffer attached for bput requests cannot be
+ * detached. Closing a file with a pending wait completes it and returns
+ * NC_EPENDING.
+ *
+ * The compile and run commands are given below.
+ *
+ *    % mpicc -g -o tst_wait_split tst_wait_split.c -lpnetcdf
+ *
+ *    % mpiexec -l -n 4 ./tst_wait_split testfile.nc
+ *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h> /* strcasecmp() */
+#include <libgen.h> /* basename() */
+#include <mpi.h>
+#include <pnetcdf.h>
+
+#include <testutils.h>
+
+#define NX 8
+#define NTESTS 1000
+
+/* wait for the split-phase wait to complete by polling it, as a program
+ * would do between its computation phases */
+static int
+poll_wait(int ncid)
+{
+    int i, err, nerrs=0, flag=0;
+
+    for (i=0; i<NTESTS && !flag; i++) {
+        err = ncmpi_wait_test(ncid, &flag); CHECK_ERR
+    }
+    err = ncmpi_wait_end(ncid); CHECK_ERR
+    return nerrs;
+}
+
+static int
+check_buf(const int *buf, int base, int line)
+{
+    int i;
+    for (i=0; i<NX; i++) {
+        if (buf[i] != base + i) {
+            printf("Error at line %d in %s: expect buf[%d]=%d but got %d\n",
+                   line,__FILE__,i,base+i,buf[i]);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+int main(int argc, char** argv) {
+    char filename[256];
+    int i, err, nerrs=0, rank, nprocs, ncid, dimids[3], fix, rec, flag;
+    int dw_enabled=0, req[3], st[3], wbuf[3][NX], rbuf[3][NX];
+    MPI_Offset start[3], count[3], numrecs;
+
+    MPI_Init(&argc, &argv);
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &nprocs);
+
+    if (argc > 2) {
+        if (!rank) printf("Usage: %s [filename]\n",argv[0]);
+        MPI_Finalize();
+        return 1;
+    }
+    if (argc == 2) snprintf(filename, 256, "%s", argv[1]);
+    else           strcpy(filename, "testfile.nc");
+    MPI_Bcast(filename, 256, MPI_CHAR, 0, MPI_COMM_WORLD);
+
+    if (rank == 0) {
+        char *cmd_str = (char*)malloc(strlen(argv[0]) + 256);
+        sprintf(cmd_str, "*** TESTING C   %s for split-phase wait ", basename(argv[0]));
+        printf("%-66s ------ ", cmd_str); fflush(stdout);
+        free(cmd_str);
+    }
+
+    err = ncmpi_create(MPI_COMM_WORLD, filename, NC_CLOBBER, MPI_INFO_NULL,
+                       &ncid); CHECK_ERR
+
+#ifdef BUILD_DRIVER_DW
+    {
+        /* the DataWarp driver carries out the wait at its start, and its
+         * APIs do not check for a pending wait */
+        char value[MPI_MAX_INFO_VAL];
+        MPI_Info info_used;
+        err = ncmpi_inq_file_info(ncid, &info_used); CHECK_ERR
+        MPI_Info_get(info_used, "nc_dw", MPI_MAX_INFO_VAL-1, value, &flag);
+        if (flag && strcasecmp(value, "enable") == 0)
+            dw_enabled = 1;
+        MPI_Info_free(&info_used);
+    }
+#endif
+
+    err = ncmpi_def_dim(ncid, "time", NC_UNLIMITED, &dimids[0]); CHECK_ERR
+    err = ncmpi_def_dim(ncid, "Y", nprocs, &dimids[1]); CHECK_ERR
+    err = ncmpi_def_dim(ncid, "X", NX, &dimids[2]); CHECK_ERR
+    err = ncmpi_def_var(ncid, "fix", NC_INT, 2, dimids+1, &fix); CHECK_ERR
+    err = ncmpi_def_var(ncid, "rec", NC_INT, 3, dimids, &rec); CHECK_ERR
+    err = ncmpi_enddef(ncid); CHECK_ERR
+
+    /* no split-phase wait has been started */
+    err = ncmpi_wait_test(ncid, &flag);
+    if (!dw_enabled) EXP_ERR(NC_EINVAL_REQUEST)
+    err = ncmpi_wait_end(ncid);
+    if (!dw_enabled) EXP_ERR(NC_EINVAL_REQUEST)
+
+    for (i=0; i<3; i++) {
+        int j;
+        for (j=0; j<NX; j++) wbuf[i][j] = rank * 100 + i * 10 + j;
+    }
+
+    /* write fix and records 0 and 1 of rec */
+    start[0] = rank; start[1] = 0;
+    count[0] = 1;    count[1] = NX;
+    err = ncmpi_iput_vara_int(ncid, fix, start, count, wbuf[0], &req[0]);
+    CHECK_ERR
+    start[0] = 0; start[1] = rank; start[2] = 0;
+    count[0] = 1; count[1] = 1;    count[2] = NX;
+    err = ncmpi_iput_vara_int(ncid, rec, start, count, wbuf[1], &req[1]);
+    CHECK_ERR
+    start[0] = 1;
+    err = ncmpi_iput_vara_int(ncid, rec, start, count, wbuf[2], &req[2]);
+    CHECK_ERR
+
+    for (i=0; i<3; i++) st[i] = -1;
+    err = ncmpi_wait_start(ncid, 3, req, st); CHECK_ERR
+
+    if (!dw_enabled) {
+        /* file access is not allowed while the wait is pending */
+        err = ncmpi_wait_start(ncid, NC_REQ_ALL, NULL, NULL);
+        EXP_ERR(NC_EPENDING)
+        err = ncmpi_wait_all(ncid, NC_REQ_ALL, NULL, NULL);
+        EXP_ERR(NC_EPENDING)
+        err = ncmpi_get_vara_int_all(ncid, fix, start+1, count+1, rbuf[0]);
+        EXP_ERR(NC_EPENDING)
+        err = ncmpi_begin_indep_data(ncid);
+        EXP_ERR(NC_EPENDING)
+        err = ncmpi_redef(ncid);
+        EXP_ERR(NC_EPENDING)
+        err = ncmpi_sync(ncid);
+        EXP_ERR(NC_EPENDING)
+    }
+
+    /* posting a new nonblocking request is allowed, write record 2 */
+    start[0] = 2;
+    err = ncmpi_iput_vara_int(ncid, rec, start, count, wbuf[0], &req[0]);
+    CHECK_ERR
+
+    nerrs += poll_wait(ncid);
+    for (i=1; i<3; i++) {
+        if (st[i] != NC_NOERR) {
+            printf("Error at line %d in %s: expect st[%d] NC_NOERR but got %d\n",
+                   __LINE__,__FILE__,i,st[i]);
+            nerrs++;
+        }
+    }
+    if (req[1] != NC_REQ_NULL || req[2] != NC_REQ_NULL) {
+        printf("Error at line %d in %s: request IDs not set to NC_REQ_NULL\n",
+               __LINE__,__FILE__);
+        nerrs++;
+    }
+
+    /* numrecs is updated once the wait ends. The DataWarp driver updates it
+     * when a request is posted. */
+    err = ncmpi_inq_dimlen(ncid, dimids[0], &numrecs); CHECK_ERR
+    if (!dw_enabled && numrecs != 2) {
+        printf("Error at line %d in %s: expect numrecs 2 but got %lld\n",
+               __LINE__,__FILE__,numrecs);
+        nerrs++;
+    }
+
+    /* complete the write of record 2, with process 0 having no request. The
+     * DataWarp driver flushes its log only on processes with pending puts,
+     * so all processes keep their requests. */
+    if (rank == 0 && !dw_enabled) {
+        err = ncmpi_cancel(ncid, 1, &req[0], st); CHECK_ERR
+    }
+    err = ncmpi_wait_start(ncid, NC_REQ_ALL, NULL, NULL); CHECK_ERR
+    err = ncmpi_wait_end(ncid); CHECK_ERR
+
+    err = ncmpi_inq_dimlen(ncid, dimids[0], &numrecs); CHECK_ERR
+    if (!dw_enabled && numrecs != ((nprocs > 1) ? 3 : 2)) {
+        printf("Error at line %d in %s: expect numrecs %d but got %lld\n",
+               __LINE__,__FILE__,(nprocs > 1) ? 3 : 2,numrecs);
+        nerrs++;
+    }
+
+    /* read back, together with a write of record 3 in the same wait */
+    memset(rbuf, 0, sizeof(rbuf));
+    start[0] = rank; start[1] = 0;
+    count[0] = 1;    count[1] = NX;
+    err = ncmpi_iget_vara_int(ncid, fix, start, count, rbuf[0], &req[0]);
+    CHECK_ERR
+    start[0] = 1; start[1] = rank; start[2] = 0;
+    count[0] = 1; count[1] = 1;    count[2] = NX;
+    err = ncmpi_iget_vara_int(ncid, rec, start, count, rbuf[1], &req[1]);
+    CHECK_ERR
+    start[0] = 3;
+    err = ncmpi_iput_vara_int(ncid, rec, start, count, wbuf[1], &req[2]);
+    CHECK_ERR
+    err = ncmpi_wait_start(ncid, 3, req, st); CHECK_ERR
+    nerrs += poll_wait(ncid);
+    nerrs += check_buf(rbuf[0], rank * 100, __LINE__);
+    nerrs += check_buf(rbuf[1], rank * 100 + 20, __LINE__);
+
+    /* read with process 0 having no request */
+    memset(rbuf, 0, sizeof(rbuf));
+    if (rank > 0) {
+        start[0] = 3;
+        err = ncmpi_iget_vara_int(ncid, rec, start, count, rbuf[0], &req[0]);
+        CHECK_ERR
+    }
+    err = ncmpi_wait_start(ncid, NC_GET_REQ_ALL, NULL, NULL); CHECK_ERR
+    err = ncmpi_wait_end(ncid); CHECK_ERR
+    if (rank > 0) nerrs += check_buf(rbuf[0], rank * 100 + 10, __LINE__);
+
+    /* the attached buffer cannot be detached while a bput is being waited */
+    err = ncmpi_buffer_attach(ncid, NX*sizeof(int)); CHECK_ERR
+    start[0] = 4;
+    err = ncmpi_bput_vara_int(ncid, rec, start, count, wbuf[2], &req[0]);
+    CHECK_ERR
+    err = ncmpi_wait_start(ncid, 1, req, st); CHECK_ERR
+    if (!dw_enabled) {
+        err = ncmpi_buffer_detach(ncid);
+        EXP_ERR(NC_EPENDING)
+    }
+    err = ncmpi_wait_end(ncid); CHECK_ERR
+    err = ncmpi_buffer_detach(ncid); CHECK_ERR
+
+    /* close completes a pending wait */
+    start[0] = 4;
+    err = ncmpi_iput_vara_int(ncid, rec, start, count, wbuf[2], &req[0]);
+    CHECK_ERR
+    err = ncmpi_wait_start(ncid, NC_REQ_ALL, NULL, NULL); CHECK_ERR
+    err = ncmpi_close(ncid);
+    if (!dw_enabled) EXP_ERR(NC_EPENDING)
+
+    err = ncmpi_open(MPI_COMM_WORLD, filename, NC_NOWRITE, MPI_INFO_NULL,
+                     &ncid); CHECK_ERR
+    err = ncmpi_inq_dimlen(ncid, dimids[0], &numrecs); CHECK_ERR
+    if (numrecs != 5) {
+        printf("Error at line %d in %s: expect numrecs 5 but got %lld\n",
+               __LINE__,__FILE__,numrecs);
+        nerrs++;
+    }
+    err = ncmpi_get_vara_int_all(ncid, rec, start, count, rbuf[0]); CHECK_ERR
+    nerrs += check_buf(rbuf[0], rank * 100 + 20, __LINE__);
+    err = ncmpi_close(ncid); CHECK_ERR
+
+    /* check if PnetCDF freed all internal malloc */
+    MPI_Offset malloc_size, sum_size;
+    err = ncmpi_inq_malloc_size(&malloc_size);
+    if (err == NC_NOERR) {
+        MPI_Reduce(&malloc_size, &sum_size, 1, MPI_OFFSET, MPI_SUM, 0, MPI_COMM_WORLD);
+        if (rank == 0 && sum_size > 0)
+            printf("heap memory allocated by PnetCDF internally has %lld bytes yet to be freed\n",
+                   sum_size);
+    }
+
+    MPI_Allreduce(MPI_IN_PLACE, &nerrs, 1, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
+    if (rank == 0) {
+        if (nerrs) printf(FAIL_STR,nerrs);
+        else       printf(PASS_STR);
+    }
+
+    MPI_Finalize();
+    return (nerrs > 0);
+}